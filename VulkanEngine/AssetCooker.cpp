@@ -0,0 +1,960 @@
+#include "AssetPack.h"
+#include "MeshFormat.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Offline tool that turns source assets into an AssetPack. Meshes come from Wavefront OBJ
+// files (positions, texture coordinates, normals, polygons), textures from binary PPM images.
+// Meshes are reordered for the vertex cache and overdraw, quantized and optionally split into
+// meshlets; texture mip chains are built with a box filter and optionally compressed to BC1.
+// The engine never decodes, resamples or optimizes anything at load time.
+
+// FIFO size the ACMR is reported for
+constexpr uint32_t REPORT_CACHE_SIZE = 16;
+
+struct CookerOptions
+{
+    std::string                 outputPath;
+    TextureFormat               format      = TextureFormat::Rgba8;
+    VertexFormat                vertexFormat = VertexFormat::Quantized;
+    bool                        optimize    = true;
+    bool                        meshlets    = false;
+    float                       overdrawThreshold = 1.05f;     // ACMR the overdraw order may cost
+    std::vector<std::string>    inputs;
+};
+
+// An asset ready to be written, its blob laid out already
+struct CookedAsset
+{
+    std::string             name;
+    PackEntry               entry;
+    std::vector<PackMip>    mips;
+    std::vector<uint8_t>    blob;
+
+    // Mesh report
+    float                   acmrBefore      = 0.0f;
+    float                   acmrAfter       = 0.0f;
+    uint64_t                floatBytes      = 0;        // of the vertices with all attributes as floats
+    float                   positionError   = 0.0f;     // largest quantization error of a coordinate
+};
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void PrintUsage(const char* executable)
+{
+    std::cout << "Usage: " << executable << " [options] <output.pack> <inputs...>\n"
+        << "\t--format <rgba8|bc1>   Texture format (default rgba8)\n"
+        << "\t--vertex-format <float|quantized> Mesh vertex format (default quantized)\n"
+        << "\t--meshlets             Split meshes into meshlets with bounding spheres and normal cones\n"
+        << "\t--no-optimize          Keep the triangle order of the source\n"
+        << "\t--overdraw-threshold <f> ACMR the overdraw order may add, as a factor (default 1.05)\n"
+        << "Inputs are .obj meshes and binary .ppm (P6) textures, named by their file name without extension.\n";
+}
+
+static bool ParseArguments(int argc, char* argv[], CookerOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (std::strcmp(arg, "--format") == 0 && hasValue)
+        {
+            const char* format = argv[++i];
+            if (std::strcmp(format, "rgba8") == 0)
+            {
+                options.format = TextureFormat::Rgba8;
+            }
+            else if (std::strcmp(format, "bc1") == 0)
+            {
+                options.format = TextureFormat::Bc1;
+            }
+            else
+            {
+                std::cerr << "Unknown texture format: " << format << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--vertex-format") == 0 && hasValue)
+        {
+            const char* format = argv[++i];
+            if (std::strcmp(format, "float") == 0)
+            {
+                options.vertexFormat = VertexFormat::Float;
+            }
+            else if (std::strcmp(format, "quantized") == 0)
+            {
+                options.vertexFormat = VertexFormat::Quantized;
+            }
+            else
+            {
+                std::cerr << "Unknown vertex format: " << format << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--meshlets") == 0)
+        {
+            options.meshlets = true;
+        }
+        else if (std::strcmp(arg, "--no-optimize") == 0)
+        {
+            options.optimize = false;
+        }
+        else if (std::strcmp(arg, "--overdraw-threshold") == 0 && hasValue)
+        {
+            options.overdrawThreshold = std::strtof(argv[++i], nullptr);
+            if (!(options.overdrawThreshold >= 1.0f && options.overdrawThreshold <= 3.0f))
+            {
+                std::cerr << "Invalid overdraw threshold: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg[0] == '-' && arg[1] == '-')
+        {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+        else if (options.outputPath.empty())
+        {
+            options.outputPath = arg;
+        }
+        else
+        {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    return !options.outputPath.empty() && !options.inputs.empty();
+}
+
+static std::string GetAssetName(const std::string& path)
+{
+    size_t start = path.find_last_of("/\\");
+    start = (start == std::string::npos) ? 0 : start + 1;
+    size_t end = path.find_last_of('.');
+    if (end == std::string::npos || end < start)
+    {
+        end = path.size();
+    }
+    return path.substr(start, end - start);
+}
+
+static std::string GetExtension(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? std::string() : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+// OBJ indices are 1-based, negative ones count back from the last element
+static int32_t ResolveObjIndex(long index, size_t count)
+{
+    long resolved = index < 0 ? static_cast<long>(count) + index : index - 1;
+    if (resolved < 0 || resolved >= static_cast<long>(count))
+    {
+        throw std::runtime_error("OBJ index out of range!");
+    }
+    return static_cast<int32_t>(resolved);
+}
+
+// A vertex as it comes out of the OBJ file, before it is encoded in the pack's vertex format
+struct SourceVertex
+{
+    float       position[3]     = {};
+    float       normal[3]       = {};
+    float       tangent[4]      = {};   // w is the bitangent sign
+    float       uv[2]           = {};
+};
+
+struct SourceMesh
+{
+    std::vector<SourceVertex>   vertices;
+    std::vector<uint32_t>       indices;
+    bool                        hasUvs      = false;
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const std::array<int32_t, 3>& corner) const
+    {
+        return (static_cast<size_t>(corner[0]) * 73856093u) ^ (static_cast<size_t>(corner[1]) * 19349663u)
+            ^ (static_cast<size_t>(corner[2]) * 83492791u);
+    }
+};
+
+static void Normalize(float v[3])
+{
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        v[axis] = length > 0.0f ? v[axis] / length : 0.0f;
+    }
+}
+
+// Polygons are triangulated as fans and vertices deduplicated by their position, texture
+// coordinate and normal indices. Vertices without a normal get the area weighted average of
+// the faces around their position.
+static SourceMesh LoadObj(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+
+    SourceMesh mesh;
+    std::vector<float> positions;
+    std::vector<float> uvs;
+    std::vector<float> normals;
+    std::vector<int32_t> vertexPositions;      // position index of each vertex
+    std::vector<bool> vertexHasNormal;
+    std::unordered_map<std::array<int32_t, 3>, uint32_t, ObjCornerHash> vertexLookup;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+
+        if (keyword == "v" || keyword == "vn")
+        {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            std::vector<float>& target = (keyword == "v") ? positions : normals;
+            target.insert(target.end(), { x, y, z });
+        }
+        else if (keyword == "vt")
+        {
+            // OBJ has the origin at the bottom left, Vulkan samples from the top left
+            float u = 0.0f, v = 0.0f;
+            stream >> u >> v;
+            uvs.insert(uvs.end(), { u, 1.0f - v });
+        }
+        else if (keyword == "f")
+        {
+            std::vector<uint32_t> polygon;
+            std::string corner;
+            while (stream >> corner)
+            {
+                // v, v/vt, v//vn or v/vt/vn
+                const long position = std::strtol(corner.c_str(), nullptr, 10);
+                long uv = 0;
+                long normal = 0;
+                const size_t firstSlash = corner.find('/');
+                const size_t secondSlash = firstSlash == std::string::npos ? std::string::npos : corner.find('/', firstSlash + 1);
+                if (firstSlash != std::string::npos)
+                {
+                    uv = std::strtol(corner.c_str() + firstSlash + 1, nullptr, 10);
+                }
+                if (secondSlash != std::string::npos)
+                {
+                    normal = std::strtol(corner.c_str() + secondSlash + 1, nullptr, 10);
+                }
+
+                const int32_t p = ResolveObjIndex(position, positions.size() / 3);
+                const int32_t t = uv != 0 ? ResolveObjIndex(uv, uvs.size() / 2) : -1;
+                const int32_t n = normal != 0 ? ResolveObjIndex(normal, normals.size() / 3) : -1;
+
+                auto found = vertexLookup.find({ p, t, n });
+                if (found == vertexLookup.end())
+                {
+                    found = vertexLookup.emplace(std::array<int32_t, 3>{ p, t, n }, static_cast<uint32_t>(mesh.vertices.size())).first;
+                    SourceVertex vertex;
+                    std::copy(&positions[p * 3], &positions[p * 3] + 3, vertex.position);
+                    if (n >= 0)
+                    {
+                        std::copy(&normals[n * 3], &normals[n * 3] + 3, vertex.normal);
+                        Normalize(vertex.normal);
+                    }
+                    if (t >= 0)
+                    {
+                        std::copy(&uvs[t * 2], &uvs[t * 2] + 2, vertex.uv);
+                        mesh.hasUvs = true;
+                    }
+                    mesh.vertices.push_back(vertex);
+                    vertexPositions.push_back(p);
+                    vertexHasNormal.push_back(n >= 0);
+                }
+                polygon.push_back(found->second);
+            }
+
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                mesh.indices.insert(mesh.indices.end(), { polygon[0], polygon[i - 1], polygon[i] });
+            }
+        }
+    }
+
+    if (mesh.indices.empty())
+    {
+        throw std::runtime_error(path + " has no faces!");
+    }
+
+    // Unnormalized cross products weigh each face by its area
+    std::vector<float> faceNormals(positions.size(), 0.0f);
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        const float* a = mesh.vertices[mesh.indices[i]].position;
+        const float* b = mesh.vertices[mesh.indices[i + 1]].position;
+        const float* c = mesh.vertices[mesh.indices[i + 2]].position;
+        const float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        const float cross[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+        for (size_t corner = 0; corner < 3; corner++)
+        {
+            const int32_t p = vertexPositions[mesh.indices[i + corner]];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                faceNormals[p * 3 + axis] += cross[axis];
+            }
+        }
+    }
+    for (size_t v = 0; v < mesh.vertices.size(); v++)
+    {
+        if (vertexHasNormal[v])
+        {
+            continue;
+        }
+        float* normal = mesh.vertices[v].normal;
+        std::copy(&faceNormals[vertexPositions[v] * 3], &faceNormals[vertexPositions[v] * 3] + 3, normal);
+        Normalize(normal);
+        if (normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f)
+        {
+            normal[1] = 1.0f;
+        }
+    }
+    return mesh;
+}
+
+// Tangents follow the texture's u direction (Lengyel's method), orthogonalized against the
+// normal; w says whether the v direction is the normal cross the tangent or its opposite.
+// Without texture coordinates, or where they are degenerate, any tangent will do.
+static void ComputeTangents(SourceMesh& mesh)
+{
+    std::vector<float> uDirections(mesh.vertices.size() * 3, 0.0f);
+    std::vector<float> vDirections(mesh.vertices.size() * 3, 0.0f);
+    if (mesh.hasUvs)
+    {
+        for (size_t i = 0; i < mesh.indices.size(); i += 3)
+        {
+            const SourceVertex& a = mesh.vertices[mesh.indices[i]];
+            const SourceVertex& b = mesh.vertices[mesh.indices[i + 1]];
+            const SourceVertex& c = mesh.vertices[mesh.indices[i + 2]];
+            const float e0[3] = { b.position[0] - a.position[0], b.position[1] - a.position[1], b.position[2] - a.position[2] };
+            const float e1[3] = { c.position[0] - a.position[0], c.position[1] - a.position[1], c.position[2] - a.position[2] };
+            const float du0 = b.uv[0] - a.uv[0], dv0 = b.uv[1] - a.uv[1];
+            const float du1 = c.uv[0] - a.uv[0], dv1 = c.uv[1] - a.uv[1];
+            const float determinant = du0 * dv1 - du1 * dv0;
+            if (std::fabs(determinant) < 1e-12f)
+            {
+                continue;
+            }
+            const float r = 1.0f / determinant;
+            for (size_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t v = mesh.indices[i + corner];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    uDirections[v * 3 + axis] += (e0[axis] * dv1 - e1[axis] * dv0) * r;
+                    vDirections[v * 3 + axis] += (e1[axis] * du0 - e0[axis] * du1) * r;
+                }
+            }
+        }
+    }
+
+    for (size_t v = 0; v < mesh.vertices.size(); v++)
+    {
+        SourceVertex& vertex = mesh.vertices[v];
+        const float* n = vertex.normal;
+        const float* u = &uDirections[v * 3];
+        const float along = n[0] * u[0] + n[1] * u[1] + n[2] * u[2];
+        float tangent[3] = { u[0] - n[0] * along, u[1] - n[1] * along, u[2] - n[2] * along };
+        Normalize(tangent);
+
+        if (tangent[0] == 0.0f && tangent[1] == 0.0f && tangent[2] == 0.0f)
+        {
+            // Cross the normal with the axis it is least aligned with
+            const float axis[3] = { std::fabs(n[0]) < 0.9f ? 1.0f : 0.0f, std::fabs(n[0]) < 0.9f ? 0.0f : 1.0f, 0.0f };
+            tangent[0] = n[1] * axis[2] - n[2] * axis[1];
+            tangent[1] = n[2] * axis[0] - n[0] * axis[2];
+            tangent[2] = n[0] * axis[1] - n[1] * axis[0];
+            Normalize(tangent);
+        }
+
+        const float bitangent[3] = { n[1] * tangent[2] - n[2] * tangent[1], n[2] * tangent[0] - n[0] * tangent[2],
+            n[0] * tangent[1] - n[1] * tangent[0] };
+        const float* w = &vDirections[v * 3];
+        std::copy(tangent, tangent + 3, vertex.tangent);
+        vertex.tangent[3] = (bitangent[0] * w[0] + bitangent[1] * w[1] + bitangent[2] * w[2]) < 0.0f ? -1.0f : 1.0f;
+    }
+}
+
+// The triangles are reordered for the post-transform cache and for overdraw, the vertices
+// for fetch locality, then both are encoded in the requested format. The ACMR of the source
+// order and of the result are kept for the report.
+static CookedAsset CookMesh(const std::string& path, const CookerOptions& options)
+{
+    SourceMesh mesh = LoadObj(path);
+    ComputeTangents(mesh);
+
+    CookedAsset asset;
+    asset.name = GetAssetName(path);
+    asset.acmrBefore = ComputeAcmr(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), REPORT_CACHE_SIZE);
+
+    if (options.optimize)
+    {
+        OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+        OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices[0].position, mesh.vertices.size(),
+            sizeof(SourceVertex), options.overdrawThreshold);
+    }
+
+    // Unused vertices are dropped even without reordering
+    std::vector<uint32_t> remap;
+    const size_t vertexCount = OptimizeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), remap);
+    std::vector<SourceVertex> vertices(vertexCount);
+    for (size_t v = 0; v < remap.size(); v++)
+    {
+        if (remap[v] != ~0u)
+        {
+            vertices[remap[v]] = mesh.vertices[v];
+        }
+    }
+    asset.acmrAfter = ComputeAcmr(mesh.indices.data(), mesh.indices.size(), vertexCount, REPORT_CACHE_SIZE);
+
+    std::vector<PackMeshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint8_t> meshletTriangles;
+    if (options.meshlets)
+    {
+        BuildMeshlets(mesh.indices.data(), mesh.indices.size(), vertices[0].position, vertexCount, sizeof(SourceVertex),
+            meshlets, meshletVertices, meshletTriangles);
+    }
+
+    PackEntry& entry = asset.entry;
+    entry.type = AssetType::Mesh;
+    entry.vertexFormat = options.vertexFormat;
+    entry.vertexCount = static_cast<uint32_t>(vertexCount);
+    entry.vertexStride = GetVertexStride(options.vertexFormat);
+    entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+    float boundsMax[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        entry.boundsMin[axis] = INFINITY;
+        boundsMax[axis] = -INFINITY;
+    }
+    for (const SourceVertex& vertex : vertices)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            entry.boundsMin[axis] = std::min(entry.boundsMin[axis], vertex.position[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], vertex.position[axis]);
+        }
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        entry.boundsExtent[axis] = boundsMax[axis] - entry.boundsMin[axis];
+    }
+
+    // Vertices, indices, then the meshlet streams, each 16-byte aligned
+    const uint64_t vertexBytes = static_cast<uint64_t>(vertexCount) * entry.vertexStride;
+    const uint64_t indexBytes = mesh.indices.size() * sizeof(uint32_t);
+    entry.indexOffset = static_cast<uint32_t>(AlignUp(vertexBytes, PACK_MIP_ALIGNMENT));
+    uint64_t blobSize = entry.indexOffset + indexBytes;
+    if (!meshlets.empty())
+    {
+        entry.meshletCount = static_cast<uint32_t>(meshlets.size());
+        entry.meshletOffset = static_cast<uint32_t>(AlignUp(blobSize, PACK_MIP_ALIGNMENT));
+        entry.meshletVertexOffset = static_cast<uint32_t>(AlignUp(entry.meshletOffset + meshlets.size() * sizeof(PackMeshlet), PACK_MIP_ALIGNMENT));
+        entry.meshletTriangleOffset = static_cast<uint32_t>(AlignUp(entry.meshletVertexOffset + meshletVertices.size() * sizeof(uint32_t),
+            PACK_MIP_ALIGNMENT));
+        blobSize = entry.meshletTriangleOffset + meshletTriangles.size();
+    }
+    if (blobSize > UINT32_MAX)
+    {
+        throw std::runtime_error(path + " is too large!");
+    }
+
+    asset.blob.resize(static_cast<size_t>(blobSize));
+    uint8_t* blob = asset.blob.data();
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        const SourceVertex& source = vertices[v];
+        if (options.vertexFormat == VertexFormat::Quantized)
+        {
+            const QuantizedVertex vertex = QuantizeVertex(source.position, source.normal, source.tangent, source.uv,
+                entry.boundsMin, entry.boundsExtent);
+            std::memcpy(blob + v * sizeof(vertex), &vertex, sizeof(vertex));
+
+            float decoded[3];
+            DequantizePosition(vertex, entry.boundsMin, entry.boundsExtent, decoded);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                asset.positionError = std::max(asset.positionError, std::fabs(decoded[axis] - source.position[axis]));
+            }
+        }
+        else
+        {
+            FloatVertex vertex;
+            std::copy(source.position, source.position + 3, vertex.position);
+            std::copy(source.normal, source.normal + 3, vertex.normal);
+            std::memcpy(blob + v * sizeof(vertex), &vertex, sizeof(vertex));
+        }
+    }
+    std::memcpy(blob + entry.indexOffset, mesh.indices.data(), indexBytes);
+    if (!meshlets.empty())
+    {
+        std::memcpy(blob + entry.meshletOffset, meshlets.data(), meshlets.size() * sizeof(PackMeshlet));
+        std::memcpy(blob + entry.meshletVertexOffset, meshletVertices.data(), meshletVertices.size() * sizeof(uint32_t));
+        std::memcpy(blob + entry.meshletTriangleOffset, meshletTriangles.data(), meshletTriangles.size());
+    }
+
+    // The baseline is every attribute as a 32-bit float
+    asset.floatBytes = vertexCount * sizeof(SourceVertex);
+    return asset;
+}
+
+// Binary PPM, 8 bits per channel, expanded to opaque RGBA
+static std::vector<uint8_t> LoadPpm(const std::string& path, uint32_t& width, uint32_t& height)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+
+    // Header fields are separated by whitespace and may be interleaved with # comments
+    auto readField = [&file]()
+    {
+        std::string field;
+        while (field.empty())
+        {
+            int c = file.get();
+            while (c != EOF && std::isspace(c))
+            {
+                c = file.get();
+            }
+            if (c == '#')
+            {
+                std::string comment;
+                std::getline(file, comment);
+                continue;
+            }
+            while (c != EOF && !std::isspace(c))
+            {
+                field.push_back(static_cast<char>(c));
+                c = file.get();
+            }
+            if (c == EOF && field.empty())
+            {
+                throw std::runtime_error("Truncated PPM header!");
+            }
+        }
+        return field;
+    };
+
+    if (readField() != "P6")
+    {
+        throw std::runtime_error(path + " is not a binary PPM!");
+    }
+    width = static_cast<uint32_t>(std::strtoul(readField().c_str(), nullptr, 10));
+    height = static_cast<uint32_t>(std::strtoul(readField().c_str(), nullptr, 10));
+    if (width == 0 || height == 0 || std::strtoul(readField().c_str(), nullptr, 10) != 255)
+    {
+        throw std::runtime_error(path + " has an unsupported size or bit depth!");
+    }
+
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+    if (!file.read(reinterpret_cast<char*>(rgb.data()), static_cast<std::streamsize>(rgb.size())))
+    {
+        throw std::runtime_error(path + " is truncated!");
+    }
+
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+    {
+        rgba[i * 4 + 0] = rgb[i * 3 + 0];
+        rgba[i * 4 + 1] = rgb[i * 3 + 1];
+        rgba[i * 4 + 2] = rgb[i * 3 + 2];
+        rgba[i * 4 + 3] = 255;
+    }
+    return rgba;
+}
+
+// 2x2 box filter; an odd last row or column is folded into its neighbour's texel
+static std::vector<uint8_t> Downsample(const std::vector<uint8_t>& source, uint32_t width, uint32_t height)
+{
+    const uint32_t outWidth = std::max(width / 2, 1u);
+    const uint32_t outHeight = std::max(height / 2, 1u);
+    std::vector<uint8_t> result(static_cast<size_t>(outWidth) * outHeight * 4);
+
+    for (uint32_t y = 0; y < outHeight; y++)
+    {
+        const uint32_t y0 = std::min(y * 2, height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+        for (uint32_t x = 0; x < outWidth; x++)
+        {
+            const uint32_t x0 = std::min(x * 2, width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                const uint32_t sum = source[(static_cast<size_t>(y0) * width + x0) * 4 + c] + source[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                    + source[(static_cast<size_t>(y1) * width + x0) * 4 + c] + source[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                result[(static_cast<size_t>(y) * outWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+static uint16_t PackRgb565(const float color[3])
+{
+    const uint32_t r = static_cast<uint32_t>(std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+    const uint32_t g = static_cast<uint32_t>(std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+    const uint32_t b = static_cast<uint32_t>(std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRgb565(uint16_t packed, int color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// One 4x4 block. The endpoints are the corners of the block's color bounding box, inset by
+// 1/16 of its size as in the classic real-time encoders, so the interpolated colors cover
+// the block better than the extremes would. Always the four color mode.
+static void EncodeBc1Block(const uint8_t texels[16][4], uint8_t out[8])
+{
+    float low[3] = { 255.0f, 255.0f, 255.0f };
+    float high[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            low[c] = std::min(low[c], static_cast<float>(texels[i][c]));
+            high[c] = std::max(high[c], static_cast<float>(texels[i][c]));
+        }
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        const float inset = (high[c] - low[c]) / 16.0f;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+
+    uint16_t color0 = PackRgb565(high);
+    uint16_t color1 = PackRgb565(low);
+    uint32_t selectors = 0;
+
+    if (color0 != color1)
+    {
+        // color0 > color1 selects the four color mode
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+        }
+
+        int palette[4][3];
+        UnpackRgb565(color0, palette[0]);
+        UnpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    const int d = texels[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            selectors |= static_cast<uint32_t>(best) << (i * 2);
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(color0 & 0xFF);
+    out[1] = static_cast<uint8_t>(color0 >> 8);
+    out[2] = static_cast<uint8_t>(color1 & 0xFF);
+    out[3] = static_cast<uint8_t>(color1 >> 8);
+    std::memcpy(out + 4, &selectors, sizeof(selectors));
+}
+
+// Blocks hanging over the edge of a small mip repeat its last row and column
+static std::vector<uint8_t> EncodeBc1(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    std::vector<uint8_t> result(static_cast<size_t>(blocksX) * blocksY * 8);
+
+    for (uint32_t by = 0; by < blocksY; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            uint8_t texels[16][4];
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                const uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+                const uint32_t y = std::min(by * 4 + i / 4, height - 1);
+                std::memcpy(texels[i], &rgba[(static_cast<size_t>(y) * width + x) * 4], 4);
+            }
+            EncodeBc1Block(texels, &result[(static_cast<size_t>(by) * blocksX + bx) * 8]);
+        }
+    }
+    return result;
+}
+
+static CookedAsset CookTexture(const std::string& path, TextureFormat format)
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> level = LoadPpm(path, width, height);
+
+    CookedAsset asset;
+    asset.name = GetAssetName(path);
+    asset.entry.type = AssetType::Texture;
+    asset.entry.width = width;
+    asset.entry.height = height;
+    asset.entry.format = format;
+
+    // Full chain down to 1x1
+    for (;;)
+    {
+        std::vector<uint8_t> data = (format == TextureFormat::Bc1) ? EncodeBc1(level, width, height) : level;
+
+        PackMip mip;
+        mip.offset = AlignUp(asset.blob.size(), PACK_MIP_ALIGNMENT);
+        mip.size = data.size();
+        mip.width = width;
+        mip.height = height;
+        asset.blob.resize(mip.offset + mip.size);
+        std::memcpy(asset.blob.data() + mip.offset, data.data(), data.size());
+        asset.mips.push_back(mip);
+
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+        level = Downsample(level, width, height);
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+
+    asset.entry.mipCount = static_cast<uint32_t>(asset.mips.size());
+    return asset;
+}
+
+// Tables first, then the blobs in input order, so assets cooked together stay close on disk
+static void WritePack(const std::string& path, std::vector<CookedAsset>& assets)
+{
+    PackHeader header;
+    header.entryCount = static_cast<uint32_t>(assets.size());
+    header.entriesOffset = sizeof(PackHeader);
+    for (const CookedAsset& asset : assets)
+    {
+        header.mipCount += static_cast<uint32_t>(asset.mips.size());
+        header.namesSize += asset.name.size();
+    }
+    header.mipsOffset = header.entriesOffset + assets.size() * sizeof(PackEntry);
+    header.namesOffset = header.mipsOffset + header.mipCount * sizeof(PackMip);
+
+    uint64_t offset = header.namesOffset + header.namesSize;
+    for (CookedAsset& asset : assets)
+    {
+        offset = AlignUp(offset, PACK_BLOB_ALIGNMENT);
+        asset.entry.offset = offset;
+        asset.entry.size = asset.blob.size();
+        offset += asset.blob.size();
+    }
+    header.fileSize = AlignUp(offset, PACK_FILE_ALIGNMENT);
+
+    // The entry table is sorted for the runtime's binary search
+    std::sort(assets.begin(), assets.end(), [](const CookedAsset& a, const CookedAsset& b) { return a.entry.nameHash < b.entry.nameHash; });
+
+    std::string names;
+    std::vector<PackMip> mips;
+    for (CookedAsset& asset : assets)
+    {
+        asset.entry.nameOffset = static_cast<uint32_t>(names.size());
+        asset.entry.nameLength = static_cast<uint32_t>(asset.name.size());
+        names += asset.name;
+
+        if (asset.entry.type == AssetType::Texture)
+        {
+            asset.entry.firstMip = static_cast<uint32_t>(mips.size());
+            mips.insert(mips.end(), asset.mips.begin(), asset.mips.end());
+        }
+    }
+
+    std::vector<uint8_t> file(static_cast<size_t>(header.fileSize), 0);
+    std::memcpy(file.data(), &header, sizeof(header));
+    for (size_t i = 0; i < assets.size(); i++)
+    {
+        std::memcpy(file.data() + header.entriesOffset + i * sizeof(PackEntry), &assets[i].entry, sizeof(PackEntry));
+        std::memcpy(file.data() + assets[i].entry.offset, assets[i].blob.data(), assets[i].blob.size());
+    }
+    if (!mips.empty())
+    {
+        std::memcpy(file.data() + header.mipsOffset, mips.data(), mips.size() * sizeof(PackMip));
+    }
+    std::memcpy(file.data() + header.namesOffset, names.data(), names.size());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size())))
+    {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    CookerOptions options;
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::vector<CookedAsset> assets;
+        for (const std::string& input : options.inputs)
+        {
+            const std::string extension = GetExtension(input);
+            if (extension == "obj")
+            {
+                assets.push_back(CookMesh(input, options));
+            }
+            else if (extension == "ppm")
+            {
+                assets.push_back(CookTexture(input, options.format));
+            }
+            else
+            {
+                throw std::runtime_error("Unsupported input " + input + "!");
+            }
+
+            CookedAsset& asset = assets.back();
+            asset.entry.nameHash = HashAssetName(asset.name.data(), asset.name.size());
+            for (size_t i = 0; i + 1 < assets.size(); i++)
+            {
+                if (assets[i].name == asset.name)
+                {
+                    throw std::runtime_error("Duplicate asset name " + asset.name + "!");
+                }
+            }
+        }
+
+        WritePack(options.outputPath, assets);
+
+        // Read back through the runtime path, which validates every table and blob
+        AssetPack pack;
+        pack.Open(options.outputPath);
+
+        // Mesh totals, ACMR weighted by triangles
+        uint64_t meshFloatBytes = 0;
+        uint64_t meshCookedBytes = 0;
+        double meshTriangles = 0.0;
+        double missesBefore = 0.0;
+        double missesAfter = 0.0;
+
+        std::cout << std::fixed << std::setprecision(3);
+        for (const CookedAsset& asset : assets)
+        {
+            const PackEntry* entry = pack.Find(asset.name);
+            if (entry == nullptr || std::memcmp(pack.GetBlob(*entry), asset.blob.data(), asset.blob.size()) != 0
+                || (entry->type == AssetType::Mesh && !pack.HasValidIndices(*entry)))
+            {
+                throw std::runtime_error("Verification of " + asset.name + " failed!");
+            }
+
+            std::cout << asset.name << ": ";
+            if (entry->type == AssetType::Mesh)
+            {
+                const double triangles = entry->indexCount / 3;
+                const uint64_t vertexBytes = static_cast<uint64_t>(entry->vertexCount) * entry->vertexStride;
+                std::cout << entry->vertexCount << " vertices, " << entry->indexCount / 3 << " triangles, vertices "
+                    << asset.floatBytes << " bytes as floats -> " << vertexBytes << " "
+                    << (entry->vertexFormat == VertexFormat::Quantized ? "quantized" : "float") << " ("
+                    << 100.0 * (1.0 - static_cast<double>(vertexBytes) / static_cast<double>(asset.floatBytes)) << "% smaller), ACMR "
+                    << asset.acmrBefore << " -> " << asset.acmrAfter;
+                if (entry->vertexFormat == VertexFormat::Quantized)
+                {
+                    std::cout << ", position error " << std::defaultfloat << asset.positionError << std::fixed;
+                }
+                if (entry->meshletCount > 0)
+                {
+                    const PackMeshlet* meshlets = pack.GetMeshlets(*entry);
+                    uint32_t cones = 0;
+                    for (uint32_t i = 0; i < entry->meshletCount; i++)
+                    {
+                        cones += meshlets[i].coneCutoff < 1.0f ? 1 : 0;
+                    }
+                    std::cout << ", " << entry->meshletCount << " meshlets (" << cones << " with a culling cone)";
+                }
+
+                meshFloatBytes += asset.floatBytes;
+                meshCookedBytes += vertexBytes;
+                meshTriangles += triangles;
+                missesBefore += asset.acmrBefore * triangles;
+                missesAfter += asset.acmrAfter * triangles;
+                std::cout << ", " << entry->size << " bytes\n";
+                continue;
+            }
+            else
+            {
+                std::cout << entry->width << "x" << entry->height << " " << (entry->format == TextureFormat::Bc1 ? "BC1" : "RGBA8")
+                    << ", " << entry->mipCount << " mips";
+            }
+            std::cout << ", " << entry->size << " bytes\n";
+        }
+        if (meshTriangles > 0.0)
+        {
+            std::cout << "Mesh vertices: " << meshFloatBytes << " bytes as floats -> " << meshCookedBytes << " ("
+                << 100.0 * (1.0 - static_cast<double>(meshCookedBytes) / static_cast<double>(meshFloatBytes)) << "% smaller), ACMR ("
+                << REPORT_CACHE_SIZE << " entry FIFO) " << missesBefore / meshTriangles << " -> " << missesAfter / meshTriangles << '\n';
+        }
+        std::cout << "Wrote " << options.outputPath << ": " << assets.size() << " assets, " << pack.GetSize() << " bytes\n";
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
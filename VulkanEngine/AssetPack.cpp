@@ -0,0 +1,345 @@
+#include "AssetPack.h"
+#include "MeshFormat.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Pages are touched at this stride by Prefetch, the smallest page size in use
+constexpr uint64_t PREFETCH_STRIDE = 4096;
+
+// Bytes of a tightly packed mip, BC1 in whole 4x4 blocks
+static uint64_t GetMipSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+    if (format == TextureFormat::Bc1)
+    {
+        return ((width + 3ull) / 4) * ((height + 3ull) / 4) * 8;
+    }
+    return static_cast<uint64_t>(width) * height * 4;
+}
+
+uint64_t HashAssetName(const char* name, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+AssetPack::~AssetPack()
+{
+    Close();
+}
+
+void AssetPack::Open(const std::string& path)
+{
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    LARGE_INTEGER size{};
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+        throw std::runtime_error("Failed to open asset pack " + path + "!");
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data == nullptr)
+    {
+        if (mapping != nullptr)
+        {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map asset pack " + path + "!");
+    }
+
+    m_File = file;
+    m_Mapping = mapping;
+    m_Size = static_cast<uint64_t>(size.QuadPart);
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat status{};
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+        throw std::runtime_error("Failed to open asset pack " + path + "!");
+    }
+
+    // The mapping keeps the file referenced, the descriptor is not needed afterwards
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map asset pack " + path + "!");
+    }
+
+    m_Size = static_cast<uint64_t>(status.st_size);
+#endif
+
+    m_Path = path;
+    m_Data = static_cast<const uint8_t*>(data);
+
+    try
+    {
+        Validate();
+    }
+    catch (...)
+    {
+        Close();
+        throw;
+    }
+
+    m_Header = reinterpret_cast<const PackHeader*>(m_Data);
+    m_Entries = reinterpret_cast<const PackEntry*>(m_Data + m_Header->entriesOffset);
+    m_Mips = reinterpret_cast<const PackMip*>(m_Data + m_Header->mipsOffset);
+    m_Names = reinterpret_cast<const char*>(m_Data + m_Header->namesOffset);
+}
+
+void AssetPack::Close()
+{
+    if (m_Data == nullptr)
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_Data);
+    CloseHandle(static_cast<HANDLE>(m_Mapping));
+    CloseHandle(static_cast<HANDLE>(m_File));
+    m_Mapping = nullptr;
+    m_File = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(m_Data), static_cast<size_t>(m_Size));
+#endif
+
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Header = nullptr;
+    m_Entries = nullptr;
+    m_Mips = nullptr;
+    m_Names = nullptr;
+}
+
+// Everything the accessors dereference is checked once here. Ranges are compared as
+// offset <= size - length, which cannot overflow.
+void AssetPack::Validate() const
+{
+    auto fits = [this](uint64_t offset, uint64_t length)
+    {
+        return length <= m_Size && offset <= m_Size - length;
+    };
+    auto fail = [this](const char* reason)
+    {
+        throw std::runtime_error("Invalid asset pack " + m_Path + ": " + reason + "!");
+    };
+
+    if (m_Size < sizeof(PackHeader))
+    {
+        fail("too small");
+    }
+    const PackHeader& header = *reinterpret_cast<const PackHeader*>(m_Data);
+    if (header.magic != PACK_MAGIC || header.version != PACK_VERSION)
+    {
+        fail("wrong magic or version");
+    }
+    if (header.fileSize != m_Size)
+    {
+        fail("truncated");
+    }
+    if (!fits(header.entriesOffset, static_cast<uint64_t>(header.entryCount) * sizeof(PackEntry))
+        || !fits(header.mipsOffset, static_cast<uint64_t>(header.mipCount) * sizeof(PackMip))
+        || !fits(header.namesOffset, header.namesSize)
+        || header.entriesOffset % alignof(PackEntry) != 0 || header.mipsOffset % alignof(PackMip) != 0)
+    {
+        fail("tables out of bounds");
+    }
+
+    const PackEntry* entries = reinterpret_cast<const PackEntry*>(m_Data + header.entriesOffset);
+    const PackMip* mips = reinterpret_cast<const PackMip*>(m_Data + header.mipsOffset);
+    for (uint32_t i = 0; i < header.entryCount; i++)
+    {
+        const PackEntry& entry = entries[i];
+        if (i > 0 && entries[i - 1].nameHash > entry.nameHash)
+        {
+            fail("entries not sorted");
+        }
+        if (!fits(entry.offset, entry.size) || entry.offset % PACK_BLOB_ALIGNMENT != 0
+            || entry.nameLength > header.namesSize || entry.nameOffset > header.namesSize - entry.nameLength)
+        {
+            fail("entry out of bounds");
+        }
+
+        if (entry.type == AssetType::Mesh)
+        {
+            const uint64_t vertexBytes = static_cast<uint64_t>(entry.vertexCount) * entry.vertexStride;
+            const uint64_t indexBytes = static_cast<uint64_t>(entry.indexCount) * sizeof(uint32_t);
+            if (GetVertexStride(entry.vertexFormat) != entry.vertexStride
+                || vertexBytes > entry.indexOffset || indexBytes > entry.size || entry.indexOffset > entry.size - indexBytes
+                || entry.indexOffset % sizeof(uint32_t) != 0)
+            {
+                fail("mesh streams out of bounds");
+            }
+            if (entry.meshletCount > 0)
+            {
+                ValidateMeshlets(entry);
+            }
+        }
+        else if (entry.type == AssetType::Texture)
+        {
+            if (entry.mipCount == 0 || entry.mipCount > 32 || entry.mipCount > header.mipCount
+                || entry.firstMip > header.mipCount - entry.mipCount || entry.width == 0 || entry.height == 0
+                || (entry.format != TextureFormat::Rgba8 && entry.format != TextureFormat::Bc1))
+            {
+                fail("bad texture");
+            }
+            for (uint32_t mip = 0; mip < entry.mipCount; mip++)
+            {
+                const PackMip& level = mips[entry.firstMip + mip];
+                if (level.size > entry.size || level.offset > entry.size - level.size || level.offset % PACK_MIP_ALIGNMENT != 0)
+                {
+                    fail("mip out of bounds");
+                }
+
+                // The copies into the image read exactly this many bytes of the mip
+                if (level.width != std::max(entry.width >> mip, 1u) || level.height != std::max(entry.height >> mip, 1u)
+                    || level.size != GetMipSize(entry.format, level.width, level.height))
+                {
+                    fail("mip size does not match its extent");
+                }
+            }
+        }
+        else
+        {
+            fail("unknown asset type");
+        }
+    }
+}
+
+bool AssetPack::HasValidIndices(const PackEntry& entry) const
+{
+    const uint8_t* blob = GetBlob(entry);
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(blob + entry.indexOffset);
+    uint32_t maxIndex = 0;
+    for (uint32_t i = 0; i < entry.indexCount; i++)
+    {
+        maxIndex = std::max(maxIndex, indices[i]);
+    }
+    if (entry.indexCount > 0 && maxIndex >= entry.vertexCount)
+    {
+        return false;
+    }
+
+    // Validate made sure the meshlets stay inside the vertex index stream
+    const uint32_t* meshletVertices = reinterpret_cast<const uint32_t*>(blob + entry.meshletVertexOffset);
+    const uint64_t meshletVertexCount = entry.meshletCount > 0 ? (entry.meshletTriangleOffset - entry.meshletVertexOffset) / sizeof(uint32_t) : 0;
+    for (uint64_t i = 0; i < meshletVertexCount; i++)
+    {
+        if (meshletVertices[i] >= entry.vertexCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The three meshlet streams follow each other up to the end of the blob, every meshlet has to
+// stay inside its streams and within the meshlet limits
+void AssetPack::ValidateMeshlets(const PackEntry& entry) const
+{
+    const uint64_t meshletBytes = static_cast<uint64_t>(entry.meshletCount) * sizeof(PackMeshlet);
+    if (entry.meshletOffset % alignof(PackMeshlet) != 0 || entry.meshletVertexOffset % sizeof(uint32_t) != 0
+        || entry.meshletOffset < static_cast<uint64_t>(entry.indexOffset) + static_cast<uint64_t>(entry.indexCount) * sizeof(uint32_t)
+        || entry.meshletOffset + meshletBytes > entry.meshletVertexOffset || entry.meshletVertexOffset > entry.meshletTriangleOffset
+        || entry.meshletTriangleOffset > entry.size)
+    {
+        throw std::runtime_error("Invalid asset pack " + m_Path + ": meshlet streams out of bounds!");
+    }
+
+    const uint64_t vertexIndices = (entry.meshletTriangleOffset - entry.meshletVertexOffset) / sizeof(uint32_t);
+    const uint64_t triangleBytes = entry.size - entry.meshletTriangleOffset;
+    const PackMeshlet* meshlets = GetMeshlets(entry);
+    for (uint32_t i = 0; i < entry.meshletCount; i++)
+    {
+        const PackMeshlet& meshlet = meshlets[i];
+        if (meshlet.vertexCount > MESHLET_MAX_VERTICES || meshlet.triangleCount > MESHLET_MAX_TRIANGLES
+            || meshlet.vertexOffset > vertexIndices || meshlet.vertexCount > vertexIndices - meshlet.vertexOffset
+            || meshlet.triangleOffset > triangleBytes || meshlet.triangleCount * 3ull > triangleBytes - meshlet.triangleOffset)
+        {
+            throw std::runtime_error("Invalid asset pack " + m_Path + ": meshlet out of bounds!");
+        }
+    }
+}
+
+const PackEntry* AssetPack::Find(const std::string& name) const
+{
+    if (m_Data == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Hash collisions are resolved by comparing the names of the equal run
+    const uint64_t hash = HashAssetName(name.data(), name.size());
+    const PackEntry* end = m_Entries + m_Header->entryCount;
+    const PackEntry* it = std::lower_bound(m_Entries, end, hash,
+        [](const PackEntry& entry, uint64_t value) { return entry.nameHash < value; });
+    for (; it != end && it->nameHash == hash; ++it)
+    {
+        if (it->nameLength == name.size() && name.compare(0, name.size(), m_Names + it->nameOffset, it->nameLength) == 0)
+        {
+            return it;
+        }
+    }
+    return nullptr;
+}
+
+std::string AssetPack::GetName(const PackEntry& entry) const
+{
+    return std::string(m_Names + entry.nameOffset, entry.nameLength);
+}
+
+void AssetPack::Prefetch(const PackEntry& entry) const
+{
+    Prefetch(entry, 0, entry.size);
+}
+
+void AssetPack::Prefetch(const PackEntry& entry, uint64_t offset, uint64_t size) const
+{
+    if (offset >= entry.size)
+    {
+        return;
+    }
+    size = std::min(size, entry.size - offset);
+
+    const volatile uint8_t* bytes = m_Data + entry.offset + offset;
+    uint8_t sink = 0;
+    for (uint64_t i = 0; i < size; i += PREFETCH_STRIDE)
+    {
+        sink ^= bytes[i];
+    }
+    // The last page when the range does not start on a page boundary
+    sink ^= bytes[size - 1];
+    (void)sink;
+}
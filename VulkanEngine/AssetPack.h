@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Packed binary assets, written offline by AssetCooker and read in place at runtime.
+//
+// File layout, all little-endian:
+//   PackHeader
+//   PackEntry[entryCount]          sorted by nameHash, so lookups are a binary search
+//   PackMip[mipCount]              mip levels of the texture entries
+//   name strings                   not terminated, addressed by offset and length
+//   blobs                          each starting on a PACK_BLOB_ALIGNMENT boundary
+// and the file is padded to PACK_FILE_ALIGNMENT.
+//
+// The structures are plain data with fixed sizes, so the mapped file is used as it is: no
+// parsing and no copies, a blob goes from the page cache straight into the staging buffer or,
+// imported with VK_EXT_external_memory_host, straight to the GPU. Blobs and the file end are
+// aligned far enough for a host pointer import, which wants at least page alignment.
+constexpr uint32_t PACK_MAGIC = 0x4B504556;                 // "VEPK"
+constexpr uint32_t PACK_VERSION = 2;
+constexpr uint64_t PACK_BLOB_ALIGNMENT = 4096;
+constexpr uint64_t PACK_FILE_ALIGNMENT = 64 * 1024;
+constexpr uint64_t PACK_MIP_ALIGNMENT = 16;                 // inside a blob, keeps buffer to image copies legal
+
+// Meshlet limits, the sizes mesh shading hardware handles best
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+enum class AssetType : uint32_t
+{
+    Mesh    = 1,
+    Texture = 2,
+};
+
+// Vertex layouts are defined in MeshFormat.h
+enum class VertexFormat : uint32_t
+{
+    Float       = 1,    // FloatVertex, position and normal
+    Quantized   = 2,    // QuantizedVertex, position, normal, tangent and texture coordinates
+};
+
+enum class TextureFormat : uint32_t
+{
+    Rgba8   = 1,    // VK_FORMAT_R8G8B8A8_UNORM
+    Bc1     = 2,    // VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8 bytes per 4x4 block
+};
+
+struct PackHeader
+{
+    uint32_t    magic           = PACK_MAGIC;
+    uint32_t    version         = PACK_VERSION;
+    uint32_t    entryCount      = 0;
+    uint32_t    mipCount        = 0;
+    uint64_t    entriesOffset   = 0;
+    uint64_t    mipsOffset      = 0;
+    uint64_t    namesOffset     = 0;
+    uint64_t    namesSize       = 0;
+    uint64_t    fileSize        = 0;
+};
+
+// Meshes: the blob holds vertexCount vertices of vertexStride bytes in vertexFormat, then
+// indexCount uint32_t indices at indexOffset. Meshes cooked with meshlets follow with
+// meshletCount PackMeshlets at meshletOffset, the meshlets' uint32_t vertex indices at
+// meshletVertexOffset and their uint8_t triangle corners, 3 per triangle, at
+// meshletTriangleOffset up to the end of the blob.
+// Textures: the blob holds mipCount levels described by PackMip[firstMip ...].
+struct PackEntry
+{
+    uint64_t    nameHash        = 0;        // HashAssetName of the name
+    uint32_t    nameOffset      = 0;        // into the name strings
+    uint32_t    nameLength      = 0;
+    AssetType   type            = AssetType::Mesh;
+    uint32_t    flags           = 0;
+    uint64_t    offset          = 0;        // of the blob, from the start of the file
+    uint64_t    size            = 0;
+
+    // Mesh
+    uint32_t    vertexCount     = 0;
+    uint32_t    vertexStride    = 0;
+    uint32_t    indexCount      = 0;
+    uint32_t    indexOffset     = 0;        // from the start of the blob
+    VertexFormat vertexFormat   = VertexFormat::Float;
+    uint32_t    meshletCount    = 0;
+    uint32_t    meshletOffset   = 0;        // from the start of the blob, like the streams below
+    uint32_t    meshletVertexOffset = 0;
+    uint32_t    meshletTriangleOffset = 0;
+    float       boundsMin[3]    = {};       // quantized positions are relative to these bounds
+    float       boundsExtent[3] = {};
+
+    // Texture
+    uint32_t    width           = 0;
+    uint32_t    height          = 0;
+    TextureFormat format        = TextureFormat::Rgba8;
+    uint32_t    firstMip        = 0;
+    uint32_t    mipCount        = 0;
+    uint32_t    padding[2]      = {};
+};
+
+struct PackMip
+{
+    uint64_t    offset          = 0;        // from the start of the blob
+    uint64_t    size            = 0;
+    uint32_t    width           = 0;
+    uint32_t    height          = 0;
+};
+
+// A cluster of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles. All
+// its triangles face away from a camera at position p, and it can be culled, when
+//   dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+// A meshlet whose normals spread too far has coneCutoff 1 and is never culled that way.
+struct PackMeshlet
+{
+    uint32_t    vertexOffset    = 0;        // first of the meshlet's entries in the vertex indices
+    uint32_t    triangleOffset  = 0;        // first byte of its triangles
+    uint32_t    vertexCount     = 0;
+    uint32_t    triangleCount   = 0;
+    float       center[3]       = {};       // bounding sphere
+    float       radius          = 0.0f;
+    float       coneAxis[3]     = {};       // average facing direction
+    float       coneCutoff      = 1.0f;
+};
+
+static_assert(sizeof(PackHeader) == 56, "PackHeader is part of the file format");
+static_assert(sizeof(PackEntry) == 128, "PackEntry is part of the file format");
+static_assert(sizeof(PackMip) == 24, "PackMip is part of the file format");
+static_assert(sizeof(PackMeshlet) == 48, "PackMeshlet is part of the file format");
+
+// 64-bit FNV-1a of the asset name
+uint64_t HashAssetName(const char* name, size_t length);
+
+// A pack mapped into memory, read only. Open checks that every table and blob lies inside
+// the file and that every mip has the size its format and extent call for, after that all
+// pointers it hands out stay valid until Close. Mesh indices are not read by Open, loaders
+// check them with HasValidIndices before the mesh reaches the GPU.
+class AssetPack
+{
+public:
+    AssetPack() = default;
+    ~AssetPack();
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // Throws if the file cannot be mapped or is not a valid pack
+    void Open(const std::string& path);
+    void Close();
+
+    bool IsOpen() const { return m_Data != nullptr; }
+    const std::string& GetPath() const { return m_Path; }
+
+    uint32_t GetEntryCount() const { return m_Header != nullptr ? m_Header->entryCount : 0; }
+    const PackEntry& GetEntry(uint32_t index) const { return m_Entries[index]; }
+
+    // Null when the pack has no asset of that name
+    const PackEntry* Find(const std::string& name) const;
+
+    std::string GetName(const PackEntry& entry) const;
+    const uint8_t* GetBlob(const PackEntry& entry) const { return m_Data + entry.offset; }
+    const PackMip* GetMips(const PackEntry& entry) const { return m_Mips + entry.firstMip; }
+    const PackMeshlet* GetMeshlets(const PackEntry& entry) const
+    {
+        return reinterpret_cast<const PackMeshlet*>(m_Data + entry.offset + entry.meshletOffset);
+    }
+
+    // The whole mapping, page aligned and PACK_FILE_ALIGNMENT long
+    const uint8_t* GetData() const { return m_Data; }
+    uint64_t GetSize() const { return m_Size; }
+
+    // Whether every index and meshlet vertex index of the mesh is below its vertexCount. Reads
+    // the index streams, so it belongs on a loading thread.
+    bool HasValidIndices(const PackEntry& entry) const;
+
+    // Reads every page of the blob so later accesses do not fault; meant for a loading thread
+    void Prefetch(const PackEntry& entry) const;
+    // Only the bytes at offset to offset + size of the blob, e.g. the mips still missing
+    void Prefetch(const PackEntry& entry, uint64_t offset, uint64_t size) const;
+
+private:
+    void Validate() const;
+    void ValidateMeshlets(const PackEntry& entry) const;
+
+    std::string         m_Path;
+    const uint8_t*      m_Data          = nullptr;
+    uint64_t            m_Size          = 0;
+    const PackHeader*   m_Header        = nullptr;
+    const PackEntry*    m_Entries       = nullptr;
+    const PackMip*      m_Mips          = nullptr;
+    const char*         m_Names         = nullptr;
+
+#if defined(_WIN32)
+    void*               m_File          = nullptr;     // HANDLEs
+    void*               m_Mapping       = nullptr;
+#endif
+};
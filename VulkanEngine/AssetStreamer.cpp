@@ -0,0 +1,536 @@
+#include "AssetStreamer.h"
+#include "Profiler.h"
+#include "UploadEngine.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+// Loader queue priorities of RequestAll and of the mips TextureStreamer asks for: geometry
+// first, then something to sample for every texture, then detail
+constexpr int MESH_PRIORITY = 2;
+constexpr int TEXTURE_TAIL_PRIORITY = 1;
+constexpr int TEXTURE_MIP_PRIORITY = 0;
+
+namespace
+{
+    // Heap order of the request queue: higher priority first, then first come first served
+    template <typename Request>
+    bool ServedAfter(const Request& a, const Request& b)
+    {
+        return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+    }
+}
+
+AssetStreamer::~AssetStreamer()
+{
+    // Destroy needs the device, after an error the thread is at least not left running
+    StopLoader();
+}
+
+void AssetStreamer::Create(VkPhysicalDevice physicalDevice, const VulkanInstanceDispatch& instanceDispatch, VkDevice device,
+    const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator, BindlessDescriptors* bindless, const std::string& path,
+    bool hostImport, bool bc1, uint64_t frameBudget, uint32_t framesInFlight, uint64_t textureBudget,
+    const VkAllocationCallbacks* callbacks)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = &allocator;
+    m_Bindless = bindless;
+    m_Callbacks = callbacks;
+    m_Bc1 = bc1;
+    m_FrameBudget = frameBudget;
+
+    m_Pack.Open(path);
+    m_Assets.assign(m_Pack.GetEntryCount(), Asset{});
+
+    if (hostImport)
+    {
+        CreateHostImport(physicalDevice, instanceDispatch);
+    }
+
+    m_Textures.Create(device, dispatch, allocator, bindless, m_Pack, m_ImportBuffer, bc1, framesInFlight, textureBudget, callbacks);
+
+    m_Stop = false;
+    m_Loader = std::thread(&AssetStreamer::LoaderMain, this);
+
+    std::cout << "Asset pack " << path << ": " << m_Pack.GetEntryCount() << " assets, " << m_Pack.GetSize() / 1024
+        << " KiB mapped, uploads " << (m_ImportBuffer != VK_NULL_HANDLE ? "read from imported host memory" : "staged") << '\n';
+}
+
+// The mapping is imported once as a whole: blobs are only page aligned relative to the file,
+// and one buffer with one allocation keeps this to a single entry of maxMemoryAllocationCount
+void AssetStreamer::CreateHostImport(VkPhysicalDevice physicalDevice, const VulkanInstanceDispatch& instanceDispatch)
+{
+    auto fallBack = [this](const char* reason)
+    {
+        std::cout << "Host pointer import is not possible (" << reason << "), asset uploads are staged\n";
+        if (m_ImportBuffer != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyBuffer(m_Device, m_ImportBuffer, m_Callbacks);
+            m_ImportBuffer = VK_NULL_HANDLE;
+        }
+    };
+
+    if (instanceDispatch.vkGetPhysicalDeviceProperties2 == nullptr || m_Dispatch->vkGetMemoryHostPointerPropertiesEXT == nullptr)
+    {
+        fallBack("entry points missing");
+        return;
+    }
+
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+    hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &hostProperties;
+    instanceDispatch.vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+    // Both the pointer and the size have to be multiples of the import alignment
+    const uint64_t alignment = std::max<uint64_t>(hostProperties.minImportedHostPointerAlignment, 1);
+    if (reinterpret_cast<uintptr_t>(m_Pack.GetData()) % alignment != 0 || m_Pack.GetSize() % alignment != 0)
+    {
+        fallBack("mapping not aligned");
+        return;
+    }
+
+    VkMemoryHostPointerPropertiesEXT pointerProperties{};
+    pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (m_Dispatch->vkGetMemoryHostPointerPropertiesEXT(m_Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        m_Pack.GetData(), &pointerProperties) != VK_SUCCESS)
+    {
+        fallBack("pointer rejected");
+        return;
+    }
+
+    VkExternalMemoryBufferCreateInfo externalInfo{};
+    externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.pNext = &externalInfo;
+    bufferInfo.size = m_Pack.GetSize();
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &m_ImportBuffer) != VK_SUCCESS)
+    {
+        m_ImportBuffer = VK_NULL_HANDLE;
+        fallBack("buffer creation failed");
+        return;
+    }
+
+    VkMemoryRequirements memRequirements;
+    m_Dispatch->vkGetBufferMemoryRequirements(m_Device, m_ImportBuffer, &memRequirements);
+
+    const uint32_t typeBits = memRequirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+    if (typeBits == 0 || memRequirements.size > m_Pack.GetSize())
+    {
+        fallBack("no compatible memory type");
+        return;
+    }
+
+    uint32_t memoryType = 0;
+    while ((typeBits & (1u << memoryType)) == 0)
+    {
+        memoryType++;
+    }
+
+    VkImportMemoryHostPointerInfoEXT importInfo{};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importInfo.pHostPointer = const_cast<uint8_t*>(m_Pack.GetData());
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &importInfo;
+    allocInfo.allocationSize = m_Pack.GetSize();
+    allocInfo.memoryTypeIndex = memoryType;
+
+    // Some drivers only import writable mappings, the pack is mapped read only
+    if (m_Dispatch->vkAllocateMemory(m_Device, &allocInfo, m_Callbacks, &m_ImportMemory) != VK_SUCCESS)
+    {
+        m_ImportMemory = VK_NULL_HANDLE;
+        fallBack("import failed");
+        return;
+    }
+
+    if (m_Dispatch->vkBindBufferMemory(m_Device, m_ImportBuffer, m_ImportMemory, 0) != VK_SUCCESS)
+    {
+        m_Dispatch->vkFreeMemory(m_Device, m_ImportMemory, m_Callbacks);
+        m_ImportMemory = VK_NULL_HANDLE;
+        fallBack("bind failed");
+        return;
+    }
+}
+
+void AssetStreamer::Destroy()
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    StopLoader();
+
+    // The device is idle, nothing still reads the resources or the imported mapping
+    for (Asset& asset : m_Assets)
+    {
+        DestroyAsset(asset);
+    }
+    m_Assets.clear();
+    m_Textures.Destroy();
+
+    if (m_ImportBuffer != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyBuffer(m_Device, m_ImportBuffer, m_Callbacks);
+        m_ImportBuffer = VK_NULL_HANDLE;
+    }
+    if (m_ImportMemory != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkFreeMemory(m_Device, m_ImportMemory, m_Callbacks);
+        m_ImportMemory = VK_NULL_HANDLE;
+    }
+
+    m_Pack.Close();
+    m_Queue.clear();
+    m_Ready.clear();
+    m_Loaded.clear();
+    m_Device = nullptr;
+}
+
+void AssetStreamer::StopLoader()
+{
+    if (!m_Loader.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_Condition.notify_one();
+    m_Loader.join();
+}
+
+void AssetStreamer::DestroyAsset(Asset& asset)
+{
+    if (asset.mesh.buffer != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyBuffer(m_Device, asset.mesh.buffer, m_Callbacks);
+    }
+    if (asset.allocation != nullptr)
+    {
+        m_Allocator->Free(asset.allocation);
+    }
+
+    asset.mesh = Mesh{};
+    asset.allocation = nullptr;
+}
+
+uint32_t AssetStreamer::Request(const std::string& name, int priority)
+{
+    const PackEntry* entry = m_Pack.Find(name);
+    if (entry == nullptr)
+    {
+        return INVALID_ASSET;
+    }
+    return Request(static_cast<uint32_t>(entry - &m_Pack.GetEntry(0)), priority);
+}
+
+// A repeated request keeps the priority of the first one. Textures are requested with their
+// tail mips, finer mips follow as TextureStreamer asks for them.
+uint32_t AssetStreamer::Request(uint32_t asset, int priority)
+{
+    if (asset >= m_Assets.size())
+    {
+        return INVALID_ASSET;
+    }
+
+    Asset& state = m_Assets[asset];
+    if (state.state != State::Unrequested)
+    {
+        return asset;
+    }
+    state.state = State::Queued;
+    state.requested = std::chrono::steady_clock::now();
+
+    const PackEntry& entry = m_Pack.GetEntry(asset);
+    QueuedRequest request;
+    request.priority = priority;
+    request.asset = asset;
+    request.mip = entry.type == AssetType::Texture ? TextureStreamer::GetTailMip(m_Pack, entry) : 0;
+    Enqueue({ request });
+
+    m_Stats.requests++;
+    return asset;
+}
+
+void AssetStreamer::Enqueue(const std::vector<QueuedRequest>& requests)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (QueuedRequest request : requests)
+        {
+            request.sequence = m_Sequence++;
+            m_Queue.push_back(request);
+            std::push_heap(m_Queue.begin(), m_Queue.end(), ServedAfter<QueuedRequest>);
+        }
+    }
+    m_Condition.notify_one();
+}
+
+void AssetStreamer::RequestAll()
+{
+    for (uint32_t i = 0; i < m_Pack.GetEntryCount(); i++)
+    {
+        Request(i, m_Pack.GetEntry(i).type == AssetType::Mesh ? MESH_PRIORITY : TEXTURE_TAIL_PRIORITY);
+    }
+}
+
+void AssetStreamer::LoaderMain()
+{
+    Profiler::SetThreadName("AssetLoader");
+
+    for (;;)
+    {
+        QueuedRequest request;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Condition.wait(lock, [this]() { return m_Stop || !m_Queue.empty(); });
+            if (m_Stop)
+            {
+                return;
+            }
+            std::pop_heap(m_Queue.begin(), m_Queue.end(), ServedAfter<QueuedRequest>);
+            request = m_Queue.back();
+            m_Queue.pop_back();
+        }
+
+        {
+            PROFILE_SCOPE("PrefetchAsset");
+            const PackEntry& entry = m_Pack.GetEntry(request.asset);
+            if (entry.type == AssetType::Texture)
+            {
+                // The mips are stored finest first, the requested one and all coarser ones are read
+                const uint64_t offset = m_Pack.GetMips(entry)[request.mip].offset;
+                m_Pack.Prefetch(entry, offset, entry.size - offset);
+            }
+            else
+            {
+                // Reading the indices also brings their pages in
+                m_Pack.Prefetch(entry);
+                request.badIndices = !m_Pack.HasValidIndices(entry);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Ready.push_back(request);
+    }
+}
+
+void AssetStreamer::Update(UploadEngine& uploadEngine, uint32_t frameIndex)
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    // Evictions come first, the memory they free goes to this frame's promotions
+    m_Textures.Update(uploadEngine, frameIndex);
+
+    std::vector<TextureStreamer::MipRequest> mips;
+    m_Textures.CollectPromotions(uploadEngine, mips);
+    if (!mips.empty())
+    {
+        std::vector<QueuedRequest> requests(mips.size());
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            requests[i].priority = TEXTURE_MIP_PRIORITY;
+            requests[i].asset = mips[i].asset;
+            requests[i].mip = mips[i].mip;
+        }
+        Enqueue(requests);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Loaded.insert(m_Loaded.end(), m_Ready.begin(), m_Ready.end());
+        m_Ready.clear();
+    }
+    if (m_Loaded.empty())
+    {
+        return;
+    }
+
+    PROFILE_FUNCTION();
+
+    // The loader finishes small blobs out of order, the budget still goes to the most important first
+    std::sort(m_Loaded.begin(), m_Loaded.end(),
+        [](const QueuedRequest& a, const QueuedRequest& b) { return ServedAfter(b, a); });
+
+    // At least one asset per frame, so an asset larger than the budget still gets through
+    uint64_t bytes = 0;
+    size_t done = 0;
+    while (done < m_Loaded.size() && (done == 0 || bytes < m_FrameBudget))
+    {
+        bytes += MakeResident(uploadEngine, m_Loaded[done]);
+        done++;
+    }
+    m_Loaded.erase(m_Loaded.begin(), m_Loaded.begin() + done);
+
+    if (!m_Loaded.empty())
+    {
+        m_Stats.budgetFrames++;
+    }
+}
+
+// Returns the bytes queued for upload. A failed asset is reported and skipped, it does not
+// stop the others; a texture whose finer mips fail keeps the ones it has.
+uint64_t AssetStreamer::MakeResident(UploadEngine& uploadEngine, const QueuedRequest& request)
+{
+    Asset& asset = m_Assets[request.asset];
+    const PackEntry& entry = m_Pack.GetEntry(request.asset);
+    const bool resident = asset.state == State::Resident;
+
+    uint64_t bytes = 0;
+    try
+    {
+        if (entry.type == AssetType::Mesh)
+        {
+            // The GPU would fetch vertices outside the buffer
+            if (request.badIndices)
+            {
+                throw std::runtime_error("Mesh index out of range!");
+            }
+            CreateMesh(uploadEngine, entry, asset);
+            bytes = entry.size;
+            m_Stats.meshes++;
+        }
+        else
+        {
+            bytes = m_Textures.MakeResident(uploadEngine, request.asset, request.mip);
+            m_Stats.textures += resident ? 0 : 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Failed to stream asset " << m_Pack.GetName(entry) << ": " << e.what() << '\n';
+        if (!resident)
+        {
+            DestroyAsset(asset);
+            asset.state = State::Failed;
+            m_Stats.failed++;
+        }
+        return 0;
+    }
+
+    (m_ImportBuffer != VK_NULL_HANDLE ? m_Stats.bytesImported : m_Stats.bytesStaged) += bytes;
+    if (resident)
+    {
+        return bytes;
+    }
+
+    asset.state = State::Resident;
+    const double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - asset.requested).count();
+    m_Stats.totalLatencyMs += latencyMs;
+    m_Stats.maxLatencyMs = std::max(m_Stats.maxLatencyMs, latencyMs);
+    return bytes;
+}
+
+// Everything that can fail comes before the upload, which must not be recorded for a
+// buffer that is then destroyed
+void AssetStreamer::CreateMesh(UploadEngine& uploadEngine, const PackEntry& entry, Asset& asset)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = entry.size;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &asset.mesh.buffer) != VK_SUCCESS)
+    {
+        asset.mesh.buffer = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to create mesh buffer!");
+    }
+
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+    asset.allocation = m_Allocator->AllocateForBuffer(asset.mesh.buffer, allocInfo);
+
+    asset.mesh.vertexFormat = entry.vertexFormat;
+    asset.mesh.vertexCount = entry.vertexCount;
+    asset.mesh.vertexStride = entry.vertexStride;
+    asset.mesh.indexCount = entry.indexCount;
+    asset.mesh.indexOffset = entry.indexOffset;
+    std::copy(entry.boundsMin, entry.boundsMin + 3, asset.mesh.boundsMin);
+    std::copy(entry.boundsExtent, entry.boundsExtent + 3, asset.mesh.boundsExtent);
+    asset.mesh.meshletCount = entry.meshletCount;
+    asset.mesh.meshletOffset = entry.meshletOffset;
+    asset.mesh.meshletVertexOffset = entry.meshletVertexOffset;
+    asset.mesh.meshletTriangleOffset = entry.meshletTriangleOffset;
+
+    const uint32_t dstStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    const uint32_t dstAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    if (m_ImportBuffer != VK_NULL_HANDLE)
+    {
+        uploadEngine.CopyBuffer(asset.mesh.buffer, 0, m_ImportBuffer, entry.offset, entry.size, dstStage, dstAccess);
+    }
+    else
+    {
+        uploadEngine.UploadBuffer(asset.mesh.buffer, 0, m_Pack.GetBlob(entry), entry.size, dstStage, dstAccess);
+    }
+}
+
+const AssetStreamer::Mesh* AssetStreamer::GetMesh(uint32_t asset) const
+{
+    if (!IsResident(asset) || m_Pack.GetEntry(asset).type != AssetType::Mesh)
+    {
+        return nullptr;
+    }
+    return &m_Assets[asset].mesh;
+}
+
+const AssetStreamer::Texture* AssetStreamer::GetTexture(uint32_t asset) const
+{
+    if (!IsResident(asset) || m_Pack.GetEntry(asset).type != AssetType::Texture)
+    {
+        return nullptr;
+    }
+    return m_Textures.GetTexture(asset);
+}
+
+void AssetStreamer::PrintStats() const
+{
+    if (m_Stats.requests == 0)
+    {
+        return;
+    }
+
+    const uint64_t resident = m_Stats.meshes + m_Stats.textures;
+    std::cout << "Asset streaming: " << m_Stats.meshes << " meshes and " << m_Stats.textures << " textures resident of "
+        << m_Stats.requests << " requested";
+    if (m_Stats.failed > 0)
+    {
+        std::cout << ", " << m_Stats.failed << " failed";
+    }
+    std::cout << ", " << m_Stats.bytesStaged / 1024 << " KiB staged, " << m_Stats.bytesImported / 1024 << " KiB imported";
+    if (resident > 0)
+    {
+        std::cout << ", request to upload " << m_Stats.totalLatencyMs / static_cast<double>(resident) << " ms average, "
+            << m_Stats.maxLatencyMs << " ms max";
+    }
+    if (m_Stats.budgetFrames > 0)
+    {
+        std::cout << ", " << m_Stats.budgetFrames << " frames at the upload budget";
+    }
+    std::cout << '\n';
+
+    m_Textures.PrintStats();
+}
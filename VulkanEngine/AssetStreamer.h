@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AssetPack.h"
+#include "GpuAllocator.h"
+#include "TextureStreamer.h"
+#include "VulkanFwd.h"
+
+class BindlessDescriptors;
+class UploadEngine;
+struct VulkanDeviceDispatch;
+struct VulkanInstanceDispatch;
+
+// Streams the meshes and textures of an AssetPack onto the GPU by priority.
+//
+// Requests go into a priority queue served by a loader thread. The loader only touches the
+// pages of the requested blob, so the page faults of a cold file are taken off the main
+// thread, and then hands the asset to the main thread. Update creates the buffers and images
+// of ready assets and queues their uploads, at most a byte budget per frame, straight from
+// the mapped file: one copy into the staging ring, no intermediate buffer. When the device
+// has VK_EXT_external_memory_host the whole mapping is imported as a transfer source and
+// even that copy goes away, the GPU reads the page cache itself.
+//
+// Textures only get their tail mips at first; TextureStreamer decides which finer mips follow
+// and which are evicted again, and registers each mip range in the bindless table once its
+// upload is queued. An asset is usable from the frame whose upload flush comes after the
+// Update that queued it.
+class AssetStreamer
+{
+public:
+    static constexpr uint32_t INVALID_ASSET = ~0u;
+
+    // The buffer holds the whole blob; see PackEntry for the layout and MeshFormat.h for the vertices
+    struct Mesh
+    {
+        VkBuffer    buffer          = nullptr;  // vertices, then indices at indexOffset
+        VertexFormat vertexFormat   = VertexFormat::Float;
+        uint32_t    vertexCount     = 0;
+        uint32_t    vertexStride    = 0;
+        uint32_t    indexCount      = 0;
+        uint64_t    indexOffset     = 0;
+        float       boundsMin[3]    = {};       // scale and bias of quantized positions
+        float       boundsExtent[3] = {};
+        uint32_t    meshletCount    = 0;        // PackMeshlets at meshletOffset, 0 without meshlets
+        uint64_t    meshletOffset   = 0;
+        uint64_t    meshletVertexOffset = 0;
+        uint64_t    meshletTriangleOffset = 0;
+    };
+
+    using Texture = TextureStreamer::Texture;
+
+    struct Stats
+    {
+        uint64_t    requests        = 0;
+        uint64_t    meshes          = 0;        // resident
+        uint64_t    textures        = 0;        // with their tail mips
+        uint64_t    failed          = 0;
+        uint64_t    bytesStaged     = 0;        // copied from the mapping into the staging ring
+        uint64_t    bytesImported   = 0;        // read by the GPU from the imported mapping
+        double      totalLatencyMs  = 0.0;      // request to upload queued, summed over assets
+        double      maxLatencyMs    = 0.0;
+        uint64_t    budgetFrames    = 0;        // Update calls that left ready assets for the next frame
+    };
+
+    AssetStreamer() = default;
+    ~AssetStreamer();
+
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    // hostImport asks for the VK_EXT_external_memory_host path, the device has to have been
+    // created with the extension. bindless may be null. textureBudget caps the memory of
+    // resident textures, 0 leaves it to the heap budget. Throws if the pack cannot be opened.
+    void Create(VkPhysicalDevice physicalDevice, const VulkanInstanceDispatch& instanceDispatch, VkDevice device,
+        const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator, BindlessDescriptors* bindless, const std::string& path,
+        bool hostImport, bool bc1, uint64_t frameBudget, uint32_t framesInFlight, uint64_t textureBudget,
+        const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    bool IsCreated() const { return m_Device != nullptr; }
+
+    // Main thread only. Higher priorities are served first, equal ones in request order.
+    // Returns the asset, INVALID_ASSET when the pack has no asset of that name.
+    uint32_t Request(const std::string& name, int priority);
+    uint32_t Request(uint32_t asset, int priority);
+
+    // Requests every asset of the pack, meshes before textures
+    void RequestAll();
+
+    // The texture is drawn this frame and needs mips down to mip; see TextureStreamer
+    void RequestMip(uint32_t asset, uint32_t mip) { m_Textures.RequestMip(asset, mip); }
+
+    // Main thread, once a frame after the frame's fence and before the upload engine is flushed
+    void Update(UploadEngine& uploadEngine, uint32_t frameIndex);
+
+    bool IsResident(uint32_t asset) const { return asset < m_Assets.size() && m_Assets[asset].state == State::Resident; }
+    const Mesh* GetMesh(uint32_t asset) const;
+    const Texture* GetTexture(uint32_t asset) const;
+    const AssetPack& GetPack() const { return m_Pack; }
+    const TextureStreamer& GetTextureStreamer() const { return m_Textures; }
+
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    enum class State
+    {
+        Unrequested,
+        Queued,     // waiting for the loader thread
+        Ready,      // pages touched, waiting for Update
+        Resident,
+        Failed,
+    };
+
+    struct Asset
+    {
+        State                   state       = State::Unrequested;
+        std::chrono::steady_clock::time_point requested;
+        Mesh                    mesh;
+        GpuAllocator::Allocation* allocation = nullptr;     // of the mesh, textures belong to TextureStreamer
+    };
+
+    struct QueuedRequest
+    {
+        int         priority    = 0;
+        uint64_t    sequence    = 0;
+        uint32_t    asset       = 0;
+        uint32_t    mip         = 0;        // textures: finest mip to load
+        bool        badIndices  = false;    // meshes: set by the loader, an index is outside the vertices
+    };
+
+    void CreateHostImport(VkPhysicalDevice physicalDevice, const VulkanInstanceDispatch& instanceDispatch);
+    void Enqueue(const std::vector<QueuedRequest>& requests);
+    void LoaderMain();
+    uint64_t MakeResident(UploadEngine& uploadEngine, const QueuedRequest& request);
+    void CreateMesh(UploadEngine& uploadEngine, const PackEntry& entry, Asset& asset);
+    void DestroyAsset(Asset& asset);
+    void StopLoader();
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    GpuAllocator*                   m_Allocator         = nullptr;
+    BindlessDescriptors*            m_Bindless          = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks         = nullptr;
+    bool                            m_Bc1               = false;    // textureCompressionBC is enabled
+    uint64_t                        m_FrameBudget       = 0;
+
+    AssetPack                       m_Pack;
+    std::vector<Asset>              m_Assets;           // one per pack entry, main thread only
+    TextureStreamer                 m_Textures;
+
+    // The whole mapping as a transfer source, null when importing is off or failed
+    VkBuffer                        m_ImportBuffer      = nullptr;
+    VkDeviceMemory                  m_ImportMemory      = nullptr;
+
+    // Shared with the loader thread. m_Queue is a heap ordered by QueuedRequest priority.
+    std::mutex                      m_Mutex;
+    std::condition_variable         m_Condition;
+    std::vector<QueuedRequest>      m_Queue;
+    std::vector<QueuedRequest>      m_Ready;
+    uint64_t                        m_Sequence          = 0;
+    bool                            m_Stop              = false;
+    std::thread                     m_Loader;
+
+    // Loaded assets Update has not had the budget for yet, main thread only
+    std::vector<QueuedRequest>      m_Loaded;
+
+    Stats                           m_Stats;
+};
@@ -0,0 +1,752 @@
+#include "BenchmarkSuite.h"
+#include "ComputeContext.h"
+#include "GpuAllocator.h"
+#include "HelloTriangleApplication.h"
+#include "PhysicalDeviceSelector.h"
+#include "UploadEngine.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Frames per startup run, enough for the first one to be measured
+constexpr uint32_t STARTUP_FRAMES = 4;
+
+// Frames dropped at the start of the frame scenarios besides the placeholder frames,
+// while caches, the allocator and the driver settle
+constexpr uint32_t WARMUP_FRAMES = 10;
+
+constexpr uint64_t UPLOAD_RING_SIZE = 16ull << 20;
+
+// Workgroup size the compute kernels are specialized with; a scan block is 4 values per invocation
+constexpr uint32_t COMPUTE_GROUP_SIZE = 256;
+constexpr uint32_t COMPUTE_SCAN_BLOCK = COMPUTE_GROUP_SIZE * 4;
+// Partial sums of the first reduction pass, few enough for one workgroup to add up
+constexpr uint32_t COMPUTE_REDUCE_GROUPS = 1024;
+// Back to back runs of a kernel in one timed batch
+constexpr uint32_t COMPUTE_ITERATIONS = 10;
+constexpr uint32_t COMPUTE_SMALL_BATCHES = 1000;
+
+struct BenchOptions
+{
+    std::string                 outputPath          = "bench_results.json";
+    std::string                 baselinePath;
+    double                      thresholdPercent    = 10.0;
+    uint32_t                    repeats             = 5;
+    uint32_t                    frames              = 300;
+    uint32_t                    drawItems           = 10000;
+    uint32_t                    uploadMiB           = 64;
+    uint32_t                    computeElements     = 1u << 24;
+    uint32_t                    width               = 1280;
+    uint32_t                    height              = 720;
+    std::string                 device;
+    std::string                 pipelineCachePath   = "bench_pipeline_cache.bin";
+    std::vector<std::string>    scenarios;          // empty runs all
+};
+
+static void PrintUsage(const char* executable)
+{
+    std::cout << "Usage: " << executable << " [options]\n"
+        << "\t--output <file.json>   Where the results are written (default bench_results.json)\n"
+        << "\t--baseline <file.json> Compare against an earlier report, exit with 2 on regressions\n"
+        << "\t--threshold <percent>  Allowed change of a median before it counts as a regression (default 10)\n"
+        << "\t--scenario <name>      startup, frame, draw, upload or compute; may be repeated (default all)\n"
+        << "\t--repeats <n>          Runs of the startup, upload and compute scenarios (default 5)\n"
+        << "\t--frames <n>           Frames rendered by the frame and draw scenarios (default 300)\n"
+        << "\t--draw-items <n>       Draw list size of the draw scenario (default 10000)\n"
+        << "\t--upload-mib <n>       Size of one upload in the upload scenario (default 64)\n"
+        << "\t--compute-elements <n> Array length of the compute scenario (default 16777216)\n"
+        << "\t--size <w>x<h>         Render target size (default 1280x720)\n"
+        << "\t--device <name|uuid>   Use this device instead of the highest scoring one\n"
+        << "\t                       (also read from VULKAN_ENGINE_DEVICE)\n";
+}
+
+static bool ParseArguments(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (std::strcmp(arg, "--output") == 0 && hasValue)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--baseline") == 0 && hasValue)
+        {
+            options.baselinePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--threshold") == 0 && hasValue)
+        {
+            options.thresholdPercent = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(arg, "--scenario") == 0 && hasValue)
+        {
+            const char* scenario = argv[++i];
+            if (std::strcmp(scenario, "startup") != 0 && std::strcmp(scenario, "frame") != 0
+                && std::strcmp(scenario, "draw") != 0 && std::strcmp(scenario, "upload") != 0
+                && std::strcmp(scenario, "compute") != 0)
+            {
+                std::cerr << "Unknown scenario: " << scenario << std::endl;
+                return false;
+            }
+            options.scenarios.push_back(scenario);
+        }
+        else if (std::strcmp(arg, "--repeats") == 0 && hasValue)
+        {
+            options.repeats = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+        {
+            options.frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--draw-items") == 0 && hasValue)
+        {
+            options.drawItems = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--upload-mib") == 0 && hasValue)
+        {
+            options.uploadMiB = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (std::strcmp(arg, "--compute-elements") == 0 && hasValue)
+        {
+            options.computeElements = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (std::strcmp(arg, "--size") == 0 && hasValue)
+        {
+            char* end = nullptr;
+            unsigned long width = std::strtoul(argv[++i], &end, 10);
+            unsigned long height = (end != nullptr && *end == 'x') ? std::strtoul(end + 1, nullptr, 10) : 0;
+            if (width == 0 || height == 0)
+            {
+                std::cerr << "Invalid size: " << argv[i] << std::endl;
+                return false;
+            }
+            options.width = static_cast<uint32_t>(width);
+            options.height = static_cast<uint32_t>(height);
+        }
+        else if (std::strcmp(arg, "--device") == 0 && hasValue)
+        {
+            options.device = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.frames <= WARMUP_FRAMES)
+    {
+        std::cerr << "Frame scenarios need more than " << WARMUP_FRAMES << " frames" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+static bool ShouldRun(const BenchOptions& options, const char* scenario)
+{
+    return options.scenarios.empty() || std::find(options.scenarios.begin(), options.scenarios.end(), scenario) != options.scenarios.end();
+}
+
+// One headless run of the engine, with the same defaults the executable uses
+static HelloTriangleApplication::RunStats RunEngine(const BenchOptions& options, uint32_t frames, uint32_t drawItems)
+{
+    EngineConfig config;
+    config.headless = true;
+    // Startup is measured to the first frame, placeholder or not
+    config.waitForContent = false;
+    config.width = options.width;
+    config.height = options.height;
+    config.frameCount = frames;
+    config.drawItems = drawItems;
+    config.pipelineCachePath = options.pipelineCachePath;
+    config.deviceOverride = options.device;
+
+    HelloTriangleApplication app(config);
+    app.run();
+    return app.GetRunStats();
+}
+
+// Frames rendered with the real content, after the warm-up
+static std::vector<double> SteadyFrames(const HelloTriangleApplication::RunStats& stats, const std::vector<double>& frameMs)
+{
+    size_t skip = std::min(frameMs.size(), static_cast<size_t>(stats.placeholderFrames + WARMUP_FRAMES));
+    return std::vector<double>(frameMs.begin() + skip, frameMs.end());
+}
+
+// Cold is the first run in the process without a pipeline cache on disk; later runs have
+// the driver loaded and the cache warm. Instance and device creation are taken from every run.
+static void RunStartupScenarios(const BenchOptions& options, std::vector<BenchmarkResult>& results)
+{
+    std::remove(options.pipelineCachePath.c_str());
+
+    BenchmarkResult cold;
+    cold.name = "startup_cold";
+    BenchmarkResult warm;
+    warm.name = "startup_warm";
+    BenchmarkResult instance;
+    instance.name = "instance_creation";
+    BenchmarkResult device;
+    device.name = "device_creation";
+
+    for (uint32_t run = 0; run <= options.repeats; run++)
+    {
+        HelloTriangleApplication::RunStats stats = RunEngine(options, STARTUP_FRAMES, 0);
+        (run == 0 ? cold : warm).samples.push_back(stats.firstFrameMs);
+        instance.samples.push_back(stats.instanceMs);
+        device.samples.push_back(stats.deviceMs);
+    }
+
+    results.push_back(cold);
+    results.push_back(warm);
+    results.push_back(instance);
+    results.push_back(device);
+}
+
+static void RunFrameScenario(const BenchOptions& options, std::vector<BenchmarkResult>& results)
+{
+    HelloTriangleApplication::RunStats stats = RunEngine(options, options.frames, 0);
+
+    BenchmarkResult frameTime;
+    frameTime.name = "frame_time";
+    frameTime.samples = SteadyFrames(stats, stats.frameMs);
+    results.push_back(frameTime);
+}
+
+// CPU time to record and submit a frame of drawItems secondary command buffer draws
+static void RunDrawScenario(const BenchOptions& options, std::vector<BenchmarkResult>& results)
+{
+    HelloTriangleApplication::RunStats stats = RunEngine(options, options.frames, options.drawItems);
+
+    BenchmarkResult submission;
+    submission.name = "draw_submission_" + std::to_string(options.drawItems);
+    submission.samples = SteadyFrames(stats, stats.submitMs);
+    if (submission.samples.empty())
+    {
+        std::cerr << "The draw list was not ready before the last frame, raise --frames" << std::endl;
+    }
+    results.push_back(submission);
+}
+
+// A bare device with one graphics queue, for the scenarios that do not need the renderer
+struct BenchDevice
+{
+    VkInstance          instance        = VK_NULL_HANDLE;
+    VkPhysicalDevice    physicalDevice  = VK_NULL_HANDLE;
+    VkDevice            device          = VK_NULL_HANDLE;
+    VulkanDeviceDispatch dispatch;                      // the engine's subsystems record through it
+    VkQueue             queue           = VK_NULL_HANDLE;
+    uint32_t            queueFamily     = 0;
+    std::string         name;
+};
+
+static uint32_t FindGraphicsFamily(VkPhysicalDevice physicalDevice)
+{
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    for (uint32_t i = 0; i < familyCount; i++)
+    {
+        if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static void DestroyBenchDevice(BenchDevice& bench)
+{
+    if (bench.device != VK_NULL_HANDLE)
+    {
+        vkDestroyDevice(bench.device, nullptr);
+    }
+    if (bench.instance != VK_NULL_HANDLE)
+    {
+        vkDestroyInstance(bench.instance, nullptr);
+    }
+    bench = BenchDevice{};
+}
+
+static BenchDevice CreateBenchDevice(const std::string& deviceOverride)
+{
+    BenchDevice bench;
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "VulkanEngineBench";
+    appInfo.apiVersion = VK_API_VERSION_1_0;
+
+    VkInstanceCreateInfo instanceInfo{};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+
+    if (vkCreateInstance(&instanceInfo, nullptr, &bench.instance) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create instance!");
+    }
+
+    try
+    {
+        PhysicalDeviceSelector selector(bench.instance, VK_API_VERSION_1_0);
+        bench.physicalDevice = selector.Select(
+            [](VkPhysicalDevice device) { return FindGraphicsFamily(device) == UINT32_MAX ? std::string("no graphics queue") : std::string(); },
+            deviceOverride);
+        for (const PhysicalDeviceSelector::Candidate& candidate : selector.GetCandidates())
+        {
+            if (candidate.device == bench.physicalDevice)
+            {
+                bench.name = candidate.name;
+            }
+        }
+
+        bench.queueFamily = FindGraphicsFamily(bench.physicalDevice);
+
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = bench.queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkDeviceCreateInfo deviceInfo{};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+
+        if (vkCreateDevice(bench.physicalDevice, &deviceInfo, nullptr, &bench.device) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create logical device!");
+        }
+
+        bench.dispatch.Load(bench.device, vkGetDeviceProcAddr);
+        vkGetDeviceQueue(bench.device, bench.queueFamily, 0, &bench.queue);
+    }
+    catch (...)
+    {
+        DestroyBenchDevice(bench);
+        throw;
+    }
+
+    return bench;
+}
+
+// Host to device local copies through the UploadEngine staging ring, from the first
+// copy into the ring until the transfer queue is idle
+static void RunUploadScenario(const BenchOptions& options, const BenchDevice& bench, std::vector<BenchmarkResult>& results)
+{
+    GpuAllocator allocator;
+    allocator.Create(bench.physicalDevice, bench.device, bench.dispatch, VK_API_VERSION_1_0, false, nullptr);
+
+    UploadEngine upload;
+    upload.Create(bench.physicalDevice, bench.device, bench.dispatch, bench.queue, bench.queueFamily, bench.queueFamily, UPLOAD_RING_SIZE,
+        nullptr);
+
+    const uint64_t size = static_cast<uint64_t>(options.uploadMiB) << 20;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    if (vkCreateBuffer(bench.device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create upload benchmark buffer!");
+    }
+
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+    GpuAllocator::Allocation* allocation = allocator.AllocateForBuffer(buffer, allocInfo);
+
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 31);
+    }
+
+    BenchmarkResult bandwidth;
+    bandwidth.name = "upload_bandwidth";
+    bandwidth.unit = "GB/s";
+    bandwidth.higherIsBetter = true;
+
+    // The first pass only warms up the ring and the driver
+    for (uint32_t run = 0; run <= options.repeats; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        upload.UploadBuffer(buffer, 0, data.data(), size, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        upload.Flush();
+        upload.WaitIdle();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run > 0)
+        {
+            bandwidth.samples.push_back(size / seconds / 1e9);
+        }
+    }
+    results.push_back(bandwidth);
+
+    vkDestroyBuffer(bench.device, buffer, nullptr);
+    allocator.Free(allocation);
+    upload.Destroy();
+    allocator.Destroy();
+}
+
+static uint32_t GroupCount(uint64_t items, uint32_t itemsPerGroup, uint32_t maxGroups)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>((items + itemsPerGroup - 1) / itemsPerGroup, maxGroups));
+}
+
+static ComputeContext::Handle CreateBenchKernel(ComputeContext& compute, const char* shader, std::vector<ComputeContext::Access> bindings,
+    uint32_t pushConstantSize, bool addBlockSums = false)
+{
+    ComputeContext::KernelDesc desc;
+    desc.path = EngineConfig().shaderDirectory + "/" + shader;
+    desc.bindings = std::move(bindings);
+    desc.pushConstantSize = pushConstantSize;
+    desc.constants.push_back({ 0, COMPUTE_GROUP_SIZE });
+    if (addBlockSums)
+    {
+        desc.constants.push_back({ 1, VK_TRUE });
+    }
+    return compute.CreateKernel(desc);
+}
+
+// A device local buffer with data in it, through a staging buffer that goes away once the copy is done
+static ComputeContext::Handle CreateDeviceBuffer(ComputeContext& compute, const void* data, uint64_t size)
+{
+    ComputeContext::Handle staging = compute.CreateBuffer(size, ComputeContext::Memory::Upload);
+    std::memcpy(compute.GetMapped(staging), data, size);
+
+    ComputeContext::Handle buffer = compute.CreateBuffer(size, ComputeContext::Memory::Device);
+    ComputeContext::Batch batch;
+    batch.Copy(staging, 0, buffer, 0, size);
+    compute.Submit(batch);
+    compute.DestroyBuffer(staging);
+    return buffer;
+}
+
+static void ReadDeviceBuffer(ComputeContext& compute, ComputeContext::Handle buffer, void* data, uint64_t size)
+{
+    ComputeContext::Handle readback = compute.CreateBuffer(size, ComputeContext::Memory::Readback);
+    ComputeContext::Batch batch;
+    batch.Copy(buffer, 0, readback, 0, size);
+    compute.Wait(compute.Submit(batch));
+    std::memcpy(data, compute.GetMapped(readback), size);
+    compute.DestroyBuffer(readback);
+}
+
+// Seconds of every run but the first, which warms up the driver and the caches
+template<typename Run>
+static std::vector<double> TimeComputeRuns(ComputeContext& compute, uint32_t repeats, const Run& run)
+{
+    std::vector<double> seconds;
+    for (uint32_t i = 0; i <= repeats; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        compute.WaitIdle();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (i > 0)
+        {
+            seconds.push_back(elapsed);
+        }
+    }
+    return seconds;
+}
+
+// Memory bound kernels on a headless ComputeContext, checked against the CPU before they are
+// timed: saxpy, a two pass reduction and a multi-level prefix sum. Bandwidth counts the bytes
+// each kernel has to move at least. Last, the cost of submitting many tiny batches, which the
+// context coalesces while the GPU is busy.
+static void RunComputeScenario(const BenchOptions& options, std::vector<BenchmarkResult>& results)
+{
+    using Access = ComputeContext::Access;
+    using Handle = ComputeContext::Handle;
+
+    ComputeContext compute;
+    compute.Create(options.device, "");
+
+    try
+    {
+        const uint32_t count = options.computeElements;
+        const uint64_t size = static_cast<uint64_t>(count) * sizeof(uint32_t);
+        const uint32_t maxGroups = compute.GetMaxGroupCount();
+
+        struct SaxpyConstants
+        {
+            float       a;
+            uint32_t    count;
+        };
+
+        Handle saxpy = CreateBenchKernel(compute, "saxpy.comp.spv", { Access::Read, Access::ReadWrite }, sizeof(SaxpyConstants));
+        Handle reduce = CreateBenchKernel(compute, "reduce.comp.spv", { Access::Read, Access::Write }, sizeof(uint32_t));
+        Handle scan = CreateBenchKernel(compute, "scan.comp.spv", { Access::ReadWrite, Access::Write }, sizeof(uint32_t));
+        Handle addBlockSums = CreateBenchKernel(compute, "scan.comp.spv", { Access::ReadWrite, Access::Read }, sizeof(uint32_t), true);
+
+        std::vector<float> x(count);
+        std::vector<float> y(count);
+        std::vector<uint32_t> values(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            x[i] = static_cast<float>(i % 1000) * 0.001f;
+            y[i] = static_cast<float>(i % 17) * 0.5f;
+            values[i] = i % 7;
+        }
+
+        Handle xBuffer = CreateDeviceBuffer(compute, x.data(), size);
+        Handle yBuffer = CreateDeviceBuffer(compute, y.data(), size);
+        Handle valueBuffer = CreateDeviceBuffer(compute, values.data(), size);
+        Handle partialBuffer = compute.CreateBuffer(COMPUTE_REDUCE_GROUPS * sizeof(uint32_t), ComputeContext::Memory::Device);
+        Handle totalBuffer = compute.CreateBuffer(sizeof(uint32_t), ComputeContext::Memory::Device);
+
+        // The scan works in place on its own copy; every level holds the block totals of the one before
+        std::vector<Handle> scanLevels = { compute.CreateBuffer(size, ComputeContext::Memory::Device) };
+        std::vector<uint32_t> scanCounts = { count };
+        while (true)
+        {
+            uint32_t blocks = (scanCounts.back() + COMPUTE_SCAN_BLOCK - 1) / COMPUTE_SCAN_BLOCK;
+            scanLevels.push_back(compute.CreateBuffer(blocks * sizeof(uint32_t), ComputeContext::Memory::Device));
+            scanCounts.push_back(blocks);
+            if (blocks == 1)
+            {
+                break;
+            }
+        }
+
+        const SaxpyConstants saxpyConstants = { 2.5f, count };
+        const uint32_t saxpyGroups = GroupCount(count, COMPUTE_GROUP_SIZE, maxGroups);
+        const uint32_t reduceGroups = GroupCount(count, COMPUTE_GROUP_SIZE, std::min(maxGroups, COMPUTE_REDUCE_GROUPS));
+
+        auto recordSaxpy = [&](ComputeContext::Batch& batch)
+        {
+            batch.Dispatch(saxpy, { xBuffer, yBuffer }, saxpyGroups, 1, 1, &saxpyConstants, sizeof(saxpyConstants));
+        };
+        auto recordReduce = [&](ComputeContext::Batch& batch)
+        {
+            batch.Dispatch(reduce, { valueBuffer, partialBuffer }, reduceGroups, 1, 1, &count, sizeof(count));
+            batch.Dispatch(reduce, { partialBuffer, totalBuffer }, 1, 1, 1, &reduceGroups, sizeof(reduceGroups));
+        };
+        auto recordScan = [&](ComputeContext::Batch& batch)
+        {
+            for (size_t level = 0; level + 1 < scanLevels.size(); level++)
+            {
+                batch.Dispatch(scan, { scanLevels[level], scanLevels[level + 1] }, GroupCount(scanCounts[level], COMPUTE_SCAN_BLOCK, maxGroups),
+                    1, 1, &scanCounts[level], sizeof(uint32_t));
+            }
+            for (size_t level = scanLevels.size() - 2; level-- > 0;)
+            {
+                batch.Dispatch(addBlockSums, { scanLevels[level], scanLevels[level + 1] },
+                    GroupCount(scanCounts[level], COMPUTE_SCAN_BLOCK, maxGroups), 1, 1, &scanCounts[level], sizeof(uint32_t));
+            }
+        };
+
+        // One run of each, checked on the CPU
+        ComputeContext::Batch batch;
+        recordSaxpy(batch);
+        recordReduce(batch);
+        batch.Copy(valueBuffer, 0, scanLevels[0], 0, size);
+        recordScan(batch);
+        compute.Submit(batch);
+
+        std::vector<float> saxpyResult(count);
+        ReadDeviceBuffer(compute, yBuffer, saxpyResult.data(), size);
+        uint32_t total = 0;
+        ReadDeviceBuffer(compute, totalBuffer, &total, sizeof(total));
+        std::vector<uint32_t> scanResult(count);
+        ReadDeviceBuffer(compute, scanLevels[0], scanResult.data(), size);
+
+        uint32_t expectedTotal = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            float expected = saxpyConstants.a * x[i] + y[i];
+            if (std::abs(saxpyResult[i] - expected) > 1e-5f * std::max(1.0f, std::abs(expected)))
+            {
+                throw std::runtime_error("Compute saxpy result is wrong at element " + std::to_string(i) + "!");
+            }
+
+            expectedTotal += values[i];
+            if (scanResult[i] != expectedTotal)
+            {
+                throw std::runtime_error("Compute scan result is wrong at element " + std::to_string(i) + "!");
+            }
+        }
+        if (total != expectedTotal)
+        {
+            throw std::runtime_error("Compute reduction result is wrong!");
+        }
+
+        auto timeKernel = [&](const char* name, double bytesPerElement, const std::function<void(ComputeContext::Batch&)>& record)
+        {
+            ComputeContext::Batch timed;
+            for (uint32_t i = 0; i < COMPUTE_ITERATIONS; i++)
+            {
+                record(timed);
+            }
+
+            BenchmarkResult bandwidth;
+            bandwidth.name = name;
+            bandwidth.unit = "GB/s";
+            bandwidth.higherIsBetter = true;
+            for (double seconds : TimeComputeRuns(compute, options.repeats, [&]() { compute.Submit(timed); }))
+            {
+                bandwidth.samples.push_back(COMPUTE_ITERATIONS * bytesPerElement * count / seconds / 1e9);
+            }
+            results.push_back(bandwidth);
+        };
+
+        // x and y read, y written; values read once; every value read and written by the scan
+        // and again by the add pass, the levels above are negligible
+        timeKernel("compute_saxpy", 12.0, recordSaxpy);
+        timeKernel("compute_reduce", 4.0, recordReduce);
+        timeKernel("compute_scan", 16.0, recordScan);
+
+        // A batch per dispatch, as a caller that submits its work as it comes would
+        Handle smallX = compute.CreateBuffer(COMPUTE_GROUP_SIZE * sizeof(float), ComputeContext::Memory::Device);
+        Handle smallY = compute.CreateBuffer(COMPUTE_GROUP_SIZE * sizeof(float), ComputeContext::Memory::Device);
+        const SaxpyConstants smallConstants = { 2.5f, COMPUTE_GROUP_SIZE };
+
+        ComputeContext::Batch small;
+        small.Fill(smallX, 0);
+        small.Fill(smallY, 0);
+        compute.Submit(small);
+        small.Clear();
+        small.Dispatch(saxpy, { smallX, smallY }, 1, 1, 1, &smallConstants, sizeof(smallConstants));
+
+        const ComputeContext::Stats before = compute.GetStats();
+        BenchmarkResult batchSubmit;
+        batchSubmit.name = "compute_batch_submit";
+        batchSubmit.unit = "us";
+        for (double seconds : TimeComputeRuns(compute, options.repeats, [&]()
+            {
+                for (uint32_t i = 0; i < COMPUTE_SMALL_BATCHES; i++)
+                {
+                    compute.Submit(small);
+                }
+            }))
+        {
+            batchSubmit.samples.push_back(seconds * 1e6 / COMPUTE_SMALL_BATCHES);
+        }
+        results.push_back(batchSubmit);
+
+        const ComputeContext::Stats& after = compute.GetStats();
+        std::cout << "Compute: " << after.batches - before.batches << " small batches went out in "
+            << after.submits - before.submits << " submits\n";
+    }
+    catch (...)
+    {
+        compute.Destroy();
+        throw;
+    }
+
+    compute.PrintStats();
+    compute.Destroy();
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    if (const char* device = std::getenv("VULKAN_ENGINE_DEVICE"))
+    {
+        options.device = device;
+    }
+
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string deviceName;
+
+    try
+    {
+        // Also names the device in the report, so it is created even without the upload scenario
+        BenchDevice bench = CreateBenchDevice(options.device);
+        deviceName = bench.name;
+        try
+        {
+            if (ShouldRun(options, "upload"))
+            {
+                RunUploadScenario(options, bench, results);
+            }
+        }
+        catch (...)
+        {
+            DestroyBenchDevice(bench);
+            throw;
+        }
+        DestroyBenchDevice(bench);
+
+        // Have their own devices and dispatch tables
+        if (ShouldRun(options, "compute"))
+        {
+            RunComputeScenario(options, results);
+        }
+        if (ShouldRun(options, "startup"))
+        {
+            RunStartupScenarios(options, results);
+        }
+        if (ShouldRun(options, "frame"))
+        {
+            RunFrameScenario(options, results);
+        }
+        if (ShouldRun(options, "draw"))
+        {
+            RunDrawScenario(options, results);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "\nBenchmark results on " << deviceName << ":\n";
+    PrintBenchmarkSummary(results, std::cout);
+
+    if (!WriteBenchmarkReport(options.outputPath, deviceName, results))
+    {
+        std::cerr << "Failed to write " << options.outputPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Results written to " << options.outputPath << '\n';
+
+    if (!options.baselinePath.empty())
+    {
+        std::map<std::string, double> baselineMedians;
+        if (!LoadBenchmarkBaseline(options.baselinePath, baselineMedians))
+        {
+            std::cerr << "Failed to read baseline " << options.baselinePath << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        uint32_t regressions = CompareWithBaseline(results, baselineMedians, options.thresholdPercent, std::cout);
+        if (regressions > 0)
+        {
+            std::cout << regressions << " scenario(s) regressed\n";
+            return 2;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
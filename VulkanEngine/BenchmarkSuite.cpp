@@ -0,0 +1,204 @@
+#include "BenchmarkSuite.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+double BenchmarkResult::Percentile(double percent) const
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+double BenchmarkResult::Mean() const
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+
+    double sum = 0.0;
+    for (double sample : samples)
+    {
+        sum += sample;
+    }
+    return sum / samples.size();
+}
+
+static std::string EscapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+bool WriteBenchmarkReport(const std::string& path, const std::string& device, const std::vector<BenchmarkResult>& results)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    file << std::setprecision(6);
+    file << "{\n  \"device\": \"" << EscapeJson(device) << "\",\n  \"scenarios\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+        auto minmax = std::minmax_element(result.samples.begin(), result.samples.end());
+        double minimum = result.samples.empty() ? 0.0 : *minmax.first;
+        double maximum = result.samples.empty() ? 0.0 : *minmax.second;
+
+        // One scenario per line, LoadBenchmarkBaseline relies on it
+        file << "    { \"name\": \"" << EscapeJson(result.name) << "\", \"unit\": \"" << result.unit
+            << "\", \"higher_is_better\": " << (result.higherIsBetter ? "true" : "false")
+            << ", \"samples\": " << result.samples.size()
+            << ", \"median\": " << result.Median()
+            << ", \"p90\": " << result.Percentile(90.0)
+            << ", \"p99\": " << result.Percentile(99.0)
+            << ", \"min\": " << minimum
+            << ", \"max\": " << maximum
+            << ", \"mean\": " << result.Mean() << " }"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+
+    return static_cast<bool>(file);
+}
+
+// Value of "key": in a line of the report, as written by WriteBenchmarkReport
+static bool FindValue(const std::string& line, const std::string& key, std::string& value)
+{
+    std::string pattern = "\"" + key + "\": ";
+    size_t start = line.find(pattern);
+    if (start == std::string::npos)
+    {
+        return false;
+    }
+    start += pattern.size();
+
+    if (line[start] == '"')
+    {
+        size_t end = line.find('"', start + 1);
+        value = line.substr(start + 1, end - start - 1);
+    }
+    else
+    {
+        size_t end = line.find_first_of(",}", start);
+        value = line.substr(start, end - start);
+    }
+    return true;
+}
+
+bool LoadBenchmarkBaseline(const std::string& path, std::map<std::string, double>& baselineMedians)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::string name;
+        std::string median;
+        if (FindValue(line, "name", name) && FindValue(line, "median", median))
+        {
+            // A hand-edited or truncated baseline only loses the lines it broke
+            const char* begin = median.c_str();
+            char* end = nullptr;
+            double value = std::strtod(begin, &end);
+            if (end == begin || median.find_first_not_of(" \t", end - begin) != std::string::npos)
+            {
+                std::cerr << "Skipping baseline line with invalid median: " << line << std::endl;
+                continue;
+            }
+            baselineMedians[name] = value;
+        }
+    }
+    return true;
+}
+
+void PrintBenchmarkSummary(const std::vector<BenchmarkResult>& results, std::ostream& out)
+{
+    // Restored at the end, the caller's stream keeps its own format
+    const std::ios_base::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+
+    out << std::left << std::setw(28) << "scenario" << std::right << std::setw(8) << "samples" << std::setw(12) << "median"
+        << std::setw(12) << "p90" << std::setw(12) << "p99" << "  unit\n";
+    for (const BenchmarkResult& result : results)
+    {
+        out << std::left << std::setw(28) << result.name << std::right << std::setw(8) << result.samples.size()
+            << std::fixed << std::setprecision(3) << std::setw(12) << result.Median() << std::setw(12) << result.Percentile(90.0)
+            << std::setw(12) << result.Percentile(99.0) << "  " << result.unit << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+uint32_t CompareWithBaseline(const std::vector<BenchmarkResult>& results, const std::map<std::string, double>& baselineMedians,
+    double thresholdPercent, std::ostream& out)
+{
+    uint32_t regressions = 0;
+    const std::ios_base::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+
+    out << "Comparison with baseline, threshold " << thresholdPercent << "%\n";
+    for (const BenchmarkResult& result : results)
+    {
+        auto it = baselineMedians.find(result.name);
+        if (it == baselineMedians.end())
+        {
+            out << "  " << std::left << std::setw(28) << result.name << std::right << " not in baseline\n";
+            continue;
+        }
+
+        double before = it->second;
+        double now = result.Median();
+        double change = before != 0.0 ? (now - before) / before * 100.0 : 0.0;
+
+        // Positive when the scenario got worse, whichever way its numbers point
+        double worse = result.higherIsBetter ? -change : change;
+        bool regressed = worse > thresholdPercent;
+        regressions += regressed ? 1 : 0;
+
+        out << "  " << std::left << std::setw(28) << result.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << before << " -> " << std::setw(12) << now << ' ' << result.unit
+            << std::showpos << std::setprecision(1) << std::setw(9) << change << '%' << std::noshowpos
+            << (regressed ? "  REGRESSION" : "") << '\n';
+    }
+
+    for (const auto& entry : baselineMedians)
+    {
+        bool found = std::any_of(results.begin(), results.end(), [&entry](const BenchmarkResult& result) { return result.name == entry.first; });
+        if (!found)
+        {
+            out << "  " << std::left << std::setw(28) << entry.first << std::right << " not run\n";
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+    return regressions;
+}
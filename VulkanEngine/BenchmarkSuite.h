@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+// Results of the VulkanEngineBench scenarios, their JSON report and the comparison
+// against a stored baseline.
+//
+// A scenario produces samples in one unit. Reports and baselines hold the median and a
+// few percentiles; regressions are judged on the median, which is the least noisy of them.
+
+struct BenchmarkResult
+{
+    std::string         name;
+    std::string         unit            = "ms";
+    bool                higherIsBetter  = false;
+    std::vector<double> samples;
+
+    // Nearest rank percentile, 0 without samples
+    double Percentile(double percent) const;
+    double Median() const { return Percentile(50.0); }
+    double Mean() const;
+};
+
+// JSON with one object per scenario: name, unit, direction, sample count, median, p90, p99, min, max, mean
+bool WriteBenchmarkReport(const std::string& path, const std::string& device, const std::vector<BenchmarkResult>& results);
+
+// Reads the median of every scenario back from a report written by WriteBenchmarkReport
+bool LoadBenchmarkBaseline(const std::string& path, std::map<std::string, double>& baselineMedians);
+
+void PrintBenchmarkSummary(const std::vector<BenchmarkResult>& results, std::ostream& out);
+
+// Prints every scenario next to its baseline and returns how many got worse by more than
+// thresholdPercent. Scenarios missing on either side are reported but never fail.
+uint32_t CompareWithBaseline(const std::vector<BenchmarkResult>& results, const std::map<std::string, double>& baselineMedians,
+    double thresholdPercent, std::ostream& out);
@@ -0,0 +1,413 @@
+#include "BindlessDescriptors.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+constexpr uint32_t KIND_COUNT = static_cast<uint32_t>(BindlessDescriptors::Kind::Count);
+
+// Binding n of the set holds the descriptors of Kind n
+constexpr VkDescriptorType DESCRIPTOR_TYPES[KIND_COUNT] =
+{
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+constexpr const char* KIND_NAMES[KIND_COUNT] = { "sampled images", "samplers", "storage buffers" };
+
+void BindlessDescriptors::Create(VkDevice device, const VulkanDeviceDispatch& dispatch, bool descriptorIndexing,
+    const Capacity& capacity, uint32_t framesInFlight, const VkAllocationCallbacks* callbacks)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Callbacks = callbacks;
+    m_DescriptorIndexing = descriptorIndexing;
+    m_FramesInFlight = std::max(framesInFlight, 1u);
+    m_FrameNumber = 0;
+    m_Stats = Stats{};
+
+    // Shaders declare the arrays with these sizes, so none may be empty
+    const uint32_t capacities[KIND_COUNT] = { capacity.sampledImages, capacity.samplers, capacity.storageBuffers };
+    for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+    {
+        m_Bindings[kind] = Binding{};
+        m_Bindings[kind].capacity = std::max(capacities[kind], 1u);
+        m_Bindings[kind].slots.resize(m_Bindings[kind].capacity);
+    }
+
+    VkDescriptorSetLayoutBinding bindings[KIND_COUNT]{};
+    VkDescriptorBindingFlags bindingFlags[KIND_COUNT]{};
+    for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+    {
+        bindings[kind].binding = kind;
+        bindings[kind].descriptorType = DESCRIPTOR_TYPES[kind];
+        bindings[kind].descriptorCount = m_Bindings[kind].capacity;
+        bindings[kind].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // Slots nobody reads need no valid descriptor, and can be written while frames that
+        // do not read them are in flight
+        bindingFlags[kind] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = KIND_COUNT;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = KIND_COUNT;
+    layoutInfo.pBindings = bindings;
+    if (m_DescriptorIndexing)
+    {
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    }
+
+    if (m_Dispatch->vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Callbacks, &m_SetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create bindless descriptor set layout!");
+    }
+
+    const uint32_t setCount = m_DescriptorIndexing ? 1 : m_FramesInFlight;
+
+    VkDescriptorPoolSize poolSizes[KIND_COUNT]{};
+    for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+    {
+        poolSizes[kind].type = DESCRIPTOR_TYPES[kind];
+        poolSizes[kind].descriptorCount = m_Bindings[kind].capacity * setCount;
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = m_DescriptorIndexing ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = KIND_COUNT;
+    poolInfo.pPoolSizes = poolSizes;
+
+    if (m_Dispatch->vkCreateDescriptorPool(m_Device, &poolInfo, m_Callbacks, &m_DescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create bindless descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(setCount, m_SetLayout);
+    std::vector<VkDescriptorSet> sets(setCount);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_DescriptorPool;
+    allocInfo.descriptorSetCount = setCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (m_Dispatch->vkAllocateDescriptorSets(m_Device, &allocInfo, sets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate bindless descriptor sets!");
+    }
+
+    m_Sets.resize(setCount);
+    for (uint32_t i = 0; i < setCount; i++)
+    {
+        m_Sets[i].set = sets[i];
+        for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+        {
+            m_Sets[i].dirty[kind].assign(m_Bindings[kind].capacity, 0);
+        }
+    }
+
+    // Plain sets have to be fully written before they are bound, every slot starts out
+    // waiting for the default descriptor
+    if (!m_DescriptorIndexing)
+    {
+        for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+        {
+            for (uint32_t index = 0; index < m_Bindings[kind].capacity; index++)
+            {
+                MarkDirty(static_cast<Kind>(kind), index);
+            }
+        }
+    }
+}
+
+void BindlessDescriptors::Destroy()
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    // Frees the sets as well
+    if (m_DescriptorPool != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyDescriptorPool(m_Device, m_DescriptorPool, m_Callbacks);
+    }
+    if (m_SetLayout != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, m_Callbacks);
+    }
+
+    m_DescriptorPool = VK_NULL_HANDLE;
+    m_SetLayout = VK_NULL_HANDLE;
+    m_Sets.clear();
+    for (Binding& binding : m_Bindings)
+    {
+        binding = Binding{};
+    }
+    m_Device = nullptr;
+}
+
+uint32_t BindlessDescriptors::AddSampledImage(VkImageView view, uint32_t layout)
+{
+    Slot slot;
+    slot.view = view;
+    slot.layout = layout;
+    return Add(Kind::SampledImage, slot);
+}
+
+uint32_t BindlessDescriptors::AddSampler(VkSampler sampler)
+{
+    Slot slot;
+    slot.sampler = sampler;
+    return Add(Kind::Sampler, slot);
+}
+
+uint32_t BindlessDescriptors::AddStorageBuffer(VkBuffer buffer, uint64_t offset, uint64_t range)
+{
+    Slot slot;
+    slot.buffer = buffer;
+    slot.offset = offset;
+    slot.range = range;
+    return Add(Kind::StorageBuffer, slot);
+}
+
+// Recycled slots are preferred, so the arrays stay as short as the number of live resources allows
+uint32_t BindlessDescriptors::Add(Kind kind, const Slot& slot)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Binding& binding = m_Bindings[static_cast<size_t>(kind)];
+    uint32_t index = 0;
+    if (!binding.freeSlots.empty())
+    {
+        index = binding.freeSlots.back();
+        binding.freeSlots.pop_back();
+    }
+    else if (binding.next < binding.capacity)
+    {
+        index = binding.next++;
+    }
+    else
+    {
+        throw std::runtime_error(std::string("Bindless descriptor table is out of ") + KIND_NAMES[static_cast<size_t>(kind)] + "!");
+    }
+
+    binding.slots[index] = slot;
+    binding.slots[index].used = true;
+    binding.live++;
+    binding.peak = std::max(binding.peak, binding.live);
+    m_Stats.registrations++;
+
+    MarkDirty(kind, index);
+
+    // Empty slots of plain sets copy slot 0, which just changed
+    if (!m_DescriptorIndexing && index == 0)
+    {
+        for (uint32_t i = 1; i < binding.capacity; i++)
+        {
+            if (!binding.slots[i].used)
+            {
+                MarkDirty(kind, i);
+            }
+        }
+    }
+    return index;
+}
+
+void BindlessDescriptors::Release(Kind kind, uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Binding& binding = m_Bindings[static_cast<size_t>(kind)];
+    if (index >= binding.capacity || !binding.slots[index].used)
+    {
+        throw std::runtime_error("Released a bindless descriptor slot that is not in use!");
+    }
+
+    binding.slots[index] = Slot{};
+    binding.live--;
+    m_Stats.releases++;
+
+    ReleasedSlot released;
+    released.index = index;
+    released.frame = m_FrameNumber;
+    binding.released.push_back(released);
+
+    // Partially bound sets can keep the stale descriptor, nothing reads it
+    if (!m_DescriptorIndexing)
+    {
+        MarkDirty(kind, index);
+    }
+}
+
+void BindlessDescriptors::MarkDirty(Kind kind, uint32_t index)
+{
+    const size_t k = static_cast<size_t>(kind);
+    for (Set& set : m_Sets)
+    {
+        if (!set.dirty[k][index])
+        {
+            set.dirty[k][index] = 1;
+            set.pending[k].push_back(index);
+        }
+    }
+}
+
+void BindlessDescriptors::BeginFrame(uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    m_FrameNumber++;
+
+    // A slot released while frame N was recorded is free once frame N + framesInFlight begins,
+    // its fence has been waited for by then
+    for (Binding& binding : m_Bindings)
+    {
+        auto recycled = std::remove_if(binding.released.begin(), binding.released.end(), [&](const ReleasedSlot& released)
+        {
+            if (released.frame + m_FramesInFlight > m_FrameNumber)
+            {
+                return false;
+            }
+            binding.freeSlots.push_back(released.index);
+            return true;
+        });
+        binding.released.erase(recycled, binding.released.end());
+    }
+
+    Flush(m_DescriptorIndexing ? m_Sets[0] : m_Sets[frameIndex % m_Sets.size()]);
+}
+
+// Sorts each binding's pending slots and writes every run of consecutive slots with one
+// VkWriteDescriptorSet. Slots that cannot be written yet (plain sets before slot 0 exists)
+// stay pending.
+void BindlessDescriptors::Flush(Set& set)
+{
+    size_t pendingCount = 0;
+    for (const std::vector<uint32_t>& pending : set.pending)
+    {
+        pendingCount += pending.size();
+    }
+    if (pendingCount == 0)
+    {
+        return;
+    }
+
+    // Reserved up front, the writes point into them
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::vector<VkDescriptorBufferInfo> bufferInfos;
+    imageInfos.reserve(pendingCount);
+    bufferInfos.reserve(pendingCount);
+    std::vector<VkWriteDescriptorSet> writes;
+    uint64_t descriptors = 0;
+
+    for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+    {
+        const Binding& binding = m_Bindings[kind];
+        std::vector<uint32_t>& pending = set.pending[kind];
+        std::sort(pending.begin(), pending.end());
+
+        std::vector<uint32_t> deferred;
+        uint32_t runEnd = UINT32_MAX;
+        for (uint32_t index : pending)
+        {
+            const Slot* slot = &binding.slots[index];
+            if (!slot->used)
+            {
+                if (m_DescriptorIndexing)
+                {
+                    set.dirty[kind][index] = 0;
+                    continue;
+                }
+                if (!binding.slots[0].used)
+                {
+                    deferred.push_back(index);
+                    continue;
+                }
+                slot = &binding.slots[0];
+            }
+            set.dirty[kind][index] = 0;
+
+            // Either extends the previous write or starts a new one
+            if (index != runEnd)
+            {
+                VkWriteDescriptorSet write{};
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = set.set;
+                write.dstBinding = kind;
+                write.dstArrayElement = index;
+                write.descriptorType = DESCRIPTOR_TYPES[kind];
+                if (DESCRIPTOR_TYPES[kind] == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                {
+                    write.pBufferInfo = bufferInfos.data() + bufferInfos.size();
+                }
+                else
+                {
+                    write.pImageInfo = imageInfos.data() + imageInfos.size();
+                }
+                writes.push_back(write);
+            }
+            writes.back().descriptorCount++;
+            runEnd = index + 1;
+            descriptors++;
+
+            if (DESCRIPTOR_TYPES[kind] == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+            {
+                bufferInfos.push_back({ slot->buffer, slot->offset, slot->range });
+            }
+            else
+            {
+                imageInfos.push_back({ slot->sampler, slot->view, static_cast<VkImageLayout>(slot->layout) });
+            }
+        }
+        pending.swap(deferred);
+    }
+
+    if (writes.empty())
+    {
+        return;
+    }
+
+    m_Dispatch->vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    m_Stats.flushes++;
+    m_Stats.descriptors += descriptors;
+    m_Stats.writes += writes.size();
+}
+
+VkDescriptorSet BindlessDescriptors::GetSet(uint32_t frameIndex) const
+{
+    return m_DescriptorIndexing ? m_Sets[0].set : m_Sets[frameIndex % m_Sets.size()].set;
+}
+
+void BindlessDescriptors::PrintStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (m_Stats.registrations == 0)
+    {
+        return;
+    }
+
+    std::cout << "Bindless descriptors: " << (m_DescriptorIndexing ? "one update-after-bind set" : "a plain set per frame in flight")
+        << ", peak";
+    for (uint32_t kind = 0; kind < KIND_COUNT; kind++)
+    {
+        std::cout << (kind == 0 ? " " : ", ") << m_Bindings[kind].peak << "/" << m_Bindings[kind].capacity << " " << KIND_NAMES[kind];
+    }
+    std::cout << ", " << m_Stats.registrations << " registered and " << m_Stats.releases << " released, "
+        << m_Stats.descriptors << " descriptors written with " << m_Stats.writes << " writes in " << m_Stats.flushes << " batches\n";
+}
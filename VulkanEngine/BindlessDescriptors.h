@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// One descriptor table for every sampled image, sampler and storage buffer, so shaders pick
+// resources by index and draws never rebind descriptor sets.
+//
+// Binding 0 is an array of sampled images, binding 1 of samplers and binding 2 of storage
+// buffers. Registering a resource hands out a slot that stays valid until it is released;
+// released slots are recycled once every frame in flight that could still read them has
+// finished. Writes are queued and applied in BeginFrame, coalesced into one
+// vkUpdateDescriptorSets with a single write per run of consecutive slots.
+//
+// With descriptor indexing (Vulkan 1.2 or VK_EXT_descriptor_indexing) the table is a single
+// update-after-bind, partially bound set: slots can be written while earlier frames are still
+// in flight and empty slots need no valid descriptor. Without it every frame in flight gets its
+// own plain set, written when BeginFrame starts that frame, and empty or released slots point
+// at slot 0 of their binding, so the first resource registered of each kind should be a
+// default one. Shaders are the same in both cases: they index the arrays with dynamically
+// uniform values, which the core shader*ArrayDynamicIndexing features allow.
+class BindlessDescriptors
+{
+public:
+    enum class Kind
+    {
+        SampledImage,
+        Sampler,
+        StorageBuffer,
+        Count
+    };
+
+    struct Capacity
+    {
+        uint32_t    sampledImages   = 0;
+        uint32_t    samplers        = 0;
+        uint32_t    storageBuffers  = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t    registrations   = 0;
+        uint64_t    releases        = 0;
+        uint64_t    flushes         = 0;    // BeginFrame calls that had writes
+        uint64_t    descriptors     = 0;    // descriptors written
+        uint64_t    writes          = 0;    // VkWriteDescriptorSet structures they took
+    };
+
+    // descriptorIndexing selects the update-after-bind table, the device has to have been
+    // created with the features it needs (see the class comment)
+    void Create(VkDevice device, const VulkanDeviceDispatch& dispatch, bool descriptorIndexing, const Capacity& capacity,
+        uint32_t framesInFlight, const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    // Thread safe. The resource has to stay alive until the slot is released and the frames
+    // in flight have finished. Throws when the binding is full.
+    uint32_t AddSampledImage(VkImageView view, uint32_t layout);    // VkImageLayout
+    uint32_t AddSampler(VkSampler sampler);
+    uint32_t AddStorageBuffer(VkBuffer buffer, uint64_t offset, uint64_t range);
+    void Release(Kind kind, uint32_t index);
+
+    // Called after the fence of frameIndex was waited for and before the frame is recorded.
+    // Applies the queued writes and recycles slots no frame in flight can read any more.
+    void BeginFrame(uint32_t frameIndex);
+
+    // The set to bind while recording frameIndex
+    VkDescriptorSet GetSet(uint32_t frameIndex) const;
+    VkDescriptorSetLayout GetSetLayout() const { return m_SetLayout; }
+    uint32_t GetCapacity(Kind kind) const { return m_Bindings[static_cast<size_t>(kind)].capacity; }
+    bool UsesDescriptorIndexing() const { return m_DescriptorIndexing; }
+
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // What a slot holds, the fields that apply to its binding are set
+    struct Slot
+    {
+        VkImageView view        = nullptr;
+        uint32_t    layout      = 0;        // VkImageLayout
+        VkSampler   sampler     = nullptr;
+        VkBuffer    buffer      = nullptr;
+        uint64_t    offset      = 0;
+        uint64_t    range       = 0;
+        bool        used        = false;
+    };
+
+    struct ReleasedSlot
+    {
+        uint32_t    index       = 0;
+        uint64_t    frame       = 0;        // frame number of the release
+    };
+
+    struct Binding
+    {
+        uint32_t                    capacity    = 0;
+        std::vector<Slot>           slots;
+        uint32_t                    next        = 0;    // slots below were handed out at least once
+        std::vector<uint32_t>       freeSlots;
+        std::vector<ReleasedSlot>   released;
+        uint32_t                    live        = 0;
+        uint32_t                    peak        = 0;
+    };
+
+    // A set with its own list of slots whose descriptors are out of date
+    struct Set
+    {
+        VkDescriptorSet             set         = nullptr;
+        std::vector<uint8_t>        dirty[static_cast<size_t>(Kind::Count)];
+        std::vector<uint32_t>       pending[static_cast<size_t>(Kind::Count)];
+    };
+
+    uint32_t Add(Kind kind, const Slot& slot);
+    void MarkDirty(Kind kind, uint32_t index);
+    void Flush(Set& set);
+
+    VkDevice                        m_Device                = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch              = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks             = nullptr;
+    bool                            m_DescriptorIndexing    = false;
+    uint32_t                        m_FramesInFlight        = 1;
+
+    VkDescriptorSetLayout           m_SetLayout             = nullptr;
+    VkDescriptorPool                m_DescriptorPool        = nullptr;
+    std::vector<Set>                m_Sets;                 // one with descriptor indexing, else one per frame in flight
+
+    // Guards the bindings and the pending lists, registration runs on loading threads
+    mutable std::mutex              m_Mutex;
+    Binding                         m_Bindings[static_cast<size_t>(Kind::Count)];
+    uint64_t                        m_FrameNumber           = 0;
+
+    Stats                           m_Stats;
+};
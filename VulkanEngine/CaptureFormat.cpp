@@ -0,0 +1,1032 @@
+#include "CaptureFormat.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    // End of a serialized pNext chain, never a structure type that is captured
+    constexpr VkStructureType CHAIN_END = VK_STRUCTURE_TYPE_MAX_ENUM;
+
+    // Structures that hold nothing but plain values after sType and pNext are copied as a block
+    template <typename Stream, typename T>
+    void SerializeTail(Stream& stream, T& structure)
+    {
+        constexpr size_t offset = offsetof(T, pNext) + sizeof(structure.pNext);
+        stream.Bytes(reinterpret_cast<uint8_t*>(&structure) + offset, sizeof(T) - offset);
+    }
+
+    // Which of the info arrays of a descriptor write the driver reads
+    bool IsImageDescriptor(VkDescriptorType type)
+    {
+        return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+            || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+            || type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    }
+
+    bool IsBufferDescriptor(VkDescriptorType type)
+    {
+        return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+            || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    }
+
+    template <typename Stream>
+    void SerializeChained(Stream& stream, VkBaseOutStructure* structure)
+    {
+        switch (structure->sType)
+        {
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2:
+            Serialize(stream, reinterpret_cast<VkPhysicalDeviceFeatures2*>(structure)->features);
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES:
+            SerializeTail(stream, *reinterpret_cast<VkPhysicalDeviceVulkan12Features*>(structure));
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES:
+            SerializeTail(stream, *reinterpret_cast<VkPhysicalDeviceDescriptorIndexingFeatures*>(structure));
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES:
+            SerializeTail(stream, *reinterpret_cast<VkPhysicalDeviceSynchronization2Features*>(structure));
+            break;
+        case VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO:
+        {
+            auto& flags = *reinterpret_cast<VkDescriptorSetLayoutBindingFlagsCreateInfo*>(structure);
+            stream.Value(flags.bindingCount);
+            stream.ValueArray(flags.pBindingFlags, flags.bindingCount);
+            break;
+        }
+        case VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO:
+        {
+            auto& dedicated = *reinterpret_cast<VkMemoryDedicatedAllocateInfo*>(structure);
+            stream.Handle(dedicated.image);
+            stream.Handle(dedicated.buffer);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Size of the structures SerializeChained knows, 0 for the others
+    size_t GetChainedSize(VkStructureType type)
+    {
+        switch (type)
+        {
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2:
+            return sizeof(VkPhysicalDeviceFeatures2);
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES:
+            return sizeof(VkPhysicalDeviceVulkan12Features);
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES:
+            return sizeof(VkPhysicalDeviceDescriptorIndexingFeatures);
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES:
+            return sizeof(VkPhysicalDeviceSynchronization2Features);
+        case VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO:
+            return sizeof(VkDescriptorSetLayoutBindingFlagsCreateInfo);
+        case VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO:
+            return sizeof(VkMemoryDedicatedAllocateInfo);
+        default:
+            return 0;
+        }
+    }
+
+    const char* const COMMAND_NAMES[] =
+    {
+        "Invalid",
+        "Device",
+        "FrameEnd",
+        "WriteMemory",
+        "GetDeviceQueue",
+        "QueueSubmit",
+        "QueueWaitIdle",
+        "DeviceWaitIdle",
+        "CreateFence",
+        "DestroyFence",
+        "ResetFences",
+        "WaitForFences",
+        "GetFenceStatus",
+        "CreateSemaphore",
+        "DestroySemaphore",
+        "AllocateMemory",
+        "FreeMemory",
+        "MapMemory",
+        "UnmapMemory",
+        "BindBufferMemory",
+        "BindImageMemory",
+        "CreateBuffer",
+        "DestroyBuffer",
+        "CreateImage",
+        "DestroyImage",
+        "CreateImageView",
+        "DestroyImageView",
+        "CreateSampler",
+        "DestroySampler",
+        "CreateQueryPool",
+        "DestroyQueryPool",
+        "CreateShaderModule",
+        "DestroyShaderModule",
+        "CreatePipelineCache",
+        "DestroyPipelineCache",
+        "CreatePipelineLayout",
+        "DestroyPipelineLayout",
+        "CreateGraphicsPipelines",
+        "CreateComputePipelines",
+        "DestroyPipeline",
+        "CreateDescriptorSetLayout",
+        "DestroyDescriptorSetLayout",
+        "CreateDescriptorPool",
+        "DestroyDescriptorPool",
+        "AllocateDescriptorSets",
+        "UpdateDescriptorSets",
+        "CreateRenderPass",
+        "DestroyRenderPass",
+        "CreateFramebuffer",
+        "DestroyFramebuffer",
+        "CreateCommandPool",
+        "DestroyCommandPool",
+        "ResetCommandPool",
+        "AllocateCommandBuffers",
+        "FreeCommandBuffers",
+        "BeginCommandBuffer",
+        "EndCommandBuffer",
+        "CreateSwapchain",
+        "DestroySwapchain",
+        "GetSwapchainImages",
+        "AcquireNextImage",
+        "QueuePresent",
+        "CmdBindPipeline",
+        "CmdSetViewport",
+        "CmdSetScissor",
+        "CmdBindDescriptorSets",
+        "CmdPushConstants",
+        "CmdBindVertexBuffers",
+        "CmdBindIndexBuffer",
+        "CmdDraw",
+        "CmdDrawIndexed",
+        "CmdDrawIndirect",
+        "CmdDrawIndexedIndirect",
+        "CmdDrawIndexedIndirectCount",
+        "CmdDispatch",
+        "CmdCopyBuffer",
+        "CmdFillBuffer",
+        "CmdCopyBufferToImage",
+        "CmdCopyImageToBuffer",
+        "CmdClearAttachments",
+        "CmdPipelineBarrier",
+        "CmdPipelineBarrier2",
+        "CmdBeginQuery",
+        "CmdEndQuery",
+        "CmdResetQueryPool",
+        "CmdWriteTimestamp",
+        "CmdBeginRenderPass",
+        "CmdEndRenderPass",
+        "CmdExecuteCommands",
+    };
+
+    static_assert(sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]) == static_cast<size_t>(CaptureCommand::Count),
+        "Every capture command needs a name");
+}
+
+void CaptureHandleMap::Add(CaptureObject type, uint64_t id, uint64_t handle)
+{
+    m_Maps[static_cast<size_t>(type)][id] = handle;
+}
+
+void CaptureHandleMap::Remove(CaptureObject type, uint64_t id)
+{
+    m_Maps[static_cast<size_t>(type)].erase(id);
+}
+
+uint64_t CaptureHandleMap::Find(CaptureObject type, uint64_t id) const
+{
+    if (id == 0)
+    {
+        return 0;
+    }
+    const auto& map = m_Maps[static_cast<size_t>(type)];
+    auto it = map.find(id);
+    if (it == map.end())
+    {
+        throw std::runtime_error("Capture uses a handle that was never created!");
+    }
+    return it->second;
+}
+
+bool CaptureHandleMap::Contains(CaptureObject type, uint64_t id) const
+{
+    return m_Maps[static_cast<size_t>(type)].count(id) != 0;
+}
+
+void CaptureWriter::Begin(CaptureCommand command)
+{
+    m_PacketStart = m_Bytes.size();
+    CapturePacketHeader header;
+    header.command = static_cast<uint16_t>(command);
+    Value(header);
+}
+
+void CaptureWriter::End()
+{
+    const uint32_t size = static_cast<uint32_t>(m_Bytes.size() - m_PacketStart - sizeof(CapturePacketHeader));
+    std::memcpy(m_Bytes.data() + m_PacketStart + offsetof(CapturePacketHeader, size), &size, sizeof(size));
+}
+
+void CaptureWriter::Bytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    m_Bytes.insert(m_Bytes.end(), bytes, bytes + size);
+}
+
+void CaptureWriter::String(const char* const& string)
+{
+    const uint32_t length = string != nullptr ? static_cast<uint32_t>(std::strlen(string)) : 0;
+    Value(length);
+    Bytes(string, length);
+}
+
+void CaptureWriter::StringArray(const char* const* const& strings, uint32_t count)
+{
+    Present(strings);
+    for (uint32_t i = 0; strings != nullptr && i < count; i++)
+    {
+        String(strings[i]);
+    }
+}
+
+void CaptureWriter::Data(const void* const& data, size_t size)
+{
+    Present(data);
+    if (data != nullptr)
+    {
+        Bytes(data, size);
+    }
+}
+
+void CaptureWriter::Chain(const void* const& next)
+{
+    for (auto* structure = static_cast<const VkBaseInStructure*>(next); structure != nullptr; structure = structure->pNext)
+    {
+        if (GetChainedSize(structure->sType) != 0)
+        {
+            Value(structure->sType);
+            SerializeChained(*this, reinterpret_cast<VkBaseOutStructure*>(const_cast<VkBaseInStructure*>(structure)));
+        }
+    }
+    Value(CHAIN_END);
+}
+
+void CaptureReader::Reset(const uint8_t* data, size_t size)
+{
+    m_Data = data;
+    m_End = data + size;
+    m_Arena.clear();
+}
+
+void CaptureReader::Bytes(void* data, size_t size)
+{
+    std::memcpy(data, Skip(size), size);
+}
+
+const uint8_t* CaptureReader::Skip(size_t size)
+{
+    if (static_cast<size_t>(m_End - m_Data) < size)
+    {
+        throw std::runtime_error("Capture packet is truncated!");
+    }
+    const uint8_t* data = m_Data;
+    m_Data += size;
+    return data;
+}
+
+void CaptureReader::Family(uint32_t& family)
+{
+    // VK_QUEUE_FAMILY_IGNORED and the external families are kept
+    Value(family);
+    if (family < m_Families.size())
+    {
+        family = m_Families[family];
+    }
+}
+
+void CaptureReader::Layout(VkImageLayout& layout)
+{
+    Value(layout);
+    if (layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+    {
+        layout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+}
+
+void CaptureReader::String(const char*& string)
+{
+    const uint32_t length = Value<uint32_t>();
+    char* characters = Allocate<char>(length + 1);
+    Bytes(characters, length);
+    string = characters;
+}
+
+void CaptureReader::StringArray(const char* const*& strings, uint32_t count)
+{
+    strings = nullptr;
+    if (Present())
+    {
+        const char** elements = Allocate<const char*>(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            String(elements[i]);
+        }
+        strings = elements;
+    }
+}
+
+void CaptureReader::Data(const void*& data, size_t size)
+{
+    data = nullptr;
+    if (Present())
+    {
+        data = Skip(size);
+    }
+}
+
+void CaptureReader::Chain(const void*& next)
+{
+    next = nullptr;
+    VkBaseOutStructure* last = nullptr;
+    for (VkStructureType type = Value<VkStructureType>(); type != CHAIN_END; type = Value<VkStructureType>())
+    {
+        const size_t size = GetChainedSize(type);
+        if (size == 0)
+        {
+            throw std::runtime_error("Capture contains an unknown structure type!");
+        }
+
+        auto* structure = reinterpret_cast<VkBaseOutStructure*>(Allocate<uint8_t>(size));
+        structure->sType = type;
+        SerializeChained(*this, structure);
+        if (last != nullptr)
+        {
+            last->pNext = structure;
+        }
+        else
+        {
+            next = structure;
+        }
+        last = structure;
+    }
+}
+
+const char* GetCaptureCommandName(CaptureCommand command)
+{
+    const size_t index = static_cast<size_t>(command);
+    return index < static_cast<size_t>(CaptureCommand::Count) ? COMMAND_NAMES[index] : "Unknown";
+}
+
+// Reading fills in sType, writing skips it; pNext is only serialized where the engine chains something
+
+#define CAPTURE_STRUCTURE_TYPE(info, type) \
+    if constexpr (Stream::IS_READING) \
+    { \
+        info.sType = type; \
+    }
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDeviceQueueCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO)
+    stream.Value(info.flags);
+    // The replayer picks its own families from the capabilities, not the index
+    stream.Value(info.queueFamilyIndex);
+    stream.Value(info.queueCount);
+    stream.ValueArray(info.pQueuePriorities, info.queueCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDeviceCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO)
+    stream.Chain(info.pNext);
+    stream.Value(info.flags);
+    stream.Value(info.queueCreateInfoCount);
+    stream.Array(info.pQueueCreateInfos, info.queueCreateInfoCount);
+    // Layers are the replayer's choice
+    stream.Value(info.enabledExtensionCount);
+    stream.StringArray(info.ppEnabledExtensionNames, info.enabledExtensionCount);
+    stream.Optional(info.pEnabledFeatures);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPhysicalDeviceFeatures& features)
+{
+    stream.Value(features);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkMemoryAllocateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO)
+    stream.Chain(info.pNext);
+    stream.Value(info.allocationSize);
+    stream.Value(info.memoryTypeIndex);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkBufferCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.size);
+    stream.Value(info.usage);
+    stream.Value(info.sharingMode);
+    stream.Value(info.queueFamilyIndexCount);
+    stream.ValueArray(info.pQueueFamilyIndices, info.queueFamilyIndexCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkImageCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.imageType);
+    stream.Value(info.format);
+    stream.Value(info.extent);
+    stream.Value(info.mipLevels);
+    stream.Value(info.arrayLayers);
+    stream.Value(info.samples);
+    stream.Value(info.tiling);
+    stream.Value(info.usage);
+    stream.Value(info.sharingMode);
+    stream.Value(info.queueFamilyIndexCount);
+    stream.ValueArray(info.pQueueFamilyIndices, info.queueFamilyIndexCount);
+    stream.Layout(info.initialLayout);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkImageViewCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Handle(info.image);
+    stream.Value(info.viewType);
+    stream.Value(info.format);
+    stream.Value(info.components);
+    stream.Value(info.subresourceRange);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSamplerCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkQueryPoolCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkShaderModuleCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.codeSize);
+    stream.ValueArray(info.pCode, static_cast<uint32_t>(info.codeSize / sizeof(uint32_t)));
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineCacheCreateInfo& info)
+{
+    // The initial data only means something to the driver that wrote it
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO)
+    stream.Value(info.flags);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineLayoutCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.setLayoutCount);
+    stream.HandleArray(info.pSetLayouts, info.setLayoutCount);
+    stream.Value(info.pushConstantRangeCount);
+    stream.ValueArray(info.pPushConstantRanges, info.pushConstantRangeCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSpecializationInfo& info)
+{
+    stream.Value(info.mapEntryCount);
+    stream.ValueArray(info.pMapEntries, info.mapEntryCount);
+    stream.Value(info.dataSize);
+    stream.Data(info.pData, info.dataSize);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineShaderStageCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.stage);
+    stream.Handle(info.module);
+    stream.String(info.pName);
+    stream.Optional(info.pSpecializationInfo);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineVertexInputStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.vertexBindingDescriptionCount);
+    stream.ValueArray(info.pVertexBindingDescriptions, info.vertexBindingDescriptionCount);
+    stream.Value(info.vertexAttributeDescriptionCount);
+    stream.ValueArray(info.pVertexAttributeDescriptions, info.vertexAttributeDescriptionCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineInputAssemblyStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineTessellationStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineViewportStateCreateInfo& info)
+{
+    // Usually dynamic, then only the counts matter
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.viewportCount);
+    stream.ValueArray(info.pViewports, info.viewportCount);
+    stream.Value(info.scissorCount);
+    stream.ValueArray(info.pScissors, info.scissorCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineRasterizationStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineMultisampleStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.rasterizationSamples);
+    stream.Value(info.sampleShadingEnable);
+    stream.Value(info.minSampleShading);
+    stream.ValueArray(info.pSampleMask, (static_cast<uint32_t>(info.rasterizationSamples) + 31) / 32);
+    stream.Value(info.alphaToCoverageEnable);
+    stream.Value(info.alphaToOneEnable);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineDepthStencilStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO)
+    SerializeTail(stream, info);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineColorBlendStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.logicOpEnable);
+    stream.Value(info.logicOp);
+    stream.Value(info.attachmentCount);
+    stream.ValueArray(info.pAttachments, info.attachmentCount);
+    stream.Value(info.blendConstants);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkPipelineDynamicStateCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.dynamicStateCount);
+    stream.ValueArray(info.pDynamicStates, info.dynamicStateCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkGraphicsPipelineCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.stageCount);
+    stream.Array(info.pStages, info.stageCount);
+    stream.Optional(info.pVertexInputState);
+    stream.Optional(info.pInputAssemblyState);
+    stream.Optional(info.pTessellationState);
+    stream.Optional(info.pViewportState);
+    stream.Optional(info.pRasterizationState);
+    stream.Optional(info.pMultisampleState);
+    stream.Optional(info.pDepthStencilState);
+    stream.Optional(info.pColorBlendState);
+    stream.Optional(info.pDynamicState);
+    stream.Handle(info.layout);
+    stream.Handle(info.renderPass);
+    stream.Value(info.subpass);
+    stream.Handle(info.basePipelineHandle);
+    stream.Value(info.basePipelineIndex);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkComputePipelineCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO)
+    stream.Value(info.flags);
+    Serialize(stream, info.stage);
+    stream.Handle(info.layout);
+    stream.Handle(info.basePipelineHandle);
+    stream.Value(info.basePipelineIndex);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorSetLayoutBinding& binding)
+{
+    stream.Value(binding.binding);
+    stream.Value(binding.descriptorType);
+    stream.Value(binding.descriptorCount);
+    stream.Value(binding.stageFlags);
+    stream.HandleArray(binding.pImmutableSamplers, binding.descriptorCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorSetLayoutCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO)
+    stream.Chain(info.pNext);
+    stream.Value(info.flags);
+    stream.Value(info.bindingCount);
+    stream.Array(info.pBindings, info.bindingCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorPoolCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.maxSets);
+    stream.Value(info.poolSizeCount);
+    stream.ValueArray(info.pPoolSizes, info.poolSizeCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorSetAllocateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO)
+    stream.Handle(info.descriptorPool);
+    stream.Value(info.descriptorSetCount);
+    stream.HandleArray(info.pSetLayouts, info.descriptorSetCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorImageInfo& info)
+{
+    stream.Handle(info.sampler);
+    stream.Handle(info.imageView);
+    stream.Layout(info.imageLayout);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDescriptorBufferInfo& info)
+{
+    stream.Handle(info.buffer);
+    stream.Value(info.offset);
+    stream.Value(info.range);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkWriteDescriptorSet& write)
+{
+    // Only the array the descriptor type uses, the others may point anywhere. Texel buffer
+    // views are not used by the engine and not captured.
+    CAPTURE_STRUCTURE_TYPE(write, VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET)
+    stream.Handle(write.dstSet);
+    stream.Value(write.dstBinding);
+    stream.Value(write.dstArrayElement);
+    stream.Value(write.descriptorCount);
+    stream.Value(write.descriptorType);
+    if (IsImageDescriptor(write.descriptorType))
+    {
+        stream.Array(write.pImageInfo, write.descriptorCount);
+    }
+    else if (IsBufferDescriptor(write.descriptorType))
+    {
+        stream.Array(write.pBufferInfo, write.descriptorCount);
+    }
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkAttachmentDescription& attachment)
+{
+    stream.Value(attachment.flags);
+    stream.Value(attachment.format);
+    stream.Value(attachment.samples);
+    stream.Value(attachment.loadOp);
+    stream.Value(attachment.storeOp);
+    stream.Value(attachment.stencilLoadOp);
+    stream.Value(attachment.stencilStoreOp);
+    stream.Layout(attachment.initialLayout);
+    stream.Layout(attachment.finalLayout);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkAttachmentReference& reference)
+{
+    stream.Value(reference.attachment);
+    stream.Layout(reference.layout);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSubpassDescription& subpass)
+{
+    stream.Value(subpass.flags);
+    stream.Value(subpass.pipelineBindPoint);
+    stream.Value(subpass.inputAttachmentCount);
+    stream.Array(subpass.pInputAttachments, subpass.inputAttachmentCount);
+    stream.Value(subpass.colorAttachmentCount);
+    stream.Array(subpass.pColorAttachments, subpass.colorAttachmentCount);
+    stream.Array(subpass.pResolveAttachments, subpass.colorAttachmentCount);
+    stream.Optional(subpass.pDepthStencilAttachment);
+    stream.Value(subpass.preserveAttachmentCount);
+    stream.ValueArray(subpass.pPreserveAttachments, subpass.preserveAttachmentCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkRenderPassCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Value(info.attachmentCount);
+    stream.Array(info.pAttachments, info.attachmentCount);
+    stream.Value(info.subpassCount);
+    stream.Array(info.pSubpasses, info.subpassCount);
+    stream.Value(info.dependencyCount);
+    stream.ValueArray(info.pDependencies, info.dependencyCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkFramebufferCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Handle(info.renderPass);
+    stream.Value(info.attachmentCount);
+    stream.HandleArray(info.pAttachments, info.attachmentCount);
+    stream.Value(info.width);
+    stream.Value(info.height);
+    stream.Value(info.layers);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkCommandPoolCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO)
+    stream.Value(info.flags);
+    stream.Family(info.queueFamilyIndex);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkCommandBufferAllocateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO)
+    stream.Handle(info.commandPool);
+    stream.Value(info.level);
+    stream.Value(info.commandBufferCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkCommandBufferInheritanceInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO)
+    stream.Handle(info.renderPass);
+    stream.Value(info.subpass);
+    stream.Handle(info.framebuffer);
+    stream.Value(info.occlusionQueryEnable);
+    stream.Value(info.queryFlags);
+    stream.Value(info.pipelineStatistics);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkCommandBufferBeginInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO)
+    stream.Value(info.flags);
+    stream.Optional(info.pInheritanceInfo);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkFenceCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_FENCE_CREATE_INFO)
+    stream.Value(info.flags);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSemaphoreCreateInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO)
+    stream.Value(info.flags);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSubmitInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_SUBMIT_INFO)
+    stream.Value(info.waitSemaphoreCount);
+    stream.HandleArray(info.pWaitSemaphores, info.waitSemaphoreCount);
+    stream.ValueArray(info.pWaitDstStageMask, info.waitSemaphoreCount);
+    stream.Value(info.commandBufferCount);
+    stream.HandleArray(info.pCommandBuffers, info.commandBufferCount);
+    stream.Value(info.signalSemaphoreCount);
+    stream.HandleArray(info.pSignalSemaphores, info.signalSemaphoreCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkSwapchainCreateInfoKHR& info)
+{
+    // Only what the replayer needs to create stand-in images; the surface and the old
+    // swapchain belong to the window system
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR)
+    stream.Value(info.flags);
+    stream.Value(info.minImageCount);
+    stream.Value(info.imageFormat);
+    stream.Value(info.imageColorSpace);
+    stream.Value(info.imageExtent);
+    stream.Value(info.imageArrayLayers);
+    stream.Value(info.imageUsage);
+    stream.Value(info.imageSharingMode);
+    stream.Value(info.queueFamilyIndexCount);
+    stream.ValueArray(info.pQueueFamilyIndices, info.queueFamilyIndexCount);
+    stream.Value(info.presentMode);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkMemoryBarrier& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER)
+    SerializeTail(stream, barrier);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkBufferMemoryBarrier& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER)
+    stream.Value(barrier.srcAccessMask);
+    stream.Value(barrier.dstAccessMask);
+    stream.Family(barrier.srcQueueFamilyIndex);
+    stream.Family(barrier.dstQueueFamilyIndex);
+    stream.Handle(barrier.buffer);
+    stream.Value(barrier.offset);
+    stream.Value(barrier.size);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkImageMemoryBarrier& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER)
+    stream.Value(barrier.srcAccessMask);
+    stream.Value(barrier.dstAccessMask);
+    stream.Layout(barrier.oldLayout);
+    stream.Layout(barrier.newLayout);
+    stream.Family(barrier.srcQueueFamilyIndex);
+    stream.Family(barrier.dstQueueFamilyIndex);
+    stream.Handle(barrier.image);
+    stream.Value(barrier.subresourceRange);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkMemoryBarrier2& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_MEMORY_BARRIER_2)
+    SerializeTail(stream, barrier);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkBufferMemoryBarrier2& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2)
+    stream.Value(barrier.srcStageMask);
+    stream.Value(barrier.srcAccessMask);
+    stream.Value(barrier.dstStageMask);
+    stream.Value(barrier.dstAccessMask);
+    stream.Family(barrier.srcQueueFamilyIndex);
+    stream.Family(barrier.dstQueueFamilyIndex);
+    stream.Handle(barrier.buffer);
+    stream.Value(barrier.offset);
+    stream.Value(barrier.size);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkImageMemoryBarrier2& barrier)
+{
+    CAPTURE_STRUCTURE_TYPE(barrier, VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2)
+    stream.Value(barrier.srcStageMask);
+    stream.Value(barrier.srcAccessMask);
+    stream.Value(barrier.dstStageMask);
+    stream.Value(barrier.dstAccessMask);
+    stream.Layout(barrier.oldLayout);
+    stream.Layout(barrier.newLayout);
+    stream.Family(barrier.srcQueueFamilyIndex);
+    stream.Family(barrier.dstQueueFamilyIndex);
+    stream.Handle(barrier.image);
+    stream.Value(barrier.subresourceRange);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkDependencyInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_DEPENDENCY_INFO)
+    stream.Value(info.dependencyFlags);
+    stream.Value(info.memoryBarrierCount);
+    stream.Array(info.pMemoryBarriers, info.memoryBarrierCount);
+    stream.Value(info.bufferMemoryBarrierCount);
+    stream.Array(info.pBufferMemoryBarriers, info.bufferMemoryBarrierCount);
+    stream.Value(info.imageMemoryBarrierCount);
+    stream.Array(info.pImageMemoryBarriers, info.imageMemoryBarrierCount);
+}
+
+template <typename Stream>
+void Serialize(Stream& stream, VkRenderPassBeginInfo& info)
+{
+    CAPTURE_STRUCTURE_TYPE(info, VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO)
+    stream.Handle(info.renderPass);
+    stream.Handle(info.framebuffer);
+    stream.Value(info.renderArea);
+    stream.Value(info.clearValueCount);
+    stream.ValueArray(info.pClearValues, info.clearValueCount);
+}
+
+#undef CAPTURE_STRUCTURE_TYPE
+
+#define CAPTURE_INSTANTIATE(type) \
+    template void Serialize<CaptureWriter>(CaptureWriter&, type&); \
+    template void Serialize<CaptureReader>(CaptureReader&, type&);
+
+CAPTURE_INSTANTIATE(VkDeviceQueueCreateInfo)
+CAPTURE_INSTANTIATE(VkDeviceCreateInfo)
+CAPTURE_INSTANTIATE(VkPhysicalDeviceFeatures)
+CAPTURE_INSTANTIATE(VkMemoryAllocateInfo)
+CAPTURE_INSTANTIATE(VkBufferCreateInfo)
+CAPTURE_INSTANTIATE(VkImageCreateInfo)
+CAPTURE_INSTANTIATE(VkImageViewCreateInfo)
+CAPTURE_INSTANTIATE(VkSamplerCreateInfo)
+CAPTURE_INSTANTIATE(VkQueryPoolCreateInfo)
+CAPTURE_INSTANTIATE(VkShaderModuleCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineCacheCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineLayoutCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineShaderStageCreateInfo)
+CAPTURE_INSTANTIATE(VkSpecializationInfo)
+CAPTURE_INSTANTIATE(VkPipelineVertexInputStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineInputAssemblyStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineTessellationStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineViewportStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineRasterizationStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineMultisampleStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineDepthStencilStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineColorBlendStateCreateInfo)
+CAPTURE_INSTANTIATE(VkPipelineDynamicStateCreateInfo)
+CAPTURE_INSTANTIATE(VkGraphicsPipelineCreateInfo)
+CAPTURE_INSTANTIATE(VkComputePipelineCreateInfo)
+CAPTURE_INSTANTIATE(VkDescriptorSetLayoutBinding)
+CAPTURE_INSTANTIATE(VkDescriptorSetLayoutCreateInfo)
+CAPTURE_INSTANTIATE(VkDescriptorPoolCreateInfo)
+CAPTURE_INSTANTIATE(VkDescriptorSetAllocateInfo)
+CAPTURE_INSTANTIATE(VkDescriptorImageInfo)
+CAPTURE_INSTANTIATE(VkDescriptorBufferInfo)
+CAPTURE_INSTANTIATE(VkWriteDescriptorSet)
+CAPTURE_INSTANTIATE(VkAttachmentDescription)
+CAPTURE_INSTANTIATE(VkAttachmentReference)
+CAPTURE_INSTANTIATE(VkSubpassDescription)
+CAPTURE_INSTANTIATE(VkRenderPassCreateInfo)
+CAPTURE_INSTANTIATE(VkFramebufferCreateInfo)
+CAPTURE_INSTANTIATE(VkCommandPoolCreateInfo)
+CAPTURE_INSTANTIATE(VkCommandBufferAllocateInfo)
+CAPTURE_INSTANTIATE(VkCommandBufferInheritanceInfo)
+CAPTURE_INSTANTIATE(VkCommandBufferBeginInfo)
+CAPTURE_INSTANTIATE(VkFenceCreateInfo)
+CAPTURE_INSTANTIATE(VkSemaphoreCreateInfo)
+CAPTURE_INSTANTIATE(VkSubmitInfo)
+CAPTURE_INSTANTIATE(VkSwapchainCreateInfoKHR)
+CAPTURE_INSTANTIATE(VkMemoryBarrier)
+CAPTURE_INSTANTIATE(VkBufferMemoryBarrier)
+CAPTURE_INSTANTIATE(VkImageMemoryBarrier)
+CAPTURE_INSTANTIATE(VkMemoryBarrier2)
+CAPTURE_INSTANTIATE(VkBufferMemoryBarrier2)
+CAPTURE_INSTANTIATE(VkImageMemoryBarrier2)
+CAPTURE_INSTANTIATE(VkDependencyInfo)
+CAPTURE_INSTANTIATE(VkRenderPassBeginInfo)
+
+#undef CAPTURE_INSTANTIATE
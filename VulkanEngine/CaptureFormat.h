@@ -0,0 +1,488 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Like VulkanDispatch.h this needs the structure definitions, it is only included by the
+// capture itself and the replayer
+#include <vulkan/vulkan.h>
+
+// The file CommandCapture writes and CaptureReplay runs.
+//
+// A capture is a CaptureFileHeader followed by packets, each a CapturePacketHeader and size
+// bytes of payload. The payload is the arguments of one Vulkan call in the order the call
+// takes them: structures member by member, arrays as a count and their elements, strings with
+// their length, handles as the 64-bit value the capturing driver returned. The replayer maps
+// those to the handles its own driver returns. Output handles follow the inputs. pNext chains
+// keep the structures the engine uses and drop the others, which only carry feedback or
+// things the replayer does differently (host memory import, pipeline creation feedback).
+//
+// Values are written in host byte order, little endian everywhere the engine runs.
+
+// Non-dispatchable handles are only distinct types, which CaptureObjectOf relies on, on 64-bit targets
+static_assert(sizeof(void*) == 8, "Captures need a 64-bit build");
+
+constexpr uint32_t CAPTURE_MAGIC = 0x50434B56;      // "VKCP"
+constexpr uint32_t CAPTURE_VERSION = 1;
+
+struct CaptureFileHeader
+{
+    uint32_t    magic       = CAPTURE_MAGIC;
+    uint32_t    version     = CAPTURE_VERSION;
+    uint32_t    firstFrame  = 0;    // the range the capture was asked for, the file may end earlier
+    uint32_t    lastFrame   = 0;
+};
+
+struct CapturePacketHeader
+{
+    uint16_t    command     = 0;    // CaptureCommand
+    uint16_t    reserved    = 0;
+    uint32_t    size        = 0;    // payload bytes after the header
+};
+
+static_assert(sizeof(CaptureFileHeader) == 16, "CaptureFileHeader is part of the file format");
+static_assert(sizeof(CapturePacketHeader) == 8, "CapturePacketHeader is part of the file format");
+
+enum class CaptureCommand : uint16_t
+{
+    // Capture bookkeeping
+    Device = 1,             // device properties and the VkDeviceCreateInfo, always the first packet
+    FrameEnd,               // frame number
+    WriteMemory,            // memory, offset, bytes the CPU wrote through a mapping
+
+    GetDeviceQueue,
+    QueueSubmit,
+    QueueWaitIdle,
+    DeviceWaitIdle,
+
+    CreateFence,
+    DestroyFence,
+    ResetFences,
+    WaitForFences,          // only recorded when the wait succeeded
+    GetFenceStatus,         // only recorded when the fence was signaled
+    CreateSemaphore,
+    DestroySemaphore,
+
+    AllocateMemory,
+    FreeMemory,
+    MapMemory,
+    UnmapMemory,
+    BindBufferMemory,
+    BindImageMemory,
+
+    CreateBuffer,
+    DestroyBuffer,
+    CreateImage,
+    DestroyImage,
+    CreateImageView,
+    DestroyImageView,
+    CreateSampler,
+    DestroySampler,
+    CreateQueryPool,
+    DestroyQueryPool,
+
+    CreateShaderModule,
+    DestroyShaderModule,
+    CreatePipelineCache,
+    DestroyPipelineCache,
+    CreatePipelineLayout,
+    DestroyPipelineLayout,
+    CreateGraphicsPipelines,
+    CreateComputePipelines,
+    DestroyPipeline,
+
+    CreateDescriptorSetLayout,
+    DestroyDescriptorSetLayout,
+    CreateDescriptorPool,
+    DestroyDescriptorPool,
+    AllocateDescriptorSets,
+    UpdateDescriptorSets,
+
+    CreateRenderPass,
+    DestroyRenderPass,
+    CreateFramebuffer,
+    DestroyFramebuffer,
+
+    CreateCommandPool,
+    DestroyCommandPool,
+    ResetCommandPool,
+    AllocateCommandBuffers,
+    FreeCommandBuffers,
+    BeginCommandBuffer,
+    EndCommandBuffer,
+
+    CreateSwapchain,
+    DestroySwapchain,
+    GetSwapchainImages,
+    AcquireNextImage,
+    QueuePresent,
+
+    CmdBindPipeline,
+    CmdSetViewport,
+    CmdSetScissor,
+    CmdBindDescriptorSets,
+    CmdPushConstants,
+    CmdBindVertexBuffers,
+    CmdBindIndexBuffer,
+    CmdDraw,
+    CmdDrawIndexed,
+    CmdDrawIndirect,
+    CmdDrawIndexedIndirect,
+    CmdDrawIndexedIndirectCount,
+    CmdDispatch,
+    CmdCopyBuffer,
+    CmdFillBuffer,
+    CmdCopyBufferToImage,
+    CmdCopyImageToBuffer,
+    CmdClearAttachments,
+    CmdPipelineBarrier,
+    CmdPipelineBarrier2,
+    CmdBeginQuery,
+    CmdEndQuery,
+    CmdResetQueryPool,
+    CmdWriteTimestamp,
+    CmdBeginRenderPass,
+    CmdEndRenderPass,
+    CmdExecuteCommands,
+
+    Count
+};
+
+// Handle types, each has its own id space in the replayer
+enum class CaptureObject : uint32_t
+{
+    Queue,
+    CommandBuffer,
+    Fence,
+    Semaphore,
+    DeviceMemory,
+    Buffer,
+    Image,
+    ImageView,
+    Sampler,
+    QueryPool,
+    ShaderModule,
+    PipelineCache,
+    PipelineLayout,
+    Pipeline,
+    DescriptorSetLayout,
+    DescriptorPool,
+    DescriptorSet,
+    RenderPass,
+    Framebuffer,
+    CommandPool,
+    Swapchain,
+    Count
+};
+
+template <typename T>
+struct CaptureObjectOf;
+
+#define CAPTURE_OBJECT_OF(handle, object) \
+    template <> struct CaptureObjectOf<handle> { static constexpr CaptureObject value = CaptureObject::object; };
+
+CAPTURE_OBJECT_OF(VkQueue, Queue)
+CAPTURE_OBJECT_OF(VkCommandBuffer, CommandBuffer)
+CAPTURE_OBJECT_OF(VkFence, Fence)
+CAPTURE_OBJECT_OF(VkSemaphore, Semaphore)
+CAPTURE_OBJECT_OF(VkDeviceMemory, DeviceMemory)
+CAPTURE_OBJECT_OF(VkBuffer, Buffer)
+CAPTURE_OBJECT_OF(VkImage, Image)
+CAPTURE_OBJECT_OF(VkImageView, ImageView)
+CAPTURE_OBJECT_OF(VkSampler, Sampler)
+CAPTURE_OBJECT_OF(VkQueryPool, QueryPool)
+CAPTURE_OBJECT_OF(VkShaderModule, ShaderModule)
+CAPTURE_OBJECT_OF(VkPipelineCache, PipelineCache)
+CAPTURE_OBJECT_OF(VkPipelineLayout, PipelineLayout)
+CAPTURE_OBJECT_OF(VkPipeline, Pipeline)
+CAPTURE_OBJECT_OF(VkDescriptorSetLayout, DescriptorSetLayout)
+CAPTURE_OBJECT_OF(VkDescriptorPool, DescriptorPool)
+CAPTURE_OBJECT_OF(VkDescriptorSet, DescriptorSet)
+CAPTURE_OBJECT_OF(VkRenderPass, RenderPass)
+CAPTURE_OBJECT_OF(VkFramebuffer, Framebuffer)
+CAPTURE_OBJECT_OF(VkCommandPool, CommandPool)
+CAPTURE_OBJECT_OF(VkSwapchainKHR, Swapchain)
+
+#undef CAPTURE_OBJECT_OF
+
+// Captured handle values and what they became in the replay. 0 always maps to VK_NULL_HANDLE.
+class CaptureHandleMap
+{
+public:
+    void Add(CaptureObject type, uint64_t id, uint64_t handle);
+    void Remove(CaptureObject type, uint64_t id);
+    // Throws for an id that was never added, the capture is broken or out of order
+    uint64_t Find(CaptureObject type, uint64_t id) const;
+    bool Contains(CaptureObject type, uint64_t id) const;
+
+    template <typename T>
+    void Add(uint64_t id, T handle) { Add(CaptureObjectOf<T>::value, id, reinterpret_cast<uint64_t>(handle)); }
+    template <typename T>
+    T Find(uint64_t id) const { return reinterpret_cast<T>(Find(CaptureObjectOf<T>::value, id)); }
+
+private:
+    std::unordered_map<uint64_t, uint64_t> m_Maps[static_cast<size_t>(CaptureObject::Count)];
+};
+
+// Appends a packet to a byte vector. Serialize takes non-const references so the same
+// function reads and writes; the writer never modifies what it is given.
+class CaptureWriter
+{
+public:
+    static constexpr bool IS_READING = false;
+
+    explicit CaptureWriter(std::vector<uint8_t>& bytes) : m_Bytes(bytes) {}
+
+    // Packets are written into the vector in place, End fills in the size
+    void Begin(CaptureCommand command);
+    void End();
+
+    void Bytes(const void* data, size_t size);
+
+    template <typename T>
+    void Value(const T& value) { Bytes(&value, sizeof(T)); }
+
+    template <typename T>
+    void Handle(const T& handle) { Value(reinterpret_cast<uint64_t>(handle)); }
+
+    void Family(const uint32_t& family) { Value(family); }
+    void Layout(const VkImageLayout& layout) { Value(layout); }
+    void String(const char* const& string);
+    void StringArray(const char* const* const& strings, uint32_t count);
+
+    // Element arrays whose count the caller serialized before. A null array is written as
+    // absent even when the count is not 0, as some optional arrays are.
+    template <typename T>
+    void ValueArray(const T* const& array, uint32_t count)
+    {
+        Present(array);
+        if (array != nullptr)
+        {
+            Bytes(array, sizeof(T) * count);
+        }
+    }
+
+    template <typename T>
+    void HandleArray(const T* const& array, uint32_t count)
+    {
+        Present(array);
+        for (uint32_t i = 0; array != nullptr && i < count; i++)
+        {
+            Handle(array[i]);
+        }
+    }
+
+    // Structures with a Serialize overload
+    template <typename T>
+    void Array(const T* const& array, uint32_t count);
+    template <typename T>
+    void Optional(const T* const& pointer);
+
+    // Untyped data of a known size, such as push constants and specialization data
+    void Data(const void* const& data, size_t size);
+
+    void Chain(const void* const& next);
+
+private:
+    void Present(const void* pointer) { Value(static_cast<uint8_t>(pointer != nullptr ? 1 : 0)); }
+
+    std::vector<uint8_t>&   m_Bytes;
+    size_t                  m_PacketStart = 0;
+};
+
+// Reads one packet's payload. Arrays and chained structures are allocated from the reader and
+// stay valid until the next Reset. Handles are translated through the handle map, queue
+// families through the family table, and the presentation layout becomes GENERAL since the
+// replay renders into plain images.
+class CaptureReader
+{
+public:
+    static constexpr bool IS_READING = true;
+
+    CaptureReader(const CaptureHandleMap& handles, const std::vector<uint32_t>& families) : m_Handles(handles), m_Families(families) {}
+
+    void Reset(const uint8_t* data, size_t size);
+    bool AtEnd() const { return m_Data == m_End; }
+
+    void Bytes(void* data, size_t size);
+    // Points into the packet instead of copying
+    const uint8_t* Skip(size_t size);
+
+    template <typename T>
+    void Value(T& value) { Bytes(&value, sizeof(T)); }
+    template <typename T>
+    T Value() { T value{}; Value(value); return value; }
+
+    template <typename T>
+    void Handle(T& handle) { handle = m_Handles.Find<T>(Value<uint64_t>()); }
+    template <typename T>
+    T Handle() { return m_Handles.Find<T>(Value<uint64_t>()); }
+
+    void Family(uint32_t& family);
+    void Layout(VkImageLayout& layout);
+    void String(const char*& string);
+    void StringArray(const char* const*& strings, uint32_t count);
+
+    template <typename T>
+    void ValueArray(const T*& array, uint32_t count)
+    {
+        array = nullptr;
+        if (Present())
+        {
+            T* elements = Allocate<T>(count);
+            Bytes(elements, sizeof(T) * count);
+            array = elements;
+        }
+    }
+
+    template <typename T>
+    void HandleArray(const T*& array, uint32_t count)
+    {
+        array = nullptr;
+        if (Present())
+        {
+            T* elements = Allocate<T>(count);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                Handle(elements[i]);
+            }
+            array = elements;
+        }
+    }
+
+    template <typename T>
+    void Array(const T*& array, uint32_t count);
+    template <typename T>
+    void Optional(const T*& pointer);
+
+    void Data(const void*& data, size_t size);
+
+    void Chain(const void*& next);
+
+    // Zeroed storage that lives until the next Reset
+    template <typename T>
+    T* Allocate(size_t count)
+    {
+        m_Arena.push_back(std::make_unique<uint64_t[]>((sizeof(T) * count + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1));
+        return reinterpret_cast<T*>(m_Arena.back().get());
+    }
+
+private:
+    bool Present() { return Value<uint8_t>() != 0; }
+
+    const CaptureHandleMap&                     m_Handles;
+    const std::vector<uint32_t>&                m_Families;
+    const uint8_t*                              m_Data  = nullptr;
+    const uint8_t*                              m_End   = nullptr;
+    std::vector<std::unique_ptr<uint64_t[]>>    m_Arena;
+};
+
+// The create infos and other structures of the captured calls. Instantiated for CaptureWriter
+// and CaptureReader in CaptureFormat.cpp.
+template <typename Stream> void Serialize(Stream& stream, VkDeviceQueueCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDeviceCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPhysicalDeviceFeatures& features);
+template <typename Stream> void Serialize(Stream& stream, VkMemoryAllocateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkBufferCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkImageCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkImageViewCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkSamplerCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkQueryPoolCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkShaderModuleCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineCacheCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineLayoutCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineShaderStageCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkSpecializationInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineVertexInputStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineInputAssemblyStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineTessellationStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineViewportStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineRasterizationStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineMultisampleStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineDepthStencilStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineColorBlendStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkPipelineDynamicStateCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkGraphicsPipelineCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkComputePipelineCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorSetLayoutBinding& binding);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorSetLayoutCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorPoolCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorSetAllocateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorImageInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkDescriptorBufferInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkWriteDescriptorSet& write);
+template <typename Stream> void Serialize(Stream& stream, VkAttachmentDescription& attachment);
+template <typename Stream> void Serialize(Stream& stream, VkAttachmentReference& reference);
+template <typename Stream> void Serialize(Stream& stream, VkSubpassDescription& subpass);
+template <typename Stream> void Serialize(Stream& stream, VkRenderPassCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkFramebufferCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkCommandPoolCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkCommandBufferAllocateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkCommandBufferInheritanceInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkCommandBufferBeginInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkFenceCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkSemaphoreCreateInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkSubmitInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkSwapchainCreateInfoKHR& info);
+template <typename Stream> void Serialize(Stream& stream, VkMemoryBarrier& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkBufferMemoryBarrier& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkImageMemoryBarrier& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkMemoryBarrier2& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkBufferMemoryBarrier2& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkImageMemoryBarrier2& barrier);
+template <typename Stream> void Serialize(Stream& stream, VkDependencyInfo& info);
+template <typename Stream> void Serialize(Stream& stream, VkRenderPassBeginInfo& info);
+
+template <typename T>
+void CaptureWriter::Array(const T* const& array, uint32_t count)
+{
+    Present(array);
+    for (uint32_t i = 0; array != nullptr && i < count; i++)
+    {
+        Serialize(*this, const_cast<T&>(array[i]));
+    }
+}
+
+template <typename T>
+void CaptureWriter::Optional(const T* const& pointer)
+{
+    Present(pointer);
+    if (pointer != nullptr)
+    {
+        Serialize(*this, const_cast<T&>(*pointer));
+    }
+}
+
+template <typename T>
+void CaptureReader::Array(const T*& array, uint32_t count)
+{
+    array = nullptr;
+    if (Present())
+    {
+        T* elements = Allocate<T>(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Serialize(*this, elements[i]);
+        }
+        array = elements;
+    }
+}
+
+template <typename T>
+void CaptureReader::Optional(const T*& pointer)
+{
+    pointer = nullptr;
+    if (Present())
+    {
+        T* element = Allocate<T>(1);
+        Serialize(*this, *element);
+        pointer = element;
+    }
+}
+
+// Name of a command for reports
+const char* GetCaptureCommandName(CaptureCommand command);
@@ -0,0 +1,2105 @@
+#include "BenchmarkSuite.h"
+#include "CaptureFormat.h"
+#include "PhysicalDeviceSelector.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Replays a capture written with --capture: the frames before the captured range once to set
+// up the resources, then the range in a loop with GPU timestamps around every submission.
+//
+// The replay runs headless. Queue families and memory types are matched to the captured ones
+// by what they can do, swapchains become plain images, and acquire and present become empty
+// submissions that signal and wait on the same semaphores. A resource whose captured memory
+// binding does not fit the requirements of this device gets memory of its own; what the
+// capture writes into the original memory is copied there as well.
+
+// Waits the capture saw succeed should succeed here too, one that does not is reported
+// instead of hanging the replay
+constexpr uint64_t FENCE_TIMEOUT_NS = 5ull * 1000 * 1000 * 1000;
+
+constexpr uint32_t MAX_VULKAN_API_VERSION = VK_API_VERSION_1_3;
+
+struct ReplayOptions
+{
+    std::string     capturePath;
+    std::string     outputPath;
+    std::string     baselinePath;
+    double          thresholdPercent    = 10.0;
+    uint32_t        loops               = 10;
+    std::string     device;
+};
+
+static void PrintUsage(const char* executable)
+{
+    std::cout << "Usage: " << executable << " <capture> [options]\n"
+        << "\t--loops <n>            Times the captured frames are replayed (default 10)\n"
+        << "\t--output <file.json>   Write the timings as a benchmark report\n"
+        << "\t--baseline <file.json> Compare against an earlier report, exit with 2 on regressions\n"
+        << "\t--threshold <percent>  Allowed change of a median before it counts as a regression (default 10)\n"
+        << "\t--device <name|uuid>   Use this device instead of the highest scoring one\n"
+        << "\t                       (also read from VULKAN_ENGINE_DEVICE)\n";
+}
+
+static bool ParseArguments(int argc, char* argv[], ReplayOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (std::strcmp(arg, "--loops") == 0 && hasValue)
+        {
+            options.loops = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+        }
+        else if (std::strcmp(arg, "--output") == 0 && hasValue)
+        {
+            options.outputPath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--baseline") == 0 && hasValue)
+        {
+            options.baselinePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--threshold") == 0 && hasValue)
+        {
+            options.thresholdPercent = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(arg, "--device") == 0 && hasValue)
+        {
+            options.device = argv[++i];
+        }
+        else if (arg[0] != '-' && options.capturePath.empty())
+        {
+            options.capturePath = arg;
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.capturePath.empty())
+    {
+        std::cerr << "No capture given" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open capture file!");
+    }
+
+    std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return data;
+}
+
+static uint32_t CountBits(uint32_t value)
+{
+    uint32_t count = 0;
+    for (; value != 0; value &= value - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+class Replayer
+{
+public:
+    struct Stats
+    {
+        uint32_t    rebinds             = 0;    // resources that got memory of their own
+        uint32_t    fenceTimeouts       = 0;
+        uint32_t    deferredDestroys    = 0;    // setup objects the loop destroyed, kept until the end
+    };
+
+    Replayer() : m_Reader(m_Handles, m_Families) {}
+
+    void Load(const std::string& path);
+    void CreateDevice(const std::string& deviceOverride);
+    void Run(uint32_t loops);
+    void Destroy();
+
+    const std::string& GetDeviceName() const { return m_DeviceName; }
+    std::vector<BenchmarkResult> GetResults() const;
+    void PrintStats() const;
+
+private:
+    struct Packet
+    {
+        CaptureCommand  command = CaptureCommand::Count;
+        const uint8_t*  data    = nullptr;
+        uint32_t        size    = 0;
+    };
+
+    // Memory a resource was rebound to, written together with the range of the captured memory
+    struct Forward
+    {
+        uint64_t        offset      = 0;
+        uint64_t        size        = 0;
+        VkDeviceMemory  memory      = VK_NULL_HANDLE;
+        uint8_t*        mapped      = nullptr;
+        size_t          resource    = 0;
+    };
+
+    struct ReplayObject
+    {
+        CaptureObject   type        = CaptureObject::Count;
+        uint64_t        id          = 0;
+        uint64_t        handle      = 0;
+        uint64_t        pool        = 0;            // command or descriptor pool it came from
+        bool            alive       = true;
+
+        // DeviceMemory
+        uint64_t        size        = 0;
+        uint32_t        memoryType  = 0;
+        uint32_t        capturedType = 0;
+        uint8_t*        mapped      = nullptr;
+        std::vector<Forward> forwards;
+
+        // Buffer and Image
+        VkDeviceMemory  dedicated   = VK_NULL_HANDLE;
+        size_t          boundMemory = SIZE_MAX;
+        size_t          swapchain   = SIZE_MAX;     // stand-in image of this swapchain object
+
+        // Swapchain
+        VkFormat        format      = VK_FORMAT_UNDEFINED;
+        VkExtent2D      extent      = {};
+        uint32_t        layers      = 1;
+        VkImageUsageFlags usage     = 0;
+    };
+
+    // Timestamp command buffers around one submission of the loop
+    struct SubmitTiming
+    {
+        VkCommandBuffer begin       = VK_NULL_HANDLE;
+        VkCommandBuffer end         = VK_NULL_HANDLE;
+        uint32_t        frame       = 0;            // captured frame number
+        uint32_t        submit      = 0;            // in the frame
+        uint32_t        validBits   = 64;           // of the queue's timestamps
+        std::vector<double> gpuMs;
+    };
+
+    void ReplayDevice(const Packet& packet, const std::string& deviceOverride);
+    void Replay(const Packet& packet);
+    void ReplayCommand(CaptureCommand command);
+
+    uint64_t ReadId() { return m_Reader.Value<uint64_t>(); }
+    std::vector<uint64_t> ReadIds(uint32_t count);
+
+    size_t AddObject(CaptureObject type, uint64_t id, uint64_t handle);
+    template <typename T>
+    size_t AddObject(uint64_t id, T handle) { return AddObject(CaptureObjectOf<T>::value, id, reinterpret_cast<uint64_t>(handle)); }
+    size_t FindObject(CaptureObject type, uint64_t id) const;
+    void DestroyCaptured(CaptureObject type, uint64_t id);
+    void DestroyObject(size_t index);
+    void Forget(size_t index);
+    void ReleaseChildren(CaptureObject type, uint64_t pool);
+    void EndLoop();
+
+    void MapFamilies(VkSharingMode& sharingMode, uint32_t& count, const uint32_t* families);
+    uint32_t FindMemoryType(uint32_t typeBits, uint32_t capturedType) const;
+    uint32_t FindMemoryTypeWithFlags(uint32_t typeBits, VkMemoryPropertyFlags wanted) const;
+    uint8_t* Map(VkDeviceMemory memory, uint8_t*& mapped);
+    void BindBuffer(size_t buffer, size_t memory, uint64_t offset);
+    void BindImage(size_t image, size_t memory, uint64_t offset);
+    void WriteMemory(size_t memory, uint64_t offset, const uint8_t* data, uint64_t size);
+    void CreateStandInImages(size_t swapchain, const std::vector<uint64_t>& ids);
+    void Signal(VkQueue queue, uint32_t waitCount, const VkSemaphore* waits, VkSemaphore signal, VkFence fence);
+    void WaitForFences(uint32_t count, const VkFence* fences, VkBool32 waitAll);
+
+    void QueueSubmit(VkQueue queue, uint32_t count, const VkSubmitInfo* submits, VkFence fence);
+    SubmitTiming* GetSubmitTiming(VkQueue queue);
+
+    std::vector<uint8_t>        m_File;
+    CaptureFileHeader           m_Header;
+    std::vector<Packet>         m_Packets;
+    size_t                      m_SetupEnd      = 0;    // packets before this run once
+    size_t                      m_LoopEnd       = 0;    // the loop is m_SetupEnd to m_LoopEnd
+    uint32_t                    m_LoopFrames    = 0;
+
+    CaptureHandleMap            m_Handles;
+    std::vector<uint32_t>       m_Families;
+    CaptureReader               m_Reader;
+
+    uint32_t                    m_CapturedApiVersion = VK_API_VERSION_1_0;
+    VkPhysicalDeviceMemoryProperties m_CapturedMemory{};
+    std::vector<VkQueueFamilyProperties> m_CapturedFamilies;
+
+    VkInstance                  m_Instance      = VK_NULL_HANDLE;
+    VulkanInstanceDispatch      m_InstanceDispatch;
+    VkPhysicalDevice            m_PhysicalDevice = VK_NULL_HANDLE;
+    VkDevice                    m_Device        = VK_NULL_HANDLE;
+    VulkanDeviceDispatch        m_DeviceDispatch;
+    std::string                 m_DeviceName;
+    VkPhysicalDeviceMemoryProperties m_Memory{};
+    std::vector<VkQueueFamilyProperties> m_QueueFamilies;
+    std::vector<uint32_t>       m_QueueCounts;          // created per family
+    std::unordered_map<VkQueue, uint32_t> m_QueueFamilyOf;
+    VkQueue                     m_SignalQueue   = VK_NULL_HANDLE;
+    float                       m_TimestampPeriod = 1.0f;
+
+    std::vector<ReplayObject>   m_Objects;
+    std::unordered_map<uint64_t, size_t> m_ObjectIndex[static_cast<size_t>(CaptureObject::Count)];
+
+    // Loop state
+    bool                        m_InLoop        = false;
+    size_t                      m_LoopStart     = 0;    // objects from here on were created by the loop
+    std::vector<size_t>         m_Shadowed;             // setup objects whose id the loop reused
+    std::vector<size_t>         m_Deferred;
+
+    std::vector<SubmitTiming>   m_SubmitTimings;
+    std::unordered_map<uint32_t, VkCommandPool> m_TimingPools;
+    VkQueryPool                 m_TimestampPool = VK_NULL_HANDLE;
+    uint32_t                    m_SubmitIndex   = 0;
+    uint32_t                    m_FrameIndex    = 0;
+    uint32_t                    m_FrameSubmit   = 0;
+    std::chrono::steady_clock::time_point m_FrameStart;
+
+    std::vector<double>         m_LoopMs;
+    std::vector<double>         m_FrameMs;
+    std::vector<double>         m_SubmitCpuMs;
+
+    Stats                       m_Stats;
+};
+
+void Replayer::Load(const std::string& path)
+{
+    m_File = ReadFile(path);
+    if (m_File.size() < sizeof(CaptureFileHeader))
+    {
+        throw std::runtime_error("Capture file is truncated!");
+    }
+    std::memcpy(&m_Header, m_File.data(), sizeof(m_Header));
+    if (m_Header.magic != CAPTURE_MAGIC || m_Header.version != CAPTURE_VERSION)
+    {
+        throw std::runtime_error("Not a capture file, or one of another version!");
+    }
+
+    // A capture cut short by a crash still replays up to its last complete packet
+    size_t offset = sizeof(CaptureFileHeader);
+    while (offset + sizeof(CapturePacketHeader) <= m_File.size())
+    {
+        CapturePacketHeader header;
+        std::memcpy(&header, m_File.data() + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.command == 0 || header.command >= static_cast<uint16_t>(CaptureCommand::Count) || offset + header.size > m_File.size())
+        {
+            std::cerr << "Capture is damaged after " << m_Packets.size() << " packets, the rest is ignored\n";
+            break;
+        }
+
+        Packet packet;
+        packet.command = static_cast<CaptureCommand>(header.command);
+        packet.data = m_File.data() + offset;
+        packet.size = header.size;
+        m_Packets.push_back(packet);
+        offset += header.size;
+    }
+
+    if (m_Packets.empty() || m_Packets[0].command != CaptureCommand::Device)
+    {
+        throw std::runtime_error("Capture does not start with the device!");
+    }
+
+    // Frame f is everything after the end of frame f - 1
+    m_SetupEnd = m_Header.firstFrame == 0 ? 1 : 0;
+    m_LoopEnd = 0;
+    m_LoopFrames = 0;
+    for (size_t i = 0; i < m_Packets.size(); i++)
+    {
+        if (m_Packets[i].command != CaptureCommand::FrameEnd)
+        {
+            continue;
+        }
+
+        uint32_t frame = 0;
+        std::memcpy(&frame, m_Packets[i].data, sizeof(frame));
+        if (frame + 1 == m_Header.firstFrame)
+        {
+            m_SetupEnd = i + 1;
+        }
+        if (m_SetupEnd != 0 && frame >= m_Header.firstFrame && frame <= m_Header.lastFrame)
+        {
+            m_LoopEnd = i + 1;
+            m_LoopFrames++;
+        }
+    }
+
+    if (m_SetupEnd == 0 || m_LoopFrames == 0)
+    {
+        throw std::runtime_error("Capture ends before its first frame!");
+    }
+    if (m_LoopFrames < m_Header.lastFrame - m_Header.firstFrame + 1)
+    {
+        std::cout << "Capture ends early, replaying " << m_LoopFrames << " of the frames asked for\n";
+    }
+
+    std::cout << "Capture: " << m_Packets.size() << " packets, frames " << m_Header.firstFrame << '-'
+        << (m_Header.firstFrame + m_LoopFrames - 1) << " in " << (m_LoopEnd - m_SetupEnd) << " packets\n";
+}
+
+void Replayer::CreateDevice(const std::string& deviceOverride)
+{
+    ReplayDevice(m_Packets[0], deviceOverride);
+}
+
+std::vector<uint64_t> Replayer::ReadIds(uint32_t count)
+{
+    std::vector<uint64_t> ids;
+    if (m_Reader.Value<uint8_t>() != 0)
+    {
+        ids.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            ids[i] = ReadId();
+        }
+    }
+    return ids;
+}
+
+// The captured device decides the API version, extensions and features, as far as this one has them
+void Replayer::ReplayDevice(const Packet& packet, const std::string& deviceOverride)
+{
+    m_Reader.Reset(packet.data, packet.size);
+    m_CapturedApiVersion = m_Reader.Value<uint32_t>();
+    const char* capturedName = nullptr;
+    m_Reader.String(capturedName);
+    const std::string capturedDevice = capturedName;
+    m_Reader.Value(m_CapturedMemory);
+    const uint32_t capturedFamilyCount = m_Reader.Value<uint32_t>();
+    const VkQueueFamilyProperties* capturedFamilies = nullptr;
+    m_Reader.ValueArray(capturedFamilies, capturedFamilyCount);
+    m_CapturedFamilies.assign(capturedFamilies, capturedFamilies + capturedFamilyCount);
+    VkDeviceCreateInfo createInfo{};
+    Serialize(m_Reader, createInfo);
+
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    if (enumerateInstanceVersion != nullptr)
+    {
+        enumerateInstanceVersion(&apiVersion);
+    }
+    apiVersion = std::min({ apiVersion, m_CapturedApiVersion, MAX_VULKAN_API_VERSION });
+
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "CaptureReplay";
+    appInfo.apiVersion = apiVersion;
+
+    VkInstanceCreateInfo instanceInfo{};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+
+    if (vkCreateInstance(&instanceInfo, nullptr, &m_Instance) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create instance!");
+    }
+    m_InstanceDispatch.Load(m_Instance);
+
+    PhysicalDeviceSelector selector(m_Instance, apiVersion);
+    m_PhysicalDevice = selector.Select([](VkPhysicalDevice) { return std::string(); }, deviceOverride);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    m_DeviceName = properties.deviceName;
+    m_TimestampPeriod = properties.limits.timestampPeriod;
+    std::cout << "Replaying a capture from " << capturedDevice << " on " << m_DeviceName << '\n';
+    if (properties.apiVersion < m_CapturedApiVersion)
+    {
+        std::cout << "Warning: the device supports an older Vulkan version than the captured one\n";
+    }
+    apiVersion = std::min(apiVersion, properties.apiVersion);
+
+    vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_Memory);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &familyCount, nullptr);
+    m_QueueFamilies.resize(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &familyCount, m_QueueFamilies.data());
+
+    // Families are matched on graphics, compute and transfer, with as few other capabilities as
+    // possible so a dedicated transfer family stays dedicated. Graphics and compute imply transfer.
+    const VkQueueFlags relevant = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    auto capabilities = [&](VkQueueFlags flags)
+    {
+        flags &= relevant;
+        return (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0 ? (flags | VK_QUEUE_TRANSFER_BIT) : flags;
+    };
+    m_Families.resize(capturedFamilyCount);
+    for (uint32_t captured = 0; captured < capturedFamilyCount; captured++)
+    {
+        const VkQueueFlags wanted = capabilities(m_CapturedFamilies[captured].queueFlags);
+        uint32_t best = UINT32_MAX;
+        uint32_t bestExtra = UINT32_MAX;
+        for (uint32_t family = 0; family < familyCount; family++)
+        {
+            const VkQueueFlags flags = capabilities(m_QueueFamilies[family].queueFlags);
+            const uint32_t extra = CountBits(flags & ~wanted);
+            if ((flags & wanted) == wanted && extra < bestExtra)
+            {
+                best = family;
+                bestExtra = extra;
+            }
+        }
+        m_Families[captured] = best != UINT32_MAX ? best : 0;
+    }
+
+    // One create info per replay family, with as many queues as any captured family mapped to it asked for
+    m_QueueCounts.assign(familyCount, 0);
+    for (uint32_t i = 0; i < createInfo.queueCreateInfoCount; i++)
+    {
+        const VkDeviceQueueCreateInfo& captured = createInfo.pQueueCreateInfos[i];
+        const uint32_t family = captured.queueFamilyIndex < m_Families.size() ? m_Families[captured.queueFamilyIndex] : 0;
+        m_QueueCounts[family] = std::min(std::max(m_QueueCounts[family], captured.queueCount), m_QueueFamilies[family].queueCount);
+    }
+
+    // The graphics family always gets a queue, acquire and present are replayed on it
+    uint32_t graphicsFamily = 0;
+    for (uint32_t family = 0; family < familyCount; family++)
+    {
+        if (m_QueueFamilies[family].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            graphicsFamily = family;
+            break;
+        }
+    }
+    m_QueueCounts[graphicsFamily] = std::max(m_QueueCounts[graphicsFamily], 1u);
+
+    uint32_t maxQueues = 1;
+    for (uint32_t count : m_QueueCounts)
+    {
+        maxQueues = std::max(maxQueues, count);
+    }
+    std::vector<float> priorities(maxQueues, 1.0f);
+    std::vector<VkDeviceQueueCreateInfo> queueInfos;
+    for (uint32_t family = 0; family < familyCount; family++)
+    {
+        if (m_QueueCounts[family] > 0)
+        {
+            VkDeviceQueueCreateInfo queueInfo{};
+            queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueInfo.queueFamilyIndex = family;
+            queueInfo.queueCount = m_QueueCounts[family];
+            queueInfo.pQueuePriorities = priorities.data();
+            queueInfos.push_back(queueInfo);
+        }
+    }
+
+    // Extensions this device does not have are dropped with a warning, the swapchain is not needed
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> available(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, available.data());
+
+    std::vector<const char*> extensions;
+    for (uint32_t i = 0; i < createInfo.enabledExtensionCount; i++)
+    {
+        const char* name = createInfo.ppEnabledExtensionNames[i];
+        if (std::strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0)
+        {
+            continue;
+        }
+        bool supported = std::any_of(available.begin(), available.end(),
+            [name](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, name) == 0; });
+        if (supported)
+        {
+            extensions.push_back(name);
+        }
+        else
+        {
+            std::cout << "Warning: " << name << " is not supported, commands that need it will fail\n";
+        }
+    }
+
+    // Features are intersected with what the device supports. Every chained feature structure
+    // the capture keeps is a list of VkBool32 after sType and pNext.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+    auto intersect = [](VkBool32* enabled, const VkBool32* supported, size_t count, uint32_t& dropped)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (enabled[i] == VK_TRUE && supported[i] != VK_TRUE)
+            {
+                enabled[i] = VK_FALSE;
+                dropped++;
+            }
+        }
+    };
+
+    uint32_t droppedFeatures = 0;
+    if (createInfo.pEnabledFeatures != nullptr)
+    {
+        intersect(reinterpret_cast<VkBool32*>(const_cast<VkPhysicalDeviceFeatures*>(createInfo.pEnabledFeatures)),
+            reinterpret_cast<const VkBool32*>(&supportedFeatures), sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32), droppedFeatures);
+    }
+
+    const bool features2 = apiVersion >= VK_API_VERSION_1_1 && m_InstanceDispatch.vkGetPhysicalDeviceFeatures2 != nullptr;
+    if (!features2)
+    {
+        createInfo.pNext = nullptr;
+    }
+    for (auto* structure = static_cast<VkBaseOutStructure*>(const_cast<void*>(createInfo.pNext)); structure != nullptr; structure = structure->pNext)
+    {
+        // Queried one at a time, so the support structure has the same layout as the enabled one
+        std::vector<uint64_t> storage(64, 0);
+        auto* support = reinterpret_cast<VkBaseOutStructure*>(storage.data());
+        support->sType = structure->sType;
+
+        size_t size = 0;
+        switch (structure->sType)
+        {
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES:
+            size = sizeof(VkPhysicalDeviceVulkan12Features);
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES:
+            size = sizeof(VkPhysicalDeviceDescriptorIndexingFeatures);
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES:
+            size = sizeof(VkPhysicalDeviceSynchronization2Features);
+            break;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2:
+            size = sizeof(VkPhysicalDeviceFeatures2);
+            break;
+        default:
+            continue;
+        }
+
+        VkPhysicalDeviceFeatures2 query{};
+        query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        query.pNext = structure->sType != VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 ? support : nullptr;
+        m_InstanceDispatch.vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &query);
+        const VkBool32* supported = structure->sType != VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2
+            ? reinterpret_cast<const VkBool32*>(support + 1) : reinterpret_cast<const VkBool32*>(&query.features);
+        intersect(reinterpret_cast<VkBool32*>(structure + 1), supported, (size - sizeof(VkBaseOutStructure)) / sizeof(VkBool32), droppedFeatures);
+    }
+    if (droppedFeatures > 0)
+    {
+        std::cout << "Warning: " << droppedFeatures << " captured features are not supported and were disabled\n";
+    }
+
+    VkDeviceCreateInfo deviceInfo = createInfo;
+    deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
+    deviceInfo.pQueueCreateInfos = queueInfos.data();
+    deviceInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    deviceInfo.ppEnabledExtensionNames = extensions.data();
+
+    if (vkCreateDevice(m_PhysicalDevice, &deviceInfo, nullptr, &m_Device) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create logical device!");
+    }
+    m_DeviceDispatch.Load(m_Device, m_InstanceDispatch.vkGetDeviceProcAddr);
+    m_DeviceDispatch.vkGetDeviceQueue(m_Device, graphicsFamily, 0, &m_SignalQueue);
+    m_QueueFamilyOf[m_SignalQueue] = graphicsFamily;
+}
+
+void Replayer::Run(uint32_t loops)
+{
+    // Everything before the captured frames, once and untimed
+    for (size_t i = 1; i < m_SetupEnd; i++)
+    {
+        Replay(m_Packets[i]);
+    }
+    m_DeviceDispatch.vkDeviceWaitIdle(m_Device);
+
+    uint32_t submits = 0;
+    for (size_t i = m_SetupEnd; i < m_LoopEnd; i++)
+    {
+        submits += m_Packets[i].command == CaptureCommand::QueueSubmit ? 1 : 0;
+    }
+    if (submits > 0)
+    {
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = submits * 2;
+        if (m_DeviceDispatch.vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_TimestampPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create timestamp query pool!");
+        }
+    }
+
+    m_InLoop = true;
+    m_LoopStart = m_Objects.size();
+    for (uint32_t loop = 0; loop < loops; loop++)
+    {
+        m_SubmitIndex = 0;
+        m_FrameIndex = 0;
+        m_FrameSubmit = 0;
+        auto loopStart = std::chrono::steady_clock::now();
+        m_FrameStart = loopStart;
+
+        for (size_t i = m_SetupEnd; i < m_LoopEnd; i++)
+        {
+            Replay(m_Packets[i]);
+        }
+        m_DeviceDispatch.vkDeviceWaitIdle(m_Device);
+        m_LoopMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loopStart).count());
+
+        // The device is idle, every timestamp of the loop is written
+        for (uint32_t submit = 0; submit < m_SubmitTimings.size() && submit < m_SubmitIndex; submit++)
+        {
+            SubmitTiming& timing = m_SubmitTimings[submit];
+            if (timing.begin == VK_NULL_HANDLE)
+            {
+                continue;
+            }
+
+            uint64_t timestamps[2] = {};
+            m_DeviceDispatch.vkGetQueryPoolResults(m_Device, m_TimestampPool, submit * 2, 2, sizeof(timestamps), timestamps,
+                sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            const uint64_t mask = timing.validBits < 64 ? (1ull << timing.validBits) - 1 : ~0ull;
+            const uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+            timing.gpuMs.push_back(static_cast<double>(ticks) * m_TimestampPeriod / 1e6);
+        }
+
+        EndLoop();
+    }
+    m_InLoop = false;
+}
+
+void Replayer::EndLoop()
+{
+    // Objects the loop created and did not destroy; the next loop creates them again
+    for (size_t i = m_Objects.size(); i > m_LoopStart; i--)
+    {
+        if (m_Objects[i - 1].alive)
+        {
+            DestroyObject(i - 1);
+        }
+    }
+    m_Objects.resize(m_LoopStart);
+
+    for (size_t index : m_Shadowed)
+    {
+        const ReplayObject& object = m_Objects[index];
+        if (object.alive)
+        {
+            m_ObjectIndex[static_cast<size_t>(object.type)][object.id] = index;
+            m_Handles.Add(object.type, object.id, object.handle);
+        }
+    }
+    m_Shadowed.clear();
+}
+
+void Replayer::Destroy()
+{
+    if (m_Device != VK_NULL_HANDLE)
+    {
+        m_DeviceDispatch.vkDeviceWaitIdle(m_Device);
+
+        for (size_t index : m_Deferred)
+        {
+            if (m_Objects[index].alive)
+            {
+                DestroyObject(index);
+            }
+        }
+        for (size_t i = m_Objects.size(); i > 0; i--)
+        {
+            if (m_Objects[i - 1].alive)
+            {
+                DestroyObject(i - 1);
+            }
+        }
+        m_Objects.clear();
+
+        for (auto& pool : m_TimingPools)
+        {
+            m_DeviceDispatch.vkDestroyCommandPool(m_Device, pool.second, nullptr);
+        }
+        m_TimingPools.clear();
+        if (m_TimestampPool != VK_NULL_HANDLE)
+        {
+            m_DeviceDispatch.vkDestroyQueryPool(m_Device, m_TimestampPool, nullptr);
+            m_TimestampPool = VK_NULL_HANDLE;
+        }
+
+        m_DeviceDispatch.vkDestroyDevice(m_Device, nullptr);
+        m_Device = VK_NULL_HANDLE;
+    }
+    if (m_Instance != VK_NULL_HANDLE)
+    {
+        vkDestroyInstance(m_Instance, nullptr);
+        m_Instance = VK_NULL_HANDLE;
+    }
+}
+
+size_t Replayer::AddObject(CaptureObject type, uint64_t id, uint64_t handle)
+{
+    auto& index = m_ObjectIndex[static_cast<size_t>(type)];
+    auto it = index.find(id);
+    if (m_InLoop && it != index.end() && it->second < m_LoopStart)
+    {
+        m_Shadowed.push_back(it->second);
+    }
+
+    ReplayObject object;
+    object.type = type;
+    object.id = id;
+    object.handle = handle;
+    m_Objects.push_back(std::move(object));
+    index[id] = m_Objects.size() - 1;
+    m_Handles.Add(type, id, handle);
+    return m_Objects.size() - 1;
+}
+
+size_t Replayer::FindObject(CaptureObject type, uint64_t id) const
+{
+    const auto& index = m_ObjectIndex[static_cast<size_t>(type)];
+    auto it = index.find(id);
+    if (it == index.end())
+    {
+        throw std::runtime_error("Capture uses a handle that was never created!");
+    }
+    return it->second;
+}
+
+// Inside the loop, objects from the setup are only destroyed after the last loop: the next
+// loop starts from the setup again and still needs them
+void Replayer::DestroyCaptured(CaptureObject type, uint64_t id)
+{
+    const auto& index = m_ObjectIndex[static_cast<size_t>(type)];
+    auto it = index.find(id);
+    if (it == index.end())
+    {
+        return;
+    }
+
+    if (m_InLoop && it->second < m_LoopStart)
+    {
+        if (std::find(m_Deferred.begin(), m_Deferred.end(), it->second) == m_Deferred.end())
+        {
+            m_Deferred.push_back(it->second);
+            m_Stats.deferredDestroys++;
+        }
+        return;
+    }
+    DestroyObject(it->second);
+}
+
+void Replayer::DestroyObject(size_t index)
+{
+    ReplayObject& object = m_Objects[index];
+    const VkDevice device = m_Device;
+    const uint64_t handle = object.handle;
+
+    switch (object.type)
+    {
+    case CaptureObject::Fence:
+        m_DeviceDispatch.vkDestroyFence(device, reinterpret_cast<VkFence>(handle), nullptr);
+        break;
+    case CaptureObject::Semaphore:
+        m_DeviceDispatch.vkDestroySemaphore(device, reinterpret_cast<VkSemaphore>(handle), nullptr);
+        break;
+    case CaptureObject::DeviceMemory:
+        for (const Forward& forward : object.forwards)
+        {
+            m_Objects[forward.resource].boundMemory = SIZE_MAX;
+        }
+        m_DeviceDispatch.vkFreeMemory(device, reinterpret_cast<VkDeviceMemory>(handle), nullptr);
+        break;
+    case CaptureObject::Buffer:
+    case CaptureObject::Image:
+        if (object.boundMemory != SIZE_MAX)
+        {
+            auto& forwards = m_Objects[object.boundMemory].forwards;
+            forwards.erase(std::remove_if(forwards.begin(), forwards.end(), [index](const Forward& forward) { return forward.resource == index; }),
+                forwards.end());
+        }
+        if (object.type == CaptureObject::Buffer)
+        {
+            m_DeviceDispatch.vkDestroyBuffer(device, reinterpret_cast<VkBuffer>(handle), nullptr);
+        }
+        else
+        {
+            m_DeviceDispatch.vkDestroyImage(device, reinterpret_cast<VkImage>(handle), nullptr);
+        }
+        if (object.dedicated != VK_NULL_HANDLE)
+        {
+            m_DeviceDispatch.vkFreeMemory(device, object.dedicated, nullptr);
+        }
+        break;
+    case CaptureObject::ImageView:
+        m_DeviceDispatch.vkDestroyImageView(device, reinterpret_cast<VkImageView>(handle), nullptr);
+        break;
+    case CaptureObject::Sampler:
+        m_DeviceDispatch.vkDestroySampler(device, reinterpret_cast<VkSampler>(handle), nullptr);
+        break;
+    case CaptureObject::QueryPool:
+        m_DeviceDispatch.vkDestroyQueryPool(device, reinterpret_cast<VkQueryPool>(handle), nullptr);
+        break;
+    case CaptureObject::ShaderModule:
+        m_DeviceDispatch.vkDestroyShaderModule(device, reinterpret_cast<VkShaderModule>(handle), nullptr);
+        break;
+    case CaptureObject::PipelineCache:
+        m_DeviceDispatch.vkDestroyPipelineCache(device, reinterpret_cast<VkPipelineCache>(handle), nullptr);
+        break;
+    case CaptureObject::PipelineLayout:
+        m_DeviceDispatch.vkDestroyPipelineLayout(device, reinterpret_cast<VkPipelineLayout>(handle), nullptr);
+        break;
+    case CaptureObject::Pipeline:
+        m_DeviceDispatch.vkDestroyPipeline(device, reinterpret_cast<VkPipeline>(handle), nullptr);
+        break;
+    case CaptureObject::DescriptorSetLayout:
+        m_DeviceDispatch.vkDestroyDescriptorSetLayout(device, reinterpret_cast<VkDescriptorSetLayout>(handle), nullptr);
+        break;
+    case CaptureObject::DescriptorPool:
+        ReleaseChildren(CaptureObject::DescriptorSet, handle);
+        m_DeviceDispatch.vkDestroyDescriptorPool(device, reinterpret_cast<VkDescriptorPool>(handle), nullptr);
+        break;
+    case CaptureObject::RenderPass:
+        m_DeviceDispatch.vkDestroyRenderPass(device, reinterpret_cast<VkRenderPass>(handle), nullptr);
+        break;
+    case CaptureObject::Framebuffer:
+        m_DeviceDispatch.vkDestroyFramebuffer(device, reinterpret_cast<VkFramebuffer>(handle), nullptr);
+        break;
+    case CaptureObject::CommandPool:
+        ReleaseChildren(CaptureObject::CommandBuffer, handle);
+        m_DeviceDispatch.vkDestroyCommandPool(device, reinterpret_cast<VkCommandPool>(handle), nullptr);
+        break;
+    case CaptureObject::CommandBuffer:
+    {
+        VkCommandBuffer commandBuffer = reinterpret_cast<VkCommandBuffer>(handle);
+        m_DeviceDispatch.vkFreeCommandBuffers(device, reinterpret_cast<VkCommandPool>(object.pool), 1, &commandBuffer);
+        break;
+    }
+    case CaptureObject::Swapchain:
+        for (size_t i = 0; i < m_Objects.size(); i++)
+        {
+            if (m_Objects[i].alive && m_Objects[i].swapchain == index)
+            {
+                DestroyObject(i);
+            }
+        }
+        break;
+    case CaptureObject::Queue:
+    case CaptureObject::DescriptorSet:
+    case CaptureObject::Count:
+        // Owned by the device or their pool
+        break;
+    }
+
+    Forget(index);
+}
+
+void Replayer::Forget(size_t index)
+{
+    ReplayObject& object = m_Objects[index];
+    object.alive = false;
+    auto& objectIndex = m_ObjectIndex[static_cast<size_t>(object.type)];
+    auto it = objectIndex.find(object.id);
+    if (it != objectIndex.end() && it->second == index)
+    {
+        objectIndex.erase(it);
+        m_Handles.Remove(object.type, object.id);
+    }
+}
+
+// Command buffers and descriptor sets go away with their pool
+void Replayer::ReleaseChildren(CaptureObject type, uint64_t pool)
+{
+    for (size_t i = 0; i < m_Objects.size(); i++)
+    {
+        if (m_Objects[i].alive && m_Objects[i].type == type && m_Objects[i].pool == pool)
+        {
+            Forget(i);
+        }
+    }
+}
+
+// Families were recorded as the capturing device numbered them. Concurrent sharing between
+// families that map to one family here becomes exclusive.
+void Replayer::MapFamilies(VkSharingMode& sharingMode, uint32_t& count, const uint32_t* families)
+{
+    if (sharingMode != VK_SHARING_MODE_CONCURRENT || families == nullptr)
+    {
+        return;
+    }
+
+    uint32_t* mapped = const_cast<uint32_t*>(families);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const uint32_t family = families[i] < m_Families.size() ? m_Families[families[i]] : families[i];
+        if (std::find(mapped, mapped + unique, family) == mapped + unique)
+        {
+            mapped[unique++] = family;
+        }
+    }
+    count = unique;
+    if (unique < 2)
+    {
+        sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        count = 0;
+    }
+}
+
+// A type with every property the captured type had that matters, and as few others as possible
+uint32_t Replayer::FindMemoryType(uint32_t typeBits, uint32_t capturedType) const
+{
+    const VkMemoryPropertyFlags relevant = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    const VkMemoryPropertyFlags wanted = capturedType < m_CapturedMemory.memoryTypeCount
+        ? m_CapturedMemory.memoryTypes[capturedType].propertyFlags & relevant : static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    uint32_t type = FindMemoryTypeWithFlags(typeBits, wanted);
+    if (type == UINT32_MAX)
+    {
+        // Device local host visible memory and cached memory are not everywhere
+        type = FindMemoryTypeWithFlags(typeBits, wanted & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+    }
+    if (type == UINT32_MAX)
+    {
+        throw std::runtime_error("Failed to find a memory type like the captured one!");
+    }
+    return type;
+}
+
+uint32_t Replayer::FindMemoryTypeWithFlags(uint32_t typeBits, VkMemoryPropertyFlags wanted) const
+{
+    uint32_t best = UINT32_MAX;
+    uint32_t bestExtra = UINT32_MAX;
+    for (uint32_t i = 0; i < m_Memory.memoryTypeCount; i++)
+    {
+        const VkMemoryPropertyFlags flags = m_Memory.memoryTypes[i].propertyFlags;
+        const uint32_t extra = CountBits(flags & ~wanted);
+        if ((typeBits & (1u << i)) && (flags & wanted) == wanted && extra < bestExtra)
+        {
+            best = i;
+            bestExtra = extra;
+        }
+    }
+    return best;
+}
+
+uint8_t* Replayer::Map(VkDeviceMemory memory, uint8_t*& mapped)
+{
+    if (mapped == nullptr)
+    {
+        void* data = nullptr;
+        if (m_DeviceDispatch.vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to map memory the capture writes to!");
+        }
+        mapped = static_cast<uint8_t*>(data);
+    }
+    return mapped;
+}
+
+// The captured offset is kept when this device's requirements allow it, otherwise the
+// resource gets memory of its own that receives the writes to its captured range
+void Replayer::BindBuffer(size_t buffer, size_t memory, uint64_t offset)
+{
+    VkBuffer handle = reinterpret_cast<VkBuffer>(m_Objects[buffer].handle);
+    VkMemoryRequirements requirements;
+    m_DeviceDispatch.vkGetBufferMemoryRequirements(m_Device, handle, &requirements);
+
+    ReplayObject& target = m_Objects[memory];
+    m_Objects[buffer].boundMemory = memory;
+    if ((requirements.memoryTypeBits & (1u << target.memoryType)) && offset % requirements.alignment == 0
+        && offset + requirements.size <= target.size)
+    {
+        m_DeviceDispatch.vkBindBufferMemory(m_Device, handle, reinterpret_cast<VkDeviceMemory>(target.handle), offset);
+        return;
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, target.capturedType);
+
+    VkDeviceMemory dedicated = VK_NULL_HANDLE;
+    if (m_DeviceDispatch.vkAllocateMemory(m_Device, &allocInfo, nullptr, &dedicated) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate memory for a rebound buffer!");
+    }
+    m_DeviceDispatch.vkBindBufferMemory(m_Device, handle, dedicated, 0);
+    m_Objects[buffer].dedicated = dedicated;
+
+    Forward forward;
+    forward.offset = offset;
+    forward.size = requirements.size;
+    forward.memory = dedicated;
+    forward.resource = buffer;
+    m_Objects[memory].forwards.push_back(forward);
+    m_Stats.rebinds++;
+}
+
+void Replayer::BindImage(size_t image, size_t memory, uint64_t offset)
+{
+    VkImage handle = reinterpret_cast<VkImage>(m_Objects[image].handle);
+    VkMemoryRequirements requirements;
+    m_DeviceDispatch.vkGetImageMemoryRequirements(m_Device, handle, &requirements);
+
+    ReplayObject& target = m_Objects[memory];
+    m_Objects[image].boundMemory = memory;
+    if ((requirements.memoryTypeBits & (1u << target.memoryType)) && offset % requirements.alignment == 0
+        && offset + requirements.size <= target.size)
+    {
+        m_DeviceDispatch.vkBindImageMemory(m_Device, handle, reinterpret_cast<VkDeviceMemory>(target.handle), offset);
+        return;
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, target.capturedType);
+
+    VkDeviceMemory dedicated = VK_NULL_HANDLE;
+    if (m_DeviceDispatch.vkAllocateMemory(m_Device, &allocInfo, nullptr, &dedicated) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate memory for a rebound image!");
+    }
+    m_DeviceDispatch.vkBindImageMemory(m_Device, handle, dedicated, 0);
+    m_Objects[image].dedicated = dedicated;
+
+    // Images are only written through copies, so there is nothing to forward
+    m_Stats.rebinds++;
+}
+
+void Replayer::WriteMemory(size_t memory, uint64_t offset, const uint8_t* data, uint64_t size)
+{
+    ReplayObject& target = m_Objects[memory];
+    if (offset < target.size)
+    {
+        uint8_t* mapped = Map(reinterpret_cast<VkDeviceMemory>(target.handle), target.mapped);
+        std::memcpy(mapped + offset, data, static_cast<size_t>(std::min(size, target.size - offset)));
+    }
+
+    for (Forward& forward : target.forwards)
+    {
+        const uint64_t begin = std::max(offset, forward.offset);
+        const uint64_t end = std::min(offset + size, forward.offset + forward.size);
+        if (begin < end)
+        {
+            uint8_t* mapped = Map(forward.memory, forward.mapped);
+            std::memcpy(mapped + (begin - forward.offset), data + (begin - offset), static_cast<size_t>(end - begin));
+        }
+    }
+}
+
+// Swapchain images become device local images of the same format and size
+void Replayer::CreateStandInImages(size_t swapchain, const std::vector<uint64_t>& ids)
+{
+    for (uint64_t id : ids)
+    {
+        auto& index = m_ObjectIndex[static_cast<size_t>(CaptureObject::Image)];
+        auto it = index.find(id);
+        if (it != index.end() && m_Objects[it->second].alive && m_Objects[it->second].swapchain == swapchain)
+        {
+            continue;
+        }
+
+        const ReplayObject& chain = m_Objects[swapchain];
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = chain.format;
+        imageInfo.extent = { chain.extent.width, chain.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = chain.layers;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = chain.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image = VK_NULL_HANDLE;
+        if (m_DeviceDispatch.vkCreateImage(m_Device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create swapchain stand-in image!");
+        }
+
+        VkMemoryRequirements requirements;
+        m_DeviceDispatch.vkGetImageMemoryRequirements(m_Device, image, &requirements);
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = FindMemoryTypeWithFlags(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (allocInfo.memoryTypeIndex == UINT32_MAX || m_DeviceDispatch.vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+        {
+            m_DeviceDispatch.vkDestroyImage(m_Device, image, nullptr);
+            throw std::runtime_error("Failed to allocate swapchain stand-in image memory!");
+        }
+        m_DeviceDispatch.vkBindImageMemory(m_Device, image, memory, 0);
+
+        const size_t object = AddObject(id, image);
+        m_Objects[object].dedicated = memory;
+        m_Objects[object].swapchain = swapchain;
+    }
+}
+
+// Acquire and present without a swapchain: a submission that only signals or only waits
+void Replayer::Signal(VkQueue queue, uint32_t waitCount, const VkSemaphore* waits, VkSemaphore signal, VkFence fence)
+{
+    std::vector<VkPipelineStageFlags> stages(waitCount, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = waits != nullptr ? waitCount : 0;
+    submitInfo.pWaitSemaphores = waits;
+    submitInfo.pWaitDstStageMask = stages.data();
+    submitInfo.signalSemaphoreCount = signal != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pSignalSemaphores = &signal;
+
+    if (m_DeviceDispatch.vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to replay acquire or present!");
+    }
+}
+
+void Replayer::WaitForFences(uint32_t count, const VkFence* fences, VkBool32 waitAll)
+{
+    if (count == 0 || fences == nullptr)
+    {
+        return;
+    }
+    if (m_DeviceDispatch.vkWaitForFences(m_Device, count, fences, waitAll, FENCE_TIMEOUT_NS) == VK_TIMEOUT)
+    {
+        if (m_Stats.fenceTimeouts++ == 0)
+        {
+            std::cout << "Warning: a fence the capture waited for did not signal in the replay\n";
+        }
+    }
+}
+
+Replayer::SubmitTiming* Replayer::GetSubmitTiming(VkQueue queue)
+{
+    if (m_TimestampPool == VK_NULL_HANDLE)
+    {
+        return nullptr;
+    }
+
+    // Recorded during the first loop, when the queue of every submission is known
+    if (m_SubmitIndex == m_SubmitTimings.size())
+    {
+        SubmitTiming timing;
+        timing.frame = m_Header.firstFrame + m_FrameIndex;
+        timing.submit = m_FrameSubmit;
+
+        auto family = m_QueueFamilyOf.find(queue);
+        if (family != m_QueueFamilyOf.end() && m_QueueFamilies[family->second].timestampValidBits > 0)
+        {
+            VkCommandPool& pool = m_TimingPools[family->second];
+            if (pool == VK_NULL_HANDLE)
+            {
+                VkCommandPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.queueFamilyIndex = family->second;
+                if (m_DeviceDispatch.vkCreateCommandPool(m_Device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create timestamp command pool!");
+                }
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 2;
+            VkCommandBuffer commandBuffers[2] = {};
+            if (m_DeviceDispatch.vkAllocateCommandBuffers(m_Device, &allocInfo, commandBuffers) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate timestamp command buffers!");
+            }
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            const uint32_t query = m_SubmitIndex * 2;
+
+            m_DeviceDispatch.vkBeginCommandBuffer(commandBuffers[0], &beginInfo);
+            m_DeviceDispatch.vkCmdResetQueryPool(commandBuffers[0], m_TimestampPool, query, 2);
+            m_DeviceDispatch.vkCmdWriteTimestamp(commandBuffers[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_TimestampPool, query);
+            m_DeviceDispatch.vkEndCommandBuffer(commandBuffers[0]);
+
+            m_DeviceDispatch.vkBeginCommandBuffer(commandBuffers[1], &beginInfo);
+            m_DeviceDispatch.vkCmdWriteTimestamp(commandBuffers[1], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_TimestampPool, query + 1);
+            m_DeviceDispatch.vkEndCommandBuffer(commandBuffers[1]);
+
+            timing.validBits = m_QueueFamilies[family->second].timestampValidBits;
+            timing.begin = commandBuffers[0];
+            timing.end = commandBuffers[1];
+        }
+        m_SubmitTimings.push_back(std::move(timing));
+    }
+
+    return m_SubmitIndex < m_SubmitTimings.size() ? &m_SubmitTimings[m_SubmitIndex] : nullptr;
+}
+
+// In the loop, the first batch starts with a timestamp and the last one ends with one
+void Replayer::QueueSubmit(VkQueue queue, uint32_t count, const VkSubmitInfo* submits, VkFence fence)
+{
+    std::vector<VkSubmitInfo> batches(submits, submits + (submits != nullptr ? count : 0));
+    std::vector<VkCommandBuffer> first;
+    std::vector<VkCommandBuffer> last;
+
+    SubmitTiming* timing = m_InLoop && !batches.empty() ? GetSubmitTiming(queue) : nullptr;
+    if (timing != nullptr && timing->begin != VK_NULL_HANDLE)
+    {
+        VkSubmitInfo& front = batches.front();
+        first.push_back(timing->begin);
+        first.insert(first.end(), front.pCommandBuffers, front.pCommandBuffers + front.commandBufferCount);
+        if (batches.size() == 1)
+        {
+            first.push_back(timing->end);
+        }
+        front.commandBufferCount = static_cast<uint32_t>(first.size());
+        front.pCommandBuffers = first.data();
+
+        if (batches.size() > 1)
+        {
+            VkSubmitInfo& back = batches.back();
+            last.assign(back.pCommandBuffers, back.pCommandBuffers + back.commandBufferCount);
+            last.push_back(timing->end);
+            back.commandBufferCount = static_cast<uint32_t>(last.size());
+            back.pCommandBuffers = last.data();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (m_DeviceDispatch.vkQueueSubmit(queue, static_cast<uint32_t>(batches.size()), batches.data(), fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to replay queue submission!");
+    }
+
+    if (m_InLoop)
+    {
+        m_SubmitCpuMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        m_SubmitIndex++;
+        m_FrameSubmit++;
+    }
+}
+
+void Replayer::Replay(const Packet& packet)
+{
+    m_Reader.Reset(packet.data, packet.size);
+    ReplayCommand(packet.command);
+}
+
+void Replayer::ReplayCommand(CaptureCommand command)
+{
+    CaptureReader& reader = m_Reader;
+    const VkDevice device = m_Device;
+
+    switch (command)
+    {
+    case CaptureCommand::Device:
+        throw std::runtime_error("Capture creates a second device!");
+
+    case CaptureCommand::FrameEnd:
+        if (m_InLoop)
+        {
+            auto now = std::chrono::steady_clock::now();
+            m_FrameMs.push_back(std::chrono::duration<double, std::milli>(now - m_FrameStart).count());
+            m_FrameStart = now;
+            m_FrameIndex++;
+            m_FrameSubmit = 0;
+        }
+        break;
+
+    case CaptureCommand::WriteMemory:
+    {
+        const size_t memory = FindObject(CaptureObject::DeviceMemory, ReadId());
+        const uint64_t offset = reader.Value<uint64_t>();
+        const uint64_t size = reader.Value<uint64_t>();
+        WriteMemory(memory, offset, reader.Skip(static_cast<size_t>(size)), size);
+        break;
+    }
+
+    // Queues and synchronization
+
+    case CaptureCommand::GetDeviceQueue:
+    {
+        uint32_t family = 0;
+        reader.Family(family);
+        const uint32_t index = reader.Value<uint32_t>();
+        const uint64_t id = ReadId();
+        VkQueue queue = VK_NULL_HANDLE;
+        const uint32_t created = family < m_QueueCounts.size() ? m_QueueCounts[family] : 0;
+        if (created == 0)
+        {
+            throw std::runtime_error("Capture uses a queue family the replay did not create queues for!");
+        }
+        m_DeviceDispatch.vkGetDeviceQueue(device, family, std::min(index, created - 1), &queue);
+        m_QueueFamilyOf[queue] = family;
+        AddObject(id, queue);
+        break;
+    }
+    case CaptureCommand::QueueSubmit:
+    {
+        VkQueue queue = reader.Handle<VkQueue>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkSubmitInfo* submits = nullptr;
+        reader.Array(submits, count);
+        VkFence fence = reader.Handle<VkFence>();
+        QueueSubmit(queue, count, submits, fence);
+        break;
+    }
+    case CaptureCommand::QueueWaitIdle:
+        m_DeviceDispatch.vkQueueWaitIdle(reader.Handle<VkQueue>());
+        break;
+    case CaptureCommand::DeviceWaitIdle:
+        m_DeviceDispatch.vkDeviceWaitIdle(device);
+        break;
+    case CaptureCommand::ResetFences:
+    {
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkFence* fences = nullptr;
+        reader.HandleArray(fences, count);
+        m_DeviceDispatch.vkResetFences(device, count, fences);
+        break;
+    }
+    case CaptureCommand::WaitForFences:
+    {
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkFence* fences = nullptr;
+        reader.HandleArray(fences, count);
+        WaitForFences(count, fences, reader.Value<VkBool32>());
+        break;
+    }
+    case CaptureCommand::GetFenceStatus:
+    {
+        VkFence fence = reader.Handle<VkFence>();
+        WaitForFences(1, &fence, VK_TRUE);
+        break;
+    }
+
+    // Memory
+
+    case CaptureCommand::AllocateMemory:
+    {
+        VkMemoryAllocateInfo info{};
+        Serialize(reader, info);
+        const uint64_t id = ReadId();
+        const uint32_t capturedType = info.memoryTypeIndex;
+
+        // A dedicated allocation is sized for its resource as this device wants it
+        uint32_t typeBits = (1u << m_Memory.memoryTypeCount) - 1;
+        for (auto* next = static_cast<const VkBaseInStructure*>(info.pNext); next != nullptr; next = next->pNext)
+        {
+            if (next->sType == VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO)
+            {
+                auto* dedicated = reinterpret_cast<const VkMemoryDedicatedAllocateInfo*>(next);
+                VkMemoryRequirements requirements{};
+                if (dedicated->image != VK_NULL_HANDLE)
+                {
+                    m_DeviceDispatch.vkGetImageMemoryRequirements(device, dedicated->image, &requirements);
+                }
+                else if (dedicated->buffer != VK_NULL_HANDLE)
+                {
+                    m_DeviceDispatch.vkGetBufferMemoryRequirements(device, dedicated->buffer, &requirements);
+                }
+                if (requirements.size != 0)
+                {
+                    info.allocationSize = std::max(info.allocationSize, requirements.size);
+                    typeBits = requirements.memoryTypeBits;
+                }
+            }
+        }
+        info.memoryTypeIndex = FindMemoryType(typeBits, capturedType);
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (m_DeviceDispatch.vkAllocateMemory(device, &info, nullptr, &memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay vkAllocateMemory!");
+        }
+        const size_t object = AddObject(id, memory);
+        m_Objects[object].size = info.allocationSize;
+        m_Objects[object].memoryType = info.memoryTypeIndex;
+        m_Objects[object].capturedType = capturedType;
+        break;
+    }
+    case CaptureCommand::FreeMemory:
+        DestroyCaptured(CaptureObject::DeviceMemory, ReadId());
+        break;
+    case CaptureCommand::MapMemory:
+    case CaptureCommand::UnmapMemory:
+        // Memory is mapped here when the capture first writes to it and stays mapped
+        break;
+    case CaptureCommand::BindBufferMemory:
+    {
+        const size_t buffer = FindObject(CaptureObject::Buffer, ReadId());
+        const size_t memory = FindObject(CaptureObject::DeviceMemory, ReadId());
+        BindBuffer(buffer, memory, reader.Value<uint64_t>());
+        break;
+    }
+    case CaptureCommand::BindImageMemory:
+    {
+        const size_t image = FindObject(CaptureObject::Image, ReadId());
+        const size_t memory = FindObject(CaptureObject::DeviceMemory, ReadId());
+        BindImage(image, memory, reader.Value<uint64_t>());
+        break;
+    }
+
+    // Objects
+
+    case CaptureCommand::CreateBuffer:
+    {
+        VkBufferCreateInfo info{};
+        Serialize(reader, info);
+        const uint64_t id = ReadId();
+        MapFamilies(info.sharingMode, info.queueFamilyIndexCount, info.pQueueFamilyIndices);
+        VkBuffer buffer = VK_NULL_HANDLE;
+        if (m_DeviceDispatch.vkCreateBuffer(device, &info, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay vkCreateBuffer!");
+        }
+        AddObject(id, buffer);
+        break;
+    }
+    case CaptureCommand::CreateImage:
+    {
+        VkImageCreateInfo info{};
+        Serialize(reader, info);
+        const uint64_t id = ReadId();
+        MapFamilies(info.sharingMode, info.queueFamilyIndexCount, info.pQueueFamilyIndices);
+        VkImage image = VK_NULL_HANDLE;
+        if (m_DeviceDispatch.vkCreateImage(device, &info, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay vkCreateImage!");
+        }
+        AddObject(id, image);
+        break;
+    }
+
+#define REPLAY_CREATE(Name, Info, Object) \
+    case CaptureCommand::Create##Name: \
+    { \
+        Info info{}; \
+        Serialize(reader, info); \
+        const uint64_t id = ReadId(); \
+        Object object = VK_NULL_HANDLE; \
+        if (m_DeviceDispatch.vkCreate##Name(device, &info, nullptr, &object) != VK_SUCCESS) \
+        { \
+            throw std::runtime_error("Failed to replay vkCreate" #Name "!"); \
+        } \
+        AddObject(id, object); \
+        break; \
+    }
+
+    REPLAY_CREATE(Fence, VkFenceCreateInfo, VkFence)
+    REPLAY_CREATE(Semaphore, VkSemaphoreCreateInfo, VkSemaphore)
+    REPLAY_CREATE(ImageView, VkImageViewCreateInfo, VkImageView)
+    REPLAY_CREATE(Sampler, VkSamplerCreateInfo, VkSampler)
+    REPLAY_CREATE(QueryPool, VkQueryPoolCreateInfo, VkQueryPool)
+    REPLAY_CREATE(ShaderModule, VkShaderModuleCreateInfo, VkShaderModule)
+    REPLAY_CREATE(PipelineCache, VkPipelineCacheCreateInfo, VkPipelineCache)
+    REPLAY_CREATE(PipelineLayout, VkPipelineLayoutCreateInfo, VkPipelineLayout)
+    REPLAY_CREATE(DescriptorSetLayout, VkDescriptorSetLayoutCreateInfo, VkDescriptorSetLayout)
+    REPLAY_CREATE(DescriptorPool, VkDescriptorPoolCreateInfo, VkDescriptorPool)
+    REPLAY_CREATE(RenderPass, VkRenderPassCreateInfo, VkRenderPass)
+    REPLAY_CREATE(Framebuffer, VkFramebufferCreateInfo, VkFramebuffer)
+    REPLAY_CREATE(CommandPool, VkCommandPoolCreateInfo, VkCommandPool)
+
+#undef REPLAY_CREATE
+
+#define REPLAY_DESTROY(Name) \
+    case CaptureCommand::Destroy##Name: \
+        DestroyCaptured(CaptureObject::Name, ReadId()); \
+        break;
+
+    REPLAY_DESTROY(Fence)
+    REPLAY_DESTROY(Semaphore)
+    REPLAY_DESTROY(Buffer)
+    REPLAY_DESTROY(Image)
+    REPLAY_DESTROY(ImageView)
+    REPLAY_DESTROY(Sampler)
+    REPLAY_DESTROY(QueryPool)
+    REPLAY_DESTROY(ShaderModule)
+    REPLAY_DESTROY(PipelineCache)
+    REPLAY_DESTROY(PipelineLayout)
+    REPLAY_DESTROY(Pipeline)
+    REPLAY_DESTROY(DescriptorSetLayout)
+    REPLAY_DESTROY(DescriptorPool)
+    REPLAY_DESTROY(RenderPass)
+    REPLAY_DESTROY(Framebuffer)
+    REPLAY_DESTROY(CommandPool)
+
+#undef REPLAY_DESTROY
+
+    case CaptureCommand::CreateGraphicsPipelines:
+    case CaptureCommand::CreateComputePipelines:
+    {
+        VkPipelineCache cache = reader.Handle<VkPipelineCache>();
+        const uint32_t count = reader.Value<uint32_t>();
+        std::vector<VkPipeline> pipelines(count);
+        VkResult result;
+        if (command == CaptureCommand::CreateGraphicsPipelines)
+        {
+            const VkGraphicsPipelineCreateInfo* infos = nullptr;
+            reader.Array(infos, count);
+            result = m_DeviceDispatch.vkCreateGraphicsPipelines(device, cache, count, infos, nullptr, pipelines.data());
+        }
+        else
+        {
+            const VkComputePipelineCreateInfo* infos = nullptr;
+            reader.Array(infos, count);
+            result = m_DeviceDispatch.vkCreateComputePipelines(device, cache, count, infos, nullptr, pipelines.data());
+        }
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay pipeline creation!");
+        }
+
+        const std::vector<uint64_t> ids = ReadIds(count);
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            AddObject(ids[i], pipelines[i]);
+        }
+        break;
+    }
+
+    // Descriptors
+
+    case CaptureCommand::AllocateDescriptorSets:
+    {
+        VkDescriptorSetAllocateInfo info{};
+        Serialize(reader, info);
+        std::vector<VkDescriptorSet> sets(info.descriptorSetCount);
+        if (m_DeviceDispatch.vkAllocateDescriptorSets(device, &info, sets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay vkAllocateDescriptorSets!");
+        }
+
+        const std::vector<uint64_t> ids = ReadIds(info.descriptorSetCount);
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            const size_t object = AddObject(ids[i], sets[i]);
+            m_Objects[object].pool = reinterpret_cast<uint64_t>(info.descriptorPool);
+        }
+        break;
+    }
+    case CaptureCommand::UpdateDescriptorSets:
+    {
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkWriteDescriptorSet* writes = nullptr;
+        reader.Array(writes, count);
+        m_DeviceDispatch.vkUpdateDescriptorSets(device, count, writes, 0, nullptr);
+        break;
+    }
+
+    // Command pools and buffers
+
+    case CaptureCommand::ResetCommandPool:
+    {
+        VkCommandPool pool = reader.Handle<VkCommandPool>();
+        m_DeviceDispatch.vkResetCommandPool(device, pool, reader.Value<VkCommandPoolResetFlags>());
+        break;
+    }
+    case CaptureCommand::AllocateCommandBuffers:
+    {
+        VkCommandBufferAllocateInfo info{};
+        Serialize(reader, info);
+        std::vector<VkCommandBuffer> commandBuffers(info.commandBufferCount);
+        if (m_DeviceDispatch.vkAllocateCommandBuffers(device, &info, commandBuffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to replay vkAllocateCommandBuffers!");
+        }
+
+        const std::vector<uint64_t> ids = ReadIds(info.commandBufferCount);
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            const size_t object = AddObject(ids[i], commandBuffers[i]);
+            m_Objects[object].pool = reinterpret_cast<uint64_t>(info.commandPool);
+        }
+        break;
+    }
+    case CaptureCommand::FreeCommandBuffers:
+    {
+        reader.Handle<VkCommandPool>();
+        const uint32_t count = reader.Value<uint32_t>();
+        for (uint64_t id : ReadIds(count))
+        {
+            DestroyCaptured(CaptureObject::CommandBuffer, id);
+        }
+        break;
+    }
+    case CaptureCommand::BeginCommandBuffer:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkCommandBufferBeginInfo info{};
+        Serialize(reader, info);
+        m_DeviceDispatch.vkBeginCommandBuffer(commandBuffer, &info);
+        break;
+    }
+    case CaptureCommand::EndCommandBuffer:
+        m_DeviceDispatch.vkEndCommandBuffer(reader.Handle<VkCommandBuffer>());
+        break;
+
+    // Swapchain
+
+    case CaptureCommand::CreateSwapchain:
+    {
+        VkSwapchainCreateInfoKHR info{};
+        Serialize(reader, info);
+        const uint64_t id = ReadId();
+
+        // The id stands in for the handle, the replay has no swapchain
+        const size_t object = AddObject(CaptureObject::Swapchain, id, id);
+        m_Objects[object].format = info.imageFormat;
+        m_Objects[object].extent = info.imageExtent;
+        m_Objects[object].layers = info.imageArrayLayers;
+        m_Objects[object].usage = info.imageUsage;
+        break;
+    }
+    case CaptureCommand::DestroySwapchain:
+        DestroyCaptured(CaptureObject::Swapchain, ReadId());
+        break;
+    case CaptureCommand::GetSwapchainImages:
+    {
+        const size_t swapchain = FindObject(CaptureObject::Swapchain, ReadId());
+        const uint32_t count = reader.Value<uint32_t>();
+        CreateStandInImages(swapchain, ReadIds(count));
+        break;
+    }
+    case CaptureCommand::AcquireNextImage:
+    {
+        ReadId();
+        VkSemaphore semaphore = reader.Handle<VkSemaphore>();
+        VkFence fence = reader.Handle<VkFence>();
+        Signal(m_SignalQueue, 0, nullptr, semaphore, fence);
+        break;
+    }
+    case CaptureCommand::QueuePresent:
+    {
+        VkQueue queue = reader.Handle<VkQueue>();
+        const uint32_t waitCount = reader.Value<uint32_t>();
+        const VkSemaphore* waits = nullptr;
+        reader.HandleArray(waits, waitCount);
+        Signal(queue, waitCount, waits, VK_NULL_HANDLE, VK_NULL_HANDLE);
+        break;
+    }
+
+    // Commands
+
+    case CaptureCommand::CmdBindPipeline:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const VkPipelineBindPoint bindPoint = reader.Value<VkPipelineBindPoint>();
+        m_DeviceDispatch.vkCmdBindPipeline(commandBuffer, bindPoint, reader.Handle<VkPipeline>());
+        break;
+    }
+    case CaptureCommand::CmdSetViewport:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t first = reader.Value<uint32_t>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkViewport* viewports = nullptr;
+        reader.ValueArray(viewports, count);
+        m_DeviceDispatch.vkCmdSetViewport(commandBuffer, first, count, viewports);
+        break;
+    }
+    case CaptureCommand::CmdSetScissor:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t first = reader.Value<uint32_t>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkRect2D* scissors = nullptr;
+        reader.ValueArray(scissors, count);
+        m_DeviceDispatch.vkCmdSetScissor(commandBuffer, first, count, scissors);
+        break;
+    }
+    case CaptureCommand::CmdBindDescriptorSets:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const VkPipelineBindPoint bindPoint = reader.Value<VkPipelineBindPoint>();
+        VkPipelineLayout layout = reader.Handle<VkPipelineLayout>();
+        const uint32_t firstSet = reader.Value<uint32_t>();
+        const uint32_t setCount = reader.Value<uint32_t>();
+        const VkDescriptorSet* sets = nullptr;
+        reader.HandleArray(sets, setCount);
+        const uint32_t offsetCount = reader.Value<uint32_t>();
+        const uint32_t* offsets = nullptr;
+        reader.ValueArray(offsets, offsetCount);
+        m_DeviceDispatch.vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, firstSet, setCount, sets, offsetCount, offsets);
+        break;
+    }
+    case CaptureCommand::CmdPushConstants:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkPipelineLayout layout = reader.Handle<VkPipelineLayout>();
+        const VkShaderStageFlags stages = reader.Value<VkShaderStageFlags>();
+        const uint32_t offset = reader.Value<uint32_t>();
+        const uint32_t size = reader.Value<uint32_t>();
+        const void* values = nullptr;
+        reader.Data(values, size);
+        m_DeviceDispatch.vkCmdPushConstants(commandBuffer, layout, stages, offset, size, values);
+        break;
+    }
+    case CaptureCommand::CmdBindVertexBuffers:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t first = reader.Value<uint32_t>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkBuffer* buffers = nullptr;
+        reader.HandleArray(buffers, count);
+        const VkDeviceSize* offsets = nullptr;
+        reader.ValueArray(offsets, count);
+        m_DeviceDispatch.vkCmdBindVertexBuffers(commandBuffer, first, count, buffers, offsets);
+        break;
+    }
+    case CaptureCommand::CmdBindIndexBuffer:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        const VkDeviceSize offset = reader.Value<VkDeviceSize>();
+        m_DeviceDispatch.vkCmdBindIndexBuffer(commandBuffer, buffer, offset, reader.Value<VkIndexType>());
+        break;
+    }
+    case CaptureCommand::CmdDraw:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        uint32_t values[4];
+        reader.Bytes(values, sizeof(values));
+        m_DeviceDispatch.vkCmdDraw(commandBuffer, values[0], values[1], values[2], values[3]);
+        break;
+    }
+    case CaptureCommand::CmdDrawIndexed:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t indexCount = reader.Value<uint32_t>();
+        const uint32_t instanceCount = reader.Value<uint32_t>();
+        const uint32_t firstIndex = reader.Value<uint32_t>();
+        const int32_t vertexOffset = reader.Value<int32_t>();
+        const uint32_t firstInstance = reader.Value<uint32_t>();
+        m_DeviceDispatch.vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+        break;
+    }
+    case CaptureCommand::CmdDrawIndirect:
+    case CaptureCommand::CmdDrawIndexedIndirect:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        const VkDeviceSize offset = reader.Value<VkDeviceSize>();
+        const uint32_t drawCount = reader.Value<uint32_t>();
+        const uint32_t stride = reader.Value<uint32_t>();
+        if (command == CaptureCommand::CmdDrawIndirect)
+        {
+            m_DeviceDispatch.vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+        }
+        else
+        {
+            m_DeviceDispatch.vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+        }
+        break;
+    }
+    case CaptureCommand::CmdDrawIndexedIndirectCount:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        const VkDeviceSize offset = reader.Value<VkDeviceSize>();
+        VkBuffer countBuffer = reader.Handle<VkBuffer>();
+        const VkDeviceSize countOffset = reader.Value<VkDeviceSize>();
+        const uint32_t maxDrawCount = reader.Value<uint32_t>();
+        const uint32_t stride = reader.Value<uint32_t>();
+        PFN_vkCmdDrawIndexedIndirectCount drawIndirectCount = m_DeviceDispatch.vkCmdDrawIndexedIndirectCount != nullptr
+            ? m_DeviceDispatch.vkCmdDrawIndexedIndirectCount : m_DeviceDispatch.vkCmdDrawIndexedIndirectCountKHR;
+        if (drawIndirectCount == nullptr)
+        {
+            throw std::runtime_error("Capture uses draw indirect count, which the device does not support!");
+        }
+        drawIndirectCount(commandBuffer, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+        break;
+    }
+    case CaptureCommand::CmdDispatch:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        uint32_t groups[3];
+        reader.Bytes(groups, sizeof(groups));
+        m_DeviceDispatch.vkCmdDispatch(commandBuffer, groups[0], groups[1], groups[2]);
+        break;
+    }
+    case CaptureCommand::CmdCopyBuffer:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer source = reader.Handle<VkBuffer>();
+        VkBuffer destination = reader.Handle<VkBuffer>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkBufferCopy* regions = nullptr;
+        reader.ValueArray(regions, count);
+        m_DeviceDispatch.vkCmdCopyBuffer(commandBuffer, source, destination, count, regions);
+        break;
+    }
+    case CaptureCommand::CmdFillBuffer:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        const VkDeviceSize offset = reader.Value<VkDeviceSize>();
+        const VkDeviceSize size = reader.Value<VkDeviceSize>();
+        m_DeviceDispatch.vkCmdFillBuffer(commandBuffer, buffer, offset, size, reader.Value<uint32_t>());
+        break;
+    }
+    case CaptureCommand::CmdCopyBufferToImage:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        VkImage image = reader.Handle<VkImage>();
+        VkImageLayout layout;
+        reader.Layout(layout);
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkBufferImageCopy* regions = nullptr;
+        reader.ValueArray(regions, count);
+        m_DeviceDispatch.vkCmdCopyBufferToImage(commandBuffer, buffer, image, layout, count, regions);
+        break;
+    }
+    case CaptureCommand::CmdCopyImageToBuffer:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkImage image = reader.Handle<VkImage>();
+        VkImageLayout layout;
+        reader.Layout(layout);
+        VkBuffer buffer = reader.Handle<VkBuffer>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkBufferImageCopy* regions = nullptr;
+        reader.ValueArray(regions, count);
+        m_DeviceDispatch.vkCmdCopyImageToBuffer(commandBuffer, image, layout, buffer, count, regions);
+        break;
+    }
+    case CaptureCommand::CmdClearAttachments:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t attachmentCount = reader.Value<uint32_t>();
+        const VkClearAttachment* attachments = nullptr;
+        reader.ValueArray(attachments, attachmentCount);
+        const uint32_t rectCount = reader.Value<uint32_t>();
+        const VkClearRect* rects = nullptr;
+        reader.ValueArray(rects, rectCount);
+        m_DeviceDispatch.vkCmdClearAttachments(commandBuffer, attachmentCount, attachments, rectCount, rects);
+        break;
+    }
+    case CaptureCommand::CmdPipelineBarrier:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const VkPipelineStageFlags srcStages = reader.Value<VkPipelineStageFlags>();
+        const VkPipelineStageFlags dstStages = reader.Value<VkPipelineStageFlags>();
+        const VkDependencyFlags dependencyFlags = reader.Value<VkDependencyFlags>();
+        const uint32_t memoryCount = reader.Value<uint32_t>();
+        const VkMemoryBarrier* memoryBarriers = nullptr;
+        reader.Array(memoryBarriers, memoryCount);
+        const uint32_t bufferCount = reader.Value<uint32_t>();
+        const VkBufferMemoryBarrier* bufferBarriers = nullptr;
+        reader.Array(bufferBarriers, bufferCount);
+        const uint32_t imageCount = reader.Value<uint32_t>();
+        const VkImageMemoryBarrier* imageBarriers = nullptr;
+        reader.Array(imageBarriers, imageCount);
+        m_DeviceDispatch.vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, dependencyFlags, memoryCount, memoryBarriers,
+            bufferCount, bufferBarriers, imageCount, imageBarriers);
+        break;
+    }
+    case CaptureCommand::CmdPipelineBarrier2:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkDependencyInfo info{};
+        Serialize(reader, info);
+        PFN_vkCmdPipelineBarrier2 pipelineBarrier2 = m_DeviceDispatch.vkCmdPipelineBarrier2 != nullptr
+            ? m_DeviceDispatch.vkCmdPipelineBarrier2 : m_DeviceDispatch.vkCmdPipelineBarrier2KHR;
+        if (pipelineBarrier2 == nullptr)
+        {
+            throw std::runtime_error("Capture uses synchronization2, which the device does not support!");
+        }
+        pipelineBarrier2(commandBuffer, &info);
+        break;
+    }
+    case CaptureCommand::CmdBeginQuery:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkQueryPool pool = reader.Handle<VkQueryPool>();
+        const uint32_t query = reader.Value<uint32_t>();
+        m_DeviceDispatch.vkCmdBeginQuery(commandBuffer, pool, query, reader.Value<VkQueryControlFlags>());
+        break;
+    }
+    case CaptureCommand::CmdEndQuery:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkQueryPool pool = reader.Handle<VkQueryPool>();
+        m_DeviceDispatch.vkCmdEndQuery(commandBuffer, pool, reader.Value<uint32_t>());
+        break;
+    }
+    case CaptureCommand::CmdResetQueryPool:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkQueryPool pool = reader.Handle<VkQueryPool>();
+        const uint32_t first = reader.Value<uint32_t>();
+        m_DeviceDispatch.vkCmdResetQueryPool(commandBuffer, pool, first, reader.Value<uint32_t>());
+        break;
+    }
+    case CaptureCommand::CmdWriteTimestamp:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const VkPipelineStageFlagBits stage = reader.Value<VkPipelineStageFlagBits>();
+        VkQueryPool pool = reader.Handle<VkQueryPool>();
+        m_DeviceDispatch.vkCmdWriteTimestamp(commandBuffer, stage, pool, reader.Value<uint32_t>());
+        break;
+    }
+    case CaptureCommand::CmdBeginRenderPass:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        VkRenderPassBeginInfo info{};
+        Serialize(reader, info);
+        m_DeviceDispatch.vkCmdBeginRenderPass(commandBuffer, &info, reader.Value<VkSubpassContents>());
+        break;
+    }
+    case CaptureCommand::CmdEndRenderPass:
+        m_DeviceDispatch.vkCmdEndRenderPass(reader.Handle<VkCommandBuffer>());
+        break;
+    case CaptureCommand::CmdExecuteCommands:
+    {
+        VkCommandBuffer commandBuffer = reader.Handle<VkCommandBuffer>();
+        const uint32_t count = reader.Value<uint32_t>();
+        const VkCommandBuffer* commandBuffers = nullptr;
+        reader.HandleArray(commandBuffers, count);
+        m_DeviceDispatch.vkCmdExecuteCommands(commandBuffer, count, commandBuffers);
+        break;
+    }
+
+    case CaptureCommand::Count:
+        throw std::runtime_error("Capture holds an unknown command!");
+    }
+}
+
+std::vector<BenchmarkResult> Replayer::GetResults() const
+{
+    std::vector<BenchmarkResult> results;
+
+    BenchmarkResult loop;
+    loop.name = "replay_loop";
+    loop.samples = m_LoopMs;
+    results.push_back(loop);
+
+    BenchmarkResult frame;
+    frame.name = "replay_frame";
+    frame.samples = m_FrameMs;
+    results.push_back(frame);
+
+    BenchmarkResult submitCpu;
+    submitCpu.name = "queue_submit_cpu";
+    submitCpu.samples = m_SubmitCpuMs;
+    results.push_back(submitCpu);
+
+    // GPU time of every submission, and of every frame as the sum of its submissions
+    std::map<uint32_t, BenchmarkResult> frames;
+    for (const SubmitTiming& timing : m_SubmitTimings)
+    {
+        if (timing.gpuMs.empty())
+        {
+            continue;
+        }
+
+        BenchmarkResult submit;
+        submit.name = "gpu_frame" + std::to_string(timing.frame) + "_submit" + std::to_string(timing.submit);
+        submit.samples = timing.gpuMs;
+        results.push_back(submit);
+
+        BenchmarkResult& total = frames[timing.frame];
+        total.name = "gpu_frame" + std::to_string(timing.frame);
+        total.samples.resize(std::max(total.samples.size(), timing.gpuMs.size()), 0.0);
+        for (size_t loop = 0; loop < timing.gpuMs.size(); loop++)
+        {
+            total.samples[loop] += timing.gpuMs[loop];
+        }
+    }
+    for (auto& total : frames)
+    {
+        results.push_back(total.second);
+    }
+    return results;
+}
+
+void Replayer::PrintStats() const
+{
+    std::cout << "Replay: " << m_Stats.rebinds << " resources rebound to memory of their own, " << m_Stats.deferredDestroys
+        << " destroys deferred to the end, " << m_Stats.fenceTimeouts << " fence waits timed out\n";
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions options;
+
+    if (const char* device = std::getenv("VULKAN_ENGINE_DEVICE"))
+    {
+        options.device = device;
+    }
+
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string deviceName;
+
+    Replayer replayer;
+    try
+    {
+        replayer.Load(options.capturePath);
+        replayer.CreateDevice(options.device);
+        deviceName = replayer.GetDeviceName();
+        replayer.Run(options.loops);
+        results = replayer.GetResults();
+        replayer.PrintStats();
+        replayer.Destroy();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        replayer.Destroy();
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "\nReplay results on " << deviceName << ":\n";
+    PrintBenchmarkSummary(results, std::cout);
+
+    if (!options.outputPath.empty())
+    {
+        if (!WriteBenchmarkReport(options.outputPath, deviceName, results))
+        {
+            std::cerr << "Failed to write " << options.outputPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Results written to " << options.outputPath << '\n';
+    }
+
+    if (!options.baselinePath.empty())
+    {
+        std::map<std::string, double> baselineMedians;
+        if (!LoadBenchmarkBaseline(options.baselinePath, baselineMedians))
+        {
+            std::cerr << "Failed to read baseline " << options.baselinePath << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        uint32_t regressions = CompareWithBaseline(results, baselineMedians, options.thresholdPercent, std::cout);
+        if (regressions > 0)
+        {
+            std::cout << regressions << " measurement(s) regressed\n";
+            return 2;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1321 @@
+#include "CommandCapture.h"
+#include "CaptureFormat.h"
+#include "VulkanDispatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+// The stream is handed to the writer thread once it holds this much
+constexpr size_t WRITE_BATCH_BYTES = 4 * 1024 * 1024;
+
+namespace
+{
+    // Command buffer commands of one thread since its last flush into the capture
+    struct ThreadCommands
+    {
+        std::vector<uint8_t>    bytes;
+        uint64_t                packets = 0;
+    };
+
+    thread_local ThreadCommands t_Commands;
+
+    // The running capture, and the functions that were in the dispatch table before it. The
+    // hooks keep forwarding through s_Next after the capture stopped, calls already inside
+    // one when the table is restored still have somewhere to go.
+    std::atomic<CommandCapture*> s_Capture{ nullptr };
+    VulkanDeviceDispatch s_Next;
+}
+
+// The recording functions put into the dispatch table. Creations are recorded after the
+// driver returned the handle, destructions before the driver can hand the handle out again.
+struct CaptureHooks
+{
+    // A packet in the capture stream, after the calling thread's pending commands
+    template <typename Record>
+    static void Write(CaptureCommand command, Record&& record)
+    {
+        CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+        if (capture == nullptr)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(capture->m_Mutex);
+        if (!capture->m_Capturing)
+        {
+            return;
+        }
+        capture->FlushThreadCommands(lock);
+
+        CaptureWriter writer(capture->m_Stream);
+        writer.Begin(command);
+        record(writer);
+        writer.End();
+        capture->FinishPacket(lock);
+    }
+
+    // A packet in the calling thread's command buffer commands, no lock taken
+    template <typename Record>
+    static void WriteCommand(CaptureCommand command, Record&& record)
+    {
+        if (s_Capture.load(std::memory_order_relaxed) == nullptr)
+        {
+            return;
+        }
+
+        CaptureWriter writer(t_Commands.bytes);
+        writer.Begin(command);
+        record(writer);
+        writer.End();
+        t_Commands.packets++;
+    }
+
+    template <typename T>
+    static T& Mutable(const T& value)
+    {
+        return const_cast<T&>(value);
+    }
+
+    // Queues and synchronization
+
+    static VKAPI_ATTR void VKAPI_CALL GetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue* pQueue)
+    {
+        s_Next.vkGetDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
+        Write(CaptureCommand::GetDeviceQueue, [&](CaptureWriter& writer)
+        {
+            writer.Family(queueFamilyIndex);
+            writer.Value(queueIndex);
+            writer.Handle(*pQueue);
+        });
+    }
+
+    // Host writes are resolved here, so the packets and the submission go out under one lock
+    static VKAPI_ATTR VkResult VKAPI_CALL QueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence)
+    {
+        CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+        if (capture != nullptr)
+        {
+            std::unique_lock<std::mutex> lock(capture->m_Mutex);
+            if (capture->m_Capturing)
+            {
+                capture->FlushThreadCommands(lock);
+                capture->FlushHostWrites(lock);
+
+                CaptureWriter writer(capture->m_Stream);
+                writer.Begin(CaptureCommand::QueueSubmit);
+                writer.Handle(queue);
+                writer.Value(submitCount);
+                writer.Array(pSubmits, submitCount);
+                writer.Handle(fence);
+                writer.End();
+                capture->FinishPacket(lock);
+            }
+        }
+        return s_Next.vkQueueSubmit(queue, submitCount, pSubmits, fence);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL QueueWaitIdle(VkQueue queue)
+    {
+        Write(CaptureCommand::QueueWaitIdle, [&](CaptureWriter& writer) { writer.Handle(queue); });
+        return s_Next.vkQueueWaitIdle(queue);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL DeviceWaitIdle(VkDevice device)
+    {
+        Write(CaptureCommand::DeviceWaitIdle, [](CaptureWriter&) {});
+        return s_Next.vkDeviceWaitIdle(device);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL ResetFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences)
+    {
+        Write(CaptureCommand::ResetFences, [&](CaptureWriter& writer)
+        {
+            writer.Value(fenceCount);
+            writer.HandleArray(pFences, fenceCount);
+        });
+        return s_Next.vkResetFences(device, fenceCount, pFences);
+    }
+
+    // A wait that timed out tells the replay nothing, it only waits where the engine did
+    static VKAPI_ATTR VkResult VKAPI_CALL WaitForFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences, VkBool32 waitAll,
+        uint64_t timeout)
+    {
+        VkResult result = s_Next.vkWaitForFences(device, fenceCount, pFences, waitAll, timeout);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::WaitForFences, [&](CaptureWriter& writer)
+            {
+                writer.Value(fenceCount);
+                writer.HandleArray(pFences, fenceCount);
+                writer.Value(waitAll);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL GetFenceStatus(VkDevice device, VkFence fence)
+    {
+        VkResult result = s_Next.vkGetFenceStatus(device, fence);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::GetFenceStatus, [&](CaptureWriter& writer) { writer.Handle(fence); });
+        }
+        return result;
+    }
+
+    // Memory
+
+    static VKAPI_ATTR VkResult VKAPI_CALL AllocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo,
+        const VkAllocationCallbacks* pAllocator, VkDeviceMemory* pMemory)
+    {
+        VkResult result = s_Next.vkAllocateMemory(device, pAllocateInfo, pAllocator, pMemory);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::AllocateMemory, [&](CaptureWriter& writer)
+            {
+                Serialize(writer, Mutable(*pAllocateInfo));
+                writer.Handle(*pMemory);
+            });
+
+            CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+            if (capture != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(capture->m_Mutex);
+                capture->m_MemorySizes[*pMemory] = pAllocateInfo->allocationSize;
+            }
+        }
+        return result;
+    }
+
+    // Freeing unmaps, so writes still pending in the memory are resolved first
+    static VKAPI_ATTR void VKAPI_CALL FreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* pAllocator)
+    {
+        Unmap(memory, true);
+        Write(CaptureCommand::FreeMemory, [&](CaptureWriter& writer) { writer.Handle(memory); });
+        s_Next.vkFreeMemory(device, memory, pAllocator);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL MapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size,
+        VkMemoryMapFlags flags, void** ppData)
+    {
+        VkResult result = s_Next.vkMapMemory(device, memory, offset, size, flags, ppData);
+        if (result != VK_SUCCESS)
+        {
+            return result;
+        }
+
+        Write(CaptureCommand::MapMemory, [&](CaptureWriter& writer)
+        {
+            writer.Handle(memory);
+            writer.Value(offset);
+            writer.Value(size);
+            writer.Value(flags);
+        });
+
+        CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+        if (capture != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(capture->m_Mutex);
+            CommandCapture::Mapping mapping;
+            mapping.memory = memory;
+            mapping.offset = offset;
+            mapping.size = size != VK_WHOLE_SIZE ? size : capture->m_MemorySizes[memory] - offset;
+            capture->m_Mappings[static_cast<const uint8_t*>(*ppData)] = mapping;
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL UnmapMemory(VkDevice device, VkDeviceMemory memory)
+    {
+        Unmap(memory, false);
+        Write(CaptureCommand::UnmapMemory, [&](CaptureWriter& writer) { writer.Handle(memory); });
+        s_Next.vkUnmapMemory(device, memory);
+    }
+
+    static void Unmap(VkDeviceMemory memory, bool free)
+    {
+        CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+        if (capture == nullptr)
+        {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(capture->m_Mutex);
+        if (capture->m_Capturing)
+        {
+            capture->FlushThreadCommands(lock);
+            capture->FlushHostWrites(lock);
+        }
+        for (auto it = capture->m_Mappings.begin(); it != capture->m_Mappings.end();)
+        {
+            it = it->second.memory == memory ? capture->m_Mappings.erase(it) : std::next(it);
+        }
+        if (free)
+        {
+            capture->m_MemorySizes.erase(memory);
+        }
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL BindBufferMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+    {
+        Write(CaptureCommand::BindBufferMemory, [&](CaptureWriter& writer)
+        {
+            writer.Handle(buffer);
+            writer.Handle(memory);
+            writer.Value(memoryOffset);
+        });
+        return s_Next.vkBindBufferMemory(device, buffer, memory, memoryOffset);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL BindImageMemory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+    {
+        Write(CaptureCommand::BindImageMemory, [&](CaptureWriter& writer)
+        {
+            writer.Handle(image);
+            writer.Handle(memory);
+            writer.Value(memoryOffset);
+        });
+        return s_Next.vkBindImageMemory(device, image, memory, memoryOffset);
+    }
+
+    // Objects whose creation is a create info and one handle, and whose destruction is the handle
+
+#define CAPTURE_CREATE_HOOK(Name, Info, Object) \
+    static VKAPI_ATTR VkResult VKAPI_CALL Create##Name(VkDevice device, const Info* pCreateInfo, const VkAllocationCallbacks* pAllocator, \
+        Object* pObject) \
+    { \
+        VkResult result = s_Next.vkCreate##Name(device, pCreateInfo, pAllocator, pObject); \
+        if (result == VK_SUCCESS) \
+        { \
+            Write(CaptureCommand::Create##Name, [&](CaptureWriter& writer) \
+            { \
+                Serialize(writer, Mutable(*pCreateInfo)); \
+                writer.Handle(*pObject); \
+            }); \
+        } \
+        return result; \
+    } \
+    static VKAPI_ATTR void VKAPI_CALL Destroy##Name(VkDevice device, Object object, const VkAllocationCallbacks* pAllocator) \
+    { \
+        if (object != VK_NULL_HANDLE) \
+        { \
+            Write(CaptureCommand::Destroy##Name, [&](CaptureWriter& writer) { writer.Handle(object); }); \
+        } \
+        s_Next.vkDestroy##Name(device, object, pAllocator); \
+    }
+
+    CAPTURE_CREATE_HOOK(Fence, VkFenceCreateInfo, VkFence)
+    CAPTURE_CREATE_HOOK(Semaphore, VkSemaphoreCreateInfo, VkSemaphore)
+    CAPTURE_CREATE_HOOK(Buffer, VkBufferCreateInfo, VkBuffer)
+    CAPTURE_CREATE_HOOK(Image, VkImageCreateInfo, VkImage)
+    CAPTURE_CREATE_HOOK(ImageView, VkImageViewCreateInfo, VkImageView)
+    CAPTURE_CREATE_HOOK(Sampler, VkSamplerCreateInfo, VkSampler)
+    CAPTURE_CREATE_HOOK(QueryPool, VkQueryPoolCreateInfo, VkQueryPool)
+    CAPTURE_CREATE_HOOK(ShaderModule, VkShaderModuleCreateInfo, VkShaderModule)
+    CAPTURE_CREATE_HOOK(PipelineCache, VkPipelineCacheCreateInfo, VkPipelineCache)
+    CAPTURE_CREATE_HOOK(PipelineLayout, VkPipelineLayoutCreateInfo, VkPipelineLayout)
+    CAPTURE_CREATE_HOOK(DescriptorSetLayout, VkDescriptorSetLayoutCreateInfo, VkDescriptorSetLayout)
+    CAPTURE_CREATE_HOOK(DescriptorPool, VkDescriptorPoolCreateInfo, VkDescriptorPool)
+    CAPTURE_CREATE_HOOK(RenderPass, VkRenderPassCreateInfo, VkRenderPass)
+    CAPTURE_CREATE_HOOK(Framebuffer, VkFramebufferCreateInfo, VkFramebuffer)
+    CAPTURE_CREATE_HOOK(CommandPool, VkCommandPoolCreateInfo, VkCommandPool)
+
+#undef CAPTURE_CREATE_HOOK
+
+    // Pipelines
+
+    static VKAPI_ATTR VkResult VKAPI_CALL CreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+        const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines)
+    {
+        VkResult result = s_Next.vkCreateGraphicsPipelines(device, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::CreateGraphicsPipelines, [&](CaptureWriter& writer)
+            {
+                writer.Handle(pipelineCache);
+                writer.Value(createInfoCount);
+                writer.Array(pCreateInfos, createInfoCount);
+                writer.HandleArray(pPipelines, createInfoCount);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL CreateComputePipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+        const VkComputePipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines)
+    {
+        VkResult result = s_Next.vkCreateComputePipelines(device, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::CreateComputePipelines, [&](CaptureWriter& writer)
+            {
+                writer.Handle(pipelineCache);
+                writer.Value(createInfoCount);
+                writer.Array(pCreateInfos, createInfoCount);
+                writer.HandleArray(pPipelines, createInfoCount);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL DestroyPipeline(VkDevice device, VkPipeline pipeline, const VkAllocationCallbacks* pAllocator)
+    {
+        if (pipeline != VK_NULL_HANDLE)
+        {
+            Write(CaptureCommand::DestroyPipeline, [&](CaptureWriter& writer) { writer.Handle(pipeline); });
+        }
+        s_Next.vkDestroyPipeline(device, pipeline, pAllocator);
+    }
+
+    // Descriptors
+
+    static VKAPI_ATTR VkResult VKAPI_CALL AllocateDescriptorSets(VkDevice device, const VkDescriptorSetAllocateInfo* pAllocateInfo,
+        VkDescriptorSet* pDescriptorSets)
+    {
+        VkResult result = s_Next.vkAllocateDescriptorSets(device, pAllocateInfo, pDescriptorSets);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::AllocateDescriptorSets, [&](CaptureWriter& writer)
+            {
+                Serialize(writer, Mutable(*pAllocateInfo));
+                writer.HandleArray(pDescriptorSets, pAllocateInfo->descriptorSetCount);
+            });
+        }
+        return result;
+    }
+
+    // The engine never copies descriptors, only the writes are recorded
+    static VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(VkDevice device, uint32_t descriptorWriteCount,
+        const VkWriteDescriptorSet* pDescriptorWrites, uint32_t descriptorCopyCount, const VkCopyDescriptorSet* pDescriptorCopies)
+    {
+        Write(CaptureCommand::UpdateDescriptorSets, [&](CaptureWriter& writer)
+        {
+            writer.Value(descriptorWriteCount);
+            writer.Array(pDescriptorWrites, descriptorWriteCount);
+        });
+        s_Next.vkUpdateDescriptorSets(device, descriptorWriteCount, pDescriptorWrites, descriptorCopyCount, pDescriptorCopies);
+    }
+
+    // Command pools and buffers
+
+    static VKAPI_ATTR VkResult VKAPI_CALL ResetCommandPool(VkDevice device, VkCommandPool commandPool, VkCommandPoolResetFlags flags)
+    {
+        Write(CaptureCommand::ResetCommandPool, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandPool);
+            writer.Value(flags);
+        });
+        return s_Next.vkResetCommandPool(device, commandPool, flags);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL AllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo,
+        VkCommandBuffer* pCommandBuffers)
+    {
+        VkResult result = s_Next.vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::AllocateCommandBuffers, [&](CaptureWriter& writer)
+            {
+                Serialize(writer, Mutable(*pAllocateInfo));
+                writer.HandleArray(pCommandBuffers, pAllocateInfo->commandBufferCount);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL FreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount,
+        const VkCommandBuffer* pCommandBuffers)
+    {
+        Write(CaptureCommand::FreeCommandBuffers, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandPool);
+            writer.Value(commandBufferCount);
+            writer.HandleArray(pCommandBuffers, commandBufferCount);
+        });
+        s_Next.vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL BeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo)
+    {
+        WriteCommand(CaptureCommand::BeginCommandBuffer, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            Serialize(writer, Mutable(*pBeginInfo));
+        });
+        return s_Next.vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+    }
+
+    // The recording is complete, it goes into the capture in one piece
+    static VKAPI_ATTR VkResult VKAPI_CALL EndCommandBuffer(VkCommandBuffer commandBuffer)
+    {
+        WriteCommand(CaptureCommand::EndCommandBuffer, [&](CaptureWriter& writer) { writer.Handle(commandBuffer); });
+
+        CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+        if (capture != nullptr)
+        {
+            std::unique_lock<std::mutex> lock(capture->m_Mutex);
+            if (capture->m_Capturing)
+            {
+                capture->FlushThreadCommands(lock);
+            }
+        }
+        return s_Next.vkEndCommandBuffer(commandBuffer);
+    }
+
+    // Swapchain
+
+    static VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(VkDevice device, const VkSwapchainCreateInfoKHR* pCreateInfo,
+        const VkAllocationCallbacks* pAllocator, VkSwapchainKHR* pSwapchain)
+    {
+        VkResult result = s_Next.vkCreateSwapchainKHR(device, pCreateInfo, pAllocator, pSwapchain);
+        if (result == VK_SUCCESS)
+        {
+            Write(CaptureCommand::CreateSwapchain, [&](CaptureWriter& writer)
+            {
+                Serialize(writer, Mutable(*pCreateInfo));
+                writer.Handle(*pSwapchain);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL DestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks* pAllocator)
+    {
+        if (swapchain != VK_NULL_HANDLE)
+        {
+            Write(CaptureCommand::DestroySwapchain, [&](CaptureWriter& writer) { writer.Handle(swapchain); });
+        }
+        s_Next.vkDestroySwapchainKHR(device, swapchain, pAllocator);
+    }
+
+    // Only the call that returns the images is recorded, not the count query before it
+    static VKAPI_ATTR VkResult VKAPI_CALL GetSwapchainImagesKHR(VkDevice device, VkSwapchainKHR swapchain, uint32_t* pSwapchainImageCount,
+        VkImage* pSwapchainImages)
+    {
+        VkResult result = s_Next.vkGetSwapchainImagesKHR(device, swapchain, pSwapchainImageCount, pSwapchainImages);
+        if (pSwapchainImages != nullptr && (result == VK_SUCCESS || result == VK_INCOMPLETE))
+        {
+            Write(CaptureCommand::GetSwapchainImages, [&](CaptureWriter& writer)
+            {
+                writer.Handle(swapchain);
+                writer.Value(*pSwapchainImageCount);
+                writer.HandleArray(pSwapchainImages, *pSwapchainImageCount);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL AcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t timeout,
+        VkSemaphore semaphore, VkFence fence, uint32_t* pImageIndex)
+    {
+        VkResult result = s_Next.vkAcquireNextImageKHR(device, swapchain, timeout, semaphore, fence, pImageIndex);
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+        {
+            Write(CaptureCommand::AcquireNextImage, [&](CaptureWriter& writer)
+            {
+                writer.Handle(swapchain);
+                writer.Handle(semaphore);
+                writer.Handle(fence);
+                writer.Value(*pImageIndex);
+            });
+        }
+        return result;
+    }
+
+    static VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo)
+    {
+        Write(CaptureCommand::QueuePresent, [&](CaptureWriter& writer)
+        {
+            writer.Handle(queue);
+            writer.Value(pPresentInfo->waitSemaphoreCount);
+            writer.HandleArray(pPresentInfo->pWaitSemaphores, pPresentInfo->waitSemaphoreCount);
+            writer.Value(pPresentInfo->swapchainCount);
+            writer.HandleArray(pPresentInfo->pSwapchains, pPresentInfo->swapchainCount);
+            writer.ValueArray(pPresentInfo->pImageIndices, pPresentInfo->swapchainCount);
+        });
+        return s_Next.vkQueuePresentKHR(queue, pPresentInfo);
+    }
+
+    // Commands
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline)
+    {
+        WriteCommand(CaptureCommand::CmdBindPipeline, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(pipelineBindPoint);
+            writer.Handle(pipeline);
+        });
+        s_Next.vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdSetViewport(VkCommandBuffer commandBuffer, uint32_t firstViewport, uint32_t viewportCount,
+        const VkViewport* pViewports)
+    {
+        WriteCommand(CaptureCommand::CmdSetViewport, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(firstViewport);
+            writer.Value(viewportCount);
+            writer.ValueArray(pViewports, viewportCount);
+        });
+        s_Next.vkCmdSetViewport(commandBuffer, firstViewport, viewportCount, pViewports);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdSetScissor(VkCommandBuffer commandBuffer, uint32_t firstScissor, uint32_t scissorCount,
+        const VkRect2D* pScissors)
+    {
+        WriteCommand(CaptureCommand::CmdSetScissor, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(firstScissor);
+            writer.Value(scissorCount);
+            writer.ValueArray(pScissors, scissorCount);
+        });
+        s_Next.vkCmdSetScissor(commandBuffer, firstScissor, scissorCount, pScissors);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint,
+        VkPipelineLayout layout, uint32_t firstSet, uint32_t descriptorSetCount, const VkDescriptorSet* pDescriptorSets,
+        uint32_t dynamicOffsetCount, const uint32_t* pDynamicOffsets)
+    {
+        WriteCommand(CaptureCommand::CmdBindDescriptorSets, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(pipelineBindPoint);
+            writer.Handle(layout);
+            writer.Value(firstSet);
+            writer.Value(descriptorSetCount);
+            writer.HandleArray(pDescriptorSets, descriptorSetCount);
+            writer.Value(dynamicOffsetCount);
+            writer.ValueArray(pDynamicOffsets, dynamicOffsetCount);
+        });
+        s_Next.vkCmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets,
+            dynamicOffsetCount, pDynamicOffsets);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdPushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkShaderStageFlags stageFlags,
+        uint32_t offset, uint32_t size, const void* pValues)
+    {
+        WriteCommand(CaptureCommand::CmdPushConstants, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(layout);
+            writer.Value(stageFlags);
+            writer.Value(offset);
+            writer.Value(size);
+            writer.Data(pValues, size);
+        });
+        s_Next.vkCmdPushConstants(commandBuffer, layout, stageFlags, offset, size, pValues);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount,
+        const VkBuffer* pBuffers, const VkDeviceSize* pOffsets)
+    {
+        WriteCommand(CaptureCommand::CmdBindVertexBuffers, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(firstBinding);
+            writer.Value(bindingCount);
+            writer.HandleArray(pBuffers, bindingCount);
+            writer.ValueArray(pOffsets, bindingCount);
+        });
+        s_Next.vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        VkIndexType indexType)
+    {
+        WriteCommand(CaptureCommand::CmdBindIndexBuffer, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(buffer);
+            writer.Value(offset);
+            writer.Value(indexType);
+        });
+        s_Next.vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount,
+        uint32_t firstVertex, uint32_t firstInstance)
+    {
+        WriteCommand(CaptureCommand::CmdDraw, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(vertexCount);
+            writer.Value(instanceCount);
+            writer.Value(firstVertex);
+            writer.Value(firstInstance);
+        });
+        s_Next.vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount,
+        uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+    {
+        WriteCommand(CaptureCommand::CmdDrawIndexed, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(indexCount);
+            writer.Value(instanceCount);
+            writer.Value(firstIndex);
+            writer.Value(vertexOffset);
+            writer.Value(firstInstance);
+        });
+        s_Next.vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+    }
+
+    static void WriteIndirect(CaptureCommand command, VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        uint32_t drawCount, uint32_t stride)
+    {
+        WriteCommand(command, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(buffer);
+            writer.Value(offset);
+            writer.Value(drawCount);
+            writer.Value(stride);
+        });
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDrawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        uint32_t drawCount, uint32_t stride)
+    {
+        WriteIndirect(CaptureCommand::CmdDrawIndirect, commandBuffer, buffer, offset, drawCount, stride);
+        s_Next.vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        uint32_t drawCount, uint32_t stride)
+    {
+        WriteIndirect(CaptureCommand::CmdDrawIndexedIndirect, commandBuffer, buffer, offset, drawCount, stride);
+        s_Next.vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+    }
+
+    // The core and the extension entry point record the same command, the replayer uses whichever it has
+    static void WriteIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer,
+        VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+    {
+        WriteCommand(CaptureCommand::CmdDrawIndexedIndirectCount, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(buffer);
+            writer.Value(offset);
+            writer.Handle(countBuffer);
+            writer.Value(countBufferOffset);
+            writer.Value(maxDrawCount);
+            writer.Value(stride);
+        });
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+    {
+        WriteIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+        s_Next.vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirectCountKHR(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset,
+        VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride)
+    {
+        WriteIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+        s_Next.vkCmdDrawIndexedIndirectCountKHR(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdDispatch(VkCommandBuffer commandBuffer, uint32_t groupCountX, uint32_t groupCountY,
+        uint32_t groupCountZ)
+    {
+        WriteCommand(CaptureCommand::CmdDispatch, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(groupCountX);
+            writer.Value(groupCountY);
+            writer.Value(groupCountZ);
+        });
+        s_Next.vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdCopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer,
+        uint32_t regionCount, const VkBufferCopy* pRegions)
+    {
+        WriteCommand(CaptureCommand::CmdCopyBuffer, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(srcBuffer);
+            writer.Handle(dstBuffer);
+            writer.Value(regionCount);
+            writer.ValueArray(pRegions, regionCount);
+        });
+        s_Next.vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, regionCount, pRegions);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdFillBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset,
+        VkDeviceSize size, uint32_t data)
+    {
+        WriteCommand(CaptureCommand::CmdFillBuffer, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(dstBuffer);
+            writer.Value(dstOffset);
+            writer.Value(size);
+            writer.Value(data);
+        });
+        s_Next.vkCmdFillBuffer(commandBuffer, dstBuffer, dstOffset, size, data);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkImage dstImage,
+        VkImageLayout dstImageLayout, uint32_t regionCount, const VkBufferImageCopy* pRegions)
+    {
+        WriteCommand(CaptureCommand::CmdCopyBufferToImage, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(srcBuffer);
+            writer.Handle(dstImage);
+            writer.Layout(dstImageLayout);
+            writer.Value(regionCount);
+            writer.ValueArray(pRegions, regionCount);
+        });
+        s_Next.vkCmdCopyBufferToImage(commandBuffer, srcBuffer, dstImage, dstImageLayout, regionCount, pRegions);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer(VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout,
+        VkBuffer dstBuffer, uint32_t regionCount, const VkBufferImageCopy* pRegions)
+    {
+        WriteCommand(CaptureCommand::CmdCopyImageToBuffer, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(srcImage);
+            writer.Layout(srcImageLayout);
+            writer.Handle(dstBuffer);
+            writer.Value(regionCount);
+            writer.ValueArray(pRegions, regionCount);
+        });
+        s_Next.vkCmdCopyImageToBuffer(commandBuffer, srcImage, srcImageLayout, dstBuffer, regionCount, pRegions);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdClearAttachments(VkCommandBuffer commandBuffer, uint32_t attachmentCount,
+        const VkClearAttachment* pAttachments, uint32_t rectCount, const VkClearRect* pRects)
+    {
+        WriteCommand(CaptureCommand::CmdClearAttachments, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(attachmentCount);
+            writer.ValueArray(pAttachments, attachmentCount);
+            writer.Value(rectCount);
+            writer.ValueArray(pRects, rectCount);
+        });
+        s_Next.vkCmdClearAttachments(commandBuffer, attachmentCount, pAttachments, rectCount, pRects);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask,
+        VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags, uint32_t memoryBarrierCount,
+        const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+        uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers)
+    {
+        WriteCommand(CaptureCommand::CmdPipelineBarrier, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(srcStageMask);
+            writer.Value(dstStageMask);
+            writer.Value(dependencyFlags);
+            writer.Value(memoryBarrierCount);
+            writer.Array(pMemoryBarriers, memoryBarrierCount);
+            writer.Value(bufferMemoryBarrierCount);
+            writer.Array(pBufferMemoryBarriers, bufferMemoryBarrierCount);
+            writer.Value(imageMemoryBarrierCount);
+            writer.Array(pImageMemoryBarriers, imageMemoryBarrierCount);
+        });
+        s_Next.vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers,
+            bufferMemoryBarrierCount, pBufferMemoryBarriers, imageMemoryBarrierCount, pImageMemoryBarriers);
+    }
+
+    static void WritePipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo)
+    {
+        WriteCommand(CaptureCommand::CmdPipelineBarrier2, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            Serialize(writer, Mutable(*pDependencyInfo));
+        });
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo)
+    {
+        WritePipelineBarrier2(commandBuffer, pDependencyInfo);
+        s_Next.vkCmdPipelineBarrier2(commandBuffer, pDependencyInfo);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier2KHR(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo)
+    {
+        WritePipelineBarrier2(commandBuffer, pDependencyInfo);
+        s_Next.vkCmdPipelineBarrier2KHR(commandBuffer, pDependencyInfo);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBeginQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query,
+        VkQueryControlFlags flags)
+    {
+        WriteCommand(CaptureCommand::CmdBeginQuery, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(queryPool);
+            writer.Value(query);
+            writer.Value(flags);
+        });
+        s_Next.vkCmdBeginQuery(commandBuffer, queryPool, query, flags);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdEndQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query)
+    {
+        WriteCommand(CaptureCommand::CmdEndQuery, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(queryPool);
+            writer.Value(query);
+        });
+        s_Next.vkCmdEndQuery(commandBuffer, queryPool, query);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdResetQueryPool(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t firstQuery,
+        uint32_t queryCount)
+    {
+        WriteCommand(CaptureCommand::CmdResetQueryPool, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Handle(queryPool);
+            writer.Value(firstQuery);
+            writer.Value(queryCount);
+        });
+        s_Next.vkCmdResetQueryPool(commandBuffer, queryPool, firstQuery, queryCount);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdWriteTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage,
+        VkQueryPool queryPool, uint32_t query)
+    {
+        WriteCommand(CaptureCommand::CmdWriteTimestamp, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(pipelineStage);
+            writer.Handle(queryPool);
+            writer.Value(query);
+        });
+        s_Next.vkCmdWriteTimestamp(commandBuffer, pipelineStage, queryPool, query);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin,
+        VkSubpassContents contents)
+    {
+        WriteCommand(CaptureCommand::CmdBeginRenderPass, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            Serialize(writer, Mutable(*pRenderPassBegin));
+            writer.Value(contents);
+        });
+        s_Next.vkCmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdEndRenderPass(VkCommandBuffer commandBuffer)
+    {
+        WriteCommand(CaptureCommand::CmdEndRenderPass, [&](CaptureWriter& writer) { writer.Handle(commandBuffer); });
+        s_Next.vkCmdEndRenderPass(commandBuffer);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount,
+        const VkCommandBuffer* pCommandBuffers)
+    {
+        WriteCommand(CaptureCommand::CmdExecuteCommands, [&](CaptureWriter& writer)
+        {
+            writer.Handle(commandBuffer);
+            writer.Value(commandBufferCount);
+            writer.HandleArray(pCommandBuffers, commandBufferCount);
+        });
+        s_Next.vkCmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+    }
+
+    // Points every function the capture records at its hook. Optional functions the device
+    // does not have stay null.
+    static void Install(VulkanDeviceDispatch& dispatch)
+    {
+#define CAPTURE_HOOK(name) if (dispatch.vk##name != nullptr) { dispatch.vk##name = &CaptureHooks::name; }
+        CAPTURE_HOOK(GetDeviceQueue)
+        CAPTURE_HOOK(QueueSubmit)
+        CAPTURE_HOOK(QueueWaitIdle)
+        CAPTURE_HOOK(DeviceWaitIdle)
+        CAPTURE_HOOK(CreateFence)
+        CAPTURE_HOOK(DestroyFence)
+        CAPTURE_HOOK(ResetFences)
+        CAPTURE_HOOK(WaitForFences)
+        CAPTURE_HOOK(GetFenceStatus)
+        CAPTURE_HOOK(CreateSemaphore)
+        CAPTURE_HOOK(DestroySemaphore)
+        CAPTURE_HOOK(AllocateMemory)
+        CAPTURE_HOOK(FreeMemory)
+        CAPTURE_HOOK(MapMemory)
+        CAPTURE_HOOK(UnmapMemory)
+        CAPTURE_HOOK(BindBufferMemory)
+        CAPTURE_HOOK(BindImageMemory)
+        CAPTURE_HOOK(CreateBuffer)
+        CAPTURE_HOOK(DestroyBuffer)
+        CAPTURE_HOOK(CreateImage)
+        CAPTURE_HOOK(DestroyImage)
+        CAPTURE_HOOK(CreateImageView)
+        CAPTURE_HOOK(DestroyImageView)
+        CAPTURE_HOOK(CreateSampler)
+        CAPTURE_HOOK(DestroySampler)
+        CAPTURE_HOOK(CreateQueryPool)
+        CAPTURE_HOOK(DestroyQueryPool)
+        CAPTURE_HOOK(CreateShaderModule)
+        CAPTURE_HOOK(DestroyShaderModule)
+        CAPTURE_HOOK(CreatePipelineCache)
+        CAPTURE_HOOK(DestroyPipelineCache)
+        CAPTURE_HOOK(CreatePipelineLayout)
+        CAPTURE_HOOK(DestroyPipelineLayout)
+        CAPTURE_HOOK(CreateGraphicsPipelines)
+        CAPTURE_HOOK(CreateComputePipelines)
+        CAPTURE_HOOK(DestroyPipeline)
+        CAPTURE_HOOK(CreateDescriptorSetLayout)
+        CAPTURE_HOOK(DestroyDescriptorSetLayout)
+        CAPTURE_HOOK(CreateDescriptorPool)
+        CAPTURE_HOOK(DestroyDescriptorPool)
+        CAPTURE_HOOK(AllocateDescriptorSets)
+        CAPTURE_HOOK(UpdateDescriptorSets)
+        CAPTURE_HOOK(CreateRenderPass)
+        CAPTURE_HOOK(DestroyRenderPass)
+        CAPTURE_HOOK(CreateFramebuffer)
+        CAPTURE_HOOK(DestroyFramebuffer)
+        CAPTURE_HOOK(CreateCommandPool)
+        CAPTURE_HOOK(DestroyCommandPool)
+        CAPTURE_HOOK(ResetCommandPool)
+        CAPTURE_HOOK(AllocateCommandBuffers)
+        CAPTURE_HOOK(FreeCommandBuffers)
+        CAPTURE_HOOK(BeginCommandBuffer)
+        CAPTURE_HOOK(EndCommandBuffer)
+        CAPTURE_HOOK(CreateSwapchainKHR)
+        CAPTURE_HOOK(DestroySwapchainKHR)
+        CAPTURE_HOOK(GetSwapchainImagesKHR)
+        CAPTURE_HOOK(AcquireNextImageKHR)
+        CAPTURE_HOOK(QueuePresentKHR)
+        CAPTURE_HOOK(CmdBindPipeline)
+        CAPTURE_HOOK(CmdSetViewport)
+        CAPTURE_HOOK(CmdSetScissor)
+        CAPTURE_HOOK(CmdBindDescriptorSets)
+        CAPTURE_HOOK(CmdPushConstants)
+        CAPTURE_HOOK(CmdBindVertexBuffers)
+        CAPTURE_HOOK(CmdBindIndexBuffer)
+        CAPTURE_HOOK(CmdDraw)
+        CAPTURE_HOOK(CmdDrawIndexed)
+        CAPTURE_HOOK(CmdDrawIndirect)
+        CAPTURE_HOOK(CmdDrawIndexedIndirect)
+        CAPTURE_HOOK(CmdDrawIndexedIndirectCount)
+        CAPTURE_HOOK(CmdDrawIndexedIndirectCountKHR)
+        CAPTURE_HOOK(CmdDispatch)
+        CAPTURE_HOOK(CmdCopyBuffer)
+        CAPTURE_HOOK(CmdFillBuffer)
+        CAPTURE_HOOK(CmdCopyBufferToImage)
+        CAPTURE_HOOK(CmdCopyImageToBuffer)
+        CAPTURE_HOOK(CmdClearAttachments)
+        CAPTURE_HOOK(CmdPipelineBarrier)
+        CAPTURE_HOOK(CmdPipelineBarrier2)
+        CAPTURE_HOOK(CmdPipelineBarrier2KHR)
+        CAPTURE_HOOK(CmdBeginQuery)
+        CAPTURE_HOOK(CmdEndQuery)
+        CAPTURE_HOOK(CmdResetQueryPool)
+        CAPTURE_HOOK(CmdWriteTimestamp)
+        CAPTURE_HOOK(CmdBeginRenderPass)
+        CAPTURE_HOOK(CmdEndRenderPass)
+        CAPTURE_HOOK(CmdExecuteCommands)
+#undef CAPTURE_HOOK
+    }
+};
+
+void CommandCapture::Create(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo& createInfo, uint32_t apiVersion,
+    VulkanDeviceDispatch& dispatch, const std::string& path, uint32_t firstFrame, uint32_t lastFrame)
+{
+    if (s_Capture.load(std::memory_order_acquire) != nullptr)
+    {
+        throw std::runtime_error("Only one command capture can run at a time!");
+    }
+
+    m_File = std::fopen(path.c_str(), "wb");
+    if (m_File == nullptr)
+    {
+        throw std::runtime_error("Failed to open capture file!");
+    }
+
+    m_Path = path;
+    m_FirstFrame = firstFrame;
+    m_LastFrame = std::max(firstFrame, lastFrame);
+    m_Stats = Stats{};
+
+    CaptureFileHeader header;
+    header.firstFrame = m_FirstFrame;
+    header.lastFrame = m_LastFrame;
+    std::fwrite(&header, sizeof(header), 1, m_File);
+    m_Stats.bytes = sizeof(header);
+
+    // What the replayer needs to pick queues and memory types that behave like these
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    const char* deviceName = properties.deviceName;
+    const VkQueueFamilyProperties* familyData = families.data();
+    CaptureWriter writer(m_Stream);
+    writer.Begin(CaptureCommand::Device);
+    writer.Value(apiVersion);
+    writer.String(deviceName);
+    writer.Value(memoryProperties);
+    writer.Value(familyCount);
+    writer.ValueArray(familyData, familyCount);
+    Serialize(writer, const_cast<VkDeviceCreateInfo&>(createInfo));
+    writer.End();
+    m_Stats.packets = 1;
+
+    s_Next = dispatch;
+    m_Dispatch = &dispatch;
+    CaptureHooks::Install(dispatch);
+
+    m_StopWriter = false;
+    m_Writer = std::thread(&CommandCapture::WriterMain, this);
+    m_Capturing = true;
+    s_Capture.store(this, std::memory_order_release);
+
+    std::cout << "Capturing frames " << m_FirstFrame << '-' << m_LastFrame << " to " << m_Path << '\n';
+}
+
+void CommandCapture::Destroy()
+{
+    Stop();
+}
+
+void CommandCapture::EndFrame(uint32_t frameNumber)
+{
+    if (!m_Capturing)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        FlushThreadCommands(lock);
+
+        CaptureWriter writer(m_Stream);
+        writer.Begin(CaptureCommand::FrameEnd);
+        writer.Value(frameNumber);
+        writer.End();
+        FinishPacket(lock);
+
+        if (frameNumber >= m_FirstFrame)
+        {
+            m_Stats.frames++;
+        }
+    }
+
+    if (frameNumber >= m_LastFrame)
+    {
+        Stop();
+    }
+}
+
+void CommandCapture::Stop()
+{
+    if (m_File == nullptr)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Capturing = false;
+        s_Capture.store(nullptr, std::memory_order_release);
+        *m_Dispatch = s_Next;
+
+        // Commands of this thread whose command buffer was never ended belong to no frame
+        t_Commands.bytes.clear();
+        t_Commands.packets = 0;
+
+        HandOff(lock);
+        m_StopWriter = true;
+        m_WriterCondition.notify_all();
+    }
+
+    m_Writer.join();
+    std::fclose(m_File);
+    m_File = nullptr;
+
+    std::cout << "Capture written to " << m_Path << '\n';
+}
+
+void CommandCapture::FlushThreadCommands(std::unique_lock<std::mutex>& lock)
+{
+    if (t_Commands.bytes.empty())
+    {
+        return;
+    }
+
+    m_Stream.insert(m_Stream.end(), t_Commands.bytes.begin(), t_Commands.bytes.end());
+    const uint64_t packets = t_Commands.packets;
+    t_Commands.bytes.clear();
+    t_Commands.packets = 0;
+    FinishPacket(lock, packets);
+}
+
+// Overlapping and adjacent ranges are merged first, a frame ring written in many small
+// allocations becomes one packet per mapping
+void CommandCapture::FlushHostWrites(std::unique_lock<std::mutex>& lock)
+{
+    if (m_HostWrites.empty())
+    {
+        return;
+    }
+
+    std::sort(m_HostWrites.begin(), m_HostWrites.end(), [](const HostWrite& a, const HostWrite& b) { return a.data < b.data; });
+
+    std::vector<HostWrite> merged;
+    for (const HostWrite& write : m_HostWrites)
+    {
+        if (!merged.empty() && write.data <= merged.back().data + merged.back().size)
+        {
+            HostWrite& last = merged.back();
+            last.size = std::max(last.size, static_cast<size_t>(write.data + write.size - last.data));
+        }
+        else
+        {
+            merged.push_back(write);
+        }
+    }
+    m_HostWrites.clear();
+
+    for (const HostWrite& range : merged)
+    {
+        const uint8_t* data = range.data;
+        const uint8_t* end = range.data + range.size;
+        while (data < end)
+        {
+            // A range can run over the end of one mapping into the next
+            auto next = m_Mappings.upper_bound(data);
+            if (next != m_Mappings.begin())
+            {
+                auto mapping = std::prev(next);
+                const uint8_t* mappingEnd = mapping->first + mapping->second.size;
+                if (data < mappingEnd)
+                {
+                    const uint8_t* pieceEnd = std::min(end, mappingEnd);
+                    const uint64_t offset = mapping->second.offset + static_cast<uint64_t>(data - mapping->first);
+                    const uint64_t size = static_cast<uint64_t>(pieceEnd - data);
+
+                    CaptureWriter writer(m_Stream);
+                    writer.Begin(CaptureCommand::WriteMemory);
+                    writer.Handle(mapping->second.memory);
+                    writer.Value(offset);
+                    writer.Value(size);
+                    writer.Bytes(data, static_cast<size_t>(size));
+                    writer.End();
+                    FinishPacket(lock);
+
+                    m_Stats.memoryWrites++;
+                    m_Stats.memoryWriteBytes += size;
+                    data = pieceEnd;
+                    continue;
+                }
+            }
+
+            m_Stats.unresolvedWrites++;
+            data = next != m_Mappings.end() && next->first < end ? next->first : end;
+        }
+    }
+}
+
+void CommandCapture::FinishPacket(std::unique_lock<std::mutex>& lock, uint64_t packets)
+{
+    m_Stats.packets += packets;
+    if (m_Stream.size() >= WRITE_BATCH_BYTES)
+    {
+        HandOff(lock);
+    }
+}
+
+// The writer has at most one batch waiting, a second full one has to wait for the disk
+void CommandCapture::HandOff(std::unique_lock<std::mutex>& lock)
+{
+    if (m_Stream.empty())
+    {
+        return;
+    }
+
+    if (!m_Pending.empty())
+    {
+        auto stallStart = std::chrono::steady_clock::now();
+        m_WriterCondition.wait(lock, [this] { return m_Pending.empty(); });
+        m_Stats.writerStalls++;
+        m_Stats.writerStallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+    }
+
+    m_Stats.bytes += m_Stream.size();
+    m_Pending.swap(m_Stream);
+    m_Stream.clear();
+    m_WriterCondition.notify_all();
+}
+
+void CommandCapture::WriterMain()
+{
+    std::vector<uint8_t> bytes;
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;)
+    {
+        m_WriterCondition.wait(lock, [this] { return !m_Pending.empty() || m_StopWriter; });
+        if (m_Pending.empty())
+        {
+            break;
+        }
+
+        // The emptied vector goes back so its capacity is reused
+        bytes.swap(m_Pending);
+        m_WriterCondition.notify_all();
+        lock.unlock();
+
+        std::fwrite(bytes.data(), 1, bytes.size(), m_File);
+        bytes.clear();
+
+        lock.lock();
+    }
+}
+
+void CommandCapture::PrintStats() const
+{
+    if (m_Stats.packets == 0)
+    {
+        return;
+    }
+
+    std::cout << "Capture: " << m_Stats.frames << " frames, " << m_Stats.packets << " packets, " << (m_Stats.bytes / 1024)
+        << " KiB, " << m_Stats.memoryWrites << " memory writes (" << (m_Stats.memoryWriteBytes / 1024) << " KiB), "
+        << m_Stats.writerStalls << " writer stalls (" << m_Stats.writerStallMs << " ms)\n";
+    if (m_Stats.unresolvedWrites > 0)
+    {
+        std::cout << "Capture: " << m_Stats.unresolvedWrites << " host writes outside mapped memory were dropped\n";
+    }
+}
+
+void CaptureHostWrite(const void* data, size_t size)
+{
+    CommandCapture* capture = s_Capture.load(std::memory_order_acquire);
+    if (capture == nullptr || size == 0)
+    {
+        return;
+    }
+
+    CommandCapture::HostWrite write;
+    write.data = static_cast<const uint8_t*>(data);
+    write.size = size;
+
+    std::lock_guard<std::mutex> lock(capture->m_Mutex);
+    capture->m_HostWrites.push_back(write);
+}
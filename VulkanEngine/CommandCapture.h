@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+struct VkDeviceCreateInfo;
+struct VulkanDeviceDispatch;
+
+// Records the engine's Vulkan calls into a file CaptureReplay can run without the engine
+// (format in CaptureFormat.h).
+//
+// Create swaps the entries of the device dispatch table for functions that serialize their
+// arguments and then call what was in the table before. Recording starts with the device and
+// stops after lastFrame, everything before firstFrame is what the replayer runs once to get
+// the resources into the state the captured frames start from. Destroy, or the end of the
+// last frame, puts the original functions back.
+//
+// Command buffer commands are collected per thread and go into the file when the command
+// buffer ends, so worker threads recording in parallel never wait for each other. Every other
+// call takes the capture lock. Full buffers are written to disk by a background thread.
+//
+// What the CPU writes into mapped memory is not visible to the dispatch table: the engine
+// reports those ranges with CaptureHostWrite and their contents are recorded at the next
+// queue submission, when the GPU can first see them.
+class CommandCapture
+{
+public:
+    struct Stats
+    {
+        uint64_t    packets             = 0;
+        uint64_t    bytes               = 0;    // written to the file, headers included
+        uint64_t    memoryWrites        = 0;    // WriteMemory packets after merging ranges
+        uint64_t    memoryWriteBytes    = 0;
+        uint64_t    unresolvedWrites    = 0;    // host writes outside every mapping, dropped
+        uint32_t    frames              = 0;    // frames in the capture range that were recorded
+        uint32_t    writerStalls        = 0;    // a full buffer had to wait for the file
+        double      writerStallMs       = 0.0;
+    };
+
+    // Starts recording into path. createInfo is what the device was created with, apiVersion
+    // the version the engine uses it with. Only one capture can run at a time.
+    void Create(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo& createInfo, uint32_t apiVersion,
+        VulkanDeviceDispatch& dispatch, const std::string& path, uint32_t firstFrame, uint32_t lastFrame);
+    // Flushes what was recorded and restores the dispatch table if the capture is still running
+    void Destroy();
+
+    // Marks the end of a frame, from the thread that submits. After lastFrame the capture is
+    // finished and the dispatch table restored.
+    void EndFrame(uint32_t frameNumber);
+
+    bool IsCapturing() const { return m_Capturing; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    friend struct CaptureHooks;
+    friend void CaptureHostWrite(const void* data, size_t size);
+
+    // Persistent mappings, by the address vkMapMemory returned
+    struct Mapping
+    {
+        VkDeviceMemory  memory  = nullptr;
+        uint64_t        offset  = 0;        // of the mapping within the memory
+        uint64_t        size    = 0;
+    };
+
+    struct HostWrite
+    {
+        const uint8_t*  data    = nullptr;
+        size_t          size    = 0;
+    };
+
+    // Callers hold m_Mutex through lock. A packet that fills the stream hands it to the writer
+    // thread, which can mean waiting for the previous one to be written.
+    void FlushThreadCommands(std::unique_lock<std::mutex>& lock);
+    void FlushHostWrites(std::unique_lock<std::mutex>& lock);
+    void FinishPacket(std::unique_lock<std::mutex>& lock, uint64_t packets = 1);
+    void HandOff(std::unique_lock<std::mutex>& lock);
+
+    // Restores the dispatch table and finishes the file
+    void Stop();
+
+    void WriterMain();
+
+    std::mutex                  m_Mutex;
+    std::condition_variable     m_WriterCondition;
+    std::thread                 m_Writer;
+    FILE*                       m_File          = nullptr;
+    std::string                 m_Path;
+
+    std::vector<uint8_t>        m_Stream;       // packets not yet handed to the writer
+    std::vector<uint8_t>        m_Pending;      // handed to the writer, empty once it took them
+    bool                        m_StopWriter    = false;
+
+    VulkanDeviceDispatch*       m_Dispatch      = nullptr;
+    bool                        m_Capturing     = false;
+    uint32_t                    m_FirstFrame    = 0;
+    uint32_t                    m_LastFrame     = 0;
+
+    std::map<const uint8_t*, Mapping>               m_Mappings;
+    std::unordered_map<VkDeviceMemory, uint64_t>    m_MemorySizes;
+    std::vector<HostWrite>                          m_HostWrites;
+
+    Stats                       m_Stats;
+};
+
+// Reports that the CPU wrote size bytes at data, which lies in a mapping of device memory.
+// Does nothing unless a capture is running. The contents are read at the next submission on
+// any queue, so this can be called before the bytes are written but they have to be in place
+// by then.
+void CaptureHostWrite(const void* data, size_t size);
@@ -0,0 +1,217 @@
+#include "CommandRecorder.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+// Slices smaller than this cost more in job overhead and vkCmdExecuteCommands than they save
+constexpr uint32_t MIN_ITEMS_PER_SLICE = 256;
+
+// More slices than threads lets threads that finish early steal the rest
+constexpr uint32_t SLICES_PER_THREAD = 4;
+
+void CommandRecorder::Create(JobSystem& jobs, VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t queueFamily,
+    uint32_t framesInFlight, const VkAllocationCallbacks* allocator)
+{
+    m_Jobs = &jobs;
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = allocator;
+    m_ThreadCount = jobs.GetThreadCount();
+    m_Stats = Stats{};
+
+    // Command buffers are only ever recycled together with their pool
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    m_Pools.resize(framesInFlight);
+    for (auto& framePools : m_Pools)
+    {
+        framePools.resize(m_ThreadCount);
+        for (ThreadPool& pool : framePools)
+        {
+            if (m_Dispatch->vkCreateCommandPool(m_Device, &poolInfo, m_Allocator, &pool.pool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create recording command pool!");
+            }
+        }
+    }
+}
+
+void CommandRecorder::Destroy()
+{
+    // Destroying a pool frees its command buffers
+    for (auto& framePools : m_Pools)
+    {
+        for (ThreadPool& pool : framePools)
+        {
+            m_Dispatch->vkDestroyCommandPool(m_Device, pool.pool, m_Allocator);
+        }
+    }
+    m_Pools.clear();
+}
+
+void CommandRecorder::BeginFrame(uint32_t frameIndex)
+{
+    m_FrameIndex = frameIndex;
+
+    for (ThreadPool& pool : m_Pools[frameIndex])
+    {
+        if (pool.used > 0)
+        {
+            m_Dispatch->vkResetCommandPool(m_Device, pool.pool, 0);
+            pool.used = 0;
+        }
+    }
+}
+
+VkCommandBuffer CommandRecorder::AcquireSecondary(ThreadPool& pool)
+{
+    if (pool.used == pool.buffers.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool.pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (m_Dispatch->vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate secondary command buffer!");
+        }
+        pool.buffers.push_back(commandBuffer);
+    }
+    return pool.buffers[pool.used++];
+}
+
+void CommandRecorder::Record(VkCommandBuffer primary, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+    uint32_t itemCount, const RecordFunction& record)
+{
+    if (itemCount == 0)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Contiguous slices of nearly equal size
+    uint32_t maxSlices = (m_ThreadCount > 1) ? m_ThreadCount * SLICES_PER_THREAD : 1;
+    uint32_t sliceCount = std::min(maxSlices, (itemCount + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE);
+    sliceCount = std::max(sliceCount, 1u);
+
+    m_Slices.resize(sliceCount);
+    for (uint32_t i = 0; i < sliceCount; i++)
+    {
+        uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(itemCount) * i / sliceCount);
+        uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(itemCount) * (i + 1) / sliceCount);
+        m_Slices[i].first = first;
+        m_Slices[i].count = end - first;
+        m_Slices[i].commandBuffer = nullptr;
+    }
+
+    m_RenderPass = renderPass;
+    m_Subpass = subpass;
+    m_Framebuffer = framebuffer;
+    m_Record = &record;
+
+    // One job per slice, the calling thread helps until all of them are recorded. Nothing on
+    // a worker would catch an exception, the first one is kept and rethrown here.
+    m_Jobs->ParallelFor(sliceCount, 1, [this](uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            try
+            {
+                RecordSlice(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_ErrorMutex);
+                if (!m_Error)
+                {
+                    m_Error = std::current_exception();
+                }
+            }
+        }
+    });
+
+    if (m_Error)
+    {
+        std::exception_ptr error = m_Error;
+        m_Error = nullptr;
+        m_Record = nullptr;
+        std::rethrow_exception(error);
+    }
+
+    // Executed in slice order, so the draw order of the list is preserved
+    std::vector<VkCommandBuffer> secondaries(sliceCount);
+    for (uint32_t i = 0; i < sliceCount; i++)
+    {
+        secondaries[i] = m_Slices[i].commandBuffer;
+    }
+    m_Dispatch->vkCmdExecuteCommands(primary, sliceCount, secondaries.data());
+
+    m_Record = nullptr;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_Stats.frames++;
+    m_Stats.items += itemCount;
+    m_Stats.secondaryBuffers += sliceCount;
+    m_Stats.recordMs += ms;
+    m_Stats.maxRecordMs = std::max(m_Stats.maxRecordMs, ms);
+}
+
+void CommandRecorder::RecordSlice(uint32_t sliceIndex)
+{
+    PROFILE_SCOPE("RecordSlice");
+
+    // Whichever thread runs the slice allocates from its own pool, so pools need no lock
+    Slice& slice = m_Slices[sliceIndex];
+    slice.commandBuffer = AcquireSecondary(m_Pools[m_FrameIndex][JobSystem::GetThreadIndex()]);
+
+    // The secondary buffer continues the render pass the primary is in
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = m_RenderPass;
+    inheritanceInfo.subpass = m_Subpass;
+    inheritanceInfo.framebuffer = m_Framebuffer;
+    inheritanceInfo.pipelineStatistics = m_InheritedPipelineStatistics;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (m_Dispatch->vkBeginCommandBuffer(slice.commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to begin recording secondary command buffer!");
+    }
+
+    (*m_Record)(slice.commandBuffer, slice.first, slice.count);
+
+    if (m_Dispatch->vkEndCommandBuffer(slice.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to record secondary command buffer!");
+    }
+}
+
+void CommandRecorder::PrintStats() const
+{
+    if (m_Stats.frames == 0)
+    {
+        return;
+    }
+
+    std::cout << "Command recording: " << m_Stats.items / m_Stats.frames << " items per frame on " << m_ThreadCount << " threads, "
+        << static_cast<double>(m_Stats.secondaryBuffers) / m_Stats.frames << " secondary buffers per frame, "
+        << m_Stats.recordMs / m_Stats.frames << " ms average, " << m_Stats.maxRecordMs << " ms max\n";
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+class JobSystem;
+struct VulkanDeviceDispatch;
+
+// Records a draw list on the job system's threads. Every thread owns one VkCommandPool per
+// frame in flight, so no two threads ever touch the same pool. The draw list is split into
+// disjoint slices, each slice is recorded as a job into a secondary command buffer that
+// continues the current render pass, and the primary command buffer executes them in order.
+//
+// Pools are reset as a whole at the start of a frame, which recycles every secondary
+// buffer of that frame at once instead of resetting or freeing them one by one.
+class CommandRecorder
+{
+public:
+    // Records draw list items [first, first + count) into commandBuffer.
+    // Called concurrently from all recording threads.
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+    struct Stats
+    {
+        uint64_t    frames              = 0;
+        uint64_t    items               = 0;
+        uint64_t    secondaryBuffers    = 0;
+        double      recordMs            = 0.0;  // wall time spent in Record
+        double      maxRecordMs         = 0.0;
+    };
+
+    // Creates pools for every thread of jobs, which has to outlive the recorder
+    void Create(JobSystem& jobs, VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t queueFamily,
+        uint32_t framesInFlight, const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    // Resets every pool of the frame. The frame's previous submission must have finished.
+    void BeginFrame(uint32_t frameIndex);
+
+    // Records itemCount items into secondary buffers and executes them in primary, which has
+    // to be inside the given subpass of renderPass, begun with secondary command buffer contents.
+    // An exception thrown while recording a slice is rethrown on the calling thread once all
+    // slices are done; nothing is executed in primary then.
+    void Record(VkCommandBuffer primary, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+        uint32_t itemCount, const RecordFunction& record);
+
+    // VkQueryPipelineStatisticFlags of a pipeline statistics query that can be active in the
+    // primary while it executes the secondaries. Needs the inheritedQueries feature.
+    void SetInheritedPipelineStatistics(uint32_t pipelineStatistics) { m_InheritedPipelineStatistics = pipelineStatistics; }
+
+    uint32_t GetThreadCount() const { return m_ThreadCount; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // One per job system thread and frame in flight
+    struct ThreadPool
+    {
+        VkCommandPool                   pool        = nullptr;
+        std::vector<VkCommandBuffer>    buffers;
+        size_t                          used        = 0;
+    };
+
+    // One secondary command buffer's share of the draw list
+    struct Slice
+    {
+        uint32_t        first           = 0;
+        uint32_t        count           = 0;
+        VkCommandBuffer commandBuffer   = nullptr;
+    };
+
+    VkCommandBuffer AcquireSecondary(ThreadPool& pool);
+    void RecordSlice(uint32_t sliceIndex);
+
+    JobSystem*                      m_Jobs          = nullptr;
+    VkDevice                        m_Device        = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch      = nullptr;
+    const VkAllocationCallbacks*    m_Allocator     = nullptr;
+    uint32_t                        m_ThreadCount   = 1;
+    uint32_t                        m_FrameIndex    = 0;
+    uint32_t                        m_InheritedPipelineStatistics = 0;
+    std::vector<std::vector<ThreadPool>> m_Pools;   // [frame in flight][thread]
+
+    // State of the current Record call, only read by the slice jobs
+    std::vector<Slice>              m_Slices;
+    VkRenderPass                    m_RenderPass    = nullptr;
+    uint32_t                        m_Subpass       = 0;
+    VkFramebuffer                   m_Framebuffer   = nullptr;
+    const RecordFunction*           m_Record        = nullptr;
+    std::mutex                      m_ErrorMutex;
+    std::exception_ptr              m_Error;        // first exception of a slice job
+
+    Stats                           m_Stats;
+};
@@ -0,0 +1,1009 @@
+#include "ComputeContext.h"
+#include "PhysicalDeviceSelector.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+constexpr uint32_t MAX_VULKAN_API_VERSION = VK_API_VERSION_1_3;
+
+// Descriptor pools are created as they fill up, each with room for this many sets
+constexpr uint32_t SETS_PER_POOL = 64;
+constexpr uint32_t DESCRIPTORS_PER_POOL = 256;
+
+// The compute family with the fewest other capabilities, a dedicated one if there is one
+static uint32_t FindComputeFamily(VkPhysicalDevice physicalDevice)
+{
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+    uint32_t best = UINT32_MAX;
+    uint32_t bestExtra = UINT32_MAX;
+    for (uint32_t i = 0; i < familyCount; i++)
+    {
+        if ((families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0 || families[i].queueCount == 0)
+        {
+            continue;
+        }
+
+        uint32_t extra = 0;
+        for (VkQueueFlags flags = families[i].queueFlags & ~VK_QUEUE_COMPUTE_BIT; flags != 0; flags &= flags - 1)
+        {
+            extra++;
+        }
+        if (extra < bestExtra)
+        {
+            best = i;
+            bestExtra = extra;
+        }
+    }
+    return best;
+}
+
+void ComputeContext::Batch::Dispatch(Handle kernel, std::initializer_list<Handle> buffers, uint32_t groupsX, uint32_t groupsY,
+    uint32_t groupsZ, const void* pushConstants, uint32_t pushConstantSize)
+{
+    Command command;
+    command.type = Type::Dispatch;
+    command.kernel = kernel;
+    command.firstBuffer = static_cast<uint32_t>(m_Buffers.size());
+    command.bufferCount = static_cast<uint32_t>(buffers.size());
+    command.groups[0] = groupsX;
+    command.groups[1] = groupsY;
+    command.groups[2] = groupsZ;
+    command.pushOffset = static_cast<uint32_t>(m_PushConstants.size());
+    command.pushSize = pushConstants != nullptr ? pushConstantSize : 0;
+
+    m_Buffers.insert(m_Buffers.end(), buffers.begin(), buffers.end());
+    if (command.pushSize > 0)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(pushConstants);
+        m_PushConstants.insert(m_PushConstants.end(), bytes, bytes + command.pushSize);
+    }
+    m_Commands.push_back(command);
+}
+
+void ComputeContext::Batch::Copy(Handle source, uint64_t sourceOffset, Handle destination, uint64_t destinationOffset, uint64_t size)
+{
+    Command command;
+    command.type = Type::Copy;
+    command.firstBuffer = static_cast<uint32_t>(m_Buffers.size());
+    command.bufferCount = 2;
+    command.sourceOffset = sourceOffset;
+    command.destinationOffset = destinationOffset;
+    command.size = size;
+
+    m_Buffers.push_back(source);
+    m_Buffers.push_back(destination);
+    m_Commands.push_back(command);
+}
+
+void ComputeContext::Batch::Fill(Handle buffer, uint32_t value)
+{
+    Command command;
+    command.type = Type::Fill;
+    command.firstBuffer = static_cast<uint32_t>(m_Buffers.size());
+    command.bufferCount = 1;
+    command.value = value;
+
+    m_Buffers.push_back(buffer);
+    m_Commands.push_back(command);
+}
+
+void ComputeContext::Batch::Clear()
+{
+    m_Commands.clear();
+    m_Buffers.clear();
+    m_PushConstants.clear();
+}
+
+void ComputeContext::Create(const std::string& deviceOverride, const std::string& pipelineCachePath)
+{
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&apiVersion) == VK_SUCCESS)
+    {
+        apiVersion = std::min(apiVersion, MAX_VULKAN_API_VERSION);
+    }
+
+    // No surface, no window system extensions
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "VulkanEngineCompute";
+    appInfo.pEngineName = "No Engine";
+    appInfo.apiVersion = apiVersion;
+
+    VkInstanceCreateInfo instanceInfo{};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+
+    if (vkCreateInstance(&instanceInfo, nullptr, &m_Instance) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create instance!");
+    }
+
+    try
+    {
+        PhysicalDeviceSelector selector(m_Instance, apiVersion);
+        m_PhysicalDevice = selector.Select(
+            [](VkPhysicalDevice device) { return FindComputeFamily(device) == UINT32_MAX ? std::string("no compute queue") : std::string(); },
+            deviceOverride);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+        m_DeviceName = properties.deviceName;
+        m_MaxGroupCount = properties.limits.maxComputeWorkGroupCount[0];
+        apiVersion = std::min(apiVersion, properties.apiVersion);
+
+        m_QueueFamily = FindComputeFamily(m_PhysicalDevice);
+
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = m_QueueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkDeviceCreateInfo deviceInfo{};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+
+        if (vkCreateDevice(m_PhysicalDevice, &deviceInfo, nullptr, &m_Device) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create logical device!");
+        }
+        m_Dispatch.Load(m_Device, vkGetDeviceProcAddr);
+        m_Dispatch.vkGetDeviceQueue(m_Device, m_QueueFamily, 0, &m_Queue);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = m_QueueFamily;
+
+        if (m_Dispatch.vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute command pool!");
+        }
+
+        m_Allocator.Create(m_PhysicalDevice, m_Device, m_Dispatch, apiVersion, false, nullptr);
+
+        if (!pipelineCachePath.empty())
+        {
+            m_PipelineCache.Create(m_PhysicalDevice, m_Device, m_Dispatch, pipelineCachePath, false, nullptr);
+            m_UsePipelineCache = true;
+        }
+    }
+    catch (...)
+    {
+        Destroy();
+        throw;
+    }
+
+    std::cout << "Compute on " << m_DeviceName << ", queue family " << m_QueueFamily << '\n';
+}
+
+void ComputeContext::Destroy()
+{
+    if (m_Device != VK_NULL_HANDLE)
+    {
+        WaitIdle();
+
+        for (Handle kernel = 0; kernel < m_Kernels.size(); kernel++)
+        {
+            if (m_Kernels[kernel].pipeline != VK_NULL_HANDLE)
+            {
+                DestroyKernel(kernel);
+            }
+        }
+        for (Handle buffer = 0; buffer < m_Buffers.size(); buffer++)
+        {
+            if (m_Buffers[buffer].buffer != VK_NULL_HANDLE)
+            {
+                DestroyBuffer(buffer);
+            }
+        }
+        m_Kernels.clear();
+        m_FreeKernels.clear();
+        m_Buffers.clear();
+        m_FreeBuffers.clear();
+
+        // Sets go away with their pools
+        for (VkDescriptorPool pool : m_DescriptorPools)
+        {
+            m_Dispatch.vkDestroyDescriptorPool(m_Device, pool, nullptr);
+        }
+        m_DescriptorPools.clear();
+        m_DescriptorSets.clear();
+        m_FreeDescriptorSets.clear();
+        m_PoolSetsLeft = 0;
+        m_PoolDescriptorsLeft = 0;
+        for (auto& setLayout : m_SetLayouts)
+        {
+            m_Dispatch.vkDestroyDescriptorSetLayout(m_Device, setLayout.second, nullptr);
+        }
+        m_SetLayouts.clear();
+
+        for (Submission& submission : m_Submissions)
+        {
+            m_Dispatch.vkDestroyFence(m_Device, submission.fence, nullptr);
+        }
+        m_Submissions.clear();
+        m_InFlight.clear();
+        m_Recording = NO_SUBMISSION;
+
+        if (m_UsePipelineCache)
+        {
+            m_PipelineCache.Save();
+            m_PipelineCache.Destroy();
+        }
+        m_Allocator.Destroy();
+
+        // Frees the command buffers
+        if (m_CommandPool != VK_NULL_HANDLE)
+        {
+            m_Dispatch.vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+            m_CommandPool = VK_NULL_HANDLE;
+        }
+
+        m_Dispatch.vkDestroyDevice(m_Device, nullptr);
+        m_Device = VK_NULL_HANDLE;
+    }
+
+    if (m_Instance != VK_NULL_HANDLE)
+    {
+        vkDestroyInstance(m_Instance, nullptr);
+        m_Instance = VK_NULL_HANDLE;
+    }
+}
+
+ComputeContext::Handle ComputeContext::CreateBuffer(uint64_t size, Memory memory)
+{
+    if (size == 0 || size % sizeof(uint32_t) != 0)
+    {
+        throw std::runtime_error("Compute buffer size has to be a non-zero multiple of 4!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    Buffer buffer;
+    buffer.size = size;
+    buffer.memory = memory;
+    if (m_Dispatch.vkCreateBuffer(m_Device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create compute buffer!");
+    }
+
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = memory == Memory::Upload ? GpuAllocator::Usage::Upload
+        : memory == Memory::Readback ? GpuAllocator::Usage::Readback : GpuAllocator::Usage::GpuOnly;
+    try
+    {
+        buffer.allocation = m_Allocator.AllocateForBuffer(buffer.buffer, allocInfo);
+    }
+    catch (...)
+    {
+        m_Dispatch.vkDestroyBuffer(m_Device, buffer.buffer, nullptr);
+        throw;
+    }
+
+    if (!m_FreeBuffers.empty())
+    {
+        Handle handle = m_FreeBuffers.back();
+        m_FreeBuffers.pop_back();
+        m_Buffers[handle] = buffer;
+        return handle;
+    }
+    m_Buffers.push_back(buffer);
+    return static_cast<Handle>(m_Buffers.size() - 1);
+}
+
+void ComputeContext::DestroyBuffer(Handle handle)
+{
+    Buffer& buffer = GetBuffer(handle);
+    Wait(buffer.lastUse);
+
+    // The work that read the sets is done as well, they can hold other buffers now
+    for (auto it = m_DescriptorSets.begin(); it != m_DescriptorSets.end();)
+    {
+        if (std::find(it->first.begin(), it->first.end(), handle) != it->first.end())
+        {
+            m_FreeDescriptorSets[static_cast<uint32_t>(it->first.size())].push_back(it->second);
+            it = m_DescriptorSets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    m_Dispatch.vkDestroyBuffer(m_Device, buffer.buffer, nullptr);
+    m_Allocator.Free(buffer.allocation);
+    buffer = Buffer{};
+    m_FreeBuffers.push_back(handle);
+}
+
+void* ComputeContext::GetMapped(Handle buffer) const
+{
+    return buffer < m_Buffers.size() && m_Buffers[buffer].allocation != nullptr ? m_Buffers[buffer].allocation->mapped : nullptr;
+}
+
+uint64_t ComputeContext::GetSize(Handle buffer) const
+{
+    return buffer < m_Buffers.size() ? m_Buffers[buffer].size : 0;
+}
+
+ComputeContext::Buffer& ComputeContext::GetBuffer(Handle buffer)
+{
+    if (buffer >= m_Buffers.size() || m_Buffers[buffer].buffer == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Invalid compute buffer handle!");
+    }
+    return m_Buffers[buffer];
+}
+
+ComputeContext::Kernel& ComputeContext::GetKernel(Handle kernel)
+{
+    if (kernel >= m_Kernels.size() || m_Kernels[kernel].pipeline == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Invalid compute kernel handle!");
+    }
+    return m_Kernels[kernel];
+}
+
+VkShaderModule ComputeContext::CreateShaderModule(const KernelDesc& desc) const
+{
+    // SPIR-V is a stream of 32-bit words, the vector keeps the code aligned for them
+    std::vector<uint32_t> code;
+    const uint32_t* words = desc.code;
+    size_t size = desc.codeSize;
+    if (words == nullptr)
+    {
+        std::ifstream file(desc.path, std::ios::ate | std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open shader " + desc.path + "!");
+        }
+
+        size = static_cast<size_t>(file.tellg());
+        code.resize(size / sizeof(uint32_t));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(code.size() * sizeof(uint32_t)));
+        words = code.data();
+    }
+    if (size == 0 || size % sizeof(uint32_t) != 0)
+    {
+        throw std::runtime_error("Invalid SPIR-V in " + (desc.path.empty() ? std::string("kernel code") : desc.path) + "!");
+    }
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = size;
+    createInfo.pCode = words;
+
+    VkShaderModule module;
+    if (m_Dispatch.vkCreateShaderModule(m_Device, &createInfo, nullptr, &module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create shader module for a compute kernel!");
+    }
+    return module;
+}
+
+VkDescriptorSetLayout ComputeContext::GetSetLayout(uint32_t bindingCount)
+{
+    VkDescriptorSetLayout& setLayout = m_SetLayouts[bindingCount];
+    if (setLayout != VK_NULL_HANDLE)
+    {
+        return setLayout;
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings.data();
+
+    if (m_Dispatch.vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+    {
+        m_SetLayouts.erase(bindingCount);
+        throw std::runtime_error("Failed to create compute descriptor set layout!");
+    }
+    return setLayout;
+}
+
+ComputeContext::Handle ComputeContext::CreateKernel(const KernelDesc& desc)
+{
+    Kernel kernel;
+    kernel.bindings = desc.bindings;
+    kernel.pushConstantSize = desc.pushConstantSize;
+    kernel.setLayout = GetSetLayout(static_cast<uint32_t>(desc.bindings.size()));
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = desc.pushConstantSize;
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &kernel.setLayout;
+    layoutInfo.pushConstantRangeCount = desc.pushConstantSize > 0 ? 1 : 0;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (m_Dispatch.vkCreatePipelineLayout(m_Device, &layoutInfo, nullptr, &kernel.layout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create compute pipeline layout!");
+    }
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    try
+    {
+        module = CreateShaderModule(desc);
+
+        std::vector<VkSpecializationMapEntry> entries(desc.constants.size());
+        std::vector<uint32_t> values(desc.constants.size());
+        for (size_t i = 0; i < desc.constants.size(); i++)
+        {
+            entries[i].constantID = desc.constants[i].id;
+            entries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+            entries[i].size = sizeof(uint32_t);
+            values[i] = desc.constants[i].value;
+        }
+
+        VkSpecializationInfo specialization{};
+        specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+        specialization.pMapEntries = entries.data();
+        specialization.dataSize = values.size() * sizeof(uint32_t);
+        specialization.pData = values.data();
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = desc.entryPoint;
+        pipelineInfo.stage.pSpecializationInfo = entries.empty() ? nullptr : &specialization;
+        pipelineInfo.layout = kernel.layout;
+
+        if (m_UsePipelineCache)
+        {
+            m_PipelineCache.CreateComputePipelines(1, &pipelineInfo, &kernel.pipeline);
+        }
+        else if (m_Dispatch.vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &kernel.pipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute pipeline!");
+        }
+    }
+    catch (...)
+    {
+        if (module != VK_NULL_HANDLE)
+        {
+            m_Dispatch.vkDestroyShaderModule(m_Device, module, nullptr);
+        }
+        m_Dispatch.vkDestroyPipelineLayout(m_Device, kernel.layout, nullptr);
+        throw;
+    }
+
+    // The pipeline keeps what it needs
+    m_Dispatch.vkDestroyShaderModule(m_Device, module, nullptr);
+
+    if (!m_FreeKernels.empty())
+    {
+        Handle handle = m_FreeKernels.back();
+        m_FreeKernels.pop_back();
+        m_Kernels[handle] = std::move(kernel);
+        return handle;
+    }
+    m_Kernels.push_back(std::move(kernel));
+    return static_cast<Handle>(m_Kernels.size() - 1);
+}
+
+void ComputeContext::DestroyKernel(Handle handle)
+{
+    Kernel& kernel = GetKernel(handle);
+    Wait(kernel.lastUse);
+
+    // A new pipeline may get the same handle value
+    if (m_BoundPipeline == kernel.pipeline)
+    {
+        m_BoundPipeline = VK_NULL_HANDLE;
+    }
+    if (m_BoundLayout == kernel.layout)
+    {
+        m_BoundLayout = VK_NULL_HANDLE;
+        m_BoundSet = VK_NULL_HANDLE;
+    }
+
+    m_Dispatch.vkDestroyPipeline(m_Device, kernel.pipeline, nullptr);
+    m_Dispatch.vkDestroyPipelineLayout(m_Device, kernel.layout, nullptr);
+    kernel = Kernel{};
+    m_FreeKernels.push_back(handle);
+}
+
+VkDescriptorSet ComputeContext::GetDescriptorSet(VkDescriptorSetLayout setLayout, const Handle* buffers, uint32_t count)
+{
+    std::vector<Handle> key(buffers, buffers + count);
+    auto it = m_DescriptorSets.find(key);
+    if (it != m_DescriptorSets.end())
+    {
+        return it->second;
+    }
+
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet>& recycled = m_FreeDescriptorSets[count];
+    if (!recycled.empty())
+    {
+        set = recycled.back();
+        recycled.pop_back();
+    }
+    else
+    {
+        if (m_PoolSetsLeft == 0 || m_PoolDescriptorsLeft < count)
+        {
+            VkDescriptorPoolSize poolSize{};
+            poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            poolSize.descriptorCount = std::max(DESCRIPTORS_PER_POOL, count);
+
+            VkDescriptorPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            poolInfo.maxSets = SETS_PER_POOL;
+            poolInfo.poolSizeCount = 1;
+            poolInfo.pPoolSizes = &poolSize;
+
+            VkDescriptorPool pool;
+            if (m_Dispatch.vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create compute descriptor pool!");
+            }
+            m_DescriptorPools.push_back(pool);
+            m_PoolSetsLeft = SETS_PER_POOL;
+            m_PoolDescriptorsLeft = poolSize.descriptorCount;
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_DescriptorPools.back();
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        if (m_Dispatch.vkAllocateDescriptorSets(m_Device, &allocInfo, &set) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate compute descriptor set!");
+        }
+        m_PoolSetsLeft--;
+        m_PoolDescriptorsLeft -= count;
+        m_Stats.descriptorSets++;
+    }
+
+    std::vector<VkDescriptorBufferInfo> bufferInfos(count);
+    std::vector<VkWriteDescriptorSet> writes(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        bufferInfos[i].buffer = m_Buffers[buffers[i]].buffer;
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    m_Dispatch.vkUpdateDescriptorSets(m_Device, count, writes.data(), 0, nullptr);
+
+    m_DescriptorSets.emplace(std::move(key), set);
+    return set;
+}
+
+ComputeContext::Completion ComputeContext::Submit(const Batch& batch)
+{
+    // Checked up front so a bad batch leaves nothing half recorded
+    for (const Batch::Command& command : batch.m_Commands)
+    {
+        for (uint32_t i = 0; i < command.bufferCount; i++)
+        {
+            GetBuffer(batch.m_Buffers[command.firstBuffer + i]);
+        }
+        if (command.type == Batch::Type::Dispatch)
+        {
+            const Kernel& kernel = GetKernel(command.kernel);
+            if (command.bufferCount != kernel.bindings.size() || command.pushSize != kernel.pushConstantSize)
+            {
+                throw std::runtime_error("Compute dispatch does not match the kernel's bindings or push constants!");
+            }
+        }
+    }
+
+    Submission& submission = GetRecordingSubmission();
+    for (const Batch::Command& command : batch.m_Commands)
+    {
+        RecordCommand(submission.commandBuffer, batch, command);
+    }
+
+    const Completion completion = m_NextCompletion++;
+    submission.completion = completion;
+    submission.batches++;
+    for (const Batch::Command& command : batch.m_Commands)
+    {
+        for (uint32_t i = 0; i < command.bufferCount; i++)
+        {
+            m_Buffers[batch.m_Buffers[command.firstBuffer + i]].lastUse = completion;
+        }
+        if (command.type == Batch::Type::Dispatch)
+        {
+            m_Kernels[command.kernel].lastUse = completion;
+        }
+    }
+    m_Stats.batches++;
+
+    // Coalesce while the GPU is busy, an idle GPU gets the work right away
+    RetireCompletedSubmissions(false);
+    if (m_InFlight.empty() || submission.batches >= MAX_BATCHES_PER_SUBMIT)
+    {
+        Flush();
+    }
+    return completion;
+}
+
+void ComputeContext::RecordCommand(VkCommandBuffer commandBuffer, const Batch& batch, const Batch::Command& command)
+{
+    const Handle* buffers = batch.m_Buffers.data() + command.firstBuffer;
+
+    switch (command.type)
+    {
+    case Batch::Type::Dispatch:
+    {
+        Kernel& kernel = m_Kernels[command.kernel];
+
+        std::vector<BufferAccess> accesses(command.bufferCount);
+        for (uint32_t i = 0; i < command.bufferCount; i++)
+        {
+            const Access access = kernel.bindings[i];
+            accesses[i].buffer = &m_Buffers[buffers[i]];
+            accesses[i].stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            accesses[i].readAccess = access != Access::Write ? VK_ACCESS_SHADER_READ_BIT : 0;
+            accesses[i].writeAccess = access != Access::Read ? VK_ACCESS_SHADER_WRITE_BIT : 0;
+        }
+        RecordBarrier(commandBuffer, accesses.data(), accesses.size());
+
+        if (m_BoundPipeline != kernel.pipeline)
+        {
+            m_Dispatch.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.pipeline);
+            m_BoundPipeline = kernel.pipeline;
+        }
+
+        // Pipeline layouts of kernels with the same bindings still differ in their push constants
+        VkDescriptorSet set = GetDescriptorSet(kernel.setLayout, buffers, command.bufferCount);
+        if (m_BoundSet != set || m_BoundLayout != kernel.layout)
+        {
+            m_Dispatch.vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel.layout, 0, 1, &set, 0, nullptr);
+            m_BoundSet = set;
+            m_BoundLayout = kernel.layout;
+        }
+
+        if (command.pushSize > 0)
+        {
+            m_Dispatch.vkCmdPushConstants(commandBuffer, kernel.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, command.pushSize,
+                batch.m_PushConstants.data() + command.pushOffset);
+        }
+
+        m_Dispatch.vkCmdDispatch(commandBuffer, command.groups[0], command.groups[1], command.groups[2]);
+        m_Stats.dispatches++;
+        break;
+    }
+    case Batch::Type::Copy:
+    {
+        Buffer& source = m_Buffers[buffers[0]];
+        Buffer& destination = m_Buffers[buffers[1]];
+
+        BufferAccess accesses[2];
+        accesses[0].buffer = &source;
+        accesses[0].stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        accesses[0].readAccess = VK_ACCESS_TRANSFER_READ_BIT;
+        accesses[1].buffer = &destination;
+        accesses[1].stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        accesses[1].writeAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+        RecordBarrier(commandBuffer, accesses, 2);
+
+        VkBufferCopy region{};
+        region.srcOffset = command.sourceOffset;
+        region.dstOffset = command.destinationOffset;
+        region.size = command.size;
+        m_Dispatch.vkCmdCopyBuffer(commandBuffer, source.buffer, destination.buffer, 1, &region);
+        m_Stats.copies++;
+        break;
+    }
+    case Batch::Type::Fill:
+    {
+        Buffer& destination = m_Buffers[buffers[0]];
+
+        BufferAccess access;
+        access.buffer = &destination;
+        access.stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        access.writeAccess = VK_ACCESS_TRANSFER_WRITE_BIT;
+        RecordBarrier(commandBuffer, &access, 1);
+
+        m_Dispatch.vkCmdFillBuffer(commandBuffer, destination.buffer, 0, VK_WHOLE_SIZE, command.value);
+        m_Stats.copies++;
+        break;
+    }
+    }
+}
+
+// Read after write needs the write made visible to the reading stage, write after write the
+// same for the writing stage, and write after read an execution dependency on the reads. All
+// of it goes into one global memory barrier, which is cheaper than one per buffer.
+void ComputeContext::RecordBarrier(VkCommandBuffer commandBuffer, const BufferAccess* accesses, size_t count)
+{
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    VkAccessFlags srcAccess = 0;
+    VkAccessFlags dstAccess = 0;
+
+    // Against the state before the command, a buffer bound twice does not wait for itself
+    for (size_t i = 0; i < count; i++)
+    {
+        const BufferAccess& access = accesses[i];
+        const BufferState& state = access.buffer->state;
+
+        if (state.writeStages != 0 && (state.visibleStages & access.stage) == 0)
+        {
+            srcStages |= state.writeStages;
+            srcAccess |= state.writeAccess;
+            dstStages |= access.stage;
+            dstAccess |= access.readAccess | access.writeAccess;
+        }
+        if (access.writeAccess != 0 && state.readStages != 0)
+        {
+            srcStages |= state.readStages;
+            dstStages |= access.stage;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const BufferAccess& access = accesses[i];
+        BufferState& state = access.buffer->state;
+
+        if (access.writeAccess != 0)
+        {
+            state.writeStages = access.stage;
+            state.writeAccess = access.writeAccess;
+            state.visibleStages = 0;
+            state.readStages = 0;
+        }
+        else
+        {
+            state.visibleStages |= access.stage;
+            state.readStages |= access.stage;
+        }
+    }
+
+    if (dstStages == 0)
+    {
+        return;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+
+    m_Dispatch.vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, srcAccess != 0 ? 1 : 0, &barrier,
+        0, nullptr, 0, nullptr);
+    m_Stats.barriers++;
+}
+
+ComputeContext::Submission& ComputeContext::GetRecordingSubmission()
+{
+    if (m_Recording != NO_SUBMISSION)
+    {
+        return m_Submissions[m_Recording];
+    }
+
+    RetireCompletedSubmissions(false);
+
+    for (size_t i = 0; i < m_Submissions.size() && m_Recording == NO_SUBMISSION; i++)
+    {
+        if (!m_Submissions[i].inFlight)
+        {
+            m_Recording = i;
+        }
+    }
+
+    if (m_Recording == NO_SUBMISSION)
+    {
+        Submission submission;
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_CommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (m_Dispatch.vkAllocateCommandBuffers(m_Device, &allocInfo, &submission.commandBuffer) != VK_SUCCESS ||
+            m_Dispatch.vkCreateFence(m_Device, &fenceInfo, nullptr, &submission.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute submission!");
+        }
+
+        m_Submissions.push_back(submission);
+        m_Recording = m_Submissions.size() - 1;
+    }
+
+    Submission& submission = m_Submissions[m_Recording];
+    submission.batches = 0;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (m_Dispatch.vkBeginCommandBuffer(submission.commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to begin recording compute command buffer!");
+    }
+
+    m_BoundPipeline = VK_NULL_HANDLE;
+    m_BoundLayout = VK_NULL_HANDLE;
+    m_BoundSet = VK_NULL_HANDLE;
+    return submission;
+}
+
+void ComputeContext::Flush()
+{
+    if (m_Recording == NO_SUBMISSION)
+    {
+        return;
+    }
+
+    const size_t submissionIndex = m_Recording;
+    Submission& submission = m_Submissions[submissionIndex];
+
+    // The fence does not make device writes visible to the host, this barrier does
+    VkPipelineStageFlags srcStages = 0;
+    VkAccessFlags srcAccess = 0;
+    for (Buffer& buffer : m_Buffers)
+    {
+        if (buffer.buffer != VK_NULL_HANDLE && buffer.memory != Memory::Device && buffer.state.writeStages != 0
+            && (buffer.state.visibleStages & VK_PIPELINE_STAGE_HOST_BIT) == 0)
+        {
+            srcStages |= buffer.state.writeStages;
+            srcAccess |= buffer.state.writeAccess;
+            buffer.state.visibleStages |= VK_PIPELINE_STAGE_HOST_BIT;
+        }
+    }
+    if (srcStages != 0)
+    {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        m_Dispatch.vkCmdPipelineBarrier(submission.commandBuffer, srcStages, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier,
+            0, nullptr, 0, nullptr);
+        m_Stats.barriers++;
+    }
+
+    if (m_Dispatch.vkEndCommandBuffer(submission.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to record compute command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &submission.commandBuffer;
+
+    m_Dispatch.vkResetFences(m_Device, 1, &submission.fence);
+    if (m_Dispatch.vkQueueSubmit(m_Queue, 1, &submitInfo, submission.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to submit compute command buffer!");
+    }
+
+    submission.inFlight = true;
+    m_InFlight.push_back(submissionIndex);
+    m_Submitted = submission.completion;
+    m_Recording = NO_SUBMISSION;
+    m_Stats.submits++;
+}
+
+void ComputeContext::RetireCompletedSubmissions(bool waitForOldest)
+{
+    while (!m_InFlight.empty())
+    {
+        Submission& submission = m_Submissions[m_InFlight.front()];
+
+        if (waitForOldest)
+        {
+            m_Dispatch.vkWaitForFences(m_Device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+            waitForOldest = false;
+        }
+        else if (m_Dispatch.vkGetFenceStatus(m_Device, submission.fence) != VK_SUCCESS)
+        {
+            break;
+        }
+
+        m_Completed = submission.completion;
+        submission.inFlight = false;
+        m_InFlight.pop_front();
+    }
+}
+
+bool ComputeContext::IsComplete(Completion completion)
+{
+    if (completion <= m_Completed)
+    {
+        return true;
+    }
+
+    // Still being coalesced, it would never finish otherwise
+    if (completion > m_Submitted)
+    {
+        Flush();
+    }
+    RetireCompletedSubmissions(false);
+    return completion <= m_Completed;
+}
+
+void ComputeContext::Wait(Completion completion)
+{
+    if (completion <= m_Completed)
+    {
+        return;
+    }
+
+    m_Stats.waits++;
+    if (completion > m_Submitted)
+    {
+        Flush();
+    }
+    while (completion > m_Completed && !m_InFlight.empty())
+    {
+        RetireCompletedSubmissions(true);
+    }
+}
+
+void ComputeContext::WaitIdle()
+{
+    Flush();
+    while (!m_InFlight.empty())
+    {
+        RetireCompletedSubmissions(true);
+    }
+}
+
+void ComputeContext::PrintStats() const
+{
+    if (m_Stats.batches == 0)
+    {
+        return;
+    }
+
+    std::cout << "Compute: " << m_Stats.batches << " batches in " << m_Stats.submits << " submits ("
+        << static_cast<double>(m_Stats.batches) / std::max<uint64_t>(m_Stats.submits, 1) << " per submit), "
+        << m_Stats.dispatches << " dispatches, " << m_Stats.copies << " copies, " << m_Stats.barriers << " barriers, "
+        << m_Stats.descriptorSets << " descriptor sets, " << m_Stats.waits << " waits\n";
+}
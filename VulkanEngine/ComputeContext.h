@@ -0,0 +1,263 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "GpuAllocator.h"
+#include "PipelineCache.h"
+#include "VulkanDispatch.h"
+#include "VulkanFwd.h"
+
+// Headless GPGPU entry point: a device with a compute queue and no surface, storage buffers,
+// SPIR-V kernels and batches of dispatches.
+//
+// A kernel declares how it accesses each of its storage buffers (set 0, bindings 0 to n-1).
+// Batches only name the buffers, and the context places the barriers: a dispatch or copy that
+// reads what an earlier one wrote, or overwrites what it read, gets one global memory barrier
+// in front of it, independent work gets none. State is tracked across batches in submission
+// order, and written host visible buffers are made visible to the host before their batch
+// completes.
+//
+// Batches are recorded as they are submitted but handed to the queue together: a batch goes
+// out right away when the GPU has nothing else to do, otherwise it joins the open command
+// buffer until the GPU catches up, a completion is polled or waited on, or the command buffer
+// holds MAX_BATCHES_PER_SUBMIT batches. Work only reaches the GPU for certain after Flush,
+// IsComplete or Wait.
+//
+// Not thread safe.
+class ComputeContext
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = ~0u;
+
+    // Submission order of a batch, completed once the GPU finished it and everything before it
+    using Completion = uint64_t;
+
+    static constexpr uint32_t MAX_BATCHES_PER_SUBMIT = 256;
+
+    enum class Memory
+    {
+        Device,     // device local, not mappable
+        Upload,     // host visible, written by the CPU
+        Readback,   // host visible and cached if possible, read by the CPU
+    };
+
+    enum class Access
+    {
+        Read,
+        Write,
+        ReadWrite,
+    };
+
+    struct SpecializationConstant
+    {
+        uint32_t    id      = 0;
+        uint32_t    value   = 0;    // 32-bit int, uint, float bits or VkBool32
+    };
+
+    struct KernelDesc
+    {
+        // SPIR-V of a compute shader, from path or from code when code is set
+        std::string             path;
+        const uint32_t*         code            = nullptr;
+        size_t                  codeSize        = 0;            // in bytes
+        const char*             entryPoint      = "main";
+
+        std::vector<Access>     bindings;                       // storage buffers of set 0, in binding order
+        uint32_t                pushConstantSize = 0;
+        std::vector<SpecializationConstant> constants;
+    };
+
+    // Recorded on any thread, submitted with ComputeContext::Submit
+    class Batch
+    {
+    public:
+        // buffers go to the kernel's bindings in order. pushConstantSize has to match the kernel's.
+        void Dispatch(Handle kernel, std::initializer_list<Handle> buffers, uint32_t groupsX, uint32_t groupsY = 1, uint32_t groupsZ = 1,
+            const void* pushConstants = nullptr, uint32_t pushConstantSize = 0);
+        void Copy(Handle source, uint64_t sourceOffset, Handle destination, uint64_t destinationOffset, uint64_t size);
+        // Sets every 32-bit word of the buffer
+        void Fill(Handle buffer, uint32_t value);
+
+        bool IsEmpty() const { return m_Commands.empty(); }
+        void Clear();
+
+    private:
+        friend class ComputeContext;
+
+        enum class Type { Dispatch, Copy, Fill };
+
+        struct Command
+        {
+            Type        type            = Type::Dispatch;
+            Handle      kernel          = INVALID_HANDLE;
+            uint32_t    firstBuffer     = 0;        // into m_Buffers
+            uint32_t    bufferCount     = 0;
+            uint32_t    groups[3]       = {};
+            uint32_t    pushOffset      = 0;        // into m_PushConstants
+            uint32_t    pushSize        = 0;
+            uint64_t    sourceOffset    = 0;
+            uint64_t    destinationOffset = 0;
+            uint64_t    size            = 0;
+            uint32_t    value           = 0;
+        };
+
+        std::vector<Command>    m_Commands;
+        std::vector<Handle>     m_Buffers;
+        std::vector<uint8_t>    m_PushConstants;
+    };
+
+    struct Stats
+    {
+        uint64_t    batches             = 0;
+        uint64_t    submits             = 0;
+        uint64_t    dispatches          = 0;
+        uint64_t    copies              = 0;    // copies and fills
+        uint64_t    barriers            = 0;
+        uint64_t    descriptorSets      = 0;    // allocated, reused for the same buffers
+        uint64_t    waits               = 0;    // completions waited on that were not done yet
+    };
+
+    // Creates its own instance and device. deviceOverride works like --device. An empty
+    // pipelineCachePath compiles the kernels without a pipeline cache.
+    void Create(const std::string& deviceOverride, const std::string& pipelineCachePath);
+    void Destroy();
+
+    // Buffers can be used for storage, copies and fills. size has to be a multiple of 4.
+    Handle CreateBuffer(uint64_t size, Memory memory);
+    // Waits for the submitted work that uses the buffer
+    void DestroyBuffer(Handle buffer);
+    // Null for Memory::Device
+    void* GetMapped(Handle buffer) const;
+    uint64_t GetSize(Handle buffer) const;
+
+    // Throws if the SPIR-V cannot be read or the pipeline cannot be created
+    Handle CreateKernel(const KernelDesc& desc);
+    // Waits for the submitted work that uses the kernel
+    void DestroyKernel(Handle kernel);
+
+    Completion Submit(const Batch& batch);
+    // Hands every batch recorded so far to the queue. Cheap when nothing is open.
+    void Flush();
+
+    // Submits the open command buffer when the batch is still in it
+    bool IsComplete(Completion completion);
+    void Wait(Completion completion);
+    void WaitIdle();
+
+    const std::string& GetDeviceName() const { return m_DeviceName; }
+    uint32_t GetMaxGroupCount() const { return m_MaxGroupCount; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // Stages and accesses of a buffer since its last write
+    struct BufferState
+    {
+        uint32_t    writeStages     = 0;    // VkPipelineStageFlags of the last write, 0 if never written
+        uint32_t    writeAccess     = 0;    // VkAccessFlags
+        uint32_t    visibleStages   = 0;    // stages the last write was made visible to
+        uint32_t    readStages      = 0;    // reads since the last write
+    };
+
+    struct Buffer
+    {
+        VkBuffer                    buffer      = nullptr;
+        GpuAllocator::Allocation*   allocation  = nullptr;
+        uint64_t                    size        = 0;
+        Memory                      memory      = Memory::Device;
+        Completion                  lastUse     = 0;
+        BufferState                 state;
+    };
+
+    struct Kernel
+    {
+        VkPipeline                  pipeline    = nullptr;
+        VkPipelineLayout            layout      = nullptr;
+        VkDescriptorSetLayout       setLayout   = nullptr;     // shared by kernels with as many bindings
+        std::vector<Access>         bindings;
+        uint32_t                    pushConstantSize = 0;
+        Completion                  lastUse     = 0;
+    };
+
+    // One command buffer and the completion of its last batch
+    struct Submission
+    {
+        VkCommandBuffer             commandBuffer   = nullptr;
+        VkFence                     fence           = nullptr;
+        Completion                  completion      = 0;
+        uint32_t                    batches         = 0;
+        bool                        inFlight        = false;
+    };
+
+    // One buffer a command reads or writes
+    struct BufferAccess
+    {
+        Buffer*     buffer      = nullptr;
+        uint32_t    stage       = 0;    // VkPipelineStageFlags
+        uint32_t    readAccess  = 0;    // VkAccessFlags, 0 when not read
+        uint32_t    writeAccess = 0;    // VkAccessFlags, 0 when not written
+    };
+
+    static constexpr size_t NO_SUBMISSION = ~size_t(0);
+
+    Submission& GetRecordingSubmission();
+    void RetireCompletedSubmissions(bool waitForOldest);
+    void RecordCommand(VkCommandBuffer commandBuffer, const Batch& batch, const Batch::Command& command);
+    // Records the barrier the accesses of one command need against earlier commands, if any,
+    // and updates the buffer states
+    void RecordBarrier(VkCommandBuffer commandBuffer, const BufferAccess* accesses, size_t count);
+    VkDescriptorSetLayout GetSetLayout(uint32_t bindingCount);
+    VkDescriptorSet GetDescriptorSet(VkDescriptorSetLayout setLayout, const Handle* buffers, uint32_t count);
+    VkShaderModule CreateShaderModule(const KernelDesc& desc) const;
+    Buffer& GetBuffer(Handle buffer);
+    Kernel& GetKernel(Handle kernel);
+
+    VkInstance          m_Instance          = nullptr;
+    VkPhysicalDevice    m_PhysicalDevice    = nullptr;
+    VkDevice            m_Device            = nullptr;
+    VulkanDeviceDispatch m_Dispatch;
+    VkQueue             m_Queue             = nullptr;
+    uint32_t            m_QueueFamily       = 0;
+    std::string         m_DeviceName;
+    uint32_t            m_MaxGroupCount     = 65535;
+
+    GpuAllocator        m_Allocator;
+    PipelineCache       m_PipelineCache;
+    bool                m_UsePipelineCache  = false;
+    VkCommandPool       m_CommandPool       = nullptr;
+
+    std::vector<Buffer>     m_Buffers;
+    std::vector<Handle>     m_FreeBuffers;
+    std::vector<Kernel>     m_Kernels;
+    std::vector<Handle>     m_FreeKernels;
+
+    // Storage buffer descriptors. Layouts are by binding count, sets by the buffers they hold;
+    // sets of a destroyed buffer are rewritten for other buffers.
+    std::map<uint32_t, VkDescriptorSetLayout>           m_SetLayouts;
+    std::map<std::vector<Handle>, VkDescriptorSet>      m_DescriptorSets;
+    std::map<uint32_t, std::vector<VkDescriptorSet>>    m_FreeDescriptorSets;
+    std::vector<VkDescriptorPool>                       m_DescriptorPools;
+    uint32_t                                            m_PoolSetsLeft = 0;
+    uint32_t                                            m_PoolDescriptorsLeft = 0;
+
+    std::vector<Submission> m_Submissions;
+    size_t                  m_Recording     = NO_SUBMISSION;
+    std::deque<size_t>      m_InFlight;     // indices into m_Submissions in submission order
+    Completion              m_NextCompletion = 1;
+    Completion              m_Submitted     = 0;    // last completion handed to the queue
+    Completion              m_Completed     = 0;
+
+    // Bound in the recording command buffer
+    VkPipeline              m_BoundPipeline = nullptr;
+    VkPipelineLayout        m_BoundLayout   = nullptr;  // of m_BoundSet
+    VkDescriptorSet         m_BoundSet      = nullptr;
+
+    Stats                   m_Stats;
+};
@@ -0,0 +1,292 @@
+#include "DebugMessageQueue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// How often the printing thread looks at the ring. Producers never wake it, that would
+// cost a system call inside the driver call.
+constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(10);
+
+// Repeats of a message id are summarized at most this often
+constexpr auto REPEAT_REPORT_INTERVAL = std::chrono::seconds(1);
+
+constexpr uint32_t DEFAULT_SEVERITY_MASK = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+constexpr uint32_t DEFAULT_TYPE_MASK = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+    VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+
+static_assert((DebugMessageQueue::RING_CAPACITY & (DebugMessageQueue::RING_CAPACITY - 1)) == 0, "Ring capacity must be a power of two");
+
+static void CopyTruncated(char* destination, size_t capacity, const char* source)
+{
+    if (source == nullptr)
+    {
+        destination[0] = '\0';
+        return;
+    }
+    size_t length = strnlen(source, capacity - 1);
+    std::memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+static const char* SeverityName(uint32_t severity)
+{
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+    {
+        return "ERROR";
+    }
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+    {
+        return "WARNING";
+    }
+    return "INFO";
+}
+
+DebugMessageQueue::DebugMessageQueue()
+    : m_Slots(new Slot[RING_CAPACITY])
+    , m_SeverityMask(DEFAULT_SEVERITY_MASK)
+    , m_TypeMask(DEFAULT_TYPE_MASK)
+{
+    // A slot is free for the producer whose position matches its sequence
+    for (uint32_t i = 0; i < RING_CAPACITY; i++)
+    {
+        m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+DebugMessageQueue::~DebugMessageQueue()
+{
+    Stop();
+}
+
+void DebugMessageQueue::Start()
+{
+    m_Stop = false;
+    m_Thread = std::thread(&DebugMessageQueue::DrainMain, this);
+}
+
+void DebugMessageQueue::Stop()
+{
+    if (!m_Thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_StopMutex);
+        m_Stop = true;
+    }
+    m_StopCondition.notify_one();
+    m_Thread.join();
+}
+
+void DebugMessageQueue::SetSeverityMask(uint32_t mask)
+{
+    m_SeverityMask.store(mask & ~static_cast<uint32_t>(VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT), std::memory_order_relaxed);
+}
+
+void DebugMessageQueue::SetTypeMask(uint32_t mask)
+{
+    m_TypeMask.store(mask, std::memory_order_relaxed);
+}
+
+void DebugMessageQueue::Push(uint32_t severity, uint32_t type, int32_t messageIdNumber, const char* messageIdName, const char* message)
+{
+    m_Received.fetch_add(1, std::memory_order_relaxed);
+
+    // Counted before filtering, the metric should not depend on what is printed
+    if ((type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) && severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+    {
+        m_PerformanceWarnings.fetch_add(1, std::memory_order_relaxed);
+        m_FramePerformanceWarnings.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!(severity & m_SeverityMask.load(std::memory_order_relaxed)) || !(type & m_TypeMask.load(std::memory_order_relaxed)))
+    {
+        m_Filtered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Claim a slot (bounded MPMC queue after Vyukov, used with a single consumer)
+    uint64_t position = m_Head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;)
+    {
+        slot = &m_Slots[position & (RING_CAPACITY - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+        if (difference == 0)
+        {
+            if (m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The printing thread is a whole ring behind, better to lose a message than to stall the driver
+            m_Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = m_Head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->severity = severity;
+    slot->type = type;
+    slot->messageIdNumber = messageIdNumber;
+    CopyTruncated(slot->messageIdName, MAX_ID_NAME_LENGTH, messageIdName);
+    CopyTruncated(slot->message, MAX_MESSAGE_LENGTH, message);
+
+    // Hands the slot to the printing thread
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void DebugMessageQueue::EndFrame()
+{
+    uint32_t count = m_FramePerformanceWarnings.exchange(0, std::memory_order_relaxed);
+    m_LastFramePerformanceWarnings.store(count, std::memory_order_relaxed);
+    if (count > 0)
+    {
+        m_FramesWithPerformanceWarnings++;
+        m_MaxFramePerformanceWarnings = std::max(m_MaxFramePerformanceWarnings, count);
+    }
+}
+
+bool DebugMessageQueue::DrainRing()
+{
+    bool printed = false;
+    for (;;)
+    {
+        Slot& slot = m_Slots[m_Tail & (RING_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_Tail + 1)
+        {
+            // Empty, or the producer that claimed it is still copying
+            break;
+        }
+
+        Print(slot);
+        printed = true;
+
+        // Frees the slot for the producer one lap ahead
+        slot.sequence.store(m_Tail + RING_CAPACITY, std::memory_order_release);
+        m_Tail++;
+    }
+    return printed;
+}
+
+void DebugMessageQueue::Print(const Slot& slot)
+{
+    // Messages without an id number (e.g. from the loader) are told apart by name
+    uint64_t key = static_cast<uint32_t>(slot.messageIdNumber);
+    if (slot.messageIdNumber == 0)
+    {
+        key = std::hash<std::string>()(slot.messageIdName) | (1ull << 63);
+    }
+
+    Repeats& repeats = m_Repeats[key];
+    repeats.count++;
+    if (repeats.count > REPEATS_SHOWN)
+    {
+        repeats.unreported++;
+        m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+        if (repeats.messageIdName[0] == '\0')
+        {
+            CopyTruncated(repeats.messageIdName, MAX_ID_NAME_LENGTH, slot.messageIdName);
+        }
+        return;
+    }
+
+    std::cerr << "Validation layer [" << SeverityName(slot.severity) << "] " << slot.message << '\n';
+    if (repeats.count == REPEATS_SHOWN)
+    {
+        std::cerr << "  (further " << (slot.messageIdName[0] != '\0' ? slot.messageIdName : "repeats of this message")
+            << " messages are summarized)\n";
+    }
+    m_Printed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DebugMessageQueue::ReportRepeats()
+{
+    bool reported = false;
+    for (auto& entry : m_Repeats)
+    {
+        Repeats& repeats = entry.second;
+        if (repeats.unreported > 0)
+        {
+            std::cerr << "Validation layer: " << repeats.unreported << " more " << repeats.messageIdName
+                << " messages (" << repeats.count << " in total)\n";
+            repeats.unreported = 0;
+            reported = true;
+        }
+    }
+    if (reported)
+    {
+        std::cerr.flush();
+    }
+}
+
+void DebugMessageQueue::DrainMain()
+{
+    auto lastReport = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_StopMutex);
+    for (;;)
+    {
+        bool stop = m_StopCondition.wait_for(lock, DRAIN_INTERVAL, [this]() { return m_Stop; });
+
+        if (DrainRing())
+        {
+            std::cerr.flush();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (stop || now - lastReport >= REPEAT_REPORT_INTERVAL)
+        {
+            ReportRepeats();
+            lastReport = now;
+        }
+
+        if (stop)
+        {
+            return;
+        }
+    }
+}
+
+DebugMessageQueue::Stats DebugMessageQueue::GetStats() const
+{
+    Stats stats;
+    stats.received = m_Received.load(std::memory_order_relaxed);
+    stats.filtered = m_Filtered.load(std::memory_order_relaxed);
+    stats.dropped = m_Dropped.load(std::memory_order_relaxed);
+    stats.printed = m_Printed.load(std::memory_order_relaxed);
+    stats.suppressed = m_Suppressed.load(std::memory_order_relaxed);
+    stats.performanceWarnings = m_PerformanceWarnings.load(std::memory_order_relaxed);
+    stats.framesWithPerformanceWarnings = m_FramesWithPerformanceWarnings;
+    stats.maxFramePerformanceWarnings = m_MaxFramePerformanceWarnings;
+    return stats;
+}
+
+void DebugMessageQueue::PrintStats(std::ostream& out) const
+{
+    Stats stats = GetStats();
+    if (stats.received == 0)
+    {
+        return;
+    }
+
+    out << "Debug messages: " << stats.received << " received, " << stats.printed << " printed, " << stats.suppressed
+        << " repeats suppressed, " << stats.filtered << " filtered, " << stats.dropped << " dropped\n";
+    if (stats.performanceWarnings > 0)
+    {
+        out << "Performance warnings: " << stats.performanceWarnings << " total, in " << stats.framesWithPerformanceWarnings
+            << " frames, at most " << stats.maxFramePerformanceWarnings << " in one frame\n";
+    }
+}
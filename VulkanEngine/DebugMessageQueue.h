@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Takes debug messenger output off the thread that made the Vulkan call.
+//
+// The messenger callback only copies the message into a bounded lock-free ring (multiple
+// producers, one consumer) and returns; a background thread drains the ring and prints.
+// The printing thread collapses repeats: each message id is shown a few times, after that
+// occurrences are only counted and reported as a summary line once per second.
+//
+// Severity and type filters can be changed at any time. VERBOSE is never accepted.
+class DebugMessageQueue
+{
+public:
+    static constexpr uint32_t RING_CAPACITY = 1024;         // power of two
+    static constexpr size_t MAX_MESSAGE_LENGTH = 1024;      // longer messages are truncated
+    static constexpr size_t MAX_ID_NAME_LENGTH = 96;
+    static constexpr uint32_t REPEATS_SHOWN = 3;            // per message id before it is summarized
+
+    struct Stats
+    {
+        uint64_t    received            = 0;
+        uint64_t    filtered            = 0;    // rejected by the severity or type filter
+        uint64_t    dropped             = 0;    // the ring was full
+        uint64_t    printed             = 0;
+        uint64_t    suppressed          = 0;    // repeats that were only counted
+        uint64_t    performanceWarnings = 0;
+        uint64_t    framesWithPerformanceWarnings = 0;
+        uint32_t    maxFramePerformanceWarnings = 0;
+    };
+
+    DebugMessageQueue();
+    ~DebugMessageQueue();
+
+    DebugMessageQueue(const DebugMessageQueue&) = delete;
+    DebugMessageQueue& operator=(const DebugMessageQueue&) = delete;
+
+    void Start();
+    // Prints whatever is still queued and the pending repeat counts
+    void Stop();
+
+    // VkDebugUtilsMessageSeverityFlagsEXT and VkDebugUtilsMessageTypeFlagsEXT
+    void SetSeverityMask(uint32_t mask);
+    void SetTypeMask(uint32_t mask);
+    uint32_t GetSeverityMask() const { return m_SeverityMask.load(std::memory_order_relaxed); }
+    uint32_t GetTypeMask() const { return m_TypeMask.load(std::memory_order_relaxed); }
+
+    // Called from the messenger callback on any thread. Never blocks or allocates.
+    void Push(uint32_t severity, uint32_t type, int32_t messageIdNumber, const char* messageIdName, const char* message);
+
+    // Closes the per-frame count of performance warnings
+    void EndFrame();
+    uint32_t GetLastFramePerformanceWarnings() const { return m_LastFramePerformanceWarnings.load(std::memory_order_relaxed); }
+
+    Stats GetStats() const;
+    void PrintStats(std::ostream& out) const;
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t>   sequence{ 0 };
+        uint32_t                severity    = 0;
+        uint32_t                type        = 0;
+        int32_t                 messageIdNumber = 0;
+        char                    messageIdName[MAX_ID_NAME_LENGTH];
+        char                    message[MAX_MESSAGE_LENGTH];
+    };
+
+    // Repeat bookkeeping per message id, only touched by the printing thread
+    struct Repeats
+    {
+        uint64_t    count               = 0;
+        uint64_t    unreported          = 0;    // suppressed since the last summary line
+        char        messageIdName[MAX_ID_NAME_LENGTH] = {};
+    };
+
+    bool DrainRing();
+    void Print(const Slot& slot);
+    void ReportRepeats();
+    void DrainMain();
+
+    std::unique_ptr<Slot[]>     m_Slots;
+    alignas(64) std::atomic<uint64_t> m_Head{ 0 };      // next slot producers claim
+    alignas(64) uint64_t        m_Tail = 0;             // next slot the printing thread reads
+
+    std::atomic<uint32_t>       m_SeverityMask;
+    std::atomic<uint32_t>       m_TypeMask;
+
+    std::atomic<uint64_t>       m_Received{ 0 };
+    std::atomic<uint64_t>       m_Filtered{ 0 };
+    std::atomic<uint64_t>       m_Dropped{ 0 };
+    std::atomic<uint64_t>       m_Printed{ 0 };
+    std::atomic<uint64_t>       m_Suppressed{ 0 };
+    std::atomic<uint64_t>       m_PerformanceWarnings{ 0 };
+    std::atomic<uint32_t>       m_FramePerformanceWarnings{ 0 };
+    std::atomic<uint32_t>       m_LastFramePerformanceWarnings{ 0 };
+
+    // Only touched by the thread that calls EndFrame
+    uint64_t                    m_FramesWithPerformanceWarnings = 0;
+    uint32_t                    m_MaxFramePerformanceWarnings   = 0;
+
+    std::unordered_map<uint64_t, Repeats> m_Repeats;
+
+    std::thread                 m_Thread;
+    std::mutex                  m_StopMutex;
+    std::condition_variable     m_StopCondition;
+    bool                        m_Stop = false;
+};
@@ -0,0 +1,128 @@
+#include "DispatchBenchmark.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+constexpr uint32_t BENCHMARK_CALL_COUNT = 1u << 22;
+constexpr uint32_t BENCHMARK_REPEATS = 5;
+
+// Commands recorded between pool resets, so the command buffer does not grow without bound
+constexpr uint32_t BENCHMARK_COMMANDS_PER_RESET = 1u << 14;
+
+using BenchmarkClock = std::chrono::steady_clock;
+
+static double SecondsSince(BenchmarkClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+static void PrintResult(std::ostream& out, const char* name, double trampolineSeconds, double directSeconds)
+{
+    double trampolineNs = trampolineSeconds * 1e9 / BENCHMARK_CALL_COUNT;
+    double directNs = directSeconds * 1e9 / BENCHMARK_CALL_COUNT;
+    out << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(8) << trampolineNs << " ns/call loader, " << std::setw(8) << directNs << " ns/call direct, "
+        << std::setw(6) << (trampolineNs - directNs) << " ns saved\n";
+}
+
+// The query is called through a pointer either way, so the compiler cannot hoist it out of the loop
+template<typename GetDeviceQueue>
+static double TimeGetDeviceQueue(GetDeviceQueue getDeviceQueue, VkDevice device, uint32_t queueFamily)
+{
+    double best = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        VkQueue queue = VK_NULL_HANDLE;
+        auto start = BenchmarkClock::now();
+        for (uint32_t i = 0; i < BENCHMARK_CALL_COUNT; i++)
+        {
+            getDeviceQueue(device, queueFamily, 0, &queue);
+        }
+        best = std::min(best, SecondsSince(start));
+    }
+    return best;
+}
+
+// Only the vkCmdSetViewport calls are timed, not the resets between batches
+template<typename SetViewport>
+static double TimeSetViewport(SetViewport setViewport, VkDevice device, VkCommandPool pool, VkCommandBuffer commandBuffer)
+{
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkViewport viewport{ 0.0f, 0.0f, 64.0f, 64.0f, 0.0f, 1.0f };
+
+    double best = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        double seconds = 0.0;
+        for (uint32_t first = 0; first < BENCHMARK_CALL_COUNT; first += BENCHMARK_COMMANDS_PER_RESET)
+        {
+            vkResetCommandPool(device, pool, 0);
+            vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+            auto start = BenchmarkClock::now();
+            for (uint32_t i = 0; i < BENCHMARK_COMMANDS_PER_RESET; i++)
+            {
+                viewport.width = static_cast<float>(64 + (i & 63));
+                setViewport(commandBuffer, 0, 1, &viewport);
+            }
+            seconds += SecondsSince(start);
+
+            vkEndCommandBuffer(commandBuffer);
+        }
+        best = std::min(best, seconds);
+    }
+    return best;
+}
+
+void RunDispatchBenchmark(VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t queueFamily,
+    const VkAllocationCallbacks* allocator, std::ostream& out)
+{
+    out << "Dispatch benchmark, " << BENCHMARK_CALL_COUNT << " calls per run\n";
+
+    // Plain function pointers to the exported symbols, so both paths are indirect calls
+    PFN_vkGetDeviceQueue trampolineGetDeviceQueue = &vkGetDeviceQueue;
+    PFN_vkCmdSetViewport trampolineSetViewport = &vkCmdSetViewport;
+
+    PrintResult(out, "vkGetDeviceQueue",
+        TimeGetDeviceQueue(trampolineGetDeviceQueue, device, queueFamily),
+        TimeGetDeviceQueue(dispatch.vkGetDeviceQueue, device, queueFamily));
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    VkCommandPool pool = VK_NULL_HANDLE;
+    if (vkCreateCommandPool(device, &poolInfo, allocator, &pool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create benchmark command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    {
+        vkDestroyCommandPool(device, pool, allocator);
+        throw std::runtime_error("Failed to allocate benchmark command buffer!");
+    }
+
+    PrintResult(out, "vkCmdSetViewport",
+        TimeSetViewport(trampolineSetViewport, device, pool, commandBuffer),
+        TimeSetViewport(dispatch.vkCmdSetViewport, device, pool, commandBuffer));
+
+    vkDestroyCommandPool(device, pool, allocator);
+}
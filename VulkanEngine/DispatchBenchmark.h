@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <iosfwd>
+
+#include "VulkanFwd.h"
+
+struct VkAllocationCallbacks;
+struct VulkanDeviceDispatch;
+
+// Measures the per-call cost of the loader's exported trampolines against the device
+// dispatch table, on a cheap query (vkGetDeviceQueue) and a cheap command
+// (vkCmdSetViewport). dispatch has to be loaded for the device.
+void RunDispatchBenchmark(VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t queueFamily,
+    const VkAllocationCallbacks* allocator, std::ostream& out);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "ValidationLayers.h"
+
+// Frames rendered in headless mode when no explicit count is given
+constexpr uint32_t DEFAULT_HEADLESS_FRAME_COUNT = 1000;
+
+// How many frames the CPU may record ahead of the GPU
+constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 8;
+
+enum class PresentMode
+{
+    Fifo,       // vsync, always supported
+    Mailbox,    // newest frame replaces the queued one, no tearing
+    Immediate   // no waiting at all, may tear
+};
+
+// Lowest severity of debug messenger output that is printed
+enum class DebugSeverity
+{
+    Error,
+    Warning,
+    Info
+};
+
+// Debug messenger types, the same bits as VkDebugUtilsMessageTypeFlagBitsEXT
+constexpr uint32_t DEBUG_TYPE_GENERAL       = 0x1;
+constexpr uint32_t DEBUG_TYPE_VALIDATION    = 0x2;
+constexpr uint32_t DEBUG_TYPE_PERFORMANCE   = 0x4;
+
+struct EngineConfig
+{
+    // Render into offscreen images instead of a window surface.
+    // No GLFW call is made, so the engine runs on machines without a display
+    // (render farm nodes, CI jobs on a software driver like lavapipe).
+    bool        headless    = false;
+
+    // Headless only: wait for the background content loads before the first frame, so
+    // rendered and dumped frames do not depend on how fast they finished
+    bool        waitForContent = true;
+
+    uint32_t    width       = WIDTH;
+    uint32_t    height      = HEIGHT;
+
+    // Number of frames to render before exiting, 0 means until the window is closed
+    // (or DEFAULT_HEADLESS_FRAME_COUNT in headless mode)
+    uint32_t    frameCount  = 0;
+
+    // Falls back to FIFO when the surface does not support the requested mode
+    PresentMode presentMode     = PresentMode::Mailbox;
+    uint32_t    framesInFlight  = DEFAULT_FRAMES_IN_FLIGHT;
+
+    // Copy every rendered frame back to host memory (headless only)
+    bool        readback    = false;
+
+    // Write the last frame read back from the GPU as a binary PPM image
+    std::string dumpPath;
+
+    // Where the pipeline cache is kept between runs, empty disables it
+    std::string pipelineCachePath = "pipeline_cache.bin";
+
+    // Forces a physical device, matched against the device name or its UUID.
+    // Empty lets the engine pick the highest scoring device.
+    std::string deviceOverride;
+
+    // Chrome/Perfetto trace of the profiler zones written at exit, empty disables it
+    std::string tracePath;
+
+    // Route the driver's host allocations through HostAllocator instead of its own heap
+    bool        hostAllocator   = true;
+
+    // Build the bindless table on descriptor indexing when the device has it, instead of a set per frame in flight
+    bool        bindless        = true;
+
+    // Job system threads, including the main thread. 0 uses one per core.
+    uint32_t    workerThreads   = 0;
+
+    // Size of the synthetic draw list, every item clears one rectangle of the frame
+    uint32_t    drawItems       = 0;
+
+    // Objects of the GPU-driven scene, culled by a compute shader and drawn indirectly. 0 disables it.
+    uint32_t    sceneObjects    = 0;
+
+    // Draw the scene from 20-byte QuantizedVertex instead of 24-byte FloatVertex, the layout
+    // AssetCooker writes by default
+    bool        quantizedVertices = false;
+
+    // Initial bytes of the frame ring per frame in flight; it grows when a frame needs more
+    uint32_t    frameRingSize   = 64 * 1024;
+
+    // Cooked asset pack streamed in at startup, empty disables asset streaming
+    std::string assetPack;
+
+    // Bytes of streamed assets queued for upload per frame; one asset always goes through
+    uint32_t    assetUploadBudget = 8 * 1024 * 1024;
+
+    // Cap on the device memory of streamed textures, on top of the heap budget. 0 means the heap
+    // budget alone decides how many mips stay resident.
+    uint64_t    textureBudget   = 0;
+
+    // Where the compiled SPIR-V shaders are looked up
+    std::string shaderDirectory = "shaders";
+
+    // Per-scope GPU timings from timestamp queries, CSV or JSON by extension; empty disables them
+    std::string gpuProfilePath;
+
+    // Also collect pipeline statistics for top level GPU scopes
+    bool        gpuPipelineStatistics = false;
+
+    // Text dump of the compiled render graph (passes, barriers, submissions, memory), empty disables it
+    std::string renderGraphDumpPath;
+
+    // Vulkan call capture for CaptureReplay, empty disables it. Recording starts with the device,
+    // the frames before captureFirstFrame become the setup the replayer runs once.
+    std::string capturePath;
+    uint32_t    captureFirstFrame = 60;
+    uint32_t    captureLastFrame = 60;
+
+    // Filters for validation layer output. Performance warnings are counted per frame either way.
+    DebugSeverity debugSeverity = DebugSeverity::Warning;
+    uint32_t    debugTypes      = DEBUG_TYPE_GENERAL | DEBUG_TYPE_VALIDATION | DEBUG_TYPE_PERFORMANCE;
+
+    // Run the job system micro-benchmark instead of the engine
+    bool        jobBenchmark    = false;
+
+    // Compare loader trampolines with the device dispatch table instead of rendering
+    bool        dispatchBenchmark = false;
+
+    // Time the SoA transform hierarchy against a naive glm::mat4 hierarchy instead of rendering
+    bool        transformBenchmark = false;
+};
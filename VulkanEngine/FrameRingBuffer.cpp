@@ -0,0 +1,214 @@
+#include "FrameRingBuffer.h"
+#include "CommandCapture.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+// Regions never shrink below this, so a few tiny frames do not lead to a growth right after
+constexpr uint64_t MIN_FRAME_SIZE = 4 * 1024;
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint64_t NextPowerOfTwo(uint64_t value)
+    {
+        uint64_t power = 1;
+        while (power < value)
+        {
+            power <<= 1;
+        }
+        return power;
+    }
+}
+
+void FrameRingBuffer::Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator,
+    uint64_t uniformAlignment, uint64_t storageAlignment, uint32_t framesInFlight, uint64_t frameSize,
+    const VkAllocationCallbacks* callbacks)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = &allocator;
+    m_Callbacks = callbacks;
+    m_UniformAlignment = std::max<uint64_t>(uniformAlignment, 1);
+    m_StorageAlignment = std::max<uint64_t>(storageAlignment, 1);
+    m_FramesInFlight = std::max(framesInFlight, 1u);
+    m_Stats = Stats{};
+
+    CreateBuffer(std::max(frameSize, MIN_FRAME_SIZE));
+}
+
+void FrameRingBuffer::Destroy()
+{
+    // The device is idle, so retired buffers can go right away
+    for (RetiredBuffer& retired : m_Retired)
+    {
+        DestroyBuffer(retired.buffer, retired.allocation);
+    }
+    m_Retired.clear();
+
+    DestroyBuffer(m_Buffer, m_Allocation);
+    m_Buffer = nullptr;
+    m_Allocation = nullptr;
+    m_Mapped = nullptr;
+}
+
+// Regions are aligned for both uniform and storage offsets, so an allocation at the start of
+// any region is valid for either
+void FrameRingBuffer::CreateBuffer(uint64_t frameSize)
+{
+    const uint64_t regionAlignment = std::max(m_UniformAlignment, m_StorageAlignment);
+    m_FrameSize = AlignUp(frameSize, regionAlignment);
+
+    const uint64_t bufferSize = m_FrameSize * m_FramesInFlight;
+    if (bufferSize > UINT32_MAX)
+    {
+        throw std::runtime_error("Frame ring buffer does not fit 32-bit dynamic offsets!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = bufferSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &m_Buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create frame ring buffer!");
+    }
+
+    // Dynamic prefers host visible device local memory, so the GPU reads the data without
+    // going over the bus
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = GpuAllocator::Usage::Dynamic;
+    m_Allocation = m_Allocator->AllocateForBuffer(m_Buffer, allocInfo);
+    m_Mapped = static_cast<uint8_t*>(m_Allocation->mapped);
+    m_DeviceLocal = (m_Allocator->GetMemoryPropertyFlags(m_Allocation->memoryType) & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+}
+
+void FrameRingBuffer::DestroyBuffer(VkBuffer buffer, GpuAllocator::Allocation* allocation)
+{
+    if (buffer != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyBuffer(m_Device, buffer, m_Callbacks);
+    }
+    if (allocation != nullptr)
+    {
+        m_Allocator->Free(allocation);
+    }
+}
+
+void FrameRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+    // Account for the frame that just finished recording
+    uint64_t demand = 0;
+    if (m_InFrame)
+    {
+        demand = m_Head.load(std::memory_order_relaxed);
+        m_Stats.frames++;
+        m_Stats.bytes += std::min(demand, m_FrameSize);
+        m_Stats.allocations += m_Allocations.exchange(0, std::memory_order_relaxed);
+        m_Stats.failedAllocations += m_Failed.exchange(0, std::memory_order_relaxed);
+        m_Stats.highWaterMark = std::max(m_Stats.highWaterMark, demand);
+    }
+
+    // Every frame that could still read a retired buffer has been waited for
+    m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(), [this](const RetiredBuffer& retired)
+    {
+        if (retired.lastFrame + m_FramesInFlight > m_FrameNumber)
+        {
+            return false;
+        }
+        DestroyBuffer(retired.buffer, retired.allocation);
+        return true;
+    }), m_Retired.end());
+
+    // Frames before this one may still be in flight with the current buffer, so it is
+    // retired instead of destroyed. Growing to a power of two above the demand keeps the
+    // number of growths logarithmic.
+    if (demand > m_FrameSize)
+    {
+        RetiredBuffer retired;
+        retired.buffer = m_Buffer;
+        retired.allocation = m_Allocation;
+        retired.lastFrame = m_FrameNumber - 1;
+        m_Retired.push_back(retired);
+
+        CreateBuffer(NextPowerOfTwo(demand));
+        m_Stats.growths++;
+    }
+
+    m_RegionOffset = static_cast<uint64_t>(frameIndex % m_FramesInFlight) * m_FrameSize;
+    m_Head.store(0, std::memory_order_relaxed);
+    m_FrameNumber++;
+    m_InFrame = true;
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::Allocate(uint64_t size)
+{
+    return AllocateAligned(size, m_UniformAlignment);
+}
+
+FrameRingBuffer::Allocation FrameRingBuffer::AllocateStorage(uint64_t size)
+{
+    return AllocateAligned(size, m_StorageAlignment);
+}
+
+// Offsets are relative to the region, which starts aligned, so aligning them is enough
+FrameRingBuffer::Allocation FrameRingBuffer::AllocateAligned(uint64_t size, uint64_t alignment)
+{
+    uint64_t head = m_Head.load(std::memory_order_relaxed);
+    uint64_t offset = 0;
+    do
+    {
+        offset = AlignUp(head, alignment);
+    }
+    while (!m_Head.compare_exchange_weak(head, offset + size, std::memory_order_relaxed));
+
+    Allocation allocation;
+    if (offset + size > m_FrameSize)
+    {
+        m_Failed.fetch_add(1, std::memory_order_relaxed);
+        return allocation;
+    }
+
+    m_Allocations.fetch_add(1, std::memory_order_relaxed);
+    allocation.buffer = m_Buffer;
+    allocation.offset = static_cast<uint32_t>(m_RegionOffset + offset);
+    allocation.data = m_Mapped + m_RegionOffset + offset;
+
+    // The caller fills it in before the frame is submitted, which is when a capture reads it
+    CaptureHostWrite(allocation.data, static_cast<size_t>(size));
+    return allocation;
+}
+
+void FrameRingBuffer::PrintStats() const
+{
+    if (m_Stats.frames == 0)
+    {
+        return;
+    }
+
+    double frames = static_cast<double>(m_Stats.frames);
+    std::cout << "Frame ring buffer: " << m_FramesInFlight << " x " << m_FrameSize / 1024 << " KiB in "
+        << (m_DeviceLocal ? "device local" : "host") << " memory, " << (m_Stats.allocations / frames)
+        << " allocations and " << (m_Stats.bytes / frames / 1024.0) << " KiB per frame, high-water mark "
+        << m_Stats.highWaterMark / 1024.0 << " KiB";
+    if (m_Stats.growths > 0)
+    {
+        std::cout << ", grown " << m_Stats.growths << " times";
+    }
+    if (m_Stats.failedAllocations > 0)
+    {
+        std::cout << ", " << m_Stats.failedAllocations << " allocations did not fit";
+    }
+    std::cout << "\n";
+}
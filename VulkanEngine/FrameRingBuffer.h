@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include "GpuAllocator.h"
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// Per-frame memory for uniforms and other data the CPU writes every frame.
+//
+// One buffer is split into a region per frame in flight and stays mapped for its whole
+// lifetime, in device local memory when the device has a host visible device local type
+// (resizable BAR). Allocations bump a pointer through the current frame's region; BeginFrame
+// moves to the next region once the frame that last used it has finished on the GPU, so
+// nothing is ever freed one by one and no vkMapMemory is needed per frame.
+//
+// Offsets are aligned to minUniformBufferOffsetAlignment so they can be passed directly as
+// dynamic offsets of VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptors. The bytes asked
+// for per frame are tracked; when a frame needed more than a region holds, the buffer is
+// replaced by a larger one at the next BeginFrame and the old one is released once no frame
+// in flight uses it.
+class FrameRingBuffer
+{
+public:
+    // data is null when the frame's region is full, the request still counts towards the
+    // size the buffer grows to
+    struct Allocation
+    {
+        VkBuffer    buffer  = nullptr;
+        uint32_t    offset  = 0;        // from the start of the buffer, usable as a dynamic offset
+        void*       data    = nullptr;
+    };
+
+    struct Stats
+    {
+        uint64_t    frames              = 0;
+        uint64_t    allocations         = 0;
+        uint64_t    failedAllocations   = 0;
+        uint64_t    bytes               = 0;    // including alignment padding
+        uint64_t    highWaterMark       = 0;    // most bytes asked for in one frame
+        uint64_t    growths             = 0;
+    };
+
+    // frameSize is the initial size of one frame's region
+    void Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator, uint64_t uniformAlignment,
+        uint64_t storageAlignment, uint32_t framesInFlight, uint64_t frameSize, const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    // Starts allocating from the region of frameIndex. The caller has waited for that frame's
+    // fence, so the data written the last time the region was used has been consumed.
+    void BeginFrame(uint32_t frameIndex);
+
+    // Thread safe, so parallel recording jobs can share the ring
+    Allocation Allocate(uint64_t size);             // uniform data
+    Allocation AllocateStorage(uint64_t size);      // storage, vertex or index data
+
+    template <typename T>
+    Allocation Push(const T& value)
+    {
+        Allocation allocation = Allocate(sizeof(T));
+        if (allocation.data != nullptr)
+        {
+            std::memcpy(allocation.data, &value, sizeof(T));
+        }
+        return allocation;
+    }
+
+    // Changes when the buffer grows, descriptors pointing at it have to be rewritten
+    VkBuffer GetBuffer() const { return m_Buffer; }
+    uint64_t GetFrameSize() const { return m_FrameSize; }
+    uint64_t GetUniformAlignment() const { return m_UniformAlignment; }
+
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // A buffer that was replaced while frames in flight may still read it
+    struct RetiredBuffer
+    {
+        VkBuffer                    buffer      = nullptr;
+        GpuAllocator::Allocation*   allocation  = nullptr;
+        uint64_t                    lastFrame   = 0;        // last frame number that used it
+    };
+
+    void CreateBuffer(uint64_t frameSize);
+    void DestroyBuffer(VkBuffer buffer, GpuAllocator::Allocation* allocation);
+    Allocation AllocateAligned(uint64_t size, uint64_t alignment);
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    GpuAllocator*                   m_Allocator         = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks         = nullptr;
+    uint64_t                        m_UniformAlignment  = 1;
+    uint64_t                        m_StorageAlignment  = 1;
+    uint32_t                        m_FramesInFlight    = 1;
+
+    VkBuffer                        m_Buffer            = nullptr;
+    GpuAllocator::Allocation*       m_Allocation        = nullptr;
+    uint8_t*                        m_Mapped            = nullptr;
+    bool                            m_DeviceLocal       = false;
+    uint64_t                        m_FrameSize         = 0;    // usable bytes per region, regions start aligned
+    std::vector<RetiredBuffer>      m_Retired;
+
+    // Offset of the current region and the bytes handed out from it. m_Head keeps counting
+    // past the end of the region so the frame's demand is known even when it overflowed.
+    uint64_t                        m_RegionOffset      = 0;
+    std::atomic<uint64_t>           m_Head              { 0 };
+    std::atomic<uint64_t>           m_Allocations       { 0 };
+    std::atomic<uint64_t>           m_Failed            { 0 };
+    uint64_t                        m_FrameNumber       = 0;
+    bool                            m_InFrame           = false;
+
+    Stats                           m_Stats;
+};
@@ -0,0 +1,1202 @@
+#include "GpuAllocator.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+// TLSF size classes: the first level is the power of two of the size, the second level
+// splits every power of two into 16 linear steps. Sizes below 256 bytes share the first
+// level 0 in steps of 16 bytes.
+static constexpr uint32_t SL_BITS = 4;
+static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+static constexpr uint32_t SMALL_BITS = 8;
+static constexpr uint32_t FL_COUNT = 64 - SMALL_BITS + 1;
+
+static constexpr uint32_t NO_REGION = UINT32_MAX;
+
+// Free space left over after an allocation is only split off when it is at least this big
+static constexpr uint64_t MIN_SPLIT_SIZE = 64;
+
+// Same block sizes as most engines use: 256 MiB, or an eighth of heaps up to 1 GiB.
+// The first blocks of a memory type start at an eighth of that and double from there,
+// so small applications do not reserve a lot of memory they never use.
+static constexpr uint64_t LARGE_HEAP_BLOCK_SIZE = 256ull * 1024 * 1024;
+static constexpr uint64_t SMALL_HEAP_SIZE = 1024ull * 1024 * 1024;
+
+// Querying the budget costs a driver call, so it is refreshed every few block allocations
+static constexpr uint64_t BUDGET_QUERY_INTERVAL = 32;
+
+// Without VK_EXT_memory_budget the engine allows itself this much of every heap
+static constexpr uint64_t FALLBACK_BUDGET_PERCENT = 80;
+
+static uint32_t BitScanForward(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+static uint32_t BitScanReverse(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+static uint32_t CountBits(uint32_t value)
+{
+    uint32_t count = 0;
+    for (; value != 0; value &= value - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static double ToMiB(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+static void MapSize(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+    if (size < (1ull << SMALL_BITS))
+    {
+        fl = 0;
+        sl = static_cast<uint32_t>(size >> (SMALL_BITS - SL_BITS));
+    }
+    else
+    {
+        uint32_t log2 = BitScanReverse(size);
+        fl = log2 - SMALL_BITS + 1;
+        sl = static_cast<uint32_t>(size >> (log2 - SL_BITS)) & (SL_COUNT - 1);
+    }
+}
+
+// One VkDeviceMemory carved up with TLSF. Every byte of the block belongs to exactly one
+// region; regions are linked in address order so freed neighbours can be merged, and free
+// regions are additionally linked into the list of their size class. A bitmap over the
+// size classes finds a fitting free region in constant time.
+struct GpuAllocator::Block
+{
+    struct Region
+    {
+        uint64_t    offset          = 0;
+        uint64_t    size            = 0;
+        uint32_t    prevPhysical    = NO_REGION;
+        uint32_t    nextPhysical    = NO_REGION;
+        uint32_t    prevFree        = NO_REGION;
+        uint32_t    nextFree        = NO_REGION;
+        Allocation* owner           = nullptr;
+        bool        free            = true;
+    };
+
+    VkDeviceMemory          memory          = nullptr;
+    uint64_t                size            = 0;
+    uint8_t*                mapped          = nullptr;
+    uint64_t                used            = 0;
+    uint32_t                allocationCount = 0;
+    bool                    defragSource    = false;    // being emptied by defragmentation
+
+    std::vector<Region>     regions;
+    std::vector<uint32_t>   unusedRegions;
+
+    uint64_t                flBitmap        = 0;
+    uint32_t                slBitmap[FL_COUNT] = {};
+    uint32_t                freeHeads[FL_COUNT][SL_COUNT];
+
+    explicit Block(uint64_t blockSize)
+        : size(blockSize)
+    {
+        for (auto& heads : freeHeads)
+        {
+            std::fill(std::begin(heads), std::end(heads), NO_REGION);
+        }
+
+        Region whole;
+        whole.size = blockSize;
+        regions.push_back(whole);
+        InsertFree(0);
+    }
+
+    // Free region size Allocate searches for. Any region in the class found for size + alignment - 1
+    // can be aligned in place; rounded up to the next class boundary, so every region in the class
+    // found is big enough. A block of at least this size always holds the allocation.
+    static uint64_t GetSearchSize(uint64_t allocSize, uint64_t alignment)
+    {
+        uint64_t searchSize = allocSize + alignment - 1;
+        if (searchSize >= (1ull << SMALL_BITS))
+        {
+            searchSize += (1ull << (BitScanReverse(searchSize) - SL_BITS)) - 1;
+        }
+        else
+        {
+            searchSize += (1ull << (SMALL_BITS - SL_BITS)) - 1;
+        }
+        return searchSize;
+    }
+
+    bool Allocate(uint64_t allocSize, uint64_t alignment, Allocation* owner, uint32_t& regionIndex)
+    {
+        uint32_t index = FindFree(GetSearchSize(allocSize, alignment));
+        if (index == NO_REGION)
+        {
+            return false;
+        }
+        RemoveFree(index);
+
+        uint64_t padding = AlignUp(regions[index].offset, alignment) - regions[index].offset;
+        if (padding > 0)
+        {
+            uint32_t front = NewRegion();
+            regions[front].offset = regions[index].offset;
+            regions[front].size = padding;
+            regions[front].prevPhysical = regions[index].prevPhysical;
+            regions[front].nextPhysical = index;
+            if (regions[front].prevPhysical != NO_REGION)
+            {
+                regions[regions[front].prevPhysical].nextPhysical = front;
+            }
+            regions[index].prevPhysical = front;
+            regions[index].offset += padding;
+            regions[index].size -= padding;
+            InsertFree(front);
+        }
+
+        if (regions[index].size - allocSize >= MIN_SPLIT_SIZE)
+        {
+            uint32_t back = NewRegion();
+            regions[back].offset = regions[index].offset + allocSize;
+            regions[back].size = regions[index].size - allocSize;
+            regions[back].prevPhysical = index;
+            regions[back].nextPhysical = regions[index].nextPhysical;
+            if (regions[back].nextPhysical != NO_REGION)
+            {
+                regions[regions[back].nextPhysical].prevPhysical = back;
+            }
+            regions[index].nextPhysical = back;
+            regions[index].size = allocSize;
+            InsertFree(back);
+        }
+
+        regions[index].free = false;
+        regions[index].owner = owner;
+        used += regions[index].size;
+        allocationCount++;
+
+        regionIndex = index;
+        return true;
+    }
+
+    void Free(uint32_t index)
+    {
+        used -= regions[index].size;
+        allocationCount--;
+        regions[index].free = true;
+        regions[index].owner = nullptr;
+
+        uint32_t next = regions[index].nextPhysical;
+        if (next != NO_REGION && regions[next].free)
+        {
+            RemoveFree(next);
+            regions[index].size += regions[next].size;
+            regions[index].nextPhysical = regions[next].nextPhysical;
+            if (regions[index].nextPhysical != NO_REGION)
+            {
+                regions[regions[index].nextPhysical].prevPhysical = index;
+            }
+            ReleaseRegion(next);
+        }
+
+        uint32_t prev = regions[index].prevPhysical;
+        if (prev != NO_REGION && regions[prev].free)
+        {
+            RemoveFree(prev);
+            regions[prev].size += regions[index].size;
+            regions[prev].nextPhysical = regions[index].nextPhysical;
+            if (regions[prev].nextPhysical != NO_REGION)
+            {
+                regions[regions[prev].nextPhysical].prevPhysical = prev;
+            }
+            ReleaseRegion(index);
+            index = prev;
+        }
+
+        InsertFree(index);
+    }
+
+private:
+    uint32_t NewRegion()
+    {
+        if (!unusedRegions.empty())
+        {
+            uint32_t index = unusedRegions.back();
+            unusedRegions.pop_back();
+            regions[index] = Region();
+            return index;
+        }
+        regions.emplace_back();
+        return static_cast<uint32_t>(regions.size() - 1);
+    }
+
+    void ReleaseRegion(uint32_t index)
+    {
+        // Stays marked free with no size, so scans over the region array skip it
+        regions[index] = Region();
+        unusedRegions.push_back(index);
+    }
+
+    // searchSize comes from GetSearchSize, every region in the class it maps to is big enough
+    uint32_t FindFree(uint64_t searchSize) const
+    {
+        uint32_t fl, sl;
+        MapSize(searchSize, fl, sl);
+        if (fl >= FL_COUNT)
+        {
+            return NO_REGION;
+        }
+
+        uint32_t slMap = slBitmap[fl] & (~0u << sl);
+        if (slMap == 0)
+        {
+            uint64_t flMap = (fl + 1 < 64) ? flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap == 0)
+            {
+                return NO_REGION;
+            }
+            fl = BitScanForward(flMap);
+            slMap = slBitmap[fl];
+        }
+
+        sl = BitScanForward(slMap);
+        return freeHeads[fl][sl];
+    }
+
+    void InsertFree(uint32_t index)
+    {
+        uint32_t fl, sl;
+        MapSize(regions[index].size, fl, sl);
+
+        uint32_t head = freeHeads[fl][sl];
+        regions[index].prevFree = NO_REGION;
+        regions[index].nextFree = head;
+        if (head != NO_REGION)
+        {
+            regions[head].prevFree = index;
+        }
+        freeHeads[fl][sl] = index;
+        slBitmap[fl] |= 1u << sl;
+        flBitmap |= 1ull << fl;
+    }
+
+    void RemoveFree(uint32_t index)
+    {
+        uint32_t fl, sl;
+        MapSize(regions[index].size, fl, sl);
+
+        uint32_t prev = regions[index].prevFree;
+        uint32_t next = regions[index].nextFree;
+        if (prev != NO_REGION)
+        {
+            regions[prev].nextFree = next;
+        }
+        if (next != NO_REGION)
+        {
+            regions[next].prevFree = prev;
+        }
+
+        if (freeHeads[fl][sl] == index)
+        {
+            freeHeads[fl][sl] = next;
+            if (next == NO_REGION)
+            {
+                slBitmap[fl] &= ~(1u << sl);
+                if (slBitmap[fl] == 0)
+                {
+                    flBitmap &= ~(1ull << fl);
+                }
+            }
+        }
+    }
+};
+
+void GpuAllocator::LinearPool::Reset()
+{
+    m_Offset = 0;
+    m_Allocations.clear();
+}
+
+void GpuAllocator::Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+    uint32_t apiVersion, bool memoryBudget, const VkAllocationCallbacks* allocator)
+{
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = allocator;
+    m_DedicatedQueries = apiVersion >= VK_API_VERSION_1_1;
+    m_MemoryBudget = memoryBudget && m_DedicatedQueries;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_BufferImageGranularity = properties.limits.bufferImageGranularity;
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    m_MemoryHeapCount = memProperties.memoryHeapCount;
+    for (uint32_t i = 0; i < m_MemoryHeapCount; i++)
+    {
+        m_HeapSize[i] = memProperties.memoryHeaps[i].size;
+        m_HeapFlags[i] = memProperties.memoryHeaps[i].flags;
+    }
+
+    m_MemoryTypeCount = memProperties.memoryTypeCount;
+    m_BlockLists.resize(2 * m_MemoryTypeCount);
+    for (uint32_t i = 0; i < m_MemoryTypeCount; i++)
+    {
+        m_MemoryTypeFlags[i] = memProperties.memoryTypes[i].propertyFlags;
+        m_MemoryTypeHeap[i] = memProperties.memoryTypes[i].heapIndex;
+
+        uint64_t heapSize = m_HeapSize[m_MemoryTypeHeap[i]];
+        m_PreferredBlockSize[i] = heapSize <= SMALL_HEAP_SIZE ? heapSize / 8 : LARGE_HEAP_BLOCK_SIZE;
+
+        for (uint32_t images = 0; images < 2; images++)
+        {
+            BlockList& list = m_BlockLists[2 * i + images];
+            list.memoryType = i;
+            list.images = images != 0;
+            list.nextBlockSize = m_PreferredBlockSize[i] / 8;
+        }
+    }
+
+    UpdateBudget();
+}
+
+void GpuAllocator::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    if (m_LiveAllocations > 0)
+    {
+        std::cerr << "GPU memory: " << m_LiveAllocations << " allocations were not freed before shutdown" << std::endl;
+    }
+
+    m_PendingMoves.clear();
+    m_MoveTargets.clear();
+
+    for (BlockList& list : m_BlockLists)
+    {
+        while (!list.blocks.empty())
+        {
+            DestroyBlock(list, list.blocks.back());
+        }
+    }
+    m_BlockLists.clear();
+
+    for (Allocation* allocation : m_Dedicated)
+    {
+        FreeDeviceMemory(allocation->memory, allocation->size, allocation->memoryType);
+        delete allocation;
+    }
+    m_Dedicated.clear();
+
+    for (auto& pool : m_Pools)
+    {
+        FreeDeviceMemory(pool->m_Memory, pool->m_Size, pool->m_MemoryType);
+    }
+    m_Pools.clear();
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+GpuAllocator::Allocation* GpuAllocator::AllocateForBuffer(VkBuffer buffer, const AllocationCreateInfo& createInfo)
+{
+    VkMemoryRequirements requirements;
+    bool prefersDedicated = false;
+    bool requiresDedicated = false;
+
+    // Vulkan 1.1 also tells whether the driver would rather give the resource its own memory
+    if (m_DedicatedQueries)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicatedRequirements;
+
+        VkBufferMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        info.buffer = buffer;
+
+        m_Dispatch->vkGetBufferMemoryRequirements2(m_Device, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        prefersDedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        requiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE;
+    }
+    else
+    {
+        m_Dispatch->vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+    }
+
+    Allocation* allocation = Allocate(requirements, prefersDedicated, requiresDedicated, buffer, VK_NULL_HANDLE, createInfo);
+    if (m_Dispatch->vkBindBufferMemory(m_Device, buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        Free(allocation);
+        throw std::runtime_error("Failed to bind buffer memory!");
+    }
+    return allocation;
+}
+
+GpuAllocator::Allocation* GpuAllocator::AllocateForImage(VkImage image, const AllocationCreateInfo& createInfo)
+{
+    VkMemoryRequirements requirements;
+    bool prefersDedicated = false;
+    bool requiresDedicated = false;
+
+    if (m_DedicatedQueries)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 requirements2{};
+        requirements2.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements2.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        info.image = image;
+
+        m_Dispatch->vkGetImageMemoryRequirements2(m_Device, &info, &requirements2);
+        requirements = requirements2.memoryRequirements;
+        prefersDedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        requiresDedicated = dedicatedRequirements.requiresDedicatedAllocation == VK_TRUE;
+    }
+    else
+    {
+        m_Dispatch->vkGetImageMemoryRequirements(m_Device, image, &requirements);
+    }
+
+    Allocation* allocation = Allocate(requirements, prefersDedicated, requiresDedicated, VK_NULL_HANDLE, image, createInfo);
+    if (m_Dispatch->vkBindImageMemory(m_Device, image, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        Free(allocation);
+        throw std::runtime_error("Failed to bind image memory!");
+    }
+    return allocation;
+}
+
+GpuAllocator::Allocation* GpuAllocator::AllocateMemory(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo)
+{
+    return Allocate(requirements, false, false, VK_NULL_HANDLE, VK_NULL_HANDLE, createInfo);
+}
+
+GpuAllocator::Allocation* GpuAllocator::Allocate(const VkMemoryRequirements& requirements, bool prefersDedicated,
+    bool requiresDedicated, VkBuffer buffer, VkImage image, const AllocationCreateInfo& createInfo)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stats.allocations++;
+
+    if (createInfo.pool != nullptr)
+    {
+        // Pool memory is shared and released with Reset, it can never be the resource's own
+        if (requiresDedicated)
+        {
+            throw std::runtime_error("Resource requires a dedicated allocation and cannot use a linear pool!");
+        }
+        return AllocateFromPool(*createInfo.pool, requirements);
+    }
+
+    uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, createInfo.usage);
+
+    // Resources bigger than half a block would waste most of a block on their own
+    Allocation* allocation = nullptr;
+    if (createInfo.dedicated || prefersDedicated || requirements.size > m_PreferredBlockSize[memoryType] / 2)
+    {
+        allocation = AllocateDedicated(requirements, memoryType, buffer, image);
+    }
+    else
+    {
+        BlockList& list = m_BlockLists[2 * memoryType + (image != VK_NULL_HANDLE ? 1 : 0)];
+
+        auto newAllocation = std::make_unique<Allocation>();
+        if (!AllocateFromList(list, requirements.size, requirements.alignment, *newAllocation))
+        {
+            // Sized for the rounded search, a block of exactly requirements.size falls in a class below it
+            CreateBlock(list, Block::GetSearchSize(requirements.size, requirements.alignment));
+            if (!AllocateFromList(list, requirements.size, requirements.alignment, *newAllocation))
+            {
+                throw std::runtime_error("Failed to sub-allocate from a new memory block!");
+            }
+        }
+        allocation = newAllocation.release();
+    }
+
+    allocation->movable = createInfo.movable;
+    m_LiveAllocations++;
+    return allocation;
+}
+
+GpuAllocator::Allocation* GpuAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType,
+    VkBuffer buffer, VkImage image)
+{
+    // Lets the driver place the resource optimally, e.g. with its own page table entries
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+    dedicatedInfo.image = image;
+
+    if (IsOverBudget(m_MemoryTypeHeap[memoryType], requirements.size))
+    {
+        m_Stats.overBudgetBlocks++;
+    }
+
+    VkDeviceMemory memory = AllocateDeviceMemory(requirements.size, memoryType, m_DedicatedQueries ? &dedicatedInfo : nullptr);
+    if (memory == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Failed to allocate dedicated device memory!");
+    }
+
+    Allocation* allocation = new Allocation();
+    allocation->memory = memory;
+    allocation->size = requirements.size;
+    allocation->memoryType = memoryType;
+    allocation->alignment = requirements.alignment;
+    allocation->kind = Allocation::Kind::Dedicated;
+
+    if (m_MemoryTypeFlags[memoryType] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        m_Dispatch->vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &allocation->mapped);
+    }
+
+    m_Dedicated.push_back(allocation);
+    m_Stats.dedicatedAllocations++;
+    return allocation;
+}
+
+GpuAllocator::Allocation* GpuAllocator::AllocateFromPool(LinearPool& pool, const VkMemoryRequirements& requirements)
+{
+    if ((requirements.memoryTypeBits & (1u << pool.m_MemoryType)) == 0)
+    {
+        throw std::runtime_error("Resource cannot use the memory type of its linear pool!");
+    }
+
+    // Buffers and images may follow each other in a pool, so keep them on separate granularity pages
+    uint64_t offset = AlignUp(pool.m_Offset, std::max<uint64_t>(requirements.alignment, m_BufferImageGranularity));
+    if (offset + requirements.size > pool.m_Size)
+    {
+        throw std::runtime_error("Linear pool is out of memory!");
+    }
+    pool.m_Offset = offset + requirements.size;
+    pool.m_HighWaterMark = std::max(pool.m_HighWaterMark, pool.m_Offset);
+
+    auto allocation = std::make_unique<Allocation>();
+    allocation->memory = pool.m_Memory;
+    allocation->offset = offset;
+    allocation->size = requirements.size;
+    allocation->mapped = pool.m_Mapped != nullptr ? pool.m_Mapped + offset : nullptr;
+    allocation->memoryType = pool.m_MemoryType;
+    allocation->alignment = requirements.alignment;
+    allocation->kind = Allocation::Kind::Linear;
+    allocation->block = &pool;
+
+    pool.m_Allocations.push_back(std::move(allocation));
+    return pool.m_Allocations.back().get();
+}
+
+bool GpuAllocator::AllocateFromList(BlockList& list, uint64_t size, uint64_t alignment, Allocation& allocation)
+{
+    for (Block* block : list.blocks)
+    {
+        if (AllocateFromBlock(list, block, size, alignment, allocation))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GpuAllocator::AllocateFromBlock(BlockList& list, Block* block, uint64_t size, uint64_t alignment, Allocation& allocation)
+{
+    uint32_t region;
+    if (block->defragSource || !block->Allocate(size, alignment, &allocation, region))
+    {
+        return false;
+    }
+
+    allocation.memory = block->memory;
+    allocation.offset = block->regions[region].offset;
+    allocation.size = size;
+    allocation.mapped = block->mapped != nullptr ? block->mapped + allocation.offset : nullptr;
+    allocation.memoryType = list.memoryType;
+    allocation.kind = Allocation::Kind::Block;
+    allocation.blockList = static_cast<size_t>(&list - m_BlockLists.data());
+    allocation.block = block;
+    allocation.region = region;
+    allocation.alignment = alignment;
+    return true;
+}
+
+GpuAllocator::Block* GpuAllocator::CreateBlock(BlockList& list, uint64_t minSize)
+{
+    const uint32_t heap = m_MemoryTypeHeap[list.memoryType];
+    uint64_t size = std::max(list.nextBlockSize, minSize);
+
+    // Close to the budget smaller blocks are tried first; going over it is still
+    // better than failing, the driver will page memory out if it has to
+    while (size / 2 >= minSize && IsOverBudget(heap, size))
+    {
+        size /= 2;
+    }
+    if (IsOverBudget(heap, size))
+    {
+        m_Stats.overBudgetBlocks++;
+    }
+
+    VkDeviceMemory memory = AllocateDeviceMemory(size, list.memoryType, nullptr);
+    while (memory == VK_NULL_HANDLE && size / 2 >= minSize)
+    {
+        size /= 2;
+        memory = AllocateDeviceMemory(size, list.memoryType, nullptr);
+    }
+    if (memory == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Failed to allocate device memory block!");
+    }
+
+    list.nextBlockSize = std::min(list.nextBlockSize * 2, m_PreferredBlockSize[list.memoryType]);
+
+    Block* block = new Block(size);
+    block->memory = memory;
+
+    // Host visible blocks stay mapped for their whole lifetime
+    if (m_MemoryTypeFlags[list.memoryType] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void* mapped = nullptr;
+        m_Dispatch->vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        block->mapped = static_cast<uint8_t*>(mapped);
+    }
+
+    list.blocks.push_back(block);
+    return block;
+}
+
+void GpuAllocator::DestroyBlock(BlockList& list, Block* block)
+{
+    // Freeing the memory also unmaps it
+    FreeDeviceMemory(block->memory, block->size, list.memoryType);
+    list.blocks.erase(std::find(list.blocks.begin(), list.blocks.end(), block));
+    delete block;
+}
+
+void GpuAllocator::Free(Allocation* allocation)
+{
+    if (allocation == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    switch (allocation->kind)
+    {
+    case Allocation::Kind::Linear:
+        // Released together by LinearPool::Reset
+        return;
+
+    case Allocation::Kind::Dedicated:
+        m_Dedicated.erase(std::find(m_Dedicated.begin(), m_Dedicated.end(), allocation));
+        FreeDeviceMemory(allocation->memory, allocation->size, allocation->memoryType);
+        break;
+
+    case Allocation::Kind::Block:
+        if (allocation->moving)
+        {
+            // Freed in the middle of a defragmentation pass, drop the space reserved for the move
+            for (size_t i = 0; i < m_PendingMoves.size(); i++)
+            {
+                if (m_PendingMoves[i].allocation == allocation)
+                {
+                    FreeRegion(m_MoveTargets[i]);
+                    m_PendingMoves.erase(m_PendingMoves.begin() + i);
+                    m_MoveTargets.erase(m_MoveTargets.begin() + i);
+                    break;
+                }
+            }
+        }
+        FreeRegion(*allocation);
+        break;
+    }
+
+    delete allocation;
+    m_LiveAllocations--;
+}
+
+void GpuAllocator::FreeRegion(Allocation& allocation)
+{
+    Block* block = static_cast<Block*>(allocation.block);
+    block->Free(allocation.region);
+
+    if (block->allocationCount == 0 && !block->defragSource)
+    {
+        ReleaseEmptyBlocks(m_BlockLists[allocation.blockList]);
+    }
+}
+
+// One empty block is kept per list, so a resource that is freed and created again
+// every frame does not allocate and free a whole block each time
+void GpuAllocator::ReleaseEmptyBlocks(BlockList& list)
+{
+    bool keptOne = false;
+    for (size_t i = list.blocks.size(); i-- > 0; )
+    {
+        Block* block = list.blocks[i];
+        if (block->allocationCount > 0 || block->defragSource)
+        {
+            continue;
+        }
+
+        if (!keptOne)
+        {
+            keptOne = true;
+        }
+        else
+        {
+            DestroyBlock(list, block);
+        }
+    }
+}
+
+GpuAllocator::LinearPool* GpuAllocator::CreateLinearPool(Usage usage, uint32_t memoryTypeBits, uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto pool = std::make_unique<LinearPool>();
+    pool->m_MemoryType = FindMemoryType(memoryTypeBits, usage);
+    pool->m_Size = size;
+    pool->m_Memory = AllocateDeviceMemory(size, pool->m_MemoryType, nullptr);
+    if (pool->m_Memory == VK_NULL_HANDLE)
+    {
+        throw std::runtime_error("Failed to allocate linear pool memory!");
+    }
+
+    if (m_MemoryTypeFlags[pool->m_MemoryType] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void* mapped = nullptr;
+        m_Dispatch->vkMapMemory(m_Device, pool->m_Memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        pool->m_Mapped = static_cast<uint8_t*>(mapped);
+    }
+
+    m_Pools.push_back(std::move(pool));
+    return m_Pools.back().get();
+}
+
+void GpuAllocator::DestroyLinearPool(LinearPool* pool)
+{
+    if (pool == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    auto it = std::find_if(m_Pools.begin(), m_Pools.end(), [&](const std::unique_ptr<LinearPool>& p) { return p.get() == pool; });
+    if (it != m_Pools.end())
+    {
+        FreeDeviceMemory(pool->m_Memory, pool->m_Size, pool->m_MemoryType);
+        m_Pools.erase(it);
+    }
+}
+
+std::vector<GpuAllocator::DefragmentationMove> GpuAllocator::BeginDefragmentation(uint64_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (!m_PendingMoves.empty())
+    {
+        throw std::runtime_error("Previous defragmentation pass has not ended!");
+    }
+
+    uint64_t movedBytes = 0;
+    for (BlockList& list : m_BlockLists)
+    {
+        if (list.blocks.size() < 2)
+        {
+            continue;
+        }
+
+        // Empty the least used blocks into the fuller ones. Destinations are tried fullest first,
+        // so moves do not land in blocks that are themselves about to be emptied.
+        std::vector<Block*> sources = list.blocks;
+        std::sort(sources.begin(), sources.end(), [](const Block* a, const Block* b) { return a->used < b->used; });
+        std::vector<Block*> destinations = list.blocks;
+
+        for (Block* source : sources)
+        {
+            if (source->allocationCount == 0)
+            {
+                continue;
+            }
+            if (movedBytes + source->used > maxBytes)
+            {
+                break;
+            }
+
+            // A block is only worth moving out of if it can be released afterwards
+            bool allMovable = true;
+            for (const Block::Region& region : source->regions)
+            {
+                if (!region.free && (!region.owner->movable || region.owner->moving))
+                {
+                    allMovable = false;
+                    break;
+                }
+            }
+            if (!allMovable)
+            {
+                continue;
+            }
+
+            source->defragSource = true;
+            const size_t firstMove = m_PendingMoves.size();
+            std::sort(destinations.begin(), destinations.end(), [](const Block* a, const Block* b) { return a->used > b->used; });
+            bool fits = true;
+
+            for (uint32_t r = 0; r < source->regions.size() && fits; r++)
+            {
+                if (source->regions[r].free)
+                {
+                    continue;
+                }
+
+                Allocation* allocation = source->regions[r].owner;
+                Allocation target;
+                fits = false;
+                for (Block* destination : destinations)
+                {
+                    if (AllocateFromBlock(list, destination, allocation->size, allocation->alignment, target))
+                    {
+                        fits = true;
+                        break;
+                    }
+                }
+                if (!fits)
+                {
+                    break;
+                }
+
+                // The region belongs to the real allocation, target is only a placeholder
+                Block* targetBlock = static_cast<Block*>(target.block);
+                targetBlock->regions[target.region].owner = allocation;
+
+                DefragmentationMove move;
+                move.allocation = allocation;
+                move.dstMemory = target.memory;
+                move.dstOffset = target.offset;
+                move.dstMapped = target.mapped;
+                m_PendingMoves.push_back(move);
+                m_MoveTargets.push_back(target);
+            }
+
+            if (!fits)
+            {
+                // The other blocks cannot take everything, leave this block where it is
+                for (size_t i = firstMove; i < m_MoveTargets.size(); i++)
+                {
+                    static_cast<Block*>(m_MoveTargets[i].block)->Free(m_MoveTargets[i].region);
+                }
+                m_PendingMoves.resize(firstMove);
+                m_MoveTargets.resize(firstMove);
+                source->defragSource = false;
+                continue;
+            }
+
+            for (size_t i = firstMove; i < m_PendingMoves.size(); i++)
+            {
+                m_PendingMoves[i].allocation->moving = true;
+            }
+            movedBytes += source->used;
+        }
+    }
+
+    return m_PendingMoves;
+}
+
+void GpuAllocator::EndDefragmentation()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for (size_t i = 0; i < m_PendingMoves.size(); i++)
+    {
+        Allocation* allocation = m_PendingMoves[i].allocation;
+        const Allocation& target = m_MoveTargets[i];
+
+        static_cast<Block*>(allocation->block)->Free(allocation->region);
+
+        allocation->memory = target.memory;
+        allocation->offset = target.offset;
+        allocation->mapped = target.mapped;
+        allocation->block = target.block;
+        allocation->region = target.region;
+        allocation->moving = false;
+
+        m_Stats.defragmentedBytes += allocation->size;
+        m_Stats.defragmentedMoves++;
+    }
+    m_PendingMoves.clear();
+    m_MoveTargets.clear();
+
+    for (BlockList& list : m_BlockLists)
+    {
+        for (Block* block : list.blocks)
+        {
+            block->defragSource = false;
+        }
+        ReleaseEmptyBlocks(list);
+    }
+}
+
+VkDeviceMemory GpuAllocator::AllocateDeviceMemory(uint64_t size, uint32_t memoryType, const void* pNext)
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (m_Dispatch->vkAllocateMemory(m_Device, &allocInfo, m_Allocator, &memory) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    m_Stats.vkAllocateCalls++;
+    m_HeapBlockBytes[m_MemoryTypeHeap[memoryType]] += size;
+    m_AllocationsSinceBudgetQuery++;
+    m_LiveBlocks++;
+    m_Stats.peakLiveBlocks = std::max(m_Stats.peakLiveBlocks, m_LiveBlocks);
+    return memory;
+}
+
+void GpuAllocator::FreeDeviceMemory(VkDeviceMemory memory, uint64_t size, uint32_t memoryType)
+{
+    m_Dispatch->vkFreeMemory(m_Device, memory, m_Allocator);
+
+    m_Stats.vkFreeCalls++;
+    m_HeapBlockBytes[m_MemoryTypeHeap[memoryType]] -= size;
+    m_LiveBlocks--;
+}
+
+// Picks the memory type with the most wanted and fewest unwanted properties
+// among the ones that have everything the usage requires
+uint32_t GpuAllocator::FindMemoryType(uint32_t typeBits, Usage usage) const
+{
+    VkMemoryPropertyFlags required = 0;
+    VkMemoryPropertyFlags preferred = 0;
+    VkMemoryPropertyFlags avoided = 0;
+
+    switch (usage)
+    {
+    case Usage::GpuOnly:
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        break;
+    case Usage::Upload:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        // Small device local and host visible heaps (BAR) are better left to dynamic data
+        avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    case Usage::Dynamic:
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        break;
+    case Usage::Readback:
+        // CPU reads from uncached memory are very slow
+        required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    }
+
+    // Protected and lazily allocated memory only work for special resources
+    const VkMemoryPropertyFlags excluded = VK_MEMORY_PROPERTY_PROTECTED_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+    uint32_t bestType = UINT32_MAX;
+    int bestScore = 0;
+    for (uint32_t i = 0; i < m_MemoryTypeCount; i++)
+    {
+        const VkMemoryPropertyFlags flags = m_MemoryTypeFlags[i];
+        if ((typeBits & (1u << i)) == 0 || (flags & required) != required || (flags & excluded) != 0)
+        {
+            continue;
+        }
+
+        int score = 32 + static_cast<int>(CountBits(flags & preferred)) - static_cast<int>(CountBits(flags & avoided));
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestType = i;
+        }
+    }
+
+    if (bestType == UINT32_MAX)
+    {
+        throw std::runtime_error("Failed to find a suitable memory type!");
+    }
+    return bestType;
+}
+
+bool GpuAllocator::IsOverBudget(uint32_t heap, uint64_t extraBytes)
+{
+    if (m_MemoryBudget && m_AllocationsSinceBudgetQuery >= BUDGET_QUERY_INTERVAL)
+    {
+        UpdateBudget();
+    }
+
+    // The driver's numbers are only as fresh as the last query, our own blocks since then are added on top
+    int64_t usage = static_cast<int64_t>(m_HeapUsage[heap])
+        + static_cast<int64_t>(m_HeapBlockBytes[heap]) - static_cast<int64_t>(m_HeapBlockBytesAtBudgetQuery[heap]);
+    return static_cast<uint64_t>(std::max<int64_t>(usage, 0)) + extraBytes > m_HeapBudget[heap];
+}
+
+void GpuAllocator::UpdateBudget()
+{
+    m_AllocationsSinceBudgetQuery = 0;
+
+    if (!m_MemoryBudget)
+    {
+        // Other processes are invisible, so only our own blocks count
+        for (uint32_t i = 0; i < m_MemoryHeapCount; i++)
+        {
+            m_HeapBudget[i] = m_HeapSize[i] / 100 * FALLBACK_BUDGET_PERCENT;
+            m_HeapUsage[i] = 0;
+            m_HeapBlockBytesAtBudgetQuery[i] = 0;
+        }
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 memProperties2{};
+    memProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memProperties2.pNext = &budgetProperties;
+
+    vkGetPhysicalDeviceMemoryProperties2(m_PhysicalDevice, &memProperties2);
+
+    for (uint32_t i = 0; i < m_MemoryHeapCount; i++)
+    {
+        m_HeapBudget[i] = budgetProperties.heapBudget[i];
+        m_HeapUsage[i] = budgetProperties.heapUsage[i];
+        m_HeapBlockBytesAtBudgetQuery[i] = m_HeapBlockBytes[i];
+    }
+}
+
+std::vector<GpuAllocator::HeapStats> GpuAllocator::GetHeapStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (m_MemoryBudget)
+    {
+        UpdateBudget();
+    }
+
+    std::vector<HeapStats> heaps(m_MemoryHeapCount);
+    for (uint32_t i = 0; i < m_MemoryHeapCount; i++)
+    {
+        heaps[i].heapSize = m_HeapSize[i];
+        heaps[i].deviceLocal = (m_HeapFlags[i] & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    for (const BlockList& list : m_BlockLists)
+    {
+        HeapStats& heap = heaps[m_MemoryTypeHeap[list.memoryType]];
+        for (const Block* block : list.blocks)
+        {
+            heap.blockCount++;
+            heap.blockBytes += block->size;
+            heap.allocationCount += block->allocationCount;
+            heap.allocationBytes += block->used;
+        }
+    }
+
+    for (const Allocation* allocation : m_Dedicated)
+    {
+        HeapStats& heap = heaps[m_MemoryTypeHeap[allocation->memoryType]];
+        heap.blockCount++;
+        heap.blockBytes += allocation->size;
+        heap.allocationCount++;
+        heap.allocationBytes += allocation->size;
+    }
+
+    for (const auto& pool : m_Pools)
+    {
+        HeapStats& heap = heaps[m_MemoryTypeHeap[pool->m_MemoryType]];
+        heap.blockCount++;
+        heap.blockBytes += pool->m_Size;
+        heap.allocationCount += static_cast<uint32_t>(pool->m_Allocations.size());
+        heap.allocationBytes += pool->m_Offset;
+    }
+
+    for (uint32_t i = 0; i < m_MemoryHeapCount; i++)
+    {
+        heaps[i].budget = m_HeapBudget[i];
+        heaps[i].usage = m_MemoryBudget ? m_HeapUsage[i] : heaps[i].blockBytes;
+    }
+    return heaps;
+}
+
+void GpuAllocator::PrintStats()
+{
+    std::vector<HeapStats> heaps = GetHeapStats();
+
+    // Other threads may be allocating, print a consistent copy
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        stats = m_Stats;
+    }
+
+    std::cout << "GPU memory: " << stats.allocations << " allocations, " << stats.vkAllocateCalls << " vkAllocateMemory calls ("
+        << stats.dedicatedAllocations << " dedicated), peak " << stats.peakLiveBlocks << " live blocks, "
+        << stats.defragmentedMoves << " moves (" << stats.defragmentedBytes << " bytes) defragmented";
+    if (stats.overBudgetBlocks > 0)
+    {
+        std::cout << ", " << stats.overBudgetBlocks << " blocks over budget";
+    }
+    std::cout << '\n';
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < heaps.size(); i++)
+    {
+        const HeapStats& heap = heaps[i];
+        std::cout << "  Heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": " << heap.allocationCount << " allocations, "
+            << ToMiB(heap.allocationBytes) << " MiB used of " << ToMiB(heap.blockBytes) << " MiB in " << heap.blockCount << " blocks, "
+            << (m_MemoryBudget ? "usage " : "own usage ") << ToMiB(heap.usage) << " / budget " << ToMiB(heap.budget)
+            << " MiB of " << ToMiB(heap.heapSize) << " MiB\n";
+    }
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// Sub-allocates device memory so resources do not each need their own vkAllocateMemory.
+// Drivers limit the number of live allocations (maxMemoryAllocationCount, often 4096)
+// and every allocation is expensive, so memory is taken from the driver in large blocks
+// per memory type and carved up with a TLSF (two-level segregated fit) allocator.
+//
+// On top of that there are linear pools for transient resources that are released all
+// at once, dedicated allocations for very large resources, persistent mapping of host
+// visible blocks and an incremental defragmentation of movable allocations. Per-heap
+// statistics use VK_EXT_memory_budget when the device supports it.
+//
+// All host visible memory handed out is also host coherent, so mapped pointers can be
+// written and read without flushes.
+class GpuAllocator
+{
+public:
+    enum class Usage
+    {
+        GpuOnly,    // device local, not mappable
+        Upload,     // written once by the CPU, read by the GPU (staging)
+        Dynamic,    // rewritten by the CPU every frame and read by the GPU, device local if possible
+        Readback,   // written by the GPU and read by the CPU, cached if possible
+    };
+
+    class LinearPool;
+
+    struct AllocationCreateInfo
+    {
+        Usage       usage       = Usage::GpuOnly;
+
+        // Always give the resource its own VkDeviceMemory
+        bool        dedicated   = false;
+
+        // The owner handles the moves returned by BeginDefragmentation for this allocation
+        bool        movable     = false;
+
+        // Allocate from this pool instead of the general blocks; freed by LinearPool::Reset
+        LinearPool* pool        = nullptr;
+    };
+
+    // Stays at the same address for its whole lifetime, only memory and offset change
+    // when defragmentation moves it
+    struct Allocation
+    {
+        VkDeviceMemory  memory      = nullptr;
+        uint64_t        offset      = 0;
+        uint64_t        size        = 0;
+        void*           mapped      = nullptr;  // null unless the memory type is host visible
+        uint32_t        memoryType  = 0;
+
+    private:
+        friend class GpuAllocator;
+
+        enum class Kind { Block, Dedicated, Linear };
+
+        Kind        kind        = Kind::Block;
+        size_t      blockList   = 0;
+        void*       block       = nullptr;      // Block* for Kind::Block
+        uint32_t    region      = 0;            // region index inside the block
+        uint64_t    alignment   = 1;            // needed again when defragmentation moves it
+        bool        movable     = false;
+        bool        moving      = false;
+    };
+
+    // One pending move of an incremental defragmentation pass. The caller creates a new
+    // resource bound to dstMemory/dstOffset, records a copy from the old one and keeps
+    // using the old resource until EndDefragmentation.
+    struct DefragmentationMove
+    {
+        Allocation*     allocation  = nullptr;
+        VkDeviceMemory  dstMemory   = nullptr;
+        uint64_t        dstOffset   = 0;
+        void*           dstMapped   = nullptr;
+    };
+
+    struct HeapStats
+    {
+        uint64_t    heapSize        = 0;
+        uint32_t    blockCount      = 0;    // includes dedicated allocations and linear pools
+        uint64_t    blockBytes      = 0;
+        uint32_t    allocationCount = 0;
+        uint64_t    allocationBytes = 0;
+
+        // From VK_EXT_memory_budget, or estimated from our own blocks without it
+        uint64_t    budget          = 0;
+        uint64_t    usage           = 0;
+        bool        deviceLocal     = false;
+    };
+
+    struct Stats
+    {
+        uint64_t    vkAllocateCalls     = 0;
+        uint64_t    vkFreeCalls         = 0;
+        uint64_t    allocations         = 0;
+        uint64_t    dedicatedAllocations = 0;
+        uint64_t    overBudgetBlocks    = 0;    // blocks allocated although the heap was over budget
+        uint64_t    defragmentedBytes   = 0;
+        uint64_t    defragmentedMoves   = 0;
+        uint64_t    peakLiveBlocks      = 0;
+    };
+
+    // A bump allocator over a single block of one memory type. Allocations are freed
+    // together by Reset, e.g. once the frame that used them has finished on the GPU.
+    class LinearPool
+    {
+    public:
+        uint64_t GetUsed() const { return m_Offset; }
+        uint64_t GetSize() const { return m_Size; }
+        uint64_t GetHighWaterMark() const { return m_HighWaterMark; }
+
+        // Releases every allocation made from the pool, the Allocation pointers become invalid
+        void Reset();
+
+    private:
+        friend class GpuAllocator;
+
+        VkDeviceMemory  m_Memory        = nullptr;
+        uint32_t        m_MemoryType    = 0;
+        uint8_t*        m_Mapped        = nullptr;
+        uint64_t        m_Size          = 0;
+        uint64_t        m_Offset        = 0;
+        uint64_t        m_HighWaterMark = 0;
+        std::vector<std::unique_ptr<Allocation>> m_Allocations;
+    };
+
+    // apiVersion is the version both instance and device support. memoryBudget tells
+    // whether VK_EXT_memory_budget was enabled on the device.
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t apiVersion,
+        bool memoryBudget, const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    // Allocate memory for the resource and bind it. Throw if no memory can be found.
+    Allocation* AllocateForBuffer(VkBuffer buffer, const AllocationCreateInfo& createInfo);
+    Allocation* AllocateForImage(VkImage image, const AllocationCreateInfo& createInfo);
+
+    // Memory the caller binds itself, e.g. one range shared by several aliasing resources.
+    // Sub-allocations come from the buffer blocks, so resources with non-linear tiling should
+    // use a dedicated allocation to stay clear of bufferImageGranularity.
+    Allocation* AllocateMemory(const VkMemoryRequirements& requirements, const AllocationCreateInfo& createInfo);
+    void Free(Allocation* allocation);
+
+    LinearPool* CreateLinearPool(Usage usage, uint32_t memoryTypeBits, uint64_t size);
+    void DestroyLinearPool(LinearPool* pool);
+
+    // Incremental defragmentation. Picks movable allocations out of the emptiest blocks
+    // of each memory type, up to maxBytes per pass, and reserves space for them in the
+    // fuller blocks; no new blocks are allocated for it. Once the copies recorded for the
+    // returned moves have finished on the GPU, EndDefragmentation switches the allocations
+    // over and releases blocks that became empty.
+    std::vector<DefragmentationMove> BeginDefragmentation(uint64_t maxBytes);
+    void EndDefragmentation();
+
+    // VkMemoryPropertyFlags of a memory type, e.g. of Allocation::memoryType
+    uint32_t GetMemoryPropertyFlags(uint32_t memoryType) const { return m_MemoryTypeFlags[memoryType]; }
+    uint32_t GetMemoryTypeHeap(uint32_t memoryType) const { return m_MemoryTypeHeap[memoryType]; }
+
+    std::vector<HeapStats> GetHeapStats();
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats();
+
+private:
+    struct Block;
+
+    // Blocks of one memory type. Buffers and images get separate lists, so a linear and
+    // a non-linear resource never share a bufferImageGranularity page.
+    struct BlockList
+    {
+        uint32_t                            memoryType  = 0;
+        bool                                images      = false;
+        uint64_t                            nextBlockSize = 0;
+        std::vector<Block*>                 blocks;
+    };
+
+    Allocation* Allocate(const VkMemoryRequirements& requirements, bool prefersDedicated, bool requiresDedicated,
+        VkBuffer buffer, VkImage image, const AllocationCreateInfo& createInfo);
+    Allocation* AllocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType,
+        VkBuffer buffer, VkImage image);
+    Allocation* AllocateFromPool(LinearPool& pool, const VkMemoryRequirements& requirements);
+    bool AllocateFromList(BlockList& list, uint64_t size, uint64_t alignment, Allocation& allocation);
+    bool AllocateFromBlock(BlockList& list, Block* block, uint64_t size, uint64_t alignment, Allocation& allocation);
+    Block* CreateBlock(BlockList& list, uint64_t minSize);
+    void DestroyBlock(BlockList& list, Block* block);
+    void FreeRegion(Allocation& allocation);
+    void ReleaseEmptyBlocks(BlockList& list);
+
+    VkDeviceMemory AllocateDeviceMemory(uint64_t size, uint32_t memoryType, const void* pNext);
+    void FreeDeviceMemory(VkDeviceMemory memory, uint64_t size, uint32_t memoryType);
+    uint32_t FindMemoryType(uint32_t typeBits, Usage usage) const;
+    bool IsOverBudget(uint32_t heap, uint64_t extraBytes);
+    void UpdateBudget();
+
+    VkPhysicalDevice    m_PhysicalDevice    = nullptr;
+    VkDevice            m_Device            = nullptr;
+    const VulkanDeviceDispatch* m_Dispatch  = nullptr;
+    const VkAllocationCallbacks* m_Allocator = nullptr;
+    bool                m_DedicatedQueries  = false;    // Vulkan 1.1 get*MemoryRequirements2
+    bool                m_MemoryBudget      = false;
+    uint64_t            m_PreferredBlockSize[32] = {};
+    uint64_t            m_BufferImageGranularity = 1;
+
+    uint32_t            m_MemoryTypeCount   = 0;
+    uint32_t            m_MemoryTypeFlags[32] = {};     // VkMemoryPropertyFlags
+    uint32_t            m_MemoryTypeHeap[32] = {};
+    uint32_t            m_MemoryHeapCount   = 0;
+    uint64_t            m_HeapSize[16]      = {};
+    uint32_t            m_HeapFlags[16]     = {};       // VkMemoryHeapFlags
+
+    // Bytes we hold from the driver per heap, and the driver's view from VK_EXT_memory_budget
+    uint64_t            m_HeapBlockBytes[16] = {};
+    uint64_t            m_HeapBudget[16]    = {};
+    uint64_t            m_HeapUsage[16]     = {};
+    uint64_t            m_HeapBlockBytesAtBudgetQuery[16] = {};
+    uint64_t            m_AllocationsSinceBudgetQuery = 0;
+
+    std::vector<BlockList>                      m_BlockLists;   // 2 per memory type
+    std::vector<Allocation*>                    m_Dedicated;
+    std::vector<std::unique_ptr<LinearPool>>    m_Pools;
+    std::vector<DefragmentationMove>            m_PendingMoves;
+    std::vector<Allocation>                     m_MoveTargets;  // regions reserved for m_PendingMoves
+    uint64_t                                    m_LiveBlocks    = 0;
+    uint64_t                                    m_LiveAllocations = 0;
+
+    std::mutex          m_Mutex;
+    Stats               m_Stats;
+};
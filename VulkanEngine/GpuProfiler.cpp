@@ -0,0 +1,413 @@
+#include "GpuProfiler.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+// Collected by top level scopes when pipeline statistics are enabled. Results come back in
+// bit order, which is also the order of the names below.
+constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+static const char* const s_StatisticNames[GpuProfiler::PIPELINE_STATISTIC_COUNT] =
+{
+    "vertices", "primitives", "vs_invocations", "clip_invocations", "clip_primitives", "fs_invocations", "cs_invocations"
+};
+
+static double Percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+bool GpuProfiler::Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+    uint32_t queueFamily, uint32_t framesInFlight, bool pipelineStatistics, const VkAllocationCallbacks* allocator)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = allocator;
+    m_PipelineStatistics = pipelineStatistics;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Zero valid bits means the queue cannot write timestamps at all
+    uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+    if (validBits == 0)
+    {
+        std::cout << "GPU profiler disabled, queue family " << queueFamily << " does not support timestamps\n";
+        return false;
+    }
+    m_TimestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_NsPerTick = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo timestampInfo{};
+    timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    timestampInfo.queryCount = MAX_SCOPES_PER_FRAME * 2;
+
+    VkQueryPoolCreateInfo statisticsInfo{};
+    statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    statisticsInfo.queryCount = MAX_SCOPES_PER_FRAME;
+    statisticsInfo.pipelineStatistics = PIPELINE_STATISTICS;
+
+    m_Frames.resize(framesInFlight);
+    for (FrameQueries& frame : m_Frames)
+    {
+        if (m_Dispatch->vkCreateQueryPool(m_Device, &timestampInfo, m_Allocator, &frame.timestampPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create timestamp query pool!");
+        }
+        if (m_PipelineStatistics &&
+            m_Dispatch->vkCreateQueryPool(m_Device, &statisticsInfo, m_Allocator, &frame.statisticsPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline statistics query pool!");
+        }
+    }
+
+    return true;
+}
+
+uint32_t GpuProfiler::GetPipelineStatistics() const
+{
+    return IsEnabled() && m_PipelineStatistics ? PIPELINE_STATISTICS : 0;
+}
+
+void GpuProfiler::Destroy()
+{
+    for (FrameQueries& frame : m_Frames)
+    {
+        m_Dispatch->vkDestroyQueryPool(m_Device, frame.timestampPool, m_Allocator);
+        m_Dispatch->vkDestroyQueryPool(m_Device, frame.statisticsPool, m_Allocator);
+    }
+    m_Frames.clear();
+    m_Current = nullptr;
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    FrameQueries& frame = m_Frames[frameIndex];
+    CollectResults(frame);
+
+    // Queries have to be reset before they are written again
+    m_Dispatch->vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, MAX_SCOPES_PER_FRAME * 2);
+    if (frame.statisticsPool != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, MAX_SCOPES_PER_FRAME);
+    }
+
+    frame.scopes.clear();
+    frame.timestampCount = 0;
+    frame.statisticsCount = 0;
+    m_Current = &frame;
+    m_OpenScopes.clear();
+}
+
+void GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, const char* name)
+{
+    if (m_Current == nullptr)
+    {
+        return;
+    }
+
+    // Out of queries, the scope is dropped but still has to be balanced by EndScope
+    if (m_Current->scopes.size() == MAX_SCOPES_PER_FRAME)
+    {
+        m_OpenScopes.push_back(~0u);
+        m_DroppedScopes++;
+        return;
+    }
+
+    RecordedScope scope;
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(m_OpenScopes.size());
+    scope.beginQuery = m_Current->timestampCount++;
+    scope.endQuery = m_Current->timestampCount++;
+
+    m_Dispatch->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_Current->timestampPool, scope.beginQuery);
+
+    if (m_Current->statisticsPool != VK_NULL_HANDLE && scope.depth == 0)
+    {
+        scope.statisticsQuery = static_cast<int32_t>(m_Current->statisticsCount++);
+        m_Dispatch->vkCmdBeginQuery(commandBuffer, m_Current->statisticsPool, scope.statisticsQuery, 0);
+    }
+
+    m_OpenScopes.push_back(static_cast<uint32_t>(m_Current->scopes.size()));
+    m_Current->scopes.push_back(scope);
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer commandBuffer)
+{
+    if (m_Current == nullptr || m_OpenScopes.empty())
+    {
+        return;
+    }
+
+    uint32_t index = m_OpenScopes.back();
+    m_OpenScopes.pop_back();
+    if (index == ~0u)
+    {
+        return;
+    }
+
+    const RecordedScope& scope = m_Current->scopes[index];
+    if (scope.statisticsQuery >= 0)
+    {
+        m_Dispatch->vkCmdEndQuery(commandBuffer, m_Current->statisticsPool, scope.statisticsQuery);
+    }
+
+    // Bottom of pipe is reached once all earlier commands have completed
+    m_Dispatch->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_Current->timestampPool, scope.endQuery);
+}
+
+void GpuProfiler::CollectPending()
+{
+    for (FrameQueries& frame : m_Frames)
+    {
+        CollectResults(frame);
+        frame.scopes.clear();
+        frame.timestampCount = 0;
+        frame.statisticsCount = 0;
+    }
+    m_Current = nullptr;
+}
+
+void GpuProfiler::CollectResults(FrameQueries& frame)
+{
+    if (frame.timestampCount == 0)
+    {
+        return;
+    }
+
+    // The frame's fence was waited on, so the results are there and this does not block
+    std::vector<uint64_t> timestamps(frame.timestampCount);
+    VkResult result = m_Dispatch->vkGetQueryPoolResults(m_Device, frame.timestampPool, 0, frame.timestampCount,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    std::vector<uint64_t> statistics(static_cast<size_t>(frame.statisticsCount) * PIPELINE_STATISTIC_COUNT);
+    bool haveStatistics = frame.statisticsCount > 0 &&
+        m_Dispatch->vkGetQueryPoolResults(m_Device, frame.statisticsPool, 0, frame.statisticsCount,
+            statistics.size() * sizeof(uint64_t), statistics.data(), PIPELINE_STATISTIC_COUNT * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+    for (const RecordedScope& recorded : frame.scopes)
+    {
+        // Masking handles a counter that wrapped between the two writes
+        uint64_t ticks = (timestamps[recorded.endQuery] - timestamps[recorded.beginQuery]) & m_TimestampMask;
+        double ms = ticks * m_NsPerTick / 1e6;
+
+        ScopeStats& scope = FindScope(recorded.name, recorded.depth);
+        AddSample(scope, ms);
+
+        if (haveStatistics && recorded.statisticsQuery >= 0)
+        {
+            const uint64_t* values = &statistics[static_cast<size_t>(recorded.statisticsQuery) * PIPELINE_STATISTIC_COUNT];
+            for (uint32_t i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+            {
+                scope.statistics[i] += values[i];
+            }
+            scope.statisticsCount++;
+        }
+    }
+}
+
+GpuProfiler::ScopeStats& GpuProfiler::FindScope(const char* name, uint32_t depth)
+{
+    auto it = m_ScopeIndex.find(name);
+    if (it != m_ScopeIndex.end())
+    {
+        return m_Scopes[it->second];
+    }
+
+    // The same literal may live at different addresses in different translation units
+    for (size_t i = 0; i < m_Scopes.size(); i++)
+    {
+        if (m_Scopes[i].name == name)
+        {
+            m_ScopeIndex[name] = i;
+            return m_Scopes[i];
+        }
+    }
+
+    m_ScopeIndex[name] = m_Scopes.size();
+    m_Scopes.emplace_back();
+    ScopeStats& scope = m_Scopes.back();
+    scope.name = name;
+    scope.depth = depth;
+    scope.recentMs.reserve(ROLLING_WINDOW);
+    return scope;
+}
+
+void GpuProfiler::AddSample(ScopeStats& scope, double ms)
+{
+    scope.minMs = (scope.count == 0) ? ms : std::min(scope.minMs, ms);
+    scope.maxMs = std::max(scope.maxMs, ms);
+    scope.totalMs += ms;
+
+    if (scope.recentMs.size() < ROLLING_WINDOW)
+    {
+        scope.recentMs.push_back(ms);
+    }
+    else
+    {
+        scope.recentMs[scope.count % ROLLING_WINDOW] = ms;
+    }
+    scope.count++;
+
+    uint32_t bucket = 0;
+    double us = ms * 1000.0;
+    while (bucket + 1 < HISTOGRAM_BUCKETS && us >= static_cast<double>(1ull << bucket))
+    {
+        bucket++;
+    }
+    scope.histogram[bucket]++;
+}
+
+void GpuProfiler::PrintSummary(std::ostream& out) const
+{
+    if (m_Scopes.empty())
+    {
+        return;
+    }
+
+    out << "GPU scopes, percentiles over the last " << ROLLING_WINDOW << " frames:\n";
+    out << std::left << std::setw(32) << "Scope" << std::right << std::setw(8) << "count" << std::setw(10) << "avg ms"
+        << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << '\n';
+
+    out << std::fixed << std::setprecision(3);
+    for (const ScopeStats& scope : m_Scopes)
+    {
+        std::string name = std::string(scope.depth * 2, ' ') + scope.name;
+        out << std::left << std::setw(32) << name << std::right << std::setw(8) << scope.count
+            << std::setw(10) << scope.totalMs / scope.count << std::setw(10) << Percentile(scope.recentMs, 0.50)
+            << std::setw(10) << Percentile(scope.recentMs, 0.95) << std::setw(10) << Percentile(scope.recentMs, 0.99)
+            << std::setw(10) << scope.maxMs << '\n';
+
+        if (scope.statisticsCount > 0)
+        {
+            out << std::setw(34) << "per frame:";
+            for (uint32_t i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+            {
+                out << ' ' << s_StatisticNames[i] << '=' << scope.statistics[i] / scope.statisticsCount;
+            }
+            out << '\n';
+        }
+    }
+    out << std::defaultfloat;
+
+    if (m_DroppedScopes > 0)
+    {
+        out << m_DroppedScopes << " GPU scopes dropped, more than " << MAX_SCOPES_PER_FRAME << " in a frame\n";
+    }
+}
+
+bool GpuProfiler::WriteReport(const std::string& path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    file << std::setprecision(6);
+
+    if (json)
+    {
+        file << "{\"scopes\":[\n";
+        for (size_t s = 0; s < m_Scopes.size(); s++)
+        {
+            const ScopeStats& scope = m_Scopes[s];
+            file << "{\"name\":\"" << scope.name << "\",\"depth\":" << scope.depth << ",\"count\":" << scope.count
+                << ",\"avg_ms\":" << scope.totalMs / scope.count << ",\"min_ms\":" << scope.minMs
+                << ",\"p50_ms\":" << Percentile(scope.recentMs, 0.50) << ",\"p95_ms\":" << Percentile(scope.recentMs, 0.95)
+                << ",\"p99_ms\":" << Percentile(scope.recentMs, 0.99) << ",\"max_ms\":" << scope.maxMs;
+
+            file << ",\"histogram_us\":[";
+            for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            {
+                file << (i > 0 ? "," : "") << scope.histogram[i];
+            }
+            file << "]";
+
+            if (scope.statisticsCount > 0)
+            {
+                file << ",\"pipeline_statistics\":{";
+                for (uint32_t i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+                {
+                    file << (i > 0 ? "," : "") << '"' << s_StatisticNames[i] << "\":" << scope.statistics[i] / scope.statisticsCount;
+                }
+                file << "}";
+            }
+            file << "}" << (s + 1 < m_Scopes.size() ? "," : "") << "\n";
+        }
+        file << "]}\n";
+    }
+    else
+    {
+        // One row per scope; histogram bucket i counts durations below 2^i us
+        file << "name,depth,count,avg_ms,min_ms,p50_ms,p95_ms,p99_ms,max_ms";
+        for (uint32_t i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+        {
+            file << ',' << s_StatisticNames[i];
+        }
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        {
+            file << ",lt_" << (1ull << i) << "us";
+        }
+        file << '\n';
+
+        for (const ScopeStats& scope : m_Scopes)
+        {
+            file << scope.name << ',' << scope.depth << ',' << scope.count << ',' << scope.totalMs / scope.count << ','
+                << scope.minMs << ',' << Percentile(scope.recentMs, 0.50) << ',' << Percentile(scope.recentMs, 0.95) << ','
+                << Percentile(scope.recentMs, 0.99) << ',' << scope.maxMs;
+            for (uint32_t i = 0; i < PIPELINE_STATISTIC_COUNT; i++)
+            {
+                file << ',';
+                if (scope.statisticsCount > 0)
+                {
+                    file << scope.statistics[i] / scope.statisticsCount;
+                }
+            }
+            for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            {
+                file << ',' << scope.histogram[i];
+            }
+            file << '\n';
+        }
+    }
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Profiler.h"
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// GPU timings from timestamp queries.
+//
+// GPU_PROFILE_SCOPE(profiler, commandBuffer, "Name") writes a timestamp at the start and the
+// end of the enclosing scope. Scopes nest. Every frame in flight has its own query pools, and
+// a frame's results are read when its slot comes around again. The frame's fence has been
+// waited on by then, so reading never stalls.
+//
+// Optionally, top level scopes also collect pipeline statistics (vertices, primitives,
+// shader invocations). Queries of one type cannot nest, so nested scopes only get timings.
+// The query stays active while secondaries run, so the device needs inheritedQueries and
+// the secondaries have to inherit GetPipelineStatistics().
+//
+// Scopes are only recorded into primary command buffers, and names must be string literals.
+class GpuProfiler
+{
+public:
+    static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+    static constexpr uint32_t PIPELINE_STATISTIC_COUNT = 7;
+
+    // Log2 buckets in microseconds, bucket i holds durations below 2^i us
+    static constexpr uint32_t HISTOGRAM_BUCKETS = 21;
+
+    // Frames the rolling percentiles are taken over
+    static constexpr uint32_t ROLLING_WINDOW = 240;
+
+    struct ScopeStats
+    {
+        std::string         name;
+        uint32_t            depth           = 0;
+        uint64_t            count           = 0;
+        double              totalMs         = 0.0;
+        double              minMs           = 0.0;
+        double              maxMs           = 0.0;
+        std::vector<double> recentMs;       // ring of the last ROLLING_WINDOW durations
+        uint64_t            histogram[HISTOGRAM_BUCKETS] = {};
+
+        uint64_t            statisticsCount = 0;
+        uint64_t            statistics[PIPELINE_STATISTIC_COUNT] = {};
+    };
+
+    // Returns false, and leaves the profiler disabled, when the queue family has no timestamps
+    bool Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch, uint32_t queueFamily,
+        uint32_t framesInFlight, bool pipelineStatistics, const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    bool IsEnabled() const { return !m_Frames.empty(); }
+
+    // VkQueryPipelineStatisticFlags the top level scopes collect, 0 without pipeline statistics.
+    // Secondary command buffers executed inside such a scope have to inherit them.
+    uint32_t GetPipelineStatistics() const;
+
+    // Collects the results the frame slot holds from its previous use and resets its queries.
+    // Has to be recorded first, outside a render pass, after the slot's fence was waited on.
+    void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Collects the frames still in flight, the device has to be idle
+    void CollectPending();
+
+    void BeginScope(VkCommandBuffer commandBuffer, const char* name);
+    void EndScope(VkCommandBuffer commandBuffer);
+
+    const std::vector<ScopeStats>& GetScopeStats() const { return m_Scopes; }
+    void PrintSummary(std::ostream& out) const;
+
+    // JSON when the path ends in .json, CSV otherwise
+    bool WriteReport(const std::string& path) const;
+
+private:
+    struct RecordedScope
+    {
+        const char* name            = nullptr;
+        uint32_t    depth           = 0;
+        uint32_t    beginQuery      = 0;
+        uint32_t    endQuery        = 0;
+        int32_t     statisticsQuery = -1;
+    };
+
+    struct FrameQueries
+    {
+        VkQueryPool                 timestampPool   = nullptr;
+        VkQueryPool                 statisticsPool  = nullptr;
+        std::vector<RecordedScope>  scopes;
+        uint32_t                    timestampCount  = 0;
+        uint32_t                    statisticsCount = 0;
+    };
+
+    void CollectResults(FrameQueries& frame);
+    ScopeStats& FindScope(const char* name, uint32_t depth);
+    void AddSample(ScopeStats& scope, double ms);
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    const VkAllocationCallbacks*    m_Allocator         = nullptr;
+    double                          m_NsPerTick         = 1.0;
+    uint64_t                        m_TimestampMask     = ~0ull;
+    bool                            m_PipelineStatistics = false;
+
+    std::vector<FrameQueries>       m_Frames;
+    FrameQueries*                   m_Current           = nullptr;
+    std::vector<uint32_t>           m_OpenScopes;       // indices into m_Current->scopes, ~0u when dropped
+    uint64_t                        m_DroppedScopes     = 0;
+
+    std::vector<ScopeStats>         m_Scopes;
+    std::unordered_map<const char*, size_t> m_ScopeIndex;
+};
+
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+        : m_Profiler(profiler)
+        , m_CommandBuffer(commandBuffer)
+    {
+        m_Profiler.BeginScope(m_CommandBuffer, name);
+    }
+
+    ~GpuProfileScope()
+    {
+        m_Profiler.EndScope(m_CommandBuffer);
+    }
+
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    GpuProfiler&    m_Profiler;
+    VkCommandBuffer m_CommandBuffer;
+};
+
+#define GPU_PROFILE_SCOPE(profiler, commandBuffer, name) \
+    GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, commandBuffer, name)
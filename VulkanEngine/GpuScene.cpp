@@ -0,0 +1,1113 @@
+#include "BindlessDescriptors.h"
+#include "FrameRingBuffer.h"
+#include "GpuScene.h"
+#include "MeshFormat.h"
+#include "PipelineCache.h"
+#include "UploadEngine.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// local_size_x of scene_cull.comp
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+// Smallest maxComputeWorkGroupCount[0] the spec allows, caps the objects one dispatch can cull
+constexpr uint32_t MAX_CULL_GROUPS = 65535;
+
+// Bindings in the order of the set layout: storage buffers, then the frame constants
+constexpr uint32_t BINDING_COUNT = 7;
+constexpr uint32_t STORAGE_BINDING_COUNT = 6;
+constexpr uint32_t STATIC_BINDING_COUNT = 4;    // bounds, object meshes, meshes, instances
+constexpr uint32_t CONSTANTS_BINDING = 6;
+
+// Material textures are square RGBA8 patterns generated at startup, each used by two materials
+constexpr uint32_t TEXTURE_SIZE = 64;
+constexpr uint32_t TEXTURE_COUNT = 4;
+constexpr uint32_t MATERIAL_COUNT = 8;
+
+// scene_quantized.vert's push constants follow the fragment shader's, at the offset it declares
+constexpr uint32_t VERTEX_CONSTANTS_OFFSET = 16;
+
+namespace
+{
+    // Mesh in scene_cull.comp
+    struct MeshInfo
+    {
+        uint32_t    indexCount      = 0;
+        uint32_t    firstIndex      = 0;
+        int32_t     vertexOffset    = 0;
+        uint32_t    padding         = 0;
+    };
+
+    // Instance in scene.vert
+    struct Instance
+    {
+        float       transform[16];
+        float       color[4];
+        uint32_t    material;
+        uint32_t    padding[3];
+    };
+
+    // Material in scene.frag, the texture and sampler are bindless indices
+    struct Material
+    {
+        uint32_t    texture;
+        uint32_t    sampler;
+        float       uvScale;
+        uint32_t    padding;
+    };
+
+    // Push constants of scene.frag
+    struct DrawConstants
+    {
+        uint32_t    materialBuffer;     // bindless index of the material table
+    };
+
+    // Push constants of scene_quantized.vert, the bounds of the quantized positions
+    struct VertexConstants
+    {
+        float       boundsMin[4];
+        float       boundsExtent[4];
+    };
+
+    // Frame constants of scene_cull.comp and scene.vert, a dynamic uniform buffer in std140 layout
+    struct FrameConstants
+    {
+        float       viewProjection[16];
+        float       planes[6][4];
+        uint32_t    objectCount;
+        uint32_t    padding[3];
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t Hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Repeatable value in [0, 1) per object and channel
+    float Random(uint32_t object, uint32_t channel)
+    {
+        return static_cast<float>(Hash(object * 8 + channel) >> 8) / 16777216.0f;
+    }
+
+    // Two triangles facing normal, counter-clockwise seen from outside. u x v has to be normal.
+    void AddQuad(std::vector<FloatVertex>& vertices, std::vector<uint32_t>& indices, uint32_t firstVertex,
+        const glm::vec3& normal, const glm::vec3& u, const glm::vec3& v)
+    {
+        uint32_t base = static_cast<uint32_t>(vertices.size()) - firstVertex;
+        const glm::vec3 corners[4] = { normal - u - v, normal + u - v, normal + u + v, normal - u + v };
+        for (const glm::vec3& corner : corners)
+        {
+            vertices.push_back({ { corner.x * 0.5f, corner.y * 0.5f, corner.z * 0.5f }, { normal.x, normal.y, normal.z } });
+        }
+        const uint32_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (uint32_t index : quad)
+        {
+            indices.push_back(base + index);
+        }
+    }
+
+    void AddTriangle(std::vector<FloatVertex>& vertices, std::vector<uint32_t>& indices, uint32_t firstVertex,
+        const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        uint32_t base = static_cast<uint32_t>(vertices.size()) - firstVertex;
+        glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+        for (const glm::vec3& corner : { a, b, c })
+        {
+            vertices.push_back({ { corner.x, corner.y, corner.z }, { normal.x, normal.y, normal.z } });
+        }
+        indices.push_back(base);
+        indices.push_back(base + 1);
+        indices.push_back(base + 2);
+    }
+}
+
+void GpuScene::Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator,
+    FrameRingBuffer& frameRing, BindlessDescriptors& bindless, PipelineCache& pipelineCache, VkRenderPass renderPass,
+    const std::string& shaderDirectory, uint32_t objectCount, uint32_t framesInFlight, DrawPath drawPath,
+    VertexFormat vertexFormat, uint32_t maxDrawCount, uint64_t storageAlignment, const VkAllocationCallbacks* callbacks)
+{
+    if (objectCount == 0 || (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE > MAX_CULL_GROUPS)
+    {
+        throw std::runtime_error("Unsupported number of scene objects!");
+    }
+    if (GetVertexStride(vertexFormat) == 0)
+    {
+        throw std::runtime_error("Unsupported scene vertex format!");
+    }
+
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = &allocator;
+    m_FrameRing = &frameRing;
+    m_Bindless = &bindless;
+    m_PipelineCache = &pipelineCache;
+    m_Callbacks = callbacks;
+    m_ObjectCount = objectCount;
+    m_DrawPath = drawPath;
+    m_VertexFormat = vertexFormat;
+    m_MaxDrawCount = std::max(maxDrawCount, 1u);
+    m_FrameSets.resize(framesInFlight);
+    m_Stats = Stats{};
+
+    BuildScene(std::max<uint64_t>(storageAlignment, 16));
+    BuildTextures();
+    CreateBuffer();
+    CreateTextures();
+    RegisterBindless();
+    CreateDescriptors();
+    CreatePipelines(renderPass, shaderDirectory);
+}
+
+void GpuScene::Destroy()
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    if (m_CullPipeline != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyPipeline(m_Device, m_CullPipeline, m_Callbacks);
+    }
+    if (m_DrawPipeline != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyPipeline(m_Device, m_DrawPipeline, m_Callbacks);
+    }
+    if (m_PipelineLayout != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyPipelineLayout(m_Device, m_PipelineLayout, m_Callbacks);
+    }
+
+    // Frees the sets as well
+    if (m_DescriptorPool != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyDescriptorPool(m_Device, m_DescriptorPool, m_Callbacks);
+    }
+    if (m_SetLayout != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyDescriptorSetLayout(m_Device, m_SetLayout, m_Callbacks);
+    }
+
+    // The device is idle, the slots can be handed out again right away
+    if (m_Registered)
+    {
+        m_Bindless->Release(BindlessDescriptors::Kind::StorageBuffer, m_MaterialIndex);
+        for (const Texture& texture : m_Textures)
+        {
+            m_Bindless->Release(BindlessDescriptors::Kind::SampledImage, texture.index);
+        }
+        m_Bindless->Release(BindlessDescriptors::Kind::Sampler, m_SamplerIndex);
+        m_Registered = false;
+    }
+
+    for (const Texture& texture : m_Textures)
+    {
+        if (texture.view != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyImageView(m_Device, texture.view, m_Callbacks);
+        }
+        if (texture.image != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyImage(m_Device, texture.image, m_Callbacks);
+        }
+        if (texture.allocation != nullptr)
+        {
+            m_Allocator->Free(texture.allocation);
+        }
+    }
+    if (m_Sampler != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroySampler(m_Device, m_Sampler, m_Callbacks);
+    }
+
+    if (m_Buffer != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyBuffer(m_Device, m_Buffer, m_Callbacks);
+    }
+    if (m_Allocation != nullptr)
+    {
+        m_Allocator->Free(m_Allocation);
+    }
+
+    m_CullPipeline = VK_NULL_HANDLE;
+    m_DrawPipeline = VK_NULL_HANDLE;
+    m_PipelineLayout = VK_NULL_HANDLE;
+    m_DescriptorPool = VK_NULL_HANDLE;
+    m_SetLayout = VK_NULL_HANDLE;
+    m_Buffer = VK_NULL_HANDLE;
+    m_Allocation = nullptr;
+    m_Textures.clear();
+    m_Sampler = VK_NULL_HANDLE;
+    m_FrameSets.clear();
+    m_Data.clear();
+    m_TextureData.clear();
+    m_Device = nullptr;
+}
+
+// Objects are scattered through a cube that grows with their number, so the density and
+// with it the fraction the camera sees stays about the same. Every other object is a cube,
+// the rest are octahedrons.
+void GpuScene::BuildScene(uint64_t storageAlignment)
+{
+    std::vector<FloatVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshInfo> meshes;
+    std::vector<float> meshRadii;
+
+    auto beginMesh = [&]()
+    {
+        MeshInfo mesh;
+        mesh.firstIndex = static_cast<uint32_t>(indices.size());
+        mesh.vertexOffset = static_cast<int32_t>(vertices.size());
+        meshes.push_back(mesh);
+        return static_cast<uint32_t>(vertices.size());
+    };
+    auto endMesh = [&](float radius)
+    {
+        meshes.back().indexCount = static_cast<uint32_t>(indices.size()) - meshes.back().firstIndex;
+        meshRadii.push_back(radius);
+    };
+
+    const glm::vec3 x(1.0f, 0.0f, 0.0f);
+    const glm::vec3 y(0.0f, 1.0f, 0.0f);
+    const glm::vec3 z(0.0f, 0.0f, 1.0f);
+
+    // Unit cube with a vertex per face corner, so every face gets its own normal
+    uint32_t firstVertex = beginMesh();
+    AddQuad(vertices, indices, firstVertex, x, y, z);
+    AddQuad(vertices, indices, firstVertex, -x, z, y);
+    AddQuad(vertices, indices, firstVertex, y, z, x);
+    AddQuad(vertices, indices, firstVertex, -y, x, z);
+    AddQuad(vertices, indices, firstVertex, z, x, y);
+    AddQuad(vertices, indices, firstVertex, -z, y, x);
+    endMesh(std::sqrt(3.0f) * 0.5f);
+
+    // Octahedron with its corners on the axes, one face per octant
+    firstVertex = beginMesh();
+    for (uint32_t octant = 0; octant < 8; octant++)
+    {
+        glm::vec3 a = x * ((octant & 1) ? -0.5f : 0.5f);
+        glm::vec3 b = y * ((octant & 2) ? -0.5f : 0.5f);
+        glm::vec3 c = z * ((octant & 4) ? -0.5f : 0.5f);
+
+        // An odd number of mirrored axes flips the winding
+        bool mirrored = (((octant & 1) != 0) != ((octant & 2) != 0)) != ((octant & 4) != 0);
+        if (mirrored)
+        {
+            std::swap(b, c);
+        }
+        AddTriangle(vertices, indices, firstVertex, a, b, c);
+    }
+    endMesh(0.5f);
+
+    m_MeshCount = static_cast<uint32_t>(meshes.size());
+    m_SceneExtent = 2.0f * std::cbrt(static_cast<float>(m_ObjectCount));
+
+    std::vector<glm::vec4> bounds(m_ObjectCount);
+    std::vector<uint32_t> objectMeshes(m_ObjectCount);
+    std::vector<Instance> instances(m_ObjectCount);
+    for (uint32_t i = 0; i < m_ObjectCount; i++)
+    {
+        uint32_t mesh = i % m_MeshCount;
+        float scale = 0.5f + 0.5f * Random(i, 0);
+        glm::vec3 position = (glm::vec3(Random(i, 1), Random(i, 2), Random(i, 3)) * 2.0f - 1.0f) * m_SceneExtent;
+        float angle = Random(i, 4) * 6.2831853f;
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f), position)
+            * glm::rotate(glm::mat4(1.0f), angle, glm::normalize(glm::vec3(0.3f, 1.0f, 0.2f)))
+            * glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+
+        bounds[i] = glm::vec4(position, meshRadii[mesh] * scale);
+        objectMeshes[i] = mesh;
+        std::memcpy(instances[i].transform, glm::value_ptr(transform), sizeof(instances[i].transform));
+
+        // Cheap integer hash so neighbouring objects differ in color
+        uint32_t hash = (i + 1) * 2654435761u;
+        instances[i].color[0] = static_cast<float>(hash & 0xFF) / 255.0f;
+        instances[i].color[1] = static_cast<float>((hash >> 8) & 0xFF) / 255.0f;
+        instances[i].color[2] = static_cast<float>((hash >> 16) & 0xFF) / 255.0f;
+        instances[i].color[3] = 1.0f;
+        instances[i].material = Hash(i * 8 + 5) % MATERIAL_COUNT;
+    }
+
+    // Quantized positions are fractions of bounds around every mesh, so one push constant covers
+    // the draw of all objects
+    std::vector<QuantizedVertex> quantized;
+    if (m_VertexFormat == VertexFormat::Quantized)
+    {
+        glm::vec3 lower = glm::make_vec3(vertices[0].position);
+        glm::vec3 upper = lower;
+        for (const FloatVertex& vertex : vertices)
+        {
+            lower = glm::min(lower, glm::make_vec3(vertex.position));
+            upper = glm::max(upper, glm::make_vec3(vertex.position));
+        }
+        const glm::vec3 extent = upper - lower;
+        std::memcpy(m_PositionMin, glm::value_ptr(lower), sizeof(m_PositionMin));
+        std::memcpy(m_PositionExtent, glm::value_ptr(extent), sizeof(m_PositionExtent));
+
+        quantized.reserve(vertices.size());
+        for (const FloatVertex& vertex : vertices)
+        {
+            // The texture coordinates scene.vert projects from the normal axis. Nothing samples a
+            // normal map, any tangent will do.
+            const glm::vec3 position = glm::make_vec3(vertex.position);
+            const glm::vec3 normal = glm::make_vec3(vertex.normal);
+            const glm::vec3 axis = glm::abs(normal);
+            const glm::vec2 uv = (axis.x >= axis.y && axis.x >= axis.z ? glm::vec2(position.y, position.z)
+                : axis.y >= axis.z ? glm::vec2(position.x, position.z) : glm::vec2(position.x, position.y)) + 0.5f;
+            const glm::vec3 tangent = glm::normalize(glm::cross(axis.x < 0.9f ? x : y, normal));
+            const float tangentAndSign[4] = { tangent.x, tangent.y, tangent.z, 1.0f };
+            quantized.push_back(QuantizeVertex(vertex.position, vertex.normal, tangentAndSign, glm::value_ptr(uv),
+                m_PositionMin, m_PositionExtent));
+        }
+    }
+
+    // Vertices and indices first, each storage section starts on the device's offset alignment
+    const uint64_t objects = m_ObjectCount;
+    m_IndexOffset = vertices.size() * GetVertexStride(m_VertexFormat);
+    m_BoundsOffset = AlignUp(m_IndexOffset + indices.size() * sizeof(uint32_t), storageAlignment);
+    m_ObjectMeshOffset = AlignUp(m_BoundsOffset + objects * sizeof(glm::vec4), storageAlignment);
+    m_MeshOffset = AlignUp(m_ObjectMeshOffset + objects * sizeof(uint32_t), storageAlignment);
+    m_InstanceOffset = AlignUp(m_MeshOffset + meshes.size() * sizeof(MeshInfo), storageAlignment);
+    m_MaterialOffset = AlignUp(m_InstanceOffset + objects * sizeof(Instance), storageAlignment);
+
+    // The material table is filled in once its textures have bindless indices
+    m_Data.assign(static_cast<size_t>(m_MaterialOffset + MATERIAL_COUNT * sizeof(Material)), 0);
+    if (m_VertexFormat == VertexFormat::Quantized)
+    {
+        std::memcpy(m_Data.data(), quantized.data(), static_cast<size_t>(m_IndexOffset));
+    }
+    else
+    {
+        std::memcpy(m_Data.data(), vertices.data(), static_cast<size_t>(m_IndexOffset));
+    }
+    std::memcpy(m_Data.data() + m_IndexOffset, indices.data(), indices.size() * sizeof(uint32_t));
+    std::memcpy(m_Data.data() + m_BoundsOffset, bounds.data(), bounds.size() * sizeof(glm::vec4));
+    std::memcpy(m_Data.data() + m_ObjectMeshOffset, objectMeshes.data(), objectMeshes.size() * sizeof(uint32_t));
+    std::memcpy(m_Data.data() + m_MeshOffset, meshes.data(), meshes.size() * sizeof(MeshInfo));
+    std::memcpy(m_Data.data() + m_InstanceOffset, instances.data(), instances.size() * sizeof(Instance));
+}
+
+// Grey patterns, the instance color tints them: checkers, diagonal stripes, dots and a grid
+void GpuScene::BuildTextures()
+{
+    m_TextureData.resize(static_cast<size_t>(TEXTURE_COUNT) * TEXTURE_SIZE * TEXTURE_SIZE);
+    uint32_t* texel = m_TextureData.data();
+    for (uint32_t texture = 0; texture < TEXTURE_COUNT; texture++)
+    {
+        for (uint32_t y = 0; y < TEXTURE_SIZE; y++)
+        {
+            for (uint32_t x = 0; x < TEXTURE_SIZE; x++)
+            {
+                bool dark = false;
+                switch (texture)
+                {
+                case 0: dark = ((x / 8 + y / 8) & 1) != 0; break;
+                case 1: dark = (((x + y) / 6) & 1) != 0; break;
+                case 2:
+                {
+                    int dx = static_cast<int>(x % 16) - 8;
+                    int dy = static_cast<int>(y % 16) - 8;
+                    dark = dx * dx + dy * dy < 25;
+                    break;
+                }
+                default: dark = x % 16 < 2 || y % 16 < 2; break;
+                }
+
+                uint32_t grey = dark ? 110 : 255;
+                *texel++ = 0xFF000000u | (grey << 16) | (grey << 8) | grey;
+            }
+        }
+    }
+}
+
+void GpuScene::CreateBuffer()
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_Data.size();
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &m_Buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create scene buffer!");
+    }
+
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+    m_Allocation = m_Allocator->AllocateForBuffer(m_Buffer, allocInfo);
+}
+
+void GpuScene::CreateTextures()
+{
+    m_Textures.resize(TEXTURE_COUNT);
+    for (Texture& texture : m_Textures)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageInfo.extent = { TEXTURE_SIZE, TEXTURE_SIZE, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (m_Dispatch->vkCreateImage(m_Device, &imageInfo, m_Callbacks, &texture.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create scene texture!");
+        }
+
+        GpuAllocator::AllocationCreateInfo allocInfo{};
+        allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+        texture.allocation = m_Allocator->AllocateForImage(texture.image, allocInfo);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = texture.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (m_Dispatch->vkCreateImageView(m_Device, &viewInfo, m_Callbacks, &texture.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create scene texture view!");
+        }
+    }
+
+    // The patterns tile across the faces
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    if (m_Dispatch->vkCreateSampler(m_Device, &samplerInfo, m_Callbacks, &m_Sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create scene sampler!");
+    }
+}
+
+// The descriptors are written by the bindless table's next BeginFrame, before the scene is
+// first drawn. Materials store the indices, so the table is filled in here.
+void GpuScene::RegisterBindless()
+{
+    m_SamplerIndex = m_Bindless->AddSampler(m_Sampler);
+    for (Texture& texture : m_Textures)
+    {
+        texture.index = m_Bindless->AddSampledImage(texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    m_MaterialIndex = m_Bindless->AddStorageBuffer(m_Buffer, m_MaterialOffset, MATERIAL_COUNT * sizeof(Material));
+    m_Registered = true;
+
+    Material materials[MATERIAL_COUNT]{};
+    for (uint32_t i = 0; i < MATERIAL_COUNT; i++)
+    {
+        materials[i].texture = m_Textures[i % TEXTURE_COUNT].index;
+        materials[i].sampler = m_SamplerIndex;
+        materials[i].uvScale = i < TEXTURE_COUNT ? 1.0f : 3.0f;
+    }
+    std::memcpy(m_Data.data() + m_MaterialOffset, materials, sizeof(materials));
+}
+
+// One set per frame in flight. The static bindings are written here, the command and count
+// buffers and the frame ring when a frame first records with them.
+void GpuScene::CreateDescriptors()
+{
+    VkDescriptorSetLayoutBinding bindings[BINDING_COUNT]{};
+    for (uint32_t binding = 0; binding < BINDING_COUNT; binding++)
+    {
+        bindings[binding].binding = binding;
+        bindings[binding].descriptorType = binding == CONSTANTS_BINDING
+            ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[binding].descriptorCount = 1;
+        bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = BINDING_COUNT;
+    layoutInfo.pBindings = bindings;
+
+    if (m_Dispatch->vkCreateDescriptorSetLayout(m_Device, &layoutInfo, m_Callbacks, &m_SetLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create scene descriptor set layout!");
+    }
+
+    const uint32_t frames = static_cast<uint32_t>(m_FrameSets.size());
+
+    VkDescriptorPoolSize poolSizes[2]{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = STORAGE_BINDING_COUNT * frames;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = frames;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = frames;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+
+    if (m_Dispatch->vkCreateDescriptorPool(m_Device, &poolInfo, m_Callbacks, &m_DescriptorPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create scene descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frames, m_SetLayout);
+    std::vector<VkDescriptorSet> sets(frames);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_DescriptorPool;
+    allocInfo.descriptorSetCount = frames;
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (m_Dispatch->vkAllocateDescriptorSets(m_Device, &allocInfo, sets.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate scene descriptor sets!");
+    }
+
+    const uint64_t objects = m_ObjectCount;
+    const VkDescriptorBufferInfo bufferInfos[STATIC_BINDING_COUNT] =
+    {
+        { m_Buffer, m_BoundsOffset, objects * sizeof(glm::vec4) },
+        { m_Buffer, m_ObjectMeshOffset, objects * sizeof(uint32_t) },
+        { m_Buffer, m_MeshOffset, m_MeshCount * sizeof(MeshInfo) },
+        { m_Buffer, m_InstanceOffset, objects * sizeof(Instance) },
+    };
+
+    std::vector<VkWriteDescriptorSet> writes;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        m_FrameSets[frame].set = sets[frame];
+        for (uint32_t binding = 0; binding < STATIC_BINDING_COUNT; binding++)
+        {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = sets[frame];
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.pBufferInfo = &bufferInfos[binding];
+            writes.push_back(write);
+        }
+    }
+    m_Dispatch->vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void GpuScene::CreatePipelines(VkRenderPass renderPass, const std::string& shaderDirectory)
+{
+    // Cull and draw share the scene's set, the frame constants come from the dynamic uniform
+    // binding. The draw also reads the bindless set and names the material table in a push constant,
+    // quantized vertices add the position bounds for the vertex shader.
+    const VkDescriptorSetLayout setLayouts[2] = { m_SetLayout, m_Bindless->GetSetLayout() };
+    const bool quantized = m_VertexFormat == VertexFormat::Quantized;
+
+    static_assert(sizeof(DrawConstants) <= VERTEX_CONSTANTS_OFFSET, "Push constant ranges overlap");
+    VkPushConstantRange pushConstantRanges[2]{};
+    pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRanges[0].offset = 0;
+    pushConstantRanges[0].size = sizeof(DrawConstants);
+    pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRanges[1].offset = VERTEX_CONSTANTS_OFFSET;
+    pushConstantRanges[1].size = sizeof(VertexConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 2;
+    layoutInfo.pSetLayouts = setLayouts;
+    layoutInfo.pushConstantRangeCount = quantized ? 2 : 1;
+    layoutInfo.pPushConstantRanges = pushConstantRanges;
+
+    if (m_Dispatch->vkCreatePipelineLayout(m_Device, &layoutInfo, m_Callbacks, &m_PipelineLayout) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create scene pipeline layout!");
+    }
+
+    VkShaderModule modules[3] = {};
+    try
+    {
+        modules[0] = CreateShaderModule(shaderDirectory + "/scene_cull.comp.spv");
+        modules[1] = CreateShaderModule(shaderDirectory + (quantized ? "/scene_quantized.vert.spv" : "/scene.vert.spv"));
+        modules[2] = CreateShaderModule(shaderDirectory + "/scene.frag.spv");
+
+        // Compaction is only worth its atomic when the GPU also supplies the draw count
+        VkBool32 compact = m_DrawPath == DrawPath::IndirectCount ? VK_TRUE : VK_FALSE;
+        VkSpecializationMapEntry compactEntry{};
+        compactEntry.constantID = 0;
+        compactEntry.offset = 0;
+        compactEntry.size = sizeof(compact);
+
+        VkSpecializationInfo specialization{};
+        specialization.mapEntryCount = 1;
+        specialization.pMapEntries = &compactEntry;
+        specialization.dataSize = sizeof(compact);
+        specialization.pData = &compact;
+
+        VkComputePipelineCreateInfo computeInfo{};
+        computeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computeInfo.stage.module = modules[0];
+        computeInfo.stage.pName = "main";
+        computeInfo.stage.pSpecializationInfo = &specialization;
+        computeInfo.layout = m_PipelineLayout;
+        m_PipelineCache->CreateComputePipelines(1, &computeInfo, &m_CullPipeline);
+
+        // The fragment shader declares the bindless arrays with the table's sizes
+        const uint32_t capacities[3] =
+        {
+            m_Bindless->GetCapacity(BindlessDescriptors::Kind::SampledImage),
+            m_Bindless->GetCapacity(BindlessDescriptors::Kind::Sampler),
+            m_Bindless->GetCapacity(BindlessDescriptors::Kind::StorageBuffer),
+        };
+        VkSpecializationMapEntry capacityEntries[3]{};
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            capacityEntries[i].constantID = i;
+            capacityEntries[i].offset = i * sizeof(uint32_t);
+            capacityEntries[i].size = sizeof(uint32_t);
+        }
+
+        VkSpecializationInfo fragmentSpecialization{};
+        fragmentSpecialization.mapEntryCount = 3;
+        fragmentSpecialization.pMapEntries = capacityEntries;
+        fragmentSpecialization.dataSize = sizeof(capacities);
+        fragmentSpecialization.pData = capacities;
+
+        VkPipelineShaderStageCreateInfo stages[2]{};
+        stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stages[0].module = modules[1];
+        stages[0].pName = "main";
+        stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stages[1].module = modules[2];
+        stages[1].pName = "main";
+        stages[1].pSpecializationInfo = &fragmentSpecialization;
+
+        VkVertexInputBindingDescription vertexBinding{};
+        vertexBinding.binding = 0;
+        vertexBinding.stride = GetVertexStride(m_VertexFormat);
+        vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        // Quantized attributes are decoded by the input assembler as far as the formats go, the
+        // tangent is left out since nothing samples a normal map
+        VkVertexInputAttributeDescription vertexAttributes[3]{};
+        uint32_t attributeCount = 0;
+        if (quantized)
+        {
+            vertexAttributes[0].location = 0;
+            vertexAttributes[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+            vertexAttributes[0].offset = offsetof(QuantizedVertex, position);
+            vertexAttributes[1].location = 1;
+            vertexAttributes[1].format = VK_FORMAT_R16G16_SNORM;
+            vertexAttributes[1].offset = offsetof(QuantizedVertex, normal);
+            vertexAttributes[2].location = 2;
+            vertexAttributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+            vertexAttributes[2].offset = offsetof(QuantizedVertex, uv);
+            attributeCount = 3;
+        }
+        else
+        {
+            vertexAttributes[0].location = 0;
+            vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+            vertexAttributes[0].offset = offsetof(FloatVertex, position);
+            vertexAttributes[1].location = 1;
+            vertexAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+            vertexAttributes[1].offset = offsetof(FloatVertex, normal);
+            attributeCount = 2;
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = 1;
+        vertexInput.pVertexBindingDescriptions = &vertexBinding;
+        vertexInput.vertexAttributeDescriptionCount = attributeCount;
+        vertexInput.pVertexAttributeDescriptions = vertexAttributes;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        // Viewport and scissor follow the target, which changes with the swapchain
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        // The projection flips Y, which turns counter-clockwise faces in the model into
+        // counter-clockwise faces in the framebuffer
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+            | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        const VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = m_PipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        m_PipelineCache->CreateGraphicsPipelines(1, &pipelineInfo, &m_DrawPipeline);
+    }
+    catch (...)
+    {
+        for (VkShaderModule module : modules)
+        {
+            if (module != VK_NULL_HANDLE)
+            {
+                m_Dispatch->vkDestroyShaderModule(m_Device, module, m_Callbacks);
+            }
+        }
+        throw;
+    }
+
+    // The pipelines keep what they need
+    for (VkShaderModule module : modules)
+    {
+        m_Dispatch->vkDestroyShaderModule(m_Device, module, m_Callbacks);
+    }
+}
+
+VkShaderModule GpuScene::CreateShaderModule(const std::string& path) const
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open shader " + path + "!");
+    }
+
+    // SPIR-V is a stream of 32-bit words, the vector keeps the code aligned for them
+    size_t size = static_cast<size_t>(file.tellg());
+    if (size == 0 || size % sizeof(uint32_t) != 0)
+    {
+        throw std::runtime_error("Invalid SPIR-V in " + path + "!");
+    }
+    std::vector<uint32_t> code(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(size));
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = size;
+    createInfo.pCode = code.data();
+
+    VkShaderModule module;
+    if (m_Dispatch->vkCreateShaderModule(m_Device, &createInfo, m_Callbacks, &module) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create shader module from " + path + "!");
+    }
+    return module;
+}
+
+void GpuScene::Upload(UploadEngine& uploads)
+{
+    // Read as vertices and indices, by the vertex shader and by the cull shader
+    uploads.UploadBuffer(m_Buffer, 0, m_Data.data(), m_Data.size(),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    // Sampled by the fragment shader only
+    const uint64_t textureSize = static_cast<uint64_t>(TEXTURE_SIZE) * TEXTURE_SIZE * sizeof(uint32_t);
+    for (uint32_t i = 0; i < TEXTURE_COUNT; i++)
+    {
+        uploads.UploadImage(m_Textures[i].image, TEXTURE_SIZE, TEXTURE_SIZE, m_TextureData.data() + i * TEXTURE_SIZE * TEXTURE_SIZE,
+            textureSize, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // The staging ring has its own copy now
+    m_Data.clear();
+    m_Data.shrink_to_fit();
+    m_TextureData.clear();
+    m_TextureData.shrink_to_fit();
+}
+
+// Looks around from the middle of the scene, turning slowly about the vertical axis
+void GpuScene::UpdateCamera(float seconds, float aspect)
+{
+    float yaw = seconds * 0.3f;
+    glm::vec3 forward(std::cos(yaw), -0.2f, std::sin(yaw));
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), forward, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // Far enough to reach the corners of the scene
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), aspect, 0.1f, m_SceneExtent * 2.0f);
+    projection[1][1] *= -1.0f;
+
+    glm::mat4 viewProjection = projection * view;
+    std::memcpy(m_ViewProjection, glm::value_ptr(viewProjection), sizeof(m_ViewProjection));
+
+    // The frustum planes are sums of the rows of the matrix (Gribb and Hartmann), with depth
+    // in [0, 1] the near plane is the third row alone. Normalized so the distance to a
+    // sphere's center can be compared with its radius.
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+    {
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+    const glm::vec4 planes[6] =
+    {
+        rows[3] + rows[0], rows[3] - rows[0],   // left, right
+        rows[3] + rows[1], rows[3] - rows[1],   // the two y planes, swapped by the flip
+        rows[2], rows[3] - rows[2]              // near, far
+    };
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec4 plane = planes[i] / glm::length(glm::vec3(planes[i]));
+        std::memcpy(m_FrustumPlanes[i], glm::value_ptr(plane), sizeof(m_FrustumPlanes[i]));
+    }
+}
+
+void GpuScene::RecordClearCount(VkCommandBuffer commandBuffer, VkBuffer drawCount)
+{
+    m_Dispatch->vkCmdFillBuffer(commandBuffer, drawCount, 0, sizeof(uint32_t), 0);
+}
+
+void GpuScene::RecordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Written once per frame, the draw reads the same constants
+    FrameConstants constants{};
+    std::memcpy(constants.viewProjection, m_ViewProjection, sizeof(constants.viewProjection));
+    std::memcpy(constants.planes, m_FrustumPlanes, sizeof(constants.planes));
+    constants.objectCount = m_ObjectCount;
+
+    FrameRingBuffer::Allocation allocation = m_FrameRing->Push(constants);
+    FrameSet& frame = m_FrameSets[frameIndex];
+    frame.constantsValid = allocation.data != nullptr;
+    if (!frame.constantsValid)
+    {
+        // The ring grows at the next frame; until then nothing is culled or drawn
+        m_Stats.skippedFrames++;
+        return;
+    }
+    frame.constantsOffset = allocation.offset;
+
+    BindFrameBuffers(frameIndex, commands, drawCount);
+
+    m_Dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+    m_Dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1,
+        &frame.set, 1, &frame.constantsOffset);
+    m_Dispatch->vkCmdDispatch(commandBuffer, (m_ObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    m_Stats.recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GpuScene::RecordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount,
+    uint32_t width, uint32_t height)
+{
+    FrameSet& frame = m_FrameSets[frameIndex];
+    if (!frame.constantsValid)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    BindFrameBuffers(frameIndex, commands, drawCount);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(width);
+    viewport.height = static_cast<float>(height);
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.extent = { width, height };
+
+    m_Dispatch->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_DrawPipeline);
+    m_Dispatch->vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    m_Dispatch->vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Both sets and the material table stay bound for every object the draw covers
+    const VkDescriptorSet sets[2] = { frame.set, m_Bindless->GetSet(frameIndex) };
+    m_Dispatch->vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 2,
+        sets, 1, &frame.constantsOffset);
+
+    DrawConstants drawConstants{};
+    drawConstants.materialBuffer = m_MaterialIndex;
+    m_Dispatch->vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+        sizeof(drawConstants), &drawConstants);
+    if (m_VertexFormat == VertexFormat::Quantized)
+    {
+        VertexConstants vertexConstants{};
+        std::memcpy(vertexConstants.boundsMin, m_PositionMin, sizeof(m_PositionMin));
+        std::memcpy(vertexConstants.boundsExtent, m_PositionExtent, sizeof(m_PositionExtent));
+        m_Dispatch->vkCmdPushConstants(commandBuffer, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, VERTEX_CONSTANTS_OFFSET,
+            sizeof(vertexConstants), &vertexConstants);
+    }
+
+    VkDeviceSize vertexOffset = 0;
+    m_Dispatch->vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_Buffer, &vertexOffset);
+    m_Dispatch->vkCmdBindIndexBuffer(commandBuffer, m_Buffer, m_IndexOffset, VK_INDEX_TYPE_UINT32);
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    switch (m_DrawPath)
+    {
+    case DrawPath::IndirectCount:
+    {
+        // Core in 1.2, VK_KHR_draw_indirect_count before
+        PFN_vkCmdDrawIndexedIndirectCount drawIndexedIndirectCount = m_Dispatch->vkCmdDrawIndexedIndirectCountKHR != nullptr
+            ? m_Dispatch->vkCmdDrawIndexedIndirectCountKHR : m_Dispatch->vkCmdDrawIndexedIndirectCount;
+        drawIndexedIndirectCount(commandBuffer, commands, 0, drawCount, 0, m_ObjectCount, stride);
+        m_Stats.drawCalls++;
+        break;
+    }
+    case DrawPath::MultiDrawIndirect:
+        for (uint32_t first = 0; first < m_ObjectCount; first += m_MaxDrawCount)
+        {
+            uint32_t count = std::min(m_ObjectCount - first, m_MaxDrawCount);
+            m_Dispatch->vkCmdDrawIndexedIndirect(commandBuffer, commands, static_cast<VkDeviceSize>(first) * stride, count, stride);
+            m_Stats.drawCalls++;
+        }
+        break;
+    case DrawPath::SingleDrawIndirect:
+        for (uint32_t object = 0; object < m_ObjectCount; object++)
+        {
+            m_Dispatch->vkCmdDrawIndexedIndirect(commandBuffer, commands, static_cast<VkDeviceSize>(object) * stride, 1, stride);
+        }
+        m_Stats.drawCalls += m_ObjectCount;
+        break;
+    }
+
+    m_Stats.frames++;
+    m_Stats.recordMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The previous submission of the frame has finished, so its set can be rewritten. The frame
+// ring only changes when it grows.
+void GpuScene::BindFrameBuffers(uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount)
+{
+    FrameSet& frame = m_FrameSets[frameIndex];
+    VkBuffer constants = m_FrameRing->GetBuffer();
+    if (frame.commands == commands && frame.drawCount == drawCount && frame.constants == constants)
+    {
+        return;
+    }
+
+    const VkDescriptorBufferInfo bufferInfos[3] =
+    {
+        { commands, 0, GetCommandBufferSize() },
+        { drawCount, 0, sizeof(uint32_t) },
+        { constants, 0, sizeof(FrameConstants) },
+    };
+
+    VkWriteDescriptorSet writes[3]{};
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = frame.set;
+        writes[i].dstBinding = STATIC_BINDING_COUNT + i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = (STATIC_BINDING_COUNT + i == CONSTANTS_BINDING)
+            ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    m_Dispatch->vkUpdateDescriptorSets(m_Device, 3, writes, 0, nullptr);
+
+    frame.commands = commands;
+    frame.drawCount = drawCount;
+    frame.constants = constants;
+    m_Stats.descriptorUpdates++;
+}
+
+uint64_t GpuScene::GetCommandBufferSize() const
+{
+    return static_cast<uint64_t>(m_ObjectCount) * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+const char* GpuScene::GetDrawPathName(DrawPath path)
+{
+    switch (path)
+    {
+    case DrawPath::IndirectCount:       return "vkCmdDrawIndexedIndirectCount";
+    case DrawPath::MultiDrawIndirect:   return "multi-draw vkCmdDrawIndexedIndirect";
+    case DrawPath::SingleDrawIndirect:  return "one vkCmdDrawIndexedIndirect per object";
+    }
+    return "unknown";
+}
+
+void GpuScene::PrintStats() const
+{
+    if (m_Stats.frames == 0)
+    {
+        return;
+    }
+
+    double frames = static_cast<double>(m_Stats.frames);
+    std::cout << "GPU scene: " << m_ObjectCount << " objects culled on the GPU and drawn with " << GetDrawPathName(m_DrawPath)
+        << " from " << (m_VertexFormat == VertexFormat::Quantized ? "quantized" : "float") << " vertices"
+        << ", " << (m_Stats.drawCalls / frames) << " draw calls and " << (m_Stats.recordMs / frames)
+        << " ms of recording per frame, " << m_Stats.descriptorUpdates << " descriptor updates";
+    if (m_Stats.skippedFrames > 0)
+    {
+        std::cout << ", " << m_Stats.skippedFrames << " frames skipped for lack of frame ring space";
+    }
+    std::cout << "\n";
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
+#include "GpuAllocator.h"
+#include "VulkanFwd.h"
+
+class BindlessDescriptors;
+class FrameRingBuffer;
+class PipelineCache;
+class UploadEngine;
+struct VulkanDeviceDispatch;
+
+// GPU-driven rendering of a large static scene.
+//
+// Object bounds, transforms and the mesh table are uploaded once into storage buffers.
+// Every frame a compute shader tests each object's bounding sphere against the view frustum
+// and writes a VkDrawIndexedIndirectCommand per visible object, so the CPU records the same
+// handful of commands whether the scene has a hundred objects or a million:
+// - with drawIndirectCount, visible objects are compacted and drawn with one
+//   vkCmdDrawIndexedIndirectCount, which reads the number of draws from the GPU
+// - without it, every object keeps its slot (instanceCount 0 when culled) and one
+//   vkCmdDrawIndexedIndirect draws them all with multiDrawIndirect
+// - without multiDrawIndirect, the commands are drawn one call each
+//
+// The per-frame command and count buffers are owned by the caller (render graph transients)
+// and passed in when recording. The camera and frustum of each frame are written to the
+// frame ring and bound as a dynamic uniform buffer.
+//
+// Objects are textured through materials. The textures, their sampler and the material table
+// are registered in the bindless descriptor table; each instance names its material and the
+// draw push constant names the table, so one bind of the bindless set covers every object.
+//
+// Vertices are either FloatVertex or QuantizedVertex (MeshFormat.h). Quantized positions are
+// fractions of bounds that enclose every mesh of the scene; scene_quantized.vert gets the
+// bounds in a push constant and unfolds the octahedral normals.
+class GpuScene
+{
+public:
+    enum class DrawPath
+    {
+        IndirectCount,
+        MultiDrawIndirect,
+        SingleDrawIndirect
+    };
+
+    struct Stats
+    {
+        uint64_t    frames              = 0;
+        uint64_t    drawCalls           = 0;
+        uint64_t    descriptorUpdates   = 0;
+        uint64_t    skippedFrames       = 0;    // the frame ring had no room for the constants
+        double      recordMs            = 0.0;  // CPU time spent recording cull and draw
+    };
+
+    // Builds the objects and creates the buffers, textures, descriptor sets and pipelines and
+    // registers the materials in bindless. The pipelines are created for subpass 0 of renderPass. vertexFormat selects the
+    // vertex layout and with it the vertex shader. maxDrawCount is the device's maxDrawIndirectCount,
+    // storageAlignment its minStorageBufferOffsetAlignment. Runs on any thread; Upload has to
+    // follow on the thread that flushes uploads.
+    void Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator, FrameRingBuffer& frameRing,
+        BindlessDescriptors& bindless, PipelineCache& pipelineCache, VkRenderPass renderPass,
+        const std::string& shaderDirectory, uint32_t objectCount, uint32_t framesInFlight, DrawPath drawPath,
+        VertexFormat vertexFormat, uint32_t maxDrawCount, uint64_t storageAlignment, const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    // Queues the static buffer and the textures for upload. Their first use has to acquire the upload.
+    void Upload(UploadEngine& uploads);
+
+    // Camera for the next recorded frame, orbiting inside the scene
+    void UpdateCamera(float seconds, float aspect);
+
+    // Clears the draw count. Recorded outside a render pass, before RecordCull.
+    void RecordClearCount(VkCommandBuffer commandBuffer, VkBuffer drawCount);
+
+    // Culls every object and writes the draw commands and the draw count
+    void RecordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount);
+
+    // Draws what RecordCull wrote, inside subpass 0 of the render pass given to Create
+    void RecordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount,
+        uint32_t width, uint32_t height);
+
+    // Size of the per-frame command buffer the caller provides, the count buffer holds one uint32_t
+    uint64_t GetCommandBufferSize() const;
+    uint32_t GetObjectCount() const { return m_ObjectCount; }
+    DrawPath GetDrawPath() const { return m_DrawPath; }
+    VertexFormat GetVertexFormat() const { return m_VertexFormat; }
+    static const char* GetDrawPathName(DrawPath path);
+
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // Descriptor set of one frame in flight. Bindings 4 and 5 are rewritten when the caller
+    // passes different buffers, binding 6 when the frame ring grows.
+    struct FrameSet
+    {
+        VkDescriptorSet set             = nullptr;
+        VkBuffer        commands        = nullptr;
+        VkBuffer        drawCount       = nullptr;
+        VkBuffer        constants       = nullptr;
+        uint32_t        constantsOffset = 0;        // dynamic offset of this frame's constants
+        bool            constantsValid  = false;
+    };
+
+    // A material texture and its bindless slot
+    struct Texture
+    {
+        VkImage                     image       = nullptr;
+        GpuAllocator::Allocation*   allocation  = nullptr;
+        VkImageView                 view        = nullptr;
+        uint32_t                    index       = 0;
+    };
+
+    void BuildScene(uint64_t storageAlignment);
+    void BuildTextures();
+    void CreateBuffer();
+    void CreateTextures();
+    void RegisterBindless();
+    void CreateDescriptors();
+    void CreatePipelines(VkRenderPass renderPass, const std::string& shaderDirectory);
+    VkShaderModule CreateShaderModule(const std::string& path) const;
+    void BindFrameBuffers(uint32_t frameIndex, VkBuffer commands, VkBuffer drawCount);
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    GpuAllocator*                   m_Allocator         = nullptr;
+    FrameRingBuffer*                m_FrameRing         = nullptr;
+    BindlessDescriptors*            m_Bindless          = nullptr;
+    PipelineCache*                  m_PipelineCache     = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks         = nullptr;
+    uint32_t                        m_ObjectCount       = 0;
+    DrawPath                        m_DrawPath          = DrawPath::IndirectCount;
+    VertexFormat                    m_VertexFormat      = VertexFormat::Float;
+    uint32_t                        m_MaxDrawCount      = 1;
+
+    // CPU copies of the static buffer and the texels of every texture, released after Upload
+    std::vector<uint8_t>            m_Data;
+    std::vector<uint32_t>           m_TextureData;
+    float                           m_SceneExtent       = 0.0f;     // objects lie in [-extent, extent]^3
+
+    // Static buffer: vertices, indices, bounds, object meshes, the mesh table, instances and materials
+    VkBuffer                        m_Buffer            = nullptr;
+    GpuAllocator::Allocation*       m_Allocation        = nullptr;
+    uint64_t                        m_IndexOffset       = 0;
+    uint64_t                        m_BoundsOffset      = 0;
+    uint64_t                        m_ObjectMeshOffset  = 0;
+    uint64_t                        m_MeshOffset        = 0;
+    uint64_t                        m_InstanceOffset    = 0;
+    uint64_t                        m_MaterialOffset    = 0;
+    uint32_t                        m_MeshCount         = 0;
+
+    // Bounds the quantized positions are fractions of, pushed to scene_quantized.vert
+    float                           m_PositionMin[3]    = {};
+    float                           m_PositionExtent[3] = {};
+
+    // Bindless slots of the textures, the sampler and the material table
+    std::vector<Texture>            m_Textures;
+    VkSampler                       m_Sampler           = nullptr;
+    uint32_t                        m_SamplerIndex      = 0;
+    uint32_t                        m_MaterialIndex     = 0;
+    bool                            m_Registered        = false;
+
+    VkDescriptorSetLayout           m_SetLayout         = nullptr;
+    VkDescriptorPool                m_DescriptorPool    = nullptr;
+    std::vector<FrameSet>           m_FrameSets;
+    VkPipelineLayout                m_PipelineLayout    = nullptr;
+    VkPipeline                      m_CullPipeline      = nullptr;
+    VkPipeline                      m_DrawPipeline      = nullptr;
+
+    // Set by UpdateCamera, written to the frame ring by RecordCull
+    float                           m_ViewProjection[16] = {};
+    float                           m_FrustumPlanes[6][4] = {};
+
+    Stats                           m_Stats;
+};
@@ -1,5 +1,9 @@
 #include "HelloTriangleApplication.h"
+#include "DispatchBenchmark.h"
 #include "ValidationLayers.h"
+#include "PhysicalDeviceSelector.h"
+#include "Profiler.h"
+#include "VulkanDispatch.h"
 
 #if PLATFORM_WIN
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -13,21 +17,53 @@
 #endif
 #include <GLFW/glfw3native.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iostream>
-#include <map>
 #include <optional>
 #include <set>
 #include <stdexcept>
 #include <vector>
 
+// Size of the persistently mapped buffer uploads are staged in
+constexpr uint64_t STAGING_RING_SIZE = 32ull * 1024 * 1024;
+
+// Newest Vulkan version the engine asks the instance for
+constexpr uint32_t MAX_VULKAN_API_VERSION = VK_API_VERSION_1_3;
+
+// Longest the windowed loop blocks in vkAcquireNextImageKHR, about a frame at 60 Hz, before
+// it goes back to processing events
+constexpr uint64_t ACQUIRE_TIMEOUT_NS = 16666667;
+
+// Format of the offscreen color target, chosen to be directly dumpable as 8-bit RGB(A)
+constexpr VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+// Slots of the bindless table with descriptor indexing, and with a plain set per frame in
+// flight. Either way at most half of a stage's limit, so other sets still fit next to it.
+constexpr BindlessDescriptors::Capacity BINDLESS_CAPACITY = { 16384, 64, 4096 };
+constexpr BindlessDescriptors::Capacity FALLBACK_BINDLESS_CAPACITY = { 64, 16, 16 };
+
 struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
 
+    // Families that can run compute or transfer work next to the graphics queue.
+    // When the device has no such family they fall back to the graphics family.
+    std::optional<uint32_t> computeFamily;
+    std::optional<uint32_t> transferFamily;
+
+    // Without a surface (headless mode) nothing is ever presented
+    bool requiresPresent = true;
+
     bool IsComplete() const
     {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+        return graphicsFamily.has_value() && (presentFamily.has_value() || !requiresPresent);
     }
 };
 
@@ -38,6 +74,7 @@ struct QueueFamilyIndices
 static QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface)
 {
     QueueFamilyIndices indices;
+    indices.requiresPresent = (surface != VK_NULL_HANDLE);
 
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
@@ -45,27 +82,50 @@ static QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKH
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-    int i = 0;
-    for (const auto& queueFamily : queueFamilies)
+    // Every family is looked at, the dedicated compute and transfer families usually come last
+    for (uint32_t i = 0; i < queueFamilyCount; i++)
     {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        const VkQueueFlags flags = queueFamilies[i].queueFlags;
+        const bool graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        const bool compute = (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+        const bool transfer = (flags & VK_QUEUE_TRANSFER_BIT) != 0;
+
+        if (graphics && !indices.graphicsFamily.has_value())
         {
             indices.graphicsFamily = i;
         }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if (presentSupport)
+        if (indices.requiresPresent)
         {
-            indices.presentFamily = i;
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+
+            // Presenting from the graphics family avoids an ownership transfer of the swapchain image
+            if (presentSupport && (!indices.presentFamily.has_value() || (graphics && indices.presentFamily != indices.graphicsFamily)))
+            {
+                indices.presentFamily = i;
+            }
+        }
+
+        if (compute && !graphics && !indices.computeFamily.has_value())
+        {
+            indices.computeFamily = i;
         }
 
-        if (indices.IsComplete()) // TODO Won't I lock myself out of using several GPUs with this early exit?
+        if (transfer && !graphics && !compute && !indices.transferFamily.has_value())
         {
-            break;
+            indices.transferFamily = i;
         }
+    }
 
-        i++;
+    // Graphics and compute queues implicitly support transfers
+    if (!indices.transferFamily.has_value())
+    {
+        indices.transferFamily = indices.computeFamily.has_value() ? indices.computeFamily : indices.graphicsFamily;
+    }
+    if (!indices.computeFamily.has_value())
+    {
+        indices.computeFamily = indices.graphicsFamily;
     }
 
     return indices;
@@ -77,23 +137,24 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
     const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
     void* pUserData)
 {
-    // Message is important enough to show
-    if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) 
-    {
-        std::cerr << "Validation layer: " << pCallbackData->pMessage << std::endl;
-    }
+    // Runs inside whatever Vulkan call triggered the message, so it only queues it.
+    // Filtering, deduplication and printing happen on the queue's own thread.
+    auto* messages = static_cast<DebugMessageQueue*>(pUserData);
+    messages->Push(messageSeverity, messageType, pCallbackData->messageIdNumber, pCallbackData->pMessageIdName,
+        pCallbackData->pMessage);
 
     return VK_FALSE;
 }
 
 static VkResult CreateDebugUtilsMessengerEXT(
+    const VulkanInstanceDispatch& dispatch,
     VkInstance instance,
     const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
     const VkAllocationCallbacks* pAllocator,
     VkDebugUtilsMessengerEXT* pDebugMessenger)
 {
-    // Extension functions must be loaded manually
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    // Extension functions are resolved once, when the instance dispatch table is loaded
+    auto func = dispatch.vkCreateDebugUtilsMessengerEXT;
     if (func != nullptr) 
     {
         return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
@@ -105,25 +166,27 @@ static VkResult CreateDebugUtilsMessengerEXT(
 }
 
 static void DestroyDebugUtilsMessengerEXT(
+    const VulkanInstanceDispatch& dispatch,
     VkInstance instance,
     VkDebugUtilsMessengerEXT debugMessenger,
     const VkAllocationCallbacks* pAllocator)
 {
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    auto func = dispatch.vkDestroyDebugUtilsMessengerEXT;
     if (func != nullptr)
     {
         func(instance, debugMessenger, pAllocator);
     }
 }
 
-static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
+static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo, DebugMessageQueue* messages)
 {
     createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
 
-    // Specify which severities to handle by a specific callback
+    // Specify which severities to handle by a specific callback.
+    // VERBOSE is never wanted; INFO is subscribed so the queue's filter can be lowered at runtime.
     createInfo.messageSeverity =
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
         VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
         VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
     // Filter which types of messages to handle
@@ -134,58 +197,246 @@ static void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT&
     // Specify the callback function
     createInfo.pfnUserCallback = DebugCallback;
     // Optional data passed to the callback
-    createInfo.pUserData = nullptr;
+    createInfo.pUserData = messages;
+}
+
+struct SwapChainSupportDetails
+{
+    VkSurfaceCapabilitiesKHR capabilities{};
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+};
+
+static SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface)
+{
+    SwapChainSupportDetails details;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+    details.formats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+    details.presentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+
+    return details;
+}
+
+static bool CheckDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<const char*>& requiredExtensions)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const char* extensionName : requiredExtensions)
+    {
+        auto it = std::find_if(availableExtensions.begin(), availableExtensions.end(),
+            [&](const VkExtensionProperties& ext) {
+                return std::strcmp(ext.extensionName, extensionName) == 0;
+            });
+
+        if (it == availableExtensions.end())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Presenting requires the swapchain device extension, headless rendering needs none
+static std::vector<const char*> GetRequiredDeviceExtensions(VkSurfaceKHR surface)
+{
+    std::vector<const char*> extensions;
+    if (surface != VK_NULL_HANDLE)
+    {
+        extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    return extensions;
+}
+
+// What the bindless table needs from descriptor indexing, in VkPhysicalDeviceVulkan12Features
+// or VkPhysicalDeviceDescriptorIndexingFeatures
+template <typename Features>
+static bool SupportsBindless(const Features& features)
+{
+    return features.descriptorBindingSampledImageUpdateAfterBind && features.descriptorBindingStorageBufferUpdateAfterBind
+        && features.descriptorBindingUpdateUnusedWhilePending && features.descriptorBindingPartiallyBound;
 }
 
-static bool IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface)
+template <typename Features>
+static void EnableBindless(Features& features)
 {
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features.descriptorBindingPartiallyBound = VK_TRUE;
+}
 
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+// Hard requirements only, everything that merely makes a device faster is left to the
+// scoring in PhysicalDeviceSelector. Returns why the device cannot be used, or an empty string.
+static std::string GetUnsuitableReason(VkPhysicalDevice device, VkSurfaceKHR surface)
+{
     QueueFamilyIndices indices = FindQueueFamilies(device, surface);
+    if (!indices.graphicsFamily.has_value())
+    {
+        return "no graphics queue";
+    }
+    if (!indices.IsComplete())
+    {
+        return "no queue can present to the surface";
+    }
+
+    if (!CheckDeviceExtensionSupport(device, GetRequiredDeviceExtensions(surface)))
+    {
+        return "missing required device extensions";
+    }
+
+    // At least one image format and one present mode are needed to build a swapchain
+    if (surface != VK_NULL_HANDLE)
+    {
+        SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device, surface);
+        if (swapChainSupport.formats.empty() || swapChainSupport.presentModes.empty())
+        {
+            return "surface offers no formats or present modes";
+        }
+    }
 
-    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU 
-        && deviceFeatures.geometryShader 
-        && indices.IsComplete();
+    return std::string();
 }
 
-static int RateDeviceSuitability(VkPhysicalDevice device)
+static VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    
-    return deviceProperties.limits.maxImageDimension2D;
+    // Prefer 8-bit BGRA with the sRGB color space, otherwise settle for whatever comes first
+    for (const auto& availableFormat : availableFormats)
+    {
+        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+        {
+            return availableFormat;
+        }
+    }
+
+    return availableFormats[0];
+}
+
+static VkPresentModeKHR ToVkPresentMode(PresentMode mode)
+{
+    switch (mode)
+    {
+    case PresentMode::Immediate:    return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    case PresentMode::Mailbox:      return VK_PRESENT_MODE_MAILBOX_KHR;
+    case PresentMode::Fifo:
+    default:                        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+}
+
+// FIFO is vsync and the only mode guaranteed to be available. MAILBOX replaces queued
+// images with newer ones (low latency without tearing), IMMEDIATE does not wait at all.
+static VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, PresentMode requested)
+{
+    VkPresentModeKHR requestedMode = ToVkPresentMode(requested);
+    for (const auto& availablePresentMode : availablePresentModes)
+    {
+        if (availablePresentMode == requestedMode)
+        {
+            return availablePresentMode;
+        }
+    }
+
+    std::cout << "Requested present mode is not supported, falling back to FIFO\n";
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+static void FramebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+    auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+    app->OnFramebufferResized();
 }
 
 void HelloTriangleApplication::MainLoop()
 {
-    while (!glfwWindowShouldClose(m_Window)) {
+    if (m_Config.dispatchBenchmark)
+    {
+        uint32_t graphicsFamily = FindQueueFamilies(m_PhysicalDevice, m_Surface).graphicsFamily.value();
+        RunDispatchBenchmark(m_LogicalDevice, m_DeviceDispatch, graphicsFamily, m_AllocationCallbacks, std::cout);
+        return;
+    }
+
+    if (m_Config.headless)
+    {
+        RunHeadless();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (!glfwWindowShouldClose(m_Window) && (m_Config.frameCount == 0 || m_FrameCounter < m_Config.frameCount)) {
+        PROFILE_SCOPE("Frame");
+
         // Check for events
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE("PollEvents");
+            glfwPollEvents();
+        }
 
+        // Jobs that have to run on the main thread, like GLFW calls
+        m_JobSystem.RunMainThreadJobs();
 
+        UpdateContentStatus();
+        DrawFrame();
+        m_HostAllocator.EndFrame();
+        m_DebugMessages.EndFrame();
+    }
+
+    // Let the last frames finish before reporting and tearing anything down
+    m_DeviceDispatch.vkDeviceWaitIdle(m_LogicalDevice);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (m_FrameCounter > 0 && seconds > 0.0)
+    {
+        std::cout << "Presented " << m_FrameCounter << " frames in " << seconds << " s, "
+            << (m_FrameCounter / seconds) << " FPS, " << m_Config.framesInFlight << " frames in flight\n";
     }
 }
 
 void HelloTriangleApplication::InitWindow()
 {
-    // Initialize the GLFW library
-    glfwInit();
+    PROFILE_FUNCTION();
 
     // Do not create an OpenGL context
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    // Make the window non-resizable
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    // The swapchain is recreated when the framebuffer size changes
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     // Initialize the window
-    m_Window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    m_Window = glfwCreateWindow(m_Config.width, m_Config.height, "Vulkan", nullptr, nullptr);
+
+    glfwSetWindowUserPointer(m_Window, this);
+    glfwSetFramebufferSizeCallback(m_Window, FramebufferResizeCallback);
 }
 
 void HelloTriangleApplication::CreateInstance()
 {
+    PROFILE_FUNCTION();
+
+    // Ask for the newest version the loader knows, up to the one the engine is written against.
+    // vkEnumerateInstanceVersion does not exist in a 1.0 loader, so it is looked up first.
+    m_InstanceApiVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    if (enumerateInstanceVersion != nullptr)
+    {
+        uint32_t loaderVersion = VK_API_VERSION_1_0;
+        enumerateInstanceVersion(&loaderVersion);
+        m_InstanceApiVersion = std::min(loaderVersion, MAX_VULKAN_API_VERSION);
+    }
+
     if (b_EnableValidationLayers && !CheckValidationLayerSupport())
     { 
         throw std::runtime_error("Validation layers requested, but not available!");
@@ -198,7 +449,7 @@ void HelloTriangleApplication::CreateInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = m_InstanceApiVersion;
 
     // Create info for Vulkan instance (essential)
     VkInstanceCreateInfo createInfo{};
@@ -218,7 +469,7 @@ void HelloTriangleApplication::CreateInstance()
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
         createInfo.ppEnabledLayerNames = validationLayers.data();
 
-        PopulateDebugMessengerCreateInfo(debugCreateInfo);
+        PopulateDebugMessengerCreateInfo(debugCreateInfo, &m_DebugMessages);
         createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&debugCreateInfo;
     } 
     else
@@ -227,80 +478,209 @@ void HelloTriangleApplication::CreateInstance()
         createInfo.pNext = nullptr;
     }
 
-    VkResult result = vkCreateInstance(&createInfo, nullptr, &m_Instance);
+    auto createStart = std::chrono::steady_clock::now();
+    VkResult result = vkCreateInstance(&createInfo, m_AllocationCallbacks, &m_Instance);
+    m_RunStats.instanceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - createStart).count();
     if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create instance!");
     }
+
+    m_InstanceDispatch.Load(m_Instance);
 }
 
 void HelloTriangleApplication::InitVulkan()
 {
-    CreateInstance();
-    SetupDebugMessenger();
-    CreateSurface();
-    PickPhysicalDevice();
-    CreateLogicalDevice();
-}
+    PROFILE_FUNCTION();
 
-void HelloTriangleApplication::PickPhysicalDevice()
-{
-    uint32_t deviceCount = 0;
-    vkEnumeratePhysicalDevices(m_Instance, &deviceCount, nullptr);
+    // Every Vulkan object is created and destroyed with the same host allocator
+    m_HostAllocator.SetEnabled(m_Config.hostAllocator);
+    m_AllocationCallbacks = m_HostAllocator.GetCallbacks();
+
+    // Running before the instance exists, so messages from vkCreateInstance are caught too
+    if (b_EnableValidationLayers)
+    {
+        uint32_t severityMask = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        if (m_Config.debugSeverity != DebugSeverity::Error)
+        {
+            severityMask |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+        }
+        if (m_Config.debugSeverity == DebugSeverity::Info)
+        {
+            severityMask |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+        }
+        m_DebugMessages.SetSeverityMask(severityMask);
+        m_DebugMessages.SetTypeMask(m_Config.debugTypes);
+        m_DebugMessages.Start();
+    }
 
-    if (deviceCount == 0) 
+    // Creating the instance (loading the driver and the layers) and creating the window both
+    // take tens of milliseconds and do not depend on each other. GLFW has to stay on the main
+    // thread, so the instance is created by a job. glfwInit comes first, the instance asks
+    // GLFW for its extensions.
+    if (!m_Config.headless)
     {
-        throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+        glfwInit();
     }
 
-    std::vector<VkPhysicalDevice> devices(deviceCount);
-    vkEnumeratePhysicalDevices(m_Instance, &deviceCount, devices.data());
-    
+    JobCounter instanceJob;
+    std::exception_ptr instanceError;
+    m_JobSystem.Spawn([this, &instanceError]()
+    {
+        try
+        {
+            CreateInstance();
+        }
+        catch (...)
+        {
+            instanceError = std::current_exception();
+        }
+    }, &instanceJob);
+
+    // Headless mode never touches GLFW, there may be no display at all
+    if (!m_Config.headless)
+    {
+        try
+        {
+            InitWindow();
+        }
+        catch (...)
+        {
+            m_JobSystem.Wait(instanceJob);
+            throw;
+        }
+    }
+
+    m_JobSystem.Wait(instanceJob);
+    if (instanceError)
+    {
+        std::rethrow_exception(instanceError);
+    }
 
-    std::multimap<int, VkPhysicalDevice> candidates;
+    SetupDebugMessenger();
+    if (!m_Config.headless)
+    {
+        CreateSurface();
+    }
+    PickPhysicalDevice();
+    CreateLogicalDevice();
+    CreateGpuAllocator();
+    CreateFrameRing();
+    CreateBindless();
+    CreateAssetStreamer();
+
+    // Content is not needed for the first frames, it keeps loading while they are rendered
+    LoadContent();
+
+    // Setting up the staging ring does not depend on the render targets, so it runs as a job
+    // while this thread creates those. Object creation is thread safe in Vulkan as long as
+    // no two threads use the same object.
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
+    uint32_t transferFamily = queueFamilyIndices.transferFamily.value();
+    uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+
+    JobCounter initJobs;
+    std::exception_ptr uploadEngineError;
+    m_JobSystem.Spawn([this, transferFamily, graphicsFamily, &uploadEngineError]()
+    {
+        try
+        {
+            CreateUploadEngine(transferFamily, graphicsFamily);
+        }
+        catch (...)
+        {
+            uploadEngineError = std::current_exception();
+        }
+    }, &initJobs);
 
-    for (const auto& device : devices) 
+    try
     {
-        if (IsDeviceSuitable(device, m_Surface)) 
+        if (m_Config.headless)
         {
-            int score = RateDeviceSuitability(device);
-            candidates.insert(std::make_pair(score, device));
+            CreateOffscreenTargets();
+            CreateRenderPass();
+            CreateOffscreenFramebuffers();
         }
+        else
+        {
+            CreateSwapChain(VK_NULL_HANDLE);
+            CreateImageViews();
+            CreateRenderPass();
+            CreateFramebuffers();
+            CreateRenderFinishedSemaphores();
+        }
+
+        CreateCommandPools();
+        CreateSyncObjects();
+        CreateGpuProfiler();
+        CreateRenderGraph();
+    }
+    catch (...)
+    {
+        // The jobs reference this stack frame
+        m_JobSystem.Wait(initJobs);
+        throw;
     }
 
-    if (candidates.rbegin()->first > 0) 
+    m_JobSystem.Wait(initJobs);
+    if (uploadEngineError)
     {
-        m_PhysicalDevice = candidates.rbegin()->second;
+        std::rethrow_exception(uploadEngineError);
     }
-    else
+
+    // The scene's pipelines need the render pass and go through the pipeline cache, so its
+    // job starts once the render pass exists and runs after the cache job
+    if (m_Config.sceneObjects > 0)
     {
-        throw std::runtime_error("Failed to find a suitable GPU!");
+        m_JobSystem.Spawn([this]()
+        {
+            // A failed cache is reported on its own
+            if (m_PipelineCacheError)
+            {
+                return;
+            }
+
+            try
+            {
+                CreateScene();
+                m_SceneReady.store(true, std::memory_order_release);
+            }
+            catch (...)
+            {
+                m_SceneError = std::current_exception();
+                m_ContentFailed.store(true, std::memory_order_release);
+            }
+        }, &m_ContentJobs, &m_PipelineCacheJob);
     }
 
+    m_RunStats.initMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+}
 
-    //for (const auto& device : devices) 
-    //{
-    //    if (IsDeviceSuitable(device)) 
-    //    {
-    //        m_PhysicalDevice = device;
-    //        break;
-    //    }
-    //}
+void HelloTriangleApplication::PickPhysicalDevice()
+{
+    PROFILE_FUNCTION();
 
-    //if (m_PhysicalDevice == VK_NULL_HANDLE) 
-    //{
-    //    throw std::runtime_error("Failed to find a suitable GPU!");
-    //}
+    VkSurfaceKHR surface = m_Surface;
+    PhysicalDeviceSelector selector(m_Instance, m_InstanceApiVersion, &m_JobSystem);
+    m_PhysicalDevice = selector.Select(
+        [surface](VkPhysicalDevice device) { return GetUnsuitableReason(device, surface); },
+        m_Config.deviceOverride);
 }
 
 void HelloTriangleApplication::CreateLogicalDevice()
 {
+    PROFILE_FUNCTION();
+
     // After selecting a physical device to use we need to set up a logical device to interface with it
     QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
-        
+    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.computeFamily.value(), indices.transferFamily.value() };
+    if (indices.presentFamily.has_value())
+    {
+        uniqueQueueFamilies.insert(indices.presentFamily.value());
+    }
+
     // Vulkan lets you assign priorities to queues to influence the scheduling of 
     // command buffer execution using floating point numbers between 0.0 and 1.0.
     float queuePriority = 1.0f;
@@ -317,6 +697,69 @@ void HelloTriangleApplication::CreateLogicalDevice()
 
     VkPhysicalDeviceFeatures deviceFeatures{};
 
+    // Only needed when the GPU profiler collects pipeline statistics
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+    m_PipelineStatisticsQuery = m_Config.gpuPipelineStatistics && supportedFeatures.pipelineStatisticsQuery;
+    deviceFeatures.pipelineStatisticsQuery = m_PipelineStatisticsQuery ? VK_TRUE : VK_FALSE;
+    if (m_Config.gpuPipelineStatistics && !m_PipelineStatisticsQuery)
+    {
+        std::cout << "Pipeline statistics queries are not supported, GPU scopes only get timings\n";
+    }
+
+    // The frame's statistics query is active while the draw list's secondaries run
+    if (m_PipelineStatisticsQuery && m_Config.drawItems > 0)
+    {
+        if (supportedFeatures.inheritedQueries)
+        {
+            deviceFeatures.inheritedQueries = VK_TRUE;
+        }
+        else
+        {
+            m_PipelineStatisticsQuery = false;
+            deviceFeatures.pipelineStatisticsQuery = VK_FALSE;
+            std::cout << "Inherited queries are not supported, GPU scopes only get timings with --draw-items\n";
+        }
+    }
+
+    // The GPU-driven scene passes the object index as firstInstance and, when it can, draws
+    // every command with one call
+    m_MultiDrawIndirect = false;
+    if (m_Config.sceneObjects > 0)
+    {
+        if (supportedFeatures.drawIndirectFirstInstance)
+        {
+            m_MultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+            deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+            deviceFeatures.multiDrawIndirect = m_MultiDrawIndirect ? VK_TRUE : VK_FALSE;
+        }
+        else
+        {
+            std::cout << "drawIndirectFirstInstance is not supported, the GPU scene is disabled\n";
+            m_Config.sceneObjects = 0;
+        }
+    }
+
+    // The scene's fragment shader picks textures, samplers and its material table from the
+    // bindless arrays with dynamically uniform indices
+    if (m_Config.sceneObjects > 0)
+    {
+        if (supportedFeatures.shaderSampledImageArrayDynamicIndexing && supportedFeatures.shaderStorageBufferArrayDynamicIndexing)
+        {
+            deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+            deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        }
+        else
+        {
+            std::cout << "Dynamic indexing of descriptor arrays is not supported, the GPU scene is disabled\n";
+            m_Config.sceneObjects = 0;
+        }
+    }
+
+    // Packs may hold BC1 textures; without the feature the streamer skips them
+    m_TextureCompressionBC = !m_Config.assetPack.empty() && supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionBC = m_TextureCompressionBC ? VK_TRUE : VK_FALSE;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -327,7 +770,152 @@ void HelloTriangleApplication::CreateLogicalDevice()
     // Vulkan made a distinction between instance and device specific validation layers,
     // but this is no longer the case.That means that the enabledLayerCount and ppEnabledLayerNames 
     // fields of VkDeviceCreateInfo are ignored by up-to-date implementations.
-    createInfo.enabledExtensionCount = 0;
+    std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions(m_Surface);
+
+    // Optional, lets the pipeline cache tell hits from misses
+    m_PipelineCreationFeedback = CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME });
+    if (m_PipelineCreationFeedback)
+    {
+        deviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    }
+
+    // Optional, lets the allocator see how much memory the driver will give us. The
+    // budget is read through vkGetPhysicalDeviceMemoryProperties2, which needs 1.1.
+    m_MemoryBudget = m_InstanceApiVersion >= VK_API_VERSION_1_1
+        && CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+    if (m_MemoryBudget)
+    {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    // Optional, lets the asset streamer import the mapped pack so uploads skip the staging
+    // copy. Builds on VK_KHR_external_memory, which is core in 1.1. Not while capturing, the
+    // replayer has no pack to import.
+    m_ExternalMemoryHost = false;
+    if (!m_Config.assetPack.empty() && m_Config.capturePath.empty() && m_InstanceApiVersion >= VK_API_VERSION_1_1)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+        m_ExternalMemoryHost = properties.apiVersion >= VK_API_VERSION_1_1
+            && CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME });
+        if (m_ExternalMemoryHost)
+        {
+            deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        }
+    }
+
+    // Optional, lets the render graph put all barriers in front of a pass into one
+    // vkCmdPipelineBarrier2. Core in 1.3, VK_KHR_synchronization2 on 1.1 and 1.2.
+    VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+    m_Synchronization2 = false;
+    if (m_InstanceApiVersion >= VK_API_VERSION_1_1 && m_InstanceDispatch.vkGetPhysicalDeviceFeatures2 != nullptr)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+        const bool core = m_InstanceApiVersion >= VK_API_VERSION_1_3 && properties.apiVersion >= VK_API_VERSION_1_3;
+        const bool extension = !core && properties.apiVersion >= VK_API_VERSION_1_1
+            && CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME });
+        if (core || extension)
+        {
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &synchronization2Features;
+            m_InstanceDispatch.vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features2);
+            m_Synchronization2 = synchronization2Features.synchronization2 == VK_TRUE;
+        }
+
+        if (m_Synchronization2)
+        {
+            if (extension)
+            {
+                deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+            }
+            synchronization2Features.pNext = nullptr;
+            createInfo.pNext = &synchronization2Features;
+        }
+    }
+
+    // Optional, lets the scene take its draw count from the cull shader, and turns the bindless
+    // table into one update-after-bind set. Vulkan 1.2 features, before that VK_KHR_draw_indirect_count
+    // (which has no feature bit) and VK_EXT_descriptor_indexing.
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
+    descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    m_DrawIndirectCount = false;
+    m_DescriptorIndexing = false;
+    const bool wantDrawIndirectCount = m_Config.sceneObjects > 0 && m_MultiDrawIndirect;
+    if (wantDrawIndirectCount || m_Config.bindless)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+        if (m_InstanceApiVersion >= VK_API_VERSION_1_2 && properties.apiVersion >= VK_API_VERSION_1_2
+            && m_InstanceDispatch.vkGetPhysicalDeviceFeatures2 != nullptr)
+        {
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &vulkan12Features;
+            m_InstanceDispatch.vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features2);
+            m_DrawIndirectCount = wantDrawIndirectCount && vulkan12Features.drawIndirectCount == VK_TRUE;
+            m_DescriptorIndexing = m_Config.bindless && SupportsBindless(vulkan12Features);
+
+            if (m_DrawIndirectCount || m_DescriptorIndexing)
+            {
+                // Only enable what is used, the query filled in every 1.2 feature
+                vulkan12Features = VkPhysicalDeviceVulkan12Features{};
+                vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+                vulkan12Features.drawIndirectCount = m_DrawIndirectCount ? VK_TRUE : VK_FALSE;
+                if (m_DescriptorIndexing)
+                {
+                    EnableBindless(vulkan12Features);
+                }
+                vulkan12Features.pNext = const_cast<void*>(createInfo.pNext);
+                createInfo.pNext = &vulkan12Features;
+            }
+        }
+        else
+        {
+            if (wantDrawIndirectCount && CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME }))
+            {
+                deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+                m_DrawIndirectCount = true;
+            }
+
+            // Needs VK_KHR_maintenance3, which is core in 1.1
+            if (m_Config.bindless && m_InstanceApiVersion >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1
+                && m_InstanceDispatch.vkGetPhysicalDeviceFeatures2 != nullptr
+                && CheckDeviceExtensionSupport(m_PhysicalDevice, { VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME }))
+            {
+                VkPhysicalDeviceFeatures2 features2{};
+                features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+                features2.pNext = &descriptorIndexingFeatures;
+                m_InstanceDispatch.vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features2);
+                m_DescriptorIndexing = SupportsBindless(descriptorIndexingFeatures);
+
+                if (m_DescriptorIndexing)
+                {
+                    descriptorIndexingFeatures = VkPhysicalDeviceDescriptorIndexingFeatures{};
+                    descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+                    EnableBindless(descriptorIndexingFeatures);
+                    descriptorIndexingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+                    createInfo.pNext = &descriptorIndexingFeatures;
+                    deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+                }
+            }
+        }
+
+        if (m_Config.bindless && !m_DescriptorIndexing)
+        {
+            std::cout << "Descriptor indexing is not supported, the bindless table uses a set per frame in flight\n";
+        }
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if (b_EnableValidationLayers) 
     {
@@ -339,35 +927,148 @@ void HelloTriangleApplication::CreateLogicalDevice()
         createInfo.enabledLayerCount = 0;
     }
 
-    if (vkCreateDevice(m_PhysicalDevice, &createInfo, nullptr, &m_LogicalDevice) != VK_SUCCESS) 
+    auto createStart = std::chrono::steady_clock::now();
+    VkResult result = vkCreateDevice(m_PhysicalDevice, &createInfo, m_AllocationCallbacks, &m_LogicalDevice);
+    m_RunStats.deviceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - createStart).count();
+    if (result != VK_SUCCESS) 
     {
         throw std::runtime_error("Failed to create logical device!");
     }
 
-    // Retrieve queue handles for each queue family
-    vkGetDeviceQueue(m_LogicalDevice, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
-    vkGetDeviceQueue(m_LogicalDevice, indices.presentFamily.value(), 0, &m_PresentQueue);
-}
+    // Frame calls go straight to the driver from here on
+    m_DeviceDispatch.Load(m_LogicalDevice, m_InstanceDispatch.vkGetDeviceProcAddr);
 
-void HelloTriangleApplication::CreateSurface()
-{
-    if (glfwCreateWindowSurface(m_Instance, m_Window, nullptr, &m_Surface) != VK_SUCCESS)
+    // Records from here on, so the replay can create everything the captured frames use
+    if (!m_Config.capturePath.empty())
     {
-        throw std::runtime_error("Failed to create window surface!");
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+        m_CommandCapture.Create(m_PhysicalDevice, createInfo, std::min(m_InstanceApiVersion, properties.apiVersion), m_DeviceDispatch,
+            m_Config.capturePath, m_Config.captureFirstFrame, m_Config.captureLastFrame);
+    }
+
+    // Retrieve queue handles for each queue family
+    m_DeviceDispatch.vkGetDeviceQueue(m_LogicalDevice, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
+    if (indices.presentFamily.has_value())
+    {
+        m_DeviceDispatch.vkGetDeviceQueue(m_LogicalDevice, indices.presentFamily.value(), 0, &m_PresentQueue);
     }
+    m_DeviceDispatch.vkGetDeviceQueue(m_LogicalDevice, indices.computeFamily.value(), 0, &m_ComputeQueue);
+    m_DeviceDispatch.vkGetDeviceQueue(m_LogicalDevice, indices.transferFamily.value(), 0, &m_TransferQueue);
+
+    auto describe = [&](uint32_t family) { return family == indices.graphicsFamily.value() ? " (shared with graphics)" : " (dedicated)"; };
+    std::cout << "Queues: graphics family " << indices.graphicsFamily.value()
+        << ", compute family " << indices.computeFamily.value() << describe(indices.computeFamily.value())
+        << ", transfer family " << indices.transferFamily.value() << describe(indices.transferFamily.value()) << '\n';
 }
 
-// Platform specific extension can be used to create a surface
-void HelloTriangleApplication::CreateSurfaceForPlatform()
+// Device memory for all resources is sub-allocated from a few large blocks
+void HelloTriangleApplication::CreateGpuAllocator()
 {
-#if PLATFORM_WIN
-    VkWin32SurfaceCreateInfoKHR createInfo{};
+    PROFILE_FUNCTION();
 
-    createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+    m_GpuAllocator.Create(m_PhysicalDevice, m_LogicalDevice, m_DeviceDispatch, std::min(m_InstanceApiVersion, properties.apiVersion),
+        m_MemoryBudget, m_AllocationCallbacks);
+}
+
+// Per-frame uniforms are sub-allocated from one mapped buffer, aligned for dynamic offsets
+void HelloTriangleApplication::CreateFrameRing()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+    m_FrameRing.Create(m_LogicalDevice, m_DeviceDispatch, m_GpuAllocator, properties.limits.minUniformBufferOffsetAlignment,
+        properties.limits.minStorageBufferOffsetAlignment, m_Config.framesInFlight, m_Config.frameRingSize,
+        m_AllocationCallbacks);
+}
+
+// Limits come from the update-after-bind properties when descriptor indexing is enabled
+void HelloTriangleApplication::CreateBindless()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+    BindlessDescriptors::Capacity capacity;
+    if (m_DescriptorIndexing)
+    {
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &indexingProperties;
+        m_InstanceDispatch.vkGetPhysicalDeviceProperties2(m_PhysicalDevice, &properties2);
+
+        capacity.sampledImages = std::min({ BINDLESS_CAPACITY.sampledImages,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages / 2,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages / 2 });
+        capacity.samplers = std::min({ BINDLESS_CAPACITY.samplers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers / 2,
+            indexingProperties.maxDescriptorSetUpdateAfterBindSamplers / 2 });
+        capacity.storageBuffers = std::min({ BINDLESS_CAPACITY.storageBuffers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers / 2,
+            indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers / 2 });
+    }
+    else
+    {
+        capacity.sampledImages = std::min(FALLBACK_BINDLESS_CAPACITY.sampledImages, properties.limits.maxPerStageDescriptorSampledImages / 2);
+        capacity.samplers = std::min(FALLBACK_BINDLESS_CAPACITY.samplers, properties.limits.maxPerStageDescriptorSamplers / 2);
+        capacity.storageBuffers = std::min(FALLBACK_BINDLESS_CAPACITY.storageBuffers, properties.limits.maxPerStageDescriptorStorageBuffers / 2);
+    }
+
+    m_Bindless.Create(m_LogicalDevice, m_DeviceDispatch, m_DescriptorIndexing, capacity, m_Config.framesInFlight, m_AllocationCallbacks);
+}
+
+// The whole pack is requested up front, meshes first. Its loader thread touches the pages
+// while the rest of the engine initializes; uploads start with the first frame.
+void HelloTriangleApplication::CreateAssetStreamer()
+{
+    if (m_Config.assetPack.empty())
+    {
+        return;
+    }
+
+    PROFILE_FUNCTION();
+
+    m_AssetStreamer.Create(m_PhysicalDevice, m_InstanceDispatch, m_LogicalDevice, m_DeviceDispatch, m_GpuAllocator, &m_Bindless,
+        m_Config.assetPack, m_ExternalMemoryHost, m_TextureCompressionBC, m_Config.assetUploadBudget, m_Config.framesInFlight, m_Config.textureBudget, m_AllocationCallbacks);
+    m_AssetStreamer.RequestAll();
+}
+
+// Pipelines compiled in earlier runs are loaded from disk, so a restart on the same
+// device and driver does not pay for compiling them again
+void HelloTriangleApplication::CreatePipelineCache()
+{
+    PROFILE_FUNCTION();
+
+    m_PipelineCache.Create(m_PhysicalDevice, m_LogicalDevice, m_DeviceDispatch, m_Config.pipelineCachePath, m_PipelineCreationFeedback,
+        m_AllocationCallbacks);
+}
+
+void HelloTriangleApplication::CreateSurface()
+{
+    PROFILE_FUNCTION();
+
+    if (glfwCreateWindowSurface(m_Instance, m_Window, m_AllocationCallbacks, &m_Surface) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create window surface!");
+    }
+}
+
+// Platform specific extension can be used to create a surface
+void HelloTriangleApplication::CreateSurfaceForPlatform()
+{
+#if PLATFORM_WIN
+    VkWin32SurfaceCreateInfoKHR createInfo{};
+
+    createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
     createInfo.hwnd = glfwGetWin32Window(m_Window);
     createInfo.hinstance = GetModuleHandle(nullptr);
 
-    if (vkCreateWin32SurfaceKHR(m_Instance, &createInfo, nullptr, &m_Surface) != VK_SUCCESS) 
+    if (vkCreateWin32SurfaceKHR(m_Instance, &createInfo, m_AllocationCallbacks, &m_Surface) != VK_SUCCESS) 
     {
         throw std::runtime_error("Failed to create window surface!");
     }
@@ -375,29 +1076,1232 @@ void HelloTriangleApplication::CreateSurfaceForPlatform()
 
 }
 
+static VkImageView CreateImageView(const VulkanDeviceDispatch& dispatch, VkDevice device, VkImage image, VkFormat format, const VkAllocationCallbacks* allocator)
+{
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView imageView = VK_NULL_HANDLE;
+    if (dispatch.vkCreateImageView(device, &viewInfo, allocator, &imageView) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create image view!");
+    }
+
+    return imageView;
+}
+
+VkExtent2D HelloTriangleApplication::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) const
+{
+    // Most window systems dictate the extent, UINT32_MAX means we get to pick it
+    if (capabilities.currentExtent.width != UINT32_MAX)
+    {
+        return capabilities.currentExtent;
+    }
+
+    // GLFW works in screen coordinates, the swapchain in pixels
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(m_Window, &width, &height);
+
+    VkExtent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+
+    return actualExtent;
+}
+
+void HelloTriangleApplication::CreateSwapChain(VkSwapchainKHR oldSwapChain)
+{
+    PROFILE_FUNCTION();
+
+    SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_PhysicalDevice, m_Surface);
+
+    VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
+    VkPresentModeKHR presentMode = ChooseSwapPresentMode(swapChainSupport.presentModes, m_Config.presentMode);
+    VkExtent2D extent = ChooseSwapExtent(swapChainSupport.capabilities);
+
+    // One image more than the minimum so we never wait on the driver to release one
+    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
+    {
+        imageCount = swapChainSupport.capabilities.maxImageCount;
+    }
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = m_Surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
+    uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+
+    if (indices.graphicsFamily != indices.presentFamily)
+    {
+        // Avoids explicit ownership transfers between the graphics and present queues
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilyIndices;
+    }
+    else
+    {
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    // Lets the driver reuse resources of the swapchain being replaced
+    createInfo.oldSwapchain = oldSwapChain;
+
+    if (m_DeviceDispatch.vkCreateSwapchainKHR(m_LogicalDevice, &createInfo, m_AllocationCallbacks, &m_SwapChain) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create swap chain!");
+    }
+
+    m_DeviceDispatch.vkGetSwapchainImagesKHR(m_LogicalDevice, m_SwapChain, &imageCount, nullptr);
+    m_SwapChainImages.resize(imageCount);
+    m_DeviceDispatch.vkGetSwapchainImagesKHR(m_LogicalDevice, m_SwapChain, &imageCount, m_SwapChainImages.data());
+
+    m_SwapChainImageFormat = static_cast<uint32_t>(surfaceFormat.format);
+    m_SwapChainWidth = extent.width;
+    m_SwapChainHeight = extent.height;
+}
+
+void HelloTriangleApplication::CreateImageViews()
+{
+    PROFILE_FUNCTION();
+
+    m_SwapChainImageViews.resize(m_SwapChainImages.size());
+
+    for (size_t i = 0; i < m_SwapChainImages.size(); i++)
+    {
+        m_SwapChainImageViews[i] = CreateImageView(m_DeviceDispatch, m_LogicalDevice, m_SwapChainImages[i], static_cast<VkFormat>(m_SwapChainImageFormat), m_AllocationCallbacks);
+    }
+}
+
+// The render finished semaphore is waited on by the presentation engine, which gives
+// no signal of when it is done with it. Having one per swapchain image guarantees it
+// is not reused before the image it was presented with has been acquired again.
+void HelloTriangleApplication::CreateRenderFinishedSemaphores()
+{
+    PROFILE_FUNCTION();
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    m_RenderFinishedSemaphores.resize(m_SwapChainImages.size());
+    for (auto& semaphore : m_RenderFinishedSemaphores)
+    {
+        if (m_DeviceDispatch.vkCreateSemaphore(m_LogicalDevice, &semaphoreInfo, m_AllocationCallbacks, &semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create synchronization objects!");
+        }
+    }
+}
+
+// Recreating the swapchain does not drain the device. The old swapchain is handed to
+// vkCreateSwapchainKHR as oldSwapchain, and its views, framebuffers and semaphores are
+// retired until every frame that could still reference them has been waited on.
+void HelloTriangleApplication::RecreateSwapChain()
+{
+    PROFILE_FUNCTION();
+
+    // A minimized window has a zero sized framebuffer, pause until it is visible again
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(m_Window, &width, &height);
+    while (width == 0 || height == 0)
+    {
+        if (glfwWindowShouldClose(m_Window))
+        {
+            return;
+        }
+        glfwWaitEvents();
+        glfwGetFramebufferSize(m_Window, &width, &height);
+    }
+
+    RetiredSwapChain retired;
+    retired.swapChain = m_SwapChain;
+    retired.imageViews = std::move(m_SwapChainImageViews);
+    retired.framebuffers = std::move(m_SwapChainFramebuffers);
+    retired.renderFinishedSemaphores = std::move(m_RenderFinishedSemaphores);
+    retired.retireFrame = m_FrameCounter;
+
+    m_SwapChainImageViews.clear();
+    m_SwapChainFramebuffers.clear();
+    m_RenderFinishedSemaphores.clear();
+
+    CreateSwapChain(retired.swapChain);
+    m_RetiredSwapChains.push_back(std::move(retired));
+
+    // The surface format is not expected to change on resize, so the render pass is kept
+    CreateImageViews();
+    CreateFramebuffers();
+    CreateRenderFinishedSemaphores();
+}
+
+void HelloTriangleApplication::DestroyRetiredSwapChain(RetiredSwapChain& retired)
+{
+    for (auto framebuffer : retired.framebuffers)
+    {
+        m_DeviceDispatch.vkDestroyFramebuffer(m_LogicalDevice, framebuffer, m_AllocationCallbacks);
+    }
+    for (auto imageView : retired.imageViews)
+    {
+        m_DeviceDispatch.vkDestroyImageView(m_LogicalDevice, imageView, m_AllocationCallbacks);
+    }
+    for (auto semaphore : retired.renderFinishedSemaphores)
+    {
+        m_DeviceDispatch.vkDestroySemaphore(m_LogicalDevice, semaphore, m_AllocationCallbacks);
+    }
+    m_DeviceDispatch.vkDestroySwapchainKHR(m_LogicalDevice, retired.swapChain, m_AllocationCallbacks);
+}
+
+// A frame's fence is waited on framesInFlight frames after it was submitted, so once
+// that many frames have started since the retirement nothing can use the old objects.
+void HelloTriangleApplication::ReleaseRetiredSwapChains()
+{
+    auto it = m_RetiredSwapChains.begin();
+    while (it != m_RetiredSwapChains.end())
+    {
+        if (m_FrameCounter >= it->retireFrame + m_Config.framesInFlight)
+        {
+            DestroyRetiredSwapChain(*it);
+            it = m_RetiredSwapChains.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// In headless mode there is no swapchain to hand out images, so the engine renders
+// into images it owns, one per frame in flight. They are used as color attachments
+// and as the source of the copy back to host memory.
+void HelloTriangleApplication::CreateOffscreenTargets()
+{
+    PROFILE_FUNCTION();
+
+    m_OffscreenTargets.resize(m_Config.framesInFlight);
+
+    for (auto& target : m_OffscreenTargets)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = OFFSCREEN_FORMAT;
+        imageInfo.extent = { m_Config.width, m_Config.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (m_DeviceDispatch.vkCreateImage(m_LogicalDevice, &imageInfo, m_AllocationCallbacks, &target.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create offscreen image!");
+        }
+
+        GpuAllocator::AllocationCreateInfo allocInfo{};
+        allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+        target.imageAllocation = m_GpuAllocator.AllocateForImage(target.image, allocInfo);
+
+        target.imageView = CreateImageView(m_DeviceDispatch, m_LogicalDevice, target.image, OFFSCREEN_FORMAT, m_AllocationCallbacks);
+
+        if (m_Config.readback)
+        {
+            CreateReadbackBuffer(target);
+        }
+    }
+
+    if (m_Config.readback)
+    {
+        m_LastFrame.resize(static_cast<size_t>(m_Config.width) * m_Config.height * 4);
+    }
+}
+
+void HelloTriangleApplication::CreateRenderPass()
+{
+    PROFILE_FUNCTION();
+
+    const bool offscreen = m_Config.headless;
+
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = offscreen ? OFFSCREEN_FORMAT : static_cast<VkFormat>(m_SwapChainImageFormat);
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    // Clear at the start of the pass, keep the result so it can be presented or read back
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // The render graph transitions the image around the pass and owns the synchronization
+    // with whatever comes before and after it, so the pass itself changes no layout
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (m_DeviceDispatch.vkCreateRenderPass(m_LogicalDevice, &renderPassInfo, m_AllocationCallbacks, &m_RenderPass) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+
+    // The scene is drawn over what the main pass left in the target. Only the load op differs,
+    // so the pass is compatible with the framebuffers made for m_RenderPass.
+    if (m_Config.sceneObjects > 0)
+    {
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        if (m_DeviceDispatch.vkCreateRenderPass(m_LogicalDevice, &renderPassInfo, m_AllocationCallbacks, &m_SceneRenderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create scene render pass!");
+        }
+    }
+}
+
+void HelloTriangleApplication::CreateFramebuffers()
+{
+    PROFILE_FUNCTION();
+
+    m_SwapChainFramebuffers.resize(m_SwapChainImageViews.size());
+
+    for (size_t i = 0; i < m_SwapChainImageViews.size(); i++)
+    {
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_RenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &m_SwapChainImageViews[i];
+        framebufferInfo.width = m_SwapChainWidth;
+        framebufferInfo.height = m_SwapChainHeight;
+        framebufferInfo.layers = 1;
+
+        if (m_DeviceDispatch.vkCreateFramebuffer(m_LogicalDevice, &framebufferInfo, m_AllocationCallbacks, &m_SwapChainFramebuffers[i]) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create framebuffer!");
+        }
+    }
+}
+
+void HelloTriangleApplication::CreateOffscreenFramebuffers()
+{
+    PROFILE_FUNCTION();
+
+    for (auto& target : m_OffscreenTargets)
+    {
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_RenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &target.imageView;
+        framebufferInfo.width = m_Config.width;
+        framebufferInfo.height = m_Config.height;
+        framebufferInfo.layers = 1;
+
+        if (m_DeviceDispatch.vkCreateFramebuffer(m_LogicalDevice, &framebufferInfo, m_AllocationCallbacks, &target.framebuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create offscreen framebuffer!");
+        }
+    }
+}
+
+void HelloTriangleApplication::CreateReadbackBuffer(OffscreenTarget& target)
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = static_cast<VkDeviceSize>(m_Config.width) * m_Config.height * 4;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_DeviceDispatch.vkCreateBuffer(m_LogicalDevice, &bufferInfo, m_AllocationCallbacks, &target.readbackBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create readback buffer!");
+    }
+
+    // Readback memory is host cached when the device has such a type and stays mapped
+    // for the whole run instead of being mapped every frame
+    GpuAllocator::AllocationCreateInfo allocInfo{};
+    allocInfo.usage = GpuAllocator::Usage::Readback;
+    target.readbackAllocation = m_GpuAllocator.AllocateForBuffer(target.readbackBuffer, allocInfo);
+}
+
+// The primary command buffers belong to the render graph, which gives every frame in flight
+// its own pool per queue and resets it as a whole once the frame's fence has signaled
+void HelloTriangleApplication::CreateCommandPools()
+{
+    PROFILE_FUNCTION();
+
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
+
+    // The draw list is recorded into secondary command buffers from per-thread pools
+    m_CommandRecorder.Create(m_JobSystem, m_LogicalDevice, m_DeviceDispatch, queueFamilyIndices.graphicsFamily.value(),
+        m_Config.framesInFlight, m_AllocationCallbacks);
+}
+
+// Uploads go through the transfer queue, so they run next to rendering instead of in front of it.
+// Runs as a job during init, the queue families are looked up on the main thread since that
+// queries the surface.
+void HelloTriangleApplication::CreateUploadEngine(uint32_t transferFamily, uint32_t graphicsFamily)
+{
+    PROFILE_FUNCTION();
+
+    m_UploadEngine.Create(m_PhysicalDevice, m_LogicalDevice, m_DeviceDispatch, m_TransferQueue, transferFamily, graphicsFamily,
+        STAGING_RING_SIZE, m_AllocationCallbacks);
+}
+
+// The frame is described once, after the targets exist. Swapchain images and offscreen
+// targets are imported; the image behind them is swapped every frame.
+void HelloTriangleApplication::CreateRenderGraph()
+{
+    PROFILE_FUNCTION();
+
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
+    m_RenderGraph.Create(m_LogicalDevice, m_DeviceDispatch, m_GpuAllocator, m_GraphicsQueue, queueFamilyIndices.graphicsFamily.value(),
+        m_ComputeQueue, queueFamilyIndices.computeFamily.value(), m_Config.framesInFlight, m_Synchronization2,
+        m_AllocationCallbacks);
+
+    RenderGraph::TextureDesc colorDesc{};
+    RenderGraph::ResourceState initialState{};
+    RenderGraph::ResourceState finalState{};
+    if (m_Config.headless)
+    {
+        // The frame fence covers the previous use of the target and its contents are cleared
+        colorDesc.width = m_Config.width;
+        colorDesc.height = m_Config.height;
+        colorDesc.format = OFFSCREEN_FORMAT;
+    }
+    else
+    {
+        // The image available semaphore is waited on at the color output stage, the layout
+        // transition in front of the main pass has to happen after it. Presentation waits
+        // for the render finished semaphore, so only the layout is left to change.
+        colorDesc.width = m_SwapChainWidth;
+        colorDesc.height = m_SwapChainHeight;
+        colorDesc.format = m_SwapChainImageFormat;
+        initialState.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        finalState.layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+    m_ColorTarget = m_RenderGraph.ImportTexture("ColorTarget", VK_NULL_HANDLE, VK_NULL_HANDLE, colorDesc, initialState, finalState);
+
+    RenderGraph::Handle mainPass = m_RenderGraph.AddPass("MainPass", RenderGraph::PassType::Graphics,
+        [this](VkCommandBuffer commandBuffer) { RecordMainPass(commandBuffer); });
+    m_RenderGraph.Write(mainPass, m_ColorTarget, RenderGraph::Access::ColorAttachmentWrite);
+
+    if (m_Config.sceneObjects > 0)
+    {
+        // Cleared, culled and drawn every frame. Until the scene is loaded the passes only
+        // get their barriers.
+        m_SceneCommands = m_RenderGraph.CreateBuffer("SceneCommands",
+            static_cast<uint64_t>(m_Config.sceneObjects) * sizeof(VkDrawIndexedIndirectCommand));
+        m_SceneDrawCount = m_RenderGraph.CreateBuffer("SceneDrawCount", sizeof(uint32_t));
+
+        RenderGraph::Handle clear = m_RenderGraph.AddPass("SceneClear", RenderGraph::PassType::Transfer,
+            [this](VkCommandBuffer commandBuffer)
+            {
+                if (m_ShowScene)
+                {
+                    m_Scene.RecordClearCount(commandBuffer, m_RenderGraph.GetBuffer(m_SceneDrawCount));
+                }
+            });
+        m_RenderGraph.Write(clear, m_SceneDrawCount, RenderGraph::Access::TransferWrite);
+
+        RenderGraph::Handle cull = m_RenderGraph.AddPass("SceneCull", RenderGraph::PassType::Compute,
+            [this](VkCommandBuffer commandBuffer) { RecordSceneCull(commandBuffer); });
+        m_RenderGraph.Write(cull, m_SceneCommands, RenderGraph::Access::StorageWrite);
+        m_RenderGraph.Write(cull, m_SceneDrawCount, RenderGraph::Access::StorageWrite);
+
+        RenderGraph::Handle scene = m_RenderGraph.AddPass("Scene", RenderGraph::PassType::Graphics,
+            [this](VkCommandBuffer commandBuffer) { RecordScenePass(commandBuffer); });
+        m_RenderGraph.Read(scene, m_SceneCommands, RenderGraph::Access::IndirectRead);
+        m_RenderGraph.Read(scene, m_SceneDrawCount, RenderGraph::Access::IndirectRead);
+        m_RenderGraph.Write(scene, m_ColorTarget, RenderGraph::Access::ColorAttachmentWrite);
+    }
+
+    if (m_Config.headless && m_Config.readback)
+    {
+        // A fence alone does not make device writes visible to the host
+        RenderGraph::ResourceState hostRead{};
+        hostRead.stages = VK_PIPELINE_STAGE_2_HOST_BIT;
+        hostRead.access = VK_ACCESS_2_HOST_READ_BIT;
+        m_ReadbackTarget = m_RenderGraph.ImportBuffer("ReadbackBuffer", VK_NULL_HANDLE,
+            static_cast<uint64_t>(m_Config.width) * m_Config.height * 4, RenderGraph::ResourceState{}, hostRead);
+
+        RenderGraph::Handle readback = m_RenderGraph.AddPass("Readback", RenderGraph::PassType::Transfer,
+            [this](VkCommandBuffer commandBuffer) { RecordReadback(commandBuffer); });
+        m_RenderGraph.Read(readback, m_ColorTarget, RenderGraph::Access::TransferRead);
+        m_RenderGraph.Write(readback, m_ReadbackTarget, RenderGraph::Access::TransferWrite);
+    }
+
+    m_RenderGraph.Compile();
+
+    if (!m_Config.renderGraphDumpPath.empty())
+    {
+        std::ofstream file(m_Config.renderGraphDumpPath);
+        if (file)
+        {
+            m_RenderGraph.DumpPlan(file);
+            std::cout << "Render graph plan written to " << m_Config.renderGraphDumpPath << '\n';
+        }
+        else
+        {
+            std::cerr << "Failed to write the render graph plan to " << m_Config.renderGraphDumpPath << '\n';
+        }
+    }
+}
+
+// Timestamps are written on the graphics queue, so that is the family that has to support them
+void HelloTriangleApplication::CreateGpuProfiler()
+{
+    PROFILE_FUNCTION();
+
+    if (m_Config.gpuProfilePath.empty() && !m_Config.gpuPipelineStatistics)
+    {
+        return;
+    }
+
+    QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_PhysicalDevice, m_Surface);
+    m_GpuProfiler.Create(m_PhysicalDevice, m_LogicalDevice, m_DeviceDispatch, queueFamilyIndices.graphicsFamily.value(),
+        m_Config.framesInFlight, m_PipelineStatisticsQuery, m_AllocationCallbacks);
+    m_CommandRecorder.SetInheritedPipelineStatistics(m_GpuProfiler.GetPipelineStatistics());
+}
+
+// Lays the draw list out as a grid of rectangles, each one cleared in its own color.
+// There is no geometry yet, so a clear per item stands in for a draw call.
+void HelloTriangleApplication::CreateDrawList()
+{
+    m_DrawItems.resize(m_Config.drawItems);
+    if (m_DrawItems.empty())
+    {
+        return;
+    }
+
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_DrawItems.size()))));
+    uint32_t rows = (static_cast<uint32_t>(m_DrawItems.size()) + columns - 1) / columns;
+
+    for (uint32_t i = 0; i < m_DrawItems.size(); i++)
+    {
+        DrawItem& item = m_DrawItems[i];
+        item.width = 0.5f / columns;
+        item.height = 0.5f / rows;
+        item.x = (static_cast<float>(i % columns) + 0.25f) / columns;
+        item.y = (static_cast<float>(i / columns) + 0.25f) / rows;
+
+        // Cheap integer hash so neighbouring items differ in color
+        uint32_t hash = (i + 1) * 2654435761u;
+        item.color[0] = static_cast<float>(hash & 0xFF) / 255.0f;
+        item.color[1] = static_cast<float>((hash >> 8) & 0xFF) / 255.0f;
+        item.color[2] = static_cast<float>((hash >> 16) & 0xFF) / 255.0f;
+        item.color[3] = 1.0f;
+    }
+}
+
+// Starts the jobs that load everything the first frames can do without. Until they are done,
+// frames show only the clear color.
+void HelloTriangleApplication::LoadContent()
+{
+    m_JobSystem.Spawn([this]()
+    {
+        try
+        {
+            CreatePipelineCache();
+        }
+        catch (...)
+        {
+            m_PipelineCacheError = std::current_exception();
+            m_ContentFailed.store(true, std::memory_order_release);
+        }
+    }, &m_PipelineCacheJob);
+
+    m_JobSystem.Spawn([this]()
+    {
+        try
+        {
+            CreateDrawList();
+            m_ContentReady.store(true, std::memory_order_release);
+        }
+        catch (...)
+        {
+            m_DrawListError = std::current_exception();
+            m_ContentFailed.store(true, std::memory_order_release);
+        }
+    }, &m_ContentJobs);
+}
+
+// Runs as a job after the pipeline cache job
+void HelloTriangleApplication::CreateScene()
+{
+    PROFILE_FUNCTION();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+
+    // A single count draw covers at most maxDrawIndirectCount commands
+    const uint32_t maxDrawCount = m_MultiDrawIndirect ? properties.limits.maxDrawIndirectCount : 1;
+    GpuScene::DrawPath drawPath = GpuScene::DrawPath::SingleDrawIndirect;
+    if (m_DrawIndirectCount && m_Config.sceneObjects <= maxDrawCount)
+    {
+        drawPath = GpuScene::DrawPath::IndirectCount;
+    }
+    else if (m_MultiDrawIndirect)
+    {
+        drawPath = GpuScene::DrawPath::MultiDrawIndirect;
+    }
+
+    m_Scene.Create(m_LogicalDevice, m_DeviceDispatch, m_GpuAllocator, m_FrameRing, m_Bindless, m_PipelineCache, m_SceneRenderPass,
+        m_Config.shaderDirectory, m_Config.sceneObjects, m_Config.framesInFlight, drawPath,
+        m_Config.quantizedVertices ? VertexFormat::Quantized : VertexFormat::Float, maxDrawCount,
+        properties.limits.minStorageBufferOffsetAlignment, m_AllocationCallbacks);
+}
+
+// Called once per frame before it is recorded
+void HelloTriangleApplication::UpdateContentStatus()
+{
+    if (m_ContentFailed.load(std::memory_order_acquire))
+    {
+        // The other content jobs may still be writing, every error is readable once all are done
+        m_JobSystem.Wait(m_ContentJobs);
+        m_JobSystem.Wait(m_PipelineCacheJob);
+        std::rethrow_exception(m_PipelineCacheError ? m_PipelineCacheError
+            : m_DrawListError ? m_DrawListError : m_SceneError);
+    }
+
+    // The scene is uploaded by this frame's flush and shown from this frame on; the acquire
+    // barriers at the start of the frame come before the cull pass reads it
+    if (!m_ShowScene && m_SceneReady.load(std::memory_order_acquire))
+    {
+        m_Scene.Upload(m_UploadEngine);
+        m_ShowScene = true;
+    }
+
+    if (m_ShowContent)
+    {
+        return;
+    }
+
+    m_ShowContent = m_ContentReady.load(std::memory_order_acquire);
+    if (m_ShowContent)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+        std::cout << "Content ready after " << ms << " ms, " << m_RunStats.placeholderFrames << " placeholder frames\n";
+    }
+    else
+    {
+        m_RunStats.placeholderFrames++;
+    }
+}
+
+void HelloTriangleApplication::ReportFirstFrame(const char* event)
+{
+    m_RunStats.firstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+    std::cout << "Time to first frame: " << m_RunStats.firstFrameMs << " ms (" << event << "), initialization took "
+        << m_RunStats.initMs << " ms\n";
+}
+
+// Runs on the recording threads, so it may only read shared state
+void HelloTriangleApplication::RecordDrawItems(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t first, uint32_t count) const
+{
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const DrawItem& item = m_DrawItems[i];
+
+        VkClearAttachment attachment{};
+        attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        attachment.colorAttachment = 0;
+        attachment.clearValue.color = { { item.color[0], item.color[1], item.color[2], item.color[3] } };
+
+        VkClearRect rect{};
+        rect.rect.offset.x = static_cast<int32_t>(item.x * extent.width);
+        rect.rect.offset.y = static_cast<int32_t>(item.y * extent.height);
+        rect.rect.extent.width = std::max(static_cast<uint32_t>(item.width * extent.width), 1u);
+        rect.rect.extent.height = std::max(static_cast<uint32_t>(item.height * extent.height), 1u);
+        rect.baseArrayLayer = 0;
+        rect.layerCount = 1;
+
+        // Tiny targets can round a rectangle past the render area
+        if (rect.rect.offset.x + rect.rect.extent.width > extent.width ||
+            rect.rect.offset.y + rect.rect.extent.height > extent.height)
+        {
+            continue;
+        }
+
+        m_DeviceDispatch.vkCmdClearAttachments(commandBuffer, 1, &attachment, 1, &rect);
+    }
+}
+
+void HelloTriangleApplication::CreateSyncObjects()
+{
+    PROFILE_FUNCTION();
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    // Created signaled so the first frame does not wait forever
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    m_Frames.resize(m_Config.framesInFlight);
+    for (auto& frame : m_Frames)
+    {
+        if (m_DeviceDispatch.vkCreateFence(m_LogicalDevice, &fenceInfo, m_AllocationCallbacks, &frame.inFlightFence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create synchronization objects!");
+        }
+
+        // Nothing is acquired in headless mode
+        if (!m_Config.headless &&
+            m_DeviceDispatch.vkCreateSemaphore(m_LogicalDevice, &semaphoreInfo, m_AllocationCallbacks, &frame.imageAvailableSemaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create synchronization objects!");
+        }
+    }
+}
+
+// Records every submission of the frame through the render graph. The profiler frame and the
+// upload acquires go at the start of the first graphics command buffer.
+void HelloTriangleApplication::RecordFrame(VkFramebuffer framebuffer, uint32_t width, uint32_t height)
+{
+    m_FrameFramebuffer = framebuffer;
+    m_FrameWidth = width;
+    m_FrameHeight = height;
+
+    m_RenderGraph.Record(m_CurrentFrame,
+        [this](VkCommandBuffer commandBuffer)
+        {
+            // Reads the timings this frame slot recorded last time and starts over
+            m_GpuProfiler.BeginFrame(commandBuffer, m_CurrentFrame);
+            m_GpuProfiler.BeginScope(commandBuffer, "Frame");
+
+            // Take ownership of everything uploaded since the last frame before anything uses it
+            GPU_PROFILE_SCOPE(m_GpuProfiler, commandBuffer, "UploadAcquire");
+            m_UploadEngine.RecordAcquireBarriers(commandBuffer, m_UploadWaits);
+        },
+        [this](VkCommandBuffer commandBuffer)
+        {
+            m_GpuProfiler.EndScope(commandBuffer);
+        });
+}
+
+void HelloTriangleApplication::RecordMainPass(VkCommandBuffer commandBuffer)
+{
+    GPU_PROFILE_SCOPE(m_GpuProfiler, commandBuffer, "MainPass");
+
+    // Cycle the clear color so consecutive frames are distinguishable
+    float phase = static_cast<float>(m_FrameCounter % 256) / 255.0f;
+    VkClearValue clearColor{};
+    clearColor.color = { { phase, 0.2f, 1.0f - phase, 1.0f } };
+
+    VkExtent2D extent = { m_FrameWidth, m_FrameHeight };
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_RenderPass;
+    renderPassInfo.framebuffer = m_FrameFramebuffer;
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    if (!m_ShowContent || m_DrawItems.empty())
+    {
+        m_DeviceDispatch.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
+    else
+    {
+        // The subpass is filled entirely by the secondary command buffers of the recording threads
+        m_DeviceDispatch.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        m_CommandRecorder.Record(commandBuffer, m_RenderPass, 0, m_FrameFramebuffer, static_cast<uint32_t>(m_DrawItems.size()),
+            [this, extent](VkCommandBuffer secondary, uint32_t first, uint32_t count)
+            {
+                RecordDrawItems(secondary, extent, first, count);
+            });
+    }
+    m_DeviceDispatch.vkCmdEndRenderPass(commandBuffer);
+}
+
+void HelloTriangleApplication::RecordSceneCull(VkCommandBuffer commandBuffer)
+{
+    if (!m_ShowScene)
+    {
+        return;
+    }
+
+    GPU_PROFILE_SCOPE(m_GpuProfiler, commandBuffer, "SceneCull");
+
+    // Animated by frame so headless runs are repeatable
+    m_Scene.UpdateCamera(static_cast<float>(m_FrameCounter) / 60.0f,
+        static_cast<float>(m_FrameWidth) / static_cast<float>(m_FrameHeight));
+    m_Scene.RecordCull(commandBuffer, m_CurrentFrame, m_RenderGraph.GetBuffer(m_SceneCommands),
+        m_RenderGraph.GetBuffer(m_SceneDrawCount));
+}
+
+void HelloTriangleApplication::RecordScenePass(VkCommandBuffer commandBuffer)
+{
+    if (!m_ShowScene)
+    {
+        return;
+    }
+
+    GPU_PROFILE_SCOPE(m_GpuProfiler, commandBuffer, "Scene");
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_SceneRenderPass;
+    renderPassInfo.framebuffer = m_FrameFramebuffer;
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = { m_FrameWidth, m_FrameHeight };
+
+    m_DeviceDispatch.vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    m_Scene.RecordDraw(commandBuffer, m_CurrentFrame, m_RenderGraph.GetBuffer(m_SceneCommands),
+        m_RenderGraph.GetBuffer(m_SceneDrawCount), m_FrameWidth, m_FrameHeight);
+    m_DeviceDispatch.vkCmdEndRenderPass(commandBuffer);
+}
+
+// The render graph moves the target to TRANSFER_SRC_OPTIMAL in front of the copy and makes
+// the copy visible to the host after it
+void HelloTriangleApplication::RecordReadback(VkCommandBuffer commandBuffer)
+{
+    GPU_PROFILE_SCOPE(m_GpuProfiler, commandBuffer, "Readback");
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { m_FrameWidth, m_FrameHeight, 1 };
+
+    m_DeviceDispatch.vkCmdCopyImageToBuffer(commandBuffer, m_RenderGraph.GetImage(m_ColorTarget), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        m_RenderGraph.GetBuffer(m_ReadbackTarget), 1, &region);
+}
+
+// The CPU only ever waits for the frame that used the same slot framesInFlight frames
+// ago, so frame N+1 is recorded while the GPU is still executing frame N.
+void HelloTriangleApplication::DrawFrame()
+{
+    FrameData& frame = m_Frames[m_CurrentFrame];
+
+    {
+        PROFILE_SCOPE("WaitForFrameFence");
+        m_DeviceDispatch.vkWaitForFences(m_LogicalDevice, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
+    }
+
+    ReleaseRetiredSwapChains();
+
+    // Under FIFO the presentation engine usually holds every image, so the acquire blocks until
+    // one is released. The wait is bounded: if no image comes within a frame the frame is skipped
+    // and the loop goes back to processing events, without spinning on the CPU.
+    uint32_t imageIndex = 0;
+    VkResult result;
+    {
+        PROFILE_SCOPE("AcquireImage");
+        result = m_DeviceDispatch.vkAcquireNextImageKHR(m_LogicalDevice, m_SwapChain, ACQUIRE_TIMEOUT_NS, frame.imageAvailableSemaphore,
+            VK_NULL_HANDLE, &imageIndex);
+    }
+
+    if (result == VK_NOT_READY || result == VK_TIMEOUT)
+    {
+        return;
+    }
+    else if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        RecreateSwapChain();
+        return;
+    }
+    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    {
+        throw std::runtime_error("Failed to acquire swap chain image!");
+    }
+
+    // Only reset the fence once work is guaranteed to be submitted with it
+    m_DeviceDispatch.vkResetFences(m_LogicalDevice, 1, &frame.inFlightFence);
+
+    // Streamed assets and texture mips that finished loading go into this frame's flush, within
+    // the frame's budget. The fence has been waited on, so the slot's texture feedback is complete.
+    m_AssetStreamer.Update(m_UploadEngine, m_CurrentFrame);
+
+    // Pending uploads are submitted first, the frame waits for the ones it acquires
+    m_UploadEngine.Flush();
+    m_UploadWaits.Clear();
+    m_UploadWaits.semaphores.push_back(frame.imageAvailableSemaphore);
+    m_UploadWaits.stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+    {
+        PROFILE_SCOPE("RecordCommands");
+        m_CommandRecorder.BeginFrame(m_CurrentFrame);
+        m_FrameRing.BeginFrame(m_CurrentFrame);
+        m_Bindless.BeginFrame(m_CurrentFrame);
+        m_RenderGraph.SetImportedTexture(m_ColorTarget, m_SwapChainImages[imageIndex], m_SwapChainImageViews[imageIndex]);
+        RecordFrame(m_SwapChainFramebuffers[imageIndex], m_SwapChainWidth, m_SwapChainHeight);
+    }
+
+    VkSemaphore renderFinishedSemaphore = m_RenderFinishedSemaphores[imageIndex];
+
+    RenderGraph::SubmitInfo submitInfo;
+    submitInfo.waitSemaphores = m_UploadWaits.semaphores.data();
+    submitInfo.waitStages = m_UploadWaits.stages.data();
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_UploadWaits.semaphores.size());
+    submitInfo.signalSemaphore = renderFinishedSemaphore;
+    submitInfo.fence = frame.inFlightFence;
+
+    {
+        PROFILE_SCOPE("QueueSubmit");
+        m_RenderGraph.Submit(submitInfo);
+    }
+
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &m_SwapChain;
+    presentInfo.pImageIndices = &imageIndex;
+
+    {
+        PROFILE_SCOPE("QueuePresent");
+        result = m_DeviceDispatch.vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+    }
+
+    if (m_FrameCounter == 0)
+    {
+        ReportFirstFrame("presented");
+    }
+    m_CommandCapture.EndFrame(m_FrameCounter);
+    m_FrameCounter++;
+    m_CurrentFrame = (m_CurrentFrame + 1) % m_Config.framesInFlight;
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_FramebufferResized)
+    {
+        m_FramebufferResized = false;
+        RecreateSwapChain();
+    }
+    else if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to present swap chain image!");
+    }
+}
+
+void HelloTriangleApplication::DrawOffscreenFrame()
+{
+    FrameData& frame = m_Frames[m_CurrentFrame];
+    OffscreenTarget& target = m_OffscreenTargets[m_CurrentFrame];
+
+    auto frameStart = std::chrono::steady_clock::now();
+
+    // Wait until the submission that last used this slot is done with its command buffer and target
+    {
+        PROFILE_SCOPE("WaitForFrameFence");
+        m_DeviceDispatch.vkWaitForFences(m_LogicalDevice, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
+    }
+
+    auto submitStart = std::chrono::steady_clock::now();
+
+    if (target.readbackBuffer != VK_NULL_HANDLE && m_FrameCounter >= m_Config.framesInFlight)
+    {
+        PROFILE_SCOPE("Readback");
+        ReadbackFrame(target);
+    }
+
+    m_DeviceDispatch.vkResetFences(m_LogicalDevice, 1, &frame.inFlightFence);
+
+    m_AssetStreamer.Update(m_UploadEngine, m_CurrentFrame);
+    m_UploadEngine.Flush();
+    m_UploadWaits.Clear();
+
+    {
+        PROFILE_SCOPE("RecordCommands");
+        m_CommandRecorder.BeginFrame(m_CurrentFrame);
+        m_FrameRing.BeginFrame(m_CurrentFrame);
+        m_Bindless.BeginFrame(m_CurrentFrame);
+        m_RenderGraph.SetImportedTexture(m_ColorTarget, target.image, target.imageView);
+        if (m_ReadbackTarget != RenderGraph::INVALID_HANDLE)
+        {
+            m_RenderGraph.SetImportedBuffer(m_ReadbackTarget, target.readbackBuffer);
+        }
+        RecordFrame(target.framebuffer, m_Config.width, m_Config.height);
+    }
+
+    RenderGraph::SubmitInfo submitInfo;
+    submitInfo.waitSemaphores = m_UploadWaits.semaphores.data();
+    submitInfo.waitStages = m_UploadWaits.stages.data();
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_UploadWaits.semaphores.size());
+    submitInfo.fence = frame.inFlightFence;
+
+    {
+        PROFILE_SCOPE("QueueSubmit");
+        m_RenderGraph.Submit(submitInfo);
+    }
+
+    auto frameEnd = std::chrono::steady_clock::now();
+    m_RunStats.frameMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+    m_RunStats.submitMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - submitStart).count());
+
+    // There is nothing to present, submission is as close as headless mode gets
+    if (m_FrameCounter == 0)
+    {
+        ReportFirstFrame("submitted");
+    }
+    m_CommandCapture.EndFrame(m_FrameCounter);
+    m_FrameCounter++;
+    m_CurrentFrame = (m_CurrentFrame + 1) % m_Config.framesInFlight;
+}
+
+// Copies a completed frame out of the persistently mapped readback buffer.
+// The caller has to make sure the frame's fence has been waited on.
+void HelloTriangleApplication::ReadbackFrame(const OffscreenTarget& target)
+{
+    std::memcpy(m_LastFrame.data(), target.readbackAllocation->mapped, m_LastFrame.size());
+}
+
+void HelloTriangleApplication::WriteFrameToFile(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing!");
+    }
+
+    // Binary PPM, RGBA pixels are written without the alpha channel
+    file << "P6\n" << m_Config.width << ' ' << m_Config.height << "\n255\n";
+    for (size_t i = 0; i + 3 < m_LastFrame.size(); i += 4)
+    {
+        file.write(reinterpret_cast<const char*>(&m_LastFrame[i]), 3);
+    }
+}
+
+void HelloTriangleApplication::RunHeadless()
+{
+    const uint32_t frameCount = m_Config.frameCount > 0 ? m_Config.frameCount : DEFAULT_HEADLESS_FRAME_COUNT;
+    m_RunStats.frameMs.reserve(frameCount);
+    m_RunStats.submitMs.reserve(frameCount);
+
+    // Frames are compared and dumped, so they show the content rather than whatever had
+    // finished loading by then
+    if (m_Config.waitForContent)
+    {
+        PROFILE_SCOPE("WaitForContent");
+        m_JobSystem.Wait(m_ContentJobs);
+        m_JobSystem.Wait(m_PipelineCacheJob);
+        UpdateContentStatus();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (m_FrameCounter < frameCount)
+    {
+        PROFILE_SCOPE("Frame");
+        UpdateContentStatus();
+        DrawOffscreenFrame();
+        m_HostAllocator.EndFrame();
+        m_DebugMessages.EndFrame();
+    }
+
+    // Make sure every frame has finished before measuring and reading back the last one
+    m_DeviceDispatch.vkDeviceWaitIdle(m_LogicalDevice);
+
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << "Headless: rendered " << frameCount << " frames (" << m_Config.width << 'x' << m_Config.height
+        << ") in " << seconds << " s, " << (frameCount / seconds) << " FPS, "
+        << (seconds * 1000.0 / frameCount) << " ms/frame, " << m_Config.framesInFlight << " frames in flight\n";
+
+    if (m_Config.readback)
+    {
+        ReadbackFrame(m_OffscreenTargets[(frameCount - 1) % m_Config.framesInFlight]);
+        if (!m_Config.dumpPath.empty())
+        {
+            WriteFrameToFile(m_Config.dumpPath);
+            std::cout << "Headless: last frame written to " << m_Config.dumpPath << '\n';
+        }
+    }
+}
+
 void HelloTriangleApplication::Cleanup()
 {
+    PROFILE_FUNCTION();
+
+    // Nothing may be destroyed while the GPU is still using it
+    if (m_LogicalDevice != VK_NULL_HANDLE)
+    {
+        m_DeviceDispatch.vkDeviceWaitIdle(m_LogicalDevice);
+    }
+
+    // A short run can end before the content jobs
+    m_JobSystem.Wait(m_ContentJobs);
+    m_JobSystem.Wait(m_PipelineCacheJob);
+
+    // A run that ends inside the capture range still leaves a replayable file; teardown is not recorded
+    m_CommandCapture.Destroy();
+    m_CommandCapture.PrintStats();
+
+    for (auto& frame : m_Frames)
+    {
+        m_DeviceDispatch.vkDestroyFence(m_LogicalDevice, frame.inFlightFence, m_AllocationCallbacks);
+        m_DeviceDispatch.vkDestroySemaphore(m_LogicalDevice, frame.imageAvailableSemaphore, m_AllocationCallbacks);
+    }
+
+    // Frees the transients, so it goes before the allocator
+    m_RenderGraph.PrintStats();
+    m_RenderGraph.Destroy();
+
+    m_Scene.PrintStats();
+    m_Scene.Destroy();
+
+    // Releases its bindless slots, so it goes before the table
+    m_AssetStreamer.PrintStats();
+    m_AssetStreamer.Destroy();
+
+    m_Bindless.PrintStats();
+    m_Bindless.Destroy();
+
+    m_FrameRing.PrintStats();
+    m_FrameRing.Destroy();
+
+    m_CommandRecorder.PrintStats();
+    m_CommandRecorder.Destroy();
+
+    // The device is idle, so the frames still in flight can be read as well
+    if (m_GpuProfiler.IsEnabled())
+    {
+        m_GpuProfiler.CollectPending();
+        m_GpuProfiler.PrintSummary(std::cout);
+        if (!m_Config.gpuProfilePath.empty())
+        {
+            if (m_GpuProfiler.WriteReport(m_Config.gpuProfilePath))
+            {
+                std::cout << "GPU profile written to " << m_Config.gpuProfilePath << '\n';
+            }
+            else
+            {
+                std::cerr << "Failed to write GPU profile to " << m_Config.gpuProfilePath << '\n';
+            }
+        }
+    }
+    m_GpuProfiler.Destroy();
+
+    m_JobSystem.PrintStats(std::cout);
+    m_JobSystem.Destroy();
+
+    for (auto& retired : m_RetiredSwapChains)
+    {
+        DestroyRetiredSwapChain(retired);
+    }
+    m_RetiredSwapChains.clear();
+
+    if (m_SwapChain != VK_NULL_HANDLE)
+    {
+        RetiredSwapChain current;
+        current.swapChain = m_SwapChain;
+        current.imageViews = std::move(m_SwapChainImageViews);
+        current.framebuffers = std::move(m_SwapChainFramebuffers);
+        current.renderFinishedSemaphores = std::move(m_RenderFinishedSemaphores);
+        DestroyRetiredSwapChain(current);
+    }
+
+    for (auto& target : m_OffscreenTargets)
+    {
+        if (target.readbackBuffer != VK_NULL_HANDLE)
+        {
+            m_DeviceDispatch.vkDestroyBuffer(m_LogicalDevice, target.readbackBuffer, m_AllocationCallbacks);
+            m_GpuAllocator.Free(target.readbackAllocation);
+        }
+        m_DeviceDispatch.vkDestroyFramebuffer(m_LogicalDevice, target.framebuffer, m_AllocationCallbacks);
+        m_DeviceDispatch.vkDestroyImageView(m_LogicalDevice, target.imageView, m_AllocationCallbacks);
+        m_DeviceDispatch.vkDestroyImage(m_LogicalDevice, target.image, m_AllocationCallbacks);
+        m_GpuAllocator.Free(target.imageAllocation);
+    }
+
+    if (m_RenderPass != VK_NULL_HANDLE)
+    {
+        m_DeviceDispatch.vkDestroyRenderPass(m_LogicalDevice, m_RenderPass, m_AllocationCallbacks);
+    }
+    if (m_SceneRenderPass != VK_NULL_HANDLE)
+    {
+        m_DeviceDispatch.vkDestroyRenderPass(m_LogicalDevice, m_SceneRenderPass, m_AllocationCallbacks);
+    }
+
+    if (m_UploadEngine.GetStats().batches > 0)
+    {
+        m_UploadEngine.PrintStats();
+    }
+    m_UploadEngine.Destroy();
+
+    m_GpuAllocator.PrintStats();
+    m_GpuAllocator.Destroy();
+
+    // Persist whatever was compiled during this run before the device goes away
+    if (m_PipelineCache.GetHandle() != VK_NULL_HANDLE)
+    {
+        m_PipelineCache.Save();
+        m_PipelineCache.PrintStats();
+        m_PipelineCache.Destroy();
+    }
+
     if (b_EnableValidationLayers && m_DebugMessenger != VK_NULL_HANDLE)
     {
         // Destroy the debug messanger
-        DestroyDebugUtilsMessengerEXT(m_Instance, m_DebugMessenger, nullptr);
+        DestroyDebugUtilsMessengerEXT(m_InstanceDispatch, m_Instance, m_DebugMessenger, m_AllocationCallbacks);
     }
 
     // Destroy the logical device
     // Logical devices dont interact directly with instances, which is why its not included as a parameter.
-    vkDestroyDevice(m_LogicalDevice, nullptr);
+    m_DeviceDispatch.vkDestroyDevice(m_LogicalDevice, m_AllocationCallbacks);
 
     // Destroy the surface
-    vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
+    vkDestroySurfaceKHR(m_Instance, m_Surface, m_AllocationCallbacks);
 
     // Destroy the Vulkan instance
-    vkDestroyInstance(m_Instance, nullptr);
+    vkDestroyInstance(m_Instance, m_AllocationCallbacks);
 
-    // Destroy the window 
-    glfwDestroyWindow(m_Window);
+    // Nothing can report a message anymore, print what is still queued
+    m_DebugMessages.Stop();
+    m_DebugMessages.PrintStats(std::cout);
 
-    // Terminate GLFW
-    glfwTerminate();
+    // Everything the driver allocated is freed by now, live bytes left over are leaks
+    m_HostAllocator.PrintStats(std::cout);
+
+    if (m_Window != nullptr)
+    {
+        // Destroy the window 
+        glfwDestroyWindow(m_Window);
+
+        // Terminate GLFW
+        glfwTerminate();
+    }
 
     std::cout << "Cleanup complete\n";
 }
@@ -405,15 +2309,17 @@ void HelloTriangleApplication::Cleanup()
 
 void HelloTriangleApplication::SetupDebugMessenger()
 {
+    PROFILE_FUNCTION();
+
     if (!b_EnableValidationLayers)
     {
         return;
     }
 
     VkDebugUtilsMessengerCreateInfoEXT createInfoValidation{};
-    PopulateDebugMessengerCreateInfo(createInfoValidation);
+    PopulateDebugMessengerCreateInfo(createInfoValidation, &m_DebugMessages);
 
-    if (CreateDebugUtilsMessengerEXT(m_Instance, &createInfoValidation, nullptr, &m_DebugMessenger) != VK_SUCCESS) {
+    if (CreateDebugUtilsMessengerEXT(m_InstanceDispatch, m_Instance, &createInfoValidation, m_AllocationCallbacks, &m_DebugMessenger) != VK_SUCCESS) {
         throw std::runtime_error("failed to set up debug messenger!");
     }
 }
@@ -452,6 +2358,8 @@ bool HelloTriangleApplication::ValidateExtensions(const char **extensions, uint3
         }
     }
 
+    return true;
+
     /* -------- Alternative implementation using std::set --------
     // Create a set of available extension names for O(log n) lookup
     std::set<std::string> availableSet;
@@ -516,10 +2424,13 @@ bool HelloTriangleApplication::CheckValidationLayerSupport()
 std::vector<const char*> HelloTriangleApplication::GetRequiredExtensions()
 {
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
+    const char** glfwExtensions = nullptr;
 
-    // Get the required extensions from GLFW
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    // Get the required extensions from GLFW, a headless instance needs no surface extensions
+    if (!m_Config.headless)
+    {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    }
     
     std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
     
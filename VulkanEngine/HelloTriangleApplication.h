@@ -1,43 +1,173 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <list>
+#include <string>
 #include <vector>
 
+#include "AssetStreamer.h"
+#include "CommandCapture.h"
+#include "CommandRecorder.h"
+#include "DebugMessageQueue.h"
+#include "BindlessDescriptors.h"
+#include "EngineConfig.h"
+#include "FrameRingBuffer.h"
+#include "GpuAllocator.h"
+#include "GpuProfiler.h"
+#include "GpuScene.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "UploadEngine.h"
+#include "VulkanDispatch.h"
+#include "VulkanFwd.h"
+
+#if defined(_WIN32)
 #define PLATFORM_WIN 1
+#else
+#define PLATFORM_WIN 0
+#endif
 
 struct GLFWwindow;
-struct VkInstance_T;
-typedef VkInstance_T* VkInstance;
-struct VkDebugUtilsMessengerEXT_T;
-typedef VkDebugUtilsMessengerEXT_T *VkDebugUtilsMessengerEXT;
-struct VkPhysicalDevice_T;
-typedef VkPhysicalDevice_T* VkPhysicalDevice;
-struct VkDevice_T;
-typedef VkDevice_T* VkDevice;
-struct VkQueue_T;
-typedef VkQueue_T* VkQueue;
-struct VkSurfaceKHR_T;
-typedef VkSurfaceKHR_T* VkSurfaceKHR;
 
 class HelloTriangleApplication
 {
 public:
+    explicit HelloTriangleApplication(const EngineConfig& config = EngineConfig{})
+        : m_Config(config)
+    {
+    }
+
+    ~HelloTriangleApplication()
+    {
+        // Content jobs still running after an error use the members destroyed below
+        if (m_JobSystem.GetThreadCount() > 0)
+        {
+            m_JobSystem.Wait(m_ContentJobs);
+            m_JobSystem.Wait(m_PipelineCacheJob);
+        }
+    }
+
     void run()
     {
-        InitWindow();
+        m_StartTime = std::chrono::steady_clock::now();
+        Profiler::SetThreadName("Main");
+
+        // The calling thread becomes the job system's main thread
+        m_JobSystem.Create(m_Config.workerThreads);
+
+        // Creates the window as well, while the instance is created on another thread
         InitVulkan();
         MainLoop();
         Cleanup();
     }
 
+    // Called from the GLFW framebuffer size callback
+    void OnFramebufferResized() { m_FramebufferResized = true; }
+
+    // Timings of the last run, for the benchmark suite. Times are in milliseconds,
+    // the startup ones are measured from the start of run().
+    struct RunStats
+    {
+        double              initMs          = 0.0;
+        double              firstFrameMs    = 0.0;
+        double              instanceMs      = 0.0;  // vkCreateInstance
+        double              deviceMs        = 0.0;  // vkCreateDevice
+        uint64_t            placeholderFrames = 0;  // rendered before the content was ready
+        std::vector<double> frameMs;                // headless frames, fence wait included
+        std::vector<double> submitMs;               // headless recording and submission only
+    };
+
+    const RunStats& GetRunStats() const { return m_RunStats; }
+
 private:
+    // Objects owned by one frame in flight
+    struct FrameData
+    {
+        VkSemaphore     imageAvailableSemaphore = nullptr;
+        VkFence         inFlightFence           = nullptr;
+    };
+
+    // One entry of the draw list, a rectangle in normalized framebuffer coordinates
+    struct DrawItem
+    {
+        float   x, y, width, height;
+        float   color[4];
+    };
+
+    // Color target used instead of a swapchain image in headless mode
+    struct OffscreenTarget
+    {
+        VkImage         image           = nullptr;
+        GpuAllocator::Allocation* imageAllocation = nullptr;
+        VkImageView     imageView       = nullptr;
+        VkFramebuffer   framebuffer     = nullptr;
+
+        // Host visible buffer the image is copied into, mapped for the whole run
+        VkBuffer        readbackBuffer  = nullptr;
+        GpuAllocator::Allocation* readbackAllocation = nullptr;
+    };
+
+    // A replaced swapchain whose objects may still be referenced by frames in flight
+    struct RetiredSwapChain
+    {
+        VkSwapchainKHR              swapChain = nullptr;
+        std::vector<VkImageView>    imageViews;
+        std::vector<VkFramebuffer>  framebuffers;
+        std::vector<VkSemaphore>    renderFinishedSemaphores;
+        uint64_t                    retireFrame = 0;
+    };
+
     void InitWindow();
     void CreateInstance();
     void InitVulkan();
     void PickPhysicalDevice();
     void CreateLogicalDevice();
+    void CreateGpuAllocator();
+    void CreateFrameRing();
+    void CreateBindless();
+    void CreateAssetStreamer();
+    void CreatePipelineCache();
     void CreateSurface();
     void CreateSurfaceForPlatform();
+    VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) const;
+    void CreateSwapChain(VkSwapchainKHR oldSwapChain);
+    void CreateImageViews();
+    void CreateRenderFinishedSemaphores();
+    void RecreateSwapChain();
+    void DestroyRetiredSwapChain(RetiredSwapChain& retired);
+    void ReleaseRetiredSwapChains();
+    void CreateOffscreenTargets();
+    void CreateRenderPass();
+    void CreateFramebuffers();
+    void CreateOffscreenFramebuffers();
+    void CreateReadbackBuffer(OffscreenTarget& target);
+    void CreateCommandPools();
+    void CreateRenderGraph();
+    void CreateDrawList();
+    void CreateScene();
+    void CreateSyncObjects();
+    void CreateGpuProfiler();
+    void CreateUploadEngine(uint32_t transferFamily, uint32_t graphicsFamily);
+    void LoadContent();
+    void UpdateContentStatus();
+    void ReportFirstFrame(const char* event);
+    void RecordFrame(VkFramebuffer framebuffer, uint32_t width, uint32_t height);
+    void RecordMainPass(VkCommandBuffer commandBuffer);
+    void RecordReadback(VkCommandBuffer commandBuffer);
+    void RecordSceneCull(VkCommandBuffer commandBuffer);
+    void RecordScenePass(VkCommandBuffer commandBuffer);
+    void RecordDrawItems(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t first, uint32_t count) const;
+    void DrawFrame();
+    void DrawOffscreenFrame();
+    void ReadbackFrame(const OffscreenTarget& target);
+    void WriteFrameToFile(const std::string& path) const;
+    void RunHeadless();
     void MainLoop();
     void Cleanup();
     void SetupDebugMessenger();
@@ -45,15 +175,114 @@ private:
     bool CheckValidationLayerSupport();
     std::vector<const char*> GetRequiredExtensions();
 
+    EngineConfig        m_Config;
+    JobSystem           m_JobSystem;
+
+    // Validation layer output, printed off the thread that made the Vulkan call
+    DebugMessageQueue   m_DebugMessages;
+
     GLFWwindow*         m_Window            = nullptr;
     VkInstance          m_Instance          = nullptr;
+    VulkanInstanceDispatch m_InstanceDispatch;
+    uint32_t            m_InstanceApiVersion = 0;
     VkPhysicalDevice    m_PhysicalDevice    = nullptr;
     VkDevice            m_LogicalDevice     = nullptr;
+    VulkanDeviceDispatch m_DeviceDispatch;              // the subsystems keep a reference, the capture wraps it
     VkQueue             m_GraphicsQueue     = nullptr;
     VkSurfaceKHR        m_Surface           = nullptr;
     VkQueue             m_PresentQueue      = nullptr;
+    VkQueue             m_ComputeQueue      = nullptr; // same as m_GraphicsQueue without a dedicated family
+    VkQueue             m_TransferQueue     = nullptr; // same as m_GraphicsQueue without a dedicated family
+
+    PipelineCache       m_PipelineCache;
+    bool                m_PipelineCreationFeedback = false;
+    bool                m_MemoryBudget      = false;
+    bool                m_Synchronization2  = false;
+    bool                m_MultiDrawIndirect = false;
+    bool                m_DrawIndirectCount = false;
+    bool                m_DescriptorIndexing = false;
+    bool                m_ExternalMemoryHost = false;
+    bool                m_TextureCompressionBC = false;
+    bool                m_PipelineStatisticsQuery = false;
+    GpuAllocator        m_GpuAllocator;
+
+    // Host memory the driver allocates for our objects; null when the driver's own allocator is used
+    HostAllocator                   m_HostAllocator;
+    const VkAllocationCallbacks*    m_AllocationCallbacks = nullptr;
+
+    VkSwapchainKHR              m_SwapChain             = nullptr;
+    std::vector<VkImage>        m_SwapChainImages;
+    std::vector<VkImageView>    m_SwapChainImageViews;
+    std::vector<VkFramebuffer>  m_SwapChainFramebuffers;
+    std::vector<VkSemaphore>    m_RenderFinishedSemaphores;
+    uint32_t                    m_SwapChainImageFormat  = 0; // VkFormat
+    uint32_t                    m_SwapChainWidth        = 0;
+    uint32_t                    m_SwapChainHeight       = 0;
+    std::list<RetiredSwapChain> m_RetiredSwapChains;
+    bool                        m_FramebufferResized    = false;
+
+    std::vector<OffscreenTarget> m_OffscreenTargets;
+    std::vector<uint8_t>        m_LastFrame;
+
+    VkRenderPass            m_RenderPass        = nullptr;
+    std::vector<FrameData>  m_Frames;
+    uint32_t                m_CurrentFrame      = 0;
+    uint64_t                m_FrameCounter      = 0;
+
+    // Recorded into secondary command buffers by jobs
+    std::vector<DrawItem>   m_DrawItems;
+
+    // Content is loaded by jobs while the first frames only show the clear color.
+    // m_DrawItems may only be read once m_ContentReady is set.
+    JobCounter              m_ContentJobs;
+    JobCounter              m_PipelineCacheJob;     // the scene job waits for it
+    std::atomic<bool>       m_ContentReady      { false };
+    std::atomic<bool>       m_SceneReady        { false };
+    std::atomic<bool>       m_ContentFailed     { false };
+    std::exception_ptr      m_PipelineCacheError;   // each written by its own job
+    std::exception_ptr      m_DrawListError;
+    std::exception_ptr      m_SceneError;
+    bool                    m_ShowContent       = false;    // m_ContentReady as seen by this frame
+    bool                    m_ShowScene         = false;    // set once the scene upload is queued
+
+    // Cold start and frame timing
+    std::chrono::steady_clock::time_point m_StartTime;
+    RunStats                m_RunStats;
+    CommandRecorder         m_CommandRecorder;
+
+    // Disabled unless a GPU profile was asked for
+    GpuProfiler             m_GpuProfiler;
+
+    // Disabled unless --capture was given, stops by itself after the last captured frame
+    CommandCapture          m_CommandCapture;
+
+    // Uniforms and other data rewritten every frame
+    FrameRingBuffer         m_FrameRing;
+
+    // Textures, samplers and storage buffers shaders index by slot
+    BindlessDescriptors     m_Bindless;
+
+    // Meshes and textures of the asset pack, loaded by priority while frames are rendered
+    AssetStreamer           m_AssetStreamer;
+
+    UploadEngine                m_UploadEngine;
+    UploadEngine::GraphicsWaits m_UploadWaits;
+
+    // The passes of a frame. Owns the primary command buffers and places the barriers.
+    RenderGraph             m_RenderGraph;
+    RenderGraph::Handle     m_ColorTarget       = RenderGraph::INVALID_HANDLE;  // swapchain image or offscreen target
+    RenderGraph::Handle     m_ReadbackTarget    = RenderGraph::INVALID_HANDLE;
+    VkFramebuffer           m_FrameFramebuffer  = nullptr;  // of the frame being recorded
+    uint32_t                m_FrameWidth        = 0;
+    uint32_t                m_FrameHeight       = 0;
+
+    // Culled by a compute pass and drawn with indirect draws over the main pass
+    GpuScene                m_Scene;
+    VkRenderPass            m_SceneRenderPass   = nullptr;
+    RenderGraph::Handle     m_SceneCommands     = RenderGraph::INVALID_HANDLE;
+    RenderGraph::Handle     m_SceneDrawCount    = RenderGraph::INVALID_HANDLE;
 
-    // Even the debug callback in Vulkan is managed with a handle 
+    // Even the debug callback in Vulkan is managed with a handle
     // that needs to be explicitly created and destroyed
     VkDebugUtilsMessengerEXT m_DebugMessenger = nullptr;
 };
@@ -0,0 +1,563 @@
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace
+{
+    // Every allocation is preceded by a header, so Free and Reallocate know where it came from
+    enum class BlockKind : uint8_t
+    {
+        Pool,
+        Arena,
+        Large,
+    };
+
+    struct Header
+    {
+        BlockKind   kind;
+        uint8_t     scope;
+        uint8_t     sizeClass;
+        uint8_t     reserved;
+        uint32_t    offset;     // from the start of the system allocation, large blocks only
+        uint64_t    size;       // as requested
+    };
+
+    constexpr size_t HEADER_SIZE = 16;
+    static_assert(sizeof(Header) == HEADER_SIZE, "The header has to keep the user pointer 16 byte aligned");
+
+    // Alignment every pool chunk and arena allocation gets without asking
+    constexpr size_t BASE_ALIGNMENT = 16;
+
+    // Chunk sizes including the header. Drivers mostly allocate small bookkeeping objects,
+    // anything above the last class is rare enough to go to the system heap.
+    constexpr std::array<uint32_t, 13> CLASS_SIZES = { 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+    constexpr uint32_t CLASS_COUNT = static_cast<uint32_t>(CLASS_SIZES.size());
+    constexpr size_t MAX_POOL_SIZE = CLASS_SIZES[CLASS_COUNT - 1] - HEADER_SIZE;
+
+    // Chunks are carved out of pages of this size
+    constexpr size_t PAGE_SIZE = 64 * 1024;
+
+    // A thread keeps at most this many bytes of free chunks per class, half of the
+    // excess goes back to the central lists where other threads can pick it up
+    constexpr size_t THREAD_CACHE_LIMIT = 2 * PAGE_SIZE;
+
+    // Per-thread scratch for VK_SYSTEM_ALLOCATION_SCOPE_COMMAND
+    constexpr size_t ARENA_SIZE = 256 * 1024;
+
+    struct FreeChunk
+    {
+        FreeChunk* next;
+    };
+
+    uint8_t* AlignPointer(uint8_t* pointer, size_t alignment)
+    {
+        uintptr_t value = reinterpret_cast<uintptr_t>(pointer);
+        return reinterpret_cast<uint8_t*>((value + alignment - 1) / alignment * alignment);
+    }
+
+    Header* GetHeader(void* memory)
+    {
+        return reinterpret_cast<Header*>(static_cast<uint8_t*>(memory) - HEADER_SIZE);
+    }
+
+    uint32_t GetSizeClass(size_t chunkSize)
+    {
+        // Indexed by chunk size in 16 byte steps
+        static const auto table = []()
+        {
+            std::array<uint8_t, CLASS_SIZES[CLASS_COUNT - 1] / BASE_ALIGNMENT + 1> result{};
+            uint32_t sizeClass = 0;
+            for (size_t i = 0; i < result.size(); i++)
+            {
+                while (CLASS_SIZES[sizeClass] < i * BASE_ALIGNMENT)
+                {
+                    sizeClass++;
+                }
+                result[i] = static_cast<uint8_t>(sizeClass);
+            }
+            return result;
+        }();
+        return table[(chunkSize + BASE_ALIGNMENT - 1) / BASE_ALIGNMENT];
+    }
+
+    // Free chunks shared by all threads and the pages they were carved from.
+    // Only touched when a thread cache runs empty or overflows.
+    struct CentralPool
+    {
+        std::mutex          mutex;
+        FreeChunk*          lists[CLASS_COUNT] = {};
+        std::vector<void*>  pages;
+
+        ~CentralPool()
+        {
+            for (void* page : pages)
+            {
+                std::free(page);
+            }
+        }
+    };
+
+    CentralPool& GetCentralPool()
+    {
+        static CentralPool pool;
+        return pool;
+    }
+
+    struct ThreadCache
+    {
+        FreeChunk*  lists[CLASS_COUNT] = {};
+        size_t      counts[CLASS_COUNT] = {};
+
+        uint8_t*    arena       = nullptr;
+        uint8_t*    arenaTop    = nullptr;
+        uint32_t    arenaLive   = 0;
+
+        ~ThreadCache()
+        {
+            CentralPool& central = GetCentralPool();
+            std::lock_guard<std::mutex> lock(central.mutex);
+            for (uint32_t c = 0; c < CLASS_COUNT; c++)
+            {
+                while (lists[c] != nullptr)
+                {
+                    FreeChunk* chunk = lists[c];
+                    lists[c] = chunk->next;
+                    chunk->next = central.lists[c];
+                    central.lists[c] = chunk;
+                }
+            }
+
+            // A command allocation still alive here would be a driver bug, keep the memory then
+            if (arenaLive == 0)
+            {
+                std::free(arena);
+            }
+        }
+
+        void Refill(uint32_t sizeClass)
+        {
+            CentralPool& central = GetCentralPool();
+            std::lock_guard<std::mutex> lock(central.mutex);
+
+            const size_t chunkSize = CLASS_SIZES[sizeClass];
+            const size_t batch = PAGE_SIZE / chunkSize;
+
+            // Take back chunks other threads returned before carving a new page
+            for (size_t i = 0; i < batch && central.lists[sizeClass] != nullptr; i++)
+            {
+                FreeChunk* chunk = central.lists[sizeClass];
+                central.lists[sizeClass] = chunk->next;
+                chunk->next = lists[sizeClass];
+                lists[sizeClass] = chunk;
+                counts[sizeClass]++;
+            }
+            if (lists[sizeClass] != nullptr)
+            {
+                return;
+            }
+
+            uint8_t* page = static_cast<uint8_t*>(std::malloc(PAGE_SIZE));
+            if (page == nullptr)
+            {
+                return;
+            }
+            central.pages.push_back(page);
+
+            for (size_t i = batch; i-- > 0; )
+            {
+                FreeChunk* chunk = reinterpret_cast<FreeChunk*>(page + i * chunkSize);
+                chunk->next = lists[sizeClass];
+                lists[sizeClass] = chunk;
+            }
+            counts[sizeClass] += batch;
+        }
+
+        void Trim(uint32_t sizeClass)
+        {
+            CentralPool& central = GetCentralPool();
+            std::lock_guard<std::mutex> lock(central.mutex);
+
+            for (size_t i = counts[sizeClass] / 2; i > 0; i--)
+            {
+                FreeChunk* chunk = lists[sizeClass];
+                lists[sizeClass] = chunk->next;
+                chunk->next = central.lists[sizeClass];
+                central.lists[sizeClass] = chunk;
+                counts[sizeClass]--;
+            }
+        }
+    };
+
+    thread_local ThreadCache t_Cache;
+
+    void* AllocateFromPool(size_t size, uint32_t scope)
+    {
+        const uint32_t sizeClass = GetSizeClass(size + HEADER_SIZE);
+        ThreadCache& cache = t_Cache;
+
+        if (cache.lists[sizeClass] == nullptr)
+        {
+            cache.Refill(sizeClass);
+            if (cache.lists[sizeClass] == nullptr)
+            {
+                return nullptr;
+            }
+        }
+
+        FreeChunk* chunk = cache.lists[sizeClass];
+        cache.lists[sizeClass] = chunk->next;
+        cache.counts[sizeClass]--;
+
+        Header* header = reinterpret_cast<Header*>(chunk);
+        header->kind = BlockKind::Pool;
+        header->scope = static_cast<uint8_t>(scope);
+        header->sizeClass = static_cast<uint8_t>(sizeClass);
+        header->offset = 0;
+        header->size = size;
+        return reinterpret_cast<uint8_t*>(chunk) + HEADER_SIZE;
+    }
+
+    void FreeToPool(Header* header)
+    {
+        const uint32_t sizeClass = header->sizeClass;
+        ThreadCache& cache = t_Cache;
+
+        // The chunk joins the cache of the freeing thread, wherever it was allocated
+        FreeChunk* chunk = reinterpret_cast<FreeChunk*>(header);
+        chunk->next = cache.lists[sizeClass];
+        cache.lists[sizeClass] = chunk;
+        cache.counts[sizeClass]++;
+
+        if (cache.counts[sizeClass] * CLASS_SIZES[sizeClass] > THREAD_CACHE_LIMIT)
+        {
+            cache.Trim(sizeClass);
+        }
+    }
+
+    void* AllocateFromArena(size_t size, size_t alignment, uint32_t scope)
+    {
+        ThreadCache& cache = t_Cache;
+        if (cache.arena == nullptr)
+        {
+            cache.arena = static_cast<uint8_t*>(std::malloc(ARENA_SIZE));
+            if (cache.arena == nullptr)
+            {
+                return nullptr;
+            }
+            cache.arenaTop = cache.arena;
+        }
+
+        uint8_t* memory = AlignPointer(cache.arenaTop + HEADER_SIZE, std::max(alignment, BASE_ALIGNMENT));
+        if (memory + size > cache.arena + ARENA_SIZE)
+        {
+            return nullptr;
+        }
+        cache.arenaTop = memory + size;
+        cache.arenaLive++;
+
+        Header* header = GetHeader(memory);
+        header->kind = BlockKind::Arena;
+        header->scope = static_cast<uint8_t>(scope);
+        header->sizeClass = 0;
+        header->offset = 0;
+        header->size = size;
+        return memory;
+    }
+
+    void FreeToArena(Header* header)
+    {
+        ThreadCache& cache = t_Cache;
+        uint8_t* memory = reinterpret_cast<uint8_t*>(header);
+
+        // Command allocations never outlive the call that made them, so they are freed on the
+        // thread that owns the arena. Anything else is ignored; that arena then never rewinds
+        // and further command allocations on its thread fall back to the pools.
+        if (memory < cache.arena || memory >= cache.arena + ARENA_SIZE)
+        {
+            return;
+        }
+
+        // Once nothing is live the whole arena is free again
+        if (--cache.arenaLive == 0)
+        {
+            cache.arenaTop = cache.arena;
+        }
+    }
+
+    void* AllocateLarge(size_t size, size_t alignment, uint32_t scope)
+    {
+        alignment = std::max(alignment, BASE_ALIGNMENT);
+        uint8_t* base = static_cast<uint8_t*>(std::malloc(size + alignment + HEADER_SIZE));
+        if (base == nullptr)
+        {
+            return nullptr;
+        }
+
+        uint8_t* memory = AlignPointer(base + HEADER_SIZE, alignment);
+        Header* header = GetHeader(memory);
+        header->kind = BlockKind::Large;
+        header->scope = static_cast<uint8_t>(scope);
+        header->sizeClass = 0;
+        header->offset = static_cast<uint32_t>(memory - base);
+        header->size = size;
+        return memory;
+    }
+}
+
+struct HostAllocator::Callbacks
+{
+    static VKAPI_ATTR void* VKAPI_CALL Allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        return static_cast<HostAllocator*>(userData)->AllocateMemory(size, alignment, static_cast<uint32_t>(scope));
+    }
+
+    static VKAPI_ATTR void* VKAPI_CALL Reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+    {
+        return static_cast<HostAllocator*>(userData)->ReallocateMemory(original, size, alignment, static_cast<uint32_t>(scope));
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL Free(void* userData, void* memory)
+    {
+        static_cast<HostAllocator*>(userData)->FreeMemory(memory);
+    }
+
+    // Memory the driver allocates itself, e.g. executable memory for shaders
+    static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+    {
+        HostAllocator* allocator = static_cast<HostAllocator*>(userData);
+        allocator->m_InternalAllocations.fetch_add(1, std::memory_order_relaxed);
+        allocator->m_InternalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL InternalFree(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+    {
+        static_cast<HostAllocator*>(userData)->m_InternalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+    }
+};
+
+HostAllocator::HostAllocator()
+    : m_Callbacks(std::make_unique<VkAllocationCallbacks>())
+{
+    m_Callbacks->pUserData = this;
+    m_Callbacks->pfnAllocation = &Callbacks::Allocation;
+    m_Callbacks->pfnReallocation = &Callbacks::Reallocation;
+    m_Callbacks->pfnFree = &Callbacks::Free;
+    m_Callbacks->pfnInternalAllocation = &Callbacks::InternalAllocation;
+    m_Callbacks->pfnInternalFree = &Callbacks::InternalFree;
+}
+
+HostAllocator::~HostAllocator() = default;
+
+const VkAllocationCallbacks* HostAllocator::GetCallbacks() const
+{
+    return m_Enabled ? m_Callbacks.get() : nullptr;
+}
+
+void* HostAllocator::AllocateMemory(size_t size, size_t alignment, uint32_t scope)
+{
+    if (size == 0 || scope >= SCOPE_COUNT)
+    {
+        return nullptr;
+    }
+
+    AtomicScopeStats& stats = m_Scopes[scope];
+    void* memory = nullptr;
+
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+    {
+        memory = AllocateFromArena(size, alignment, scope);
+        if (memory != nullptr)
+        {
+            stats.arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (memory == nullptr && size <= MAX_POOL_SIZE && alignment <= BASE_ALIGNMENT)
+    {
+        memory = AllocateFromPool(size, scope);
+        if (memory != nullptr)
+        {
+            stats.poolAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (memory == nullptr)
+    {
+        memory = AllocateLarge(size, alignment, scope);
+        if (memory == nullptr)
+        {
+            // Vulkan turns this into VK_ERROR_OUT_OF_HOST_MEMORY
+            return nullptr;
+        }
+        stats.largeAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    stats.allocations.fetch_add(1, std::memory_order_relaxed);
+    CountLive(scope, static_cast<int64_t>(size));
+    return memory;
+}
+
+void* HostAllocator::ReallocateMemory(void* original, size_t size, size_t alignment, uint32_t scope)
+{
+    if (original == nullptr)
+    {
+        return AllocateMemory(size, alignment, scope);
+    }
+    if (size == 0)
+    {
+        FreeMemory(original);
+        return nullptr;
+    }
+
+    Header* header = GetHeader(original);
+    const uint32_t oldScope = header->scope;
+    const size_t oldSize = static_cast<size_t>(header->size);
+    const bool aligned = reinterpret_cast<uintptr_t>(original) % std::max(alignment, BASE_ALIGNMENT) == 0;
+
+    // Grow or shrink in place while the chunk is big enough
+    if (header->kind == BlockKind::Pool && aligned && size + HEADER_SIZE <= CLASS_SIZES[header->sizeClass])
+    {
+        header->size = size;
+        m_Scopes[oldScope].reallocations.fetch_add(1, std::memory_order_relaxed);
+        CountLive(oldScope, static_cast<int64_t>(size) - static_cast<int64_t>(oldSize));
+        return original;
+    }
+
+    void* memory = AllocateMemory(size, alignment, scope);
+    if (memory == nullptr)
+    {
+        // The original stays valid, as the spec requires
+        return nullptr;
+    }
+
+    std::memcpy(memory, original, std::min(size, oldSize));
+    FreeMemory(original);
+
+    // Counted as one reallocation instead of an allocation and a free
+    AtomicScopeStats& stats = m_Scopes[scope];
+    stats.allocations.fetch_sub(1, std::memory_order_relaxed);
+    stats.reallocations.fetch_add(1, std::memory_order_relaxed);
+    m_Scopes[oldScope].frees.fetch_sub(1, std::memory_order_relaxed);
+    return memory;
+}
+
+void HostAllocator::FreeMemory(void* memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+
+    Header* header = GetHeader(memory);
+    const uint32_t scope = header->scope;
+    const int64_t size = static_cast<int64_t>(header->size);
+
+    switch (header->kind)
+    {
+    case BlockKind::Pool:
+        FreeToPool(header);
+        break;
+    case BlockKind::Arena:
+        FreeToArena(header);
+        break;
+    case BlockKind::Large:
+        std::free(static_cast<uint8_t*>(memory) - header->offset);
+        break;
+    }
+
+    m_Scopes[scope].frees.fetch_add(1, std::memory_order_relaxed);
+    CountLive(scope, -size);
+}
+
+void HostAllocator::CountLive(uint32_t scope, int64_t bytes)
+{
+    AtomicScopeStats& stats = m_Scopes[scope];
+    int64_t live = stats.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    int64_t peak = stats.peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !stats.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+void HostAllocator::EndFrame()
+{
+    uint64_t total = 0;
+    for (const AtomicScopeStats& stats : m_Scopes)
+    {
+        total += stats.allocations.load(std::memory_order_relaxed) + stats.reallocations.load(std::memory_order_relaxed);
+    }
+
+    // The first frame creates pipelines and other lazily built driver state, it is
+    // left out of the steady state numbers
+    uint64_t frameAllocations = total - m_AllocationsAtFrame;
+    m_AllocationsAtFrame = total;
+    if (++m_Frames == 1)
+    {
+        m_AllocationsAfterFirstFrame = total;
+    }
+    else
+    {
+        m_MaxFrameAllocations = std::max(m_MaxFrameAllocations, frameAllocations);
+    }
+}
+
+HostAllocator::ScopeStats HostAllocator::GetScopeStats(uint32_t scope) const
+{
+    const AtomicScopeStats& stats = m_Scopes[scope];
+
+    ScopeStats result;
+    result.allocations = stats.allocations.load(std::memory_order_relaxed);
+    result.reallocations = stats.reallocations.load(std::memory_order_relaxed);
+    result.frees = stats.frees.load(std::memory_order_relaxed);
+    result.poolAllocations = stats.poolAllocations.load(std::memory_order_relaxed);
+    result.arenaAllocations = stats.arenaAllocations.load(std::memory_order_relaxed);
+    result.largeAllocations = stats.largeAllocations.load(std::memory_order_relaxed);
+    result.liveBytes = stats.liveBytes.load(std::memory_order_relaxed);
+    result.peakBytes = stats.peakBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void HostAllocator::PrintStats(std::ostream& out) const
+{
+    if (!m_Enabled)
+    {
+        out << "Host allocations: driver default allocator\n";
+        return;
+    }
+
+    static const char* scopeNames[SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+
+    out << std::left << std::setw(20) << "Host allocations" << std::right << std::setw(10) << "allocs" << std::setw(10) << "reallocs"
+        << std::setw(10) << "frees" << std::setw(10) << "pool" << std::setw(10) << "arena" << std::setw(10) << "large"
+        << std::setw(12) << "live KiB" << std::setw(12) << "peak KiB" << '\n';
+
+    out << std::fixed << std::setprecision(1);
+    for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++)
+    {
+        ScopeStats stats = GetScopeStats(scope);
+        out << "  " << std::left << std::setw(18) << scopeNames[scope] << std::right << std::setw(10) << stats.allocations
+            << std::setw(10) << stats.reallocations << std::setw(10) << stats.frees << std::setw(10) << stats.poolAllocations
+            << std::setw(10) << stats.arenaAllocations << std::setw(10) << stats.largeAllocations
+            << std::setw(12) << stats.liveBytes / 1024.0 << std::setw(12) << stats.peakBytes / 1024.0 << '\n';
+    }
+
+    out << "  driver internal: " << m_InternalAllocations.load(std::memory_order_relaxed) << " allocations, "
+        << m_InternalBytes.load(std::memory_order_relaxed) / 1024.0 << " KiB live\n";
+
+    if (m_Frames > 1)
+    {
+        out << "  per frame after the first: " << static_cast<double>(m_AllocationsAtFrame - m_AllocationsAfterFirstFrame) / (m_Frames - 1)
+            << " allocations on average, " << m_MaxFrameAllocations << " at most\n";
+    }
+    out << std::defaultfloat;
+}
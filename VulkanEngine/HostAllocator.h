@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <iosfwd>
+#include <memory>
+
+#include "VulkanFwd.h"
+
+// VkAllocationCallbacks that take the driver's host allocations off the global heap
+// and count them per VkSystemAllocationScope.
+//
+// - Small allocations come from size class free lists that are private to each thread,
+//   so the common case takes no lock and never calls malloc.
+// - VK_SYSTEM_ALLOCATION_SCOPE_COMMAND allocations only live for the duration of one
+//   Vulkan call, which also means they are made and freed on the same thread. They are
+//   bumped out of a per-thread arena that rewinds whenever no command allocation is live,
+//   so scratch memory is reused across calls and frames.
+// - Everything else (big or over-aligned) goes to the system heap with manual alignment.
+//
+// Freed small chunks are kept for reuse and only given back to the system at exit.
+class HostAllocator
+{
+public:
+    static constexpr uint32_t SCOPE_COUNT = 5;   // VK_SYSTEM_ALLOCATION_SCOPE_COMMAND .. INSTANCE
+
+    struct ScopeStats
+    {
+        uint64_t    allocations         = 0;
+        uint64_t    reallocations       = 0;
+        uint64_t    frees               = 0;
+        uint64_t    poolAllocations     = 0;    // served by the thread-local size classes
+        uint64_t    arenaAllocations    = 0;    // served by the command scope arena
+        uint64_t    largeAllocations    = 0;    // went to the system heap
+        int64_t     liveBytes           = 0;
+        int64_t     peakBytes           = 0;
+    };
+
+    HostAllocator();
+    ~HostAllocator();
+
+    // Returns null when disabled, which makes Vulkan fall back to its own allocator
+    const VkAllocationCallbacks* GetCallbacks() const;
+    void SetEnabled(bool enabled) { m_Enabled = enabled; }
+    bool IsEnabled() const { return m_Enabled; }
+
+    // Marks a frame boundary for the per-frame allocation counts
+    void EndFrame();
+
+    ScopeStats GetScopeStats(uint32_t scope) const;
+    void PrintStats(std::ostream& out) const;
+
+private:
+    struct AtomicScopeStats
+    {
+        std::atomic<uint64_t>   allocations{ 0 };
+        std::atomic<uint64_t>   reallocations{ 0 };
+        std::atomic<uint64_t>   frees{ 0 };
+        std::atomic<uint64_t>   poolAllocations{ 0 };
+        std::atomic<uint64_t>   arenaAllocations{ 0 };
+        std::atomic<uint64_t>   largeAllocations{ 0 };
+        std::atomic<int64_t>    liveBytes{ 0 };
+        std::atomic<int64_t>    peakBytes{ 0 };
+    };
+
+    // The PFN_vkAllocationFunction and friends, defined next to vulkan.h
+    struct Callbacks;
+
+    void* AllocateMemory(size_t size, size_t alignment, uint32_t scope);
+    void* ReallocateMemory(void* original, size_t size, size_t alignment, uint32_t scope);
+    void FreeMemory(void* memory);
+    void CountLive(uint32_t scope, int64_t bytes);
+
+    std::unique_ptr<VkAllocationCallbacks>  m_Callbacks;
+    bool                                    m_Enabled   = true;
+
+    AtomicScopeStats            m_Scopes[SCOPE_COUNT];
+    std::atomic<uint64_t>       m_InternalAllocations{ 0 };
+    std::atomic<int64_t>        m_InternalBytes{ 0 };
+
+    // Per-frame allocation counts, only touched by the thread that calls EndFrame
+    uint64_t                    m_Frames                = 0;
+    uint64_t                    m_AllocationsAtFrame    = 0;
+    uint64_t                    m_MaxFrameAllocations   = 0;
+    uint64_t                    m_AllocationsAfterFirstFrame = 0;
+};
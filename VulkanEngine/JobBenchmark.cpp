@@ -0,0 +1,150 @@
+#include "JobBenchmark.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Jobs spawned per measurement, well past the size of a deque so its overflow path is never hit
+constexpr uint32_t BENCHMARK_JOB_COUNT = 1u << 20;
+constexpr uint32_t BENCHMARK_BATCH_SIZE = 2048;
+constexpr uint32_t BENCHMARK_REPEATS = 5;
+constexpr uint32_t BENCHMARK_CHAIN_LENGTH = 1u << 16;
+constexpr uint32_t BENCHMARK_PARALLEL_FOR_ITEMS = 1u << 24;
+
+using BenchmarkClock = std::chrono::steady_clock;
+
+static double SecondsSince(BenchmarkClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+static void PrintResult(std::ostream& out, const char* name, double seconds, uint64_t jobs)
+{
+    out << "  " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(10) << seconds * 1e9 / jobs << " ns/job  "
+        << std::setw(10) << std::setprecision(2) << jobs / seconds / 1e6 << " M jobs/s\n";
+}
+
+// Spawns jobs in batches small enough for the deque, waiting after each batch.
+// The best of several runs is kept to filter out scheduling noise.
+static double SpawnAndWait(JobSystem& jobs, std::atomic<uint32_t>& sink)
+{
+    double best = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        auto start = BenchmarkClock::now();
+        for (uint32_t first = 0; first < BENCHMARK_JOB_COUNT; first += BENCHMARK_BATCH_SIZE)
+        {
+            JobCounter counter;
+            for (uint32_t i = 0; i < BENCHMARK_BATCH_SIZE; i++)
+            {
+                jobs.Spawn([&sink]() { sink.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            }
+            jobs.Wait(counter);
+        }
+        best = std::min(best, SecondsSince(start));
+    }
+    return best;
+}
+
+// The spawning thread does not help, every job has to be stolen by a worker
+static double SpawnAndSteal(JobSystem& jobs, std::atomic<uint32_t>& sink)
+{
+    double best = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        auto start = BenchmarkClock::now();
+        for (uint32_t first = 0; first < BENCHMARK_JOB_COUNT; first += BENCHMARK_BATCH_SIZE)
+        {
+            JobCounter counter;
+            for (uint32_t i = 0; i < BENCHMARK_BATCH_SIZE; i++)
+            {
+                jobs.Spawn([&sink]() { sink.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            }
+            while (!counter.IsDone())
+            {
+            }
+            // Spawned counters may only go out of scope through Wait
+            jobs.Wait(counter);
+        }
+        best = std::min(best, SecondsSince(start));
+    }
+    return best;
+}
+
+// Every job depends on the one before it, so this measures the latency of a dependency hand-off
+static double DependencyChain(JobSystem& jobs, std::atomic<uint32_t>& sink)
+{
+    std::vector<JobCounter> counters(BENCHMARK_CHAIN_LENGTH);
+
+    auto start = BenchmarkClock::now();
+    for (uint32_t i = 0; i < BENCHMARK_CHAIN_LENGTH; i++)
+    {
+        jobs.Spawn([&sink]() { sink.fetch_add(1, std::memory_order_relaxed); }, &counters[i], i > 0 ? &counters[i - 1] : nullptr);
+    }
+    jobs.Wait(counters.back());
+    double seconds = SecondsSince(start);
+
+    for (JobCounter& counter : counters)
+    {
+        jobs.Wait(counter);
+    }
+    return seconds;
+}
+
+void RunJobBenchmark(uint32_t threadCount, std::ostream& out)
+{
+    std::atomic<uint32_t> sink{ 0 };
+
+    {
+        JobSystem jobs;
+        jobs.Create(1);
+        out << "Job system benchmark, " << BENCHMARK_JOB_COUNT << " empty jobs per run\n";
+        PrintResult(out, "spawn + run, 1 thread", SpawnAndWait(jobs, sink), BENCHMARK_JOB_COUNT);
+        jobs.Destroy();
+    }
+
+    JobSystem jobs;
+    jobs.Create(threadCount);
+    out << "With " << jobs.GetThreadCount() << " threads:\n";
+
+    PrintResult(out, "spawn + run, all threads", SpawnAndWait(jobs, sink), BENCHMARK_JOB_COUNT);
+
+    if (jobs.GetThreadCount() > 1)
+    {
+        uint64_t stolenBefore = jobs.GetStats().jobsStolen;
+        double seconds = SpawnAndSteal(jobs, sink);
+        PrintResult(out, "spawn + steal", seconds, BENCHMARK_JOB_COUNT);
+        out << "    " << (jobs.GetStats().jobsStolen - stolenBefore) / BENCHMARK_REPEATS << " jobs stolen per run\n";
+    }
+
+    PrintResult(out, "dependency chain", DependencyChain(jobs, sink), BENCHMARK_CHAIN_LENGTH);
+
+    // Enough arithmetic per item that splitting the loop is worth it
+    std::vector<float> values(BENCHMARK_PARALLEL_FOR_ITEMS);
+    auto work = [&values](uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            values[i] = std::sqrt(static_cast<float>(i)) * 0.5f + std::sin(static_cast<float>(i));
+        }
+    };
+
+    auto start = BenchmarkClock::now();
+    work(0, BENCHMARK_PARALLEL_FOR_ITEMS);
+    double serial = SecondsSince(start);
+
+    start = BenchmarkClock::now();
+    jobs.ParallelFor(BENCHMARK_PARALLEL_FOR_ITEMS, BENCHMARK_PARALLEL_FOR_ITEMS / (jobs.GetThreadCount() * 16), work);
+    double parallel = SecondsSince(start);
+
+    out << std::setprecision(2) << "  ParallelFor over " << BENCHMARK_PARALLEL_FOR_ITEMS << " items: " << serial * 1000.0
+        << " ms serial, " << parallel * 1000.0 << " ms parallel, " << serial / parallel << "x\n";
+
+    jobs.PrintStats(out);
+    jobs.Destroy();
+}
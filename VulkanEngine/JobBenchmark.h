@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include <iosfwd>
+
+// Measures the job system's per-job overhead: spawning and running empty jobs on one
+// thread, the same with every thread helping, jobs that can only run by being stolen,
+// dependency chains and ParallelFor against a plain loop. Needs no GPU.
+// threadCount 0 uses one thread per core.
+void RunJobBenchmark(uint32_t threadCount, std::ostream& out);
@@ -0,0 +1,478 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Jobs a deque holds before new ones are run on the spot, must be a power of two
+constexpr uint32_t DEQUE_CAPACITY = 4096;
+
+// Jobs carved out of the heap at once when a thread's free list runs dry
+constexpr uint32_t JOB_CHUNK_SIZE = 256;
+
+// Failed attempts to find work before an idle worker goes to sleep
+constexpr uint32_t IDLE_SPIN_COUNT = 64;
+
+// Safety net for a missed wake-up, a sleeping worker looks for work at least this often
+constexpr auto IDLE_SLEEP_TIMEOUT = std::chrono::milliseconds(1);
+
+constexpr uint32_t INVALID_THREAD_INDEX = ~0u;
+
+static thread_local uint32_t s_ThreadIndex = INVALID_THREAD_INDEX;
+
+JobSystem::WorkStealingDeque::WorkStealingDeque(uint32_t capacity)
+    : m_Buffer(new std::atomic<Job*>[capacity])
+    , m_Mask(static_cast<int64_t>(capacity) - 1)
+{
+}
+
+bool JobSystem::WorkStealingDeque::Push(Job* job)
+{
+    int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+    int64_t top = m_Top.load(std::memory_order_acquire);
+    if (bottom - top > m_Mask)
+    {
+        return false;
+    }
+
+    m_Buffer[bottom & m_Mask].store(job, std::memory_order_relaxed);
+    // Publishes the slot and the job's payload to thieves
+    m_Bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Pop()
+{
+    int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+    m_Bottom.store(bottom, std::memory_order_relaxed);
+    // The new bottom has to be visible before top is read, or a thief and the owner
+    // could both take the last job
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_Top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // Empty
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_Buffer[bottom & m_Mask].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // Last job, race the thieves for it
+        if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            job = nullptr;
+        }
+        m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Steal()
+{
+    int64_t top = m_Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+    {
+        return nullptr;
+    }
+
+    Job* job = m_Buffer[top & m_Mask].load(std::memory_order_relaxed);
+    if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        // Lost against the owner or another thief
+        return nullptr;
+    }
+    return job;
+}
+
+bool JobSystem::WorkStealingDeque::IsEmpty() const
+{
+    return m_Top.load(std::memory_order_acquire) >= m_Bottom.load(std::memory_order_acquire);
+}
+
+JobSystem::ThreadState::ThreadState()
+    : deque(DEQUE_CAPACITY)
+{
+}
+
+// Workers still running when an exception unwinds past the owner have to be joined
+JobSystem::~JobSystem()
+{
+    if (!m_Threads.empty())
+    {
+        Destroy();
+    }
+}
+
+void JobSystem::Create(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    m_Quit.store(false);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        m_Threads.push_back(std::make_unique<ThreadState>());
+        m_Threads.back()->stealSeed = i * 2654435761u + 1;
+    }
+
+    s_ThreadIndex = 0;
+    for (uint32_t i = 1; i < threadCount; i++)
+    {
+        m_Workers.emplace_back(&JobSystem::WorkerMain, this, i);
+    }
+}
+
+void JobSystem::Destroy()
+{
+    // Whatever was queued for the main thread still has to run. This may run from the
+    // destructor, so an exception of a job without a counter is dropped here.
+    ExecuteMainThreadJobs();
+
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Quit.store(true);
+    }
+    m_SleepCondition.notify_all();
+    for (std::thread& worker : m_Workers)
+    {
+        worker.join();
+    }
+    m_Workers.clear();
+
+    // Finish the stragglers so every job is back on a free list
+    while (Job* job = FindJob(0))
+    {
+        Execute(job);
+    }
+
+    m_Threads.clear();
+    s_ThreadIndex = INVALID_THREAD_INDEX;
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+    return s_ThreadIndex;
+}
+
+JobSystem::Job* JobSystem::AllocateJob()
+{
+    ThreadState& thread = *m_Threads[s_ThreadIndex];
+
+    if (thread.freeJobs == nullptr)
+    {
+        // Take back everything other threads have freed since the last time
+        thread.freeJobs = thread.returnedJobs.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    if (thread.freeJobs == nullptr)
+    {
+        thread.chunks.emplace_back(new Job[JOB_CHUNK_SIZE]);
+        Job* chunk = thread.chunks.back().get();
+        for (uint32_t i = 0; i < JOB_CHUNK_SIZE; i++)
+        {
+            chunk[i].owner = s_ThreadIndex;
+            chunk[i].next = (i + 1 < JOB_CHUNK_SIZE) ? &chunk[i + 1] : nullptr;
+        }
+        thread.freeJobs = chunk;
+    }
+
+    Job* job = thread.freeJobs;
+    thread.freeJobs = job->next;
+    thread.jobsSpawned.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::FreeJob(Job* job)
+{
+    ThreadState& owner = *m_Threads[job->owner];
+
+    if (job->owner == s_ThreadIndex)
+    {
+        job->next = owner.freeJobs;
+        owner.freeJobs = job;
+        return;
+    }
+
+    // Only the owner ever takes from this list, and always all of it, so there is no ABA problem
+    Job* head = owner.returnedJobs.load(std::memory_order_relaxed);
+    do
+    {
+        job->next = head;
+    } while (!owner.returnedJobs.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void JobSystem::Submit(Job* job, JobCounter* dependency)
+{
+    if (dependency != nullptr)
+    {
+        // Checked under the lock so it cannot reach zero between the check and the append
+        std::lock_guard<std::mutex> lock(dependency->m_Mutex);
+        if (!dependency->IsDone())
+        {
+            dependency->m_Waiting.push_back(job);
+            return;
+        }
+    }
+    PushJob(job);
+}
+
+void JobSystem::SubmitToMainThread(Job* job)
+{
+    std::lock_guard<std::mutex> lock(m_MainThreadMutex);
+    m_MainThreadJobs.push_back(job);
+}
+
+void JobSystem::PushJob(Job* job)
+{
+    ThreadState& thread = *m_Threads[s_ThreadIndex];
+    if (!thread.deque.Push(job))
+    {
+        thread.inlineOverflows.fetch_add(1, std::memory_order_relaxed);
+        Execute(job);
+        return;
+    }
+
+    // Pairs with the fence in WorkerMain: either the sleeper sees the job or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_Sleeping.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_SleepCondition.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::FindJob(uint32_t threadIndex)
+{
+    ThreadState& thread = *m_Threads[threadIndex];
+
+    if (Job* job = thread.deque.Pop())
+    {
+        return job;
+    }
+
+    // Start at a random victim so thieves do not all pile onto the same deque
+    uint32_t threadCount = static_cast<uint32_t>(m_Threads.size());
+    thread.stealSeed ^= thread.stealSeed << 13;
+    thread.stealSeed ^= thread.stealSeed >> 17;
+    thread.stealSeed ^= thread.stealSeed << 5;
+    uint32_t start = thread.stealSeed % threadCount;
+
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        uint32_t victim = (start + i) % threadCount;
+        if (victim == threadIndex)
+        {
+            continue;
+        }
+        if (Job* job = m_Threads[victim]->deque.Steal())
+        {
+            thread.jobsStolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::Execute(Job* job)
+{
+    JobCounter* counter = job->counter;
+    std::exception_ptr error;
+    try
+    {
+        job->invoke(job->payload);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    FreeJob(job);
+
+    // The counter still has to reach zero, or its waiter would never return
+    if (error)
+    {
+        std::mutex& mutex = counter != nullptr ? counter->m_Mutex : m_ErrorMutex;
+        std::exception_ptr& first = counter != nullptr ? counter->m_Error : m_Error;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!first)
+        {
+            first = error;
+        }
+    }
+
+    m_Threads[s_ThreadIndex]->jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+    if (counter != nullptr)
+    {
+        FinishJob(counter);
+    }
+}
+
+void JobSystem::FinishJob(JobCounter* counter)
+{
+    uint32_t pending = counter->m_Pending.load(std::memory_order_relaxed);
+    while (pending > 1)
+    {
+        if (counter->m_Pending.compare_exchange_weak(pending, pending - 1, std::memory_order_release, std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+
+    // Possibly the last job. The count drops to zero under the lock, so a waiter that
+    // takes the lock afterwards knows this thread is done with the counter.
+    std::vector<Job*> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->m_Mutex);
+        if (counter->m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            ready.swap(counter->m_Waiting);
+        }
+    }
+
+    // Release everything that depended on the counter
+    for (Job* job : ready)
+    {
+        PushJob(job);
+    }
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    uint32_t threadIndex = s_ThreadIndex;
+    while (!counter.IsDone())
+    {
+        if (Job* job = FindJob(threadIndex))
+        {
+            Execute(job);
+        }
+        else if (threadIndex == 0)
+        {
+            ExecuteMainThreadJobs();
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // The thread that finished the last job may still hold the lock, the counter
+    // must not go out of scope before it has let go
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(counter.m_Mutex);
+        // Taken out so the counter can be reused
+        error.swap(counter.m_Error);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+    ExecuteMainThreadJobs();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_ErrorMutex);
+        error.swap(m_Error);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::ExecuteMainThreadJobs()
+{
+    std::vector<Job*> jobs;
+    {
+        std::lock_guard<std::mutex> lock(m_MainThreadMutex);
+        jobs.swap(m_MainThreadJobs);
+    }
+    for (Job* job : jobs)
+    {
+        Execute(job);
+    }
+}
+
+bool JobSystem::HasWork() const
+{
+    for (const auto& thread : m_Threads)
+    {
+        if (!thread->deque.IsEmpty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::WorkerMain(uint32_t threadIndex)
+{
+    s_ThreadIndex = threadIndex;
+    std::string name = "Worker " + std::to_string(threadIndex);
+    Profiler::SetThreadName(name.c_str());
+
+    uint32_t idleSpins = 0;
+    while (!m_Quit.load(std::memory_order_relaxed))
+    {
+        if (Job* job = FindJob(threadIndex))
+        {
+            Execute(job);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (++idleSpins < IDLE_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_Sleeping.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!HasWork() && !m_Quit.load(std::memory_order_relaxed))
+        {
+            m_SleepCondition.wait_for(lock, IDLE_SLEEP_TIMEOUT);
+        }
+        m_Sleeping.fetch_sub(1, std::memory_order_relaxed);
+        idleSpins = 0;
+    }
+}
+
+JobSystem::Stats JobSystem::GetStats() const
+{
+    Stats stats;
+    for (const auto& thread : m_Threads)
+    {
+        stats.jobsSpawned += thread->jobsSpawned.load(std::memory_order_relaxed);
+        stats.jobsExecuted += thread->jobsExecuted.load(std::memory_order_relaxed);
+        stats.jobsStolen += thread->jobsStolen.load(std::memory_order_relaxed);
+        stats.inlineOverflows += thread->inlineOverflows.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::PrintStats(std::ostream& out) const
+{
+    Stats stats = GetStats();
+    out << "Job system: " << m_Threads.size() << " threads, " << stats.jobsExecuted << " jobs executed, "
+        << stats.jobsStolen << " stolen";
+    if (stats.inlineOverflows > 0)
+    {
+        out << ", " << stats.inlineOverflows << " run inline on a full deque";
+    }
+    out << "\n";
+}
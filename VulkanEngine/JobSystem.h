@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobCounter;
+
+// Work-stealing job scheduler.
+//
+// Every thread, the main thread included, owns a Chase-Lev deque. A thread pushes and pops
+// its own jobs at the bottom without taking a lock, idle threads steal from the top of the
+// others. Jobs carry their callable inline and come from per-thread free lists, so spawning
+// never allocates once the lists are warm.
+//
+// Waiting on a JobCounter never blocks a thread: the waiter keeps running jobs until the
+// counter drops to zero. Jobs spawned with SpawnOnMainThread only run on the thread that
+// called Create, for APIs like GLFW that must be called from the main thread.
+//
+// A job that throws still counts as finished. The first exception of the jobs spawned with
+// a counter is rethrown by the Wait on that counter, once all of them are done. Jobs without
+// a counter have nobody waiting for them, their first exception is rethrown by the next
+// RunMainThreadJobs call.
+//
+// Jobs may only be spawned from the job system's own threads, and only one JobSystem
+// may exist at a time.
+class JobSystem
+{
+public:
+    static constexpr size_t JOB_PAYLOAD_SIZE = 64;
+    static constexpr size_t JOB_PAYLOAD_ALIGNMENT = 16;
+
+    struct Stats
+    {
+        uint64_t    jobsSpawned     = 0;
+        uint64_t    jobsExecuted    = 0;
+        uint64_t    jobsStolen      = 0;
+        uint64_t    inlineOverflows = 0;    // jobs run on the spot because a deque was full
+    };
+
+    JobSystem() = default;
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // threadCount includes the calling thread, which becomes the main thread; 0 uses one per core
+    void Create(uint32_t threadCount);
+    void Destroy();
+
+    // Runs function on any thread. counter, if given, is incremented now and decremented once the
+    // job has finished. A job with a dependency only becomes runnable once the dependency is zero.
+    template <typename Function>
+    void Spawn(Function&& function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr)
+    {
+        Submit(CreateJob(std::forward<Function>(function), counter), dependency);
+    }
+
+    // Runs function on the main thread the next time it waits or calls RunMainThreadJobs
+    template <typename Function>
+    void SpawnOnMainThread(Function&& function, JobCounter* counter = nullptr)
+    {
+        SubmitToMainThread(CreateJob(std::forward<Function>(function), counter));
+    }
+
+    // Executes other jobs until counter reaches zero, then rethrows the first exception
+    // of its jobs, if any
+    void Wait(JobCounter& counter);
+
+    // Calls function(first, count) for batches of at most batchSize items and waits for all of them
+    template <typename Function>
+    void ParallelFor(uint32_t itemCount, uint32_t batchSize, Function&& function);
+
+    // Main thread only, runs the jobs queued with SpawnOnMainThread and rethrows the first
+    // exception of a job spawned without a counter
+    void RunMainThreadJobs();
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+
+    // 0 on the main thread, 1..GetThreadCount()-1 on the workers
+    static uint32_t GetThreadIndex();
+
+    Stats GetStats() const;
+    void PrintStats(std::ostream& out) const;
+
+private:
+    friend class JobCounter;
+
+    struct Job
+    {
+        alignas(JOB_PAYLOAD_ALIGNMENT) unsigned char payload[JOB_PAYLOAD_SIZE];
+        void        (*invoke)(void* payload)    = nullptr;  // runs and destroys the callable, even if it throws
+        JobCounter* counter                     = nullptr;
+        uint32_t    owner                       = 0;        // thread whose free list it returns to
+        Job*        next                        = nullptr;  // free list link
+    };
+
+    // Chase-Lev deque with a fixed capacity (Le et al., "Correct and Efficient Work-Stealing
+    // for Weak Memory Models"). Push and Pop are owner only, Steal may be called by any thread.
+    class WorkStealingDeque
+    {
+    public:
+        explicit WorkStealingDeque(uint32_t capacity);
+
+        bool Push(Job* job);
+        Job* Pop();
+        Job* Steal();
+        bool IsEmpty() const;
+
+    private:
+        std::atomic<int64_t>                m_Top{ 0 };
+        std::atomic<int64_t>                m_Bottom{ 0 };
+        std::unique_ptr<std::atomic<Job*>[]> m_Buffer;
+        int64_t                             m_Mask;
+    };
+
+    // Aligned to a cache line so threads do not invalidate each other's counters
+    struct alignas(64) ThreadState
+    {
+        ThreadState();
+
+        WorkStealingDeque       deque;
+        Job*                    freeJobs        = nullptr;  // owner only
+        std::atomic<Job*>       returnedJobs{ nullptr };    // freed by other threads
+        std::vector<std::unique_ptr<Job[]>> chunks;
+        uint32_t                stealSeed       = 0;
+
+        std::atomic<uint64_t>   jobsSpawned{ 0 };
+        std::atomic<uint64_t>   jobsExecuted{ 0 };
+        std::atomic<uint64_t>   jobsStolen{ 0 };
+        std::atomic<uint64_t>   inlineOverflows{ 0 };
+    };
+
+    template <typename Function>
+    Job* CreateJob(Function&& function, JobCounter* counter);
+
+    Job* AllocateJob();
+    void FreeJob(Job* job);
+    void Submit(Job* job, JobCounter* dependency);
+    void SubmitToMainThread(Job* job);
+    void PushJob(Job* job);
+    Job* FindJob(uint32_t threadIndex);
+    void Execute(Job* job);
+    void FinishJob(JobCounter* counter);
+    void ExecuteMainThreadJobs();
+    bool HasWork() const;
+    void WorkerMain(uint32_t threadIndex);
+
+    std::vector<std::unique_ptr<ThreadState>>   m_Threads;
+    std::vector<std::thread>                    m_Workers;
+
+    // Idle workers sleep here after spinning for a while
+    std::mutex                  m_SleepMutex;
+    std::condition_variable     m_SleepCondition;
+    std::atomic<uint32_t>       m_Sleeping{ 0 };
+    std::atomic<bool>           m_Quit{ false };
+
+    std::mutex                  m_MainThreadMutex;
+    std::vector<Job*>           m_MainThreadJobs;
+
+    // First exception of a job spawned without a counter
+    std::mutex                  m_ErrorMutex;
+    std::exception_ptr          m_Error;
+};
+
+// Number of unfinished jobs. Can be reused once it has reached zero; a counter that
+// jobs were spawned with may only be destroyed after JobSystem::Wait has returned.
+class JobCounter
+{
+public:
+    bool IsDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t>       m_Pending{ 0 };
+    std::mutex                  m_Mutex;
+    std::vector<JobSystem::Job*> m_Waiting;    // dependent jobs, pushed once m_Pending reaches zero
+    std::exception_ptr          m_Error;        // first exception of its jobs, guarded by m_Mutex
+};
+
+template <typename Function>
+JobSystem::Job* JobSystem::CreateJob(Function&& function, JobCounter* counter)
+{
+    using Callable = std::decay_t<Function>;
+    static_assert(sizeof(Callable) <= JOB_PAYLOAD_SIZE, "Job captures too much, capture a pointer to the data instead");
+    static_assert(alignof(Callable) <= JOB_PAYLOAD_ALIGNMENT, "Job callable is over-aligned");
+
+    Job* job = AllocateJob();
+    new (job->payload) Callable(std::forward<Function>(function));
+    job->invoke = [](void* payload)
+    {
+        struct Destroyer
+        {
+            Callable* callable;
+            ~Destroyer() { callable->~Callable(); }
+        };
+        Destroyer destroyer{ std::launder(reinterpret_cast<Callable*>(payload)) };
+        (*destroyer.callable)();
+    };
+    job->counter = counter;
+    if (counter != nullptr)
+    {
+        counter->m_Pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+template <typename Function>
+void JobSystem::ParallelFor(uint32_t itemCount, uint32_t batchSize, Function&& function)
+{
+    if (itemCount == 0)
+    {
+        return;
+    }
+    batchSize = std::max(batchSize, 1u);
+
+    // A single batch is not worth a job
+    if (itemCount <= batchSize)
+    {
+        function(0u, itemCount);
+        return;
+    }
+
+    JobCounter counter;
+    auto* target = &function;
+    for (uint32_t first = 0; first < itemCount; first += batchSize)
+    {
+        uint32_t count = std::min(batchSize, itemCount - first);
+        Spawn([target, first, count]() { (*target)(first, count); }, &counter);
+    }
+    Wait(counter);
+}
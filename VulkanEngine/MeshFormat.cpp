@@ -0,0 +1,183 @@
+#include "MeshFormat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint32_t GetVertexStride(VertexFormat format)
+{
+    switch (format)
+    {
+    case VertexFormat::Float:
+        return sizeof(FloatVertex);
+    case VertexFormat::Quantized:
+        return sizeof(QuantizedVertex);
+    }
+    return 0;
+}
+
+// Rounds to nearest even; values too large become infinity, too small ones denormals or zero
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFFu)
+    {
+        // Infinity stays infinity, NaN keeps a mantissa bit
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+    }
+
+    const int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+
+    if (halfExponent <= 0)
+    {
+        if (halfExponent < -10)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+        // Denormal: the implicit bit becomes explicit and the mantissa shifts right
+        mantissa |= 0x800000u;
+        const uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1u) != 0))
+        {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u) != 0))
+    {
+        // A carry into the exponent is the correct result, up to infinity
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float HalfToFloat(uint16_t value)
+{
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1Fu;
+    uint32_t mantissa = value & 0x3FFu;
+
+    uint32_t bits;
+    if (exponent == 0x1Fu)
+    {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    else if (mantissa == 0)
+    {
+        bits = sign;
+    }
+    else
+    {
+        // Denormal, normalized for the float
+        uint32_t shift = 0;
+        while ((mantissa & 0x400u) == 0)
+        {
+            mantissa <<= 1;
+            shift++;
+        }
+        bits = sign | ((127 - 15 + 1 - shift) << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+uint16_t QuantizeUnorm16(float value)
+{
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+}
+
+int16_t QuantizeSnorm16(float value)
+{
+    value = std::min(std::max(value, -1.0f), 1.0f);
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+void EncodeOctahedral(const float direction[3], int16_t encoded[2])
+{
+    const float length = std::fabs(direction[0]) + std::fabs(direction[1]) + std::fabs(direction[2]);
+    float x = length > 0.0f ? direction[0] / length : 0.0f;
+    float y = length > 0.0f ? direction[1] / length : 0.0f;
+    const float z = length > 0.0f ? direction[2] / length : 1.0f;
+
+    // The lower hemisphere is folded over the diagonals
+    if (z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    encoded[0] = QuantizeSnorm16(x);
+    encoded[1] = QuantizeSnorm16(y);
+}
+
+void DecodeOctahedral(const int16_t encoded[2], float direction[3])
+{
+    // -32768 decodes to -1 like -32767, as the snorm vertex formats do
+    float x = std::max(static_cast<float>(encoded[0]) / 32767.0f, -1.0f);
+    float y = std::max(static_cast<float>(encoded[1]) / 32767.0f, -1.0f);
+    const float z = 1.0f - std::fabs(x) - std::fabs(y);
+    if (z < 0.0f)
+    {
+        const float unfoldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const float unfoldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = unfoldedX;
+        y = unfoldedY;
+    }
+
+    const float length = std::sqrt(x * x + y * y + z * z);
+    direction[0] = x / length;
+    direction[1] = y / length;
+    direction[2] = z / length;
+}
+
+QuantizedVertex QuantizeVertex(const float position[3], const float normal[3], const float tangent[4], const float uv[2],
+    const float boundsMin[3], const float boundsExtent[3])
+{
+    QuantizedVertex vertex{};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // A flat axis has no extent, all its positions are at the minimum
+        const float relative = boundsExtent[axis] > 0.0f ? (position[axis] - boundsMin[axis]) / boundsExtent[axis] : 0.0f;
+        vertex.position[axis] = QuantizeUnorm16(relative);
+    }
+    vertex.position[3] = tangent[3] < 0.0f ? 0 : 65535;
+
+    EncodeOctahedral(normal, vertex.normal);
+    EncodeOctahedral(tangent, vertex.tangent);
+    vertex.uv[0] = FloatToHalf(uv[0]);
+    vertex.uv[1] = FloatToHalf(uv[1]);
+    return vertex;
+}
+
+void DequantizePosition(const QuantizedVertex& vertex, const float boundsMin[3], const float boundsExtent[3], float position[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        position[axis] = boundsMin[axis] + static_cast<float>(vertex.position[axis]) / 65535.0f * boundsExtent[axis];
+    }
+}
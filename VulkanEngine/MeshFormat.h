@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "AssetPack.h"
+
+// Vertex layouts of cooked meshes and the conversions between them and floats.
+//
+// QuantizedVertex stores what a float vertex with position, normal, tangent and texture
+// coordinates holds in 48 bytes in 20: positions as 16-bit fractions of the mesh bounds,
+// normal and tangent as octahedral 16-bit pairs and texture coordinates as half floats. All
+// attributes are plain vertex formats, so the input assembler decodes them except for the
+// bounds scale and the octahedral unfolding, a few instructions in the vertex shader:
+//   position = boundsMin + position.xyz * boundsExtent
+//   n = vec3(oct.xy, 1 - |oct.x| - |oct.y|); if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy); normalize(n)
+
+// Position and normal as floats, the layout of GpuScene's vertices
+struct FloatVertex
+{
+    float       position[3];
+    float       normal[3];
+};
+
+struct QuantizedVertex
+{
+    uint16_t    position[4];    // VK_FORMAT_R16G16B16A16_UNORM, w is the bitangent sign: 0 negative, 1 positive
+    int16_t     normal[2];      // VK_FORMAT_R16G16_SNORM, octahedral
+    int16_t     tangent[2];     // VK_FORMAT_R16G16_SNORM, octahedral
+    uint16_t    uv[2];          // VK_FORMAT_R16G16_SFLOAT
+};
+
+static_assert(sizeof(FloatVertex) == 24, "FloatVertex is part of the file format");
+static_assert(sizeof(QuantizedVertex) == 20, "QuantizedVertex is part of the file format");
+
+// Bytes of a vertex, 0 for an unknown format
+uint32_t GetVertexStride(VertexFormat format);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// value is clamped to [0, 1] and [-1, 1]
+uint16_t QuantizeUnorm16(float value);
+int16_t QuantizeSnorm16(float value);
+
+// A unit vector folded onto the octahedron and stored as two snorm values
+void EncodeOctahedral(const float direction[3], int16_t encoded[2]);
+void DecodeOctahedral(const int16_t encoded[2], float direction[3]);
+
+// tangent holds the bitangent sign in w
+QuantizedVertex QuantizeVertex(const float position[3], const float normal[3], const float tangent[4], const float uv[2],
+    const float boundsMin[3], const float boundsExtent[3]);
+void DequantizePosition(const QuantizedVertex& vertex, const float boundsMin[3], const float boundsExtent[3], float position[3]);
@@ -0,0 +1,517 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Forsyth's scoring: the three vertices of the last triangle get a fixed score so the next
+// triangle does not simply reuse them, the rest of the cache decays with its position, and
+// vertices with few triangles left are boosted so they get finished instead of left behind
+constexpr uint32_t CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+// Cache simulated when clusters for overdraw are formed, the size the ACMR is reported for
+constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+// Soft cluster boundaries are not placed closer than this many triangles
+constexpr size_t MIN_CLUSTER_TRIANGLES = 16;
+
+namespace
+{
+    struct VertexScoreTable
+    {
+        float   cache[CACHE_SIZE];
+        float   valence[64];
+
+        VertexScoreTable()
+        {
+            for (uint32_t i = 0; i < CACHE_SIZE; i++)
+            {
+                cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                    : std::pow(1.0f - static_cast<float>(i - 3) / static_cast<float>(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+            for (uint32_t i = 0; i < 64; i++)
+            {
+                valence[i] = i == 0 ? 0.0f : VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+            }
+        }
+
+        float Score(int32_t cachePosition, uint32_t remaining) const
+        {
+            if (remaining == 0)
+            {
+                return -1.0f;
+            }
+            const float valenceScore = remaining < 64 ? valence[remaining]
+                : VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+            return (cachePosition >= 0 ? cache[cachePosition] : 0.0f) + valenceScore;
+        }
+    };
+
+    const float* GetPosition(const float* positions, size_t positionStride, uint32_t vertex)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride);
+    }
+
+    // Unnormalized, its length is twice the triangle's area
+    void TriangleNormal(const float* a, const float* b, const float* c, float normal[3])
+    {
+        const float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+        normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+        normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+    }
+}
+
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    if (indexCount < 3)
+    {
+        return 0.0f;
+    }
+
+    // A vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        const uint32_t vertex = indices[i];
+        if (time - loadedAt[vertex] > cacheSize)
+        {
+            loadedAt[vertex] = time++;
+            misses++;
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    static const VertexScoreTable s_Scores;
+
+    // Triangles of each vertex; the first remaining[v] entries of its range are not emitted yet
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        remaining[indices[i]]++;
+    }
+    std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> filled(vertexCount, 0);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (size_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t v = indices[t * 3 + corner];
+                adjacency[firstTriangle[v] + filled[v]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    std::vector<int32_t> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = s_Scores.Score(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    int64_t best = -1;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if (triangleScore[t] > bestScore)
+        {
+            bestScore = triangleScore[t];
+            best = static_cast<int64_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> result(triangleCount * 3);
+    uint32_t cache[CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    size_t nextCandidate = 0;
+
+    for (size_t output = 0; output < triangleCount; output++)
+    {
+        // Nothing in the cache has triangles left, continue with the next one in input order
+        if (best < 0)
+        {
+            while (emitted[nextCandidate])
+            {
+                nextCandidate++;
+            }
+            best = static_cast<int64_t>(nextCandidate);
+        }
+
+        const size_t triangle = static_cast<size_t>(best);
+        const uint32_t* corners = &indices[triangle * 3];
+        emitted[triangle] = true;
+
+        uint32_t newCache[CACHE_SIZE + 3];
+        uint32_t newCount = 0;
+        for (size_t corner = 0; corner < 3; corner++)
+        {
+            const uint32_t v = corners[corner];
+            result[output * 3 + corner] = v;
+
+            // Swap the triangle out of the vertex's remaining range
+            uint32_t* begin = &adjacency[firstTriangle[v]];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* it = std::find(begin, end, static_cast<uint32_t>(triangle));
+            if (it != end)
+            {
+                std::swap(*it, *(end - 1));
+                remaining[v]--;
+            }
+
+            if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+            {
+                newCache[newCount++] = v;
+            }
+        }
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            if (std::find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+            {
+                newCache[newCount++] = cache[i];
+            }
+        }
+
+        // Vertices pushed past the end lose their cache score, all others move
+        for (uint32_t i = 0; i < newCount; i++)
+        {
+            const uint32_t v = newCache[i];
+            cachePosition[v] = i < CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+            vertexScore[v] = s_Scores.Score(cachePosition[v], remaining[v]);
+        }
+
+        best = -1;
+        bestScore = -1.0f;
+        for (uint32_t i = 0; i < newCount; i++)
+        {
+            const uint32_t v = newCache[i];
+            for (uint32_t j = 0; j < remaining[v]; j++)
+            {
+                const uint32_t t = adjacency[firstTriangle[v] + j];
+                triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = static_cast<int64_t>(t);
+                }
+            }
+        }
+
+        cacheCount = std::min(newCount, CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride,
+    float threshold)
+{
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    const float acmrBefore = ComputeAcmr(indices, triangleCount * 3, vertexCount, OVERDRAW_CACHE_SIZE);
+
+    // Hard boundaries where the cache starts over anyway (all three vertices miss), then soft
+    // ones inside those wherever the cluster so far is within the threshold of the whole
+    std::vector<size_t> clusterStarts;
+    {
+        std::vector<uint32_t> loadedAt(vertexCount, 0);
+        uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+        auto countMisses = [&](size_t triangle)
+        {
+            uint32_t misses = 0;
+            for (size_t corner = 0; corner < 3; corner++)
+            {
+                const uint32_t v = indices[triangle * 3 + corner];
+                if (time - loadedAt[v] > OVERDRAW_CACHE_SIZE)
+                {
+                    loadedAt[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        };
+
+        std::vector<size_t> hardStarts;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (countMisses(t) == 3)
+            {
+                hardStarts.push_back(t);
+            }
+        }
+        hardStarts.push_back(triangleCount);
+        if (hardStarts.front() != 0)
+        {
+            hardStarts.insert(hardStarts.begin(), 0);
+        }
+
+        for (size_t h = 0; h + 1 < hardStarts.size(); h++)
+        {
+            const size_t begin = hardStarts[h];
+            const size_t end = hardStarts[h + 1];
+            const float clusterAcmr = ComputeAcmr(indices + begin * 3, (end - begin) * 3, vertexCount, OVERDRAW_CACHE_SIZE);
+
+            // Every split starts the simulated cache cold, as the cluster may be drawn anywhere
+            time += OVERDRAW_CACHE_SIZE + 1;
+            size_t start = begin;
+            size_t misses = 0;
+            clusterStarts.push_back(begin);
+            for (size_t t = begin; t < end; t++)
+            {
+                misses += countMisses(t);
+                const size_t triangles = t + 1 - start;
+                if (triangles >= MIN_CLUSTER_TRIANGLES && end - (t + 1) >= MIN_CLUSTER_TRIANGLES
+                    && static_cast<float>(misses) / static_cast<float>(triangles) <= clusterAcmr * threshold)
+                {
+                    start = t + 1;
+                    misses = 0;
+                    time += OVERDRAW_CACHE_SIZE + 1;
+                    clusterStarts.push_back(start);
+                }
+            }
+        }
+        clusterStarts.push_back(triangleCount);
+    }
+
+    const size_t clusterCount = clusterStarts.size() - 1;
+    if (clusterCount < 2)
+    {
+        return;
+    }
+
+    // Area weighted centroid and normal of every cluster and of the whole mesh
+    std::vector<float> clusterCentroids(clusterCount * 3, 0.0f);
+    std::vector<float> clusterNormals(clusterCount * 3, 0.0f);
+    float meshCentroid[3] = {};
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float clusterArea = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const float* a = GetPosition(positions, positionStride, indices[t * 3]);
+            const float* b = GetPosition(positions, positionStride, indices[t * 3 + 1]);
+            const float* p = GetPosition(positions, positionStride, indices[t * 3 + 2]);
+            float normal[3];
+            TriangleNormal(a, b, p, normal);
+            const float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float center = (a[axis] + b[axis] + p[axis]) / 3.0f;
+                clusterCentroids[c * 3 + axis] += center * area;
+                clusterNormals[c * 3 + axis] += normal[axis];
+                meshCentroid[axis] += center * area;
+            }
+            clusterArea += area;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            clusterCentroids[c * 3 + axis] /= std::max(clusterArea, 1e-30f);
+        }
+        meshArea += clusterArea;
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        meshCentroid[axis] /= std::max(meshArea, 1e-30f);
+    }
+
+    // Clusters far out along their own normal occlude the rest and go first
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        const float* n = &clusterNormals[c * 3];
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float key = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            key += (clusterCentroids[c * 3 + axis] - meshCentroid[axis]) * (length > 0.0f ? n[axis] / length : 0.0f);
+        }
+        sortKeys[c] = key;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+    for (size_t c : order)
+    {
+        result.insert(result.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+    }
+
+    if (ComputeAcmr(result.data(), result.size(), vertexCount, OVERDRAW_CACHE_SIZE) <= acmrBefore * threshold)
+    {
+        std::copy(result.begin(), result.end(), indices);
+    }
+}
+
+size_t OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap)
+{
+    remap.assign(vertexCount, ~0u);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t& target = remap[indices[i]];
+        if (target == ~0u)
+        {
+            target = next++;
+        }
+        indices[i] = target;
+    }
+    return next;
+}
+
+void BuildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride,
+    std::vector<PackMeshlet>& meshlets, std::vector<uint32_t>& vertexIndices, std::vector<uint8_t>& triangles)
+{
+    // Local index of each vertex in the meshlet being built, 0xFF when it is not part of it
+    std::vector<uint8_t> local(vertexCount, 0xFF);
+    PackMeshlet meshlet;
+
+    auto finish = [&]()
+    {
+        if (meshlet.triangleCount == 0)
+        {
+            return;
+        }
+
+        const uint32_t* vertices = &vertexIndices[meshlet.vertexOffset];
+        float minimum[3] = { INFINITY, INFINITY, INFINITY };
+        float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            const float* p = GetPosition(positions, positionStride, vertices[i]);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                minimum[axis] = std::min(minimum[axis], p[axis]);
+                maximum[axis] = std::max(maximum[axis], p[axis]);
+            }
+            local[vertices[i]] = 0xFF;
+        }
+        float radiusSquared = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            meshlet.center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+        }
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            const float* p = GetPosition(positions, positionStride, vertices[i]);
+            const float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+            radiusSquared = std::max(radiusSquared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        meshlet.radius = std::sqrt(radiusSquared);
+
+        // The cone axis is the average of the unit triangle normals; the cutoff comes from the
+        // triangle furthest from it. Spreads of 90 degrees or more cannot be culled by a cone.
+        std::vector<float> normals(meshlet.triangleCount * 3, 0.0f);
+        float axis[3] = {};
+        const uint8_t* corners = &triangles[meshlet.triangleOffset];
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            float* n = &normals[t * 3];
+            TriangleNormal(GetPosition(positions, positionStride, vertices[corners[t * 3]]),
+                GetPosition(positions, positionStride, vertices[corners[t * 3 + 1]]),
+                GetPosition(positions, positionStride, vertices[corners[t * 3 + 2]]), n);
+            const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int i = 0; i < 3; i++)
+            {
+                n[i] = length > 0.0f ? n[i] / length : 0.0f;
+                axis[i] += n[i];
+            }
+        }
+        const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        float minimumDot = 1.0f;
+        if (axisLength > 0.0f)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                axis[i] /= axisLength;
+            }
+            for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+            {
+                const float* n = &normals[t * 3];
+                if (n[0] != 0.0f || n[1] != 0.0f || n[2] != 0.0f)
+                {
+                    minimumDot = std::min(minimumDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+                }
+            }
+        }
+        if (axisLength > 0.0f && minimumDot > 0.0f)
+        {
+            std::copy(axis, axis + 3, meshlet.coneAxis);
+            meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+        }
+        else
+        {
+            meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+            meshlet.coneCutoff = 1.0f;
+        }
+
+        meshlets.push_back(meshlet);
+        meshlet = PackMeshlet{};
+    };
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t newVertices = 0;
+        for (size_t corner = 0; corner < 3; corner++)
+        {
+            const uint32_t v = indices[i + corner];
+            const bool repeated = (corner > 0 && indices[i] == v) || (corner > 1 && indices[i + 1] == v);
+            newVertices += (local[v] == 0xFF && !repeated) ? 1 : 0;
+        }
+        if (meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+        {
+            finish();
+        }
+
+        if (meshlet.triangleCount == 0)
+        {
+            meshlet.vertexOffset = static_cast<uint32_t>(vertexIndices.size());
+            meshlet.triangleOffset = static_cast<uint32_t>(triangles.size());
+        }
+        for (size_t corner = 0; corner < 3; corner++)
+        {
+            const uint32_t v = indices[i + corner];
+            if (local[v] == 0xFF)
+            {
+                local[v] = static_cast<uint8_t>(meshlet.vertexCount++);
+                vertexIndices.push_back(v);
+            }
+            triangles.push_back(local[v]);
+        }
+        meshlet.triangleCount++;
+    }
+    finish();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "AssetPack.h"
+
+// Index and vertex reordering for AssetCooker. Triangle lists are uint32_t indices, positions
+// are three floats at the start of each positionStride bytes.
+//
+// The usual order is OptimizeVertexCache, then OptimizeOverdraw, then OptimizeVertexFetch:
+// the first orders triangles so vertices are reused while still in the post-transform cache,
+// the second moves whole runs of triangles around to draw the outside of the mesh first
+// without giving much of that back, and the last renumbers the vertices in the order the
+// triangles use them so vertex fetches walk memory forward.
+
+// Average cache miss ratio, transformed vertices per triangle, of a FIFO cache of cacheSize
+// entries like the one GPUs have historically been designed around. 0.5 is the best a
+// regular grid can do, 3 the worst.
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize);
+
+// Tom Forsyth's linear-speed vertex cache optimization, for an LRU cache of 32 entries
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Splits the triangles into clusters that start on a cold cache and sorts those so clusters
+// facing outward from the mesh center come first (Sander, Nehab and Barczak, "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw"). The result is kept only if its ACMR
+// stays within threshold times the input's.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride,
+    float threshold);
+
+// Renumbers the vertices by first use and drops unused ones. remap receives the new index of
+// every old vertex, ~0u for dropped ones. Returns the new vertex count.
+size_t OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap);
+
+// Cuts the triangle list, in its order, into meshlets of at most MESHLET_MAX_VERTICES vertices
+// and MESHLET_MAX_TRIANGLES triangles and computes their bounding spheres and normal cones.
+// The offsets of the meshlets index vertexIndices and triangles.
+void BuildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride,
+    std::vector<PackMeshlet>& meshlets, std::vector<uint32_t>& vertexIndices, std::vector<uint8_t>& triangles);
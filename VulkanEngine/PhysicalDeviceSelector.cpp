@@ -0,0 +1,282 @@
+#include "PhysicalDeviceSelector.h"
+#include "JobSystem.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+
+// Weights of the scoring. The device type dominates, because a discrete GPU beats an
+// integrated one on almost every workload, but a well equipped integrated GPU can still
+// win against a small discrete one through memory, queues and limits.
+static constexpr int64_t SCORE_DISCRETE_GPU = 4000;
+static constexpr int64_t SCORE_INTEGRATED_GPU = 2000;
+static constexpr int64_t SCORE_VIRTUAL_GPU = 1000;
+static constexpr int64_t SCORE_CPU = 100;
+
+static constexpr int64_t SCORE_PER_GIB_DEVICE_LOCAL = 100;
+static constexpr int64_t MAX_MEMORY_SCORE = 3200;
+
+static constexpr int64_t SCORE_DEDICATED_COMPUTE_QUEUE = 300;
+static constexpr int64_t SCORE_DEDICATED_TRANSFER_QUEUE = 300;
+
+static const char* DeviceTypeName(uint32_t type)
+{
+    switch (type)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:      return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:    return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:       return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:               return "cpu";
+    default:                                        return "other";
+    }
+}
+
+static std::string ToLower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+// Lower case hex without separators, so "01234567-89ab-..." and "0123456789AB..." compare equal
+static std::string NormalizeUUID(const std::string& text)
+{
+    std::string result;
+    for (unsigned char c : text)
+    {
+        if (std::isxdigit(c))
+        {
+            result.push_back(static_cast<char>(std::tolower(c)));
+        }
+    }
+    return result;
+}
+
+PhysicalDeviceSelector::PhysicalDeviceSelector(VkInstance instance, uint32_t instanceApiVersion, JobSystem* jobs)
+    : m_Instance(instance)
+    , m_InstanceApiVersion(instanceApiVersion)
+    , m_Jobs(jobs)
+{
+}
+
+VkPhysicalDevice PhysicalDeviceSelector::Select(const RequirementCheck& requirements, const std::string& overrideDevice)
+{
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(m_Instance, &deviceCount, nullptr);
+
+    if (deviceCount == 0)
+    {
+        throw std::runtime_error("Failed to find GPUs with Vulkan support!");
+    }
+
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(m_Instance, &deviceCount, devices.data());
+
+    // Queries of different physical devices do not touch shared state
+    m_Candidates.assign(deviceCount, Candidate{});
+    auto evaluate = [this, &devices](uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            m_Candidates[i] = Evaluate(devices[i]);
+        }
+    };
+    if (m_Jobs != nullptr)
+    {
+        m_Jobs->ParallelFor(deviceCount, 1, evaluate);
+    }
+    else
+    {
+        evaluate(0, deviceCount);
+    }
+
+    // A rejected device keeps its score, but is never chosen
+    for (Candidate& candidate : m_Candidates)
+    {
+        candidate.rejectReason = requirements(candidate.device);
+        Log(candidate);
+    }
+
+    const Candidate* chosen = nullptr;
+    const char* reason = "highest score";
+
+    if (!overrideDevice.empty())
+    {
+        for (const Candidate& candidate : m_Candidates)
+        {
+            if (candidate.rejectReason.empty() && MatchesOverride(candidate, overrideDevice))
+            {
+                chosen = &candidate;
+                reason = "requested override";
+                break;
+            }
+        }
+
+        if (chosen == nullptr)
+        {
+            std::cerr << "Device override \"" << overrideDevice << "\" matches no usable device, falling back to scoring" << std::endl;
+        }
+    }
+
+    if (chosen == nullptr)
+    {
+        // Ties go to the device the loader listed first
+        for (const Candidate& candidate : m_Candidates)
+        {
+            if (candidate.rejectReason.empty() && (chosen == nullptr || candidate.score > chosen->score))
+            {
+                chosen = &candidate;
+            }
+        }
+    }
+
+    if (chosen == nullptr)
+    {
+        throw std::runtime_error("Failed to find a suitable GPU!");
+    }
+
+    std::cout << "Selected device: " << chosen->name << " (" << reason << ")\n";
+    return chosen->device;
+}
+
+PhysicalDeviceSelector::Candidate PhysicalDeviceSelector::Evaluate(VkPhysicalDevice device) const
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(device, &features);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    Candidate candidate;
+    candidate.device = device;
+    candidate.name = properties.deviceName;
+    candidate.deviceType = properties.deviceType;
+    candidate.uuid = QueryDeviceUUID(device, properties.apiVersion);
+
+    switch (properties.deviceType)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:      candidate.typeScore = SCORE_DISCRETE_GPU; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:    candidate.typeScore = SCORE_INTEGRATED_GPU; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:       candidate.typeScore = SCORE_VIRTUAL_GPU; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:               candidate.typeScore = SCORE_CPU; break;
+    default:                                        candidate.typeScore = 0; break;
+    }
+
+    // The largest device local heap is what textures and render targets live in.
+    // Integrated GPUs report (part of) system memory here, which is why the type
+    // weight above is still needed.
+    VkDeviceSize largestDeviceLocalHeap = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+    {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            largestDeviceLocalHeap = std::max(largestDeviceLocalHeap, memoryProperties.memoryHeaps[i].size);
+        }
+    }
+    // CPU devices (lavapipe, SwiftShader) report system memory as device local, which would
+    // outweigh the type gap to an integrated GPU with a small carveout
+    int64_t heapGiB = static_cast<int64_t>(largestDeviceLocalHeap >> 30);
+    candidate.memoryScore = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU
+        ? 0 : std::min(heapGiB * SCORE_PER_GIB_DEVICE_LOCAL, MAX_MEMORY_SCORE);
+
+    // Queue families without graphics let compute and uploads overlap with rendering
+    bool dedicatedCompute = false;
+    bool dedicatedTransfer = false;
+    for (const auto& queueFamily : queueFamilies)
+    {
+        bool graphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        bool compute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+        bool transfer = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0;
+        dedicatedCompute |= compute && !graphics;
+        dedicatedTransfer |= transfer && !graphics && !compute;
+    }
+    candidate.queueScore = (dedicatedCompute ? SCORE_DEDICATED_COMPUTE_QUEUE : 0) + (dedicatedTransfer ? SCORE_DEDICATED_TRANSFER_QUEUE : 0);
+
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    candidate.limitScore = limits.maxImageDimension2D / 64
+        + limits.maxComputeSharedMemorySize / 1024
+        + limits.maxComputeWorkGroupInvocations / 16
+        + static_cast<int64_t>(limits.maxSamplerAnisotropy) * 4
+        + (limits.timestampComputeAndGraphics ? 25 : 0);
+
+    candidate.featureScore = (features.multiDrawIndirect ? 100 : 0)
+        + (features.drawIndirectFirstInstance ? 25 : 0)
+        + (features.samplerAnisotropy ? 50 : 0)
+        + (features.geometryShader ? 50 : 0)
+        + (features.textureCompressionBC ? 25 : 0)
+        + (features.pipelineStatisticsQuery ? 25 : 0)
+        + (features.shaderInt64 ? 25 : 0);
+
+    candidate.score = candidate.typeScore + candidate.memoryScore + candidate.queueScore + candidate.limitScore + candidate.featureScore;
+    return candidate;
+}
+
+// The device UUID is stable across driver updates and reboots, unlike the enumeration
+// order, but it needs Vulkan 1.1 on both the instance and the device.
+std::string PhysicalDeviceSelector::QueryDeviceUUID(VkPhysicalDevice device, uint32_t deviceApiVersion) const
+{
+    if (m_InstanceApiVersion < VK_API_VERSION_1_1 || deviceApiVersion < VK_API_VERSION_1_1)
+    {
+        return std::string();
+    }
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+
+    static const char* hexDigits = "0123456789abcdef";
+    std::string uuid;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+    {
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+        {
+            uuid.push_back('-');
+        }
+        uuid.push_back(hexDigits[idProperties.deviceUUID[i] >> 4]);
+        uuid.push_back(hexDigits[idProperties.deviceUUID[i] & 0xF]);
+    }
+    return uuid;
+}
+
+bool PhysicalDeviceSelector::MatchesOverride(const Candidate& candidate, const std::string& overrideDevice)
+{
+    std::string normalized = NormalizeUUID(overrideDevice);
+    if (!candidate.uuid.empty() && normalized.size() == 2 * VK_UUID_SIZE && normalized == NormalizeUUID(candidate.uuid))
+    {
+        return true;
+    }
+
+    return ToLower(candidate.name).find(ToLower(overrideDevice)) != std::string::npos;
+}
+
+void PhysicalDeviceSelector::Log(const Candidate& candidate)
+{
+    std::cout << "Device: " << candidate.name << " [" << DeviceTypeName(candidate.deviceType) << "]";
+    if (!candidate.uuid.empty())
+    {
+        std::cout << " uuid " << candidate.uuid;
+    }
+
+    if (!candidate.rejectReason.empty())
+    {
+        std::cout << " - rejected: " << candidate.rejectReason << '\n';
+        return;
+    }
+
+    std::cout << " - score " << candidate.score << " (type " << candidate.typeScore << ", memory " << candidate.memoryScore
+        << ", queues " << candidate.queueScore << ", limits " << candidate.limitScore << ", features " << candidate.featureScore << ")\n";
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+class JobSystem;
+
+// Picks the physical device to run on. Devices that cannot run the engine at all are
+// rejected by a caller supplied check; the rest are scored on what makes them fast
+// (device type, device local memory, dedicated queues, limits and optional features)
+// and the highest score wins. A device can also be forced by name or UUID.
+//
+// With a job system, the devices are queried in parallel. The requirement check may use
+// the surface and always runs on the calling thread.
+class PhysicalDeviceSelector
+{
+public:
+    // Returns an empty string if the engine can run on the device, otherwise the reason it cannot
+    using RequirementCheck = std::function<std::string(VkPhysicalDevice)>;
+
+    struct Candidate
+    {
+        VkPhysicalDevice    device          = nullptr;
+        std::string         name;
+        std::string         uuid;           // empty when the device UUID cannot be queried
+        uint32_t            deviceType      = 0; // VkPhysicalDeviceType
+        std::string         rejectReason;   // empty for usable devices
+
+        // Score and the parts it is made of, kept for the log
+        int64_t             score           = 0;
+        int64_t             typeScore       = 0;
+        int64_t             memoryScore     = 0;
+        int64_t             queueScore      = 0;
+        int64_t             limitScore      = 0;
+        int64_t             featureScore    = 0;
+    };
+
+    PhysicalDeviceSelector(VkInstance instance, uint32_t instanceApiVersion, JobSystem* jobs = nullptr);
+
+    // Throws if no device passes the requirement check.
+    // overrideDevice is matched against the device name (case insensitive substring)
+    // or its UUID; an override that matches no usable device is ignored with a warning.
+    VkPhysicalDevice Select(const RequirementCheck& requirements, const std::string& overrideDevice);
+
+    const std::vector<Candidate>& GetCandidates() const { return m_Candidates; }
+
+private:
+    Candidate Evaluate(VkPhysicalDevice device) const;
+    std::string QueryDeviceUUID(VkPhysicalDevice device, uint32_t deviceApiVersion) const;
+    static bool MatchesOverride(const Candidate& candidate, const std::string& overrideDevice);
+    static void Log(const Candidate& candidate);
+
+    VkInstance              m_Instance              = nullptr;
+    uint32_t                m_InstanceApiVersion    = 0;
+    JobSystem*              m_Jobs                  = nullptr;
+    std::vector<Candidate>  m_Candidates;
+};
@@ -0,0 +1,364 @@
+#include "PipelineCache.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Header written in front of the driver's blob. The driver puts its own header in the
+// blob too, but it only covers the device, not the driver version, and it carries no
+// checksum, so a cache from an updated driver or a torn write would be handed to the
+// driver as is.
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  cacheUUID[VK_UUID_SIZE];
+    uint32_t reserved;
+    uint64_t dataSize;
+    uint64_t checksum;
+    double   averageMissMs;
+};
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43504B56; // "VKPC"
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// FNV-1a, fast enough for a few megabytes and catches truncated or garbled files
+static uint64_t ComputeChecksum(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const char* ToString(PipelineCache::LoadResult result)
+{
+    switch (result)
+    {
+    case PipelineCache::LoadResult::Loaded:         return "loaded";
+    case PipelineCache::LoadResult::FileMissing:    return "no cache file";
+    case PipelineCache::LoadResult::Corrupt:        return "corrupt, discarded";
+    case PipelineCache::LoadResult::DeviceMismatch: return "device or driver changed, discarded";
+    default:                                        return "not loaded";
+    }
+}
+
+double PipelineCache::Stats::EstimatedTimeSavedMs() const
+{
+    if (hits == 0 || averageMissMs <= 0.0)
+    {
+        return 0.0;
+    }
+    return hits * averageMissMs - hitMs;
+}
+
+void PipelineCache::Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+    const std::string& path, bool creationFeedback, const VkAllocationCallbacks* allocator)
+{
+    m_PhysicalDevice = physicalDevice;
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = allocator;
+    m_Path = path;
+    m_CreationFeedback = creationFeedback;
+    m_Stats = Stats{};
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    m_VendorID = properties.vendorID;
+    m_DeviceID = properties.deviceID;
+    m_DriverVersion = properties.driverVersion;
+    std::memcpy(m_CacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::string data;
+    m_Stats.loadResult = m_Path.empty() ? LoadResult::NotLoaded : ReadFile(data, m_Stats.averageMissMs);
+    if (m_Stats.loadResult != LoadResult::Loaded)
+    {
+        data.clear();
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (m_Dispatch->vkCreatePipelineCache(m_Device, &createInfo, m_Allocator, &m_Cache) != VK_SUCCESS)
+    {
+        // The driver may still refuse a blob that passed every check, start over empty
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        m_Stats.loadResult = LoadResult::Corrupt;
+        data.clear();
+
+        if (m_Dispatch->vkCreatePipelineCache(m_Device, &createInfo, m_Allocator, &m_Cache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline cache!");
+        }
+    }
+
+    m_Stats.loadedBytes = data.size();
+    m_Stats.loadMs = MillisecondsSince(start);
+}
+
+void PipelineCache::Destroy()
+{
+    if (m_Cache != VK_NULL_HANDLE)
+    {
+        m_Dispatch->vkDestroyPipelineCache(m_Device, m_Cache, m_Allocator);
+        m_Cache = VK_NULL_HANDLE;
+    }
+}
+
+PipelineCache::LoadResult PipelineCache::ReadFile(std::string& data, double& averageMissMs) const
+{
+    std::ifstream file(m_Path, std::ios::binary);
+    if (!file)
+    {
+        return LoadResult::FileMissing;
+    }
+
+    PipelineCacheFileHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION)
+    {
+        return LoadResult::Corrupt;
+    }
+
+    if (header.vendorID != m_VendorID || header.deviceID != m_DeviceID || header.driverVersion != m_DriverVersion ||
+        std::memcmp(header.cacheUUID, m_CacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return LoadResult::DeviceMismatch;
+    }
+
+    // Check the size against the file before allocating, a garbled header could ask for anything
+    std::error_code error;
+    uintmax_t fileSize = std::filesystem::file_size(m_Path, error);
+    if (error || fileSize != sizeof(header) + header.dataSize)
+    {
+        return LoadResult::Corrupt;
+    }
+
+    data.resize(static_cast<size_t>(header.dataSize));
+    if (!file.read(&data[0], data.size()))
+    {
+        return LoadResult::Corrupt;
+    }
+
+    if (ComputeChecksum(data.data(), data.size()) != header.checksum)
+    {
+        return LoadResult::Corrupt;
+    }
+
+    // The blob starts with the driver's own header, which has to agree with ours
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader))
+    {
+        return LoadResult::Corrupt;
+    }
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader.vendorID != m_VendorID ||
+        driverHeader.deviceID != m_DeviceID || std::memcmp(driverHeader.pipelineCacheUUID, m_CacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return LoadResult::DeviceMismatch;
+    }
+
+    averageMissMs = header.averageMissMs;
+    return LoadResult::Loaded;
+}
+
+// Writes and flushes the file all the way to the disk, not only to the OS
+static bool WriteFileDurably(const std::string& path, const PipelineCacheFileHeader& header, const std::vector<uint8_t>& data)
+{
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && (data.empty() || std::fwrite(data.data(), data.size(), 1, file) == 1)
+        && std::fflush(file) == 0;
+#if defined(_WIN32)
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    return std::fclose(file) == 0 && written;
+}
+
+void PipelineCache::Save()
+{
+    if (m_Cache == VK_NULL_HANDLE || m_Path.empty())
+    {
+        return;
+    }
+
+    // A warm start that compiled nothing new would write back the same blob
+    if (m_Stats.loadResult == LoadResult::Loaded && m_Stats.misses == 0 && m_Stats.unclassified == 0)
+    {
+        return;
+    }
+
+    size_t dataSize = 0;
+    if (m_Dispatch->vkGetPipelineCacheData(m_Device, m_Cache, &dataSize, nullptr) != VK_SUCCESS)
+    {
+        return;
+    }
+    std::vector<uint8_t> data(dataSize);
+    if (m_Dispatch->vkGetPipelineCacheData(m_Device, m_Cache, &dataSize, data.data()) != VK_SUCCESS)
+    {
+        return;
+    }
+    data.resize(dataSize);
+
+    PipelineCacheFileHeader header{};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.version = PIPELINE_CACHE_VERSION;
+    header.vendorID = m_VendorID;
+    header.deviceID = m_DeviceID;
+    header.driverVersion = m_DriverVersion;
+    std::memcpy(header.cacheUUID, m_CacheUUID, VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.checksum = ComputeChecksum(data.data(), data.size());
+    header.averageMissMs = m_Stats.misses > 0 ? m_Stats.missMs / m_Stats.misses : m_Stats.averageMissMs;
+
+    // Write next to the target and rename over it, so a crash mid-write leaves either
+    // the old cache or the new one, never a torn file. The data reaches the disk before the
+    // rename does, otherwise a power loss could keep the rename but not the contents.
+    std::string tempPath = m_Path + ".tmp";
+    if (!WriteFileDurably(tempPath, header, data))
+    {
+        std::cerr << "Pipeline cache: failed to write " << tempPath << std::endl;
+        std::error_code ignored;
+        std::filesystem::remove(tempPath, ignored);
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, m_Path, error);
+    if (error)
+    {
+        std::cerr << "Pipeline cache: failed to replace " << m_Path << ": " << error.message() << std::endl;
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+void PipelineCache::RecordCreation(double ms, bool feedbackValid, bool hit)
+{
+    if (!feedbackValid)
+    {
+        m_Stats.unclassified++;
+        m_Stats.unclassifiedMs += ms;
+    }
+    else if (hit)
+    {
+        m_Stats.hits++;
+        m_Stats.hitMs += ms;
+    }
+    else
+    {
+        m_Stats.misses++;
+        m_Stats.missMs += ms;
+    }
+}
+
+// Both pipeline types go through the same steps: chain a feedback struct per pipeline,
+// create the whole batch through the cache and attribute the time to each pipeline.
+template<typename CreateInfo, typename CreateFunction>
+static void CreatePipelinesWithFeedback(uint32_t count, const CreateInfo* createInfos, bool creationFeedback,
+    CreateFunction create, std::vector<VkPipelineCreationFeedbackEXT>& feedback, double& batchMs)
+{
+    std::vector<CreateInfo> chainedInfos(createInfos, createInfos + count);
+    std::vector<VkPipelineCreationFeedbackCreateInfoEXT> feedbackInfos(count);
+    feedback.assign(count, VkPipelineCreationFeedbackEXT{});
+
+    if (creationFeedback)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            feedbackInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+            feedbackInfos[i].pNext = chainedInfos[i].pNext;
+            feedbackInfos[i].pPipelineCreationFeedback = &feedback[i];
+            chainedInfos[i].pNext = &feedbackInfos[i];
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (create(chainedInfos.data()) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create pipelines!");
+    }
+    batchMs = MillisecondsSince(start);
+}
+
+void PipelineCache::CreateGraphicsPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo* createInfos, VkPipeline* pipelines)
+{
+    std::vector<VkPipelineCreationFeedbackEXT> feedback;
+    double batchMs = 0.0;
+    CreatePipelinesWithFeedback(count, createInfos, m_CreationFeedback,
+        [&](const VkGraphicsPipelineCreateInfo* infos) { return m_Dispatch->vkCreateGraphicsPipelines(m_Device, m_Cache, count, infos, m_Allocator, pipelines); },
+        feedback, batchMs);
+
+    for (const auto& entry : feedback)
+    {
+        bool valid = (entry.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0;
+        bool hit = (entry.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+        RecordCreation(valid ? entry.duration / 1.0e6 : batchMs / count, valid, hit);
+    }
+}
+
+void PipelineCache::CreateComputePipelines(uint32_t count, const VkComputePipelineCreateInfo* createInfos, VkPipeline* pipelines)
+{
+    std::vector<VkPipelineCreationFeedbackEXT> feedback;
+    double batchMs = 0.0;
+    CreatePipelinesWithFeedback(count, createInfos, m_CreationFeedback,
+        [&](const VkComputePipelineCreateInfo* infos) { return m_Dispatch->vkCreateComputePipelines(m_Device, m_Cache, count, infos, m_Allocator, pipelines); },
+        feedback, batchMs);
+
+    for (const auto& entry : feedback)
+    {
+        bool valid = (entry.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) != 0;
+        bool hit = (entry.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+        RecordCreation(valid ? entry.duration / 1.0e6 : batchMs / count, valid, hit);
+    }
+}
+
+void PipelineCache::PrintStats() const
+{
+    std::cout << "Pipeline cache: " << ToString(m_Stats.loadResult) << " (" << m_Stats.loadedBytes << " bytes in "
+        << m_Stats.loadMs << " ms), " << m_Stats.hits << " hits (" << m_Stats.hitMs << " ms), "
+        << m_Stats.misses << " misses (" << m_Stats.missMs << " ms)";
+    if (m_Stats.unclassified > 0)
+    {
+        std::cout << ", " << m_Stats.unclassified << " unclassified (" << m_Stats.unclassifiedMs << " ms)";
+    }
+    std::cout << ", estimated time saved " << m_Stats.EstimatedTimeSavedMs() << " ms\n";
+}
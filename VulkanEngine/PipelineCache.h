@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// Wraps a VkPipelineCache that survives restarts. The driver's cache blob is stored
+// on disk behind a small header that ties it to one device and driver build and
+// carries a checksum of the blob. A cache that does not match is discarded and the
+// engine starts with an empty one.
+class PipelineCache
+{
+public:
+    enum class LoadResult
+    {
+        NotLoaded,
+        Loaded,
+        FileMissing,
+        Corrupt,            // truncated file, bad magic or checksum mismatch
+        DeviceMismatch,     // written by another device, vendor or driver version
+    };
+
+    struct Stats
+    {
+        LoadResult  loadResult          = LoadResult::NotLoaded;
+        size_t      loadedBytes         = 0;
+        double      loadMs              = 0.0;
+
+        // Classified with VK_EXT_pipeline_creation_feedback when the device supports it,
+        // otherwise every pipeline ends up in unclassified
+        uint32_t    hits                = 0;
+        uint32_t    misses              = 0;
+        uint32_t    unclassified        = 0;
+        double      hitMs               = 0.0;
+        double      missMs              = 0.0;
+        double      unclassifiedMs      = 0.0;
+
+        // Average time a pipeline took to compile without the cache, carried over
+        // between runs so a fully warm start can still estimate what it saved
+        double      averageMissMs       = 0.0;
+
+        double EstimatedTimeSavedMs() const;
+    };
+
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+        const std::string& path, bool creationFeedback, const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    // Writes the cache to disk if it learned anything since it was loaded
+    void Save();
+
+    // Same contract as vkCreate*Pipelines, but timed and classified as hit or miss.
+    // Throws if pipeline creation fails.
+    void CreateGraphicsPipelines(uint32_t count, const VkGraphicsPipelineCreateInfo* createInfos, VkPipeline* pipelines);
+    void CreateComputePipelines(uint32_t count, const VkComputePipelineCreateInfo* createInfos, VkPipeline* pipelines);
+
+    VkPipelineCache GetHandle() const { return m_Cache; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    LoadResult ReadFile(std::string& data, double& averageMissMs) const;
+    void RecordCreation(double ms, bool feedbackValid, bool hit);
+
+    VkPhysicalDevice    m_PhysicalDevice    = nullptr;
+    VkDevice            m_Device            = nullptr;
+    const VulkanDeviceDispatch* m_Dispatch  = nullptr;
+    const VkAllocationCallbacks* m_Allocator = nullptr;
+    VkPipelineCache     m_Cache             = nullptr;
+    std::string         m_Path;
+    bool                m_CreationFeedback  = false;
+
+    // Identity of the device the cache belongs to
+    uint32_t            m_VendorID          = 0;
+    uint32_t            m_DeviceID          = 0;
+    uint32_t            m_DriverVersion     = 0;
+    uint8_t             m_CacheUUID[16]     = {};
+
+    Stats               m_Stats;
+};
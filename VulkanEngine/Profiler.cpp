@@ -0,0 +1,229 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+    #define PROFILER_USE_TSC 1
+#else
+    #define PROFILER_USE_TSC 0
+#endif
+
+namespace
+{
+    struct Zone
+    {
+        const char* name;
+        uint64_t    start;
+        uint64_t    end;
+    };
+
+    // One per thread that ever recorded a zone. Owned by the registry rather than the
+    // thread, so zones of threads that already exited are still exported.
+    struct ThreadBuffer
+    {
+        uint32_t            threadIndex = 0;
+        std::string         name;
+        std::vector<Zone>   zones;
+    };
+
+    // A raw timestamp and the steady_clock time it was taken at. Comparing the origin
+    // with a second sample at export gives the tick rate over the whole run.
+    struct Timebase
+    {
+        uint64_t                                ticks;
+        std::chrono::steady_clock::time_point   time;
+    };
+
+    struct Registry
+    {
+        std::mutex                                  mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>>  threads;
+    };
+
+    uint64_t ReadTicks()
+    {
+#if PROFILER_USE_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Taken during static initialization, before any zone can be recorded
+    const Timebase g_Origin = { ReadTicks(), std::chrono::steady_clock::now() };
+
+    Registry& GetRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    ThreadBuffer& GetThreadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+
+            auto newBuffer = std::make_unique<ThreadBuffer>();
+            newBuffer->threadIndex = static_cast<uint32_t>(registry.threads.size());
+            newBuffer->name = "Thread " + std::to_string(newBuffer->threadIndex);
+            // Reserve up front so recording a zone does not reallocate in the common case
+            newBuffer->zones.reserve(1 << 16);
+
+            buffer = newBuffer.get();
+            registry.threads.push_back(std::move(newBuffer));
+        }
+        return *buffer;
+    }
+
+    // Raw ticks per microsecond, measured over the whole run
+    double TicksPerMicrosecond()
+    {
+#if PROFILER_USE_TSC
+        const Timebase& origin = g_Origin;
+        uint64_t ticks = ReadTicks();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin.time).count();
+        if (us <= 0.0 || ticks <= origin.ticks)
+        {
+            return 1.0;
+        }
+        return (ticks - origin.ticks) / us;
+#else
+        return 1000.0;
+#endif
+    }
+
+    void WriteJsonString(std::ostream& out, const char* text)
+    {
+        out << '"';
+        for (const char* c = text; *c != '\0'; c++)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                out << '\\';
+            }
+            out << *c;
+        }
+        out << '"';
+    }
+
+    double Percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+}
+
+uint64_t Profiler::Now()
+{
+    return ReadTicks();
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+    GetThreadBuffer().zones.push_back({ name, start, end });
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+    buffer.name = name;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to open " << path << " for writing!" << std::endl;
+        return false;
+    }
+
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    const double ticksPerUs = TicksPerMicrosecond();
+    const uint64_t origin = g_Origin.ticks;
+
+    // Complete ("X") events nest by time, so no explicit begin/end pairing is needed
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& thread : registry.threads)
+    {
+        file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << thread->threadIndex
+            << ",\"args\":{\"name\":";
+        WriteJsonString(file, thread->name.c_str());
+        file << "}}";
+        first = false;
+
+        for (const Zone& zone : thread->zones)
+        {
+            double ts = static_cast<int64_t>(zone.start - origin) / ticksPerUs;
+            double dur = (zone.end - zone.start) / ticksPerUs;
+            file << ",\n{\"ph\":\"X\",\"name\":";
+            WriteJsonString(file, zone.name);
+            file << ",\"pid\":1,\"tid\":" << thread->threadIndex << std::fixed << std::setprecision(3)
+                << ",\"ts\":" << ts << ",\"dur\":" << dur << '}';
+        }
+    }
+    file << "\n]}\n";
+
+    return static_cast<bool>(file);
+}
+
+void Profiler::PrintSummary(std::ostream& out)
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    const double ticksPerMs = TicksPerMicrosecond() * 1000.0;
+
+    // Zones are grouped by name; the same literal may live at different addresses
+    // in different translation units, so compare the text
+    std::map<std::string, std::vector<double>> durations;
+    for (const auto& thread : registry.threads)
+    {
+        for (const Zone& zone : thread->zones)
+        {
+            durations[zone.name].push_back((zone.end - zone.start) / ticksPerMs);
+        }
+    }
+
+    out << std::left << std::setw(40) << "Zone" << std::right << std::setw(8) << "count" << std::setw(12) << "total ms"
+        << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << '\n';
+
+    out << std::fixed << std::setprecision(3);
+    for (auto& entry : durations)
+    {
+        std::vector<double>& values = entry.second;
+        std::sort(values.begin(), values.end());
+
+        double total = 0.0;
+        for (double value : values)
+        {
+            total += value;
+        }
+
+        out << std::left << std::setw(40) << entry.first << std::right << std::setw(8) << values.size() << std::setw(12) << total
+            << std::setw(10) << Percentile(values, 0.50) << std::setw(10) << Percentile(values, 0.95)
+            << std::setw(10) << Percentile(values, 0.99) << std::setw(10) << values.back() << '\n';
+    }
+    out << std::defaultfloat;
+}
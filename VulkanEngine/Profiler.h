@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+
+// Scoped-zone CPU profiler.
+//
+// PROFILE_SCOPE("Name") times the enclosing scope and PROFILE_FUNCTION() the enclosing
+// function. Zones are appended to a buffer owned by the calling thread, so recording
+// takes no lock. Names must be string literals, only the pointer is stored.
+//
+// Profiling is compiled out of release builds. Define ENGINE_PROFILING=1 to keep it.
+#ifndef ENGINE_PROFILING
+    #ifdef NDEBUG
+        #define ENGINE_PROFILING 0
+    #else
+        #define ENGINE_PROFILING 1
+    #endif
+#endif
+
+namespace Profiler
+{
+    // Raw timestamp, TSC ticks on x86-64 and steady_clock nanoseconds elsewhere
+    uint64_t Now();
+
+    void Record(const char* name, uint64_t start, uint64_t end);
+
+    // Shown as the thread's name in the trace viewer
+    void SetThreadName(const char* name);
+
+    // Exporting reads every thread's buffer, so it must not run while other threads
+    // are still recording (the engine exports once it has shut down)
+    bool WriteChromeTrace(const std::string& path);
+
+    // Count, total and p50/p95/p99/max duration per zone name
+    void PrintSummary(std::ostream& out);
+}
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : m_Name(name)
+        , m_Start(Profiler::Now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::Record(m_Name, m_Start, Profiler::Now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_Name;
+    uint64_t    m_Start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if ENGINE_PROFILING
+    #define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+    #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+    #define PROFILE_SCOPE(name) ((void)0)
+    #define PROFILE_FUNCTION() ((void)0)
+#endif
@@ -0,0 +1,1438 @@
+#include "RenderGraph.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+// Access bits that make a use a write; the others only need visibility
+constexpr VkAccessFlags2 WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT
+    | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+namespace
+{
+    // Stages, access and layout of one kind of use. Shader stages are filled in per pass type.
+    struct AccessInfo
+    {
+        VkPipelineStageFlags2   stages;
+        VkAccessFlags2          access;
+        VkImageLayout           layout;
+        bool                    shader;
+        bool                    write;
+        VkImageUsageFlags       imageUsage;
+        VkBufferUsageFlags      bufferUsage;
+    };
+
+    AccessInfo GetAccessInfo(RenderGraph::Access access)
+    {
+        switch (access)
+        {
+        case RenderGraph::Access::ColorAttachmentWrite:
+            return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0 };
+        case RenderGraph::Access::DepthStencilWrite:
+            return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, false, true, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 };
+        case RenderGraph::Access::DepthStencilRead:
+            return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false, false, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 };
+        case RenderGraph::Access::SampledRead:
+            return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false, VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT };
+        case RenderGraph::Access::StorageRead:
+            return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_SHADER_READ_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, true, false, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+        case RenderGraph::Access::StorageWrite:
+            return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_GENERAL, true, true, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT };
+        case RenderGraph::Access::UniformRead:
+            return { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_UNIFORM_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, true, false, 0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
+        case RenderGraph::Access::VertexBufferRead:
+            return { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false, false, 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT };
+        case RenderGraph::Access::IndexBufferRead:
+            return { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false, false, 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT };
+        case RenderGraph::Access::IndirectRead:
+            return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+                VK_IMAGE_LAYOUT_UNDEFINED, false, false, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT };
+        case RenderGraph::Access::TransferRead:
+            return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false, false, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+        case RenderGraph::Access::TransferWrite:
+            return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false, true, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+        }
+        throw std::runtime_error("Unknown render graph access!");
+    }
+
+    bool IsAttachmentAccess(RenderGraph::Access access)
+    {
+        return access == RenderGraph::Access::ColorAttachmentWrite || access == RenderGraph::Access::DepthStencilWrite
+            || access == RenderGraph::Access::DepthStencilRead || access == RenderGraph::Access::VertexBufferRead
+            || access == RenderGraph::Access::IndexBufferRead;
+    }
+
+    VkImageAspectFlags GetAspectMask(uint32_t format)
+    {
+        switch (static_cast<VkFormat>(format))
+        {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+    // The stage bits the graph uses all exist in synchronization 1 with the same values.
+    // NONE becomes TOP_OF_PIPE as a source and BOTTOM_OF_PIPE as a destination.
+    VkPipelineStageFlags ToLegacyStages(VkPipelineStageFlags2 stages, bool source)
+    {
+        if (stages == VK_PIPELINE_STAGE_2_NONE)
+        {
+            return source ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+        return static_cast<VkPipelineStageFlags>(stages);
+    }
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    const char* GetLayoutName(uint32_t layout)
+    {
+        switch (static_cast<VkImageLayout>(layout))
+        {
+        case VK_IMAGE_LAYOUT_UNDEFINED:                         return "UNDEFINED";
+        case VK_IMAGE_LAYOUT_GENERAL:                           return "GENERAL";
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:          return "COLOR_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:  return "DEPTH_STENCIL_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:   return "DEPTH_STENCIL_READ_ONLY";
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:          return "SHADER_READ_ONLY";
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:              return "TRANSFER_SRC";
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:              return "TRANSFER_DST";
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:                   return "PRESENT_SRC";
+        default:                                                return "OTHER";
+        }
+    }
+
+    std::string GetStageNames(uint64_t stages)
+    {
+        static const std::pair<VkPipelineStageFlags2, const char*> names[] =
+        {
+            { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,            "DRAW_INDIRECT" },
+            { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT,             "VERTEX_INPUT" },
+            { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,            "VERTEX_SHADER" },
+            { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,          "FRAGMENT_SHADER" },
+            { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT,     "EARLY_FRAGMENT_TESTS" },
+            { VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,      "LATE_FRAGMENT_TESTS" },
+            { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,  "COLOR_ATTACHMENT_OUTPUT" },
+            { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,           "COMPUTE_SHADER" },
+            { VK_PIPELINE_STAGE_2_TRANSFER_BIT,                 "TRANSFER" },
+            { VK_PIPELINE_STAGE_2_HOST_BIT,                     "HOST" },
+            { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,             "ALL_COMMANDS" },
+        };
+
+        std::string result;
+        for (const auto& name : names)
+        {
+            if (stages & name.first)
+            {
+                result += result.empty() ? "" : "|";
+                result += name.second;
+            }
+        }
+        return result.empty() ? "NONE" : result;
+    }
+}
+
+void RenderGraph::Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator,
+    VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t computeFamily, uint32_t framesInFlight,
+    bool synchronization2, const VkAllocationCallbacks* callbacks)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = &allocator;
+    m_Callbacks = callbacks;
+    m_Queues[0] = graphicsQueue;
+    m_Queues[1] = computeQueue;
+    m_GraphicsFamily = graphicsFamily;
+    m_ComputeFamily = computeFamily;
+    m_FramesInFlight = framesInFlight;
+
+    // The entry point comes from VK_KHR_synchronization2 before 1.3 and is core after
+    m_Synchronization2 = synchronization2
+        && (m_Dispatch->vkCmdPipelineBarrier2KHR != nullptr || m_Dispatch->vkCmdPipelineBarrier2 != nullptr);
+}
+
+void RenderGraph::Destroy()
+{
+    Reset();
+    m_Device = VK_NULL_HANDLE;
+    m_Allocator = nullptr;
+}
+
+void RenderGraph::Reset()
+{
+    DestroyCompiled();
+    m_Passes.clear();
+    m_Resources.clear();
+}
+
+RenderGraph::Handle RenderGraph::AddResource(Resource&& resource)
+{
+    m_Resources.push_back(std::move(resource));
+    m_Compiled = false;
+    return static_cast<Handle>(m_Resources.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::CreateTexture(const std::string& name, const TextureDesc& desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.texture = true;
+    resource.desc = desc;
+    return AddResource(std::move(resource));
+}
+
+RenderGraph::Handle RenderGraph::CreateBuffer(const std::string& name, uint64_t size)
+{
+    Resource resource;
+    resource.name = name;
+    resource.size = size;
+    return AddResource(std::move(resource));
+}
+
+RenderGraph::Handle RenderGraph::ImportTexture(const std::string& name, VkImage image, VkImageView view, const TextureDesc& desc,
+    const ResourceState& initialState, const ResourceState& finalState)
+{
+    Resource resource;
+    resource.name = name;
+    resource.texture = true;
+    resource.imported = true;
+    resource.desc = desc;
+    resource.initialState = initialState;
+    resource.finalState = finalState;
+    resource.images.push_back(image);
+    resource.views.push_back(view);
+    return AddResource(std::move(resource));
+}
+
+RenderGraph::Handle RenderGraph::ImportBuffer(const std::string& name, VkBuffer buffer, uint64_t size,
+    const ResourceState& initialState, const ResourceState& finalState)
+{
+    Resource resource;
+    resource.name = name;
+    resource.imported = true;
+    resource.size = size;
+    resource.initialState = initialState;
+    resource.finalState = finalState;
+    resource.buffers.push_back(buffer);
+    return AddResource(std::move(resource));
+}
+
+void RenderGraph::SetImportedTexture(Handle texture, VkImage image, VkImageView view)
+{
+    Resource& resource = m_Resources.at(texture);
+    if (!resource.imported || !resource.texture)
+    {
+        throw std::runtime_error("Render graph resource '" + resource.name + "' is not an imported texture!");
+    }
+    resource.images[0] = image;
+    resource.views[0] = view;
+}
+
+void RenderGraph::SetImportedBuffer(Handle buffer, VkBuffer vkBuffer)
+{
+    Resource& resource = m_Resources.at(buffer);
+    if (!resource.imported || resource.texture)
+    {
+        throw std::runtime_error("Render graph resource '" + resource.name + "' is not an imported buffer!");
+    }
+    resource.buffers[0] = vkBuffer;
+}
+
+RenderGraph::Handle RenderGraph::AddPass(const std::string& name, PassType type, ExecuteFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.execute = std::move(execute);
+    m_Passes.push_back(std::move(pass));
+    m_Compiled = false;
+    return static_cast<Handle>(m_Passes.size() - 1);
+}
+
+void RenderGraph::Read(Handle pass, Handle resource, Access access)
+{
+    AddUse(pass, resource, access, false);
+}
+
+void RenderGraph::Write(Handle pass, Handle resource, Access access)
+{
+    AddUse(pass, resource, access, true);
+}
+
+void RenderGraph::SetSideEffect(Handle pass)
+{
+    m_Passes.at(pass).sideEffect = true;
+}
+
+// Several uses of one resource in a pass are merged into one, which then needs a layout
+// that suits all of them
+void RenderGraph::AddUse(Handle passHandle, Handle resourceHandle, Access access, bool write)
+{
+    Pass& pass = m_Passes.at(passHandle);
+    Resource& resource = m_Resources.at(resourceHandle);
+    AccessInfo info = GetAccessInfo(access);
+
+    if (info.write != write)
+    {
+        throw std::runtime_error("Render graph pass '" + pass.name + "' uses '" + resource.name
+            + (write ? "' as a write with a read access!" : "' as a read with a write access!"));
+    }
+    if (pass.type != PassType::Graphics && IsAttachmentAccess(access))
+    {
+        throw std::runtime_error("Render graph pass '" + pass.name + "' is not a graphics pass but uses '" + resource.name + "' as an attachment or vertex input!");
+    }
+    if (pass.type == PassType::Transfer && info.shader)
+    {
+        throw std::runtime_error("Render graph pass '" + pass.name + "' is a transfer pass but accesses '" + resource.name + "' from a shader!");
+    }
+    if (resource.texture ? info.imageUsage == 0 : info.bufferUsage == 0)
+    {
+        throw std::runtime_error("Render graph pass '" + pass.name + "' uses '" + resource.name + "' with an access its kind of resource does not support!");
+    }
+
+    if (info.shader)
+    {
+        info.stages = (pass.type == PassType::Graphics)
+            ? VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT
+            : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    }
+    resource.usage |= resource.texture ? info.imageUsage : info.bufferUsage;
+
+    Use use;
+    use.resource = resourceHandle;
+    use.stages = info.stages;
+    use.access = info.access;
+    use.layout = resource.texture ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    use.read = !write || (info.access & ~WRITE_ACCESS_MASK) != 0;
+    use.write = write;
+
+    for (Use& existing : pass.uses)
+    {
+        if (existing.resource == resourceHandle)
+        {
+            existing.stages |= use.stages;
+            existing.access |= use.access;
+            existing.layout = (existing.layout == use.layout) ? use.layout : static_cast<uint32_t>(VK_IMAGE_LAYOUT_GENERAL);
+            existing.read = existing.read || use.read;
+            existing.write = existing.write || use.write;
+            m_Compiled = false;
+            return;
+        }
+    }
+
+    pass.uses.push_back(use);
+    m_Compiled = false;
+}
+
+void RenderGraph::Compile()
+{
+    DestroyCompiled();
+
+    CullPasses();
+    BuildBatches();
+    ComputeLifetimes();
+    CreateTransients();
+    PlaceBarriers();
+    CreateFrameObjects();
+
+    m_Compiled = true;
+}
+
+// Walks the passes backwards. A pass is needed if it has side effects or writes a resource
+// that is imported or read by a needed pass after it.
+void RenderGraph::CullPasses()
+{
+    std::vector<bool> needed(m_Resources.size(), false);
+
+    for (size_t i = m_Passes.size(); i-- > 0; )
+    {
+        Pass& pass = m_Passes[i];
+
+        bool live = pass.sideEffect;
+        for (const Use& use : pass.uses)
+        {
+            if (use.write && (m_Resources[use.resource].imported || needed[use.resource]))
+            {
+                live = true;
+            }
+        }
+
+        pass.culled = !live;
+        if (live)
+        {
+            for (const Use& use : pass.uses)
+            {
+                if (use.read)
+                {
+                    needed[use.resource] = true;
+                }
+            }
+        }
+    }
+
+    m_Order.clear();
+    for (uint32_t i = 0; i < m_Passes.size(); i++)
+    {
+        Pass& pass = m_Passes[i];
+        pass.batch = NO_INDEX;
+        pass.queue = (pass.type == PassType::AsyncCompute && HasAsyncCompute()) ? 1 : 0;
+        if (!pass.culled)
+        {
+            m_Order.push_back(i);
+        }
+    }
+}
+
+// Passes keep their declaration order. Every run of passes on one queue becomes a batch.
+// The first and the last batch are always on the graphics queue: the frame's external waits,
+// the imported resources and the frame fence all belong to the graphics queue.
+void RenderGraph::BuildBatches()
+{
+    m_Batches.clear();
+    m_Batches.emplace_back();
+
+    for (uint32_t passIndex : m_Order)
+    {
+        Pass& pass = m_Passes[passIndex];
+        if (m_Batches.back().queue != pass.queue)
+        {
+            m_Batches.emplace_back();
+            m_Batches.back().queue = pass.queue;
+        }
+        pass.batch = static_cast<uint32_t>(m_Batches.size() - 1);
+        m_Batches.back().passes.push_back(passIndex);
+    }
+
+    if (m_Batches.back().queue != 0)
+    {
+        m_Batches.emplace_back();
+    }
+
+    for (Batch& batch : m_Batches)
+    {
+        batch.before.resize(batch.passes.size());
+    }
+
+    m_FirstGraphicsBatch = 0;
+    m_LastGraphicsBatch = static_cast<uint32_t>(m_Batches.size() - 1);
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+    for (Resource& resource : m_Resources)
+    {
+        resource.firstPass = NO_INDEX;
+        resource.lastPass = 0;
+        resource.queueMask = 0;
+    }
+
+    for (uint32_t position = 0; position < m_Order.size(); position++)
+    {
+        const Pass& pass = m_Passes[m_Order[position]];
+        for (const Use& use : pass.uses)
+        {
+            Resource& resource = m_Resources[use.resource];
+            resource.firstPass = std::min(resource.firstPass, position);
+            resource.lastPass = std::max(resource.lastPass, position);
+            resource.queueMask |= 1u << pass.queue;
+        }
+    }
+}
+
+// Creates the transients of every frame in flight, packs them into as few heaps as possible
+// and binds them. Transients that are alive at the same time never overlap in memory;
+// transients used by both queues get a heap of their own.
+void RenderGraph::CreateTransients()
+{
+    std::vector<Handle> transients;
+    for (Handle handle = 0; handle < m_Resources.size(); handle++)
+    {
+        Resource& resource = m_Resources[handle];
+        if (resource.imported || resource.firstPass == NO_INDEX)
+        {
+            continue;
+        }
+        transients.push_back(handle);
+
+        resource.images.assign(m_FramesInFlight, VK_NULL_HANDLE);
+        resource.views.assign(m_FramesInFlight, VK_NULL_HANDLE);
+        resource.buffers.assign(m_FramesInFlight, VK_NULL_HANDLE);
+
+        VkMemoryRequirements requirements{};
+        for (uint32_t frame = 0; frame < m_FramesInFlight; frame++)
+        {
+            if (resource.texture)
+            {
+                VkImageCreateInfo imageInfo{};
+                imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                imageInfo.imageType = VK_IMAGE_TYPE_2D;
+                imageInfo.format = static_cast<VkFormat>(resource.desc.format);
+                imageInfo.extent = { resource.desc.width, resource.desc.height, 1 };
+                imageInfo.mipLevels = resource.desc.mipLevels;
+                imageInfo.arrayLayers = resource.desc.arrayLayers;
+                imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+                imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+                imageInfo.usage = resource.usage;
+                imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+                if (m_Dispatch->vkCreateImage(m_Device, &imageInfo, m_Callbacks, &resource.images[frame]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create render graph texture " + resource.name + "!");
+                }
+                m_Dispatch->vkGetImageMemoryRequirements(m_Device, resource.images[frame], &requirements);
+            }
+            else
+            {
+                VkBufferCreateInfo bufferInfo{};
+                bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                bufferInfo.size = resource.size;
+                bufferInfo.usage = resource.usage;
+                bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+                if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &resource.buffers[frame]) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create render graph buffer " + resource.name + "!");
+                }
+                m_Dispatch->vkGetBufferMemoryRequirements(m_Device, resource.buffers[frame], &requirements);
+            }
+        }
+
+        resource.memorySize = requirements.size;
+        resource.alignment = requirements.alignment;
+        resource.memoryTypeBits = requirements.memoryTypeBits;
+    }
+
+    // Largest first, so every heap is sized by its first resource and the smaller ones fill
+    // the gaps left by lifetimes that do not overlap
+    std::stable_sort(transients.begin(), transients.end(), [this](Handle a, Handle b)
+    {
+        return m_Resources[a].memorySize > m_Resources[b].memorySize;
+    });
+
+    m_Heaps.clear();
+    m_TransientBytes = 0;
+    m_UnaliasedBytes = 0;
+
+    for (Handle handle : transients)
+    {
+        Resource& resource = m_Resources[handle];
+        const bool singleQueue = (resource.queueMask & (resource.queueMask - 1)) == 0;
+        m_UnaliasedBytes += resource.memorySize;
+
+        for (uint32_t heapIndex = 0; heapIndex < m_Heaps.size() && resource.heap == NO_INDEX; heapIndex++)
+        {
+            Heap& heap = m_Heaps[heapIndex];
+            if (!singleQueue || heap.images != resource.texture || heap.queueMask != resource.queueMask
+                || (heap.memoryTypeBits & resource.memoryTypeBits) == 0)
+            {
+                continue;
+            }
+
+            // Ranges taken by resources that are alive at the same time, by offset
+            std::vector<std::pair<uint64_t, uint64_t>> taken;
+            for (Handle other : heap.resources)
+            {
+                const Resource& placed = m_Resources[other];
+                if (placed.firstPass <= resource.lastPass && resource.firstPass <= placed.lastPass)
+                {
+                    taken.emplace_back(placed.heapOffset, placed.heapOffset + placed.memorySize);
+                }
+            }
+            std::sort(taken.begin(), taken.end());
+
+            uint64_t offset = 0;
+            for (const auto& range : taken)
+            {
+                if (offset + resource.memorySize <= range.first)
+                {
+                    break;
+                }
+                offset = std::max(offset, AlignUp(range.second, resource.alignment));
+            }
+
+            if (offset + resource.memorySize <= heap.size)
+            {
+                resource.heap = heapIndex;
+                resource.heapOffset = offset;
+                heap.memoryTypeBits &= resource.memoryTypeBits;
+                heap.alignment = std::max(heap.alignment, resource.alignment);
+                heap.resources.push_back(handle);
+            }
+        }
+
+        if (resource.heap == NO_INDEX)
+        {
+            Heap heap;
+            heap.images = resource.texture;
+            heap.queueMask = singleQueue ? resource.queueMask : 0;
+            heap.memoryTypeBits = resource.memoryTypeBits;
+            heap.size = resource.memorySize;
+            heap.alignment = resource.alignment;
+            heap.resources.push_back(handle);
+
+            resource.heap = static_cast<uint32_t>(m_Heaps.size());
+            resource.heapOffset = 0;
+            m_Heaps.push_back(std::move(heap));
+        }
+    }
+
+    // Every heap is its own device memory allocation, images never share a block with buffers
+    for (Heap& heap : m_Heaps)
+    {
+        m_TransientBytes += heap.size;
+
+        VkMemoryRequirements requirements{};
+        requirements.size = heap.size;
+        requirements.alignment = heap.alignment;
+        requirements.memoryTypeBits = heap.memoryTypeBits;
+
+        GpuAllocator::AllocationCreateInfo allocInfo{};
+        allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+        allocInfo.dedicated = true;
+
+        heap.allocations.assign(m_FramesInFlight, nullptr);
+        for (uint32_t frame = 0; frame < m_FramesInFlight; frame++)
+        {
+            heap.allocations[frame] = m_Allocator->AllocateMemory(requirements, allocInfo);
+            const GpuAllocator::Allocation& allocation = *heap.allocations[frame];
+
+            for (Handle handle : heap.resources)
+            {
+                Resource& resource = m_Resources[handle];
+                VkResult result = resource.texture
+                    ? m_Dispatch->vkBindImageMemory(m_Device, resource.images[frame], allocation.memory, allocation.offset + resource.heapOffset)
+                    : m_Dispatch->vkBindBufferMemory(m_Device, resource.buffers[frame], allocation.memory, allocation.offset + resource.heapOffset);
+                if (result != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to bind render graph resource " + resource.name + "!");
+                }
+
+                if (resource.texture)
+                {
+                    VkImageViewCreateInfo viewInfo{};
+                    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                    viewInfo.image = resource.images[frame];
+                    viewInfo.viewType = resource.desc.arrayLayers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+                    viewInfo.format = static_cast<VkFormat>(resource.desc.format);
+                    viewInfo.subresourceRange.aspectMask = GetAspectMask(resource.desc.format);
+                    viewInfo.subresourceRange.baseMipLevel = 0;
+                    viewInfo.subresourceRange.levelCount = resource.desc.mipLevels;
+                    viewInfo.subresourceRange.baseArrayLayer = 0;
+                    viewInfo.subresourceRange.layerCount = resource.desc.arrayLayers;
+
+                    if (m_Dispatch->vkCreateImageView(m_Device, &viewInfo, m_Callbacks, &resource.views[frame]) != VK_SUCCESS)
+                    {
+                        throw std::runtime_error("Failed to create render graph texture view " + resource.name + "!");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Binary semaphores can only be waited on once, so every pair of batches gets its own.
+// A signal covers everything submitted earlier on its queue, so only the latest batch
+// of the other queue a batch depends on has to be waited for.
+void RenderGraph::AddEdge(uint32_t from, uint32_t to, uint64_t waitStages)
+{
+    for (Edge& edge : m_Edges)
+    {
+        if (edge.to == to)
+        {
+            edge.from = std::max(edge.from, from);
+            edge.waitStages |= waitStages;
+            return;
+        }
+    }
+
+    Edge edge;
+    edge.from = from;
+    edge.to = to;
+    edge.waitStages = waitStages;
+    m_Edges.push_back(edge);
+}
+
+// Replays every access in execution order and places the barriers, ownership transfers
+// and semaphores it needs
+void RenderGraph::PlaceBarriers()
+{
+    std::vector<Tracking> tracking(m_Resources.size());
+    for (Handle handle = 0; handle < m_Resources.size(); handle++)
+    {
+        const Resource& resource = m_Resources[handle];
+        Tracking& state = tracking[handle];
+        state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (resource.imported)
+        {
+            // Owned by the graphics queue, with the state the frame starts in as the last write
+            state.layout = resource.texture ? resource.initialState.layout : static_cast<uint32_t>(VK_IMAGE_LAYOUT_UNDEFINED);
+            state.queue = 0;
+            state.writeStages = resource.initialState.stages;
+            state.writeAccess = resource.initialState.access & WRITE_ACCESS_MASK;
+        }
+    }
+
+    m_Edges.clear();
+
+    uint32_t position = 0;
+    for (uint32_t batchIndex = 0; batchIndex < m_Batches.size(); batchIndex++)
+    {
+        Batch& batch = m_Batches[batchIndex];
+        for (size_t i = 0; i < batch.passes.size(); i++, position++)
+        {
+            const Pass& pass = m_Passes[batch.passes[i]];
+            BarrierBatch& before = batch.before[i];
+
+            for (const Use& use : pass.uses)
+            {
+                const Resource& resource = m_Resources[use.resource];
+                Tracking& state = tracking[use.resource];
+
+                if (!resource.imported && resource.firstPass == position)
+                {
+                    if (!use.write)
+                    {
+                        throw std::runtime_error("Render graph pass '" + pass.name + "' reads '" + resource.name + "' before any pass writes it!");
+                    }
+
+                    // The memory may still be in use by the transients it aliases, which all
+                    // ended on this queue before this pass
+                    const Heap& heap = m_Heaps[resource.heap];
+                    for (Handle other : heap.resources)
+                    {
+                        const Resource& previous = m_Resources[other];
+                        bool overlaps = previous.heapOffset < resource.heapOffset + resource.memorySize
+                            && resource.heapOffset < previous.heapOffset + previous.memorySize;
+                        if (other != use.resource && overlaps && previous.lastPass < position)
+                        {
+                            state.writeStages |= tracking[other].writeStages | tracking[other].readStages;
+                            state.writeAccess |= tracking[other].writeAccess;
+                        }
+                    }
+                    state.queue = pass.queue;
+                }
+
+                const bool layoutChange = resource.texture && use.layout != state.layout;
+                const bool ownershipChange = state.queue != NO_INDEX && state.queue != pass.queue;
+                const uint64_t previousStages = state.writeStages | state.readStages;
+                bool synchronized = false;
+
+                if (ownershipChange)
+                {
+                    // Released after the last use on the old queue, acquired in front of this pass
+                    Barrier release;
+                    release.resource = use.resource;
+                    release.srcStages = previousStages;
+                    release.srcAccess = state.writeAccess;
+                    release.oldLayout = state.layout;
+                    release.newLayout = resource.texture ? use.layout : static_cast<uint32_t>(VK_IMAGE_LAYOUT_UNDEFINED);
+                    release.srcFamily = FamilyOf(state.queue);
+                    release.dstFamily = FamilyOf(pass.queue);
+
+                    Barrier acquire = release;
+                    acquire.srcStages = VK_PIPELINE_STAGE_2_NONE;
+                    acquire.srcAccess = VK_ACCESS_2_NONE;
+                    acquire.dstStages = use.stages;
+                    acquire.dstAccess = use.access;
+
+                    uint32_t releaseBatch = (state.lastBatch == NO_INDEX) ? m_FirstGraphicsBatch : state.lastBatch;
+                    (resource.texture ? m_Batches[releaseBatch].after.images : m_Batches[releaseBatch].after.buffers).push_back(release);
+                    (resource.texture ? before.images : before.buffers).push_back(acquire);
+                    AddEdge(releaseBatch, batchIndex, use.stages);
+                    synchronized = true;
+                }
+                else if (layoutChange)
+                {
+                    Barrier transition;
+                    transition.resource = use.resource;
+                    transition.srcStages = previousStages;
+                    transition.srcAccess = state.writeAccess;
+                    transition.dstStages = use.stages;
+                    transition.dstAccess = use.access;
+                    transition.oldLayout = state.layout;
+                    transition.newLayout = use.layout;
+                    before.images.push_back(transition);
+                    synchronized = true;
+                }
+                else if (use.write)
+                {
+                    // Write after write or after read; nothing to wait for on the first write
+                    if (previousStages != 0)
+                    {
+                        before.memorySrcStages |= previousStages;
+                        before.memorySrcAccess |= state.writeAccess;
+                        before.memoryDstStages |= use.stages;
+                        before.memoryDstAccess |= use.access;
+                        synchronized = true;
+                    }
+                }
+                else if (state.writeStages != 0
+                    && ((use.stages & ~state.visibleStages) != 0 || (use.access & ~state.visibleAccess) != 0))
+                {
+                    // Read after write, unless an earlier read already made the write visible here
+                    before.memorySrcStages |= state.writeStages;
+                    before.memorySrcAccess |= state.writeAccess;
+                    before.memoryDstStages |= use.stages;
+                    before.memoryDstAccess |= use.access;
+                    synchronized = true;
+                }
+
+                if (use.write)
+                {
+                    state.writeStages = use.stages;
+                    state.writeAccess = use.access & WRITE_ACCESS_MASK;
+                    state.readStages = 0;
+                    state.visibleStages = 0;
+                    state.visibleAccess = 0;
+                }
+                else if (layoutChange || ownershipChange)
+                {
+                    // The transition is a write that finished before this pass' stages
+                    state.writeStages = use.stages;
+                    state.writeAccess = VK_ACCESS_2_NONE;
+                    state.readStages = use.stages;
+                    state.visibleStages = use.stages;
+                    state.visibleAccess = use.access;
+                }
+                else
+                {
+                    state.readStages |= use.stages;
+                    if (synchronized)
+                    {
+                        state.visibleStages |= use.stages;
+                        state.visibleAccess |= use.access;
+                    }
+                }
+
+                state.layout = resource.texture ? use.layout : static_cast<uint32_t>(VK_IMAGE_LAYOUT_UNDEFINED);
+                state.queue = pass.queue;
+                state.lastBatch = batchIndex;
+            }
+        }
+    }
+
+    // Imported resources are handed back on the graphics queue in the state the caller asked for
+    for (Handle handle = 0; handle < m_Resources.size(); handle++)
+    {
+        const Resource& resource = m_Resources[handle];
+        const ResourceState& finalState = resource.finalState;
+        if (!resource.imported || (finalState.layout == VK_IMAGE_LAYOUT_UNDEFINED && finalState.stages == 0))
+        {
+            continue;
+        }
+
+        Tracking& state = tracking[handle];
+        const uint32_t newLayout = (resource.texture && finalState.layout != VK_IMAGE_LAYOUT_UNDEFINED) ? finalState.layout : state.layout;
+        const uint64_t previousStages = state.writeStages | state.readStages;
+
+        Barrier barrier;
+        barrier.resource = handle;
+        barrier.srcStages = previousStages;
+        barrier.srcAccess = state.writeAccess;
+        barrier.dstStages = finalState.stages;
+        barrier.dstAccess = finalState.access;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = newLayout;
+
+        if (state.queue != 0)
+        {
+            barrier.srcFamily = FamilyOf(state.queue);
+            barrier.dstFamily = m_GraphicsFamily;
+
+            Barrier release = barrier;
+            release.dstStages = VK_PIPELINE_STAGE_2_NONE;
+            release.dstAccess = VK_ACCESS_2_NONE;
+            barrier.srcStages = VK_PIPELINE_STAGE_2_NONE;
+            barrier.srcAccess = VK_ACCESS_2_NONE;
+
+            BarrierBatch& releaseAfter = m_Batches[state.lastBatch].after;
+            BarrierBatch& acquireAfter = m_Batches[m_LastGraphicsBatch].after;
+            (resource.texture ? releaseAfter.images : releaseAfter.buffers).push_back(release);
+            (resource.texture ? acquireAfter.images : acquireAfter.buffers).push_back(barrier);
+            AddEdge(state.lastBatch, m_LastGraphicsBatch, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            continue;
+        }
+
+        BarrierBatch& after = m_Batches[state.lastBatch == NO_INDEX ? m_LastGraphicsBatch : state.lastBatch].after;
+        if (resource.texture && newLayout != state.layout)
+        {
+            after.images.push_back(barrier);
+        }
+        else if (previousStages != 0 && finalState.stages != 0
+            && (state.writeAccess != 0 || (finalState.stages & ~state.visibleStages) != 0))
+        {
+            after.memorySrcStages |= previousStages;
+            after.memorySrcAccess |= state.writeAccess;
+            after.memoryDstStages |= finalState.stages;
+            after.memoryDstAccess |= finalState.access;
+        }
+    }
+
+    // The last graphics submission carries the frame fence, so it has to wait for the
+    // compute queue. Waiting on its last batch covers the earlier ones.
+    for (uint32_t batchIndex = m_LastGraphicsBatch; batchIndex-- > 0; )
+    {
+        if (m_Batches[batchIndex].queue != 0)
+        {
+            AddEdge(batchIndex, m_LastGraphicsBatch, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            break;
+        }
+    }
+
+    // A frame that starts on the compute queue still waits for the frame's external
+    // semaphores, which the leading graphics batch takes
+    if (m_Batches.size() > 1 && m_Batches[1].queue != 0)
+    {
+        AddEdge(0, 1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+    }
+
+    for (uint32_t edgeIndex = 0; edgeIndex < m_Edges.size(); edgeIndex++)
+    {
+        m_Batches[m_Edges[edgeIndex].from].signals.push_back(edgeIndex);
+        m_Batches[m_Edges[edgeIndex].to].waits.push_back(edgeIndex);
+    }
+}
+
+// Command pools per frame and queue, one command buffer per batch, one semaphore per edge
+void RenderGraph::CreateFrameObjects()
+{
+    const uint32_t queueCount = HasAsyncCompute() ? 2 : 1;
+    m_CommandPools.assign(m_FramesInFlight * queueCount, VK_NULL_HANDLE);
+
+    for (uint32_t frame = 0; frame < m_FramesInFlight; frame++)
+    {
+        for (uint32_t queue = 0; queue < queueCount; queue++)
+        {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            // Command buffers are rerecorded every frame
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = FamilyOf(queue);
+
+            if (m_Dispatch->vkCreateCommandPool(m_Device, &poolInfo, m_Callbacks, &m_CommandPools[frame * queueCount + queue]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create render graph command pool!");
+            }
+        }
+
+        for (Batch& batch : m_Batches)
+        {
+            batch.commandBuffers.resize(m_FramesInFlight);
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = m_CommandPools[frame * queueCount + batch.queue];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (m_Dispatch->vkAllocateCommandBuffers(m_Device, &allocInfo, &batch.commandBuffers[frame]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate render graph command buffers!");
+            }
+        }
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (Edge& edge : m_Edges)
+    {
+        edge.semaphores.assign(m_FramesInFlight, VK_NULL_HANDLE);
+        for (VkSemaphore& semaphore : edge.semaphores)
+        {
+            if (m_Dispatch->vkCreateSemaphore(m_Device, &semaphoreInfo, m_Callbacks, &semaphore) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create render graph semaphore!");
+            }
+        }
+    }
+}
+
+void RenderGraph::DestroyCompiled()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    for (Edge& edge : m_Edges)
+    {
+        for (VkSemaphore semaphore : edge.semaphores)
+        {
+            m_Dispatch->vkDestroySemaphore(m_Device, semaphore, m_Callbacks);
+        }
+    }
+    m_Edges.clear();
+
+    // Destroying a pool also frees its command buffers
+    for (VkCommandPool pool : m_CommandPools)
+    {
+        m_Dispatch->vkDestroyCommandPool(m_Device, pool, m_Callbacks);
+    }
+    m_CommandPools.clear();
+    m_Batches.clear();
+
+    for (Resource& resource : m_Resources)
+    {
+        if (resource.imported)
+        {
+            continue;
+        }
+        for (VkImageView view : resource.views)
+        {
+            m_Dispatch->vkDestroyImageView(m_Device, view, m_Callbacks);
+        }
+        for (VkImage image : resource.images)
+        {
+            m_Dispatch->vkDestroyImage(m_Device, image, m_Callbacks);
+        }
+        for (VkBuffer buffer : resource.buffers)
+        {
+            m_Dispatch->vkDestroyBuffer(m_Device, buffer, m_Callbacks);
+        }
+        resource.views.clear();
+        resource.images.clear();
+        resource.buffers.clear();
+        resource.heap = NO_INDEX;
+    }
+
+    for (Heap& heap : m_Heaps)
+    {
+        for (GpuAllocator::Allocation* allocation : heap.allocations)
+        {
+            m_Allocator->Free(allocation);
+        }
+    }
+    m_Heaps.clear();
+    m_Order.clear();
+    m_TransientBytes = 0;
+    m_UnaliasedBytes = 0;
+    m_Compiled = false;
+}
+
+void RenderGraph::Record(uint32_t frameIndex, const ExecuteFunction& begin, const ExecuteFunction& end)
+{
+    if (!m_Compiled)
+    {
+        throw std::runtime_error("Render graph recorded without being compiled!");
+    }
+
+    m_FrameIndex = frameIndex;
+
+    const uint32_t queueCount = HasAsyncCompute() ? 2 : 1;
+    for (uint32_t queue = 0; queue < queueCount; queue++)
+    {
+        m_Dispatch->vkResetCommandPool(m_Device, m_CommandPools[frameIndex * queueCount + queue], 0);
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    for (uint32_t batchIndex = 0; batchIndex < m_Batches.size(); batchIndex++)
+    {
+        const Batch& batch = m_Batches[batchIndex];
+        VkCommandBuffer commandBuffer = batch.commandBuffers[frameIndex];
+
+        if (m_Dispatch->vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to begin recording command buffer!");
+        }
+
+        if (batchIndex == m_FirstGraphicsBatch && begin)
+        {
+            begin(commandBuffer);
+        }
+
+        for (size_t i = 0; i < batch.passes.size(); i++)
+        {
+            RecordBarriers(commandBuffer, batch.before[i]);
+            const Pass& pass = m_Passes[batch.passes[i]];
+            if (pass.execute)
+            {
+                pass.execute(commandBuffer);
+            }
+        }
+        RecordBarriers(commandBuffer, batch.after);
+
+        if (batchIndex == m_LastGraphicsBatch && end)
+        {
+            end(commandBuffer);
+        }
+
+        if (m_Dispatch->vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to record command buffer!");
+        }
+    }
+
+    m_Stats.frames++;
+}
+
+void RenderGraph::Submit(const SubmitInfo& info)
+{
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    std::vector<VkSemaphore> signalSemaphores;
+
+    for (uint32_t batchIndex = 0; batchIndex < m_Batches.size(); batchIndex++)
+    {
+        const Batch& batch = m_Batches[batchIndex];
+        waitSemaphores.clear();
+        waitStages.clear();
+        signalSemaphores.clear();
+
+        if (batchIndex == m_FirstGraphicsBatch)
+        {
+            waitSemaphores.insert(waitSemaphores.end(), info.waitSemaphores, info.waitSemaphores + info.waitSemaphoreCount);
+            waitStages.insert(waitStages.end(), info.waitStages, info.waitStages + info.waitSemaphoreCount);
+        }
+        for (uint32_t edgeIndex : batch.waits)
+        {
+            waitSemaphores.push_back(m_Edges[edgeIndex].semaphores[m_FrameIndex]);
+            // All stages the graph uses have the same bit in both versions
+            const uint64_t stages = m_Edges[edgeIndex].waitStages;
+            waitStages.push_back(stages != 0 ? static_cast<VkPipelineStageFlags>(stages)
+                : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT));
+        }
+        for (uint32_t edgeIndex : batch.signals)
+        {
+            signalSemaphores.push_back(m_Edges[edgeIndex].semaphores[m_FrameIndex]);
+        }
+
+        const bool last = (batchIndex == m_LastGraphicsBatch);
+        if (last && info.signalSemaphore != VK_NULL_HANDLE)
+        {
+            signalSemaphores.push_back(info.signalSemaphore);
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &batch.commandBuffers[m_FrameIndex];
+        submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        if (m_Dispatch->vkQueueSubmit(m_Queues[batch.queue], 1, &submitInfo, last ? info.fence : VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+        m_Stats.submissions++;
+    }
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch)
+{
+    if (batch.Empty())
+    {
+        return;
+    }
+
+    auto imageRange = [this](const Barrier& barrier)
+    {
+        const Resource& resource = m_Resources[barrier.resource];
+        VkImageSubresourceRange range{};
+        range.aspectMask = GetAspectMask(resource.desc.format);
+        range.baseMipLevel = 0;
+        range.levelCount = VK_REMAINING_MIP_LEVELS;
+        range.baseArrayLayer = 0;
+        range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        return range;
+    };
+    auto frameSlot = [this](const Barrier& barrier) { return m_Resources[barrier.resource].imported ? 0 : m_FrameIndex; };
+
+    const bool memory = batch.memorySrcStages != 0 || batch.memoryDstStages != 0;
+    m_Stats.barrierCalls++;
+    m_Stats.imageBarriers += batch.images.size();
+    m_Stats.bufferBarriers += batch.buffers.size();
+    m_Stats.memoryBarriers += memory ? 1 : 0;
+
+    if (m_Synchronization2)
+    {
+        std::vector<VkImageMemoryBarrier2> imageBarriers(batch.images.size());
+        for (size_t i = 0; i < batch.images.size(); i++)
+        {
+            const Barrier& barrier = batch.images[i];
+            VkImageMemoryBarrier2& imageBarrier = imageBarriers[i];
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            imageBarrier.srcStageMask = barrier.srcStages;
+            imageBarrier.srcAccessMask = barrier.srcAccess;
+            imageBarrier.dstStageMask = barrier.dstStages;
+            imageBarrier.dstAccessMask = barrier.dstAccess;
+            imageBarrier.oldLayout = static_cast<VkImageLayout>(barrier.oldLayout);
+            imageBarrier.newLayout = static_cast<VkImageLayout>(barrier.newLayout);
+            imageBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+            imageBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+            imageBarrier.image = m_Resources[barrier.resource].images[frameSlot(barrier)];
+            imageBarrier.subresourceRange = imageRange(barrier);
+        }
+
+        std::vector<VkBufferMemoryBarrier2> bufferBarriers(batch.buffers.size());
+        for (size_t i = 0; i < batch.buffers.size(); i++)
+        {
+            const Barrier& barrier = batch.buffers[i];
+            VkBufferMemoryBarrier2& bufferBarrier = bufferBarriers[i];
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            bufferBarrier.srcStageMask = barrier.srcStages;
+            bufferBarrier.srcAccessMask = barrier.srcAccess;
+            bufferBarrier.dstStageMask = barrier.dstStages;
+            bufferBarrier.dstAccessMask = barrier.dstAccess;
+            bufferBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+            bufferBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+            bufferBarrier.buffer = m_Resources[barrier.resource].buffers[frameSlot(barrier)];
+            bufferBarrier.offset = 0;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+        }
+
+        VkMemoryBarrier2 memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        memoryBarrier.srcStageMask = batch.memorySrcStages;
+        memoryBarrier.srcAccessMask = batch.memorySrcAccess;
+        memoryBarrier.dstStageMask = batch.memoryDstStages;
+        memoryBarrier.dstAccessMask = batch.memoryDstAccess;
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.memoryBarrierCount = memory ? 1 : 0;
+        dependencyInfo.pMemoryBarriers = &memoryBarrier;
+        dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+
+        // The extension entry point is only loaded when the extension is enabled
+        PFN_vkCmdPipelineBarrier2 pipelineBarrier2 = m_Dispatch->vkCmdPipelineBarrier2KHR != nullptr
+            ? m_Dispatch->vkCmdPipelineBarrier2KHR : m_Dispatch->vkCmdPipelineBarrier2;
+        pipelineBarrier2(commandBuffer, &dependencyInfo);
+        return;
+    }
+
+    // Without synchronization2 one call has a single pair of stage masks for all its barriers
+    VkPipelineStageFlags2 srcStages = batch.memorySrcStages;
+    VkPipelineStageFlags2 dstStages = batch.memoryDstStages;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers(batch.images.size());
+    for (size_t i = 0; i < batch.images.size(); i++)
+    {
+        const Barrier& barrier = batch.images[i];
+        VkImageMemoryBarrier& imageBarrier = imageBarriers[i];
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccess);
+        imageBarrier.dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccess);
+        imageBarrier.oldLayout = static_cast<VkImageLayout>(barrier.oldLayout);
+        imageBarrier.newLayout = static_cast<VkImageLayout>(barrier.newLayout);
+        imageBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+        imageBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+        imageBarrier.image = m_Resources[barrier.resource].images[frameSlot(barrier)];
+        imageBarrier.subresourceRange = imageRange(barrier);
+        srcStages |= barrier.srcStages;
+        dstStages |= barrier.dstStages;
+    }
+
+    std::vector<VkBufferMemoryBarrier> bufferBarriers(batch.buffers.size());
+    for (size_t i = 0; i < batch.buffers.size(); i++)
+    {
+        const Barrier& barrier = batch.buffers[i];
+        VkBufferMemoryBarrier& bufferBarrier = bufferBarriers[i];
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccess);
+        bufferBarrier.dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccess);
+        bufferBarrier.srcQueueFamilyIndex = barrier.srcFamily;
+        bufferBarrier.dstQueueFamilyIndex = barrier.dstFamily;
+        bufferBarrier.buffer = m_Resources[barrier.resource].buffers[frameSlot(barrier)];
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        srcStages |= barrier.srcStages;
+        dstStages |= barrier.dstStages;
+    }
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = static_cast<VkAccessFlags>(batch.memorySrcAccess);
+    memoryBarrier.dstAccessMask = static_cast<VkAccessFlags>(batch.memoryDstAccess);
+
+    m_Dispatch->vkCmdPipelineBarrier(commandBuffer, ToLegacyStages(srcStages, true), ToLegacyStages(dstStages, false), 0,
+        memory ? 1 : 0, &memoryBarrier,
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+VkImage RenderGraph::GetImage(Handle texture) const
+{
+    const Resource& resource = m_Resources.at(texture);
+    size_t slot = resource.imported ? 0 : m_FrameIndex;
+    return slot < resource.images.size() ? resource.images[slot] : VK_NULL_HANDLE;
+}
+
+VkImageView RenderGraph::GetImageView(Handle texture) const
+{
+    const Resource& resource = m_Resources.at(texture);
+    size_t slot = resource.imported ? 0 : m_FrameIndex;
+    return slot < resource.views.size() ? resource.views[slot] : VK_NULL_HANDLE;
+}
+
+VkBuffer RenderGraph::GetBuffer(Handle buffer) const
+{
+    const Resource& resource = m_Resources.at(buffer);
+    size_t slot = resource.imported ? 0 : m_FrameIndex;
+    return slot < resource.buffers.size() ? resource.buffers[slot] : VK_NULL_HANDLE;
+}
+
+void RenderGraph::DumpPlan(std::ostream& out) const
+{
+    auto queueName = [](uint32_t queue) { return queue == 0 ? "graphics" : "compute"; };
+    auto dumpBarriers = [this, &out](const char* where, const BarrierBatch& batch)
+    {
+        if (batch.Empty())
+        {
+            return;
+        }
+        out << "      barriers " << where << ":\n";
+        for (const auto* list : { &batch.images, &batch.buffers })
+        {
+            for (const Barrier& barrier : *list)
+            {
+                out << "        " << m_Resources[barrier.resource].name << ": " << GetStageNames(barrier.srcStages)
+                    << " -> " << GetStageNames(barrier.dstStages);
+                if (m_Resources[barrier.resource].texture)
+                {
+                    out << ", " << GetLayoutName(barrier.oldLayout) << " -> " << GetLayoutName(barrier.newLayout);
+                }
+                if (barrier.srcFamily != barrier.dstFamily)
+                {
+                    out << ", family " << barrier.srcFamily << " -> " << barrier.dstFamily
+                        << (barrier.dstStages == 0 ? " (release)" : " (acquire)");
+                }
+                out << '\n';
+            }
+        }
+        if (batch.memorySrcStages != 0 || batch.memoryDstStages != 0)
+        {
+            out << "        memory: " << GetStageNames(batch.memorySrcStages) << " -> " << GetStageNames(batch.memoryDstStages) << '\n';
+        }
+    };
+
+    uint32_t culled = 0;
+    for (const Pass& pass : m_Passes)
+    {
+        culled += pass.culled ? 1 : 0;
+    }
+
+    out << "Render graph: " << m_Passes.size() << " passes (" << culled << " culled), " << m_Resources.size() << " resources, "
+        << m_Batches.size() << " submissions, " << (m_Synchronization2 ? "synchronization2" : "synchronization 1 barriers")
+        << (HasAsyncCompute() ? ", async compute queue\n" : ", no async compute queue\n");
+
+    out << "Resources:\n";
+    for (const Resource& resource : m_Resources)
+    {
+        out << "  " << std::left << std::setw(24) << resource.name << std::right << (resource.imported ? " imported " : " transient ");
+        if (resource.texture)
+        {
+            out << "texture " << resource.desc.width << 'x' << resource.desc.height << " format " << resource.desc.format;
+        }
+        else
+        {
+            out << "buffer " << resource.size << " bytes";
+        }
+
+        if (resource.firstPass == NO_INDEX)
+        {
+            out << ", unused\n";
+            continue;
+        }
+        out << ", passes " << resource.firstPass << ".." << resource.lastPass;
+        if (resource.heap != NO_INDEX)
+        {
+            out << ", heap " << resource.heap << " at " << resource.heapOffset << " (" << resource.memorySize << " bytes)";
+        }
+        out << '\n';
+    }
+
+    out << "Passes:\n";
+    for (const Pass& pass : m_Passes)
+    {
+        if (pass.culled)
+        {
+            out << "  " << pass.name << ": culled\n";
+        }
+    }
+    for (uint32_t batchIndex = 0; batchIndex < m_Batches.size(); batchIndex++)
+    {
+        const Batch& batch = m_Batches[batchIndex];
+        out << "  submission " << batchIndex << " on the " << queueName(batch.queue) << " queue";
+        for (uint32_t edgeIndex : batch.waits)
+        {
+            out << ", waits for " << m_Edges[edgeIndex].from << " at " << GetStageNames(m_Edges[edgeIndex].waitStages);
+        }
+        for (uint32_t edgeIndex : batch.signals)
+        {
+            out << ", signals " << m_Edges[edgeIndex].to;
+        }
+        out << '\n';
+
+        for (size_t i = 0; i < batch.passes.size(); i++)
+        {
+            dumpBarriers("before", batch.before[i]);
+            out << "    " << m_Passes[batch.passes[i]].name << '\n';
+        }
+        dumpBarriers("at the end", batch.after);
+    }
+
+    out << "Transient memory per frame in flight: " << m_TransientBytes << " bytes in " << m_Heaps.size() << " heaps, "
+        << m_UnaliasedBytes << " bytes without aliasing\n";
+}
+
+void RenderGraph::PrintStats() const
+{
+    if (m_Stats.frames == 0)
+    {
+        return;
+    }
+
+    uint32_t culled = 0;
+    for (const Pass& pass : m_Passes)
+    {
+        culled += pass.culled ? 1 : 0;
+    }
+
+    double frames = static_cast<double>(m_Stats.frames);
+    std::cout << "Render graph: " << (m_Passes.size() - culled) << " passes (" << culled << " culled), "
+        << (m_Stats.submissions / frames) << " submissions, " << (m_Stats.barrierCalls / frames) << " barrier calls with "
+        << (m_Stats.imageBarriers / frames) << " image, " << (m_Stats.bufferBarriers / frames) << " buffer and "
+        << (m_Stats.memoryBarriers / frames) << " memory barriers per frame; transient memory "
+        << (m_TransientBytes >> 10) << " KiB per frame in flight (" << (m_UnaliasedBytes >> 10) << " KiB without aliasing)\n";
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "GpuAllocator.h"
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// Declarative frame graph on top of the logical device.
+//
+// Passes declare which resources they read and write and how (attachment, shader, transfer),
+// Compile() turns that into a plan and Record()/Submit() run it every frame:
+// - passes nothing depends on are culled. A pass survives if it writes an imported resource,
+//   is marked with SetSideEffect, or writes a resource a surviving pass reads later.
+// - barriers follow from the order of accesses to each resource. All barriers in front of a
+//   pass go into one synchronization2 dependency (one vkCmdPipelineBarrier without it), and
+//   buffer hazards collapse into a single global memory barrier.
+// - transient textures and buffers are created by the graph, once per frame in flight.
+//   Transients on the same queue whose lifetimes do not overlap share memory.
+// - AsyncCompute passes run on the dedicated compute queue when the device has one. Runs of
+//   passes on one queue become one submission; semaphores and queue family ownership
+//   transfers are added where a resource moves between the queues.
+//
+// Resources that are not transient are imported with the state they are in when the frame
+// starts, owned by the graphics queue, and the state they have to be left in.
+class RenderGraph
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = ~0u;
+
+    enum class PassType
+    {
+        Graphics,
+        Compute,        // on the graphics queue
+        AsyncCompute,   // on the compute queue if there is a dedicated one
+        Transfer
+    };
+
+    // How a pass uses a resource. Shader accesses cover the vertex and fragment stages in
+    // graphics passes and the compute stage in compute passes.
+    enum class Access
+    {
+        ColorAttachmentWrite,
+        DepthStencilWrite,
+        DepthStencilRead,
+        SampledRead,
+        StorageRead,
+        StorageWrite,
+        UniformRead,
+        VertexBufferRead,
+        IndexBufferRead,
+        IndirectRead,
+        TransferRead,
+        TransferWrite
+    };
+
+    // Synchronization2 stage and access masks plus the image layout. A final state with an
+    // undefined layout and no stages leaves the resource as the last pass used it.
+    struct ResourceState
+    {
+        uint64_t    stages  = 0;    // VkPipelineStageFlags2
+        uint64_t    access  = 0;    // VkAccessFlags2
+        uint32_t    layout  = 0;    // VkImageLayout
+    };
+
+    struct TextureDesc
+    {
+        uint32_t    width       = 0;
+        uint32_t    height      = 0;
+        uint32_t    format      = 0;    // VkFormat
+        uint32_t    mipLevels   = 1;
+        uint32_t    arrayLayers = 1;
+    };
+
+    // Records the pass. Transient resources are looked up with GetImage/GetBuffer.
+    using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+    struct SubmitInfo
+    {
+        // Waited on by the first graphics submission
+        const VkSemaphore*  waitSemaphores      = nullptr;
+        const uint32_t*     waitStages          = nullptr;  // VkPipelineStageFlags
+        uint32_t            waitSemaphoreCount  = 0;
+
+        // Signaled by the last graphics submission, which also waits for the compute queue
+        VkSemaphore         signalSemaphore     = nullptr;
+        VkFence             fence               = nullptr;
+    };
+
+    struct Stats
+    {
+        uint64_t    frames              = 0;
+        uint64_t    submissions         = 0;
+        uint64_t    barrierCalls        = 0;
+        uint64_t    imageBarriers       = 0;
+        uint64_t    bufferBarriers      = 0;    // queue family ownership transfers
+        uint64_t    memoryBarriers      = 0;
+    };
+
+    // computeQueue may be the graphics queue, async compute passes then run in line.
+    // synchronization2 tells whether the feature was enabled on the device.
+    void Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator, VkQueue graphicsQueue,
+        uint32_t graphicsFamily, VkQueue computeQueue, uint32_t computeFamily, uint32_t framesInFlight,
+        bool synchronization2, const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    // Forgets every pass and resource and destroys the transients. The GPU must be idle.
+    void Reset();
+
+    Handle CreateTexture(const std::string& name, const TextureDesc& desc);
+    Handle CreateBuffer(const std::string& name, uint64_t size);
+    Handle ImportTexture(const std::string& name, VkImage image, VkImageView view, const TextureDesc& desc,
+        const ResourceState& initialState, const ResourceState& finalState);
+    Handle ImportBuffer(const std::string& name, VkBuffer buffer, uint64_t size,
+        const ResourceState& initialState, const ResourceState& finalState);
+
+    // Swaps the object behind an imported resource, e.g. the acquired swapchain image.
+    // The compiled plan stays valid.
+    void SetImportedTexture(Handle texture, VkImage image, VkImageView view);
+    void SetImportedBuffer(Handle buffer, VkBuffer vkBuffer);
+
+    Handle AddPass(const std::string& name, PassType type, ExecuteFunction execute);
+    void Read(Handle pass, Handle resource, Access access);
+    void Write(Handle pass, Handle resource, Access access);
+
+    // Keeps the pass even if none of its results are used
+    void SetSideEffect(Handle pass);
+
+    // Culls, schedules, places barriers and creates the transient resources. Throws if the
+    // graph is invalid. Has to be called again after passes or resources were added, with
+    // the GPU idle since the transients of the previous plan are destroyed.
+    void Compile();
+
+    // Records every batch of the plan for one frame in flight. The previous submission of
+    // that frame must have finished. begin and end are recorded at the start of the first
+    // and the end of the last graphics command buffer; either may be empty.
+    void Record(uint32_t frameIndex, const ExecuteFunction& begin, const ExecuteFunction& end);
+    void Submit(const SubmitInfo& info);
+
+    // Objects of the frame being recorded, valid inside execute functions
+    VkImage GetImage(Handle texture) const;
+    VkImageView GetImageView(Handle texture) const;
+    VkBuffer GetBuffer(Handle buffer) const;
+
+    // Human readable plan: resources and lifetimes, memory placement, passes with their
+    // barriers, culled passes, batches and the semaphores between them
+    void DumpPlan(std::ostream& out) const;
+
+    bool HasAsyncCompute() const { return m_ComputeFamily != m_GraphicsFamily; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    static constexpr uint32_t NO_INDEX = ~0u;
+
+    struct Use
+    {
+        Handle      resource    = INVALID_HANDLE;
+        uint64_t    stages      = 0;
+        uint64_t    access      = 0;
+        uint32_t    layout      = 0;
+        bool        read        = false;
+        bool        write       = false;
+    };
+
+    struct Pass
+    {
+        std::string         name;
+        PassType            type        = PassType::Graphics;
+        ExecuteFunction     execute;
+        std::vector<Use>    uses;           // one per resource
+        bool                sideEffect  = false;
+        bool                culled      = false;
+        uint32_t            queue       = 0;    // 0 graphics, 1 compute
+        uint32_t            batch       = NO_INDEX;
+    };
+
+    struct Resource
+    {
+        std::string     name;
+        bool            texture     = false;
+        bool            imported    = false;
+        TextureDesc     desc;
+        uint64_t        size        = 0;        // buffers
+        ResourceState   initialState;
+        ResourceState   finalState;
+        uint32_t        usage       = 0;        // VkImageUsageFlags or VkBufferUsageFlags
+
+        // Lifetime in compiled pass order and the queues that touch it (bit per queue)
+        uint32_t        firstPass   = NO_INDEX;
+        uint32_t        lastPass    = 0;
+        uint32_t        queueMask   = 0;
+
+        // Memory placement of transients
+        uint64_t        memorySize  = 0;
+        uint64_t        alignment   = 1;
+        uint32_t        memoryTypeBits = 0;
+        uint32_t        heap        = NO_INDEX;
+        uint64_t        heapOffset  = 0;
+
+        // Objects per frame in flight; imported resources only use the first entry
+        std::vector<VkImage>        images;
+        std::vector<VkImageView>    views;
+        std::vector<VkBuffer>       buffers;
+    };
+
+    // Memory shared by aliasing transients, allocated once per frame in flight
+    struct Heap
+    {
+        bool                images          = false;
+        uint32_t            queueMask       = 0;
+        uint32_t            memoryTypeBits  = ~0u;
+        uint64_t            size            = 0;
+        uint64_t            alignment       = 1;
+        std::vector<Handle> resources;
+        std::vector<GpuAllocator::Allocation*> allocations;
+    };
+
+    struct Barrier
+    {
+        Handle      resource    = INVALID_HANDLE;
+        uint64_t    srcStages   = 0;
+        uint64_t    srcAccess   = 0;
+        uint64_t    dstStages   = 0;
+        uint64_t    dstAccess   = 0;
+        uint32_t    oldLayout   = 0;
+        uint32_t    newLayout   = 0;
+        uint32_t    srcFamily   = ~0u;      // VK_QUEUE_FAMILY_IGNORED without an ownership transfer
+        uint32_t    dstFamily   = ~0u;
+    };
+
+    // Everything recorded at one point of a command buffer as a single dependency
+    struct BarrierBatch
+    {
+        std::vector<Barrier>    images;
+        std::vector<Barrier>    buffers;        // only for ownership transfers
+        uint64_t    memorySrcStages = 0;
+        uint64_t    memorySrcAccess = 0;
+        uint64_t    memoryDstStages = 0;
+        uint64_t    memoryDstAccess = 0;
+
+        bool Empty() const { return images.empty() && buffers.empty() && memorySrcStages == 0 && memoryDstStages == 0; }
+    };
+
+    // Consecutive passes on one queue, submitted together
+    struct Batch
+    {
+        uint32_t                    queue       = 0;
+        std::vector<uint32_t>       passes;
+        std::vector<BarrierBatch>   before;     // in front of each pass
+        BarrierBatch                after;      // releases and final states
+        std::vector<uint32_t>       waits;      // indices into m_Edges
+        std::vector<uint32_t>       signals;
+        std::vector<VkCommandBuffer> commandBuffers;    // per frame in flight
+    };
+
+    // A semaphore from one batch to a later batch on the other queue
+    struct Edge
+    {
+        uint32_t    from        = 0;
+        uint32_t    to          = 0;
+        uint64_t    waitStages  = 0;
+        std::vector<VkSemaphore> semaphores;    // per frame in flight
+    };
+
+    // Access history of one resource while barriers are placed
+    struct Tracking
+    {
+        uint32_t    layout          = 0;
+        uint32_t    queue           = NO_INDEX;
+        uint64_t    writeStages     = 0;
+        uint64_t    writeAccess     = 0;
+        uint64_t    readStages      = 0;        // since the last write
+        uint64_t    visibleStages   = 0;        // the last write is visible to these
+        uint64_t    visibleAccess   = 0;
+        uint32_t    lastBatch       = NO_INDEX;
+    };
+
+    Handle AddResource(Resource&& resource);
+    void AddUse(Handle pass, Handle resource, Access access, bool write);
+    void CullPasses();
+    void BuildBatches();
+    void ComputeLifetimes();
+    void PlaceBarriers();
+    void AddEdge(uint32_t from, uint32_t to, uint64_t waitStages);
+    void CreateTransients();
+    void CreateFrameObjects();
+    void DestroyCompiled();
+    void RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch);
+    uint32_t FamilyOf(uint32_t queue) const { return queue == 0 ? m_GraphicsFamily : m_ComputeFamily; }
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    GpuAllocator*                   m_Allocator         = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks         = nullptr;
+    VkQueue                         m_Queues[2]         = {};
+    uint32_t                        m_GraphicsFamily    = 0;
+    uint32_t                        m_ComputeFamily     = 0;
+    uint32_t                        m_FramesInFlight    = 1;
+    bool                            m_Synchronization2  = false;
+
+    std::vector<Pass>               m_Passes;
+    std::vector<Resource>           m_Resources;
+
+    // Compiled plan
+    bool                            m_Compiled          = false;
+    std::vector<uint32_t>           m_Order;            // surviving passes in execution order
+    std::vector<Batch>              m_Batches;
+    std::vector<Edge>               m_Edges;
+    std::vector<Heap>               m_Heaps;
+    uint32_t                        m_FirstGraphicsBatch = 0;
+    uint32_t                        m_LastGraphicsBatch = 0;
+    uint64_t                        m_TransientBytes    = 0;    // per frame in flight
+    uint64_t                        m_UnaliasedBytes    = 0;
+
+    // Command pools per frame in flight and queue
+    std::vector<VkCommandPool>      m_CommandPools;
+    uint32_t                        m_FrameIndex        = 0;
+
+    Stats                           m_Stats;
+};
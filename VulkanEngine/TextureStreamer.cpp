@@ -0,0 +1,629 @@
+#include "TextureStreamer.h"
+#include "BindlessDescriptors.h"
+#include "CommandCapture.h"
+#include "Profiler.h"
+#include "UploadEngine.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// Share of the heap budget streamed textures may fill the heap up to; the rest is left for
+// allocations made between two checks and for the driver
+constexpr uint64_t BUDGET_PERCENT = 90;
+
+// A promotion of mips evicted this many frames ago or less counts as thrashing
+constexpr uint64_t THRASH_FRAMES = 120;
+
+void TextureStreamer::Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator,
+    BindlessDescriptors* bindless, const AssetPack& pack, VkBuffer importBuffer, bool bc1, uint32_t framesInFlight,
+    uint64_t budgetLimit, const VkAllocationCallbacks* callbacks)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = &allocator;
+    m_Bindless = bindless;
+    m_Pack = &pack;
+    m_ImportBuffer = importBuffer;
+    m_Bc1 = bc1;
+    m_FramesInFlight = framesInFlight;
+    m_BudgetLimit = budgetLimit;
+    m_Callbacks = callbacks;
+
+    m_Textures.assign(pack.GetEntryCount(), Resident{});
+    bool hasTextures = false;
+    for (uint32_t i = 0; i < pack.GetEntryCount(); i++)
+    {
+        const PackEntry& entry = pack.GetEntry(i);
+        if (entry.type == AssetType::Texture)
+        {
+            const uint32_t tailMip = GetTailMip(pack, entry);
+            m_Textures[i].tailMip = tailMip;
+            m_Textures[i].wantedMip = tailMip;
+            m_Textures[i].requestedMip = tailMip;
+            m_Textures[i].texture.firstMip = tailMip;
+            hasTextures = true;
+        }
+    }
+
+    if (hasTextures)
+    {
+        CreateFeedback();
+    }
+}
+
+void TextureStreamer::CreateFeedback()
+{
+    const uint64_t size = static_cast<uint64_t>(m_Textures.size()) * sizeof(uint32_t);
+
+    m_Feedback.resize(m_FramesInFlight);
+    for (Feedback& feedback : m_Feedback)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Callbacks, &feedback.buffer) != VK_SUCCESS)
+        {
+            feedback.buffer = VK_NULL_HANDLE;
+            throw std::runtime_error("Failed to create texture feedback buffer!");
+        }
+
+        GpuAllocator::AllocationCreateInfo allocInfo{};
+        allocInfo.usage = GpuAllocator::Usage::Readback;
+        feedback.allocation = m_Allocator->AllocateForBuffer(feedback.buffer, allocInfo);
+        std::memset(feedback.allocation->mapped, 0xFF, static_cast<size_t>(size));
+        CaptureHostWrite(feedback.allocation->mapped, static_cast<size_t>(size));
+
+        if (m_Bindless != nullptr)
+        {
+            feedback.bindlessIndex = m_Bindless->AddStorageBuffer(feedback.buffer, 0, size);
+        }
+    }
+}
+
+void TextureStreamer::Destroy()
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    // The device is idle
+    for (Resident& resident : m_Textures)
+    {
+        Retire(resident);
+    }
+    DestroyRetired(true);
+    m_Textures.clear();
+
+    for (Feedback& feedback : m_Feedback)
+    {
+        if (feedback.bindlessIndex != ~0u)
+        {
+            m_Bindless->Release(BindlessDescriptors::Kind::StorageBuffer, feedback.bindlessIndex);
+        }
+        if (feedback.buffer != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyBuffer(m_Device, feedback.buffer, m_Callbacks);
+        }
+        if (feedback.allocation != nullptr)
+        {
+            m_Allocator->Free(feedback.allocation);
+        }
+    }
+    m_Feedback.clear();
+
+    m_Device = nullptr;
+}
+
+uint32_t TextureStreamer::GetTailMip(const AssetPack& pack, const PackEntry& entry)
+{
+    const PackMip* mips = pack.GetMips(entry);
+    uint32_t mip = 0;
+    while (mip + 1 < entry.mipCount && (mips[mip].width > TAIL_SIZE || mips[mip].height > TAIL_SIZE))
+    {
+        mip++;
+    }
+    return mip;
+}
+
+// Pack bytes of mips firstMip to the end of the chain, what the image of that range holds
+// give or take alignment
+uint64_t TextureStreamer::RangeBytes(uint32_t asset, uint32_t firstMip) const
+{
+    const PackEntry& entry = m_Pack->GetEntry(asset);
+    const PackMip* mips = m_Pack->GetMips(entry);
+    uint64_t bytes = 0;
+    for (uint32_t i = firstMip; i < entry.mipCount; i++)
+    {
+        bytes += mips[i].size;
+    }
+    return bytes;
+}
+
+void TextureStreamer::Update(UploadEngine& uploadEngine, uint32_t frameIndex)
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    PROFILE_FUNCTION();
+
+    m_Frame++;
+    DestroyRetired(false);
+    ReadFeedback(frameIndex);
+
+    const int64_t headroom = ComputeHeadroom();
+    if (headroom < 0)
+    {
+        const uint64_t excess = static_cast<uint64_t>(-headroom);
+        if (Evict(uploadEngine, excess, ~0u) < excess)
+        {
+            m_Stats.overBudgetFrames++;
+        }
+    }
+}
+
+// The buffer of this slot was last written by the frame framesInFlight frames ago, whose
+// fence has been waited on
+void TextureStreamer::ReadFeedback(uint32_t frameIndex)
+{
+    if (m_Feedback.empty())
+    {
+        return;
+    }
+
+    uint32_t* values = static_cast<uint32_t*>(m_Feedback[frameIndex].allocation->mapped);
+    for (uint32_t asset = 0; asset < m_Textures.size(); asset++)
+    {
+        if (values[asset] != NO_FEEDBACK)
+        {
+            NoteUse(asset, values[asset]);
+        }
+    }
+    std::memset(values, 0xFF, m_Textures.size() * sizeof(uint32_t));
+    CaptureHostWrite(values, m_Textures.size() * sizeof(uint32_t));
+}
+
+void TextureStreamer::RequestMip(uint32_t asset, uint32_t mip)
+{
+    if (asset < m_Textures.size() && m_Pack->GetEntry(asset).type == AssetType::Texture)
+    {
+        NoteUse(asset, mip);
+    }
+}
+
+void TextureStreamer::NoteUse(uint32_t asset, uint32_t mip)
+{
+    Resident& resident = m_Textures[asset];
+    mip = std::min(mip, resident.tailMip);
+    if (!resident.used || resident.lastUsedFrame != m_Frame)
+    {
+        resident.wantedMip = mip;
+    }
+    else
+    {
+        resident.wantedMip = std::min(resident.wantedMip, mip);
+    }
+    resident.lastUsedFrame = m_Frame;
+    resident.used = true;
+}
+
+// Bytes that may still be added to the texture heap, negative when over budget. Loads in
+// flight are counted as if they were resident already.
+int64_t TextureStreamer::ComputeHeadroom()
+{
+    if (m_Heap == ~0u)
+    {
+        // No texture yet, they will go into the largest device local heap
+        uint64_t largest = 0;
+        const std::vector<GpuAllocator::HeapStats> heaps = m_Allocator->GetHeapStats();
+        for (uint32_t i = 0; i < heaps.size(); i++)
+        {
+            if (heaps[i].deviceLocal && heaps[i].heapSize > largest)
+            {
+                largest = heaps[i].heapSize;
+                m_Heap = i;
+            }
+        }
+        if (m_Heap == ~0u)
+        {
+            m_Heap = 0;
+        }
+    }
+
+    const GpuAllocator::HeapStats heap = m_Allocator->GetHeapStats()[m_Heap];
+
+    // Free space inside our own blocks is available without growing the heap's usage
+    const uint64_t blockSlack = heap.blockBytes - std::min(heap.blockBytes, heap.allocationBytes);
+    const uint64_t usage = heap.usage - std::min(heap.usage, blockSlack);
+
+    uint64_t pending = 0;
+    for (uint32_t asset = 0; asset < m_Textures.size(); asset++)
+    {
+        const Resident& resident = m_Textures[asset];
+        if (resident.texture.image != VK_NULL_HANDLE && resident.requestedMip < resident.texture.firstMip)
+        {
+            pending += RangeBytes(asset, resident.requestedMip) - RangeBytes(asset, resident.texture.firstMip);
+        }
+    }
+
+    int64_t headroom = static_cast<int64_t>(heap.budget / 100 * BUDGET_PERCENT) - static_cast<int64_t>(usage + pending);
+    if (m_BudgetLimit != 0)
+    {
+        headroom = std::min(headroom, static_cast<int64_t>(m_BudgetLimit) - static_cast<int64_t>(m_Stats.residentBytes + pending));
+    }
+    return headroom;
+}
+
+// Drops the finest mips of textures least recently used first until bytes are freed. Textures
+// used in the last frame only lose mips finer than they asked for, none goes below its tail.
+// Returns the bytes freed.
+uint64_t TextureStreamer::Evict(UploadEngine& uploadEngine, uint64_t bytes, uint32_t keepAsset)
+{
+    struct Candidate
+    {
+        uint32_t    asset;
+        uint64_t    lastUsedFrame;
+    };
+
+    std::vector<Candidate> candidates;
+    for (uint32_t asset = 0; asset < m_Textures.size(); asset++)
+    {
+        const Resident& resident = m_Textures[asset];
+        const uint32_t floor = IsRecent(resident) ? resident.wantedMip : resident.tailMip;
+        if (asset != keepAsset && resident.texture.image != VK_NULL_HANDLE && resident.requestedMip == resident.texture.firstMip
+            && resident.texture.firstMip < floor)
+        {
+            candidates.push_back({ asset, resident.used ? resident.lastUsedFrame : 0 });
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const Candidate& a, const Candidate& b) { return a.lastUsedFrame < b.lastUsedFrame; });
+
+    uint64_t freed = 0;
+    for (const Candidate& candidate : candidates)
+    {
+        if (freed >= bytes)
+        {
+            break;
+        }
+
+        Resident& resident = m_Textures[candidate.asset];
+        const uint32_t floor = IsRecent(resident) ? resident.wantedMip : resident.tailMip;
+        const PackMip* mips = m_Pack->GetMips(m_Pack->GetEntry(candidate.asset));
+
+        const uint32_t oldFirstMip = resident.texture.firstMip;
+        uint32_t firstMip = oldFirstMip;
+        uint64_t dropped = 0;
+        while (firstMip < floor && freed + dropped < bytes)
+        {
+            dropped += mips[firstMip].size;
+            firstMip++;
+        }
+
+        try
+        {
+            MakeResident(uploadEngine, candidate.asset, firstMip);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to evict mips of " << m_Pack->GetName(m_Pack->GetEntry(candidate.asset)) << ": " << e.what() << '\n';
+            continue;
+        }
+
+        freed += dropped;
+        resident.evictedMip = firstMip - 1;
+        resident.evictedFrame = m_Frame;
+        m_Stats.evictions++;
+        m_Stats.mipsEvicted += firstMip - oldFirstMip;
+        m_Stats.bytesEvicted += dropped;
+    }
+    return freed;
+}
+
+void TextureStreamer::CollectPromotions(UploadEngine& uploadEngine, std::vector<MipRequest>& requests)
+{
+    if (m_Device == nullptr)
+    {
+        return;
+    }
+
+    // Textures in use that want finer mips than they have and are not loading any yet
+    std::vector<uint32_t> wanted;
+    for (uint32_t asset = 0; asset < m_Textures.size(); asset++)
+    {
+        const Resident& resident = m_Textures[asset];
+        if (resident.texture.image != VK_NULL_HANDLE && IsRecent(resident) && resident.wantedMip < resident.texture.firstMip
+            && resident.requestedMip == resident.texture.firstMip)
+        {
+            wanted.push_back(asset);
+        }
+    }
+    if (wanted.empty())
+    {
+        return;
+    }
+
+    PROFILE_FUNCTION();
+
+    // The finest needs first, they are the closest to the camera
+    std::sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b)
+    {
+        return m_Textures[a].wantedMip != m_Textures[b].wantedMip ? m_Textures[a].wantedMip < m_Textures[b].wantedMip : a < b;
+    });
+
+    int64_t headroom = ComputeHeadroom();
+    for (uint32_t asset : wanted)
+    {
+        Resident& resident = m_Textures[asset];
+        const uint64_t current = RangeBytes(asset, resident.texture.firstMip);
+
+        int64_t cost = static_cast<int64_t>(RangeBytes(asset, resident.wantedMip) - current);
+        if (cost > headroom)
+        {
+            headroom += static_cast<int64_t>(Evict(uploadEngine, static_cast<uint64_t>(cost - headroom), asset));
+        }
+
+        uint32_t mip = resident.wantedMip;
+        while (mip < resident.texture.firstMip && cost > headroom)
+        {
+            mip++;
+            cost = static_cast<int64_t>(RangeBytes(asset, mip) - current);
+        }
+
+        if (mip != resident.wantedMip && resident.clampedMip != resident.wantedMip)
+        {
+            resident.clampedMip = resident.wantedMip;
+            m_Stats.clamped++;
+        }
+        if (mip == resident.texture.firstMip)
+        {
+            continue;
+        }
+
+        if (resident.evictedFrame != 0 && resident.evictedFrame + THRASH_FRAMES >= m_Frame && mip <= resident.evictedMip)
+        {
+            m_Stats.thrash++;
+        }
+
+        headroom -= cost;
+        resident.requestedMip = mip;
+        requests.push_back({ asset, mip });
+    }
+}
+
+// Everything that can fail comes before the upload, which must not be recorded for an image
+// that is then destroyed
+uint64_t TextureStreamer::MakeResident(UploadEngine& uploadEngine, uint32_t asset, uint32_t mip)
+{
+    const PackEntry& entry = m_Pack->GetEntry(asset);
+    Resident& resident = m_Textures[asset];
+
+    if (entry.format == TextureFormat::Bc1 && !m_Bc1)
+    {
+        resident.requestedMip = resident.texture.firstMip;
+        throw std::runtime_error("BC1 textures are not supported by the device!");
+    }
+    const VkFormat format = entry.format == TextureFormat::Bc1 ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+
+    const PackMip* mips = m_Pack->GetMips(entry);
+    const uint32_t levelCount = entry.mipCount - mip;
+
+    Resident fresh;
+    auto destroyFresh = [this, &fresh]()
+    {
+        if (fresh.texture.view != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyImageView(m_Device, fresh.texture.view, m_Callbacks);
+        }
+        if (fresh.texture.image != VK_NULL_HANDLE)
+        {
+            m_Dispatch->vkDestroyImage(m_Device, fresh.texture.image, m_Callbacks);
+        }
+        if (fresh.allocation != nullptr)
+        {
+            m_Allocator->Free(fresh.allocation);
+        }
+    };
+
+    try
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = { mips[mip].width, mips[mip].height, 1 };
+        imageInfo.mipLevels = levelCount;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (m_Dispatch->vkCreateImage(m_Device, &imageInfo, m_Callbacks, &fresh.texture.image) != VK_SUCCESS)
+        {
+            fresh.texture.image = VK_NULL_HANDLE;
+            throw std::runtime_error("Failed to create texture image!");
+        }
+
+        GpuAllocator::AllocationCreateInfo allocInfo{};
+        allocInfo.usage = GpuAllocator::Usage::GpuOnly;
+        fresh.allocation = m_Allocator->AllocateForImage(fresh.texture.image, allocInfo);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = fresh.texture.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = levelCount;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (m_Dispatch->vkCreateImageView(m_Device, &viewInfo, m_Callbacks, &fresh.texture.view) != VK_SUCCESS)
+        {
+            fresh.texture.view = VK_NULL_HANDLE;
+            throw std::runtime_error("Failed to create texture image view!");
+        }
+    }
+    catch (...)
+    {
+        destroyFresh();
+        resident.requestedMip = resident.texture.firstMip;
+        throw;
+    }
+
+    // Level offsets are relative to the blob, the first uploaded level is not at its start
+    std::vector<UploadEngine::ImageLevel> levels(levelCount);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        levels[i].offset = mips[mip + i].offset;
+        levels[i].size = mips[mip + i].size;
+        levels[i].width = mips[mip + i].width;
+        levels[i].height = mips[mip + i].height;
+        bytes += mips[mip + i].size;
+    }
+
+    if (m_ImportBuffer != VK_NULL_HANDLE)
+    {
+        uploadEngine.CopyImageLevels(fresh.texture.image, m_ImportBuffer, entry.offset, levels.data(), levelCount,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    else
+    {
+        uploadEngine.UploadImageLevels(fresh.texture.image, m_Pack->GetBlob(entry), levels.data(), levelCount,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // The upload is recorded now, a full table leaves the texture resident without a slot
+    if (m_Bindless != nullptr)
+    {
+        try
+        {
+            fresh.texture.bindlessIndex = m_Bindless->AddSampledImage(fresh.texture.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Texture " << m_Pack->GetName(entry) << " has no bindless slot: " << e.what() << '\n';
+        }
+    }
+
+    const uint32_t oldFirstMip = resident.texture.image != VK_NULL_HANDLE ? resident.texture.firstMip : entry.mipCount;
+    Retire(resident);
+
+    resident.texture.image = fresh.texture.image;
+    resident.texture.view = fresh.texture.view;
+    resident.texture.bindlessIndex = fresh.texture.bindlessIndex;
+    resident.texture.width = entry.width;
+    resident.texture.height = entry.height;
+    resident.texture.mipCount = entry.mipCount;
+    resident.texture.firstMip = mip;
+    resident.requestedMip = mip;
+    resident.allocation = fresh.allocation;
+
+    m_Heap = m_Allocator->GetMemoryTypeHeap(fresh.allocation->memoryType);
+
+    m_Stats.residentBytes += fresh.allocation->size;
+    m_Stats.peakResidentBytes = std::max(m_Stats.peakResidentBytes, m_Stats.residentBytes);
+    m_Stats.residentMips += levelCount;
+    if (mip < oldFirstMip)
+    {
+        m_Stats.mipsLoaded += oldFirstMip - mip;
+        if (oldFirstMip != entry.mipCount)
+        {
+            m_Stats.promotions++;
+        }
+    }
+    if (mip <= resident.wantedMip)
+    {
+        resident.clampedMip = ~0u;
+    }
+    return bytes;
+}
+
+// Hands the texture's image to the retired list; the bindless slot is released right away,
+// the table itself keeps it from being reused while frames in flight can read it
+void TextureStreamer::Retire(Resident& resident)
+{
+    if (resident.texture.bindlessIndex != ~0u)
+    {
+        m_Bindless->Release(BindlessDescriptors::Kind::SampledImage, resident.texture.bindlessIndex);
+        resident.texture.bindlessIndex = ~0u;
+    }
+    if (resident.texture.image == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    m_Stats.residentBytes -= resident.allocation->size;
+    m_Stats.residentMips -= resident.texture.mipCount - resident.texture.firstMip;
+
+    Retired retired;
+    retired.image = resident.texture.image;
+    retired.view = resident.texture.view;
+    retired.allocation = resident.allocation;
+    retired.frame = m_Frame;
+    m_Retired.push_back(retired);
+
+    resident.texture.image = VK_NULL_HANDLE;
+    resident.texture.view = VK_NULL_HANDLE;
+    resident.allocation = nullptr;
+}
+
+void TextureStreamer::DestroyRetired(bool all)
+{
+    size_t kept = 0;
+    for (const Retired& retired : m_Retired)
+    {
+        if (!all && retired.frame + m_FramesInFlight > m_Frame)
+        {
+            m_Retired[kept++] = retired;
+            continue;
+        }
+        m_Dispatch->vkDestroyImageView(m_Device, retired.view, m_Callbacks);
+        m_Dispatch->vkDestroyImage(m_Device, retired.image, m_Callbacks);
+        m_Allocator->Free(retired.allocation);
+    }
+    m_Retired.resize(kept);
+}
+
+const TextureStreamer::Texture* TextureStreamer::GetTexture(uint32_t asset) const
+{
+    if (asset >= m_Textures.size() || m_Textures[asset].texture.image == VK_NULL_HANDLE)
+    {
+        return nullptr;
+    }
+    return &m_Textures[asset].texture;
+}
+
+void TextureStreamer::PrintStats() const
+{
+    if (m_Stats.peakResidentBytes == 0)
+    {
+        return;
+    }
+
+    std::cout << "Texture streaming: " << m_Stats.residentMips << " mips resident in " << m_Stats.residentBytes / 1024
+        << " KiB (peak " << m_Stats.peakResidentBytes / 1024 << " KiB), " << m_Stats.promotions << " promotions loaded "
+        << m_Stats.mipsLoaded << " mips, " << m_Stats.evictions << " evictions dropped " << m_Stats.mipsEvicted << " mips ("
+        << m_Stats.bytesEvicted / 1024 << " KiB), " << m_Stats.thrash << " thrashing";
+    if (m_Stats.clamped > 0)
+    {
+        std::cout << ", " << m_Stats.clamped << " promotions clamped";
+    }
+    if (m_Stats.overBudgetFrames > 0)
+    {
+        std::cout << ", " << m_Stats.overBudgetFrames << " frames over budget";
+    }
+    std::cout << '\n';
+}
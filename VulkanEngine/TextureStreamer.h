@@ -0,0 +1,170 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "AssetPack.h"
+#include "GpuAllocator.h"
+#include "VulkanFwd.h"
+
+class BindlessDescriptors;
+class UploadEngine;
+struct VulkanDeviceDispatch;
+
+// Keeps the textures of an AssetPack resident a mip range at a time, within the memory budget.
+//
+// A texture first gets its tail, the mips of at most TAIL_SIZE texels a side. Finer mips are
+// loaded when something asks for them: shaders atomicMin the mip level they would sample into
+// the feedback buffer of the frame, or the CPU calls RequestMip. The image only ever holds the
+// resident range, so a change recreates it with the new range and uploads that from the pack;
+// there is no sparse residency. The old image is destroyed once no frame in flight uses it.
+//
+// Once a frame the budget is checked: the device local heap's usage from VK_EXT_memory_budget
+// (or the allocator's own estimate) against 90% of its budget, and the resident bytes against
+// the configured texture budget. Over it, textures that were not used in the last frame lose
+// their finest mips, least recently used first, down to their tail. A promotion that still
+// does not fit is clamped to the finest mip that does.
+//
+// AssetStreamer owns this and feeds it: it loads the pages of the requested mips on its loader
+// thread and calls MakeResident when they are there.
+class TextureStreamer
+{
+public:
+    static constexpr uint32_t TAIL_SIZE = 64;
+    static constexpr uint32_t NO_FEEDBACK = ~0u;
+
+    struct Texture
+    {
+        VkImage     image           = nullptr;
+        VkImageView view            = nullptr;
+        uint32_t    width           = 0;        // of the full chain's mip 0
+        uint32_t    height          = 0;
+        uint32_t    mipCount        = 0;        // of the full chain
+        uint32_t    firstMip        = 0;        // level 0 of the image is this mip of the chain
+        uint32_t    bindlessIndex   = ~0u;      // changes with every new mip range, read it every frame
+    };
+
+    // A mip the loader should prefetch before MakeResident is called for it
+    struct MipRequest
+    {
+        uint32_t    asset           = 0;
+        uint32_t    mip             = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t    residentBytes       = 0;
+        uint64_t    peakResidentBytes   = 0;
+        uint64_t    residentMips        = 0;
+        uint64_t    promotions          = 0;    // mip ranges made finer
+        uint64_t    mipsLoaded          = 0;
+        uint64_t    evictions           = 0;    // mip ranges made coarser to free memory
+        uint64_t    mipsEvicted         = 0;
+        uint64_t    bytesEvicted        = 0;
+        uint64_t    thrash              = 0;    // promotions of mips evicted less than THRASH_FRAMES ago
+        uint64_t    clamped             = 0;    // promotions cut short by the budget
+        uint64_t    overBudgetFrames    = 0;    // frames that ended over the budget anyway
+    };
+
+    TextureStreamer() = default;
+    ~TextureStreamer() = default;
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // The pack stays open and importBuffer (the imported mapping, may be null) alive until
+    // Destroy. budgetLimit caps the resident bytes, 0 leaves it to the heap budget.
+    void Create(VkDevice device, const VulkanDeviceDispatch& dispatch, GpuAllocator& allocator,
+        BindlessDescriptors* bindless, const AssetPack& pack, VkBuffer importBuffer, bool bc1, uint32_t framesInFlight,
+        uint64_t budgetLimit, const VkAllocationCallbacks* callbacks);
+    void Destroy();
+
+    // Finest mip loaded first, the tail of the texture
+    static uint32_t GetTailMip(const AssetPack& pack, const PackEntry& entry);
+
+    // Main thread, once a frame after the frame's fence and before the upload engine is
+    // flushed. Reads the frame's feedback, releases old images and evicts when over budget.
+    void Update(UploadEngine& uploadEngine, uint32_t frameIndex);
+
+    // Mips to load, finest wanted first within the budget; each has to reach MakeResident
+    void CollectPromotions(UploadEngine& uploadEngine, std::vector<MipRequest>& requests);
+
+    // (Re)creates the image with mips mip to the tail and queues their upload. Throws when the
+    // image cannot be created, the texture then keeps its old range.
+    uint64_t MakeResident(UploadEngine& uploadEngine, uint32_t asset, uint32_t mip);
+
+    // CPU side feedback: the texture is used this frame and mip is the finest it needs
+    void RequestMip(uint32_t asset, uint32_t mip);
+
+    // Null until the tail is resident
+    const Texture* GetTexture(uint32_t asset) const;
+
+    // Storage buffer slot of the frame's feedback, one uint per asset (NO_FEEDBACK when not
+    // sampled). Shaders write it with atomicMin; the frame has to make the writes visible to the
+    // host with a barrier to VK_PIPELINE_STAGE_HOST_BIT.
+    uint32_t GetFeedbackIndex(uint32_t frameIndex) const { return m_Feedback[frameIndex].bindlessIndex; }
+    VkBuffer GetFeedbackBuffer(uint32_t frameIndex) const { return m_Feedback[frameIndex].buffer; }
+
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    struct Resident
+    {
+        Texture                     texture;
+        GpuAllocator::Allocation*   allocation      = nullptr;
+        uint32_t                    tailMip         = 0;
+        uint32_t                    wantedMip       = 0;        // finest mip asked for in lastUsedFrame
+        uint32_t                    requestedMip    = 0;        // below texture.firstMip while the loader has it
+        uint64_t                    lastUsedFrame   = 0;
+        uint32_t                    evictedMip      = 0;        // coarsest mip of the last eviction
+        uint64_t                    evictedFrame    = 0;
+        uint32_t                    clampedMip      = ~0u;      // wantedMip of the last clamp, counted once
+        bool                        used            = false;    // lastUsedFrame is valid
+    };
+
+    // Images of replaced ranges, destroyed framesInFlight frames later
+    struct Retired
+    {
+        VkImage                     image           = nullptr;
+        VkImageView                 view            = nullptr;
+        GpuAllocator::Allocation*   allocation      = nullptr;
+        uint64_t                    frame           = 0;
+    };
+
+    struct Feedback
+    {
+        VkBuffer                    buffer          = nullptr;
+        GpuAllocator::Allocation*   allocation      = nullptr;
+        uint32_t                    bindlessIndex   = ~0u;
+    };
+
+    void CreateFeedback();
+    void ReadFeedback(uint32_t frameIndex);
+    int64_t ComputeHeadroom();
+    uint64_t Evict(UploadEngine& uploadEngine, uint64_t bytes, uint32_t keepAsset);
+    uint64_t RangeBytes(uint32_t asset, uint32_t firstMip) const;
+    bool IsRecent(const Resident& resident) const { return resident.used && resident.lastUsedFrame + 1 >= m_Frame; }
+    void NoteUse(uint32_t asset, uint32_t mip);
+    void Retire(Resident& resident);
+    void DestroyRetired(bool all);
+
+    VkDevice                        m_Device            = nullptr;
+    const VulkanDeviceDispatch*     m_Dispatch          = nullptr;
+    GpuAllocator*                   m_Allocator         = nullptr;
+    BindlessDescriptors*            m_Bindless          = nullptr;
+    const AssetPack*                m_Pack              = nullptr;
+    const VkAllocationCallbacks*    m_Callbacks         = nullptr;
+    VkBuffer                        m_ImportBuffer      = nullptr;
+    bool                            m_Bc1               = false;
+    uint32_t                        m_FramesInFlight    = 1;
+    uint64_t                        m_BudgetLimit       = 0;
+
+    std::vector<Resident>           m_Textures;         // one per pack entry, unused for meshes
+    std::vector<Retired>            m_Retired;
+    std::vector<Feedback>           m_Feedback;         // one per frame in flight
+    uint64_t                        m_Frame             = 0;
+    uint32_t                        m_Heap              = ~0u;      // heap of the texture allocations
+
+    Stats                           m_Stats;
+};
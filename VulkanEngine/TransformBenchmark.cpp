@@ -0,0 +1,329 @@
+#include "TransformBenchmark.h"
+#include "TransformHierarchy.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t BENCHMARK_NODE_COUNT = 1u << 20;
+
+// Every node past the roots gets the next free slot among the children of the earlier nodes,
+// which gives a tree of a few levels like a scene of many small prefabs
+constexpr uint32_t BENCHMARK_ROOT_COUNT = 256;
+constexpr uint32_t BENCHMARK_BRANCHING = 4;
+
+// Roots are spread over a cube of this half size, children stay close to their parent
+constexpr float BENCHMARK_SCENE_EXTENT = 200.0f;
+constexpr float BENCHMARK_CHILD_OFFSET = 4.0f;
+
+constexpr uint32_t BENCHMARK_REPEATS = 5;
+
+// Nodes moved between two partial updates, one in this many
+constexpr uint32_t BENCHMARK_MOVED_INTERVAL = 100;
+
+namespace
+{
+    using BenchmarkClock = std::chrono::steady_clock;
+
+    // The layout most engines start with: one struct per node, matrices recomputed with glm
+    struct NaiveNode
+    {
+        glm::vec3   position;
+        glm::quat   rotation;
+        glm::vec3   scale;
+        glm::mat4   world;
+        glm::vec3   boundsCenter;
+        glm::vec3   boundsExtent;
+        uint32_t    parent;
+    };
+
+    struct Scene
+    {
+        std::vector<NaiveNode>  naive;
+        TransformHierarchy      hierarchy;
+        std::vector<uint32_t>   moved;
+    };
+
+    double SecondsSince(BenchmarkClock::time_point start)
+    {
+        return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+    }
+
+    void PrintResult(std::ostream& out, const char* name, double seconds, double baseline)
+    {
+        out << "  " << std::left << std::setw(34) << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(9) << seconds * 1000.0 << " ms" << std::setw(9) << seconds * 1e9 / BENCHMARK_NODE_COUNT
+            << " ns/node" << std::setw(8) << baseline / seconds << "x\n";
+    }
+
+    void BuildScene(Scene& scene)
+    {
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        scene.naive.resize(BENCHMARK_NODE_COUNT);
+        scene.hierarchy.Reserve(BENCHMARK_NODE_COUNT);
+
+        for (uint32_t i = 0; i < BENCHMARK_NODE_COUNT; i++)
+        {
+            bool root = i < BENCHMARK_ROOT_COUNT;
+            float offset = root ? BENCHMARK_SCENE_EXTENT : BENCHMARK_CHILD_OFFSET;
+
+            NaiveNode& node = scene.naive[i];
+            node.parent = root ? TransformHierarchy::NO_PARENT : (i - BENCHMARK_ROOT_COUNT) / BENCHMARK_BRANCHING;
+            node.position = glm::vec3(unit(generator), unit(generator), unit(generator)) * offset;
+            node.rotation = glm::angleAxis(unit(generator) * 3.14159f,
+                glm::normalize(glm::vec3(unit(generator), unit(generator), unit(generator)) + glm::vec3(0.0f, 0.0f, 2.0f)));
+            node.scale = glm::vec3(0.8f + 0.2f * unit(generator), 0.8f + 0.2f * unit(generator), 0.8f + 0.2f * unit(generator));
+            node.boundsCenter = glm::vec3(0.0f);
+            node.boundsExtent = glm::vec3(0.5f);
+
+            float position[3] = { node.position.x, node.position.y, node.position.z };
+            float rotation[4] = { node.rotation.x, node.rotation.y, node.rotation.z, node.rotation.w };
+            float scale[3] = { node.scale.x, node.scale.y, node.scale.z };
+            float center[3] = { node.boundsCenter.x, node.boundsCenter.y, node.boundsCenter.z };
+            float extent[3] = { node.boundsExtent.x, node.boundsExtent.y, node.boundsExtent.z };
+
+            uint32_t handle = scene.hierarchy.AddNode(node.parent);
+            scene.hierarchy.SetLocal(handle, position, rotation, scale);
+            scene.hierarchy.SetBounds(handle, center, extent);
+        }
+
+        for (uint32_t i = 0; i < BENCHMARK_NODE_COUNT / BENCHMARK_MOVED_INTERVAL; i++)
+        {
+            scene.moved.push_back(generator() % BENCHMARK_NODE_COUNT);
+        }
+        std::sort(scene.moved.begin(), scene.moved.end());
+    }
+
+    void NaiveUpdate(std::vector<NaiveNode>& nodes)
+    {
+        for (NaiveNode& node : nodes)
+        {
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), node.position) * glm::mat4_cast(node.rotation)
+                * glm::scale(glm::mat4(1.0f), node.scale);
+            node.world = (node.parent == TransformHierarchy::NO_PARENT) ? local : nodes[node.parent].world * local;
+        }
+    }
+
+    uint32_t NaiveCull(const std::vector<NaiveNode>& nodes, const glm::vec4 planes[6], std::vector<uint32_t>& visible)
+    {
+        for (uint32_t i = 0; i < nodes.size(); i++)
+        {
+            const NaiveNode& node = nodes[i];
+            glm::vec3 center = glm::vec3(node.world * glm::vec4(node.boundsCenter, 1.0f));
+            glm::vec3 extent = glm::abs(glm::vec3(node.world[0])) * node.boundsExtent.x
+                + glm::abs(glm::vec3(node.world[1])) * node.boundsExtent.y
+                + glm::abs(glm::vec3(node.world[2])) * node.boundsExtent.z;
+
+            bool inside = true;
+            for (uint32_t p = 0; p < 6 && inside; p++)
+            {
+                glm::vec3 normal = glm::vec3(planes[p]);
+                inside = glm::dot(normal, center) + planes[p].w + glm::dot(glm::abs(normal), extent) >= 0.0f;
+            }
+            if (inside)
+            {
+                visible.push_back(i);
+            }
+        }
+        return static_cast<uint32_t>(visible.size());
+    }
+
+    // Camera in the middle of the scene, planes extracted as in GpuScene::UpdateCamera
+    void BuildFrustum(glm::vec4 planes[6])
+    {
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, -0.2f, 0.3f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, BENCHMARK_SCENE_EXTENT * 2.0f);
+        glm::mat4 viewProjection = projection * view;
+
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+        {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[2];
+        planes[5] = rows[3] - rows[2];
+    }
+
+    // Largest difference between the two layouts, relative to the magnitude of the element
+    float CompareWorldMatrices(const Scene& scene)
+    {
+        float largest = 0.0f;
+        for (uint32_t i = 0; i < BENCHMARK_NODE_COUNT; i++)
+        {
+            float matrix[16];
+            scene.hierarchy.GetWorldMatrix(i, matrix);
+            for (int c = 0; c < 4; c++)
+            {
+                for (int r = 0; r < 4; r++)
+                {
+                    float expected = scene.naive[i].world[c][r];
+                    largest = std::max(largest, std::fabs(matrix[c * 4 + r] - expected) / (1.0f + std::fabs(expected)));
+                }
+            }
+        }
+        return largest;
+    }
+
+    void MarkRootsDirty(Scene& scene)
+    {
+        for (uint32_t i = 0; i < BENCHMARK_ROOT_COUNT; i++)
+        {
+            const glm::vec3& position = scene.naive[i].position;
+            float value[3] = { position.x, position.y, position.z };
+            scene.hierarchy.SetPosition(i, value);
+        }
+    }
+
+    void MarkMovedDirty(Scene& scene)
+    {
+        for (uint32_t node : scene.moved)
+        {
+            const glm::vec3& position = scene.naive[node].position;
+            float value[3] = { position.x, position.y, position.z };
+            scene.hierarchy.SetPosition(node, value);
+        }
+    }
+}
+
+void RunTransformBenchmark(std::ostream& out)
+{
+    Scene scene;
+    BuildScene(scene);
+
+    // The first update sorts the slots by level and computes everything once
+    scene.hierarchy.Update();
+
+    const TransformHierarchy::Isa isas[] = { TransformHierarchy::Isa::Scalar, TransformHierarchy::Isa::Sse, TransformHierarchy::Isa::Avx2 };
+    const TransformHierarchy::Isa best = TransformHierarchy::DetectIsa();
+
+    out << "Transform hierarchy benchmark, " << BENCHMARK_NODE_COUNT << " nodes in " << scene.hierarchy.GetLevelCount()
+        << " levels, best of " << BENCHMARK_REPEATS << " runs, widest kernel " << TransformHierarchy::GetIsaName(best) << "\n";
+
+    // Full update: moving the roots dirties the whole tree
+    double naive = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        auto start = BenchmarkClock::now();
+        NaiveUpdate(scene.naive);
+        naive = std::min(naive, SecondsSince(start));
+    }
+    PrintResult(out, "full update, AoS glm::mat4", naive, naive);
+
+    for (TransformHierarchy::Isa isa : isas)
+    {
+        if (isa > best)
+        {
+            continue;
+        }
+        scene.hierarchy.SetIsa(isa);
+
+        double seconds = 1e30;
+        for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+        {
+            MarkRootsDirty(scene);
+            auto start = BenchmarkClock::now();
+            scene.hierarchy.Update();
+            seconds = std::min(seconds, SecondsSince(start));
+        }
+        std::string name = std::string("full update, SoA ") + TransformHierarchy::GetIsaName(isa);
+        PrintResult(out, name.c_str(), seconds, naive);
+        out << "    largest difference to AoS " << std::scientific << std::setprecision(1) << CompareWorldMatrices(scene)
+            << std::fixed << "\n";
+    }
+
+    // Partial update: the naive layout has no dirty tracking and recomputes everything
+    out << "  " << scene.moved.size() << " nodes moved (1 in " << BENCHMARK_MOVED_INTERVAL << ") per partial update\n";
+    for (TransformHierarchy::Isa isa : isas)
+    {
+        if (isa > best)
+        {
+            continue;
+        }
+        scene.hierarchy.SetIsa(isa);
+        scene.hierarchy.ResetStats();
+
+        double seconds = 1e30;
+        for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+        {
+            MarkMovedDirty(scene);
+            auto start = BenchmarkClock::now();
+            scene.hierarchy.Update();
+            seconds = std::min(seconds, SecondsSince(start));
+        }
+        std::string name = std::string("partial update, SoA ") + TransformHierarchy::GetIsaName(isa);
+        PrintResult(out, name.c_str(), seconds, naive);
+        out << "    " << scene.hierarchy.GetStats().nodesUpdated / BENCHMARK_REPEATS << " nodes recomputed\n";
+    }
+
+    // Frustum culling of the world space bounding boxes
+    glm::vec4 frustum[6];
+    BuildFrustum(frustum);
+    float planes[6][4];
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i][j] = frustum[i][j];
+        }
+    }
+
+    std::vector<uint32_t> visible;
+    visible.reserve(BENCHMARK_NODE_COUNT);
+
+    uint32_t naiveVisible = 0;
+    naive = 1e30;
+    for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+    {
+        visible.clear();
+        auto start = BenchmarkClock::now();
+        naiveVisible = NaiveCull(scene.naive, frustum, visible);
+        naive = std::min(naive, SecondsSince(start));
+    }
+    PrintResult(out, "cull, AoS glm::mat4", naive, naive);
+    out << "    " << naiveVisible << " visible\n";
+
+    for (TransformHierarchy::Isa isa : isas)
+    {
+        if (isa > best)
+        {
+            continue;
+        }
+        scene.hierarchy.SetIsa(isa);
+
+        uint32_t visibleCount = 0;
+        double seconds = 1e30;
+        for (uint32_t repeat = 0; repeat < BENCHMARK_REPEATS; repeat++)
+        {
+            visible.clear();
+            auto start = BenchmarkClock::now();
+            visibleCount = scene.hierarchy.Cull(planes, visible);
+            seconds = std::min(seconds, SecondsSince(start));
+        }
+        std::string name = std::string("cull, SoA ") + TransformHierarchy::GetIsaName(isa);
+        PrintResult(out, name.c_str(), seconds, naive);
+        out << "    " << visibleCount << " visible";
+        if (visibleCount != naiveVisible)
+        {
+            // Boxes touching a plane can go either way with the rounding of the other layout
+            out << ", " << static_cast<int64_t>(visibleCount) - static_cast<int64_t>(naiveVisible) << " compared to AoS";
+        }
+        out << "\n";
+    }
+}
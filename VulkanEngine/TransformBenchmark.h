@@ -0,0 +1,9 @@
+#pragma once
+
+#include <iosfwd>
+
+// Compares TransformHierarchy's SoA kernels (scalar, SSE and AVX2 where the CPU has it)
+// with a naive array of nodes holding glm::mat4 world matrices, at 1M nodes: updating
+// every world matrix, updating after a few nodes moved, and frustum culling the bounding
+// boxes. Also checks that all kernels agree with the naive version. Needs no GPU.
+void RunTransformBenchmark(std::ostream& out);
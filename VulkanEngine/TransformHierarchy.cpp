@@ -0,0 +1,862 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#if TRANSFORM_HIERARCHY_SIMD
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic without flags, GCC and Clang need the AVX2 kernels marked so the
+// rest of the file stays runnable on CPUs without AVX2
+#if TRANSFORM_HIERARCHY_SIMD && (defined(__GNUC__) || defined(__clang__))
+    #define TRANSFORM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+    #define TRANSFORM_TARGET_AVX2
+#endif
+
+namespace
+{
+    // What the update kernels read and write, indexed by slot
+    struct UpdateArrays
+    {
+        const float*    position[3];
+        const float*    rotation[4];
+        const float*    scale[3];
+        const int32_t*  parent;
+        float*          world[12];
+    };
+
+    struct CullArrays
+    {
+        const float*    world[12];
+        const float*    center[3];
+        const float*    extent[3];
+        const uint8_t*  hasBounds;
+        const int32_t*  handle;
+    };
+
+    using KernelClock = std::chrono::steady_clock;
+
+    double MillisecondsSince(KernelClock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(KernelClock::now() - start).count();
+    }
+
+    uint32_t CountTrailingZeros(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return static_cast<uint32_t>(__builtin_ctz(value));
+#endif
+    }
+
+    bool AnyDirty(const uint8_t* dirty, uint32_t count)
+    {
+        uint8_t any = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            any |= dirty[i];
+        }
+        return any != 0;
+    }
+
+    // One bit per lane that has bounds, in the order of a movemask
+    uint32_t BoundsMask(const uint8_t* hasBounds, uint32_t count)
+    {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            mask |= (hasBounds[i] != 0 ? 1u : 0u) << i;
+        }
+        return mask;
+    }
+
+    // World = parent * local, where the local matrix is built from translation, rotation
+    // quaternion and scale. Matrices are affine, column-major, without the last row.
+    void UpdateScalar(const UpdateArrays& a, uint32_t first, uint32_t count, bool hasParent)
+    {
+        for (uint32_t s = first; s < first + count; s++)
+        {
+            float qx = a.rotation[0][s];
+            float qy = a.rotation[1][s];
+            float qz = a.rotation[2][s];
+            float qw = a.rotation[3][s];
+            float x2 = qx * 2.0f;
+            float y2 = qy * 2.0f;
+            float z2 = qz * 2.0f;
+            float xx = qx * x2, yy = qy * y2, zz = qz * z2;
+            float xy = qx * y2, xz = qx * z2, yz = qy * z2;
+            float wx = qw * x2, wy = qw * y2, wz = qw * z2;
+            float sx = a.scale[0][s];
+            float sy = a.scale[1][s];
+            float sz = a.scale[2][s];
+
+            float l[12] =
+            {
+                (1.0f - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx,
+                (xy - wz) * sy, (1.0f - (xx + zz)) * sy, (yz + wx) * sy,
+                (xz + wy) * sz, (yz - wx) * sz, (1.0f - (xx + yy)) * sz,
+                a.position[0][s], a.position[1][s], a.position[2][s]
+            };
+
+            if (!hasParent)
+            {
+                for (uint32_t k = 0; k < 12; k++)
+                {
+                    a.world[k][s] = l[k];
+                }
+                continue;
+            }
+
+            int32_t parent = a.parent[s];
+            float p[12];
+            for (uint32_t k = 0; k < 12; k++)
+            {
+                p[k] = a.world[k][parent];
+            }
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                for (uint32_t r = 0; r < 3; r++)
+                {
+                    float w = p[r] * l[c * 3] + p[3 + r] * l[c * 3 + 1] + p[6 + r] * l[c * 3 + 2];
+                    a.world[c * 3 + r][s] = (c == 3) ? w + p[9 + r] : w;
+                }
+            }
+        }
+    }
+
+    // The box is moved to world space (center by the matrix, extent by its absolute 3x3 part)
+    // and is outside when it lies entirely behind one plane
+    void CullScalar(const CullArrays& a, uint32_t first, uint32_t count, const float planes[6][4],
+        std::vector<uint32_t>& visible)
+    {
+        for (uint32_t s = first; s < first + count; s++)
+        {
+            if (a.hasBounds[s] == 0)
+            {
+                continue;
+            }
+
+            float center[3];
+            float extent[3];
+            for (uint32_t r = 0; r < 3; r++)
+            {
+                center[r] = a.world[r][s] * a.center[0][s] + a.world[3 + r][s] * a.center[1][s]
+                    + a.world[6 + r][s] * a.center[2][s] + a.world[9 + r][s];
+                extent[r] = std::fabs(a.world[r][s]) * a.extent[0][s] + std::fabs(a.world[3 + r][s]) * a.extent[1][s]
+                    + std::fabs(a.world[6 + r][s]) * a.extent[2][s];
+            }
+
+            bool inside = true;
+            for (uint32_t i = 0; i < 6 && inside; i++)
+            {
+                float distance = planes[i][0] * center[0] + planes[i][1] * center[1] + planes[i][2] * center[2] + planes[i][3];
+                float radius = std::fabs(planes[i][0]) * extent[0] + std::fabs(planes[i][1]) * extent[1]
+                    + std::fabs(planes[i][2]) * extent[2];
+                inside = distance + radius >= 0.0f;
+            }
+            if (inside)
+            {
+                visible.push_back(static_cast<uint32_t>(a.handle[s]));
+            }
+        }
+    }
+
+#if TRANSFORM_HIERARCHY_SIMD
+    __m128 Gather4(const float* base, const int32_t* index)
+    {
+        return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+    }
+
+    // Same math as UpdateScalar, four slots per instruction. count is a multiple of 4.
+    void UpdateSse(const UpdateArrays& a, uint32_t first, uint32_t count, bool hasParent)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+
+        for (uint32_t s = first; s < first + count; s += 4)
+        {
+            __m128 qx = _mm_loadu_ps(a.rotation[0] + s);
+            __m128 qy = _mm_loadu_ps(a.rotation[1] + s);
+            __m128 qz = _mm_loadu_ps(a.rotation[2] + s);
+            __m128 qw = _mm_loadu_ps(a.rotation[3] + s);
+            __m128 x2 = _mm_mul_ps(qx, two);
+            __m128 y2 = _mm_mul_ps(qy, two);
+            __m128 z2 = _mm_mul_ps(qz, two);
+            __m128 xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+            __m128 xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+            __m128 wx = _mm_mul_ps(qw, x2), wy = _mm_mul_ps(qw, y2), wz = _mm_mul_ps(qw, z2);
+            __m128 sx = _mm_loadu_ps(a.scale[0] + s);
+            __m128 sy = _mm_loadu_ps(a.scale[1] + s);
+            __m128 sz = _mm_loadu_ps(a.scale[2] + s);
+
+            __m128 l[12] =
+            {
+                _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+                _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+                _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+                _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+                _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+                _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+                _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+                _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+                _mm_loadu_ps(a.position[0] + s),
+                _mm_loadu_ps(a.position[1] + s),
+                _mm_loadu_ps(a.position[2] + s)
+            };
+
+            if (!hasParent)
+            {
+                for (uint32_t k = 0; k < 12; k++)
+                {
+                    _mm_storeu_ps(a.world[k] + s, l[k]);
+                }
+                continue;
+            }
+
+            // SSE has no gather, the parents' matrices are collected lane by lane
+            __m128 p[12];
+            for (uint32_t k = 0; k < 12; k++)
+            {
+                p[k] = Gather4(a.world[k], a.parent + s);
+            }
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                for (uint32_t r = 0; r < 3; r++)
+                {
+                    __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[r], l[c * 3]), _mm_mul_ps(p[3 + r], l[c * 3 + 1])),
+                        _mm_mul_ps(p[6 + r], l[c * 3 + 2]));
+                    if (c == 3)
+                    {
+                        w = _mm_add_ps(w, p[9 + r]);
+                    }
+                    _mm_storeu_ps(a.world[c * 3 + r] + s, w);
+                }
+            }
+        }
+    }
+
+    // Same math as UpdateScalar, eight slots per instruction. count is a multiple of 8.
+    TRANSFORM_TARGET_AVX2 void UpdateAvx2(const UpdateArrays& a, uint32_t first, uint32_t count, bool hasParent)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+
+        for (uint32_t s = first; s < first + count; s += 8)
+        {
+            __m256 qx = _mm256_loadu_ps(a.rotation[0] + s);
+            __m256 qy = _mm256_loadu_ps(a.rotation[1] + s);
+            __m256 qz = _mm256_loadu_ps(a.rotation[2] + s);
+            __m256 qw = _mm256_loadu_ps(a.rotation[3] + s);
+            __m256 x2 = _mm256_mul_ps(qx, two);
+            __m256 y2 = _mm256_mul_ps(qy, two);
+            __m256 z2 = _mm256_mul_ps(qz, two);
+            __m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+            __m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+            __m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+            __m256 sx = _mm256_loadu_ps(a.scale[0] + s);
+            __m256 sy = _mm256_loadu_ps(a.scale[1] + s);
+            __m256 sz = _mm256_loadu_ps(a.scale[2] + s);
+
+            __m256 l[12] =
+            {
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+                _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+                _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+                _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+                _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+                _mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+                _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+                _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+                _mm256_loadu_ps(a.position[0] + s),
+                _mm256_loadu_ps(a.position[1] + s),
+                _mm256_loadu_ps(a.position[2] + s)
+            };
+
+            if (!hasParent)
+            {
+                for (uint32_t k = 0; k < 12; k++)
+                {
+                    _mm256_storeu_ps(a.world[k] + s, l[k]);
+                }
+                continue;
+            }
+
+            __m256i parent = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.parent + s));
+            __m256 p[12];
+            for (uint32_t k = 0; k < 12; k++)
+            {
+                p[k] = _mm256_i32gather_ps(a.world[k], parent, 4);
+            }
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                for (uint32_t r = 0; r < 3; r++)
+                {
+                    __m256 w = (c == 3) ? p[9 + r] : _mm256_setzero_ps();
+                    w = _mm256_fmadd_ps(p[r], l[c * 3], w);
+                    w = _mm256_fmadd_ps(p[3 + r], l[c * 3 + 1], w);
+                    w = _mm256_fmadd_ps(p[6 + r], l[c * 3 + 2], w);
+                    _mm256_storeu_ps(a.world[c * 3 + r] + s, w);
+                }
+            }
+        }
+    }
+
+    __m128 Abs4(__m128 value)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+    }
+
+    // Same test as CullScalar, four boxes per instruction. Visible lanes are compacted with a movemask.
+    void CullSse(const CullArrays& a, uint32_t count, const float planes[6][4], std::vector<uint32_t>& visible)
+    {
+        const __m128 zero = _mm_setzero_ps();
+
+        uint32_t s = 0;
+        for (; s + 4 <= count; s += 4)
+        {
+            uint32_t bounded = BoundsMask(a.hasBounds + s, 4);
+            if (bounded == 0)
+            {
+                continue;
+            }
+
+            __m128 w[12];
+            for (uint32_t k = 0; k < 12; k++)
+            {
+                w[k] = _mm_loadu_ps(a.world[k] + s);
+            }
+            __m128 cx = _mm_loadu_ps(a.center[0] + s);
+            __m128 cy = _mm_loadu_ps(a.center[1] + s);
+            __m128 cz = _mm_loadu_ps(a.center[2] + s);
+            __m128 ex = _mm_loadu_ps(a.extent[0] + s);
+            __m128 ey = _mm_loadu_ps(a.extent[1] + s);
+            __m128 ez = _mm_loadu_ps(a.extent[2] + s);
+
+            __m128 center[3];
+            __m128 extent[3];
+            for (uint32_t r = 0; r < 3; r++)
+            {
+                center[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[r], cx), _mm_mul_ps(w[3 + r], cy)),
+                    _mm_add_ps(_mm_mul_ps(w[6 + r], cz), w[9 + r]));
+                extent[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs4(w[r]), ex), _mm_mul_ps(Abs4(w[3 + r]), ey)),
+                    _mm_mul_ps(Abs4(w[6 + r]), ez));
+            }
+
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (uint32_t i = 0; i < 6; i++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i][0]), center[0]),
+                    _mm_mul_ps(_mm_set1_ps(planes[i][1]), center[1])),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i][2]), center[2]), _mm_set1_ps(planes[i][3])));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(planes[i][0])), extent[0]),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(planes[i][1])), extent[1])),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(planes[i][2])), extent[2]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside)) & bounded;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                visible.push_back(static_cast<uint32_t>(a.handle[s + CountTrailingZeros(mask)]));
+            }
+        }
+        CullScalar(a, s, count - s, planes, visible);
+    }
+
+    TRANSFORM_TARGET_AVX2 __m256 Abs8(__m256 value)
+    {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), value);
+    }
+
+    // Same test as CullScalar, eight boxes per instruction
+    TRANSFORM_TARGET_AVX2 void CullAvx2(const CullArrays& a, uint32_t count, const float planes[6][4],
+        std::vector<uint32_t>& visible)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+
+        __m256 normal[6][3];
+        __m256 absNormal[6][3];
+        __m256 distance[6];
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                normal[i][j] = _mm256_set1_ps(planes[i][j]);
+                absNormal[i][j] = _mm256_set1_ps(std::fabs(planes[i][j]));
+            }
+            distance[i] = _mm256_set1_ps(planes[i][3]);
+        }
+
+        uint32_t s = 0;
+        for (; s + 8 <= count; s += 8)
+        {
+            uint32_t bounded = BoundsMask(a.hasBounds + s, 8);
+            if (bounded == 0)
+            {
+                continue;
+            }
+
+            __m256 w[12];
+            for (uint32_t k = 0; k < 12; k++)
+            {
+                w[k] = _mm256_loadu_ps(a.world[k] + s);
+            }
+            __m256 cx = _mm256_loadu_ps(a.center[0] + s);
+            __m256 cy = _mm256_loadu_ps(a.center[1] + s);
+            __m256 cz = _mm256_loadu_ps(a.center[2] + s);
+            __m256 ex = _mm256_loadu_ps(a.extent[0] + s);
+            __m256 ey = _mm256_loadu_ps(a.extent[1] + s);
+            __m256 ez = _mm256_loadu_ps(a.extent[2] + s);
+
+            __m256 center[3];
+            __m256 extent[3];
+            for (uint32_t r = 0; r < 3; r++)
+            {
+                center[r] = _mm256_fmadd_ps(w[r], cx, _mm256_fmadd_ps(w[3 + r], cy, _mm256_fmadd_ps(w[6 + r], cz, w[9 + r])));
+                extent[r] = _mm256_fmadd_ps(Abs8(w[r]), ex,
+                    _mm256_fmadd_ps(Abs8(w[3 + r]), ey, _mm256_mul_ps(Abs8(w[6 + r]), ez)));
+            }
+
+            __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+            for (uint32_t i = 0; i < 6; i++)
+            {
+                __m256 d = _mm256_fmadd_ps(normal[i][0], center[0],
+                    _mm256_fmadd_ps(normal[i][1], center[1], _mm256_fmadd_ps(normal[i][2], center[2], distance[i])));
+                __m256 radius = _mm256_fmadd_ps(absNormal[i][0], extent[0],
+                    _mm256_fmadd_ps(absNormal[i][1], extent[1], _mm256_mul_ps(absNormal[i][2], extent[2])));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, radius), zero, _CMP_GE_OQ));
+            }
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside)) & bounded;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                visible.push_back(static_cast<uint32_t>(a.handle[s + CountTrailingZeros(mask)]));
+            }
+        }
+        CullScalar(a, s, count - s, planes, visible);
+    }
+#endif
+}
+
+void TransformHierarchy::Slots::Resize(size_t count)
+{
+    for (FloatArray& array : position) { array.resize(count); }
+    for (FloatArray& array : rotation) { array.resize(count); }
+    for (FloatArray& array : scale) { array.resize(count); }
+    for (FloatArray& array : world) { array.resize(count); }
+    for (FloatArray& array : boundsCenter) { array.resize(count); }
+    for (FloatArray& array : boundsExtent) { array.resize(count); }
+    parent.resize(count);
+    handle.resize(count);
+    dirty.resize(count);
+    hasBounds.resize(count);
+}
+
+void TransformHierarchy::Slots::Reserve(size_t count)
+{
+    for (FloatArray& array : position) { array.reserve(count); }
+    for (FloatArray& array : rotation) { array.reserve(count); }
+    for (FloatArray& array : scale) { array.reserve(count); }
+    for (FloatArray& array : world) { array.reserve(count); }
+    for (FloatArray& array : boundsCenter) { array.reserve(count); }
+    for (FloatArray& array : boundsExtent) { array.reserve(count); }
+    parent.reserve(count);
+    handle.reserve(count);
+    dirty.reserve(count);
+    hasBounds.reserve(count);
+}
+
+TransformHierarchy::TransformHierarchy()
+    : m_Isa(DetectIsa())
+{
+}
+
+void TransformHierarchy::Reserve(uint32_t nodeCount)
+{
+    m_Slots.Reserve(nodeCount);
+    m_SlotOf.reserve(nodeCount);
+    m_ParentOf.reserve(nodeCount);
+    m_Depth.reserve(nodeCount);
+}
+
+void TransformHierarchy::Clear()
+{
+    m_Slots.Resize(0);
+    m_SlotOf.clear();
+    m_ParentOf.clear();
+    m_Depth.clear();
+    m_LevelStart.clear();
+    m_OrderDirty = false;
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent)
+{
+    assert(parent == NO_PARENT || parent < m_SlotOf.size());
+
+    uint32_t node = static_cast<uint32_t>(m_SlotOf.size());
+    uint32_t slot = node;
+    m_Slots.Resize(slot + 1);
+
+    static const float identity[12] = { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        m_Slots.position[i][slot] = 0.0f;
+        m_Slots.scale[i][slot] = 1.0f;
+        m_Slots.boundsCenter[i][slot] = 0.0f;
+        m_Slots.boundsExtent[i][slot] = 0.0f;
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        m_Slots.rotation[i][slot] = (i == 3) ? 1.0f : 0.0f;
+    }
+    for (uint32_t k = 0; k < 12; k++)
+    {
+        m_Slots.world[k][slot] = identity[k];
+    }
+    m_Slots.parent[slot] = (parent == NO_PARENT) ? -1 : static_cast<int32_t>(m_SlotOf[parent]);
+    m_Slots.handle[slot] = static_cast<int32_t>(node);
+    m_Slots.dirty[slot] = 1;
+    m_Slots.hasBounds[slot] = 0;
+
+    m_SlotOf.push_back(slot);
+    m_ParentOf.push_back(parent);
+    m_Depth.push_back(parent == NO_PARENT ? 0 : m_Depth[parent] + 1);
+
+    // Appended at the end, which breaks the level order unless it happens to be the deepest level
+    m_OrderDirty = true;
+    return node;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const float position[3], const float rotation[4], const float scale[3])
+{
+    uint32_t slot = m_SlotOf[node];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        m_Slots.position[i][slot] = position[i];
+        m_Slots.scale[i][slot] = scale[i];
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        m_Slots.rotation[i][slot] = rotation[i];
+    }
+    m_Slots.dirty[slot] = 1;
+}
+
+void TransformHierarchy::SetPosition(uint32_t node, const float position[3])
+{
+    uint32_t slot = m_SlotOf[node];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        m_Slots.position[i][slot] = position[i];
+    }
+    m_Slots.dirty[slot] = 1;
+}
+
+void TransformHierarchy::SetBounds(uint32_t node, const float center[3], const float extent[3])
+{
+    uint32_t slot = m_SlotOf[node];
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        m_Slots.boundsCenter[i][slot] = center[i];
+        m_Slots.boundsExtent[i][slot] = extent[i];
+    }
+    m_Slots.hasBounds[slot] = 1;
+}
+
+// Counting sort of the slots by depth. Handles are added parents first, so keeping their order
+// within a level is enough for every parent to come before its children.
+void TransformHierarchy::SortByLevel()
+{
+    uint32_t nodeCount = GetNodeCount();
+    uint32_t levelCount = 0;
+    for (uint32_t depth : m_Depth)
+    {
+        levelCount = std::max(levelCount, depth + 1);
+    }
+
+    m_LevelStart.assign(levelCount + 1, 0);
+    for (uint32_t depth : m_Depth)
+    {
+        m_LevelStart[depth + 1]++;
+    }
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        m_LevelStart[level + 1] += m_LevelStart[level];
+    }
+
+    std::vector<uint32_t> next(m_LevelStart.begin(), m_LevelStart.end() - 1);
+    std::vector<uint32_t> newSlotOf(nodeCount);
+    for (uint32_t node = 0; node < nodeCount; node++)
+    {
+        newSlotOf[node] = next[m_Depth[node]]++;
+    }
+
+    Slots sorted;
+    sorted.Resize(nodeCount);
+    for (uint32_t node = 0; node < nodeCount; node++)
+    {
+        uint32_t from = m_SlotOf[node];
+        uint32_t to = newSlotOf[node];
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            sorted.position[i][to] = m_Slots.position[i][from];
+            sorted.scale[i][to] = m_Slots.scale[i][from];
+            sorted.boundsCenter[i][to] = m_Slots.boundsCenter[i][from];
+            sorted.boundsExtent[i][to] = m_Slots.boundsExtent[i][from];
+        }
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            sorted.rotation[i][to] = m_Slots.rotation[i][from];
+        }
+        for (uint32_t k = 0; k < 12; k++)
+        {
+            sorted.world[k][to] = m_Slots.world[k][from];
+        }
+        sorted.parent[to] = (m_ParentOf[node] == NO_PARENT) ? -1 : static_cast<int32_t>(newSlotOf[m_ParentOf[node]]);
+        sorted.handle[to] = static_cast<int32_t>(node);
+        sorted.dirty[to] = m_Slots.dirty[from];
+        sorted.hasBounds[to] = m_Slots.hasBounds[from];
+    }
+
+    m_Slots = std::move(sorted);
+    m_SlotOf = std::move(newSlotOf);
+    m_OrderDirty = false;
+    m_Stats.reorders++;
+}
+
+// Parents come before their children, so one pass carries a flag down any number of levels
+void TransformHierarchy::PropagateDirty()
+{
+    uint32_t first = (m_LevelStart.size() > 1) ? m_LevelStart[1] : GetNodeCount();
+    uint8_t* dirty = m_Slots.dirty.data();
+    const int32_t* parent = m_Slots.parent.data();
+    for (uint32_t s = first; s < GetNodeCount(); s++)
+    {
+        dirty[s] |= dirty[parent[s]];
+    }
+}
+
+void TransformHierarchy::Update()
+{
+    auto start = KernelClock::now();
+
+    if (m_OrderDirty)
+    {
+        SortByLevel();
+    }
+    PropagateDirty();
+
+    for (uint32_t level = 0; level + 1 < m_LevelStart.size(); level++)
+    {
+        UpdateLevel(m_LevelStart[level], m_LevelStart[level + 1] - m_LevelStart[level], level > 0);
+    }
+    std::fill(m_Slots.dirty.begin(), m_Slots.dirty.end(), static_cast<uint8_t>(0));
+
+    m_Stats.updates++;
+    m_Stats.updateMs += MillisecondsSince(start);
+}
+
+// Runs of chunks that contain a dirty slot go to the SIMD kernel, clean chunks are skipped and
+// the slots after the last full chunk are done one by one. Clean lanes of a dirty chunk are
+// recomputed too, which gives the same result since neither they nor their parents changed.
+void TransformHierarchy::UpdateLevel(uint32_t first, uint32_t count, bool hasParent)
+{
+    UpdateArrays arrays;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        arrays.position[i] = m_Slots.position[i].data();
+        arrays.scale[i] = m_Slots.scale[i].data();
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        arrays.rotation[i] = m_Slots.rotation[i].data();
+    }
+    for (uint32_t k = 0; k < 12; k++)
+    {
+        arrays.world[k] = m_Slots.world[k].data();
+    }
+    arrays.parent = m_Slots.parent.data();
+
+    uint32_t width = 1;
+    void (*kernel)(const UpdateArrays&, uint32_t, uint32_t, bool) = UpdateScalar;
+#if TRANSFORM_HIERARCHY_SIMD
+    if (m_Isa == Isa::Avx2)
+    {
+        width = 8;
+        kernel = UpdateAvx2;
+    }
+    else if (m_Isa == Isa::Sse)
+    {
+        width = 4;
+        kernel = UpdateSse;
+    }
+#endif
+
+    const uint8_t* dirty = m_Slots.dirty.data();
+    uint32_t end = first + count;
+    uint32_t s = first;
+    while (s + width <= end)
+    {
+        if (!AnyDirty(dirty + s, width))
+        {
+            m_Stats.chunksSkipped++;
+            s += width;
+            continue;
+        }
+
+        uint32_t runStart = s;
+        while (s + width <= end && AnyDirty(dirty + s, width))
+        {
+            s += width;
+        }
+        kernel(arrays, runStart, s - runStart, hasParent);
+        m_Stats.nodesUpdated += s - runStart;
+    }
+    for (; s < end; s++)
+    {
+        if (dirty[s] != 0)
+        {
+            UpdateScalar(arrays, s, 1, hasParent);
+            m_Stats.nodesUpdated++;
+        }
+    }
+}
+
+uint32_t TransformHierarchy::Cull(const float planes[6][4], std::vector<uint32_t>& visible)
+{
+    auto start = KernelClock::now();
+
+    CullArrays arrays;
+    for (uint32_t k = 0; k < 12; k++)
+    {
+        arrays.world[k] = m_Slots.world[k].data();
+    }
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        arrays.center[i] = m_Slots.boundsCenter[i].data();
+        arrays.extent[i] = m_Slots.boundsExtent[i].data();
+    }
+    arrays.hasBounds = m_Slots.hasBounds.data();
+    arrays.handle = m_Slots.handle.data();
+
+    size_t before = visible.size();
+    visible.reserve(before + GetNodeCount());
+
+    switch (m_Isa)
+    {
+#if TRANSFORM_HIERARCHY_SIMD
+    case Isa::Avx2:
+        CullAvx2(arrays, GetNodeCount(), planes, visible);
+        break;
+    case Isa::Sse:
+        CullSse(arrays, GetNodeCount(), planes, visible);
+        break;
+#endif
+    default:
+        CullScalar(arrays, 0, GetNodeCount(), planes, visible);
+        break;
+    }
+
+    uint32_t visibleCount = static_cast<uint32_t>(visible.size() - before);
+    m_Stats.culls++;
+    m_Stats.nodesTested += GetNodeCount();
+    m_Stats.nodesVisible += visibleCount;
+    m_Stats.cullMs += MillisecondsSince(start);
+    return visibleCount;
+}
+
+void TransformHierarchy::GetWorldMatrix(uint32_t node, float matrix[16]) const
+{
+    uint32_t slot = m_SlotOf[node];
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        for (uint32_t r = 0; r < 3; r++)
+        {
+            matrix[c * 4 + r] = m_Slots.world[c * 3 + r][slot];
+        }
+        matrix[c * 4 + 3] = (c == 3) ? 1.0f : 0.0f;
+    }
+}
+
+void TransformHierarchy::SetIsa(Isa isa)
+{
+    m_Isa = std::min(isa, DetectIsa());
+}
+
+TransformHierarchy::Isa TransformHierarchy::DetectIsa()
+{
+#if TRANSFORM_HIERARCHY_SIMD
+    #ifdef _MSC_VER
+    // AVX2 and FMA in CPUID, and the OS saving the YMM registers (OSXSAVE and XCR0 bits 1 and 2)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (fma && osSavesYmm && avx2)
+        {
+            return Isa::Avx2;
+        }
+    }
+    #else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return Isa::Avx2;
+    }
+    #endif
+    return Isa::Sse;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+const char* TransformHierarchy::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::Scalar:   return "scalar";
+    case Isa::Sse:      return "SSE";
+    case Isa::Avx2:     return "AVX2";
+    }
+    return "unknown";
+}
+
+void TransformHierarchy::PrintStats(std::ostream& out) const
+{
+    if (m_Stats.updates == 0)
+    {
+        return;
+    }
+
+    out << std::fixed << std::setprecision(3)
+        << "Transform hierarchy (" << GetIsaName(m_Isa) << "): " << GetNodeCount() << " nodes in " << GetLevelCount()
+        << " levels, " << m_Stats.updates << " updates, " << m_Stats.nodesUpdated / m_Stats.updates
+        << " nodes recomputed and " << m_Stats.updateMs / m_Stats.updates << " ms per update, "
+        << m_Stats.chunksSkipped << " clean chunks skipped, " << m_Stats.reorders << " reorders\n";
+    if (m_Stats.culls > 0)
+    {
+        out << "  Cull: " << m_Stats.culls << " culls, " << m_Stats.cullMs / m_Stats.culls << " ms and "
+            << m_Stats.nodesVisible / m_Stats.culls << " of " << m_Stats.nodesTested / m_Stats.culls
+            << " nodes visible per cull\n";
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <iosfwd>
+#include <new>
+#include <vector>
+
+// SSE is part of x64, AVX2 is detected at runtime. Other architectures use the scalar kernels.
+#if defined(_M_X64) || defined(__x86_64__)
+    #define TRANSFORM_HIERARCHY_SIMD 1
+#else
+    #define TRANSFORM_HIERARCHY_SIMD 0
+#endif
+
+// Cache line alignment for the SoA arrays, so SIMD loads of a chunk never straddle two lines
+// more often than they have to and two arrays never share a line
+constexpr size_t TRANSFORM_ARRAY_ALIGNMENT = 64;
+
+template <typename T>
+struct CacheAlignedAllocator
+{
+    using value_type = T;
+
+    CacheAlignedAllocator() = default;
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(TRANSFORM_ARRAY_ALIGNMENT)));
+    }
+    void deallocate(T* pointer, size_t)
+    {
+        ::operator delete(pointer, std::align_val_t(TRANSFORM_ARRAY_ALIGNMENT));
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+// Scene graph transforms laid out for the CPU caches and SIMD units.
+//
+// Nodes are addressed by stable handles in the order they were added. Internally every
+// attribute (position, rotation quaternion, scale, the twelve floats of the affine world
+// matrix, parent, dirty flag) is its own contiguous array, and the arrays are sorted by
+// depth: all roots first, then their children, and so on. Each level only depends on the
+// levels before it, so Update is one linear pass over the arrays that computes 4 (SSE) or
+// 8 (AVX2) world matrices per instruction, gathering the parents' matrices by index.
+//
+// SetLocal marks a node dirty. Update first pushes dirty flags down to the children in a
+// linear pass, then only recomputes chunks that contain a dirty node, so moving one object
+// costs its subtree and not the whole scene.
+//
+// Cull tests the world space bounding boxes of the nodes that have bounds against six
+// frustum planes, 4 or 8 boxes at a time, and returns the handles of the visible ones.
+class TransformHierarchy
+{
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    enum class Isa
+    {
+        Scalar,
+        Sse,
+        Avx2
+    };
+
+    struct Stats
+    {
+        uint64_t    updates         = 0;
+        uint64_t    nodesUpdated    = 0;    // including clean lanes of dirty chunks
+        uint64_t    chunksSkipped   = 0;
+        uint64_t    reorders        = 0;    // level order rebuilt after nodes were added
+        uint64_t    culls           = 0;
+        uint64_t    nodesTested     = 0;
+        uint64_t    nodesVisible    = 0;
+        double      updateMs        = 0.0;
+        double      cullMs          = 0.0;
+    };
+
+    TransformHierarchy();
+
+    void Reserve(uint32_t nodeCount);
+    void Clear();
+
+    // Adds a node with an identity local transform. parent is NO_PARENT or a handle returned
+    // earlier, so handles are always topologically sorted.
+    uint32_t AddNode(uint32_t parent = NO_PARENT);
+
+    // rotation is a unit quaternion (x, y, z, w)
+    void SetLocal(uint32_t node, const float position[3], const float rotation[4], const float scale[3]);
+    void SetPosition(uint32_t node, const float position[3]);
+
+    // Local space bounding box, nodes without bounds are never returned by Cull
+    void SetBounds(uint32_t node, const float center[3], const float extent[3]);
+
+    // Recomputes the world matrices of dirty nodes and their descendants
+    void Update();
+
+    // Appends the handles of nodes whose world bounds intersect the frustum. A plane (a, b, c, d)
+    // keeps points with a*x + b*y + c*z + d >= 0, the normal does not have to be unit length.
+    // Call after Update. Returns the number of visible nodes.
+    uint32_t Cull(const float planes[6][4], std::vector<uint32_t>& visible);
+
+    // Column-major 4x4 world matrix of the last Update
+    void GetWorldMatrix(uint32_t node, float matrix[16]) const;
+
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_SlotOf.size()); }
+    uint32_t GetLevelCount() const { return m_LevelStart.empty() ? 0 : static_cast<uint32_t>(m_LevelStart.size() - 1); }
+
+    // Kernels default to the widest instruction set the CPU supports. SetIsa falls back to a
+    // narrower one the CPU does not support.
+    void SetIsa(Isa isa);
+    Isa GetIsa() const { return m_Isa; }
+    static Isa DetectIsa();
+    static const char* GetIsaName(Isa isa);
+
+    const Stats& GetStats() const { return m_Stats; }
+    void ResetStats() { m_Stats = Stats(); }
+    void PrintStats(std::ostream& out) const;
+
+private:
+    using FloatArray = std::vector<float, CacheAlignedAllocator<float>>;
+    using IndexArray = std::vector<int32_t, CacheAlignedAllocator<int32_t>>;
+    using FlagArray = std::vector<uint8_t, CacheAlignedAllocator<uint8_t>>;
+
+    // Attributes indexed by slot. The world matrix is stored column-major without its last
+    // row: m_World[column * 3 + row].
+    struct Slots
+    {
+        FloatArray  position[3];
+        FloatArray  rotation[4];
+        FloatArray  scale[3];
+        FloatArray  world[12];
+        FloatArray  boundsCenter[3];
+        FloatArray  boundsExtent[3];
+        IndexArray  parent;         // slot of the parent, -1 for roots
+        IndexArray  handle;         // handle stored in this slot
+        FlagArray   dirty;
+        FlagArray   hasBounds;
+
+        void Resize(size_t count);
+        void Reserve(size_t count);
+    };
+
+    void SortByLevel();
+    void PropagateDirty();
+    void UpdateLevel(uint32_t first, uint32_t count, bool hasParent);
+
+    Slots                   m_Slots;
+    std::vector<uint32_t>   m_SlotOf;           // indexed by handle
+    std::vector<uint32_t>   m_ParentOf;         // parent handle, indexed by handle
+    std::vector<uint32_t>   m_Depth;            // indexed by handle
+    std::vector<uint32_t>   m_LevelStart;       // first slot of every level, plus the slot count
+    bool                    m_OrderDirty        = false;
+
+    Isa                     m_Isa               = Isa::Scalar;
+    Stats                   m_Stats;
+};
@@ -0,0 +1,606 @@
+#include "UploadEngine.h"
+#include "CommandCapture.h"
+#include "VulkanDispatch.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t FindHostVisibleMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter)
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    // Every implementation has at least one host visible and coherent memory type
+    const VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type for the staging ring!");
+}
+
+void UploadEngine::Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+    VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, uint64_t ringSize,
+    const VkAllocationCallbacks* allocator)
+{
+    m_Device = device;
+    m_Dispatch = &dispatch;
+    m_Allocator = allocator;
+    m_TransferQueue = transferQueue;
+    m_TransferFamily = transferFamily;
+    m_GraphicsFamily = graphicsFamily;
+    m_RingSize = ringSize;
+    m_RingHead = 0;
+    m_RingTail = 0;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    // 16 bytes satisfies the 4 byte and texel size rules of buffer to image copies
+    m_CopyAlignment = std::max<uint64_t>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = m_TransferFamily;
+
+    if (m_Dispatch->vkCreateCommandPool(m_Device, &poolInfo, m_Allocator, &m_CommandPool) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create upload command pool!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_RingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (m_Dispatch->vkCreateBuffer(m_Device, &bufferInfo, m_Allocator, &m_RingBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create staging ring buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    m_Dispatch->vkGetBufferMemoryRequirements(m_Device, m_RingBuffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = FindHostVisibleMemoryType(physicalDevice, memRequirements.memoryTypeBits);
+
+    if (m_Dispatch->vkAllocateMemory(m_Device, &allocInfo, m_Allocator, &m_RingMemory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate staging ring memory!");
+    }
+
+    if (m_Dispatch->vkBindBufferMemory(m_Device, m_RingBuffer, m_RingMemory, 0) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to bind buffer memory!");
+    }
+
+    // Mapped once for the lifetime of the engine, coherent so no flushes are needed
+    void* mapped = nullptr;
+    if (m_Dispatch->vkMapMemory(m_Device, m_RingMemory, 0, m_RingSize, 0, &mapped) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to map staging ring memory!");
+    }
+    m_RingMapped = static_cast<uint8_t*>(mapped);
+}
+
+void UploadEngine::Destroy()
+{
+    if (m_Device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    for (auto& batch : m_Batches)
+    {
+        m_Dispatch->vkDestroyFence(m_Device, batch.fence, m_Allocator);
+        m_Dispatch->vkDestroySemaphore(m_Device, batch.semaphore, m_Allocator);
+    }
+    m_Batches.clear();
+    m_InFlight.clear();
+    m_AwaitingAcquire.clear();
+    m_Recording = NO_BATCH;
+
+    // Destroying the pool also frees the batches' command buffers
+    m_Dispatch->vkDestroyCommandPool(m_Device, m_CommandPool, m_Allocator);
+
+    if (m_RingMapped != nullptr)
+    {
+        m_Dispatch->vkUnmapMemory(m_Device, m_RingMemory);
+        m_RingMapped = nullptr;
+    }
+    m_Dispatch->vkDestroyBuffer(m_Device, m_RingBuffer, m_Allocator);
+    m_Dispatch->vkFreeMemory(m_Device, m_RingMemory, m_Allocator);
+
+    m_Device = VK_NULL_HANDLE;
+}
+
+UploadEngine::Batch& UploadEngine::GetRecordingBatch()
+{
+    if (m_Recording != NO_BATCH)
+    {
+        return m_Batches[m_Recording];
+    }
+
+    RetireCompletedBatches(false);
+
+    // A batch can be reused once the GPU is done with it and its semaphore was waited on
+    for (size_t i = 0; i < m_Batches.size() && m_Recording == NO_BATCH; i++)
+    {
+        if (!m_Batches[i].inFlight && !m_Batches[i].waitPending)
+        {
+            m_Recording = i;
+        }
+    }
+
+    if (m_Recording == NO_BATCH)
+    {
+        Batch batch;
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_CommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if (m_Dispatch->vkAllocateCommandBuffers(m_Device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS ||
+            m_Dispatch->vkCreateFence(m_Device, &fenceInfo, m_Allocator, &batch.fence) != VK_SUCCESS ||
+            m_Dispatch->vkCreateSemaphore(m_Device, &semaphoreInfo, m_Allocator, &batch.semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create upload batch!");
+        }
+
+        m_Batches.push_back(batch);
+        m_Recording = m_Batches.size() - 1;
+    }
+
+    Batch& batch = m_Batches[m_Recording];
+    batch.transfers.clear();
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (m_Dispatch->vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to begin recording upload command buffer!");
+    }
+
+    return batch;
+}
+
+// Returns the offset of size free bytes in the staging buffer. When the ring is full the
+// oldest batch is waited on; this only ever blocks the uploading thread, not rendering.
+uint64_t UploadEngine::AllocateStaging(uint64_t size)
+{
+    if (size > m_RingSize)
+    {
+        throw std::runtime_error("Upload is larger than the staging ring!");
+    }
+
+    for (;;)
+    {
+        // Nothing is owned by the GPU, so the whole ring is free
+        if (m_InFlight.empty() && m_Recording == NO_BATCH)
+        {
+            m_RingHead = AlignUp(m_RingHead, m_RingSize);
+            m_RingTail = m_RingHead;
+        }
+
+        uint64_t start = AlignUp(m_RingHead, m_CopyAlignment);
+
+        // A single copy never wraps around the end of the buffer
+        if (start % m_RingSize + size > m_RingSize)
+        {
+            start = AlignUp(start, m_RingSize);
+        }
+
+        if (start + size - m_RingTail <= m_RingSize)
+        {
+            m_RingHead = start + size;
+            return start % m_RingSize;
+        }
+
+        m_Stats.ringStalls++;
+        if (m_InFlight.empty())
+        {
+            // Only the batch being recorded holds staging space, submit it to free some
+            Flush();
+        }
+        RetireCompletedBatches(true);
+    }
+}
+
+void UploadEngine::RetireCompletedBatches(bool waitForOldest)
+{
+    while (!m_InFlight.empty())
+    {
+        Batch& batch = m_Batches[m_InFlight.front()];
+
+        if (waitForOldest)
+        {
+            m_Dispatch->vkWaitForFences(m_Device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+            waitForOldest = false;
+        }
+        else if (m_Dispatch->vkGetFenceStatus(m_Device, batch.fence) != VK_SUCCESS)
+        {
+            break;
+        }
+
+        m_RingTail = batch.ringEnd;
+        batch.inFlight = false;
+        m_InFlight.pop_front();
+    }
+}
+
+void UploadEngine::UploadBuffer(VkBuffer buffer, uint64_t offset, const void* data, uint64_t size, uint32_t dstStage, uint32_t dstAccess)
+{
+    // Big uploads go through the ring in pieces so they never need all of it at once
+    const uint64_t maxChunk = m_RingSize / 4;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    for (uint64_t done = 0; done < size; )
+    {
+        uint64_t chunk = std::min(size - done, maxChunk);
+        uint64_t stagingOffset = AllocateStaging(chunk);
+        std::memcpy(m_RingMapped + stagingOffset, bytes + done, static_cast<size_t>(chunk));
+        CaptureHostWrite(m_RingMapped + stagingOffset, static_cast<size_t>(chunk));
+
+        Batch& batch = GetRecordingBatch();
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = stagingOffset;
+        copyRegion.dstOffset = offset + done;
+        copyRegion.size = chunk;
+        m_Dispatch->vkCmdCopyBuffer(batch.commandBuffer, m_RingBuffer, buffer, 1, &copyRegion);
+
+        PendingTransfer transfer;
+        transfer.buffer = buffer;
+        transfer.offset = offset + done;
+        transfer.size = chunk;
+        transfer.dstStage = dstStage;
+        transfer.dstAccess = dstAccess;
+        batch.transfers.push_back(transfer);
+
+        done += chunk;
+        m_Stats.bufferCopies++;
+    }
+
+    m_Stats.bytesUploaded += size;
+}
+
+void UploadEngine::UploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, uint64_t size,
+    uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess)
+{
+    ImageLevel level;
+    level.size = size;
+    level.width = width;
+    level.height = height;
+    UploadImageLevels(image, data, &level, 1, finalLayout, dstStage, dstAccess);
+}
+
+void UploadEngine::UploadImageLevels(VkImage image, const void* data, const ImageLevel* levels, uint32_t levelCount,
+    uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess)
+{
+    // Like buffers, a mip chain goes through the ring in pieces: consecutive levels are packed
+    // into one staging allocation, each at the copy alignment, until a quarter of the ring is used
+    const uint64_t maxChunk = m_RingSize / 4;
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    for (uint32_t first = 0; first < levelCount; )
+    {
+        std::vector<ImageLevel> staged;
+        uint64_t stagingSize = 0;
+        for (uint32_t i = first; i < levelCount; i++)
+        {
+            const uint64_t end = AlignUp(stagingSize + levels[i].size, m_CopyAlignment);
+            if (!staged.empty() && end > maxChunk)
+            {
+                break;
+            }
+            staged.push_back(levels[i]);
+            staged.back().offset = stagingSize;
+            stagingSize = end;
+        }
+
+        const uint64_t stagingOffset = AllocateStaging(stagingSize);
+        for (size_t i = 0; i < staged.size(); i++)
+        {
+            std::memcpy(m_RingMapped + stagingOffset + staged[i].offset, bytes + levels[first + i].offset,
+                static_cast<size_t>(staged[i].size));
+            CaptureHostWrite(m_RingMapped + stagingOffset + staged[i].offset, static_cast<size_t>(staged[i].size));
+            m_Stats.bytesUploaded += staged[i].size;
+        }
+
+        const uint32_t count = static_cast<uint32_t>(staged.size());
+        RecordImageCopy(image, m_RingBuffer, stagingOffset, staged.data(), first, count, finalLayout, dstStage, dstAccess);
+        first += count;
+    }
+}
+
+void UploadEngine::CopyBuffer(VkBuffer buffer, uint64_t offset, VkBuffer source, uint64_t sourceOffset, uint64_t size,
+    uint32_t dstStage, uint32_t dstAccess)
+{
+    Batch& batch = GetRecordingBatch();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = sourceOffset;
+    copyRegion.dstOffset = offset;
+    copyRegion.size = size;
+    m_Dispatch->vkCmdCopyBuffer(batch.commandBuffer, source, buffer, 1, &copyRegion);
+
+    PendingTransfer transfer;
+    transfer.buffer = buffer;
+    transfer.offset = offset;
+    transfer.size = size;
+    transfer.dstStage = dstStage;
+    transfer.dstAccess = dstAccess;
+    batch.transfers.push_back(transfer);
+
+    m_Stats.bufferCopies++;
+    m_Stats.bytesUploaded += size;
+    m_Stats.bytesDirect += size;
+}
+
+void UploadEngine::CopyImageLevels(VkImage image, VkBuffer source, uint64_t sourceOffset, const ImageLevel* levels, uint32_t levelCount,
+    uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess)
+{
+    RecordImageCopy(image, source, sourceOffset, levels, 0, levelCount, finalLayout, dstStage, dstAccess);
+
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        m_Stats.bytesUploaded += levels[i].size;
+        m_Stats.bytesDirect += levels[i].size;
+    }
+}
+
+// Levels baseLevel to baseLevel + levelCount - 1, levels[0] being baseLevel
+void UploadEngine::RecordImageCopy(VkImage image, VkBuffer source, uint64_t sourceOffset, const ImageLevel* levels, uint32_t baseLevel,
+    uint32_t levelCount, uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess)
+{
+    Batch& batch = GetRecordingBatch();
+
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = baseLevel;
+    range.levelCount = levelCount;
+    range.layerCount = 1;
+
+    // The previous contents are discarded, so the image can start from an undefined layout
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = 0;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = image;
+    toTransfer.subresourceRange = range;
+
+    m_Dispatch->vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    std::vector<VkBufferImageCopy> regions(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset = sourceOffset + levels[i].offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = baseLevel + i;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { levels[i].width, levels[i].height, 1 };
+    }
+    m_Dispatch->vkCmdCopyBufferToImage(batch.commandBuffer, source, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        levelCount, regions.data());
+
+    PendingTransfer transfer;
+    transfer.image = image;
+    transfer.layout = finalLayout;
+    transfer.baseLevel = baseLevel;
+    transfer.levelCount = levelCount;
+    transfer.dstStage = dstStage;
+    transfer.dstAccess = dstAccess;
+    batch.transfers.push_back(transfer);
+
+    m_Stats.imageCopies++;
+}
+
+void UploadEngine::Flush()
+{
+    if (m_Recording == NO_BATCH)
+    {
+        return;
+    }
+
+    const size_t batchIndex = m_Recording;
+    Batch& batch = m_Batches[batchIndex];
+    const bool dedicated = UsesDedicatedQueue();
+
+    // With a dedicated transfer queue this is the release half of the ownership transfer:
+    // the destination access is performed by the acquire on the graphics queue.
+    // On a shared queue it is an ordinary barrier that makes the writes visible.
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags dstStages = 0;
+
+    for (const PendingTransfer& transfer : batch.transfers)
+    {
+        if (transfer.buffer != VK_NULL_HANDLE)
+        {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dedicated ? 0 : transfer.dstAccess;
+            barrier.srcQueueFamilyIndex = dedicated ? m_TransferFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = dedicated ? m_GraphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = transfer.buffer;
+            barrier.offset = transfer.offset;
+            barrier.size = transfer.size;
+            bufferBarriers.push_back(barrier);
+        }
+        else
+        {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dedicated ? 0 : transfer.dstAccess;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = static_cast<VkImageLayout>(transfer.layout);
+            barrier.srcQueueFamilyIndex = dedicated ? m_TransferFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = dedicated ? m_GraphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = transfer.image;
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, transfer.baseLevel, transfer.levelCount, 0, 1 };
+            imageBarriers.push_back(barrier);
+        }
+        dstStages |= transfer.dstStage;
+    }
+
+    m_Dispatch->vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        dedicated ? static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) : dstStages, 0, 0, nullptr,
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+    if (m_Dispatch->vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to record upload command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    if (dedicated)
+    {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.semaphore;
+    }
+
+    m_Dispatch->vkResetFences(m_Device, 1, &batch.fence);
+    if (m_Dispatch->vkQueueSubmit(m_TransferQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to submit upload command buffer!");
+    }
+
+    batch.ringEnd = m_RingHead;
+    batch.inFlight = true;
+    m_InFlight.push_back(batchIndex);
+
+    if (dedicated)
+    {
+        batch.waitPending = true;
+        m_AwaitingAcquire.push_back(batchIndex);
+    }
+    else
+    {
+        batch.transfers.clear();
+    }
+
+    m_Recording = NO_BATCH;
+    m_Stats.batches++;
+}
+
+void UploadEngine::RecordAcquireBarriers(VkCommandBuffer commandBuffer, GraphicsWaits& waits)
+{
+    if (m_AwaitingAcquire.empty())
+    {
+        return;
+    }
+
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags dstStages = 0;
+
+    for (size_t batchIndex : m_AwaitingAcquire)
+    {
+        Batch& batch = m_Batches[batchIndex];
+        VkPipelineStageFlags batchStages = 0;
+
+        // Must match the release barriers recorded in Flush()
+        for (const PendingTransfer& transfer : batch.transfers)
+        {
+            if (transfer.buffer != VK_NULL_HANDLE)
+            {
+                VkBufferMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = transfer.dstAccess;
+                barrier.srcQueueFamilyIndex = m_TransferFamily;
+                barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+                barrier.buffer = transfer.buffer;
+                barrier.offset = transfer.offset;
+                barrier.size = transfer.size;
+                bufferBarriers.push_back(barrier);
+            }
+            else
+            {
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = transfer.dstAccess;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = static_cast<VkImageLayout>(transfer.layout);
+                barrier.srcQueueFamilyIndex = m_TransferFamily;
+                barrier.dstQueueFamilyIndex = m_GraphicsFamily;
+                barrier.image = transfer.image;
+                barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, transfer.baseLevel, transfer.levelCount, 0, 1 };
+                imageBarriers.push_back(barrier);
+            }
+            batchStages |= transfer.dstStage;
+        }
+
+        waits.semaphores.push_back(batch.semaphore);
+        waits.stages.push_back(batchStages);
+        dstStages |= batchStages;
+
+        batch.waitPending = false;
+        batch.transfers.clear();
+    }
+    m_AwaitingAcquire.clear();
+
+    // The semaphore wait happens at dstStages, the acquire chains onto it at the same stages
+    m_Dispatch->vkCmdPipelineBarrier(commandBuffer, dstStages, dstStages, 0, 0, nullptr,
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void UploadEngine::WaitIdle()
+{
+    while (!m_InFlight.empty())
+    {
+        RetireCompletedBatches(true);
+    }
+}
+
+void UploadEngine::PrintStats() const
+{
+    std::cout << "Uploads: " << m_Stats.bytesUploaded << " bytes in " << m_Stats.bufferCopies << " buffer and "
+        << m_Stats.imageCopies << " image copies, " << m_Stats.batches << " batches, " << m_Stats.ringStalls << " staging stalls ("
+        << (UsesDedicatedQueue() ? "dedicated transfer queue" : "graphics queue") << ")\n";
+    if (m_Stats.bytesDirect > 0)
+    {
+        std::cout << "Uploads: " << m_Stats.bytesDirect << " bytes copied without staging\n";
+    }
+}
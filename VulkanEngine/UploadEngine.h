@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "VulkanFwd.h"
+
+struct VulkanDeviceDispatch;
+
+// Streams buffer and image data to the GPU on the transfer queue.
+//
+// Data is copied into a persistently mapped staging ring and the copies are batched
+// into one command buffer per Flush(). When the transfer queue belongs to its own
+// family the resources are released to the graphics family at the end of the batch;
+// the graphics side acquires them with RecordAcquireBarriers() and waits on the
+// semaphores it returns, so uploads overlap rendering instead of stalling it.
+class UploadEngine
+{
+public:
+    // Semaphores and stages the next graphics submission has to wait on
+    struct GraphicsWaits
+    {
+        std::vector<VkSemaphore>    semaphores;
+        std::vector<uint32_t>       stages;     // VkPipelineStageFlags
+
+        void Clear() { semaphores.clear(); stages.clear(); }
+    };
+
+    // One mip level of an image upload. offset is relative to the data or source offset
+    // passed along and has to be a multiple of the texel block size.
+    struct ImageLevel
+    {
+        uint64_t    offset  = 0;
+        uint64_t    size    = 0;
+        uint32_t    width   = 0;
+        uint32_t    height  = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t    bytesUploaded   = 0;
+        uint64_t    bufferCopies    = 0;
+        uint64_t    imageCopies     = 0;
+        uint64_t    batches         = 0;
+        uint64_t    ringStalls      = 0;    // times an upload had to wait for staging space
+        uint64_t    bytesDirect     = 0;    // copied from caller buffers without staging, part of bytesUploaded
+    };
+
+    void Create(VkPhysicalDevice physicalDevice, VkDevice device, const VulkanDeviceDispatch& dispatch,
+        VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, uint64_t ringSize,
+        const VkAllocationCallbacks* allocator);
+    void Destroy();
+
+    // dstStage and dstAccess describe the first use of the data on the graphics queue.
+    // Buffer uploads larger than the staging ring are split into several copies.
+    void UploadBuffer(VkBuffer buffer, uint64_t offset, const void* data, uint64_t size, uint32_t dstStage, uint32_t dstAccess);
+
+    // Uploads mip 0, layer 0 of a color image that is in an undefined layout and leaves it in finalLayout
+    void UploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, uint64_t size,
+        uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess);
+
+    // Uploads levels 0 to levelCount - 1 of layer 0. Levels go through the ring in groups, a
+    // single level still has to fit it.
+    void UploadImageLevels(VkImage image, const void* data, const ImageLevel* levels, uint32_t levelCount,
+        uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess);
+
+    // Copy from a buffer the transfer queue can read as it is, such as imported host memory,
+    // so the data skips the staging ring. The source has to stay alive until WaitIdle.
+    void CopyBuffer(VkBuffer buffer, uint64_t offset, VkBuffer source, uint64_t sourceOffset, uint64_t size,
+        uint32_t dstStage, uint32_t dstAccess);
+    void CopyImageLevels(VkImage image, VkBuffer source, uint64_t sourceOffset, const ImageLevel* levels, uint32_t levelCount,
+        uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess);
+
+    // Submits everything recorded since the last flush. Cheap when nothing is pending.
+    void Flush();
+
+    // Records the acquire half of every ownership transfer submitted so far into a graphics
+    // command buffer and adds the matching waits. Has to be called for every graphics
+    // submission so each batch semaphore is waited on exactly once.
+    void RecordAcquireBarriers(VkCommandBuffer commandBuffer, GraphicsWaits& waits);
+
+    // Blocks until every submitted batch has finished on the transfer queue
+    void WaitIdle();
+
+    bool UsesDedicatedQueue() const { return m_TransferFamily != m_GraphicsFamily; }
+    const Stats& GetStats() const { return m_Stats; }
+    void PrintStats() const;
+
+private:
+    // Barrier state shared by the release on the transfer queue and the acquire on the graphics queue
+    struct PendingTransfer
+    {
+        VkBuffer    buffer      = nullptr;
+        VkImage     image       = nullptr;
+        uint64_t    offset      = 0;
+        uint64_t    size        = 0;
+        uint32_t    layout      = 0;    // VkImageLayout after the transfer
+        uint32_t    baseLevel   = 0;
+        uint32_t    levelCount  = 1;
+        uint32_t    dstStage    = 0;
+        uint32_t    dstAccess   = 0;
+    };
+
+    struct Batch
+    {
+        VkCommandBuffer                 commandBuffer   = nullptr;
+        VkFence                         fence           = nullptr;
+        VkSemaphore                     semaphore       = nullptr;
+        uint64_t                        ringEnd         = 0;    // ring position after the batch's data
+        bool                            inFlight        = false;
+        bool                            waitPending     = false; // semaphore signaled but not yet waited on
+        std::vector<PendingTransfer>    transfers;
+    };
+
+    static constexpr size_t NO_BATCH = ~size_t(0);
+
+    Batch& GetRecordingBatch();
+    uint64_t AllocateStaging(uint64_t size);
+    void RetireCompletedBatches(bool waitForOldest);
+    void RecordImageCopy(VkImage image, VkBuffer source, uint64_t sourceOffset, const ImageLevel* levels, uint32_t baseLevel,
+        uint32_t levelCount, uint32_t finalLayout, uint32_t dstStage, uint32_t dstAccess);
+
+    VkDevice            m_Device            = nullptr;
+    const VulkanDeviceDispatch* m_Dispatch  = nullptr;
+    const VkAllocationCallbacks* m_Allocator = nullptr;
+    VkQueue             m_TransferQueue     = nullptr;
+    uint32_t            m_TransferFamily    = 0;
+    uint32_t            m_GraphicsFamily    = 0;
+    VkCommandPool       m_CommandPool       = nullptr;
+
+    // Staging ring. Positions grow forever and are wrapped with % m_RingSize when used,
+    // so head - tail is always the number of bytes still owned by the GPU.
+    VkBuffer            m_RingBuffer        = nullptr;
+    VkDeviceMemory      m_RingMemory        = nullptr;
+    uint8_t*            m_RingMapped        = nullptr;
+    uint64_t            m_RingSize          = 0;
+    uint64_t            m_RingHead          = 0;
+    uint64_t            m_RingTail          = 0;
+    uint64_t            m_CopyAlignment     = 16;
+
+    std::vector<Batch>  m_Batches;
+    size_t              m_Recording         = NO_BATCH;
+    std::deque<size_t>  m_InFlight;         // indices into m_Batches in submission order
+
+    // Submitted batches whose acquire has not been recorded on the graphics queue yet
+    std::vector<size_t> m_AwaitingAcquire;
+
+    Stats               m_Stats;
+};
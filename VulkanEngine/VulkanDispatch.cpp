@@ -0,0 +1,42 @@
+#include "VulkanDispatch.h"
+
+#include <stdexcept>
+#include <string>
+
+void VulkanInstanceDispatch::Load(VkInstance instance)
+{
+#define VULKAN_LOAD_REQUIRED(name) \
+    name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name)); \
+    if (name == nullptr) \
+    { \
+        throw std::runtime_error(std::string("Failed to load ") + #name + "!"); \
+    }
+#define VULKAN_LOAD_OPTIONAL(name) \
+    name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name));
+
+    VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOAD_REQUIRED)
+    VULKAN_INSTANCE_FUNCTIONS_OPTIONAL(VULKAN_LOAD_OPTIONAL)
+
+#undef VULKAN_LOAD_REQUIRED
+#undef VULKAN_LOAD_OPTIONAL
+}
+
+void VulkanDeviceDispatch::Load(VkDevice device, PFN_vkGetDeviceProcAddr getDeviceProcAddr)
+{
+    // vkGetDeviceProcAddr returns null for extensions the device was not created with,
+    // and for core functions newer than the device's API version
+#define VULKAN_LOAD_REQUIRED(name) \
+    name = reinterpret_cast<PFN_##name>(getDeviceProcAddr(device, #name)); \
+    if (name == nullptr) \
+    { \
+        throw std::runtime_error(std::string("Failed to load ") + #name + "!"); \
+    }
+#define VULKAN_LOAD_OPTIONAL(name) \
+    name = reinterpret_cast<PFN_##name>(getDeviceProcAddr(device, #name));
+
+    VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_REQUIRED)
+    VULKAN_DEVICE_FUNCTIONS_OPTIONAL(VULKAN_LOAD_OPTIONAL)
+
+#undef VULKAN_LOAD_REQUIRED
+#undef VULKAN_LOAD_OPTIONAL
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+// Unlike the other engine headers this one needs the function pointer types from vulkan.h.
+// It is only included by translation units that call into Vulkan anyway, and by the headers
+// of the objects that own an instance or a device and with it their tables.
+#include <vulkan/vulkan.h>
+
+// Function tables that call the driver directly.
+//
+// The functions exported by the loader are trampolines: they look up the dispatch table of
+// the handle they are given and jump through it. Pointers from vkGetDeviceProcAddr skip that
+// step (with validation enabled they point into the first layer instead of the driver).
+// The tables are filled once, right after the instance and the device are created, and
+// extension entry points are resolved at the same time instead of on every call.
+//
+// The lists below are X-macros: every entry becomes a member of the table and a lookup in
+// Load. Entries in the _OPTIONAL lists come from extensions or newer core versions and are
+// null when not available; the others are core 1.0 and their absence is an error.
+//
+// Each table belongs to the object that owns the instance or the device it was loaded for, and
+// the subsystems created for that device keep a reference to it. Several devices can live in
+// one process that way. Every device-level call the engine makes goes through the table, never
+// the loader exports, so CommandCapture can put its recording functions in it while it runs.
+
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+    X(vkDestroyInstance) \
+    X(vkEnumeratePhysicalDevices) \
+    X(vkEnumerateDeviceExtensionProperties) \
+    X(vkGetPhysicalDeviceProperties) \
+    X(vkGetPhysicalDeviceFeatures) \
+    X(vkGetPhysicalDeviceMemoryProperties) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties) \
+    X(vkCreateDevice) \
+    X(vkGetDeviceProcAddr)
+
+#define VULKAN_INSTANCE_FUNCTIONS_OPTIONAL(X) \
+    X(vkGetPhysicalDeviceProperties2) \
+    X(vkGetPhysicalDeviceFeatures2) \
+    X(vkGetPhysicalDeviceMemoryProperties2) \
+    X(vkDestroySurfaceKHR) \
+    X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+    X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+    X(vkCreateDebugUtilsMessengerEXT) \
+    X(vkDestroyDebugUtilsMessengerEXT)
+
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+    X(vkDestroyDevice) \
+    X(vkGetDeviceQueue) \
+    X(vkQueueSubmit) \
+    X(vkQueueWaitIdle) \
+    X(vkDeviceWaitIdle) \
+    X(vkCreateFence) \
+    X(vkDestroyFence) \
+    X(vkResetFences) \
+    X(vkGetFenceStatus) \
+    X(vkWaitForFences) \
+    X(vkCreateSemaphore) \
+    X(vkDestroySemaphore) \
+    X(vkAllocateMemory) \
+    X(vkFreeMemory) \
+    X(vkMapMemory) \
+    X(vkUnmapMemory) \
+    X(vkBindBufferMemory) \
+    X(vkBindImageMemory) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkGetImageMemoryRequirements) \
+    X(vkCreateBuffer) \
+    X(vkDestroyBuffer) \
+    X(vkCreateImage) \
+    X(vkDestroyImage) \
+    X(vkCreateImageView) \
+    X(vkDestroyImageView) \
+    X(vkCreateQueryPool) \
+    X(vkDestroyQueryPool) \
+    X(vkGetQueryPoolResults) \
+    X(vkCreatePipelineCache) \
+    X(vkDestroyPipelineCache) \
+    X(vkGetPipelineCacheData) \
+    X(vkCreateShaderModule) \
+    X(vkDestroyShaderModule) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkCreateComputePipelines) \
+    X(vkDestroyPipeline) \
+    X(vkCreatePipelineLayout) \
+    X(vkDestroyPipelineLayout) \
+    X(vkCreateSampler) \
+    X(vkDestroySampler) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateDescriptorPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkAllocateDescriptorSets) \
+    X(vkUpdateDescriptorSets) \
+    X(vkCreateRenderPass) \
+    X(vkDestroyRenderPass) \
+    X(vkCreateFramebuffer) \
+    X(vkDestroyFramebuffer) \
+    X(vkCreateCommandPool) \
+    X(vkDestroyCommandPool) \
+    X(vkResetCommandPool) \
+    X(vkAllocateCommandBuffers) \
+    X(vkFreeCommandBuffers) \
+    X(vkBeginCommandBuffer) \
+    X(vkEndCommandBuffer) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdSetViewport) \
+    X(vkCmdSetScissor) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdPushConstants) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdBindIndexBuffer) \
+    X(vkCmdDraw) \
+    X(vkCmdDrawIndexed) \
+    X(vkCmdDrawIndirect) \
+    X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDispatch) \
+    X(vkCmdCopyBuffer) \
+    X(vkCmdFillBuffer) \
+    X(vkCmdCopyBufferToImage) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdClearAttachments) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdEndQuery) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdWriteTimestamp) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdExecuteCommands)
+
+#define VULKAN_DEVICE_FUNCTIONS_OPTIONAL(X) \
+    X(vkGetBufferMemoryRequirements2) \
+    X(vkGetImageMemoryRequirements2) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroySwapchainKHR) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkAcquireNextImageKHR) \
+    X(vkQueuePresentKHR) \
+    X(vkCmdPipelineBarrier2) \
+    X(vkCmdPipelineBarrier2KHR) \
+    X(vkCmdDrawIndexedIndirectCount) \
+    X(vkCmdDrawIndexedIndirectCountKHR) \
+    X(vkGetMemoryHostPointerPropertiesEXT)
+
+#define VULKAN_DISPATCH_MEMBER(name) PFN_##name name = nullptr;
+
+struct VulkanInstanceDispatch
+{
+    VULKAN_INSTANCE_FUNCTIONS(VULKAN_DISPATCH_MEMBER)
+    VULKAN_INSTANCE_FUNCTIONS_OPTIONAL(VULKAN_DISPATCH_MEMBER)
+
+    // Throws if a core function is missing
+    void Load(VkInstance instance);
+};
+
+struct VulkanDeviceDispatch
+{
+    VULKAN_DEVICE_FUNCTIONS(VULKAN_DISPATCH_MEMBER)
+    VULKAN_DEVICE_FUNCTIONS_OPTIONAL(VULKAN_DISPATCH_MEMBER)
+
+    // Throws if a core function is missing
+    void Load(VkDevice device, PFN_vkGetDeviceProcAddr getDeviceProcAddr);
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+// Forward declarations of the Vulkan handles used in engine headers.
+// Only translation units that actually call into Vulkan include vulkan.h.
+
+struct VkInstance_T;
+typedef VkInstance_T* VkInstance;
+struct VkDebugUtilsMessengerEXT_T;
+typedef VkDebugUtilsMessengerEXT_T* VkDebugUtilsMessengerEXT;
+struct VkPhysicalDevice_T;
+typedef VkPhysicalDevice_T* VkPhysicalDevice;
+struct VkDevice_T;
+typedef VkDevice_T* VkDevice;
+struct VkQueue_T;
+typedef VkQueue_T* VkQueue;
+struct VkSurfaceKHR_T;
+typedef VkSurfaceKHR_T* VkSurfaceKHR;
+struct VkImage_T;
+typedef VkImage_T* VkImage;
+struct VkImageView_T;
+typedef VkImageView_T* VkImageView;
+struct VkDeviceMemory_T;
+typedef VkDeviceMemory_T* VkDeviceMemory;
+struct VkBuffer_T;
+typedef VkBuffer_T* VkBuffer;
+struct VkRenderPass_T;
+typedef VkRenderPass_T* VkRenderPass;
+struct VkFramebuffer_T;
+typedef VkFramebuffer_T* VkFramebuffer;
+struct VkCommandPool_T;
+typedef VkCommandPool_T* VkCommandPool;
+struct VkCommandBuffer_T;
+typedef VkCommandBuffer_T* VkCommandBuffer;
+struct VkFence_T;
+typedef VkFence_T* VkFence;
+struct VkSemaphore_T;
+typedef VkSemaphore_T* VkSemaphore;
+struct VkSwapchainKHR_T;
+typedef VkSwapchainKHR_T* VkSwapchainKHR;
+struct VkPipelineCache_T;
+typedef VkPipelineCache_T* VkPipelineCache;
+struct VkPipeline_T;
+typedef VkPipeline_T* VkPipeline;
+struct VkQueryPool_T;
+typedef VkQueryPool_T* VkQueryPool;
+struct VkShaderModule_T;
+typedef VkShaderModule_T* VkShaderModule;
+struct VkPipelineLayout_T;
+typedef VkPipelineLayout_T* VkPipelineLayout;
+struct VkDescriptorSetLayout_T;
+typedef VkDescriptorSetLayout_T* VkDescriptorSetLayout;
+struct VkDescriptorPool_T;
+typedef VkDescriptorPool_T* VkDescriptorPool;
+struct VkDescriptorSet_T;
+typedef VkDescriptorSet_T* VkDescriptorSet;
+struct VkSampler_T;
+typedef VkSampler_T* VkSampler;
+
+struct VkExtent2D;
+struct VkSurfaceCapabilitiesKHR;
+struct VkGraphicsPipelineCreateInfo;
+struct VkComputePipelineCreateInfo;
+struct VkMemoryRequirements;
+struct VkAllocationCallbacks;
@@ -1,21 +1,373 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 
 #include "HelloTriangleApplication.h"
+#include "JobBenchmark.h"
+#include "TransformBenchmark.h"
 
-int main() 
+static void PrintUsage(const char* executable)
 {
-    HelloTriangleApplication app;
+    std::cout << "Usage: " << executable << " [options]\n"
+        << "\t--headless          Render offscreen without a window or surface\n"
+        << "\t--no-content-wait   Headless: render placeholder frames while content loads\n"
+        << "\t--frames <n>        Number of frames to render before exiting\n"
+        << "\t--size <w>x<h>      Render target size\n"
+        << "\t--present-mode <m>  fifo, mailbox or immediate\n"
+        << "\t--frames-in-flight <n>  Frames the CPU may record ahead of the GPU (1-" << MAX_FRAMES_IN_FLIGHT << ")\n"
+        << "\t--readback          Copy every frame back to host memory (headless)\n"
+        << "\t--dump <file.ppm>   Write the last frame to a PPM image (implies --readback)\n"
+        << "\t--pipeline-cache <file>  Pipeline cache file (default pipeline_cache.bin)\n"
+        << "\t--no-pipeline-cache Do not load or save the pipeline cache\n"
+        << "\t--device <name|uuid> Use this device instead of the highest scoring one\n"
+        << "\t                    (also read from VULKAN_ENGINE_DEVICE)\n"
+        << "\t--trace <file.json> Write a Chrome trace and print zone percentiles at exit\n"
+        << "\t--no-host-allocator Let the driver use its default host allocator\n"
+        << "\t--no-bindless       Keep a bindless descriptor set per frame in flight even with descriptor indexing\n"
+        << "\t--worker-threads <n> Job system threads including the main thread (default one per core)\n"
+        << "\t--draw-items <n>    Size of the synthetic draw list (default 0)\n"
+        << "\t--scene-objects <n> Objects in the GPU-culled scene (default 0, off)\n"
+        << "\t--quantized-vertices Draw the scene from quantized vertices decoded in the vertex shader\n"
+        << "\t--shader-dir <dir>  Directory of the compiled shaders (default shaders)\n"
+        << "\t--frame-ring-kib <n> Initial per-frame uniform ring size in KiB (default 64, grows as needed)\n"
+        << "\t--asset-pack <file> Stream the meshes and textures of a pack written by AssetCooker\n"
+        << "\t--asset-budget-kib <n> Streamed bytes uploaded per frame in KiB (default 8192)\n"
+        << "\t--texture-budget-mib <n> Cap streamed texture memory in MiB (default: the heap budget)\n"
+        << "\t--job-benchmark     Measure job spawn and steal overhead and exit\n"
+        << "\t--dispatch-benchmark Measure loader trampoline against direct dispatch overhead and exit\n"
+        << "\t--transform-benchmark Time SIMD transform hierarchy updates and culling at 1M nodes and exit\n"
+        << "\t--gpu-profile <file.csv|file.json> Write per-scope GPU timings at exit\n"
+        << "\t--gpu-pipeline-stats Collect pipeline statistics for top level GPU scopes\n"
+        << "\t--render-graph-dump <file> Write the compiled render graph plan\n"
+        << "\t--capture <file>    Record the Vulkan calls of a frame range for CaptureReplay\n"
+        << "\t--capture-frames <first>[-<last>] Frames to capture (default 60)\n"
+        << "\t--debug-severity <s> Lowest validation message severity shown: error, warning or info\n"
+        << "\t--debug-types <list> Comma separated validation message types shown:\n"
+        << "\t                    general, validation, performance (default all)\n";
+}
 
-    try 
+static bool ParseDebugTypes(const char* list, uint32_t& types)
+{
+    types = 0;
+    std::string remaining = list;
+    while (!remaining.empty())
+    {
+        size_t comma = remaining.find(',');
+        std::string type = remaining.substr(0, comma);
+        remaining = (comma == std::string::npos) ? std::string() : remaining.substr(comma + 1);
+
+        if (type == "general")
+        {
+            types |= DEBUG_TYPE_GENERAL;
+        }
+        else if (type == "validation")
+        {
+            types |= DEBUG_TYPE_VALIDATION;
+        }
+        else if (type == "performance")
+        {
+            types |= DEBUG_TYPE_PERFORMANCE;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return types != 0;
+}
+
+static bool ParseArguments(int argc, char* argv[], EngineConfig& config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+
+        if (std::strcmp(arg, "--headless") == 0)
+        {
+            config.headless = true;
+        }
+        else if (std::strcmp(arg, "--no-content-wait") == 0)
+        {
+            config.waitForContent = false;
+        }
+        else if (std::strcmp(arg, "--frames") == 0 && hasValue)
+        {
+            config.frameCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--size") == 0 && hasValue)
+        {
+            unsigned long width = 0;
+            unsigned long height = 0;
+            char* end = nullptr;
+            width = std::strtoul(argv[++i], &end, 10);
+            if (end != nullptr && *end == 'x')
+            {
+                height = std::strtoul(end + 1, nullptr, 10);
+            }
+            if (width == 0 || height == 0)
+            {
+                std::cerr << "Invalid size: " << argv[i] << std::endl;
+                return false;
+            }
+            config.width = static_cast<uint32_t>(width);
+            config.height = static_cast<uint32_t>(height);
+        }
+        else if (std::strcmp(arg, "--present-mode") == 0 && hasValue)
+        {
+            const char* mode = argv[++i];
+            if (std::strcmp(mode, "fifo") == 0)
+            {
+                config.presentMode = PresentMode::Fifo;
+            }
+            else if (std::strcmp(mode, "mailbox") == 0)
+            {
+                config.presentMode = PresentMode::Mailbox;
+            }
+            else if (std::strcmp(mode, "immediate") == 0)
+            {
+                config.presentMode = PresentMode::Immediate;
+            }
+            else
+            {
+                std::cerr << "Invalid present mode: " << mode << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--frames-in-flight") == 0 && hasValue)
+        {
+            unsigned long framesInFlight = std::strtoul(argv[++i], nullptr, 10);
+            if (framesInFlight == 0 || framesInFlight > MAX_FRAMES_IN_FLIGHT)
+            {
+                std::cerr << "Invalid number of frames in flight: " << argv[i] << std::endl;
+                return false;
+            }
+            config.framesInFlight = static_cast<uint32_t>(framesInFlight);
+        }
+        else if (std::strcmp(arg, "--readback") == 0)
+        {
+            config.readback = true;
+        }
+        else if (std::strcmp(arg, "--dump") == 0 && hasValue)
+        {
+            config.readback = true;
+            config.dumpPath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--pipeline-cache") == 0 && hasValue)
+        {
+            config.pipelineCachePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--no-pipeline-cache") == 0)
+        {
+            config.pipelineCachePath.clear();
+        }
+        else if (std::strcmp(arg, "--device") == 0 && hasValue)
+        {
+            config.deviceOverride = argv[++i];
+        }
+        else if (std::strcmp(arg, "--trace") == 0 && hasValue)
+        {
+            config.tracePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--no-host-allocator") == 0)
+        {
+            config.hostAllocator = false;
+        }
+        else if (std::strcmp(arg, "--no-bindless") == 0)
+        {
+            config.bindless = false;
+        }
+        else if (std::strcmp(arg, "--worker-threads") == 0 && hasValue)
+        {
+            config.workerThreads = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--gpu-profile") == 0 && hasValue)
+        {
+            config.gpuProfilePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--gpu-pipeline-stats") == 0)
+        {
+            config.gpuPipelineStatistics = true;
+        }
+        else if (std::strcmp(arg, "--render-graph-dump") == 0 && hasValue)
+        {
+            config.renderGraphDumpPath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--capture") == 0 && hasValue)
+        {
+            config.capturePath = argv[++i];
+        }
+        else if (std::strcmp(arg, "--capture-frames") == 0 && hasValue)
+        {
+            char* end = nullptr;
+            unsigned long first = std::strtoul(argv[++i], &end, 10);
+            unsigned long last = first;
+            if (*end == '-')
+            {
+                last = std::strtoul(end + 1, &end, 10);
+            }
+            if (*end != '\0' || last < first || last > UINT32_MAX)
+            {
+                std::cerr << "Invalid capture frame range: " << argv[i] << std::endl;
+                return false;
+            }
+            config.captureFirstFrame = static_cast<uint32_t>(first);
+            config.captureLastFrame = static_cast<uint32_t>(last);
+        }
+        else if (std::strcmp(arg, "--debug-severity") == 0 && hasValue)
+        {
+            const char* severity = argv[++i];
+            if (std::strcmp(severity, "error") == 0)
+            {
+                config.debugSeverity = DebugSeverity::Error;
+            }
+            else if (std::strcmp(severity, "warning") == 0)
+            {
+                config.debugSeverity = DebugSeverity::Warning;
+            }
+            else if (std::strcmp(severity, "info") == 0)
+            {
+                config.debugSeverity = DebugSeverity::Info;
+            }
+            else
+            {
+                std::cerr << "Invalid debug severity: " << severity << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--debug-types") == 0 && hasValue)
+        {
+            if (!ParseDebugTypes(argv[++i], config.debugTypes))
+            {
+                std::cerr << "Invalid debug message types: " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--job-benchmark") == 0)
+        {
+            config.jobBenchmark = true;
+        }
+        else if (std::strcmp(arg, "--dispatch-benchmark") == 0)
+        {
+            config.dispatchBenchmark = true;
+        }
+        else if (std::strcmp(arg, "--transform-benchmark") == 0)
+        {
+            config.transformBenchmark = true;
+        }
+        else if (std::strcmp(arg, "--draw-items") == 0 && hasValue)
+        {
+            config.drawItems = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--scene-objects") == 0 && hasValue)
+        {
+            config.sceneObjects = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--quantized-vertices") == 0)
+        {
+            config.quantizedVertices = true;
+        }
+        else if (std::strcmp(arg, "--shader-dir") == 0 && hasValue)
+        {
+            config.shaderDirectory = argv[++i];
+        }
+        else if (std::strcmp(arg, "--frame-ring-kib") == 0 && hasValue)
+        {
+            unsigned long kib = std::strtoul(argv[++i], nullptr, 10);
+            if (kib == 0 || kib > 1024 * 1024)
+            {
+                std::cerr << "Invalid frame ring size: " << argv[i] << std::endl;
+                return false;
+            }
+            config.frameRingSize = static_cast<uint32_t>(kib * 1024);
+        }
+        else if (std::strcmp(arg, "--asset-pack") == 0 && hasValue)
+        {
+            config.assetPack = argv[++i];
+        }
+        else if (std::strcmp(arg, "--asset-budget-kib") == 0 && hasValue)
+        {
+            unsigned long kib = std::strtoul(argv[++i], nullptr, 10);
+            if (kib == 0 || kib > 1024 * 1024)
+            {
+                std::cerr << "Invalid asset upload budget: " << argv[i] << std::endl;
+                return false;
+            }
+            config.assetUploadBudget = static_cast<uint32_t>(kib * 1024);
+        }
+        else if (std::strcmp(arg, "--texture-budget-mib") == 0 && hasValue)
+        {
+            unsigned long mib = std::strtoul(argv[++i], nullptr, 10);
+            if (mib == 0 || mib > 1024 * 1024)
+            {
+                std::cerr << "Invalid texture budget: " << argv[i] << std::endl;
+                return false;
+            }
+            config.textureBudget = static_cast<uint64_t>(mib) * 1024 * 1024;
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    EngineConfig config;
+
+    // Lets a machine be pinned to one device without touching the command line
+    if (const char* device = std::getenv("VULKAN_ENGINE_DEVICE"))
+    {
+        config.deviceOverride = device;
+    }
+
+    if (!ParseArguments(argc, argv, config))
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Needs neither a window nor a GPU
+    if (config.jobBenchmark)
+    {
+        RunJobBenchmark(config.workerThreads, std::cout);
+        return EXIT_SUCCESS;
+    }
+    if (config.transformBenchmark)
+    {
+        RunTransformBenchmark(std::cout);
+        return EXIT_SUCCESS;
+    }
+
+    HelloTriangleApplication app(config);
+
+    try
     {
         app.run();
     }
-    catch (const std::exception& e) 
+    catch (const std::exception& e)
     {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
 
+    if (!config.tracePath.empty())
+    {
+#if ENGINE_PROFILING
+        if (Profiler::WriteChromeTrace(config.tracePath))
+        {
+            std::cout << "Trace written to " << config.tracePath << '\n';
+        }
+        Profiler::PrintSummary(std::cout);
+#else
+        std::cout << "Profiling is compiled out of this build, rebuild with ENGINE_PROFILING=1 for --trace\n";
+#endif
+    }
+
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
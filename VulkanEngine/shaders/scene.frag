@@ -0,0 +1,41 @@
+#version 450
+
+// Textures scene objects through the bindless table (set 1). The array sizes are the table's
+// capacities, passed as specialization constants.
+
+layout(constant_id = 0) const uint SAMPLED_IMAGE_CAPACITY = 1;
+layout(constant_id = 1) const uint SAMPLER_CAPACITY = 1;
+layout(constant_id = 2) const uint STORAGE_BUFFER_CAPACITY = 1;
+
+struct Material
+{
+    uint    textureIndex;
+    uint    samplerIndex;
+    float   uvScale;
+    uint    padding;
+};
+
+layout(set = 1, binding = 0) uniform texture2D textures[SAMPLED_IMAGE_CAPACITY];
+layout(set = 1, binding = 1) uniform sampler samplers[SAMPLER_CAPACITY];
+layout(std430, set = 1, binding = 2) readonly buffer Materials { Material materials[]; } buffers[STORAGE_BUFFER_CAPACITY];
+
+// Bindless index of the material table
+layout(push_constant) uniform DrawConstants
+{
+    uint    materialBuffer;
+};
+
+layout(location = 0) in vec3 inColor;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) flat in uint inMaterial;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // Every fragment of a draw belongs to the same object, so the indices are dynamically
+    // uniform and need neither nonuniformEXT nor the non-uniform indexing features
+    Material material = buffers[materialBuffer].materials[inMaterial];
+    vec3 texel = texture(sampler2D(textures[material.textureIndex], samplers[material.samplerIndex]), inUV * material.uvScale).rgb;
+    outColor = vec4(inColor * texel, 1.0);
+}
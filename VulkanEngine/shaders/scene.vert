@@ -0,0 +1,44 @@
+#version 450
+
+// Draws one GpuScene object. gl_InstanceIndex is the object index the cull shader
+// put into firstInstance.
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+struct Instance
+{
+    mat4    transform;
+    vec4    color;
+    uint    material;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Instances { Instance instances[]; };
+
+// Written to the frame ring every frame, bound with a dynamic offset
+layout(std140, set = 0, binding = 6) uniform FrameConstants
+{
+    mat4    viewProjection;
+    vec4    planes[6];
+    uint    objectCount;
+};
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) flat out uint outMaterial;
+
+void main()
+{
+    Instance instance = instances[gl_InstanceIndex];
+    gl_Position = viewProjection * (instance.transform * vec4(inPosition, 1.0));
+
+    // Objects are only scaled uniformly, so the normal can go through the same matrix
+    vec3 normal = normalize(mat3(instance.transform) * inNormal);
+    float light = max(dot(normal, normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    outColor = instance.color.rgb * (0.25 + 0.75 * light);
+
+    // Projected along the axis the face points at most, so each cube face gets the whole texture
+    vec3 axis = abs(inNormal);
+    outUV = (axis.x >= axis.y && axis.x >= axis.z ? inPosition.yz : axis.y >= axis.z ? inPosition.xz : inPosition.xy) + 0.5;
+    outMaterial = instance.material;
+}
@@ -0,0 +1,63 @@
+#version 450
+
+// scene.vert for QuantizedVertex (MeshFormat.h): positions are unorm fractions of the bounds
+// in the push constants, normals are folded onto the octahedron.
+
+layout(location = 0) in vec4 inPosition;    // w is the bitangent sign
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+struct Instance
+{
+    mat4    transform;
+    vec4    color;
+    uint    material;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Instances { Instance instances[]; };
+
+// Written to the frame ring every frame, bound with a dynamic offset
+layout(std140, set = 0, binding = 6) uniform FrameConstants
+{
+    mat4    viewProjection;
+    vec4    planes[6];
+    uint    objectCount;
+};
+
+// The first 16 bytes belong to scene.frag
+layout(push_constant) uniform VertexConstants
+{
+    layout(offset = 16) vec4 boundsMin;
+    vec4    boundsExtent;
+};
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out vec2 outUV;
+layout(location = 2) flat out uint outMaterial;
+
+vec3 DecodeOctahedral(vec2 oct)
+{
+    vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main()
+{
+    vec3 position = boundsMin.xyz + inPosition.xyz * boundsExtent.xyz;
+    vec3 modelNormal = DecodeOctahedral(inNormal);
+
+    Instance instance = instances[gl_InstanceIndex];
+    gl_Position = viewProjection * (instance.transform * vec4(position, 1.0));
+
+    // Objects are only scaled uniformly, so the normal can go through the same matrix
+    vec3 normal = normalize(mat3(instance.transform) * modelNormal);
+    float light = max(dot(normal, normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+    outColor = instance.color.rgb * (0.25 + 0.75 * light);
+
+    outUV = inUV;
+    outMaterial = instance.material;
+}